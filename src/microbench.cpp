@@ -0,0 +1,599 @@
+//
+// $Id$
+//
+
+//
+// Copyright (c) 2001-2014, Andrew Aksyonoff
+// Copyright (c) 2008-2014, Sphinx Technologies Inc
+// All rights reserved
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License. You should have
+// received a copy of the GPL license along with this program; if you
+// did not, you can find it at http://www.gnu.org/
+//
+
+#include "sphinx.h"
+#include "sphinxutils.h"
+#include "sphinxint.h"
+#include "sphinxjson.h"
+#include "sphinxexcerpt.h"
+#include <math.h>
+
+#define BENCH_INDEX_PATH		"microbench_tmp"
+#define BENCH_VOCABULARY		20000		// distinct synthetic keywords
+#define BENCH_DOC_WORDS			100			// keywords per document body
+#define BENCH_TITLE_WORDS		8			// keywords per document title
+#define BENCH_SEED				1234567
+
+/////////////////////////////////////////////////////////////////////////////
+// SYNTHETIC DATA
+/////////////////////////////////////////////////////////////////////////////
+
+/// log-uniform keyword pick, so that the head keywords occur in most documents and the tail is rare
+static int RandomWord ()
+{
+	double fRand = sphRand() / 4294967296.0;
+	return Min ( (int)pow ( (double)BENCH_VOCABULARY, fRand ) - 1, BENCH_VOCABULARY-1 );
+}
+
+
+static void GenerateText ( CSphVector<char> & dText, int iWords )
+{
+	dText.Resize ( 0 );
+	char sWord[16];
+	for ( int i=0; i<iWords; i++ )
+	{
+		int iLen = snprintf ( sWord, sizeof(sWord), i ? " w%d" : "w%d", RandomWord() );
+		memcpy ( dText.AddN ( iLen ), sWord, iLen );
+	}
+	dText.Add ( '\0' );
+}
+
+
+/// generates the documents on the fly
+class BenchSource_c : public CSphSource_Document
+{
+public:
+	BenchSource_c ( const CSphSchema & tSchema, int iDocs )
+		: CSphSource_Document ( "bench" )
+		, m_iDocs ( iDocs )
+	{
+		m_tSchema = tSchema;
+		m_dFields[0] = m_dFields[1] = NULL;
+	}
+
+	virtual BYTE ** NextDocument ( CSphString & )
+	{
+		if ( m_tDocInfo.m_uDocID>=(SphDocID_t)m_iDocs )
+		{
+			m_tDocInfo.m_uDocID = 0;
+			return NULL;
+		}
+
+		m_tDocInfo.m_uDocID++;
+		m_tDocInfo.SetAttr ( m_tSchema.GetAttr(0).m_tLocator, sphRand() % 100 );
+		m_tDocInfo.SetAttr ( m_tSchema.GetAttr(1).m_tLocator, sphRand() % 100000 );
+
+		GenerateText ( m_dTitle, BENCH_TITLE_WORDS );
+		GenerateText ( m_dBody, BENCH_DOC_WORDS );
+		m_dFields[0] = (BYTE*) m_dTitle.Begin();
+		m_dFields[1] = (BYTE*) m_dBody.Begin();
+		return m_dFields;
+	}
+
+	bool Connect ( CSphString & ) { return true; }
+	void Disconnect () {}
+	bool HasAttrsConfigured () { return true; }
+	bool IterateStart ( CSphString & ) { m_tDocInfo.Reset ( m_tSchema.GetRowSize() ); m_iPlainFieldsLength = m_tSchema.m_dFields.GetLength(); return true; }
+	bool IterateMultivaluedStart ( int, CSphString & ) { return false; }
+	bool IterateMultivaluedNext () { return false; }
+	bool IterateFieldMVAStart ( int, CSphString & ) { return false; }
+	bool IterateFieldMVANext () { return false; }
+	bool IterateKillListStart ( CSphString & ) { return false; }
+	bool IterateKillListNext ( SphDocID_t & ) { return false; }
+
+private:
+	int					m_iDocs;
+	CSphVector<char>	m_dTitle;
+	CSphVector<char>	m_dBody;
+	BYTE *				m_dFields[2];
+};
+
+
+static void DeleteIndexFiles ( const char * sIndex )
+{
+	const char * sExts[] = { "spa", "spd", "spe", "sph", "spi", "spk", "spl", "spm", "spp", "sps", "spds" };
+	CSphString sName;
+	for ( int i=0; i<(int)(sizeof(sExts)/sizeof(sExts[0])); i++ )
+	{
+		sName.SetSprintf ( "%s.%s", sIndex, sExts[i] );
+		unlink ( sName.cstr() );
+	}
+}
+
+
+/// build a plain index with default indexer settings, then load it for searching
+static CSphIndex * BuildBenchIndex ( int iDocs )
+{
+	CSphString sError;
+	CSphConfigSection hIndex;
+
+	CSphIndexSettings tSettings;
+	if ( !sphConfIndex ( hIndex, tSettings, sError ) )
+		sphDie ( "failed to setup index: %s", sError.cstr() );
+
+	CSphTokenizerSettings tTokSettings;
+	sphConfTokenizer ( hIndex, tTokSettings );
+	CSphDictSettings tDictSettings;
+	sphConfDictionary ( hIndex, tDictSettings );
+
+	ISphTokenizer * pTokenizer = ISphTokenizer::Create ( tTokSettings, NULL, sError );
+	if ( !pTokenizer )
+		sphDie ( "failed to create tokenizer: %s", sError.cstr() );
+
+	CSphDict * pDict = tDictSettings.m_bWordDict
+		? sphCreateDictionaryKeywords ( tDictSettings, NULL, pTokenizer, "bench", sError )
+		: sphCreateDictionaryCRC ( tDictSettings, NULL, pTokenizer, "bench", sError );
+	if ( !pDict )
+		sphDie ( "failed to create dictionary: %s", sError.cstr() );
+
+	CSphSchema tSchema;
+	CSphColumnInfo tCol;
+	tCol.m_sName = "title";
+	tSchema.m_dFields.Add ( tCol );
+	tCol.m_sName = "body";
+	tSchema.m_dFields.Add ( tCol );
+	tCol.m_sName = "gid";
+	tCol.m_eAttrType = SPH_ATTR_INTEGER;
+	tSchema.AddAttr ( tCol, true );
+	tCol.m_sName = "price";
+	tSchema.AddAttr ( tCol, true );
+
+	sphSrand ( BENCH_SEED );
+	BenchSource_c * pSrc = new BenchSource_c ( tSchema, iDocs );
+	pSrc->SetTokenizer ( pTokenizer );
+	pSrc->SetDict ( pDict );
+
+	CSphSourceSettings tSourceSettings;
+	pSrc->Setup ( tSourceSettings );
+
+	CSphVector<CSphSource*> dSources;
+	dSources.Add ( pSrc );
+
+	DeleteIndexFiles ( BENCH_INDEX_PATH );
+	CSphIndex * pBuild = sphCreateIndexPhrase ( "bench", BENCH_INDEX_PATH );
+	pBuild->SetTokenizer ( pTokenizer ); // index owns the pair from now on
+	pBuild->SetDictionary ( pDict );
+	pBuild->Setup ( tSettings );
+	if ( !pBuild->Build ( dSources, 256*1024*1024, 1024*1024 ) )
+		sphDie ( "failed to build index: %s", pBuild->GetLastError().cstr() );
+
+	SafeDelete ( pSrc );
+	SafeDelete ( pBuild );
+
+	CSphString sWarning;
+	CSphIndex * pIndex = sphCreateIndexPhrase ( "bench", BENCH_INDEX_PATH );
+	if ( !pIndex->Prealloc ( false, false, sWarning ) || !pIndex->Preread() )
+		sphDie ( "failed to load index: %s", pIndex->GetLastError().cstr() );
+
+	return pIndex;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// BENCHMARKS
+/////////////////////////////////////////////////////////////////////////////
+
+/// shared state, prepared once before running the benchmarks
+struct BenchEnv_t
+{
+	CSphIndex *				m_pIndex;
+	ISphTokenizer *			m_pTokenizer;
+	CSphVector<char>		m_dText;		///< long synthetic text, for the tokenizer
+	CSphVector<char>		m_dDoc;			///< document sized synthetic text, for the excerpts
+	CSphVector<BYTE>		m_dJsonSmall;	///< small object, searched linearly
+	CSphVector<BYTE>		m_dJsonLarge;	///< large object, searched using the key directory
+	CSphVector<CSphString>	m_dJsonKeys;
+
+	BenchEnv_t ()
+		: m_pIndex ( NULL )
+		, m_pTokenizer ( NULL )
+	{}
+
+	~BenchEnv_t ()
+	{
+		SafeDelete ( m_pIndex );
+		SafeDelete ( m_pTokenizer );
+	}
+};
+
+
+struct BenchDesc_t;
+typedef int64_t ( *BenchFunc_fn ) ( BenchEnv_t & tEnv, const BenchDesc_t & tDesc );
+
+/// one benchmark; returns the number of items (matches, tokens, lookups etc) processed per repetition
+struct BenchDesc_t
+{
+	const char *	m_sName;
+	BenchFunc_fn	m_fnBench;
+	const char *	m_sQuery;		///< full-text query, or the JSON object to search
+	ESphRankMode	m_eRanker;
+	const char *	m_sSortBy;		///< extended sort clause, or NULL for relevance
+	const char *	m_sGroupBy;		///< group-by attribute, or NULL
+};
+
+
+/// run a query against the synthetic index; items are the matches pushed into the sorter
+static int64_t BenchQuery ( BenchEnv_t & tEnv, const BenchDesc_t & tDesc )
+{
+	CSphQuery tQuery;
+	tQuery.m_sQuery = tDesc.m_sQuery;
+	tQuery.m_eMode = SPH_MATCH_EXTENDED2;
+	tQuery.m_eRanker = tDesc.m_eRanker;
+	if ( tDesc.m_eRanker==SPH_RANK_EXPR || tDesc.m_eRanker==SPH_RANK_EXPORT )
+		tQuery.m_sRankerExpr = "sum(lcs*user_weight)*1000+bm25";
+
+	if ( tDesc.m_sSortBy )
+	{
+		tQuery.m_eSort = SPH_SORT_EXTENDED;
+		tQuery.m_sSortBy = tDesc.m_sSortBy;
+	}
+
+	if ( tDesc.m_sGroupBy )
+	{
+		tQuery.m_eGroupFunc = SPH_GROUPBY_ATTR;
+		tQuery.m_sGroupBy = tDesc.m_sGroupBy;
+	}
+
+	// declared before the result, so that its rows go back while the arena is still current
+	CSphMatchArena tArena;
+	tArena.Start();
+
+	CSphQueryResult tResult;
+	CSphMultiQueryArgs tArgs ( KillListVector(), 1 );
+	SphQueueSettings_t tQueueSettings ( tQuery, tEnv.m_pIndex->GetMatchSchema(), tResult.m_sError, NULL );
+	tQueueSettings.m_bComputeItems = true;
+
+	ISphMatchSorter * pSorter = sphCreateQueue ( tQueueSettings );
+	if ( !pSorter )
+		sphDie ( "%s: failed to create sorter: %s", tDesc.m_sName, tResult.m_sError.cstr() );
+
+	if ( !tEnv.m_pIndex->MultiQuery ( &tQuery, &tResult, 1, &pSorter, tArgs ) )
+		sphDie ( "%s: query failed: %s", tDesc.m_sName, tResult.m_sError.cstr() );
+
+	SafeDelete ( pSorter );
+	return tResult.m_tStats.m_iPushedMatches;
+}
+
+
+static int64_t BenchTokenizer ( BenchEnv_t & tEnv, const BenchDesc_t & )
+{
+	int64_t iTokens = 0;
+	tEnv.m_pTokenizer->SetBuffer ( (BYTE*)tEnv.m_dText.Begin(), tEnv.m_dText.GetLength()-1 );
+	while ( tEnv.m_pTokenizer->GetToken() )
+		iTokens++;
+	return iTokens;
+}
+
+
+static int64_t BenchJsonFind ( BenchEnv_t & tEnv, const BenchDesc_t & tDesc )
+{
+	const CSphVector<BYTE> & dJson = strcmp ( tDesc.m_sQuery, "large" ) ? tEnv.m_dJsonSmall : tEnv.m_dJsonLarge;
+	int iKeys = strcmp ( tDesc.m_sQuery, "large" ) ? 8 : tEnv.m_dJsonKeys.GetLength();
+
+	const BYTE * pRoot = dJson.Begin();
+	ESphJsonType eRoot = sphJsonFindFirst ( &pRoot );
+
+	int64_t iFound = 0;
+	for ( int iPass=0; iPass<10000; iPass++ )
+	{
+		const CSphString & sKey = tEnv.m_dJsonKeys [ iPass % iKeys ];
+		const BYTE * p = pRoot;
+		if ( sphJsonFindByKey ( eRoot, &p, sKey.cstr(), sKey.Length(), sphJsonKeyMask ( sKey.cstr(), sKey.Length() ) )!=JSON_EOF )
+			iFound++;
+	}
+	return iFound;
+}
+
+
+static int64_t BenchExcerpt ( BenchEnv_t & tEnv, const BenchDesc_t & tDesc )
+{
+	ExcerptQuery_t tQuery;
+	tQuery.m_sWords = tDesc.m_sQuery;
+	tQuery.m_bHighlightQuery = true;
+
+	CSphString sError;
+	SnippetContext_t tCtx;
+	if ( !tCtx.Setup ( tEnv.m_pIndex, tQuery, sError ) )
+		sphDie ( "%s: failed to setup snippets: %s", tDesc.m_sName, sError.cstr() );
+
+	const int EXCERPTS = 100;
+	for ( int i=0; i<EXCERPTS; i++ )
+	{
+		tQuery.m_sSource = tEnv.m_dDoc.Begin();
+		tQuery.m_dRes.Resize ( 0 );
+
+		CSphString sWarning;
+		sphBuildExcerpt ( tQuery, tEnv.m_pIndex, tCtx.m_tStripper.Ptr(), tCtx.m_tExtQuery, tCtx.m_eExtQuerySPZ,
+			sWarning, sError, tCtx.m_pDict, tCtx.m_tTokenizer.Ptr(), tCtx.m_pQueryTokenizer );
+		if ( !sError.IsEmpty() )
+			sphDie ( "%s: failed to build excerpt: %s", tDesc.m_sName, sError.cstr() );
+	}
+	return EXCERPTS;
+}
+
+
+/// random docid to row lookups, as done for UPDATE rows, kill checks and lookup sorts; half of them miss
+static int64_t BenchDocidLookup ( BenchEnv_t & tEnv, const BenchDesc_t & )
+{
+	const int LOOKUPS = 100000;
+	DWORD uRange = 2*(DWORD)tEnv.m_pIndex->GetStats().m_iTotalDocuments;
+
+	for ( int i=0; i<LOOKUPS; i++ )
+		tEnv.m_pIndex->HasDocid ( 1 + sphRand() % uRange );
+	return LOOKUPS;
+}
+
+
+static const BenchDesc_t g_dBenchmarks[] =
+{
+	// doclist decoding and boolean operators, no hits needed
+	{ "doclist_frequent",		BenchQuery, "w0",				SPH_RANK_NONE, NULL, NULL },
+	{ "doclist_rare",			BenchQuery, "w5000",			SPH_RANK_NONE, NULL, NULL },
+	{ "and_2",					BenchQuery, "w0 w1",			SPH_RANK_NONE, NULL, NULL },
+	{ "and_4",					BenchQuery, "w0 w1 w2 w3",		SPH_RANK_NONE, NULL, NULL },
+	{ "or_2",					BenchQuery, "w0 | w1",			SPH_RANK_NONE, NULL, NULL },
+	{ "or_4",					BenchQuery, "w0 | w1 | w2 | w3", SPH_RANK_NONE, NULL, NULL },
+	{ "phrase_2",				BenchQuery, "\"w0 w1\"",		SPH_RANK_NONE, NULL, NULL },
+
+	// rankers, reading the hitlists too
+	{ "ranker_proximity_bm25",	BenchQuery, "w0 w1",			SPH_RANK_PROXIMITY_BM25, NULL, NULL },
+	{ "ranker_bm25",			BenchQuery, "w0 w1",			SPH_RANK_BM25, NULL, NULL },
+	{ "ranker_wordcount",		BenchQuery, "w0 w1",			SPH_RANK_WORDCOUNT, NULL, NULL },
+	{ "ranker_proximity",		BenchQuery, "w0 w1",			SPH_RANK_PROXIMITY, NULL, NULL },
+	{ "ranker_matchany",		BenchQuery, "w0 w1",			SPH_RANK_MATCHANY, NULL, NULL },
+	{ "ranker_fieldmask",		BenchQuery, "w0 w1",			SPH_RANK_FIELDMASK, NULL, NULL },
+	{ "ranker_sph04",			BenchQuery, "w0 w1",			SPH_RANK_SPH04, NULL, NULL },
+	{ "ranker_expr",			BenchQuery, "w0 w1",			SPH_RANK_EXPR, NULL, NULL },
+	{ "ranker_export",			BenchQuery, "w0 w1",			SPH_RANK_EXPORT, NULL, NULL },
+
+	// sorters, over a full scan
+	{ "sort_relevance",			BenchQuery, "",					SPH_RANK_NONE, NULL, NULL },
+	{ "sort_attr",				BenchQuery, "",					SPH_RANK_NONE, "price desc", NULL },
+	{ "sort_attr_2",			BenchQuery, "",					SPH_RANK_NONE, "gid asc, price desc", NULL },
+	{ "group_attr",				BenchQuery, "",					SPH_RANK_NONE, NULL, "gid" },
+	{ "group_attr_sorted",		BenchQuery, "",					SPH_RANK_NONE, "price desc", "gid" },
+
+	// misc hot paths
+	{ "tokenizer_utf8",			BenchTokenizer, NULL,			SPH_RANK_NONE, NULL, NULL },
+	{ "json_find_small",		BenchJsonFind, "small",			SPH_RANK_NONE, NULL, NULL },
+	{ "json_find_large",		BenchJsonFind, "large",			SPH_RANK_NONE, NULL, NULL },
+	{ "excerpt",				BenchExcerpt, "w0 w1",			SPH_RANK_NONE, NULL, NULL },
+	{ "excerpt_phrase",			BenchExcerpt, "\"w0 w1\" w2",	SPH_RANK_NONE, NULL, NULL },
+
+	// attribute storage
+	{ "docid_lookup",			BenchDocidLookup, NULL,			SPH_RANK_NONE, NULL, NULL }
+};
+
+
+static void ParseJson ( CSphVector<BYTE> & dBson, int iKeys )
+{
+	CSphString sJson = "{";
+	for ( int i=0; i<iKeys; i++ )
+		sJson.SetSprintf ( "%s%s\"key%d\":%d", sJson.cstr(), i ? "," : "", i, i );
+	sJson.SetSprintf ( "%s}", sJson.cstr() );
+
+	// parser needs two trailing zeroes
+	CSphVector<char> dSrc ( sJson.Length()+2 );
+	memcpy ( dSrc.Begin(), sJson.cstr(), sJson.Length() );
+	dSrc[sJson.Length()] = dSrc[sJson.Length()+1] = '\0';
+
+	CSphString sError;
+	if ( !sphJsonParse ( dBson, dSrc.Begin(), false, false, sError ) )
+		sphDie ( "failed to parse JSON: %s", sError.cstr() );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// HARNESS
+/////////////////////////////////////////////////////////////////////////////
+
+/// per-benchmark timing stats
+struct BenchResult_t
+{
+	const char *	m_sName;
+	int64_t			m_iItems;		///< items processed per repetition
+	int64_t			m_tmMin;
+	int64_t			m_tmMedian;
+	int64_t			m_tmMax;
+	double			m_fMean;
+	double			m_fStddev;
+};
+
+
+static void RunBenchmark ( BenchEnv_t & tEnv, const BenchDesc_t & tDesc, int iWarmup, int iReps, BenchResult_t & tRes )
+{
+	for ( int i=0; i<iWarmup; i++ )
+		tDesc.m_fnBench ( tEnv, tDesc );
+
+	CSphVector<int64_t> dTimes;
+	int64_t iItems = 0;
+	for ( int i=0; i<iReps; i++ )
+	{
+		int64_t tmStart = sphMicroTimer();
+		iItems = tDesc.m_fnBench ( tEnv, tDesc );
+		dTimes.Add ( Max ( sphMicroTimer()-tmStart, (int64_t)1 ) );
+	}
+	dTimes.Sort();
+
+	double fSum = 0.0;
+	ARRAY_FOREACH ( i, dTimes )
+		fSum += (double)dTimes[i];
+	double fMean = fSum / dTimes.GetLength();
+
+	double fVar = 0.0;
+	ARRAY_FOREACH ( i, dTimes )
+		fVar += ( dTimes[i]-fMean )*( dTimes[i]-fMean );
+
+	tRes.m_sName = tDesc.m_sName;
+	tRes.m_iItems = iItems;
+	tRes.m_tmMin = dTimes[0];
+	tRes.m_tmMedian = dTimes [ dTimes.GetLength()/2 ];
+	tRes.m_tmMax = dTimes.Last();
+	tRes.m_fMean = fMean;
+	tRes.m_fStddev = dTimes.GetLength()>1 ? sqrt ( fVar / ( dTimes.GetLength()-1 ) ) : 0.0;
+}
+
+
+static void FormatJson ( CSphStringBuilder & tOut, const CSphVector<BenchResult_t> & dResults, int iDocs, int iWarmup, int iReps )
+{
+	tOut.Appendf ( "{\n\"version\": \"%s\",\n\"docs\": %d,\n\"warmup\": %d,\n\"reps\": %d,\n\"benchmarks\": [\n",
+		SPHINX_VERSION, iDocs, iWarmup, iReps );
+
+	ARRAY_FOREACH ( i, dResults )
+	{
+		const BenchResult_t & tRes = dResults[i];
+		tOut.Appendf ( "\t{ \"name\": \"%s\", \"items\": "INT64_FMT", \"min_usec\": "INT64_FMT", \"median_usec\": "INT64_FMT
+			", \"mean_usec\": %.1f, \"stddev_usec\": %.1f, \"max_usec\": "INT64_FMT", \"items_per_sec\": %.1f }%s\n",
+			tRes.m_sName, tRes.m_iItems, tRes.m_tmMin, tRes.m_tmMedian, tRes.m_fMean, tRes.m_fStddev, tRes.m_tmMax,
+			(double)tRes.m_iItems*1000000.0/tRes.m_tmMedian, i+1<dResults.GetLength() ? "," : "" );
+	}
+	tOut += "]\n}\n";
+}
+
+
+int main ( int argc, char ** argv )
+{
+	//////////////////////
+	// parse command line
+	//////////////////////
+
+	#define OPT1(_a1)		else if ( !strcmp(argv[i],_a1) )
+
+	int iDocs = 100000;
+	int iReps = 10;
+	int iWarmup = 2;
+	const char * sFilter = NULL;
+	const char * sJsonFile = NULL;
+	bool bList = false;
+
+	int i;
+	for ( i=1; i<argc; i++ )
+	{
+		// handle argless options
+		if ( argv[i][0]!='-' ) break;
+		OPT1 ( "--list" )		{ bList = true; continue; }
+
+		// handle options with 1 arg
+		if ( (i+1)>=argc )		break;
+		OPT1 ( "--docs" )		iDocs = atoi ( argv[++i] );
+		OPT1 ( "--reps" )		iReps = atoi ( argv[++i] );
+		OPT1 ( "--warmup" )		iWarmup = atoi ( argv[++i] );
+		OPT1 ( "--filter" )		sFilter = argv[++i];
+		OPT1 ( "--json" )		sJsonFile = argv[++i];
+		else
+			break;
+	}
+
+	if ( i!=argc || iDocs<1 || iReps<1 || iWarmup<0 )
+	{
+		fprintf ( stdout, SPHINX_BANNER );
+		fprintf ( stdout,
+			"Usage: microbench [OPTIONS]\n"
+			"\n"
+			"Runs the engine micro-benchmarks over a synthetic index built on the fly.\n"
+			"\n"
+			"Options are:\n"
+			"--docs <N>\t\tdocuments in the synthetic index (default is 100000)\n"
+			"--reps <N>\t\ttimed repetitions per benchmark (default is 10)\n"
+			"--warmup <N>\t\tuntimed repetitions before the timed ones (default is 2)\n"
+			"--filter <SUBSTR>\tonly run the benchmarks with this substring in the name\n"
+			"--json <FILE>\t\talso write the results to FILE as JSON ('-' for stdout)\n"
+			"--list\t\t\tlist the benchmarks and exit\n"
+		);
+		return 1;
+	}
+
+	const int iBenchmarks = sizeof(g_dBenchmarks)/sizeof(g_dBenchmarks[0]);
+	if ( bList )
+	{
+		for ( int j=0; j<iBenchmarks; j++ )
+			fprintf ( stdout, "%s\n", g_dBenchmarks[j].m_sName );
+		return 0;
+	}
+
+	FILE * fpJson = NULL;
+	if ( sJsonFile && strcmp ( sJsonFile, "-" ) )
+	{
+		fpJson = fopen ( sJsonFile, "w" );
+		if ( !fpJson )
+			sphDie ( "failed to open %s: %s", sJsonFile, strerror(errno) );
+	}
+
+	//////////////////////
+	// prepare the data
+	//////////////////////
+
+	char cTopOfMainStack;
+	sphThreadInit();
+	MemorizeStack ( &cTopOfMainStack );
+
+	if ( !sphInitMatchArena() )
+		sphDie ( "failed to init match arena" );
+
+	BenchEnv_t tEnv;
+
+	int64_t tmBuild = sphMicroTimer();
+	tEnv.m_pIndex = BuildBenchIndex ( iDocs );
+	tmBuild = sphMicroTimer() - tmBuild;
+
+	tEnv.m_pTokenizer = sphCreateUTF8Tokenizer();
+	sphSrand ( BENCH_SEED );
+	GenerateText ( tEnv.m_dText, 200000 );
+	GenerateText ( tEnv.m_dDoc, 2000 );
+
+	for ( int j=0; j<64; j++ )
+		tEnv.m_dJsonKeys.Add().SetSprintf ( "key%d", j );
+	ParseJson ( tEnv.m_dJsonSmall, 8 );
+	ParseJson ( tEnv.m_dJsonLarge, tEnv.m_dJsonKeys.GetLength() );
+
+	if ( !sJsonFile || fpJson )
+		fprintf ( stdout, "built %d docs index in %d.%03d sec; %d warmup, %d timed repetition(s)\n\n",
+			iDocs, (int)( tmBuild/1000000 ), (int)( ( tmBuild%1000000 )/1000 ), iWarmup, iReps );
+
+	/////////
+	// run
+	/////////
+
+	CSphVector<BenchResult_t> dResults;
+	for ( int j=0; j<iBenchmarks; j++ )
+	{
+		const BenchDesc_t & tDesc = g_dBenchmarks[j];
+		if ( sFilter && !strstr ( tDesc.m_sName, sFilter ) )
+			continue;
+
+		BenchResult_t & tRes = dResults.Add();
+		RunBenchmark ( tEnv, tDesc, iWarmup, iReps, tRes );
+
+		if ( !sJsonFile || fpJson )
+			fprintf ( stdout, "%-24s median %8d.%03d msec, stddev %8.3f msec, "INT64_FMT" items, %.1f items/sec\n",
+				tRes.m_sName, (int)( tRes.m_tmMedian/1000 ), (int)( tRes.m_tmMedian%1000 ), tRes.m_fStddev/1000.0,
+				tRes.m_iItems, (double)tRes.m_iItems*1000000.0/tRes.m_tmMedian );
+	}
+
+	if ( sJsonFile )
+	{
+		CSphStringBuilder tJson;
+		FormatJson ( tJson, dResults, iDocs, iWarmup, iReps );
+		fputs ( tJson.cstr(), fpJson ? fpJson : stdout );
+		if ( fpJson )
+			fclose ( fpJson );
+	}
+
+	SafeDelete ( tEnv.m_pIndex );
+	DeleteIndexFiles ( BENCH_INDEX_PATH );
+	return 0;
+}
+
+//
+// $Id$
+//
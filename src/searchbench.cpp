@@ -0,0 +1,834 @@
+//
+// $Id$
+//
+
+//
+// Copyright (c) 2001-2014, Andrew Aksyonoff
+// Copyright (c) 2008-2014, Sphinx Technologies Inc
+// All rights reserved
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License. You should have
+// received a copy of the GPL license along with this program; if you
+// did not, you can find it at http://www.gnu.org/
+//
+
+#include "sphinx.h"
+#include "sphinxutils.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#if USE_WINDOWS
+	#include <winsock2.h>
+
+	#define sphSockRecv(_sock,_buf,_len)	::recv(_sock,_buf,_len,0)
+	#define sphSockSend(_sock,_buf,_len)	::send(_sock,_buf,_len,0)
+	#define sphSockClose(_sock)				::closesocket(_sock)
+#else
+	#include <unistd.h>
+	#include <netinet/in.h>
+	#include <netinet/tcp.h>
+	#include <arpa/inet.h>
+	#include <sys/socket.h>
+	#include <netdb.h>
+
+	#ifndef MSG_NOSIGNAL
+	#define MSG_NOSIGNAL 0
+	#endif
+
+	#define sphSockRecv(_sock,_buf,_len)	::recv(_sock,_buf,_len,MSG_NOSIGNAL)
+	#define sphSockSend(_sock,_buf,_len)	::send(_sock,_buf,_len,MSG_NOSIGNAL)
+	#define sphSockClose(_sock)				::close(_sock)
+#endif
+
+#define SPHINXAPI_PORT			9312
+#define SPHINXQL_PORT			9306
+
+// API protocol bits we need (see searchd.cpp)
+#define SEARCHD_COMMAND_PERSIST		4
+#define SEARCHD_COMMAND_SPHINXQL	8
+#define VER_COMMAND_SPHINXQL		0x100
+#define SEARCHD_OK					0
+#define SEARCHD_WARNING				3
+
+// MySQL protocol bits we need
+#define MYSQL_COM_QUIT				1
+#define MYSQL_COM_QUERY				3
+#define MYSQL_CLIENT_CAPS			( 0x0001 | 0x0200 | 0x8000 | 0x20000 ) // long password, 4.1 protocol, secure auth, multi results
+#define MYSQL_MORE_RESULTS			0x0008
+
+/////////////////////////////////////////////////////////////////////////////
+// QUERY LOG
+/////////////////////////////////////////////////////////////////////////////
+
+/// extract the statement from a query log line
+/// accepts query_log_format=sphinxql lines, and plain one-statement-per-line files
+static bool ExtractStatement ( const char * sLine, CSphString & sStmt )
+{
+	const char * p = sLine;
+	while ( sphIsSpace(*p) )
+		p++;
+	if ( !*p || *p=='#' )
+		return false;
+
+	// skip the "/* time conn real wall found */" header
+	if ( p[0]=='/' && p[1]=='*' )
+	{
+		p = strstr ( p, "*/" );
+		if ( !p )
+			return false;
+		p += 2;
+		while ( sphIsSpace(*p) )
+			p++;
+	}
+
+	// failed queries are logged with the error; do not replay them
+	if ( strstr ( p, " # error=" ) )
+		return false;
+
+	// cut off the trailing "; /* counters */" comment, and the semicolon
+	const char * pEnd = strstr ( p, "; /*" );
+	if ( !pEnd )
+		pEnd = p + strlen(p);
+	while ( pEnd>p && ( sphIsSpace ( pEnd[-1] ) || pEnd[-1]==';' ) )
+		pEnd--;
+
+	if ( pEnd==p )
+		return false;
+
+	sStmt.SetBinary ( p, pEnd-p );
+	return true;
+}
+
+
+static bool LoadQueries ( const char * sFile, CSphVector<CSphString> & dQueries, CSphString & sError )
+{
+	FILE * fp = fopen ( sFile, "rb" );
+	if ( !fp )
+	{
+		sError.SetSprintf ( "failed to open %s: %s", sFile, strerror(errno) );
+		return false;
+	}
+
+	CSphVector<char> dLine;
+	CSphString sStmt;
+	for ( ;; )
+	{
+		int c = fgetc ( fp );
+		if ( c!=EOF && c!='\n' )
+		{
+			dLine.Add ( (char)c );
+			continue;
+		}
+
+		dLine.Add ( '\0' );
+		if ( ExtractStatement ( dLine.Begin(), sStmt ) )
+			dQueries.Add ( sStmt );
+		dLine.Resize ( 0 );
+
+		if ( c==EOF )
+			break;
+	}
+	fclose ( fp );
+
+	if ( !dQueries.GetLength() )
+	{
+		sError.SetSprintf ( "no queries found in %s", sFile );
+		return false;
+	}
+	return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// CONNECTIONS
+/////////////////////////////////////////////////////////////////////////////
+
+/// one client connection to searchd
+class BenchConn_c
+{
+public:
+	explicit BenchConn_c ( const sockaddr_in & tAddr )
+		: m_tAddr ( tAddr )
+		, m_iSock ( -1 )
+	{}
+
+	virtual ~BenchConn_c ()
+	{
+		Close();
+	}
+
+	/// (re)connect and perform the protocol handshake
+	virtual bool Connect ( CSphString & sError ) = 0;
+
+	/// run one statement, count the result rows
+	virtual bool Query ( const CSphString & sQuery, int64_t & iRows, CSphString & sError ) = 0;
+
+	bool IsConnected () const
+	{
+		return m_iSock>=0;
+	}
+
+	void Close ()
+	{
+		if ( m_iSock>=0 )
+			sphSockClose ( m_iSock );
+		m_iSock = -1;
+	}
+
+protected:
+	sockaddr_in		m_tAddr;
+	int				m_iSock;
+
+protected:
+	bool OpenSocket ( CSphString & sError )
+	{
+		Close();
+		m_iSock = (int) socket ( AF_INET, SOCK_STREAM, 0 );
+		if ( m_iSock<0 )
+		{
+			sError.SetSprintf ( "socket() failed: %s", strerror(errno) );
+			return false;
+		}
+
+		if ( connect ( m_iSock, (const sockaddr *)&m_tAddr, sizeof(m_tAddr) )<0 )
+		{
+			sError.SetSprintf ( "connect() failed: %s", strerror(errno) );
+			Close();
+			return false;
+		}
+
+		int iOn = 1;
+		setsockopt ( m_iSock, IPPROTO_TCP, TCP_NODELAY, (char*)&iOn, sizeof(iOn) );
+		return true;
+	}
+
+	bool SendAll ( const BYTE * pBuf, int iLen, CSphString & sError )
+	{
+		while ( iLen>0 )
+		{
+			int iRes = sphSockSend ( m_iSock, (const char *)pBuf, iLen );
+			if ( iRes<0 && errno==EINTR )
+				continue;
+			if ( iRes<=0 )
+			{
+				sError.SetSprintf ( "send() failed: %s", iRes<0 ? strerror(errno) : "connection closed" );
+				Close();
+				return false;
+			}
+			pBuf += iRes;
+			iLen -= iRes;
+		}
+		return true;
+	}
+
+	bool RecvAll ( BYTE * pBuf, int iLen, CSphString & sError )
+	{
+		while ( iLen>0 )
+		{
+			int iRes = sphSockRecv ( m_iSock, (char *)pBuf, iLen );
+			if ( iRes<0 && errno==EINTR )
+				continue;
+			if ( iRes<=0 )
+			{
+				sError.SetSprintf ( "recv() failed: %s", iRes<0 ? strerror(errno) : "connection closed" );
+				Close();
+				return false;
+			}
+			pBuf += iRes;
+			iLen -= iRes;
+		}
+		return true;
+	}
+
+	/// read next MySQL packet of the result (from the socket or from an already received reply)
+	virtual bool ReadPacket ( CSphVector<BYTE> & dPacket, CSphString & sError ) = 0;
+
+	/// walk the MySQL result set(s), count the rows
+	bool ReadResult ( int64_t & iRows, CSphString & sError )
+	{
+		CSphVector<BYTE> dPacket;
+		iRows = 0;
+
+		for ( ;; )
+		{
+			if ( !ReadPacket ( dPacket, sError ) )
+				return false;
+			if ( !dPacket.GetLength() )
+			{
+				sError = "empty packet in reply";
+				return false;
+			}
+
+			// OK packet, eg. for SET or an empty query; we do not send multi-statements, so we are done
+			if ( dPacket[0]==0x00 )
+				return true;
+
+			if ( dPacket[0]==0xff )
+				return PacketError ( dPacket, sError );
+
+			// result set; column definitions up to EOF, then rows up to EOF
+			for ( int iEofs=0; iEofs<2; )
+			{
+				if ( !ReadPacket ( dPacket, sError ) )
+					return false;
+				if ( dPacket.GetLength() && dPacket[0]==0xff )
+					return PacketError ( dPacket, sError );
+
+				if ( dPacket.GetLength()<9 && dPacket.GetLength() && dPacket[0]==0xfe )
+					iEofs++;
+				else if ( iEofs )
+					iRows++;
+			}
+
+			// EOF carries the status flags; go on if there is another result set
+			int iStatus = dPacket.GetLength()>=5 ? ( dPacket[3] | ( dPacket[4]<<8 ) ) : 0;
+			if ( !( iStatus & MYSQL_MORE_RESULTS ) )
+				return true;
+		}
+	}
+
+	static bool PacketError ( const CSphVector<BYTE> & dPacket, CSphString & sError )
+	{
+		// 0xff, error code (2 bytes), '#' and sqlstate (5 bytes), message
+		int iSkip = ( dPacket.GetLength()>3 && dPacket[3]=='#' ) ? 9 : 3;
+		if ( dPacket.GetLength()>iSkip )
+			sError.SetBinary ( (const char *)dPacket.Begin()+iSkip, dPacket.GetLength()-iSkip );
+		else
+			sError = "error packet in reply";
+		return false;
+	}
+};
+
+
+/// SphinxQL (MySQL protocol) connection
+class SqlConn_c : public BenchConn_c
+{
+public:
+	explicit SqlConn_c ( const sockaddr_in & tAddr )
+		: BenchConn_c ( tAddr )
+	{}
+
+	virtual ~SqlConn_c ()
+	{
+		if ( IsConnected() )
+		{
+			BYTE dQuit[5] = { 1, 0, 0, 0, MYSQL_COM_QUIT };
+			CSphString sError;
+			SendAll ( dQuit, sizeof(dQuit), sError );
+		}
+	}
+
+	virtual bool Connect ( CSphString & sError )
+	{
+		if ( !OpenSocket ( sError ) )
+			return false;
+
+		// server greeting
+		CSphVector<BYTE> dPacket;
+		if ( !ReadPacket ( dPacket, sError ) )
+			return false;
+		if ( dPacket.GetLength() && dPacket[0]==0xff )
+		{
+			Close();
+			return PacketError ( dPacket, sError );
+		}
+
+		// handshake response; searchd does not check the credentials
+		CSphVector<BYTE> dAuth;
+		DWORD uCaps = MYSQL_CLIENT_CAPS;
+		DWORD uMaxPacket = 16777216;
+		for ( int i=0; i<4; i++ )
+			dAuth.Add ( (BYTE)( uCaps>>(8*i) ) );
+		for ( int i=0; i<4; i++ )
+			dAuth.Add ( (BYTE)( uMaxPacket>>(8*i) ) );
+		dAuth.Add ( 33 ); // utf8_general_ci
+		for ( int i=0; i<23; i++ )
+			dAuth.Add ( 0 );
+		const char * sUser = "root";
+		for ( const char * s = sUser; *s; s++ )
+			dAuth.Add ( *s );
+		dAuth.Add ( 0 ); // user terminator
+		dAuth.Add ( 0 ); // empty auth response
+
+		if ( !SendPacket ( dAuth.Begin(), dAuth.GetLength(), 1, sError ) )
+			return false;
+
+		if ( !ReadPacket ( dPacket, sError ) )
+			return false;
+		if ( !dPacket.GetLength() || dPacket[0]!=0x00 )
+		{
+			Close();
+			return PacketError ( dPacket, sError );
+		}
+		return true;
+	}
+
+	virtual bool Query ( const CSphString & sQuery, int64_t & iRows, CSphString & sError )
+	{
+		CSphVector<BYTE> dCmd ( sQuery.Length()+1 );
+		dCmd[0] = MYSQL_COM_QUERY;
+		memcpy ( dCmd.Begin()+1, sQuery.cstr(), sQuery.Length() );
+
+		if ( !SendPacket ( dCmd.Begin(), dCmd.GetLength(), 0, sError ) )
+			return false;
+		return ReadResult ( iRows, sError );
+	}
+
+protected:
+	bool SendPacket ( const BYTE * pData, int iLen, BYTE uSeq, CSphString & sError )
+	{
+		if ( iLen>=0xffffff )
+		{
+			sError = "query is too long";
+			return false;
+		}
+
+		CSphVector<BYTE> dBuf ( iLen+4 );
+		dBuf[0] = (BYTE)( iLen & 0xff );
+		dBuf[1] = (BYTE)( ( iLen>>8 ) & 0xff );
+		dBuf[2] = (BYTE)( ( iLen>>16 ) & 0xff );
+		dBuf[3] = uSeq;
+		memcpy ( dBuf.Begin()+4, pData, iLen );
+		return SendAll ( dBuf.Begin(), dBuf.GetLength(), sError );
+	}
+
+	virtual bool ReadPacket ( CSphVector<BYTE> & dPacket, CSphString & sError )
+	{
+		BYTE dHeader[4];
+		if ( !RecvAll ( dHeader, sizeof(dHeader), sError ) )
+			return false;
+
+		int iLen = dHeader[0] | ( dHeader[1]<<8 ) | ( dHeader[2]<<16 );
+		dPacket.Resize ( iLen );
+		return !iLen || RecvAll ( dPacket.Begin(), iLen, sError );
+	}
+};
+
+
+/// API protocol connection, runs the statements using the sphinxql command
+class ApiConn_c : public BenchConn_c
+{
+public:
+	explicit ApiConn_c ( const sockaddr_in & tAddr )
+		: BenchConn_c ( tAddr )
+		, m_iReplyPos ( 0 )
+	{}
+
+	virtual bool Connect ( CSphString & sError )
+	{
+		if ( !OpenSocket ( sError ) )
+			return false;
+
+		// exchange versions, then switch to a persistent connection
+		BYTE dVer[4];
+		if ( !RecvAll ( dVer, sizeof(dVer), sError ) )
+			return false;
+
+		BYTE dHello[16];
+		PutDword ( dHello, 1 );
+		PutWord ( dHello+4, SEARCHD_COMMAND_PERSIST );
+		PutWord ( dHello+6, 0 );
+		PutDword ( dHello+8, 4 );
+		PutDword ( dHello+12, 1 );
+		return SendAll ( dHello, sizeof(dHello), sError );
+	}
+
+	virtual bool Query ( const CSphString & sQuery, int64_t & iRows, CSphString & sError )
+	{
+		int iLen = sQuery.Length();
+		CSphVector<BYTE> dReq ( 12+iLen );
+		PutWord ( dReq.Begin(), SEARCHD_COMMAND_SPHINXQL );
+		PutWord ( dReq.Begin()+2, VER_COMMAND_SPHINXQL );
+		PutDword ( dReq.Begin()+4, 4+iLen );
+		PutDword ( dReq.Begin()+8, iLen );
+		if ( iLen>0 )
+			memcpy ( dReq.Begin()+12, sQuery.cstr(), iLen );
+		if ( !SendAll ( dReq.Begin(), dReq.GetLength(), sError ) )
+			return false;
+
+		// status, version, length
+		BYTE dHeader[8];
+		if ( !RecvAll ( dHeader, sizeof(dHeader), sError ) )
+			return false;
+
+		int iStatus = ( dHeader[0]<<8 ) | dHeader[1];
+		int iReplyLen = (int)( ( dHeader[4]<<24 ) | ( dHeader[5]<<16 ) | ( dHeader[6]<<8 ) | dHeader[7] );
+		if ( iReplyLen<0 || iReplyLen>64*1024*1024 )
+		{
+			sError.SetSprintf ( "invalid reply length %d", iReplyLen );
+			Close();
+			return false;
+		}
+
+		m_dReply.Resize ( iReplyLen );
+		m_iReplyPos = 0;
+		if ( iReplyLen && !RecvAll ( m_dReply.Begin(), iReplyLen, sError ) )
+			return false;
+
+		if ( iStatus!=SEARCHD_OK && iStatus!=SEARCHD_WARNING )
+		{
+			// error message is a length-prefixed string
+			if ( iReplyLen>4 )
+				sError.SetBinary ( (const char *)m_dReply.Begin()+4, iReplyLen-4 );
+			else
+				sError.SetSprintf ( "searchd returned status %d", iStatus );
+			return false;
+		}
+
+		// warning message goes before the reply body
+		if ( iStatus==SEARCHD_WARNING && iReplyLen>=4 )
+			m_iReplyPos = 4 + (int)( ( m_dReply[0]<<24 ) | ( m_dReply[1]<<16 ) | ( m_dReply[2]<<8 ) | m_dReply[3] );
+
+		return ReadResult ( iRows, sError );
+	}
+
+protected:
+	CSphVector<BYTE>	m_dReply;
+	int					m_iReplyPos;
+
+protected:
+	static void PutWord ( BYTE * pBuf, int iValue )
+	{
+		pBuf[0] = (BYTE)( ( iValue>>8 ) & 0xff );
+		pBuf[1] = (BYTE)( iValue & 0xff );
+	}
+
+	static void PutDword ( BYTE * pBuf, DWORD uValue )
+	{
+		pBuf[0] = (BYTE)( ( uValue>>24 ) & 0xff );
+		pBuf[1] = (BYTE)( ( uValue>>16 ) & 0xff );
+		pBuf[2] = (BYTE)( ( uValue>>8 ) & 0xff );
+		pBuf[3] = (BYTE)( uValue & 0xff );
+	}
+
+	virtual bool ReadPacket ( CSphVector<BYTE> & dPacket, CSphString & sError )
+	{
+		if ( m_iReplyPos+4>m_dReply.GetLength() )
+		{
+			sError = "truncated sphinxql reply";
+			return false;
+		}
+
+		const BYTE * pHeader = m_dReply.Begin() + m_iReplyPos;
+		int iLen = pHeader[0] | ( pHeader[1]<<8 ) | ( pHeader[2]<<16 );
+		m_iReplyPos += 4;
+		if ( m_iReplyPos+iLen>m_dReply.GetLength() )
+		{
+			sError = "truncated sphinxql reply";
+			return false;
+		}
+
+		dPacket.Resize ( iLen );
+		if ( iLen )
+			memcpy ( dPacket.Begin(), m_dReply.Begin()+m_iReplyPos, iLen );
+		m_iReplyPos += iLen;
+		return true;
+	}
+};
+
+/////////////////////////////////////////////////////////////////////////////
+// LOAD GENERATOR
+/////////////////////////////////////////////////////////////////////////////
+
+/// run settings shared by all the workers
+struct BenchConfig_t
+{
+	sockaddr_in				m_tAddr;
+	bool					m_bApi;
+	int						m_iConnections;
+	double					m_fRate;		///< target arrival rate, queries per second; 0 means closed loop
+	int64_t					m_iCount;		///< total queries to send
+	int64_t					m_tmDeadline;	///< stop sending after this time; 0 means no limit
+	int64_t					m_tmStart;		///< run start, arrivals are scheduled from here
+	CSphVector<CSphString>	m_dQueries;
+
+	BenchConfig_t ()
+		: m_bApi ( false )
+		, m_iConnections ( 1 )
+		, m_fRate ( 0.0 )
+		, m_iCount ( 0 )
+		, m_tmDeadline ( 0 )
+		, m_tmStart ( 0 )
+	{
+		memset ( &m_tAddr, 0, sizeof(m_tAddr) );
+	}
+};
+
+
+/// per-connection worker state and results
+struct BenchWorker_t
+{
+	const BenchConfig_t *	m_pConfig;
+	CSphAtomic<long> *		m_pNext;		///< shared sequence number of the next query
+	SphThread_t				m_tThread;
+
+	CSphVector<int64_t>		m_dLatencies;	///< usec, of successful queries
+	int64_t					m_iErrors;
+	int64_t					m_iLate;		///< queries that could not be sent on schedule
+	int64_t					m_iRows;
+	CSphString				m_sLastError;
+
+	BenchWorker_t ()
+		: m_pConfig ( NULL )
+		, m_pNext ( NULL )
+		, m_iErrors ( 0 )
+		, m_iLate ( 0 )
+		, m_iRows ( 0 )
+	{}
+};
+
+
+static void BenchSleepUntil ( int64_t tmWhen )
+{
+	for ( ;; )
+	{
+		int64_t tmLeft = tmWhen - sphMicroTimer();
+		if ( tmLeft<=0 )
+			return;
+#if USE_WINDOWS
+		Sleep ( (DWORD) Max ( tmLeft/1000, (int64_t)1 ) );
+#else
+		usleep ( (useconds_t) Min ( tmLeft, (int64_t)100000 ) );
+#endif
+	}
+}
+
+
+static void BenchThreadFunc ( void * pArg )
+{
+	BenchWorker_t & tWorker = *(BenchWorker_t *)pArg;
+	const BenchConfig_t & tConfig = *tWorker.m_pConfig;
+
+	BenchConn_c * pConn = tConfig.m_bApi
+		? (BenchConn_c *) new ApiConn_c ( tConfig.m_tAddr )
+		: (BenchConn_c *) new SqlConn_c ( tConfig.m_tAddr );
+
+	CSphString sError;
+	for ( ;; )
+	{
+		int64_t iSeq = tWorker.m_pNext->Inc();
+		if ( iSeq>=tConfig.m_iCount )
+			break;
+
+		// open loop sends on a fixed schedule, and measures from the scheduled time,
+		// so that the server stalls show up in the latencies instead of just slowing the client down
+		int64_t tmScheduled = sphMicroTimer();
+		if ( tConfig.m_fRate>0.0 )
+		{
+			tmScheduled = tConfig.m_tmStart + (int64_t)( (double)iSeq*1000000.0/tConfig.m_fRate );
+			BenchSleepUntil ( tmScheduled );
+			if ( sphMicroTimer()-tmScheduled>1000 )
+				tWorker.m_iLate++;
+		}
+
+		if ( tConfig.m_tmDeadline && sphMicroTimer()>=tConfig.m_tmDeadline )
+			break;
+
+		int64_t iRows = 0;
+		bool bOk = ( pConn->IsConnected() || pConn->Connect ( sError ) )
+			&& pConn->Query ( tConfig.m_dQueries [ (int)( iSeq % tConfig.m_dQueries.GetLength() ) ], iRows, sError );
+
+		int64_t tmDone = sphMicroTimer();
+		if ( bOk )
+		{
+			tWorker.m_dLatencies.Add ( tmDone-tmScheduled );
+			tWorker.m_iRows += iRows;
+		} else
+		{
+			tWorker.m_iErrors++;
+			tWorker.m_sLastError = sError;
+		}
+	}
+
+	SafeDelete ( pConn );
+}
+
+
+static int64_t Percentile ( const CSphVector<int64_t> & dSorted, int iPermille )
+{
+	if ( !dSorted.GetLength() )
+		return 0;
+	int64_t iRank = ( (int64_t)dSorted.GetLength()*iPermille + 999 ) / 1000;
+	return dSorted [ (int) Max ( Min ( iRank, (int64_t)dSorted.GetLength() ) - 1, (int64_t)0 ) ];
+}
+
+
+static void PrintMsec ( const char * sName, int64_t iUsec )
+{
+	fprintf ( stdout, " %s %d.%03d", sName, (int)( iUsec/1000 ), (int)( iUsec%1000 ) );
+}
+
+
+int main ( int argc, char ** argv )
+{
+	if ( argc<=1 )
+	{
+		fprintf ( stdout, SPHINX_BANNER );
+		fprintf ( stdout,
+			"Usage: searchbench [OPTIONS] <QUERY-LOG>\n"
+			"\n"
+			"Replays the statements from a query_log_format=sphinxql query log\n"
+			"(or a plain file with one SphinxQL statement per line) against searchd,\n"
+			"and reports the throughput and the latency percentiles.\n"
+			"\n"
+			"Options are:\n"
+			"-h, --host <host>\tsearchd host (default is 127.0.0.1)\n"
+			"-p, --port <port>\tsearchd port (default is 9306, or 9312 with --api)\n"
+			"--api\t\t\tuse the API protocol instead of SphinxQL\n"
+			"-c, --connections <N>\tconcurrent connections (default is 1)\n"
+			"-r, --rate <QPS>\topen loop, send queries at this fixed rate;\n"
+			"\t\t\tdefault is closed loop (each connection sends the next\n"
+			"\t\t\tquery as soon as it gets a reply)\n"
+			"-n, --count <N>\t\ttotal queries to send, looping over the log\n"
+			"\t\t\t(default is every logged query once)\n"
+			"-t, --time <SEC>\tstop after this many seconds\n"
+		);
+		exit ( 0 );
+	}
+
+	//////////////////////
+	// parse command line
+	//////////////////////
+
+	#define OPT(_a1,_a2)	else if ( !strcmp(argv[i],_a1) || !strcmp(argv[i],_a2) )
+	#define OPT1(_a1)		else if ( !strcmp(argv[i],_a1) )
+
+	BenchConfig_t tConfig;
+	const char * sHost = "127.0.0.1";
+	int iPort = 0;
+	int iTime = 0;
+
+	int i;
+	for ( i=1; i<argc-1; i++ )
+	{
+		// handle argless options
+		if ( argv[i][0]!='-' ) break;
+		OPT1 ( "--api" )				{ tConfig.m_bApi = true; continue; }
+
+		// handle options with 1 arg
+		if ( (i+2)>=argc )				break;
+		OPT ( "-h", "--host" )			sHost = argv[++i];
+		OPT ( "-p", "--port" )			iPort = atoi ( argv[++i] );
+		OPT ( "-c", "--connections" )	tConfig.m_iConnections = atoi ( argv[++i] );
+		OPT ( "-r", "--rate" )			tConfig.m_fRate = atof ( argv[++i] );
+		OPT ( "-n", "--count" )			tConfig.m_iCount = strtoll ( argv[++i], NULL, 10 );
+		OPT ( "-t", "--time" )			iTime = atoi ( argv[++i] );
+		else
+			break;
+	}
+
+	if ( i!=argc-1 )
+		sphDie ( "malformed or unknown option near '%s'; run without arguments for help", argv[i] );
+
+	if ( tConfig.m_iConnections<1 )
+		sphDie ( "invalid connection count %d", tConfig.m_iConnections );
+	if ( tConfig.m_fRate<0.0 )
+		sphDie ( "invalid rate %f", tConfig.m_fRate );
+
+	CSphString sError;
+	if ( !LoadQueries ( argv[i], tConfig.m_dQueries, sError ) )
+		sphDie ( "%s", sError.cstr() );
+
+	if ( !tConfig.m_iCount )
+		tConfig.m_iCount = iTime ? INT64_MAX : tConfig.m_dQueries.GetLength();
+
+#if USE_WINDOWS
+	WSADATA tWSAData;
+	if ( WSAStartup ( WINSOCK_VERSION, &tWSAData ) )
+		sphDie ( "failed to initialize WinSock2" );
+#endif
+
+	if ( !iPort )
+		iPort = tConfig.m_bApi ? SPHINXAPI_PORT : SPHINXQL_PORT;
+
+	tConfig.m_tAddr.sin_family = AF_INET;
+	tConfig.m_tAddr.sin_port = htons ( (short)iPort );
+	tConfig.m_tAddr.sin_addr.s_addr = inet_addr ( sHost );
+	if ( tConfig.m_tAddr.sin_addr.s_addr==INADDR_NONE )
+	{
+		hostent * pHost = gethostbyname ( sHost );
+		if ( !pHost || pHost->h_addrtype!=AF_INET )
+			sphDie ( "failed to resolve host '%s'", sHost );
+		memcpy ( &tConfig.m_tAddr.sin_addr, pHost->h_addr_list[0], sizeof(tConfig.m_tAddr.sin_addr) );
+	}
+
+	fprintf ( stdout, "replaying %d queries over %s at %s:%d, %d connection(s), %s\n",
+		tConfig.m_dQueries.GetLength(), tConfig.m_bApi ? "API" : "SphinxQL", sHost, iPort, tConfig.m_iConnections,
+		tConfig.m_fRate>0.0 ? "open loop" : "closed loop" );
+
+	/////////
+	// run
+	/////////
+
+	sphThreadInit ( false );
+
+	CSphAtomic<long> tNext;
+	CSphFixedVector<BenchWorker_t> dWorkers ( tConfig.m_iConnections );
+
+	tConfig.m_tmStart = sphMicroTimer();
+	if ( iTime )
+		tConfig.m_tmDeadline = tConfig.m_tmStart + (int64_t)iTime*1000000;
+
+	ARRAY_FOREACH ( j, dWorkers )
+	{
+		dWorkers[j].m_pConfig = &tConfig;
+		dWorkers[j].m_pNext = &tNext;
+		if ( !sphThreadCreate ( &dWorkers[j].m_tThread, BenchThreadFunc, &dWorkers[j] ) )
+			sphDie ( "failed to create thread: %s", strerror(errno) );
+	}
+
+	ARRAY_FOREACH ( j, dWorkers )
+		sphThreadJoin ( &dWorkers[j].m_tThread );
+
+	int64_t tmElapsed = Max ( sphMicroTimer() - tConfig.m_tmStart, (int64_t)1 );
+
+	////////////
+	// report
+	////////////
+
+	CSphVector<int64_t> dLatencies;
+	int64_t iErrors = 0, iLate = 0, iRows = 0, iTotalLatency = 0;
+	ARRAY_FOREACH ( j, dWorkers )
+	{
+		const BenchWorker_t & tWorker = dWorkers[j];
+		ARRAY_FOREACH ( k, tWorker.m_dLatencies )
+		{
+			dLatencies.Add ( tWorker.m_dLatencies[k] );
+			iTotalLatency += tWorker.m_dLatencies[k];
+		}
+		iErrors += tWorker.m_iErrors;
+		iLate += tWorker.m_iLate;
+		iRows += tWorker.m_iRows;
+		if ( !tWorker.m_sLastError.IsEmpty() )
+			sError = tWorker.m_sLastError;
+	}
+	dLatencies.Sort();
+
+	int64_t iOk = dLatencies.GetLength();
+	fprintf ( stdout, "queries: "INT64_FMT" ok, "INT64_FMT" errors, "INT64_FMT" rows\n", iOk, iErrors, iRows );
+	fprintf ( stdout, "elapsed: %d.%03d sec, %.1f qps\n", (int)( tmElapsed/1000000 ), (int)( ( tmElapsed%1000000 )/1000 ),
+		(double)iOk*1000000.0/tmElapsed );
+
+	fprintf ( stdout, "latency, msec:" );
+	PrintMsec ( "avg", iOk ? iTotalLatency/iOk : 0 );
+	PrintMsec ( "p50", Percentile ( dLatencies, 500 ) );
+	PrintMsec ( "p90", Percentile ( dLatencies, 900 ) );
+	PrintMsec ( "p95", Percentile ( dLatencies, 950 ) );
+	PrintMsec ( "p99", Percentile ( dLatencies, 990 ) );
+	PrintMsec ( "p999", Percentile ( dLatencies, 999 ) );
+	PrintMsec ( "max", iOk ? dLatencies.Last() : 0 );
+	fprintf ( stdout, "\n" );
+
+	if ( iLate )
+		fprintf ( stdout, "WARNING: "INT64_FMT" queries were sent behind schedule; consider more connections\n", iLate );
+	if ( iErrors )
+		fprintf ( stdout, "last error: %s\n", sError.cstr() );
+
+	return iErrors ? 1 : 0;
+}
+
+//
+// $Id$
+//
@@ -46,6 +46,7 @@ extern "C"
 #define SPH_ADDRPORT_SIZE		sizeof("000.000.000.000:00000")
 #define MVA_UPDATES_POOL		1048576
 #define NETOUTBUF				8192
+#define NETOUTBUF_REF_MIN		512		// min blob size to send by reference instead of copying
 #define PING_INTERVAL			1000
 #define QLSTATE_FLUSH_MSEC		50
 #define DEFAULT_MAX_MATCHES		1000
@@ -85,6 +86,12 @@ extern "C"
 	#include <sys/un.h>
 	#include <netdb.h>
 	#include <sys/syscall.h>
+	#include <sys/uio.h>
+	#include <limits.h>
+
+	#ifndef IOV_MAX
+	#define IOV_MAX 16
+	#endif
 
 	#if HAVE_POLL
 	#include <poll.h>
@@ -133,6 +140,9 @@ struct ServedDesc_t
 	CSphString			m_sGlobalIDFPath;
 	bool				m_bOnDiskAttrs;
 	bool				m_bOnDiskPools;
+	bool				m_bInfixTrigrams;
+	CSphVector<CSphString>	m_dJsonIndexPaths;
+	CSphVector<CSphString>	m_dDocidOrderedAttrs;
 	int64_t				m_iMass; // relative weight (by access speed) of the index
 
 						ServedDesc_t ();
@@ -280,6 +290,7 @@ static int				g_iReadTimeout		= 5;	// sec
 static int				g_iWriteTimeout		= 5;
 static int				g_iClientTimeout	= 300;
 static int				g_iPersistentPoolSize	= 0;
+static int				g_iAgentMuxConnections	= 0;	///< shared multiplexed connections per persistent agent host (0 means exclusive persistent sockets)
 static CSphVector<int>	g_dPersistentConnections; // protect by CSphScopedLock<ThreadsOnlyMutex_t> tLock ( g_tPersLock );
 static int				g_iMaxChildren		= 0;
 #if !USE_WINDOWS
@@ -289,6 +300,7 @@ static bool				g_bPreopenIndexes	= false;
 #endif
 static bool				g_bWatchdog			= true;
 static int				g_iExpansionLimit	= 0;
+static int64_t			g_iExpansionCacheSize	= 0;	// in bytes, per index
 static bool				g_bOnDiskAttrs		= false;
 static bool				g_bOnDiskPools		= false;
 static int				g_iShutdownTimeout	= 3000000; // default timeout on daemon shutdown and stopwait is 3 seconds
@@ -503,6 +515,7 @@ static List_t					g_dThd;				///< existing threads table
 
 static int						g_iConnID = 0;		///< global conn-id in none/fork/threads; current conn-id in prefork
 static SphThreadKey_t			g_tConnKey;			///< current conn-id TLS in threads
+static SphThreadKey_t			g_tMuxKey;			///< current multiplexed reply stream TLS in threads
 static int *					g_pConnID = NULL;	///< global conn-id ptr in prefork
 
 // handshake
@@ -663,6 +676,7 @@ enum SearchdCommand_e
 	SEARCHD_COMMAND_PING		= 9,
 	SEARCHD_COMMAND_DELETE		= 10,
 	SEARCHD_COMMAND_UVAR		= 11,
+	SEARCHD_COMMAND_MULTIPLEX	= 12,
 
 	SEARCHD_COMMAND_TOTAL
 };
@@ -680,6 +694,7 @@ enum
 	VER_COMMAND_SPHINXQL	= 0x100,
 	VER_COMMAND_PING		= 0x100,
 	VER_COMMAND_UVAR		= 0x100,
+	VER_COMMAND_MULTIPLEX	= 0x100,
 };
 
 
@@ -696,14 +711,25 @@ enum SearchdStatus_e
 /// master-agent API protocol extensions version
 enum
 {
-	VER_MASTER = 11
+	VER_MASTER = 13
+};
+
+
+/// agent result set encodings, requested by master (master-agent extension v.12)
+/// values are communicated over network between searchds and MUST NOT CHANGE
+enum
+{
+	RESULT_COLUMNAR		= 1UL << 0,	///< matches go column by column, with delta coded ints and per-column string dictionaries
+	RESULT_COMPRESSED	= 1UL << 1	///< columnar matches block is zlib compressed
 };
 
+static DWORD g_uAgentResultEncoding = RESULT_COLUMNAR;	///< result set encoding this master asks agents for
+
 
 /// command names
 static const char * g_dApiCommands[SEARCHD_COMMAND_TOTAL] =
 {
-	"search", "excerpt", "update", "keywords", "persist", "status", "query", "flushattrs", "query", "ping", "delete", "uvar"
+	"search", "excerpt", "update", "keywords", "persist", "status", "query", "flushattrs", "query", "ping", "delete", "uvar", "multiplex"
 };
 
 
@@ -713,6 +739,18 @@ static const char * g_dApiCommands[SEARCHD_COMMAND_TOTAL] =
 const int	STATS_MAX_AGENTS	= 1024;	///< we'll track stats for this much remote agents
 const int	STATS_MAX_DASH	= 256;	///< we'll track stats for RR of this much remote agents
 const int	STATS_DASH_TIME = 15;	///< store the history for last periods
+const int	HOST_LATENCY_SAMPLES = 64;	///< recent answer latencies kept per host, for hedging
+const int	HEDGE_MIN_SAMPLES = 16;		///< do not hedge until mirrors got this many latency samples
+const float	LATENCY_EWMA_ALPHA = 0.2f;	///< weight of the newest sample in the moving average latency
+const int	STATS_MAX_INDEXES	= 256;	///< we'll track latencies for this much local indexes
+const int	STATS_MAX_STMTS		= 64;	///< we'll track latencies for this much SphinxQL statement types
+
+const int	LATENCY_SUB_BUCKETS	= 8;	///< linear sub-buckets per power of two, so buckets are within 12.5% of the value
+const int	LATENCY_BUCKETS		= 200;	///< enough to cover up to 2^27 usec (over 2 minutes); slower ones land in the last bucket
+const int	LATENCY_FINE_SEC	= 10;	///< fine slice length, in seconds
+const int	LATENCY_FINE_SLICES	= 6;	///< fine slices make up the 1 minute window
+const int	LATENCY_COARSE_SEC	= 60;	///< coarse slice length, in seconds
+const int	LATENCY_COARSE_SLICES	= 5;	///< coarse slices make up the 5 minutes window
 
 template <class DATA, int SIZE> class StaticStorage_t : public ISphNoncopyable
 {
@@ -749,6 +787,141 @@ public:
 	}
 };
 
+/// lock-free increment of a counter in the shared stats
+static inline void StatsAtomicInc ( volatile DWORD * pValue )
+{
+#if USE_WINDOWS
+	InterlockedIncrement ( (volatile LONG *)pValue );
+#elif HAVE_SYNC_FETCH
+	__sync_fetch_and_add ( pValue, 1 );
+#else
+	(*pValue)++;
+#endif
+}
+
+/// lock-free compare-and-swap of a value in the shared stats
+static inline bool StatsAtomicCas ( volatile DWORD * pValue, DWORD uOld, DWORD uNew )
+{
+#if USE_WINDOWS
+	return InterlockedCompareExchange ( (volatile LONG *)pValue, (LONG)uNew, (LONG)uOld )==(LONG)uOld;
+#elif HAVE_SYNC_FETCH
+	return __sync_bool_compare_and_swap ( pValue, uOld, uNew );
+#else
+	if ( *pValue!=uOld )
+		return false;
+	*pValue = uNew;
+	return true;
+#endif
+}
+
+/// latency bucket for a value, log-linear (HDR-style)
+/// values below 8 usec get exact buckets, then every power of two splits into 8 equal sub-buckets
+static inline int LatencyBucket ( int64_t iMicrosec )
+{
+	if ( iMicrosec<LATENCY_SUB_BUCKETS )
+		return (int) Max ( iMicrosec, 0 );
+
+	int iLog = sphLog2 ( (uint64_t)iMicrosec ) - 1;
+	int iBucket = LATENCY_SUB_BUCKETS*( iLog-2 ) + (int)( ( iMicrosec>>( iLog-3 ) ) & ( LATENCY_SUB_BUCKETS-1 ) );
+	return Min ( iBucket, LATENCY_BUCKETS-1 );
+}
+
+/// highest value that falls into the given latency bucket
+static inline int64_t LatencyBucketMax ( int iBucket )
+{
+	if ( iBucket<LATENCY_SUB_BUCKETS )
+		return iBucket;
+
+	int iLog = iBucket/LATENCY_SUB_BUCKETS + 2;
+	int64_t iBase = (int64_t)( LATENCY_SUB_BUCKETS + iBucket%LATENCY_SUB_BUCKETS ) << ( iLog-3 );
+	return iBase + ( (int64_t)1 << ( iLog-3 ) ) - 1;
+}
+
+/// one time slice of a latency histogram
+struct LatencySlice_t
+{
+	volatile DWORD	m_uPeriod;						///< period this slice counts (biased by 1, so 0 means never used)
+	volatile DWORD	m_dBuckets[LATENCY_BUCKETS];	///< samples per bucket
+};
+
+/// latency histogram over sliding windows, kept in the shared stats
+/// writers never lock; a slice gets recycled by the first writer of a new period, and samples
+/// racing with that recycle might be lost, which is fine for the percentiles
+struct LatencyHistogram_t
+{
+	LatencySlice_t	m_dFine[LATENCY_FINE_SLICES];
+	LatencySlice_t	m_dCoarse[LATENCY_COARSE_SLICES];
+
+	void Add ( int64_t iMicrosec )
+	{
+		DWORD uNow = (DWORD)( sphMicroTimer()/1000000 );
+		int iBucket = LatencyBucket ( iMicrosec );
+		AddToRing ( m_dFine, LATENCY_FINE_SLICES, uNow/LATENCY_FINE_SEC+1, iBucket );
+		AddToRing ( m_dCoarse, LATENCY_COARSE_SLICES, uNow/LATENCY_COARSE_SEC+1, iBucket );
+	}
+
+	/// sum up the window (either 1 or 5 minutes) into dBuckets, returns total samples
+	int64_t Collect ( int64_t * dBuckets, bool bCoarse ) const
+	{
+		DWORD uNow = (DWORD)( sphMicroTimer()/1000000 );
+		const LatencySlice_t * pRing = bCoarse ? m_dCoarse : m_dFine;
+		int iSlices = bCoarse ? LATENCY_COARSE_SLICES : LATENCY_FINE_SLICES;
+		DWORD uPeriod = uNow / ( bCoarse ? LATENCY_COARSE_SEC : LATENCY_FINE_SEC ) + 1;
+
+		int64_t iTotal = 0;
+		for ( int i=0; i<LATENCY_BUCKETS; i++ )
+			dBuckets[i] = 0;
+
+		for ( int i=0; i<iSlices; i++ )
+		{
+			const LatencySlice_t & tSlice = pRing[i];
+			if ( !tSlice.m_uPeriod || tSlice.m_uPeriod>uPeriod || uPeriod-tSlice.m_uPeriod>=(DWORD)iSlices )
+				continue;
+
+			for ( int j=0; j<LATENCY_BUCKETS; j++ )
+			{
+				dBuckets[j] += tSlice.m_dBuckets[j];
+				iTotal += tSlice.m_dBuckets[j];
+			}
+		}
+		return iTotal;
+	}
+
+private:
+	static void AddToRing ( LatencySlice_t * pRing, int iSlices, DWORD uPeriod, int iBucket )
+	{
+		LatencySlice_t & tSlice = pRing [ uPeriod % iSlices ];
+		DWORD uSeen = tSlice.m_uPeriod;
+		if ( uSeen<uPeriod && StatsAtomicCas ( &tSlice.m_uPeriod, uSeen, uPeriod ) )
+			memset ( (void*)tSlice.m_dBuckets, 0, sizeof(tSlice.m_dBuckets) );
+		StatsAtomicInc ( &tSlice.m_dBuckets[iBucket] );
+	}
+};
+
+/// percentile (given in permilles) of the collected latencies, in usec; upper bound of the bucket it falls into
+static int64_t LatencyPercentile ( const int64_t * dBuckets, int64_t iTotal, int iPermille )
+{
+	if ( iTotal<=0 )
+		return 0;
+
+	int64_t iRank = Max ( ( iTotal*iPermille + 999 )/1000, (int64_t)1 );
+	int64_t iSeen = 0;
+	for ( int i=0; i<LATENCY_BUCKETS; i++ )
+	{
+		iSeen += dBuckets[i];
+		if ( iSeen>=iRank )
+			return LatencyBucketMax(i);
+	}
+	return LatencyBucketMax ( LATENCY_BUCKETS-1 );
+}
+
+/// per-index latencies; slots are claimed lock-free by the index name hash
+struct IndexLatency_t
+{
+	volatile uint64_t	m_uNameHash;	///< FNV64 of the index name, 0 if the slot is free
+	LatencyHistogram_t	m_tWall;		///< local search wall time
+};
+
 /// per-agent query stats
 enum eAgentStats
 {
@@ -889,6 +1062,11 @@ struct HostDashboard_t
 	int64_t			m_iErrorsARow;			// num of errors a row, updated when we update the general statistic.
 	AgentDesc_t		m_dDescriptor;			// only host info, no indices. Used for ping.
 	bool			m_bNeedPing;			// we'll ping only HA agents, not everyone
+	float			m_fLatencyEwma;			// moving average of answer latency, in msec; 0 if still unknown
+	int				m_iOutstanding;			// requests sent to the host and not yet answered
+	int				m_dLatencies[HOST_LATENCY_SAMPLES];	// recent answer latencies, in usec, ring buffer
+	DWORD			m_uLatencySamples;		// total latency samples ever added
+	LatencyHistogram_t	m_tLatency;			// answer latencies over the sliding windows
 
 private:
 	AgentDash_t	m_dStats[STATS_DASH_TIME];
@@ -902,6 +1080,24 @@ public:
 		m_iErrorsARow = 0;
 		m_dDescriptor = *pAgent;
 		m_bNeedPing = false;
+		m_fLatencyEwma = 0.0f;
+		m_iOutstanding = 0;
+		m_uLatencySamples = 0;
+	}
+
+	/// account an answer latency; timeouts only push the moving average, they are not real samples
+	void AddLatency ( int64_t iMicrosec, bool bSample )
+	{
+		float fMsec = Max ( iMicrosec/1000.0f, 0.001f );
+		m_fLatencyEwma = ( m_fLatencyEwma>0.0f ) ? m_fLatencyEwma + LATENCY_EWMA_ALPHA*( fMsec-m_fLatencyEwma ) : fMsec;
+		if ( bSample )
+			m_dLatencies [ ( m_uLatencySamples++ ) % HOST_LATENCY_SAMPLES ] = (int) Min ( iMicrosec, (int64_t)INT_MAX );
+		m_tLatency.Add ( iMicrosec );
+	}
+
+	inline int GetLatencySamples() const
+	{
+		return (int) Min ( m_uLatencySamples, (DWORD)HOST_LATENCY_SAMPLES );
 	}
 
 	inline bool IsOlder ( int64_t iTime ) const
@@ -982,6 +1178,9 @@ struct SearchdStats_t
 	int64_t		m_iCommandCount[SEARCHD_COMMAND_TOTAL];
 	int64_t		m_iAgentConnect;
 	int64_t		m_iAgentRetry;
+	int64_t		m_iAgentHedged;		///< backup requests sent to another mirror
+	int64_t		m_iAgentResultBytes;	///< columnar matches received from agents, in bytes
+	int64_t		m_iAgentResultSaved;	///< bytes the row-wise matches would have taken on top of that
 
 	int64_t		m_iQueries;			///< search queries count (differs from search commands count because of multi-queries)
 	int64_t		m_iQueryTime;		///< wall time spent (including network wait time)
@@ -999,6 +1198,11 @@ struct SearchdStats_t
 	int64_t		m_iPredictedTime;	///< total agent predicted query time
 	int64_t		m_iAgentPredictedTime;	///< total agent predicted query time
 
+	LatencyHistogram_t	m_dCommandLatency[SEARCHD_COMMAND_TOTAL];	///< API commands wall time
+	LatencyHistogram_t	m_dStmtLatency[STATS_MAX_STMTS];			///< SphinxQL statements wall time
+	LatencyHistogram_t	m_tQueueWait;		///< wait from the connection accept (or the multiplexed request read) to the handler start
+	IndexLatency_t		m_dIndexLatency[STATS_MAX_INDEXES];			///< local index searches wall time
+
 	StaticStorage_t<AgentStats_t,STATS_MAX_AGENTS> m_dAgentStats;
 	StaticStorage_t<HostDashboard_t,STATS_MAX_DASH> m_dDashboard;
 	SmallStringHash_T<int>							m_hDashBoard; ///< find hosts for agents and sort them all
@@ -1008,6 +1212,67 @@ static SearchdStats_t *			g_pStats		= NULL;
 static CSphSharedBuffer<SearchdStats_t>	g_tStatsBuffer;
 static CSphProcessSharedMutex	g_tStatsMutex;
 
+
+/// walk the probe sequence of an index latency slot; slots are never released, so no locking is needed
+static IndexLatency_t * LookupIndexLatency ( uint64_t uHash )
+{
+	for ( int i=0; i<STATS_MAX_INDEXES; i++ )
+	{
+		IndexLatency_t & tSlot = g_pStats->m_dIndexLatency [ ( uHash+i ) % STATS_MAX_INDEXES ];
+		if ( tSlot.m_uNameHash==uHash )
+			return &tSlot;
+		if ( !tSlot.m_uNameHash )
+			break;
+	}
+	return NULL;
+}
+
+
+/// find latency slot of a local index, optionally claiming a free one
+static IndexLatency_t * FindIndexLatency ( const char * sIndex, bool bClaim )
+{
+	if ( !g_pStats || !sIndex )
+		return NULL;
+
+	uint64_t uHash = sphFNV64 ( sIndex );
+	if ( !uHash )
+		uHash = 1;
+
+	IndexLatency_t * pSlot = LookupIndexLatency ( uHash );
+	if ( pSlot || !bClaim )
+		return pSlot;
+
+	// claim a free slot under the lock, and recheck, as someone might have beaten us to it
+	g_tStatsMutex.Lock();
+	pSlot = LookupIndexLatency ( uHash );
+	for ( int i=0; !pSlot && i<STATS_MAX_INDEXES; i++ )
+	{
+		IndexLatency_t & tSlot = g_pStats->m_dIndexLatency [ ( uHash+i ) % STATS_MAX_INDEXES ];
+		if ( !tSlot.m_uNameHash )
+		{
+			tSlot.m_uNameHash = uHash;
+			pSlot = &tSlot;
+		}
+	}
+	g_tStatsMutex.Unlock();
+	return pSlot;
+}
+
+
+static void StatIndexLatency ( const char * sIndex, int64_t tmWall )
+{
+	IndexLatency_t * pSlot = FindIndexLatency ( sIndex, true );
+	if ( pSlot )
+		pSlot->m_tWall.Add ( tmWall );
+}
+
+
+static void StatQueueWait ( int64_t tmWait )
+{
+	if ( g_pStats )
+		g_pStats->m_tQueueWait.Add ( tmWait );
+}
+
 static CSphQueryResultMeta		g_tLastMeta;
 static StaticThreadsOnlyMutex_t g_tLastMetaMutex;
 
@@ -1104,6 +1369,7 @@ ServedDesc_t::ServedDesc_t ()
 	, m_bAlterEnabled ( true )
 	, m_bOnDiskAttrs ( false )
 	, m_bOnDiskPools ( false )
+	, m_bInfixTrigrams ( false )
 	, m_iMass ( 0 )
 {}
 
@@ -1351,6 +1617,7 @@ void StaticThreadsOnlyMutex_t::Unlock()
 /////////////////////////////////////////////////////////////////////////////
 
 void Shutdown (); // forward ref for sphFatal()
+static void AgentMuxShutdown (); // definition is below
 
 
 /// format current timestamp for logging
@@ -1771,6 +2038,9 @@ void Shutdown ()
 			// stop search threads; up to shutdown_timeout seconds
 			while ( g_dThd.GetLength() > 0 && ( sphMicroTimer()-tmShutStarted )<g_iShutdownTimeout )
 				sphSleepMsec ( 50 );
+
+			// close the multiplexed agent links
+			AgentMuxShutdown();
 		}
 
 		sphThreadJoin ( &g_tRotationServiceThread );
@@ -1826,6 +2096,8 @@ void Shutdown ()
 		SafeDelete ( g_pLocalIndexes );
 		SafeDelete ( g_pTemplateIndexes );
 		sphDoneIOStats();
+		sphDoneMatchArena();
+		sphShutdownSnippetThreads();
 		sphRTDone();
 
 		sphShutdownWordforms ();
@@ -2832,6 +3104,16 @@ int sphSockRead ( int iSock, void * buf, int iLen, int iReadTimeout, bool bIntr
 // NETWORK BUFFERS
 /////////////////////////////////////////////////////////////////////////////
 
+/// multiplexed reply stream of the current request thread (see SEARCHD_COMMAND_MULTIPLEX)
+/// network buffers created for that socket in that thread tag their output with the request id
+struct MuxReply_t
+{
+	int				m_iSock;		///< shared client socket
+	CSphMutex *		m_pSendLock;	///< whole frames are written under it
+	DWORD			m_uId;			///< request id
+};
+
+
 /// dynamic response buffer
 /// to remove ISphNoncopyable just add copy c-tor and operator=
 /// splitting application network packets in several sphSocketSend()s causes
@@ -2863,10 +3145,16 @@ public:
 
 	bool SendLSBDword ( DWORD v )
 	{
-		SendByte ( (BYTE)( v & 0xff ) );
-		SendByte ( (BYTE)( (v>>8) & 0xff ) );
-		SendByte ( (BYTE)( (v>>16) & 0xff ) );
-		return SendByte ( (BYTE)( (v>>24) & 0xff) );
+		if ( m_bError )
+			return false;
+
+		ResizeIf ( sizeof(DWORD) );
+		m_pBufferPtr[0] = (BYTE)( v & 0xff );
+		m_pBufferPtr[1] = (BYTE)( (v>>8) & 0xff );
+		m_pBufferPtr[2] = (BYTE)( (v>>16) & 0xff );
+		m_pBufferPtr[3] = (BYTE)( (v>>24) & 0xff );
+		m_pBufferPtr += sizeof(DWORD);
+		return true;
 	}
 
 	bool SendUint64 ( uint64_t iValue )
@@ -2882,15 +3170,21 @@ public:
 #endif
 
 	bool		SendString ( const char * sStr );
+	bool		SendDwords ( const DWORD * pValues, int iCount );		///< network order, one buffer check for all the values
+	bool		SendMva64 ( const DWORD * pValues, int iValues );		///< network order, iValues is the count of DWORDs (ie. twice the count of 64-bit values)
 
 	bool		SendMysqlInt ( int iVal );
 	bool		SendMysqlString ( const char * sStr );
 
 	bool		Flush ( bool bUnfreeze=false );
+	bool		FlushRefs ();	///< flush if there's referenced data pending, so that the caller can release it
 	bool		GetError () { return m_bError; }
 	int			GetSentCount () { return m_iSent; }
 	void		FreezeBlock ( const char * sError, int iLen );
 
+	/// frame every flushed block with the given request id, for a link shared by concurrent requests
+	void		SetMultiplexed ( CSphMutex * pSendLock, DWORD uId ) { m_pMuxLock = pSendLock; m_uMuxId = uId; }
+
 protected:
 	BYTE *		m_pBuffer;			///< my dynamic buffer
 	int			m_iBufferSize;		///< my dynamic buffer size
@@ -2902,14 +3196,34 @@ protected:
 	int			m_iErrorLength;
 	bool		m_bFlushEnabled;	///< in frozen state we never flush until special command
 	BYTE *		m_pSize;			///< the pointer to the size of frozen block
+	CSphMutex *	m_pMuxLock;			///< multiplexed link send lock, NULL for an exclusive socket
+	DWORD		m_uMuxId;			///< multiplexed request id
+
+	/// output chunk, either a piece of my buffer or a referenced external blob
+	struct Chunk_t
+	{
+		const BYTE *	m_pData;	///< external data, or NULL for my buffer
+		int				m_iOff;		///< my buffer offset
+		int				m_iLen;
+	};
+
+	CSphVector<Chunk_t>	m_dChunks;	///< chunks queued before the current buffer tail
+	int					m_iTailOff;	///< my buffer offset where the current (not yet chunked) tail starts
 
 protected:
 	bool		SetError ( bool bValue );	///< set error flag
 	bool		ResizeIf ( int iToAdd );	///< flush if there's not enough free space to add iToAdd bytes
+	bool		WaitWritable ( int64_t tmMaxTimer );
+	void		SendPlain ( const BYTE * pData, int iLen, int64_t tmMaxTimer );
+	void		SendVectored ( int64_t tmMaxTimer );
 
 public:
 	bool							SendBytes ( const void * pBuf, int iLen );	///< (was) protected to avoid network-vs-host order bugs
 	template < typename T > bool	SendT ( T tValue );							///< (was) protected to avoid network-vs-host order bugs
+
+	/// send a blob without copying it, by reference (small blobs still get copied)
+	/// referenced data must stay intact until the next Flush()
+	bool							SendBytesRef ( const void * pBuf, int iLen );
 };
 
 
@@ -2986,6 +3300,19 @@ protected:
 	BYTE *				m_pMaxibuffer;
 };
 
+
+/// multiplexed request buffer; the request is already read into memory,
+/// and the replies (errors included) go framed to the shared client connection
+class MuxInputBuffer_c : public InputBuffer_c
+{
+public:
+					MuxInputBuffer_c ( const BYTE * pBuf, int iLen, int iSock ) : InputBuffer_c ( pBuf, iLen ), m_iSock ( iSock ) {}
+	virtual void	SendErrorReply ( const char *, ... ) __attribute__ ( ( format ( printf, 2, 3 ) ) );
+
+protected:
+	int				m_iSock;
+};
+
 /////////////////////////////////////////////////////////////////////////////
 
 NetOutputBuffer_c::NetOutputBuffer_c ( int iSock )
@@ -2995,10 +3322,18 @@ NetOutputBuffer_c::NetOutputBuffer_c ( int iSock )
 	, m_bError ( false )
 	, m_iSent ( 0 )
 	, m_bFlushEnabled ( true )
+	, m_pMuxLock ( NULL )
+	, m_uMuxId ( 0 )
+	, m_iTailOff ( 0 )
 {
 	assert ( m_iSock>0 );
 	m_pBuffer = new BYTE [ m_iBufferSize ];
 	m_pBufferPtr = m_pBuffer;
+
+	// replies of a multiplexed request go to the shared client connection
+	const MuxReply_t * pMux = ( g_eWorkers==MPM_THREADS ) ? (const MuxReply_t *) sphThreadGet ( g_tMuxKey ) : NULL;
+	if ( pMux && pMux->m_iSock==iSock )
+		SetMultiplexed ( pMux->m_pSendLock, pMux->m_uId );
 }
 
 
@@ -3029,6 +3364,39 @@ bool NetOutputBuffer_c::SendString ( const char * sStr )
 }
 
 
+bool NetOutputBuffer_c::SendDwords ( const DWORD * pValues, int iCount )
+{
+	if ( m_bError )
+		return false;
+
+	ResizeIf ( iCount*sizeof(DWORD) );
+	for ( int i=0; i<iCount; i++ )
+	{
+		sphUnalignedWrite ( m_pBufferPtr, htonl ( pValues[i] ) );
+		m_pBufferPtr += sizeof(DWORD);
+	}
+	return true;
+}
+
+
+bool NetOutputBuffer_c::SendMva64 ( const DWORD * pValues, int iValues )
+{
+	if ( m_bError )
+		return false;
+
+	assert ( ( iValues%2 )==0 );
+	ResizeIf ( iValues*sizeof(DWORD) );
+	for ( ; iValues>0; iValues-=2, pValues+=2 )
+	{
+		uint64_t uVal = (uint64_t)MVA_UPSIZE ( pValues );
+		sphUnalignedWrite ( m_pBufferPtr, htonl ( (DWORD)( uVal>>32 ) ) );
+		sphUnalignedWrite ( m_pBufferPtr+sizeof(DWORD), htonl ( (DWORD)( uVal & 0xffffffffUL ) ) );
+		m_pBufferPtr += 2*sizeof(DWORD);
+	}
+	return true;
+}
+
+
 int MysqlPackedLen ( int iLen )
 {
 	if ( iLen<251 )
@@ -3167,47 +3535,83 @@ bool NetOutputBuffer_c::SendBytes ( const void * pBuf, int iLen )
 }
 
 
-bool NetOutputBuffer_c::Flush ( bool bUnfreeze )
+bool NetOutputBuffer_c::SendBytesRef ( const void * pBuf, int iLen )
 {
+#if USE_WINDOWS
+	return SendBytes ( pBuf, iLen );
+#else
+	// frozen blocks must be measured and possibly discarded as a whole, so no refs there
+	// multiplexed frames are sent plain, so no refs there either
+	if ( iLen<NETOUTBUF_REF_MIN || !m_bFlushEnabled || m_pMuxLock )
+		return SendBytes ( pBuf, iLen );
+
 	if ( m_bError )
 		return false;
 
-	int iLen = m_pBufferPtr-m_pBuffer;
-	if ( iLen==0 )
-		return true;
-
-	if ( g_bGotSigterm )
-		sphLogDebug ( "SIGTERM in NetOutputBuffer::Flush" );
-
-	if ( bUnfreeze )
+	int iOff = m_pBufferPtr-m_pBuffer;
+	if ( iOff>m_iTailOff )
 	{
-		BYTE * pBuf = m_pBufferPtr;
-		m_pBufferPtr = m_pSize;
-		SendDword ( pBuf-m_pSize-4 );
-		m_pBufferPtr = pBuf;
-		m_bFlushEnabled = true;
+		Chunk_t & tOwn = m_dChunks.Add();
+		tOwn.m_pData = NULL;
+		tOwn.m_iOff = m_iTailOff;
+		tOwn.m_iLen = iOff-m_iTailOff;
 	}
 
-	// buffer overloaded. It is fail. Send the error message.
-	if ( !m_bFlushEnabled )
+	Chunk_t & tRef = m_dChunks.Add();
+	tRef.m_pData = (const BYTE *)pBuf;
+	tRef.m_iOff = 0;
+	tRef.m_iLen = iLen;
+
+	m_iTailOff = iOff;
+	return true;
+#endif
+}
+
+
+bool NetOutputBuffer_c::FlushRefs ()
+{
+	if ( !m_dChunks.GetLength() )
+		return !m_bError;
+	return Flush();
+}
+
+
+bool NetOutputBuffer_c::WaitWritable ( int64_t tmMaxTimer )
+{
+	int64_t tmMicroLeft = tmMaxTimer - sphMicroTimer();
+	int iRes = 0; // time out
+	if ( tmMicroLeft>0 )
+		iRes = sphPoll ( m_iSock, tmMicroLeft, true );
+
+	switch ( iRes )
 	{
-		sphLogDebug ( "NetOutputBuffer with disabled flush is overloaded" );
-		m_pBufferPtr = m_pBuffer;
-		SendBytes ( m_sError, m_iErrorLength );
-		iLen = m_pBufferPtr-m_pBuffer;
-		if ( iLen==0 )
-			return true;
-	}
+		case 1: // ready for writing
+			break;
 
-	assert ( iLen>0 );
-	assert ( iLen<=(int)m_iBufferSize );
-	char * pBuffer = reinterpret_cast<char *> ( m_pBuffer );
+		case 0: // timed out
+		{
+			sphWarning ( "timed out while trying to flush network buffers" );
+			m_bError = true;
+			break;
+		}
 
-	ESphQueryState eOld = SPH_QSTATE_TOTAL;
-	if ( m_pProfile )
-		eOld = m_pProfile->Switch ( SPH_QSTATE_NET_WRITE );
+		case -1: // error
+		{
+			int iErrno = sphSockGetErrno();
+			if ( iErrno==EINTR )
+				break;
+			sphWarning ( "select() failed: %d: %s", iErrno, sphSockError(iErrno) );
+			m_bError = true;
+			break;
+		}
+	}
+	return !m_bError;
+}
 
-	const int64_t tmMaxTimer = sphMicroTimer() + g_iWriteTimeout*1000000; // in microseconds
+
+void NetOutputBuffer_c::SendPlain ( const BYTE * pData, int iLen, int64_t tmMaxTimer )
+{
+	const char * pBuffer = reinterpret_cast<const char *> ( pData );
 	while ( !m_bError )
 	{
 		int iRes = sphSockSend ( m_iSock, pBuffer, iLen );
@@ -3232,51 +3636,154 @@ bool NetOutputBuffer_c::Flush ( bool bUnfreeze )
 		}
 
 		// wait until we can write
-		int64_t tmMicroLeft = tmMaxTimer - sphMicroTimer();
-		if ( tmMicroLeft>0 )
-			iRes = sphPoll ( m_iSock, tmMicroLeft, true );
-		else
-			iRes = 0; // time out
+		WaitWritable ( tmMaxTimer );
+	}
+}
 
-		switch ( iRes )
-		{
-			case 1: // ready for writing
-				break;
 
-			case 0: // timed out
+void NetOutputBuffer_c::SendVectored ( int64_t tmMaxTimer )
+{
+#if USE_WINDOWS
+	assert ( 0 && "INTERNAL ERROR: no vectored output on Windows" );
+#else
+	// close the chunk list with the buffer tail
+	int iTailLen = ( m_pBufferPtr-m_pBuffer ) - m_iTailOff;
+	if ( iTailLen>0 )
+	{
+		Chunk_t & tOwn = m_dChunks.Add();
+		tOwn.m_pData = NULL;
+		tOwn.m_iOff = m_iTailOff;
+		tOwn.m_iLen = iTailLen;
+	}
+
+	// buffer might have been reallocated since the chunks were queued, so resolve the offsets only now
+	CSphVector<struct iovec> dIov ( m_dChunks.GetLength() );
+	ARRAY_FOREACH ( i, m_dChunks )
+	{
+		const Chunk_t & tChunk = m_dChunks[i];
+		dIov[i].iov_base = (void*)( tChunk.m_pData ? tChunk.m_pData : m_pBuffer+tChunk.m_iOff );
+		dIov[i].iov_len = tChunk.m_iLen;
+	}
+
+	int iCur = 0;
+	while ( !m_bError && iCur<dIov.GetLength() )
+	{
+		struct msghdr tMsg;
+		memset ( &tMsg, 0, sizeof(tMsg) );
+		tMsg.msg_iov = dIov.Begin()+iCur;
+		tMsg.msg_iovlen = Min ( dIov.GetLength()-iCur, IOV_MAX );
+
+		int iRes = ::sendmsg ( m_iSock, &tMsg, MSG_NOSIGNAL );
+		if ( iRes < 0 )
+		{
+			int iErrno = sphSockGetErrno();
+			if ( iErrno==EINTR ) // interrupted before any data was sent; just loop
+				continue;
+			if ( iErrno!=EAGAIN && iErrno!=EWOULDBLOCK )
 			{
-				sphWarning ( "timed out while trying to flush network buffers" );
+				sphWarning ( "sendmsg() failed: %d: %s", iErrno, sphSockError(iErrno) );
 				m_bError = true;
 				break;
 			}
+		} else
+		{
+			m_iSent += iRes;
 
-			case -1: // error
+			// skip what was sent, maybe in the middle of an iovec
+			while ( iCur<dIov.GetLength() && iRes>=(int)dIov[iCur].iov_len )
+				iRes -= dIov[iCur++].iov_len;
+			if ( iCur<dIov.GetLength() )
 			{
-				int iErrno = sphSockGetErrno();
-				if ( iErrno==EINTR )
-					break;
-				sphWarning ( "select() failed: %d: %s", iErrno, sphSockError(iErrno) );
-				m_bError = true;
-				break;
+				dIov[iCur].iov_base = (BYTE*)dIov[iCur].iov_base + iRes;
+				dIov[iCur].iov_len -= iRes;
 			}
-		}
-	}
-
-	if ( m_pProfile )
-		m_pProfile->Switch ( eOld );
 
-	m_pBufferPtr = m_pBuffer;
-	return !m_bError;
-}
+			if ( iCur==dIov.GetLength() )
+				break;
+		}
 
-void NetOutputBuffer_c::FreezeBlock ( const char * sError, int iLen )
-{
-	m_sError = sError;
-	m_iErrorLength = iLen;
-	m_bFlushEnabled = false;
-	// reserve the DWORD for the size
-	m_pSize = m_pBufferPtr;
-	SendDword ( 0 );
+		// wait until we can write
+		WaitWritable ( tmMaxTimer );
+	}
+#endif
+}
+
+
+bool NetOutputBuffer_c::Flush ( bool bUnfreeze )
+{
+	if ( m_bError )
+		return false;
+
+	int iLen = m_pBufferPtr-m_pBuffer;
+	if ( iLen==0 && !m_dChunks.GetLength() )
+		return true;
+
+	if ( g_bGotSigterm )
+		sphLogDebug ( "SIGTERM in NetOutputBuffer::Flush" );
+
+	if ( bUnfreeze )
+	{
+		BYTE * pBuf = m_pBufferPtr;
+		m_pBufferPtr = m_pSize;
+		SendDword ( pBuf-m_pSize-4 );
+		m_pBufferPtr = pBuf;
+		m_bFlushEnabled = true;
+	}
+
+	// buffer overloaded. It is fail. Send the error message.
+	if ( !m_bFlushEnabled )
+	{
+		sphLogDebug ( "NetOutputBuffer with disabled flush is overloaded" );
+		m_pBufferPtr = m_pBuffer;
+		m_dChunks.Resize ( 0 );
+		m_iTailOff = 0;
+		SendBytes ( m_sError, m_iErrorLength );
+		iLen = m_pBufferPtr-m_pBuffer;
+		if ( iLen==0 )
+			return true;
+	}
+
+	assert ( iLen>0 || m_dChunks.GetLength() );
+	assert ( iLen<=(int)m_iBufferSize );
+
+	ESphQueryState eOld = SPH_QSTATE_TOTAL;
+	if ( m_pProfile )
+		eOld = m_pProfile->Switch ( SPH_QSTATE_NET_WRITE );
+
+	const int64_t tmMaxTimer = sphMicroTimer() + g_iWriteTimeout*1000000; // in microseconds
+	if ( m_pMuxLock )
+	{
+		// shared link; prepend the frame header, and never interleave with the other frames
+		assert ( !m_dChunks.GetLength() );
+		DWORD dFrame[2];
+		dFrame[0] = htonl ( m_uMuxId );
+		dFrame[1] = htonl ( iLen );
+		CSphScopedLock<CSphMutex> tLock ( *m_pMuxLock );
+		SendPlain ( (const BYTE *)dFrame, sizeof(dFrame), tmMaxTimer );
+		SendPlain ( m_pBuffer, iLen, tmMaxTimer );
+		m_iSent -= ( m_bError ? 0 : sizeof(dFrame) ); // callers check the sent reply sizes; framing is not a part of those
+	} else if ( m_dChunks.GetLength() )
+		SendVectored ( tmMaxTimer );
+	else
+		SendPlain ( m_pBuffer, iLen, tmMaxTimer );
+
+	if ( m_pProfile )
+		m_pProfile->Switch ( eOld );
+
+	m_pBufferPtr = m_pBuffer;
+	m_dChunks.Resize ( 0 );
+	m_iTailOff = 0;
+	return !m_bError;
+}
+
+void NetOutputBuffer_c::FreezeBlock ( const char * sError, int iLen )
+{
+	m_sError = sError;
+	m_iErrorLength = iLen;
+	m_bFlushEnabled = false;
+	// reserve the DWORD for the size
+	m_pSize = m_pBufferPtr;
+	SendDword ( 0 );
 }
 
 
@@ -3561,6 +4068,26 @@ void NetInputBuffer_c::SendErrorReply ( const char * sTemplate, ... )
 		sphInfo ( "query error: %s", sBuf );
 }
 
+
+void MuxInputBuffer_c::SendErrorReply ( const char * sTemplate, ... )
+{
+	char sBuf [ 2048 ];
+
+	va_list ap;
+	va_start ( ap, sTemplate );
+	vsnprintf ( sBuf, sizeof(sBuf), sTemplate, ap );
+	va_end ( ap );
+	sBuf [ sizeof(sBuf)-1 ] = '\0';
+
+	// the buffer picks the request id from the thread
+	NetOutputBuffer_c tOut ( m_iSock );
+	tOut.SendWord ( SEARCHD_ERROR );
+	tOut.SendWord ( 0 ); // version doesn't matter
+	tOut.SendInt ( 4+strlen(sBuf) );
+	tOut.SendString ( sBuf );
+	tOut.Flush ();
+}
+
 // fix MSVC 2005 fuckup
 #if USE_WINDOWS
 #pragma conform(forScope,on)
@@ -3576,7 +4103,8 @@ enum HAStrategies_e {
 	HA_AVOIDDEAD,
 	HA_AVOIDERRORS,
 	HA_AVOIDDEADTM,			///< the same as HA_AVOIDDEAD, but uses just min timeout instead of weighted random
-	HA_AVOIDERRORSTM		///< the same as HA_AVOIDERRORS, but uses just min timeout instead of weighted random
+	HA_AVOIDERRORSTM,		///< the same as HA_AVOIDERRORS, but uses just min timeout instead of weighted random
+	HA_EWMA					///< least moving average latency times outstanding requests
 };
 
 class InterWorkerStorage : public ISphNoncopyable
@@ -4053,6 +4581,96 @@ public:
 	}
 
 
+	/// pick the mirror with the least expected wait, ie. moving average latency times (outstanding requests + 1)
+	/// mirrors with no latency stats yet are assumed as fast as the fastest known one, so that they get probed;
+	/// dead ones (several hard errors in a row) are only picked when everything else is dead too
+	int LeastLatencyAgent ( int iSkipDash ) const
+	{
+		const int64_t iDeadThr = 3;
+
+		float fFastest = 0.0f;
+		ARRAY_FOREACH ( i, m_dAgents )
+		{
+			float fLatency = GetCommonStat(i).m_fLatencyEwma;
+			if ( fLatency>0.0f && ( fFastest<=0.0f || fLatency<fFastest ) )
+				fFastest = fLatency;
+		}
+		if ( fFastest<=0.0f )
+			fFastest = 1.0f;
+
+		int iBestAgent = -1;
+		int iTies = 0;
+		float fBestScore = 0.0f;
+		bool bBestDead = true;
+		ARRAY_FOREACH ( i, m_dAgents )
+		{
+			if ( m_dAgents[i].m_iDashIndex==iSkipDash )
+				continue;
+
+			// no locks for g_pStats since we just reading, and read data is not critical.
+			const HostDashboard_t & dDash = GetCommonStat ( i );
+			bool bDead = ( dDash.m_iErrorsARow>iDeadThr );
+			float fScore = ( dDash.m_fLatencyEwma>0.0f ? dDash.m_fLatencyEwma : fFastest ) * ( Max ( dDash.m_iOutstanding, 0 )+1 );
+
+			if ( iBestAgent<0 || ( bBestDead && !bDead ) || ( bDead==bBestDead && fScore<fBestScore ) )
+			{
+				iBestAgent = i;
+				fBestScore = fScore;
+				bBestDead = bDead;
+				iTies = 1;
+			} else if ( bDead==bBestDead && fScore==fBestScore && ( sphRand() % ++iTies )==0 )
+			{
+				iBestAgent = i;
+			}
+		}
+		return iBestAgent;
+	}
+
+	AgentDesc_t * StLeastLatency ()
+	{
+		if ( !g_pStats )
+			return RandAgent();
+
+		if ( m_dAgents.GetLength()==1 )
+			return GetAgent(0);
+
+		int iBestAgent = LeastLatencyAgent ( -1 );
+		sphLogDebug ( "HA selected %d node with least expected latency", iBestAgent );
+		return GetAgent ( iBestAgent );
+	}
+
+	/// pick a mirror on some other host for a backup request; NULL if there is none
+	AgentDesc_t * HedgeAgent ( int iPrimaryDash )
+	{
+		if ( !g_pStats )
+			return NULL;
+
+		int iAgent = LeastLatencyAgent ( iPrimaryDash );
+		return iAgent<0 ? NULL : GetAgent ( iAgent );
+	}
+
+	/// hedge delay, in usec; given percentile of recent answer latencies, pooled over all the mirrors
+	/// returns -1 while there are too few samples to tell
+	int64_t GetHedgeDelay ( int iPercentile ) const
+	{
+		if ( !g_pStats )
+			return -1;
+
+		CSphVector<int> dSamples;
+		ARRAY_FOREACH ( i, m_dAgents )
+		{
+			const HostDashboard_t & dDash = GetCommonStat ( i );
+			for ( int j=0; j<dDash.GetLatencySamples(); j++ )
+				dSamples.Add ( dDash.m_dLatencies[j] );
+		}
+
+		if ( dSamples.GetLength()<HEDGE_MIN_SAMPLES )
+			return -1;
+
+		dSamples.Sort();
+		return dSamples [ Min ( dSamples.GetLength()*iPercentile/100, dSamples.GetLength()-1 ) ];
+	}
+
 	AgentDesc_t * GetRRAgent ( HAStrategies_e eStrategy )
 	{
 		switch ( eStrategy )
@@ -4063,6 +4681,8 @@ public:
 			return StLowErrors();
 		case HA_ROUNDROBIN:
 			return RRAgent();
+		case HA_EWMA:
+			return StLeastLatency();
 		default:
 			return RandAgent();
 		}
@@ -4129,6 +4749,8 @@ enum AgentState_e
 };
 
 /// remote agent connection (local per-query state)
+class AgentMuxLink_c;
+
 struct AgentConn_t : public AgentDesc_t
 {
 	int				m_iSock;		///< socket number, -1 if not connected
@@ -4153,6 +4775,16 @@ struct AgentConn_t : public AgentDesc_t
 	int				m_iStoreTag;
 	int				m_iWeight;
 
+	AgentConn_t *	m_pTwin;		///< the other connection of a hedged request, if any; first one to answer wins
+	bool			m_bAnswered;	///< got a complete reply (unlike m_bSuccess, never reset on merge)
+	bool			m_bPing;		///< ping request, does not count towards host latency stats
+	bool			m_bOutstanding;	///< counted in the host outstanding requests
+
+	bool				m_bMux;			///< goes over a shared multiplexed link; m_iSock is then the reply notification pipe
+	AgentMuxLink_c *	m_pMuxLink;		///< that link, while the request is in flight
+	DWORD				m_uMuxId;		///< request id on that link
+	int					m_iMuxNotify;	///< notification pipe write end
+
 public:
 	AgentConn_t ()
 		: m_iSock ( -1 )
@@ -4170,6 +4802,14 @@ public:
 		, m_iWorkerTag ( -1 )
 		, m_iStoreTag ( 0 )
 		, m_iWeight ( -1 )
+		, m_pTwin ( NULL )
+		, m_bAnswered ( false )
+		, m_bPing ( false )
+		, m_bOutstanding ( false )
+		, m_bMux ( false )
+		, m_pMuxLink ( NULL )
+		, m_uMuxId ( 0 )
+		, m_iMuxNotify ( -1 )
 	{}
 
 	~AgentConn_t ()
@@ -4181,6 +4821,9 @@ public:
 
 	void Close ( bool bClosePersist=true )
 	{
+		SetOutstanding ( false );
+		if ( m_pMuxLink )
+			CloseMux ();
 		SafeDeleteArray ( m_pReplyBuf );
 		if ( m_iSock>0 )
 		{
@@ -4199,6 +4842,31 @@ public:
 
 	void Fail ( eAgentStats eStat, const char* sMessage, ... ) __attribute__ ( ( format ( printf, 3, 4 ) ) );
 
+	/// detach from the multiplexed link; a reply that arrives later gets dropped
+	void CloseMux ();
+
+	/// pick up the reply handed over by the multiplexed link reader
+	bool TakeMuxReply ();
+
+	/// account this request in the host outstanding requests counter
+	void SetOutstanding ( bool bOutstanding )
+	{
+		if ( m_bOutstanding==bOutstanding || !g_pStats || m_iDashIndex<0 || m_iDashIndex>=STATS_MAX_DASH )
+			return;
+
+		m_bOutstanding = bOutstanding;
+		g_tStatsMutex.Lock();
+		int & iOutstanding = g_pStats->m_dDashboard.m_dItemStats[m_iDashIndex].m_iOutstanding;
+		iOutstanding = Max ( iOutstanding + ( bOutstanding ? 1 : -1 ), 0 );
+		g_tStatsMutex.Unlock();
+	}
+
+	/// whether the other connection of a hedged request has already answered
+	inline bool IsHedgeLoser () const
+	{
+		return m_pTwin && m_pTwin->m_bAnswered;
+	}
+
 	AgentConn_t & operator = ( const AgentDesc_t & rhs )
 	{
 		m_sHost = rhs.m_sHost;
@@ -4220,6 +4888,12 @@ public:
 	void TakeTraits ( AgentDesc_t & rhs )
 	{
 		*this = rhs;
+
+		// persistent agents share a few multiplexed links instead of renting exclusive sockets, if configured
+		m_bMux = ( m_bPersistent && g_iAgentMuxConnections>0 );
+		if ( m_bMux )
+			m_bPersistent = false;
+
 		if ( m_bPersistent )
 		{
 			m_iSock = m_dPersPool.RentConnection();
@@ -4240,6 +4914,7 @@ struct DistributedIndex_t
 	bool						m_bToDelete;				///< should be deleted
 	bool						m_bDivideRemoteRanges;			///< whether we divide big range onto agents or not
 	HAStrategies_e				m_eHaStrategy;				///< how to select the best of my agents
+	int							m_iHedgePercentile;			///< send a hedged request to another mirror after this latency percentile (0 means never)
 	InterWorkerStorage *		m_pHAStorage;				///< IPC HA arrays
 
 public:
@@ -4249,6 +4924,7 @@ public:
 		, m_bToDelete ( false )
 		, m_bDivideRemoteRanges ( false )
 		, m_eHaStrategy ( HA_RANDOM )
+		, m_iHedgePercentile ( 0 )
 		, m_pHAStorage ( NULL )
 	{}
 	~DistributedIndex_t()
@@ -4358,6 +5034,8 @@ inline void agent_stats_inc ( AgentConn_t & tAgent, eAgentStats iCounter )
 				g_pStats->m_dDashboard.m_dItemStats [ tAgent.m_iDashIndex ].m_iLastQueryTime = tAgent.m_iStartQuery;
 				g_pStats->m_dDashboard.m_dItemStats [ tAgent.m_iDashIndex ].m_iLastAnswerTime = tAgent.m_iEndQuery;
 				pCurStat[eTotalMsecs]+=tAgent.m_iEndQuery-tAgent.m_iStartQuery;
+				if ( !tAgent.m_bPing && ( iCounter==eNoErrors || iCounter==eWarnings || iCounter==eTimeoutsQuery ) )
+					g_pStats->m_dDashboard.m_dItemStats [ tAgent.m_iDashIndex ].AddLatency ( tAgent.m_iEndQuery-tAgent.m_iStartQuery, iCounter!=eTimeoutsQuery );
 			}
 		}
 		g_tStatsMutex.Unlock ();
@@ -4374,24 +5052,709 @@ void AgentConn_t::Fail ( eAgentStats eStat, const char* sMessage, ... )
 	agent_stats_inc ( *this, eStat );
 }
 
-struct AgentConnectionContext_t
-{
-	const IRequestBuilder_t * m_pBuilder;
-	AgentConn_t	* m_pAgents;
-	int m_iAgentCount;
-	int m_iTimeout;
-	int m_iRetriesMax;
-	int m_iDelay;
+struct AgentConnectionContext_t
+{
+	const IRequestBuilder_t * m_pBuilder;
+	AgentConn_t	* m_pAgents;
+	int m_iAgentCount;
+	int m_iTimeout;
+	int m_iRetriesMax;
+	int m_iDelay;
+
+	AgentConnectionContext_t ()
+		: m_pBuilder ( NULL )
+		, m_pAgents ( NULL )
+		, m_iAgentCount ( 0 )
+		, m_iTimeout ( 0 )
+		, m_iRetriesMax ( 0 )
+		, m_iDelay ( 0 )
+	{}
+};
+
+/// fill the agent socket address, return its length
+static socklen_t AgentSockAddr ( const AgentDesc_t & tAgent, struct sockaddr_storage & ss )
+{
+	socklen_t len = 0;
+	memset ( &ss, 0, sizeof(ss) );
+	ss.ss_family = (short)tAgent.m_iFamily;
+
+	if ( ss.ss_family==AF_INET )
+	{
+		struct sockaddr_in *in = (struct sockaddr_in *)&ss;
+		in->sin_port = htons ( (unsigned short)tAgent.m_iPort );
+		in->sin_addr.s_addr = tAgent.m_uAddr;
+		len = sizeof(*in);
+	}
+#if !USE_WINDOWS
+	else if ( ss.ss_family==AF_UNIX )
+	{
+		struct sockaddr_un *un = (struct sockaddr_un *)&ss;
+		snprintf ( un->sun_path, sizeof(un->sun_path), "%s", tAgent.m_sPath.cstr() );
+		len = sizeof(*un);
+	}
+#endif
+	return len;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// MULTIPLEXED AGENT LINKS
+/////////////////////////////////////////////////////////////////////////////
+
+#if !USE_WINDOWS
+
+/// wake up the owner of a multiplexed request
+static void MuxNotify ( const AgentConn_t & tAgent )
+{
+	BYTE uByte = 1;
+	while ( ::write ( tAgent.m_iMuxNotify, &uByte, 1 )<0 && errno==EINTR );
+}
+
+
+/// long-lived connection to an agent host, shared by the concurrent queries
+/// every request and every reply goes in a frame (DWORD id, DWORD length, then the usual packet);
+/// the replies come back in any order, and the reader thread hands them over by id
+class AgentMuxLink_c : public ISphNoncopyable
+{
+public:
+	int				m_iSock;
+	int				m_iDashIndex;
+	bool			m_bReady;		///< handshake done, usable for queries (guarded by the pool lock)
+	CSphMutex		m_tSendLock;	///< whole frames are written under it
+
+public:
+	explicit AgentMuxLink_c ( int iDashIndex )
+		: m_iSock ( -1 )
+		, m_iDashIndex ( iDashIndex )
+		, m_bReady ( false )
+		, m_bBroken ( false )
+		, m_iRefs ( 1 )
+		, m_uNextId ( 0 )
+		, m_iHeadRead ( 0 )
+		, m_pBody ( NULL )
+		, m_iBodyLen ( 0 )
+		, m_iBodyRead ( 0 )
+	{
+		m_tSendLock.Init();
+		m_tLock.Init();
+	}
+
+	~AgentMuxLink_c ()
+	{
+		assert ( !m_hPending.GetLength() );
+		if ( m_iSock>=0 )
+			sphSockClose ( m_iSock );
+		SafeDeleteArray ( m_pBody );
+		m_tLock.Done();
+		m_tSendLock.Done();
+	}
+
+	bool	Connect ( const AgentDesc_t & tAgent, int iTimeout, CSphString & sError, bool & bRefused );
+	bool	Register ( AgentConn_t & tAgent );
+	void	Unregister ( const AgentConn_t & tAgent );
+	bool	ReadFrames ( CSphString & sError );
+	void	Break ( const CSphString & sReason );
+
+	int GetPending ()
+	{
+		CSphScopedLock<CSphMutex> tLock ( m_tLock );
+		return m_hPending.GetLength();
+	}
+
+	void AddRef ()
+	{
+		CSphScopedLock<CSphMutex> tLock ( m_tLock );
+		++m_iRefs;
+	}
+
+	void Release ()
+	{
+		m_tLock.Lock();
+		bool bLast = ( --m_iRefs==0 );
+		m_tLock.Unlock();
+		if ( bLast )
+			delete this;
+	}
+
+private:
+	CSphMutex		m_tLock;		///< guards the pending requests and the refcount
+	bool			m_bBroken;
+	int				m_iRefs;
+	DWORD			m_uNextId;
+	CSphOrderedHash < AgentConn_t *, DWORD, IdentityHash_fn, 256 > m_hPending;	///< in-flight requests by id
+
+	// reader state, only touched by the reader thread
+	BYTE			m_dHead[16];	///< frame id, frame length, reply status and version, reply length
+	int				m_iHeadRead;
+	BYTE *			m_pBody;
+	int				m_iBodyLen;
+	int				m_iBodyRead;
+
+	void			Deliver ( DWORD uId, int iStatus );
+};
+
+
+bool AgentMuxLink_c::Connect ( const AgentDesc_t & tAgent, int iTimeout, CSphString & sError, bool & bRefused )
+{
+	bRefused = false;
+
+	struct sockaddr_storage ss;
+	socklen_t len = AgentSockAddr ( tAgent, ss );
+
+	m_iSock = socket ( tAgent.m_iFamily, SOCK_STREAM, 0 );
+	if ( m_iSock<0 )
+	{
+		sError.SetSprintf ( "socket() failed: %s", sphSockError() );
+		return false;
+	}
+
+	if ( sphSetSockNB ( m_iSock )<0 )
+	{
+		sError.SetSprintf ( "sphSetSockNB() failed: %s", sphSockError() );
+		return false;
+	}
+
+#ifdef TCP_NODELAY
+	int iOn = 1;
+	if ( tAgent.m_iFamily==AF_INET && setsockopt ( m_iSock, IPPROTO_TCP, TCP_NODELAY, (char*)&iOn, sizeof(iOn) ) )
+	{
+		sError.SetSprintf ( "setsockopt() failed: %s", sphSockError() );
+		return false;
+	}
+#endif
+
+	if ( g_pStats )
+	{
+		g_tStatsMutex.Lock();
+		g_pStats->m_iAgentConnect++;
+		g_tStatsMutex.Unlock();
+	}
+
+	if ( connect ( m_iSock, (struct sockaddr*)&ss, len )<0 )
+	{
+		int iErr = sphSockGetErrno();
+		if ( iErr!=EINPROGRESS && iErr!=EINTR && iErr!=EWOULDBLOCK )
+		{
+			sError.SetSprintf ( "connect() failed: %s", sphSockError(iErr) );
+			return false;
+		}
+
+		if ( sphPoll ( m_iSock, iTimeout*I64C(1000), true )<=0 )
+		{
+			sError = "connect() timed out";
+			return false;
+		}
+
+		iErr = 0;
+		socklen_t iErrLen = sizeof(iErr);
+		getsockopt ( m_iSock, SOL_SOCKET, SO_ERROR, (char*)&iErr, &iErrLen );
+		if ( iErr )
+		{
+			sError.SetSprintf ( "connect() failed: %s", strerror(iErr) );
+			return false;
+		}
+	}
+
+	// switch the connection to the multiplexed mode
+	NetOutputBuffer_c tOut ( m_iSock );
+	tOut.SendDword ( SPHINX_CLIENT_VERSION );
+	tOut.SendWord ( SEARCHD_COMMAND_MULTIPLEX );
+	tOut.SendWord ( VER_COMMAND_MULTIPLEX );
+	tOut.SendInt ( 0 );
+	if ( !tOut.Flush() )
+	{
+		sError = "failed to send multiplex handshake";
+		return false;
+	}
+
+	// server version, reply status and version, reply length, accepted flag
+	// an older agent replies with an error, which is long enough as well
+	DWORD dReply[4];
+	if ( sphSockRead ( m_iSock, dReply, sizeof(dReply), Max ( iTimeout/1000, 1 ), false )!=(int)sizeof(dReply) )
+	{
+		sError = "failed to receive multiplex handshake reply";
+		return false;
+	}
+
+	if ( ntohs ( *(WORD*)( dReply+1 ) )!=SEARCHD_OK || ntohl ( dReply[3] )!=1 )
+	{
+		sError = "agent refused multiplexed connection";
+		bRefused = true;
+		return false;
+	}
+	return true;
+}
+
+
+bool AgentMuxLink_c::Register ( AgentConn_t & tAgent )
+{
+	CSphScopedLock<CSphMutex> tLock ( m_tLock );
+	if ( m_bBroken )
+		return false;
+
+	tAgent.m_uMuxId = ++m_uNextId;
+	tAgent.m_pMuxLink = this;
+	m_hPending.Add ( &tAgent, tAgent.m_uMuxId );
+	return true;
+}
+
+
+void AgentMuxLink_c::Unregister ( const AgentConn_t & tAgent )
+{
+	CSphScopedLock<CSphMutex> tLock ( m_tLock );
+	AgentConn_t ** ppAgent = m_hPending ( tAgent.m_uMuxId );
+	if ( ppAgent && *ppAgent==&tAgent )
+		m_hPending.Delete ( tAgent.m_uMuxId );
+}
+
+
+void AgentMuxLink_c::Deliver ( DWORD uId, int iStatus )
+{
+	CSphScopedLock<CSphMutex> tLock ( m_tLock );
+	AgentConn_t ** ppAgent = m_hPending ( uId );
+	if ( !ppAgent )
+	{
+		// the request was abandoned meanwhile (timed out, or hedged and answered elsewhere)
+		SafeDeleteArray ( m_pBody );
+		return;
+	}
+
+	AgentConn_t & tAgent = **ppAgent;
+	m_hPending.Delete ( uId );
+
+	assert ( !tAgent.m_pReplyBuf );
+	tAgent.m_pReplyBuf = m_pBody;
+	tAgent.m_iReplySize = m_iBodyLen;
+	tAgent.m_iReplyRead = m_iBodyLen;
+	tAgent.m_iReplyStatus = iStatus;
+	m_pBody = NULL;
+	MuxNotify ( tAgent );
+}
+
+
+bool AgentMuxLink_c::ReadFrames ( CSphString & sError )
+{
+	for ( ;; )
+	{
+		bool bHead = ( m_iHeadRead<(int)sizeof(m_dHead) );
+		BYTE * pDst = bHead ? m_dHead+m_iHeadRead : m_pBody+m_iBodyRead;
+		int iWant = bHead ? (int)sizeof(m_dHead)-m_iHeadRead : m_iBodyLen-m_iBodyRead;
+
+		if ( iWant>0 )
+		{
+			int iRes = sphSockRecv ( m_iSock, (char*)pDst, iWant );
+			if ( iRes==0 )
+			{
+				sError = "agent closed the connection";
+				return false;
+			}
+			if ( iRes<0 )
+			{
+				int iErr = sphSockGetErrno();
+				if ( iErr==EAGAIN || iErr==EWOULDBLOCK || iErr==EINTR )
+					return true;
+				sError.SetSprintf ( "failed to receive reply: %s", sphSockError(iErr) );
+				return false;
+			}
+
+			if ( bHead )
+			{
+				m_iHeadRead += iRes;
+				if ( m_iHeadRead<(int)sizeof(m_dHead) )
+					continue;
+
+				int iFrameLen = ntohl ( sphUnalignedRead ( *(DWORD*)( m_dHead+4 ) ) );
+				m_iBodyLen = ntohl ( sphUnalignedRead ( *(DWORD*)( m_dHead+12 ) ) );
+				if ( m_iBodyLen<0 || m_iBodyLen>g_iMaxPacketSize || iFrameLen!=m_iBodyLen+8 )
+				{
+					sError.SetSprintf ( "invalid multiplexed frame (length=%d, reply length=%d)", iFrameLen, m_iBodyLen );
+					return false;
+				}
+				m_pBody = new BYTE [ m_iBodyLen ];
+				m_iBodyRead = 0;
+			} else
+				m_iBodyRead += iRes;
+		}
+
+		if ( m_iHeadRead==(int)sizeof(m_dHead) && m_iBodyRead==m_iBodyLen )
+		{
+			DWORD uId = ntohl ( sphUnalignedRead ( *(DWORD*)m_dHead ) );
+			int iStatus = ntohs ( sphUnalignedRead ( *(WORD*)( m_dHead+8 ) ) );
+			Deliver ( uId, iStatus );
+			m_iHeadRead = 0;
+		}
+	}
+}
+
+
+void AgentMuxLink_c::Break ( const CSphString & sReason )
+{
+	CSphScopedLock<CSphMutex> tLock ( m_tLock );
+	m_bBroken = true;
+	m_hPending.IterateStart();
+	while ( m_hPending.IterateNext() )
+	{
+		AgentConn_t & tAgent = *m_hPending.IterateGet();
+		tAgent.m_sFailure = sReason;
+		MuxNotify ( tAgent );
+	}
+	m_hPending.Reset();
+}
+
+
+/// multiplexed links to all the agent hosts, and the thread that reads their replies
+class AgentMuxPool_c
+{
+public:
+	AgentMuxPool_c ()
+		: m_bStarted ( false )
+	{
+		m_tLock.Init();
+		m_dWake[0] = m_dWake[1] = -1;
+	}
+
+	~AgentMuxPool_c ()
+	{
+		m_tLock.Done();
+	}
+
+	bool	Query ( AgentConn_t & tAgent, const IRequestBuilder_t & tBuilder, int iTimeout, CSphString & sError );
+	bool	IsRefused ( int iDashIndex );
+	void	Shutdown ();
+
+private:
+	CSphMutex						m_tLock;		///< guards everything below
+	CSphVector<AgentMuxLink_c *>	m_dLinks;
+	CSphVector<int>					m_dRefused;		///< hosts that do not speak the multiplexed protocol
+	SphThread_t						m_tReader;
+	bool							m_bStarted;
+	int								m_dWake[2];		///< wakes the reader up when the links change
+
+	AgentMuxLink_c *	GetLink ( const AgentDesc_t & tAgent, int iTimeout, CSphString & sError );
+	void				RemoveLink ( AgentMuxLink_c * pLink );
+	void				Wake ();
+	void				ReadLoop ();
+
+	static void ReaderThread ( void * pArg )
+	{
+		( (AgentMuxPool_c *)pArg )->ReadLoop();
+	}
+};
+
+static AgentMuxPool_c g_tAgentMux;
+
+
+bool AgentMuxPool_c::IsRefused ( int iDashIndex )
+{
+	CSphScopedLock<CSphMutex> tLock ( m_tLock );
+	return m_dRefused.Contains ( iDashIndex );
+}
+
+
+void AgentMuxPool_c::Wake ()
+{
+	BYTE uByte = 1;
+	while ( ::write ( m_dWake[1], &uByte, 1 )<0 && errno==EINTR );
+}
+
+
+AgentMuxLink_c * AgentMuxPool_c::GetLink ( const AgentDesc_t & tAgent, int iTimeout, CSphString & sError )
+{
+	AgentMuxLink_c * pLink = NULL;
+	int64_t tmMaxTimer = sphMicroTimer() + iTimeout*1000;
+	for ( bool bFirst = true; !pLink; bFirst = false )
+	{
+		// all the links to that host are still connecting; wait for one
+		if ( !bFirst )
+		{
+			if ( sphMicroTimer()>=tmMaxTimer )
+			{
+				sError = "timed out waiting for a multiplexed link";
+				return NULL;
+			}
+			sphSleepMsec ( 1 );
+		}
+
+		CSphScopedLock<CSphMutex> tLock ( m_tLock );
+		if ( !m_bStarted )
+		{
+			if ( pipe ( m_dWake ) || sphSetSockNB ( m_dWake[0] )<0 )
+			{
+				sError.SetSprintf ( "pipe() failed: %s", strerror(errno) );
+				return NULL;
+			}
+			if ( !SphCrashLogger_c::ThreadCreate ( &m_tReader, ReaderThread, this ) )
+			{
+				sError.SetSprintf ( "failed to create agent link reader thread: %s", strerror(errno) );
+				return NULL;
+			}
+			m_bStarted = true;
+		}
+
+		// the least busy link to that host; open one more while below the limit, and all are busy
+		AgentMuxLink_c * pBest = NULL;
+		int iBestPending = 0;
+		int iLinks = 0;
+		ARRAY_FOREACH ( i, m_dLinks )
+		{
+			AgentMuxLink_c * pCur = m_dLinks[i];
+			if ( pCur->m_iDashIndex!=tAgent.m_iDashIndex )
+				continue;
+			++iLinks;
+			if ( !pCur->m_bReady )
+				continue;
+			int iPending = pCur->GetPending();
+			if ( !pBest || iPending<iBestPending )
+			{
+				pBest = pCur;
+				iBestPending = iPending;
+			}
+		}
+
+		if ( pBest && ( !iBestPending || iLinks>=g_iAgentMuxConnections ) )
+		{
+			pBest->AddRef();
+			return pBest;
+		}
+
+		if ( iLinks<g_iAgentMuxConnections )
+		{
+			pLink = new AgentMuxLink_c ( tAgent.m_iDashIndex );
+			pLink->AddRef(); // one for the pool, one for the caller
+			m_dLinks.Add ( pLink );
+		}
+	}
+
+	bool bRefused = false;
+	bool bOk = pLink->Connect ( tAgent, iTimeout, sError, bRefused );
+
+	CSphScopedLock<CSphMutex> tLock ( m_tLock );
+	if ( bOk )
+	{
+		pLink->m_bReady = true;
+		Wake();
+		return pLink;
+	}
+
+	m_dLinks.RemoveValue ( pLink );
+	if ( bRefused && !m_dRefused.Contains ( tAgent.m_iDashIndex ) )
+		m_dRefused.Add ( tAgent.m_iDashIndex );
+	pLink->Release();
+	pLink->Release();
+	return NULL;
+}
+
+
+void AgentMuxPool_c::RemoveLink ( AgentMuxLink_c * pLink )
+{
+	m_tLock.Lock();
+	bool bOwned = m_dLinks.RemoveValue ( pLink );
+	m_tLock.Unlock();
+	if ( bOwned )
+		pLink->Release();
+}
+
+
+bool AgentMuxPool_c::Query ( AgentConn_t & tAgent, const IRequestBuilder_t & tBuilder, int iTimeout, CSphString & sError )
+{
+	AgentMuxLink_c * pLink = GetLink ( tAgent, iTimeout, sError );
+	if ( !pLink )
+		return false;
+
+	// the reply is handed over through a pipe, so that the usual socket polling loops can wait for it
+	int dPipe[2];
+	if ( pipe ( dPipe ) )
+	{
+		sError.SetSprintf ( "pipe() failed: %s", strerror(errno) );
+		pLink->Release();
+		return false;
+	}
+	tAgent.m_iSock = dPipe[0];
+	tAgent.m_iMuxNotify = dPipe[1];
+
+	// the agent takes over the caller's link reference
+	if ( !pLink->Register ( tAgent ) )
+	{
+		::close ( dPipe[0] );
+		::close ( dPipe[1] );
+		tAgent.m_iSock = -1;
+		tAgent.m_iMuxNotify = -1;
+		pLink->Release();
+		sError = "multiplexed link is closed";
+		return false;
+	}
+
+	NetOutputBuffer_c tOut ( pLink->m_iSock );
+	tOut.SetMultiplexed ( &pLink->m_tSendLock, tAgent.m_uMuxId );
+	tBuilder.BuildRequest ( tAgent, tOut );
+	if ( !tOut.Flush() )
+	{
+		// a partial frame might be sent, so the link is unusable now;
+		// the reader notices that, and fails the other requests too
+		shutdown ( pLink->m_iSock, SHUT_RDWR );
+		sError = "failed to send query over multiplexed link";
+		return false;
+	}
+	return true;
+}
+
+
+void AgentMuxPool_c::ReadLoop ()
+{
+	CSphVector<AgentMuxLink_c *> dLinks;
+	CSphVector<struct pollfd> dFds;
+
+	while ( !g_bShutdown )
+	{
+		dLinks.Resize ( 0 );
+		dFds.Resize ( 0 );
+
+		m_tLock.Lock();
+		ARRAY_FOREACH ( i, m_dLinks )
+			if ( m_dLinks[i]->m_bReady )
+			{
+				dLinks.Add ( m_dLinks[i] );
+				struct pollfd & tFd = dFds.Add();
+				tFd.fd = m_dLinks[i]->m_iSock;
+				tFd.events = POLLIN;
+				tFd.revents = 0;
+			}
+		m_tLock.Unlock();
+
+		struct pollfd & tWake = dFds.Add();
+		tWake.fd = m_dWake[0];
+		tWake.events = POLLIN;
+		tWake.revents = 0;
+
+		if ( ::poll ( dFds.Begin(), dFds.GetLength(), 1000 )<=0 )
+			continue;
+
+		if ( dFds.Last().revents )
+		{
+			BYTE dBuf[64];
+			while ( ::read ( m_dWake[0], dBuf, sizeof(dBuf) )>0 );
+		}
+
+		// only this thread removes the ready links, so the snapshot stays valid
+		ARRAY_FOREACH ( i, dLinks )
+		{
+			if ( !dFds[i].revents )
+				continue;
+
+			CSphString sError;
+			if ( dLinks[i]->ReadFrames ( sError ) )
+				continue;
+
+			sphWarning ( "multiplexed agent link failed: %s", sError.cstr() );
+			dLinks[i]->Break ( sError );
+			RemoveLink ( dLinks[i] );
+		}
+	}
+}
+
+
+void AgentMuxPool_c::Shutdown ()
+{
+	if ( !m_bStarted )
+		return;
+
+	Wake();
+	sphThreadJoin ( &m_tReader );
+
+	CSphString sReason = "shutting down";
+	ARRAY_FOREACH ( i, m_dLinks )
+	{
+		m_dLinks[i]->Break ( sReason );
+		m_dLinks[i]->Release();
+	}
+	m_dLinks.Reset();
+
+	::close ( m_dWake[0] );
+	::close ( m_dWake[1] );
+	m_bStarted = false;
+}
+
+
+void AgentConn_t::CloseMux ()
+{
+	m_pMuxLink->Unregister ( *this );
+	m_pMuxLink->Release();
+	m_pMuxLink = NULL;
+
+	::close ( m_iSock );
+	::close ( m_iMuxNotify );
+	m_iSock = -1;
+	m_iMuxNotify = -1;
+	if ( m_eState!=AGENT_RETRY )
+		m_eState = AGENT_UNUSED;
+}
+
+
+bool AgentConn_t::TakeMuxReply ()
+{
+	// the reader either handed the reply over, or failed the whole link
+	BYTE uByte;
+	while ( ::read ( m_iSock, &uByte, 1 )<0 && errno==EINTR );
+
+	if ( !m_pReplyBuf )
+	{
+		if ( m_sFailure.IsEmpty() )
+			m_sFailure = "multiplexed link failed";
+		return false;
+	}
+
+	m_eState = AGENT_REPLY;
+	return true;
+}
+
+
+static bool AgentMuxRefused ( int iDashIndex )
+{
+	return g_tAgentMux.IsRefused ( iDashIndex );
+}
+
+
+static void AgentMuxShutdown ()
+{
+	g_tAgentMux.Shutdown();
+}
+
+
+/// send the queries of the multiplexed agents over the shared links, return how many were sent
+static int RemoteQueryMuxAgents ( AgentConnectionContext_t * pCtx )
+{
+	int iAgents = 0;
+	for ( int i=0; i<pCtx->m_iAgentCount; i++ )
+	{
+		AgentConn_t & tAgent = pCtx->m_pAgents[i];
+		if ( !tAgent.m_bMux || tAgent.m_eState!=AGENT_ESTABLISHED )
+			continue;
+
+		CSphString sError;
+		if ( !g_tAgentMux.Query ( tAgent, *pCtx->m_pBuilder, pCtx->m_iTimeout, sError ) )
+		{
+			tAgent.Fail ( eConnectFailures, "%s", sError.cstr() );
+			tAgent.m_eState = AGENT_RETRY;
+			continue;
+		}
+		tAgent.m_eState = AGENT_QUERYED;
+		iAgents++;
+	}
+	return iAgents;
+}
+
+#else // USE_WINDOWS
+
+// no multiplexed agent links on Windows; agent_multiplex_connections is forced to 0 there
+void AgentConn_t::CloseMux () {}
+bool AgentConn_t::TakeMuxReply () { return false; }
+static bool AgentMuxRefused ( int ) { return true; }
+static void AgentMuxShutdown () {}
+static int RemoteQueryMuxAgents ( AgentConnectionContext_t * ) { return 0; }
+
+#endif // USE_WINDOWS
+
+/////////////////////////////////////////////////////////////////////////////
 
-	AgentConnectionContext_t ()
-		: m_pBuilder ( NULL )
-		, m_pAgents ( NULL )
-		, m_iAgentCount ( 0 )
-		, m_iTimeout ( 0 )
-		, m_iRetriesMax ( 0 )
-		, m_iDelay ( 0 )
-	{}
-};
 
 void RemoteConnectToAgent ( AgentConn_t & tAgent )
 {
@@ -4405,6 +5768,7 @@ void RemoteConnectToAgent ( AgentConn_t & tAgent )
 			tAgent.m_eState = AGENT_ESTABLISHED;
 			tAgent.m_iStartQuery = sphMicroTimer();
 			tAgent.m_iWall -= tAgent.m_iStartQuery;
+			tAgent.SetOutstanding ( true );
 			return;
 		}
 		tAgent.Close();
@@ -4412,26 +5776,21 @@ void RemoteConnectToAgent ( AgentConn_t & tAgent )
 
 	tAgent.m_bSuccess = false;
 
-	socklen_t len = 0;
-	struct sockaddr_storage ss;
-	memset ( &ss, 0, sizeof(ss) );
-	ss.ss_family = (short)tAgent.m_iFamily;
+	// multiplexed agents only need a request slot on a shared link, which RemoteQueryAgents() takes
+	if ( tAgent.m_bMux && AgentMuxRefused ( tAgent.m_iDashIndex ) )
+		tAgent.m_bMux = false;
 
-	if ( ss.ss_family==AF_INET )
-	{
-		struct sockaddr_in *in = (struct sockaddr_in *)&ss;
-		in->sin_port = htons ( (unsigned short)tAgent.m_iPort );
-		in->sin_addr.s_addr = tAgent.m_uAddr;
-		len = sizeof(*in);
-	}
-#if !USE_WINDOWS
-	else if ( ss.ss_family==AF_UNIX )
+	if ( tAgent.m_bMux )
 	{
-		struct sockaddr_un *un = (struct sockaddr_un *)&ss;
-		snprintf ( un->sun_path, sizeof(un->sun_path), "%s", tAgent.m_sPath.cstr() );
-		len = sizeof(*un);
+		tAgent.m_iStartQuery = sphMicroTimer();
+		tAgent.m_iWall -= tAgent.m_iStartQuery;
+		tAgent.SetOutstanding ( true );
+		tAgent.m_eState = AGENT_ESTABLISHED;
+		return;
 	}
-#endif
+
+	struct sockaddr_storage ss;
+	socklen_t len = AgentSockAddr ( tAgent, ss );
 
 	tAgent.m_iSock = socket ( tAgent.m_iFamily, SOCK_STREAM, 0 );
 	if ( tAgent.m_iSock<0 )
@@ -4466,6 +5825,7 @@ void RemoteConnectToAgent ( AgentConn_t & tAgent )
 
 	tAgent.m_iStartQuery = sphMicroTimer();
 	tAgent.m_iWall -= tAgent.m_iStartQuery;
+	tAgent.SetOutstanding ( true );
 	if ( connect ( tAgent.m_iSock, (struct sockaddr*)&ss, len )<0 )
 	{
 		int iErr = sphSockGetErrno();
@@ -4503,7 +5863,7 @@ int RemoteQueryAgents ( AgentConnectionContext_t * pCtx )
 	assert ( pCtx->m_pAgents );
 	assert ( pCtx->m_iAgentCount );
 
-	int iAgents = 0;
+	int iAgents = RemoteQueryMuxAgents ( pCtx );
 	int64_t tmMaxTimer = sphMicroTimer() + pCtx->m_iTimeout*1000; // in microseconds
 
 	int eid = epoll_create ( pCtx->m_iAgentCount );
@@ -4715,7 +6075,7 @@ int RemoteQueryAgents ( AgentConnectionContext_t * pCtx )
 // epoll version. Plain version below
 // processing states AGENT_QUERY, AGENT_PREREPLY and AGENT_REPLY
 // may work in parallel with RemoteQueryAgents, so the state MAY change duirng a call.
-int RemoteWaitForAgents ( CSphVector<AgentConn_t> & dAgents, int iTimeout, IReplyParser_t & tParser )
+int RemoteWaitForAgents ( CSphVector<AgentConn_t> & dAgents, int iTimeout, IReplyParser_t & tParser, bool bLeavePending=false )
 {
 	assert ( iTimeout>=0 );
 
@@ -4736,7 +6096,7 @@ int RemoteWaitForAgents ( CSphVector<AgentConn_t> & dAgents, int iTimeout, IRepl
 			ARRAY_FOREACH ( iAgent, dAgents )
 			{
 				AgentConn_t & tAgent = dAgents[iAgent];
-				if ( tAgent.m_bBlackhole )
+				if ( tAgent.m_bBlackhole || tAgent.IsHedgeLoser() )
 					continue;
 
 				if ( tAgent.m_eState==AGENT_QUERYED || tAgent.m_eState==AGENT_REPLY || tAgent.m_eState==AGENT_PREREPLY )
@@ -4788,6 +6148,18 @@ int RemoteWaitForAgents ( CSphVector<AgentConn_t> & dAgents, int iTimeout, IRepl
 
 			for ( ;; )
 			{
+				// multiplexed replies arrive whole, already read by the link reader
+				if ( tAgent.m_bMux && ( tAgent.m_eState==AGENT_QUERYED || tAgent.m_eState==AGENT_PREREPLY ) )
+				{
+					if ( tAgent.m_eState==AGENT_PREREPLY )
+						tAgent.m_iWall -= sphMicroTimer();
+					if ( !tAgent.TakeMuxReply() )
+					{
+						agent_stats_inc ( tAgent, eNetworkErrors );
+						break;
+					}
+				}
+
 				if ( tAgent.m_eState==AGENT_QUERYED || tAgent.m_eState==AGENT_PREREPLY )
 				{
 					if ( tAgent.m_eState==AGENT_PREREPLY )
@@ -4843,7 +6215,7 @@ int RemoteWaitForAgents ( CSphVector<AgentConn_t> & dAgents, int iTimeout, IRepl
 				}
 
 				// if we are reading reply, read another chunk
-				if ( tAgent.m_eState==AGENT_REPLY )
+				if ( tAgent.m_eState==AGENT_REPLY && tAgent.m_iReplyRead<tAgent.m_iReplySize )
 				{
 					// do read
 					assert ( tAgent.m_iReplyRead<tAgent.m_iReplySize );
@@ -4866,6 +6238,10 @@ int RemoteWaitForAgents ( CSphVector<AgentConn_t> & dAgents, int iTimeout, IRepl
 				// if reply was fully received, parse it
 				if ( tAgent.m_eState==AGENT_REPLY && tAgent.m_iReplyRead==tAgent.m_iReplySize )
 				{
+					// the other connection of a hedged request was faster; drop this reply
+					if ( tAgent.IsHedgeLoser() )
+						break;
+
 					MemInputBuffer_c tReq ( tAgent.m_pReplyBuf, tAgent.m_iReplySize );
 
 					// absolve thy former sins
@@ -4910,6 +6286,15 @@ int RemoteWaitForAgents ( CSphVector<AgentConn_t> & dAgents, int iTimeout, IRepl
 					iAgents++;
 					tAgent.Close ( false );
 					tAgent.m_bSuccess = true;
+					tAgent.m_bAnswered = true;
+
+					// stop waiting for the other connection of a hedged request (unless its worker still owns it)
+					AgentConn_t * pTwin = tAgent.m_pTwin;
+					if ( pTwin && pTwin->m_iSock>=0 && epoll_ctl ( eid, EPOLL_CTL_DEL, pTwin->m_iSock, &dEvent )==0 )
+					{
+						--iEvents;
+						pTwin->Close();
+					}
 				}
 
 				bFailure = false;
@@ -4939,7 +6324,11 @@ int RemoteWaitForAgents ( CSphVector<AgentConn_t> & dAgents, int iTimeout, IRepl
 		AgentConn_t & tAgent = dAgents[iAgent];
 		if ( tAgent.m_bBlackhole )
 			tAgent.Close ();
-		else if ( bTimeout && ( tAgent.m_eState==AGENT_QUERYED || tAgent.m_eState==AGENT_PREREPLY ) )
+		else if ( tAgent.IsHedgeLoser() )
+		{
+			if ( tAgent.m_eState==AGENT_QUERYED || tAgent.m_eState==AGENT_PREREPLY || tAgent.m_eState==AGENT_REPLY )
+				tAgent.Close ();
+		} else if ( bTimeout && !bLeavePending && ( tAgent.m_eState==AGENT_QUERYED || tAgent.m_eState==AGENT_PREREPLY ) )
 		{
 			assert ( !tAgent.m_dResults.GetLength() );
 			assert ( !tAgent.m_bSuccess );
@@ -4960,7 +6349,7 @@ int RemoteQueryAgents ( AgentConnectionContext_t * pCtx )
 	assert ( pCtx->m_pAgents );
 	assert ( pCtx->m_iAgentCount );
 
-	int iAgents = 0;
+	int iAgents = RemoteQueryMuxAgents ( pCtx );
 	int64_t tmMaxTimer = sphMicroTimer() + pCtx->m_iTimeout*1000; // in microseconds
 	CSphVector<int> dWorkingSet;
 	dWorkingSet.Reserve ( pCtx->m_iAgentCount );
@@ -5182,7 +6571,7 @@ int RemoteQueryAgents ( AgentConnectionContext_t * pCtx )
 }
 
 // processing states AGENT_QUERY, AGENT_PREREPLY and AGENT_REPLY
-int RemoteWaitForAgents ( CSphVector<AgentConn_t> & dAgents, int iTimeout, IReplyParser_t & tParser )
+int RemoteWaitForAgents ( CSphVector<AgentConn_t> & dAgents, int iTimeout, IReplyParser_t & tParser, bool bLeavePending=false )
 {
 	assert ( iTimeout>=0 );
 
@@ -5212,7 +6601,7 @@ int RemoteWaitForAgents ( CSphVector<AgentConn_t> & dAgents, int iTimeout, IRepl
 		ARRAY_FOREACH ( iAgent, dAgents )
 		{
 			AgentConn_t & tAgent = dAgents[iAgent];
-			if ( tAgent.m_bBlackhole )
+			if ( tAgent.m_bBlackhole || tAgent.IsHedgeLoser() )
 				continue;
 
 			if ( tAgent.m_eState==AGENT_QUERYED || tAgent.m_eState==AGENT_REPLY || tAgent.m_eState==AGENT_PREREPLY )
@@ -5274,6 +6663,18 @@ int RemoteWaitForAgents ( CSphVector<AgentConn_t> & dAgents, int iTimeout, IRepl
 			bool bWarnings = false;
 			for ( ;; )
 			{
+				// multiplexed replies arrive whole, already read by the link reader
+				if ( tAgent.m_bMux && ( tAgent.m_eState==AGENT_QUERYED || tAgent.m_eState==AGENT_PREREPLY ) )
+				{
+					if ( tAgent.m_eState==AGENT_PREREPLY )
+						tAgent.m_iWall -= sphMicroTimer();
+					if ( !tAgent.TakeMuxReply() )
+					{
+						agent_stats_inc ( tAgent, eNetworkErrors );
+						break;
+					}
+				}
+
 				if ( tAgent.m_eState==AGENT_QUERYED || tAgent.m_eState==AGENT_PREREPLY )
 				{
 					if ( tAgent.m_eState==AGENT_PREREPLY )
@@ -5329,7 +6730,7 @@ int RemoteWaitForAgents ( CSphVector<AgentConn_t> & dAgents, int iTimeout, IRepl
 				}
 
 				// if we are reading reply, read another chunk
-				if ( tAgent.m_eState==AGENT_REPLY )
+				if ( tAgent.m_eState==AGENT_REPLY && tAgent.m_iReplyRead<tAgent.m_iReplySize )
 				{
 					// do read
 					assert ( tAgent.m_iReplyRead<tAgent.m_iReplySize );
@@ -5352,6 +6753,10 @@ int RemoteWaitForAgents ( CSphVector<AgentConn_t> & dAgents, int iTimeout, IRepl
 				// if reply was fully received, parse it
 				if ( tAgent.m_eState==AGENT_REPLY && tAgent.m_iReplyRead==tAgent.m_iReplySize )
 				{
+					// the other connection of a hedged request was faster; drop this reply
+					if ( tAgent.IsHedgeLoser() )
+						break;
+
 					MemInputBuffer_c tReq ( tAgent.m_pReplyBuf, tAgent.m_iReplySize );
 
 					// absolve thy former sins
@@ -5394,6 +6799,7 @@ int RemoteWaitForAgents ( CSphVector<AgentConn_t> & dAgents, int iTimeout, IRepl
 					iAgents++;
 					tAgent.Close ( false );
 					tAgent.m_bSuccess = true;
+					tAgent.m_bAnswered = true;
 				}
 
 				bFailure = false;
@@ -5419,7 +6825,11 @@ int RemoteWaitForAgents ( CSphVector<AgentConn_t> & dAgents, int iTimeout, IRepl
 		AgentConn_t & tAgent = dAgents[iAgent];
 		if ( tAgent.m_bBlackhole )
 			tAgent.Close ();
-		else if ( tAgent.m_eState==AGENT_QUERYED || tAgent.m_eState==AGENT_PREREPLY )
+		else if ( tAgent.IsHedgeLoser() )
+		{
+			if ( tAgent.m_eState==AGENT_QUERYED || tAgent.m_eState==AGENT_PREREPLY || tAgent.m_eState==AGENT_REPLY )
+				tAgent.Close ();
+		} else if ( !bLeavePending && ( tAgent.m_eState==AGENT_QUERYED || tAgent.m_eState==AGENT_PREREPLY ) )
 		{
 			assert ( !tAgent.m_dResults.GetLength() );
 			assert ( !tAgent.m_bSuccess );
@@ -5685,39 +7095,15 @@ public:
 		const IRequestBuilder_t & tBuilder, int iTimeout, int iRetryMax=0, int iDelay=0 )
 		: m_tWorkerPool ( dAgents.GetLength() )
 	{
-		assert ( dAgents.GetLength() );
-
-		iThreads = Max ( 1, Min ( iThreads, dAgents.GetLength() ) );
-		m_dThds.Resize ( iThreads );
-
-		AgentWorkContext_t tCtx;
-		tCtx.m_pBuilder = &tBuilder;
-		tCtx.m_iAgentCount = 1;
-		tCtx.m_pfn = ThdWorkParallel;
-		tCtx.m_iDelay = iDelay;
-		tCtx.m_iRetriesMax = iRetryMax;
-		tCtx.m_iTimeout = iTimeout;
-
-
-		if ( iThreads>1 )
-		{
-			m_tWorkerPool.SetWorksCount ( dAgents.GetLength() );
-			ARRAY_FOREACH ( i, dAgents )
-			{
-				tCtx.m_pAgents = dAgents.Begin()+i;
-				m_tWorkerPool.RawPush ( tCtx );
-			}
-		} else
-		{
-			m_tWorkerPool.SetWorksCount ( 1 );
-			tCtx.m_pAgents = dAgents.Begin();
-			tCtx.m_iAgentCount = dAgents.GetLength();
-			tCtx.m_pfn = ThdWorkSequental;
-			m_tWorkerPool.RawPush ( tCtx );
-		}
+		Init ( iThreads, dAgents.Begin(), dAgents.GetLength(), tBuilder, iTimeout, iRetryMax, iDelay );
+	}
 
-		ARRAY_FOREACH ( i, m_dThds )
-			SphCrashLogger_c::ThreadCreate ( m_dThds.Begin()+i, ThdWorkPool_t::PoolThreadFunc, &m_tWorkerPool );
+	// works over a sub-range of agents (used to start hedged requests after the primary ones)
+	CSphRemoteAgentsController ( int iThreads, AgentConn_t * pAgents, int iAgents,
+		const IRequestBuilder_t & tBuilder, int iTimeout, int iRetryMax=0, int iDelay=0 )
+		: m_tWorkerPool ( iAgents )
+	{
+		Init ( iThreads, pAgents, iAgents, tBuilder, iTimeout, iRetryMax, iDelay );
 	}
 
 	~CSphRemoteAgentsController ()
@@ -5754,6 +7140,42 @@ public:
 	}
 
 private:
+	void Init ( int iThreads, AgentConn_t * pAgents, int iAgents, const IRequestBuilder_t & tBuilder, int iTimeout, int iRetryMax, int iDelay )
+	{
+		assert ( iAgents );
+
+		iThreads = Max ( 1, Min ( iThreads, iAgents ) );
+		m_dThds.Resize ( iThreads );
+
+		AgentWorkContext_t tCtx;
+		tCtx.m_pBuilder = &tBuilder;
+		tCtx.m_iAgentCount = 1;
+		tCtx.m_pfn = ThdWorkParallel;
+		tCtx.m_iDelay = iDelay;
+		tCtx.m_iRetriesMax = iRetryMax;
+		tCtx.m_iTimeout = iTimeout;
+
+		if ( iThreads>1 )
+		{
+			m_tWorkerPool.SetWorksCount ( iAgents );
+			for ( int i=0; i<iAgents; i++ )
+			{
+				tCtx.m_pAgents = pAgents+i;
+				m_tWorkerPool.RawPush ( tCtx );
+			}
+		} else
+		{
+			m_tWorkerPool.SetWorksCount ( 1 );
+			tCtx.m_pAgents = pAgents;
+			tCtx.m_iAgentCount = iAgents;
+			tCtx.m_pfn = ThdWorkSequental;
+			m_tWorkerPool.RawPush ( tCtx );
+		}
+
+		ARRAY_FOREACH ( i, m_dThds )
+			SphCrashLogger_c::ThreadCreate ( m_dThds.Begin()+i, ThdWorkPool_t::PoolThreadFunc, &m_tWorkerPool );
+	}
+
 	ThdWorkPool_t m_tWorkerPool;
 	CSphVector<SphThread_t> m_dThds;
 };
@@ -5795,6 +7217,8 @@ struct SearchReplyParser_t : public IReplyParser_t, public ISphNoncopyable
 	virtual bool ParseReply ( MemInputBuffer_c & tReq, AgentConn_t & tAgent ) const;
 
 protected:
+	bool				ParseColumnar ( MemInputBuffer_c & tReq, CSphQueryResult & tRes, DWORD uEncoding, CSphString & sError ) const;
+
 	int					m_iStart;
 	int					m_iEnd;
 	CSphVector<DWORD> &	m_dMvaStorage;
@@ -6034,7 +7458,7 @@ void SearchRequestBuilder_t::BuildRequest ( AgentConn_t & tAgent, NetOutputBuffe
 {
 	const char* sIndexes = tAgent.m_sIndexes.cstr();
 	bool bAgentWeigth = ( tAgent.m_iWeight!=-1 );
-	int iReqLen = 8; // int num-queries
+	int iReqLen = 12; // int master-version, dword result-encoding, int num-queries
 	for ( int i=m_iStart; i<=m_iEnd; i++ )
 		iReqLen += CalcQueryLen ( sIndexes, m_dQueries[i], bAgentWeigth );
 
@@ -6043,6 +7467,7 @@ void SearchRequestBuilder_t::BuildRequest ( AgentConn_t & tAgent, NetOutputBuffe
 	tOut.SendInt ( iReqLen ); // request body length
 
 	tOut.SendInt ( VER_MASTER );
+	tOut.SendDword ( g_uAgentResultEncoding ); // v.12
 	tOut.SendInt ( m_iEnd-m_iStart+1 );
 	for ( int i=m_iStart; i<=m_iEnd; i++ )
 		SendQuery ( sIndexes, tOut, m_dQueries[i], bAgentWeigth, tAgent.m_iWeight );
@@ -6110,8 +7535,17 @@ bool SearchReplyParser_t::ParseReply ( MemInputBuffer_c & tReq, AgentConn_t & tA
 			tAgent.m_sFailure.SetSprintf ( "id64 agent, id32 master, docids might be wrapped" );
 #endif
 
+		// v.12, how the agent chose to encode the matches
+		DWORD uEncoding = tReq.GetDword ();
+
 		assert ( !tRes.m_dMatches.GetLength() );
-		if ( iMatches )
+		if ( iMatches && ( uEncoding & RESULT_COLUMNAR ) )
+		{
+			tRes.m_dMatches.Resize ( iMatches );
+			if ( !ParseColumnar ( tReq, tRes, uEncoding, tAgent.m_sFailure ) )
+				return false;
+
+		} else if ( iMatches )
 		{
 			tRes.m_dMatches.Resize ( iMatches );
 			ARRAY_FOREACH ( i, tRes.m_dMatches )
@@ -6237,6 +7671,12 @@ bool SearchReplyParser_t::ParseReply ( MemInputBuffer_c & tReq, AgentConn_t & tA
 		tRes.m_iAgentFetchedDocs = tReq.GetDword();
 		tRes.m_iAgentFetchedHits = tReq.GetDword();
 		tRes.m_iAgentFetchedSkips = tReq.GetDword();
+		tRes.m_tAgentStats.m_iDoclistBytes = tReq.GetUint64();
+		tRes.m_tAgentStats.m_iHitlistBytes = tReq.GetUint64();
+		tRes.m_tAgentStats.m_iDocinfoBytes = tReq.GetUint64();
+		tRes.m_tAgentStats.m_iPushedMatches = tReq.GetUint64();
+		tRes.m_tAgentStats.m_iFilterEvals = tReq.GetUint64();
+		tRes.m_tAgentStats.m_iArenaBytes = tReq.GetUint64();
 
 		const int iWordsCount = tReq.GetInt (); // FIXME! sanity check?
 		if ( iRetrieved!=iMatches )
@@ -6264,6 +7704,51 @@ bool SearchReplyParser_t::ParseReply ( MemInputBuffer_c & tReq, AgentConn_t & tA
 	return true;
 }
 
+
+bool SearchReplyParser_t::ParseColumnar ( MemInputBuffer_c & tReq, CSphQueryResult & tRes, DWORD uEncoding, CSphString & sError ) const
+{
+	int iPlainLen = tReq.GetInt ();
+	int iRawLen = tReq.GetInt ();
+	int iDataLen = tReq.GetInt ();
+	if ( iRawLen<0 || iDataLen<0 || iRawLen>g_iMaxPacketSize || iDataLen>iRawLen
+		|| ( !( uEncoding & RESULT_COMPRESSED ) && iDataLen!=iRawLen ) )
+	{
+		sError.SetSprintf ( "invalid columnar block received (raw=%d, data=%d)", iRawLen, iDataLen );
+		return false;
+	}
+
+	CSphVector<BYTE> dData ( iDataLen );
+	if ( !tReq.GetBytes ( dData.Begin(), iDataLen ) )
+	{
+		sError = "truncated columnar block";
+		return false;
+	}
+
+	CSphVector<BYTE> dRaw;
+	if ( uEncoding & RESULT_COMPRESSED )
+	{
+		dRaw.Resize ( iRawLen );
+		if ( !sphDecompressBlock ( dData.Begin(), iDataLen, dRaw.Begin(), iRawLen ) )
+		{
+			sError = "failed to decompress columnar block";
+			return false;
+		}
+	} else
+		dRaw.SwapData ( dData );
+
+	if ( !sphDecodeColumnar ( dRaw.Begin(), iRawLen, tRes.m_dMatches.Begin(), tRes.m_dMatches.GetLength(), tRes.m_tSchema, m_dMvaStorage, m_dStringsStorage ) )
+	{
+		sError = "broken columnar block received";
+		return false;
+	}
+
+	g_tStatsMutex.Lock();
+	g_pStats->m_iAgentResultBytes += 12+iDataLen;
+	g_pStats->m_iAgentResultSaved += iPlainLen-12-iDataLen;
+	g_tStatsMutex.Unlock();
+	return true;
+}
+
 /////////////////////////////////////////////////////////////////////////////
 
 // returns true if incoming schema (src) is equal to existing (dst); false otherwise
@@ -7245,9 +8730,9 @@ static void LogQuerySphinxql ( const CSphQuery & q, const CSphQueryResult & tRes
 		// all we have is an error
 		tBuf.Appendf ( " /""* error=%s */", tRes.m_sError.cstr() );
 
-	} else if ( g_bIOStats || g_bCpuStats || dAgentTimes.GetLength() || !tRes.m_sWarning.IsEmpty() )
+	} else
 	{
-		// got some extra data, add a comment
+		// work counters are always there, add a comment
 		tBuf += " /""*";
 
 		// performance counters
@@ -7264,6 +8749,18 @@ static void LogQuerySphinxql ( const CSphQuery & q, const CSphQueryResult & tRes
 				tBuf.Appendf ( " cpums=%d.%d", (int)( tRes.m_iCpuTime/1000 ), (int)( tRes.m_iCpuTime%1000 )/100 );
 		}
 
+		// work counters, local plus agents
+		CSphQueryStats tStats = tRes.m_tStats;
+		tStats.Add ( tRes.m_tAgentStats );
+		tBuf.Appendf ( " docs=%u hits=%u skips=%u matches="INT64_FMT" filters="INT64_FMT,
+			tStats.m_iFetchedDocs + tRes.m_iAgentFetchedDocs, tStats.m_iFetchedHits + tRes.m_iAgentFetchedHits,
+			tStats.m_iSkips + tRes.m_iAgentFetchedSkips, tStats.m_iPushedMatches, tStats.m_iFilterEvals );
+		tBuf.Appendf ( " spd_kb=%d.%d spp_kb=%d.%d spa_kb=%d.%d arena_kb=%d.%d",
+			(int)( tStats.m_iDoclistBytes/1024 ), (int)( tStats.m_iDoclistBytes%1024 )*10/1024,
+			(int)( tStats.m_iHitlistBytes/1024 ), (int)( tStats.m_iHitlistBytes%1024 )*10/1024,
+			(int)( tStats.m_iDocinfoBytes/1024 ), (int)( tStats.m_iDocinfoBytes%1024 )*10/1024,
+			(int)( tStats.m_iArenaBytes/1024 ), (int)( tStats.m_iArenaBytes%1024 )*10/1024 );
+
 		// per-agent times
 		if ( dAgentTimes.GetLength() )
 		{
@@ -7347,30 +8844,48 @@ static int SendGetAttrCount ( const ISphSchema & tSchema, bool bAgentMode=false
 	return iCount;
 }
 
-class CSphTaggedVector
+static char g_sJsonNull[] = "{}";
+
+
+/// matches of an agent result encoded column by column, see RESULT_COLUMNAR
+struct ColumnarResult_t
 {
-public:
-	const PoolPtrs_t & operator [] ( int iTag ) const
-	{
-		return m_dPool [ iTag & 0x7FFFFFF ];
-	}
-	PoolPtrs_t & operator [] ( int iTag )
-	{
-		return m_dPool [ iTag & 0x7FFFFFF ];
-	}
+	DWORD				m_uEncoding;	///< RESULT_xxx flags actually used
+	int					m_iPlainLen;	///< row-wise matches length this block replaces
+	int					m_iRawLen;		///< uncompressed block length
+	CSphVector<BYTE>	m_dData;		///< block, zlib compressed with RESULT_COMPRESSED
+
+	ColumnarResult_t ()
+		: m_uEncoding ( 0 )
+		, m_iPlainLen ( 0 )
+		, m_iRawLen ( 0 )
+	{}
+};
+
+
+static void EncodeColumnar ( ColumnarResult_t & tBlock, DWORD uEncoding, const CSphQueryResult * pRes, const CSphTaggedVector & dTag2Pools, int iAttrsCount )
+{
+	CSphVector<BYTE> dRaw;
+	sphEncodeColumnar ( dRaw, pRes->m_dMatches.Begin() + pRes->m_iOffset, pRes->m_iCount, pRes->m_tSchema, iAttrsCount, dTag2Pools );
 
-	void Resize ( int iSize )
+	tBlock.m_uEncoding = RESULT_COLUMNAR;
+	tBlock.m_iRawLen = dRaw.GetLength();
+	if ( uEncoding & RESULT_COMPRESSED )
 	{
-		m_dPool.Resize ( iSize );
+		tBlock.m_dData.Resize ( sphCompressBound ( dRaw.GetLength() ) );
+		int iPacked = sphCompressBlock ( dRaw.Begin(), dRaw.GetLength(), tBlock.m_dData.Begin(), tBlock.m_dData.GetLength() );
+		if ( iPacked>0 && iPacked<dRaw.GetLength() )
+		{
+			tBlock.m_dData.Resize ( iPacked );
+			tBlock.m_uEncoding |= RESULT_COMPRESSED;
+			return;
+		}
 	}
+	tBlock.m_dData.SwapData ( dRaw );
+}
 
-private:
-	CSphVector<PoolPtrs_t> m_dPool;
-};
-
-static char g_sJsonNull[] = "{}";
 
-int CalcResultLength ( int iVer, const CSphQueryResult * pRes, const CSphTaggedVector & dTag2Pools, bool bAgentMode, const CSphQuery & tQuery, int iMasterVer )
+int CalcResultLength ( int iVer, const CSphQueryResult * pRes, const CSphTaggedVector & dTag2Pools, bool bAgentMode, const CSphQuery & tQuery, int iMasterVer, const ColumnarResult_t * pColumnar )
 {
 	int iRespLen = 0;
 
@@ -7408,13 +8923,18 @@ int CalcResultLength ( int iVer, const CSphQueryResult * pRes, const CSphTaggedV
 			iRespLen += 8 + strlen ( pRes->m_tSchema.GetAttr(i).m_sName.cstr() ); // namelen, name, type
 	}
 
+	// columnar matches replace all the per-match data below
+	const int iRowMatches = pColumnar ? 0 : pRes->m_iCount;
+	if ( bAgentMode && iMasterVer>=12 )
+		iRespLen += 4 + ( pColumnar ? 12+pColumnar->m_dData.GetLength() : 0 ); // encoding, block lengths and data
+
 	// matches
 	if ( iVer<0x102 )
-		iRespLen += 16*pRes->m_iCount; // matches
+		iRespLen += 16*iRowMatches; // matches
 	else if ( iVer<0x108 )
-		iRespLen += ( 8+4*iAttrsCount )*pRes->m_iCount; // matches
+		iRespLen += ( 8+4*iAttrsCount )*iRowMatches; // matches
 	else
-		iRespLen += 4 + ( 8+4*USE_64BIT+4*iAttrsCount )*pRes->m_iCount; // id64 tag and matches
+		iRespLen += 4 + ( 8+4*USE_64BIT+4*iAttrsCount )*iRowMatches; // id64 tag and matches
 
 	if ( iVer>=0x114 )
 	{
@@ -7423,7 +8943,7 @@ int CalcResultLength ( int iVer, const CSphQueryResult * pRes, const CSphTaggedV
 		for ( int i=0; i<iAttrsCount; i++ )
 			if ( pRes->m_tSchema.GetAttr(i).m_eAttrType==SPH_ATTR_BIGINT )
 				iWideAttrs++;
-		iRespLen += 4*pRes->m_iCount*iWideAttrs; // extra 4 bytes per attr per match
+		iRespLen += 4*iRowMatches*iWideAttrs; // extra 4 bytes per attr per match
 	}
 
 	// agents send additional flag from words statistics
@@ -7476,7 +8996,7 @@ int CalcResultLength ( int iVer, const CSphQueryResult * pRes, const CSphTaggedV
 
 	if ( iVer>=0x10C && dMvaItems.GetLength() )
 	{
-		for ( int i=0; i<pRes->m_iCount; i++ )
+		for ( int i=0; i<iRowMatches; i++ )
 		{
 			const CSphMatch & tMatch = pRes->m_dMatches [ pRes->m_iOffset+i ];
 			const DWORD * pMvaPool = dTag2Pools [ tMatch.m_iTag ].m_pMva;
@@ -7493,7 +9013,7 @@ int CalcResultLength ( int iVer, const CSphQueryResult * pRes, const CSphTaggedV
 
 	if ( iVer>=0x117 && dStringItems.GetLength() )
 	{
-		for ( int i=0; i<pRes->m_iCount; i++ )
+		for ( int i=0; i<iRowMatches; i++ )
 		{
 			const CSphMatch & tMatch = pRes->m_dMatches [ pRes->m_iOffset+i ];
 			const BYTE * pStrings = dTag2Pools [ tMatch.m_iTag ].m_pStrings;
@@ -7522,10 +9042,13 @@ int CalcResultLength ( int iVer, const CSphQueryResult * pRes, const CSphTaggedV
 	// fetched_docs and fetched_hits from agent to master
 	if ( bAgentMode && iMasterVer>=7 )
 		iRespLen += 12;
+	// work counters from agent to master
+	if ( bAgentMode && iMasterVer>=13 )
+		iRespLen += 48;
 
 	if ( iVer>=0x117 && dStringPtrItems.GetLength() )
 	{
-		for ( int i=0; i<pRes->m_iCount; i++ )
+		for ( int i=0; i<iRowMatches; i++ )
 		{
 			const CSphMatch & tMatch = pRes->m_dMatches [ pRes->m_iOffset+i ];
 			ARRAY_FOREACH ( j, dStringPtrItems )
@@ -7541,7 +9064,7 @@ int CalcResultLength ( int iVer, const CSphQueryResult * pRes, const CSphTaggedV
 	{
 		CSphVector<BYTE> dJson ( 512 );
 		// to master pass JSON as raw data
-		for ( int i=0; i<pRes->m_iCount; i++ )
+		for ( int i=0; i<iRowMatches; i++ )
 		{
 			const CSphMatch & tMatch = pRes->m_dMatches [ pRes->m_iOffset+i ];
 			const BYTE * pPool = dTag2Pools [ tMatch.m_iTag ].m_pStrings;
@@ -7576,7 +9099,7 @@ int CalcResultLength ( int iVer, const CSphQueryResult * pRes, const CSphTaggedV
 	{
 		CSphVector<BYTE> dJson ( 512 );
 
-		for ( int i=0; i<pRes->m_iCount; i++ )
+		for ( int i=0; i<iRowMatches; i++ )
 		{
 			const CSphMatch & tMatch = pRes->m_dMatches [ pRes->m_iOffset+i ];
 			const BYTE * pStrings = dTag2Pools [ tMatch.m_iTag ].m_pStrings;
@@ -7614,7 +9137,7 @@ int CalcResultLength ( int iVer, const CSphQueryResult * pRes, const CSphTaggedV
 
 	if ( iVer>=0x11C && dFactorItems.GetLength() )
 	{
-		for ( int i=0; i<pRes->m_iCount; i++ )
+		for ( int i=0; i<iRowMatches; i++ )
 		{
 			const CSphMatch & tMatch = pRes->m_dMatches [ pRes->m_iOffset+i ];
 			ARRAY_FOREACH ( j, dFactorItems )
@@ -7631,7 +9154,7 @@ int CalcResultLength ( int iVer, const CSphQueryResult * pRes, const CSphTaggedV
 
 
 void SendResult ( int iVer, NetOutputBuffer_c & tOut, const CSphQueryResult * pRes,
-					const CSphTaggedVector & dTag2Pools, bool bAgentMode, const CSphQuery & tQuery, int iMasterVer )
+					const CSphTaggedVector & dTag2Pools, bool bAgentMode, const CSphQuery & tQuery, int iMasterVer, const ColumnarResult_t * pColumnar )
 {
 	// status
 	if ( iVer>=0x10D )
@@ -7711,9 +9234,22 @@ void SendResult ( int iVer, NetOutputBuffer_c & tOut, const CSphQueryResult * pR
 	if ( iVer>=0x108 )
 		tOut.SendInt ( USE_64BIT );
 
+	if ( bAgentMode && iMasterVer>=12 )
+	{
+		tOut.SendDword ( pColumnar ? pColumnar->m_uEncoding : 0 );
+		if ( pColumnar )
+		{
+			tOut.SendInt ( pColumnar->m_iPlainLen );
+			tOut.SendInt ( pColumnar->m_iRawLen );
+			tOut.SendInt ( pColumnar->m_dData.GetLength() );
+			tOut.SendBytes ( pColumnar->m_dData.Begin(), pColumnar->m_dData.GetLength() );
+		}
+	}
+
 	CSphVector<BYTE> dJson ( 512 );
 
-	for ( int i=0; i<pRes->m_iCount; i++ )
+	const int iRowMatches = pColumnar ? 0 : pRes->m_iCount;
+	for ( int i=0; i<iRowMatches; i++ )
 	{
 		const CSphMatch & tMatch = pRes->m_dMatches [ pRes->m_iOffset+i ];
 #if USE_64BIT
@@ -7764,20 +9300,9 @@ void SendResult ( int iVer, NetOutputBuffer_c & tOut, const CSphQueryResult * pR
 							int iValues = *pValues++;
 							tOut.SendDword ( iValues );
 							if ( tAttr.m_eAttrType==SPH_ATTR_INT64SET )
-							{
-								assert ( ( iValues%2 )==0 );
-								while ( iValues )
-								{
-									uint64_t uVal = (uint64_t)MVA_UPSIZE ( pValues );
-									tOut.SendUint64 ( uVal );
-									pValues += 2;
-									iValues -= 2;
-								}
-							} else
-							{
-								while ( iValues-- )
-									tOut.SendDword ( *pValues++ );
-							}
+								tOut.SendMva64 ( pValues, iValues );
+							else
+								tOut.SendDwords ( pValues, iValues );
 						}
 						break;
 					}
@@ -7829,7 +9354,7 @@ void SendResult ( int iVer, NetOutputBuffer_c & tOut, const CSphQueryResult * pR
 							assert ( pStrings );
 							int iLen = sphUnpackStr ( pStrings+uOffset, &pStr );
 							tOut.SendDword ( iLen );
-							tOut.SendBytes ( pStr, iLen );
+							tOut.SendBytesRef ( pStr, iLen );
 						}
 						break;
 					}
@@ -7849,7 +9374,7 @@ void SendResult ( int iVer, NetOutputBuffer_c & tOut, const CSphQueryResult * pR
 						{
 							int iLen = strlen ( pString );
 							tOut.SendDword ( iLen );
-							tOut.SendBytes ( pString, iLen );
+							tOut.SendBytesRef ( pString, iLen );
 						}
 						break;
 					}
@@ -7882,7 +9407,7 @@ void SendResult ( int iVer, NetOutputBuffer_c & tOut, const CSphQueryResult * pR
 							int iLen = sphJsonNodeSize ( eJson, pData );
 							if ( sphJsonNodeSize ( eJson, NULL )<0 )
 								tOut.SendDword ( iLen );
-							tOut.SendBytes ( pData, iLen );
+							tOut.SendBytesRef ( pData, iLen );
 						} else
 						{
 							// to client send data as string
@@ -7908,7 +9433,7 @@ void SendResult ( int iVer, NetOutputBuffer_c & tOut, const CSphQueryResult * pR
 						{
 							DWORD uLength = *(DWORD*)pData;
 							tOut.SendDword ( uLength );
-							tOut.SendBytes ( pData+sizeof(DWORD), uLength-sizeof(DWORD) );
+							tOut.SendBytesRef ( pData+sizeof(DWORD), uLength-sizeof(DWORD) );
 						}
 						break;
 					}
@@ -7972,6 +9497,17 @@ void SendResult ( int iVer, NetOutputBuffer_c & tOut, const CSphQueryResult * pR
 		tOut.SendDword ( pRes->m_tStats.m_iFetchedHits + pRes->m_iAgentFetchedHits );
 		if ( iMasterVer>=8 )
 			tOut.SendDword ( pRes->m_tStats.m_iSkips + pRes->m_iAgentFetchedSkips );
+		if ( iMasterVer>=13 )
+		{
+			CSphQueryStats tStats = pRes->m_tStats;
+			tStats.Add ( pRes->m_tAgentStats );
+			tOut.SendUint64 ( tStats.m_iDoclistBytes );
+			tOut.SendUint64 ( tStats.m_iHitlistBytes );
+			tOut.SendUint64 ( tStats.m_iDocinfoBytes );
+			tOut.SendUint64 ( tStats.m_iPushedMatches );
+			tOut.SendUint64 ( tStats.m_iFilterEvals );
+			tOut.SendUint64 ( tStats.m_iArenaBytes );
+		}
 	}
 
 	tOut.SendInt ( pRes->m_hWordStats.GetLength() );
@@ -9099,13 +10635,62 @@ struct Expr_Snippet_c : public ISphStringExpr
 
 	virtual void Command ( ESphExprCommand eCmd, void * pArg )
 	{
-		if ( eCmd!=SPH_EXPR_SET_STRING_POOL )
+		if ( eCmd!=SPH_EXPR_SET_STRING_POOL && eCmd!=SPH_EXPR_SET_STORED_FIELDS )
 			return;
 
 		if ( m_pArgs )
-			m_pArgs->Command ( SPH_EXPR_SET_STRING_POOL, pArg );
+			m_pArgs->Command ( eCmd, pArg );
 		if ( m_pText )
-			m_pText->Command ( SPH_EXPR_SET_STRING_POOL, pArg );
+			m_pText->Command ( eCmd, pArg );
+	}
+};
+
+
+/// stored field fetched by match docid from the stored fields snapshot of the search
+struct Expr_StoredField_c : public ISphStringExpr
+{
+	int							m_iField;
+	const ISphStoredFields *	m_pFields;
+
+	explicit Expr_StoredField_c ( int iField )
+		: m_iField ( iField )
+		, m_pFields ( NULL )
+	{}
+
+	~Expr_StoredField_c ()
+	{
+		SafeRelease ( m_pFields );
+	}
+
+	virtual int StringEval ( const CSphMatch & tMatch, const BYTE ** ppStr ) const
+	{
+		*ppStr = NULL;
+		if ( !m_pFields )
+			return 0;
+
+		BYTE * pText = NULL;
+		int iLen = 0;
+		m_pFields->GetField ( tMatch.m_uDocID, m_iField, &pText, &iLen );
+		*ppStr = pText;
+		return iLen;
+	}
+
+	virtual void Command ( ESphExprCommand eCmd, void * pArg )
+	{
+		if ( eCmd!=SPH_EXPR_SET_STORED_FIELDS )
+			return;
+
+		// postlimit evaluation happens after the search, so hold on to the snapshot
+		const ISphStoredFields * pFields = (const ISphStoredFields *)pArg;
+		if ( pFields )
+			pFields->AddRef();
+		SafeRelease ( m_pFields );
+		m_pFields = pFields;
+	}
+
+	virtual bool IsStringPtr() const
+	{
+		return true;
 	}
 };
 
@@ -9117,16 +10702,27 @@ struct Expr_Snippet_c : public ISphStringExpr
 struct ExprHook_t : public ISphExprHook
 {
 	static const int HOOK_SNIPPET = 1;
+	static const int HOOK_STORED_FIELD = 1000;
 	CSphIndex * m_pIndex; /// BLOODY HACK
 	CSphQueryProfile * m_pProfiler;
+	int m_iStoredFields; ///< stored field nodes created so far; these use m_pIndex field numbers
 
 	ExprHook_t ()
 		: m_pIndex ( NULL )
 		, m_pProfiler ( NULL )
+		, m_iStoredFields ( 0 )
 	{}
 
-	virtual int IsKnownIdent ( const char * )
+	virtual int IsKnownIdent ( const char * sIdent )
 	{
+		// stored fields are only visible when the index keeps them
+		if ( !m_pIndex )
+			return -1;
+
+		const CSphVector<CSphString> & dStored = m_pIndex->GetSettings().m_dStoredFields;
+		ARRAY_FOREACH ( i, dStored )
+			if ( dStored[i]==sIdent )
+				return HOOK_STORED_FIELD + i;
 		return -1;
 	}
 
@@ -9138,8 +10734,14 @@ struct ExprHook_t : public ISphExprHook
 			return -1;
 	}
 
-	virtual ISphExpr * CreateNode ( int DEBUGARG(iID), ISphExpr * pLeft, ESphEvalStage * pEvalStage, CSphString & sError )
+	virtual ISphExpr * CreateNode ( int iID, ISphExpr * pLeft, ESphEvalStage * pEvalStage, CSphString & sError )
 	{
+		if ( iID>=HOOK_STORED_FIELD )
+		{
+			m_iStoredFields++;
+			return new Expr_StoredField_c ( iID-HOOK_STORED_FIELD );
+		}
+
 		assert ( iID==HOOK_SNIPPET );
 		if ( pEvalStage )
 			*pEvalStage = SPH_EVAL_POSTLIMIT;
@@ -9151,10 +10753,10 @@ struct ExprHook_t : public ISphExprHook
 		return pRes;
 	}
 
-	virtual ESphAttr GetIdentType ( int )
+	virtual ESphAttr GetIdentType ( int DEBUGARG(iID) )
 	{
-		assert ( 0 );
-		return SPH_ATTR_NONE;
+		assert ( iID>=HOOK_STORED_FIELD );
+		return SPH_ATTR_STRINGPTR;
 	}
 
 	virtual ESphAttr GetReturnType ( int DEBUGARG(iID), const CSphVector<ESphAttr> & dArgs, bool, CSphString & sError )
@@ -9770,11 +11372,9 @@ void SearchHandler_c::RunLocalSearchesMT ()
 			tRes.m_iMultiplier = m_bMultiQueue ? iQueries : 1;
 			tRes.m_iCpuTime += tRaw.m_iCpuTime / tRes.m_iMultiplier;
 			tRes.m_tIOStats.Add ( tRaw.m_tIOStats );
+			tRes.m_tStats.Add ( tRaw.m_tStats );
 			if ( tRaw.m_bHasPrediction )
-			{
-				tRes.m_tStats.Add ( tRaw.m_tStats );
 				tRes.m_iPredictedTime = CalcPredictedTimeMsec ( tRes );
-			}
 
 			// extract matches from sorter
 			FlattenToRes ( pSorter, tRes, iOrderTag+iQuery-m_iStart );
@@ -9886,6 +11486,7 @@ bool SearchHandler_c::RunLocalSearch ( int iLocal, ISphMatchSorter ** ppSorters,
 	}
 
 	bool bResult = false;
+	int64_t tmIndex = sphMicroTimer();
 	ppResults[0]->m_tIOStats.Start();
 	if ( *pMulti )
 	{
@@ -9895,6 +11496,7 @@ bool SearchHandler_c::RunLocalSearch ( int iLocal, ISphMatchSorter ** ppSorters,
 		bResult = pServed->m_pIndex->MultiQueryEx ( iQueries, &m_dQueries[m_iStart], ppResults, ppSorters, tMultiArgs );
 	}
 	ppResults[0]->m_tIOStats.Stop();
+	StatIndexLatency ( m_dLocal[iLocal].m_sName.cstr(), sphMicroTimer()-tmIndex );
 
 	iCpuTime += sphCpuTimer();
 	for ( int i=0; i<iQueries; ++i )
@@ -10058,6 +11660,7 @@ void SearchHandler_c::RunLocalSearches ( ISphMatchSorter * pLocalSorter, const c
 		}
 
 		bool bResult = false;
+		int64_t tmIndex = sphMicroTimer();
 		if ( m_bMultiQueue )
 		{
 			tStats.m_tIOStats.Start();
@@ -10073,6 +11676,7 @@ void SearchHandler_c::RunLocalSearches ( ISphMatchSorter * pLocalSorter, const c
 			bResult = pServed->m_pIndex->MultiQueryEx ( dSorters.GetLength(), &m_dQueries[m_iStart], &dResults[m_iStart], &dSorters[0], tMultiArgs );
 			dResults[m_iStart]->m_tIOStats.Stop();
 		}
+		StatIndexLatency ( sLocal, sphMicroTimer()-tmIndex );
 
 		// handle results
 		if ( !bResult )
@@ -10101,6 +11705,7 @@ void SearchHandler_c::RunLocalSearches ( ISphMatchSorter * pLocalSorter, const c
 					tRes.m_iQueryTime += tStats.m_iQueryTime / ( m_iEnd-m_iStart+1 );
 					tRes.m_iCpuTime += tStats.m_iCpuTime / ( m_iEnd-m_iStart+1 );
 					tRes.m_tIOStats.Add ( tStats.m_tIOStats );
+					tRes.m_tStats.Add ( tStats.m_tStats );
 					tRes.m_pMva = tStats.m_pMva;
 					tRes.m_pStrings = tStats.m_pStrings;
 					tRes.m_bArenaProhibit = tStats.m_bArenaProhibit;
@@ -10369,6 +11974,43 @@ struct TaggedLocalSorter_fn
 	}
 };
 
+/// a backup mirror to send the request to, if the primary agent answers slower than usual
+struct HedgeSlot_t
+{
+	int				m_iAgent;		///< index of the primary agent connection
+	AgentDesc_t		m_tMirror;		///< where to send the hedged request
+};
+
+/// match row arena for one query subset
+/// results keep their rows past the subset, so these are copied out of the arena before it is reset
+class SubsetArena_c : public ISphNoncopyable
+{
+public:
+	SubsetArena_c ( CSphVector<AggrResult_t> & dResults, int iStart, int iEnd )
+		: m_dResults ( dResults )
+		, m_iStart ( iStart )
+		, m_iEnd ( iEnd )
+	{
+		m_tArena.Start();
+	}
+
+	~SubsetArena_c ()
+	{
+		for ( int iRes=m_iStart; iRes<=m_iEnd; iRes++ )
+		{
+			AggrResult_t & tRes = m_dResults[iRes];
+			tRes.m_tStats.m_iArenaBytes += m_tArena.GetReservedBytes();
+			m_tArena.Detach ( tRes.m_dMatches.Begin(), tRes.m_dMatches.GetLength() );
+		}
+	}
+
+private:
+	CSphMatchArena				m_tArena;
+	CSphVector<AggrResult_t> &	m_dResults;
+	int							m_iStart;
+	int							m_iEnd;
+};
+
 void SearchHandler_c::RunSubset ( int iStart, int iEnd )
 {
 	m_iStart = iStart;
@@ -10380,6 +12022,9 @@ void SearchHandler_c::RunSubset ( int iStart, int iEnd )
 	int64_t tmLocal = 0;
 	int64_t tmCpu = sphCpuTimer ();
 
+	// rows of this subset come from one arena; result rows are detached from it on the way out
+	SubsetArena_c tArena ( m_dResults, iStart, iEnd );
+
 	// prepare for descent
 	CSphQuery & tFirst = m_dQueries[iStart];
 
@@ -10444,6 +12089,8 @@ void SearchHandler_c::RunSubset ( int iStart, int iEnd )
 	////////////////////////////
 
 	CSphVector<AgentConn_t> dAgents;
+	CSphVector<HedgeSlot_t> dHedges;
+	int64_t iHedgeDelay = 0;
 	int iDivideLimits = 1;
 	int iAgentConnectTimeout = 0, iAgentQueryTimeout = 0;
 	int iTagsCount = 0;
@@ -10494,10 +12141,26 @@ void SearchHandler_c::RunSubset ( int iStart, int iEnd )
 				dAgents.Reserve ( dAgents.GetLength() + pDist->m_dAgents.GetLength() );
 				ARRAY_FOREACH ( j, pDist->m_dAgents )
 				{
-					dAgents.Add().TakeTraits ( *pDist->m_dAgents[j].GetRRAgent ( pDist->m_eHaStrategy ) );
+					MetaAgentDesc_t & tMeta = pDist->m_dAgents[j];
+					AgentDesc_t * pAgent = tMeta.GetRRAgent ( pDist->m_eHaStrategy );
+					dAgents.Add().TakeTraits ( *pAgent );
 					dAgents.Last().m_iStoreTag = iTagsCount;
 					dAgents.Last().m_iWeight = iWeight;
 					iTagsCount += iTagStep;
+
+					// pick a backup mirror in case this one will be slower than usual
+					if ( pDist->m_iHedgePercentile && tMeta.IsHA() )
+					{
+						int64_t iDelay = tMeta.GetHedgeDelay ( pDist->m_iHedgePercentile );
+						AgentDesc_t * pMirror = ( iDelay>=0 ) ? tMeta.HedgeAgent ( pAgent->m_iDashIndex ) : NULL;
+						if ( pMirror )
+						{
+							HedgeSlot_t & tHedge = dHedges.Add();
+							tHedge.m_iAgent = dAgents.GetLength()-1;
+							tHedge.m_tMirror = *pMirror;
+							iHedgeDelay = Max ( iHedgeDelay, iDelay );
+						}
+					}
 				}
 
 				m_dLocal.Reserve ( m_dLocal.GetLength() + pDist->m_dLocal.GetLength() );
@@ -10620,6 +12283,7 @@ void SearchHandler_c::RunSubset ( int iStart, int iEnd )
 			UnlockOnDestroy ExtraLocker ( pExtraSchemaMT );
 
 			m_tHook.m_pIndex = pFirstIndex->m_pIndex;
+			m_tHook.m_iStoredFields = 0;
 			SphQueueSettings_t tQueueSettings ( m_dQueries[iStart], tFirstSchema, sError, m_pProfile );
 			tQueueSettings.m_bComputeItems = true;
 			tQueueSettings.m_pExtra = pExtraSchemaMT;
@@ -10628,6 +12292,14 @@ void SearchHandler_c::RunSubset ( int iStart, int iEnd )
 			pLocalSorter = sphCreateQueue ( tQueueSettings );
 
 			uLocalPFFlags = tQueueSettings.m_uPackedFactorFlags;
+
+			// stored field expressions are numbered after the fields of the index they were created for,
+			// and each search binds the stored fields snapshot of its own index; so every index needs a sorter of its own
+			if ( m_tHook.m_iStoredFields )
+			{
+				SafeDelete ( pLocalSorter );
+				uLocalPFFlags = SPH_FACTOR_DISABLE;
+			}
 		}
 
 		ReleaseIndex ( 0 );
@@ -10651,12 +12323,19 @@ void SearchHandler_c::RunSubset ( int iStart, int iEnd )
 	// connect to remote agents and query them, if required
 	CSphScopedPtr<SearchRequestBuilder_t> tReqBuilder ( NULL );
 	CSphScopedPtr<CSphRemoteAgentsController> tDistCtrl ( NULL );
+	CSphScopedPtr<CSphRemoteAgentsController> tHedgeCtrl ( NULL );
+	int64_t tmHedge = 0;
+	int iRetryCount = 0;
 	if ( dAgents.GetLength() )
 	{
 		if ( m_pProfile )
 			m_pProfile->Switch ( SPH_QSTATE_DIST_CONNECT );
 
-		int iRetryCount = Min ( Max ( tFirst.m_iRetryCount, 0 ), MAX_RETRY_COUNT ); // paranoid clamp
+		iRetryCount = Min ( Max ( tFirst.m_iRetryCount, 0 ), MAX_RETRY_COUNT ); // paranoid clamp
+
+		// hedged requests are appended later, and controllers keep pointers into dAgents, so no reallocs then
+		dAgents.Reserve ( dAgents.GetLength() + dHedges.GetLength() );
+		tmHedge = sphMicroTimer() + iHedgeDelay;
 
 		tReqBuilder = new SearchRequestBuilder_t ( m_dQueries, iStart, iEnd, iDivideLimits );
 		tDistCtrl = new CSphRemoteAgentsController ( g_iDistThreads, dAgents,
@@ -10691,13 +12370,25 @@ void SearchHandler_c::RunSubset ( int iStart, int iEnd )
 		if ( m_pProfile )
 			m_pProfile->Switch ( SPH_QSTATE_DIST_WAIT );
 
+		int64_t tmHedgeWait = 0;
+		bool bFinalWait = false;
 		while ( !bDistDone )
 		{
 			// don't forget to check incoming replies after send was over
-			tDistCtrl->WaitAgentsEvent();
-			bDistDone = tDistCtrl->IsDone();
+			if ( bFinalWait )
+			{
+				bDistDone = true;
+			} else
+			{
+				tDistCtrl->WaitAgentsEvent();
+				bDistDone = tDistCtrl->IsDone();
+			}
+
+			// all requests are sent; if hedging is on, only wait for the replies until the hedge point
+			bool bHedgeWait = ( bDistDone && !bFinalWait && dHedges.GetLength() );
+
 			// wait for remote queries to complete
-			if ( tDistCtrl->HasReadyAgents() )
+			if ( tDistCtrl->HasReadyAgents() || bHedgeWait || bFinalWait )
 			{
 				CSphVector<DWORD> dMvaStorage;
 				CSphVector<BYTE> dStringStorage;
@@ -10705,7 +12396,14 @@ void SearchHandler_c::RunSubset ( int iStart, int iEnd )
 				dStringStorage.Add ( 0 );
 				SearchReplyParser_t tParser ( iStart, iEnd, dMvaStorage, dStringStorage );
 				int iMsecLeft = iAgentQueryTimeout - (int)( tmLocal/1000 );
-				int iReplys = RemoteWaitForAgents ( dAgents, Max ( iMsecLeft, 0 ), tParser );
+				if ( tmHedgeWait )
+					iMsecLeft -= (int)( ( sphMicroTimer()-tmHedgeWait )/1000 );
+				if ( bHedgeWait )
+				{
+					tmHedgeWait = sphMicroTimer();
+					iMsecLeft = Min ( iMsecLeft, Max ( (int)( ( tmHedge-tmHedgeWait )/1000 ), 1 ) );
+				}
+				int iReplys = RemoteWaitForAgents ( dAgents, Max ( iMsecLeft, 0 ), tParser, bHedgeWait );
 				// check if there were valid (though might be 0-matches) replies, and merge them
 				if ( iReplys )
 				{
@@ -10767,6 +12465,7 @@ void SearchHandler_c::RunSubset ( int iStart, int iEnd )
 							tRes.m_iAgentFetchedDocs += tRemoteResult.m_iAgentFetchedDocs;
 							tRes.m_iAgentFetchedHits += tRemoteResult.m_iAgentFetchedHits;
 							tRes.m_iAgentFetchedSkips += tRemoteResult.m_iAgentFetchedSkips;
+							tRes.m_tAgentStats.Add ( tRemoteResult.m_tAgentStats );
 							tRes.m_bHasPrediction |= ( m_dQueries[iRes].m_iMaxPredictedMsec>0 );
 
 							// merge this agent's words
@@ -10782,6 +12481,45 @@ void SearchHandler_c::RunSubset ( int iStart, int iEnd )
 					m_dMva2Free.Add ( dMvaStorage.LeakData() );
 					m_dString2Free.Add ( dStringStorage.LeakData() );
 				}
+
+				// the hedge point passed, and some primary agents are still busy; ask their mirrors too
+				if ( bHedgeWait )
+				{
+					int iFirstHedge = dAgents.GetLength();
+					ARRAY_FOREACH ( i, dHedges )
+					{
+						AgentConn_t & tPrimary = dAgents[dHedges[i].m_iAgent];
+						if ( tPrimary.m_eState!=AGENT_QUERYED && tPrimary.m_eState!=AGENT_PREREPLY && tPrimary.m_eState!=AGENT_REPLY )
+							continue;
+
+						assert ( dAgents.GetLength()<dAgents.GetLimit() );
+						AgentConn_t & tHedge = dAgents.Add();
+						tHedge.TakeTraits ( dHedges[i].m_tMirror );
+						tHedge.m_iStoreTag = tPrimary.m_iStoreTag;
+						tHedge.m_iWeight = tPrimary.m_iWeight;
+						tHedge.m_pTwin = &tPrimary;
+						tPrimary.m_pTwin = &tHedge;
+					}
+
+					int iHedges = dAgents.GetLength() - iFirstHedge;
+					if ( iHedges )
+					{
+						if ( g_pStats )
+						{
+							g_tStatsMutex.Lock();
+							g_pStats->m_iAgentHedged += iHedges;
+							g_tStatsMutex.Unlock();
+						}
+
+						tHedgeCtrl = new CSphRemoteAgentsController ( g_iDistThreads, dAgents.Begin()+iFirstHedge, iHedges,
+							*tReqBuilder.Ptr(), iAgentConnectTimeout, iRetryCount, tFirst.m_iRetryDelay );
+						tHedgeCtrl->Finish();
+					}
+
+					// now wait for whoever answers first
+					bFinalWait = true;
+					bDistDone = false;
+				}
 			}
 		} // while ( !bDistDone )
 	} // if ( bDist && dAgents.GetLength() )
@@ -10803,7 +12541,7 @@ void SearchHandler_c::RunSubset ( int iStart, int iEnd )
 					m_dAgentTimes[j].Add ( ( tAgent.m_iWall ) / ( 1000 * ( iEnd-iStart+1 ) ) );
 			}
 
-			if ( !tAgent.m_bSuccess && !tAgent.m_sFailure.IsEmpty() )
+			if ( !tAgent.m_bSuccess && !tAgent.m_sFailure.IsEmpty() && !tAgent.IsHedgeLoser() )
 				for ( int j=iStart; j<=iEnd; j++ )
 					m_dFailuresSet[j].SubmitEx ( tFirst.m_sIndexes.cstr(), tAgent.m_bBlackhole ? "blackhole %s: %s" : "agent %s: %s",
 						tAgent.GetName().cstr(), tAgent.m_sFailure.cstr() );
@@ -11007,7 +12745,7 @@ bool CheckCommandVersion ( int iVer, int iDaemonVersion, InputBuffer_c & tReq )
 }
 
 
-void SendSearchResponse ( SearchHandler_c & tHandler, InputBuffer_c & tReq, int iSock, int iVer, int iMasterVer )
+void SendSearchResponse ( SearchHandler_c & tHandler, InputBuffer_c & tReq, int iSock, int iVer, int iMasterVer, DWORD uEncoding )
 {
 	// serve the response
 	NetOutputBuffer_c tOut ( iSock );
@@ -11026,7 +12764,7 @@ void SendSearchResponse ( SearchHandler_c & tHandler, InputBuffer_c & tReq, int
 			return;
 		}
 
-		iReplyLen = CalcResultLength ( iVer, &tRes, tRes.m_dTag2Pools, bAgentMode, tHandler.m_dQueries[0], iMasterVer );
+		iReplyLen = CalcResultLength ( iVer, &tRes, tRes.m_dTag2Pools, bAgentMode, tHandler.m_dQueries[0], iMasterVer, NULL );
 		bool bWarning = ( iVer>=0x106 && !tRes.m_sWarning.IsEmpty() );
 
 		// send it
@@ -11034,12 +12772,34 @@ void SendSearchResponse ( SearchHandler_c & tHandler, InputBuffer_c & tReq, int
 		tOut.SendWord ( VER_COMMAND_SEARCH );
 		tOut.SendInt ( iReplyLen );
 
-		SendResult ( iVer, tOut, &tRes, tRes.m_dTag2Pools, bAgentMode, tHandler.m_dQueries[0], iMasterVer );
+		SendResult ( iVer, tOut, &tRes, tRes.m_dTag2Pools, bAgentMode, tHandler.m_dQueries[0], iMasterVer, NULL );
 
 	} else
 	{
+		// master might want matches column by column; only use that when it is actually smaller
+		CSphVector<ColumnarResult_t> dColumnar ( tHandler.m_dQueries.GetLength() );
+		CSphVector<const ColumnarResult_t *> dBlocks ( tHandler.m_dQueries.GetLength() );
+		dBlocks.Fill ( NULL );
+		bool bColumnar = ( bAgentMode && iMasterVer>=12 && ( uEncoding & RESULT_COLUMNAR ) );
+
 		ARRAY_FOREACH ( i, tHandler.m_dQueries )
-			iReplyLen += CalcResultLength ( iVer, &tHandler.m_dResults[i], tHandler.m_dResults[i].m_dTag2Pools, bAgentMode, tHandler.m_dQueries[i], iMasterVer );
+		{
+			const AggrResult_t & tRes = tHandler.m_dResults[i];
+			int iRowLen = CalcResultLength ( iVer, &tRes, tRes.m_dTag2Pools, bAgentMode, tHandler.m_dQueries[i], iMasterVer, NULL );
+			if ( bColumnar && tRes.m_sError.IsEmpty() && tRes.m_iCount>0 )
+			{
+				ColumnarResult_t & tBlock = dColumnar[i];
+				EncodeColumnar ( tBlock, uEncoding, &tRes, tRes.m_dTag2Pools, SendGetAttrCount ( tRes.m_tSchema, bAgentMode ) );
+				int iColLen = CalcResultLength ( iVer, &tRes, tRes.m_dTag2Pools, bAgentMode, tHandler.m_dQueries[i], iMasterVer, &tBlock );
+				tBlock.m_iPlainLen = iRowLen - iColLen + 12 + tBlock.m_dData.GetLength();
+				if ( iColLen<iRowLen && tBlock.m_iRawLen<=tBlock.m_iPlainLen )
+				{
+					dBlocks[i] = &tBlock;
+					iRowLen = iColLen;
+				}
+			}
+			iReplyLen += iRowLen;
+		}
 
 		// send it
 		tOut.SendWord ( (WORD)SEARCHD_OK );
@@ -11047,7 +12807,7 @@ void SendSearchResponse ( SearchHandler_c & tHandler, InputBuffer_c & tReq, int
 		tOut.SendInt ( iReplyLen );
 
 		ARRAY_FOREACH ( i, tHandler.m_dQueries )
-			SendResult ( iVer, tOut, &tHandler.m_dResults[i], tHandler.m_dResults[i].m_dTag2Pools, bAgentMode, tHandler.m_dQueries[i], iMasterVer );
+			SendResult ( iVer, tOut, &tHandler.m_dResults[i], tHandler.m_dResults[i].m_dTag2Pools, bAgentMode, tHandler.m_dQueries[i], iMasterVer, dBlocks[i] );
 	}
 
 	tOut.Flush ();
@@ -11075,6 +12835,11 @@ void HandleCommandSearch ( int iSock, int iVer, InputBuffer_c & tReq, ThdDesc_t
 		return;
 	}
 
+	// result set encoding requested by master
+	DWORD uEncoding = 0;
+	if ( iMasterVer>=12 )
+		uEncoding = tReq.GetDword();
+
 	// parse request
 	int iQueries = 1;
 	if ( iVer>=0x10D )
@@ -11099,7 +12864,7 @@ void HandleCommandSearch ( int iSock, int iVer, InputBuffer_c & tReq, ThdDesc_t
 
 	// run queries, send response
 	tHandler.RunQueries();
-	SendSearchResponse ( tHandler, tReq, iSock, iVer, iMasterVer );
+	SendSearchResponse ( tHandler, tReq, iSock, iVer, iMasterVer, uEncoding );
 
 	int64_t iTotalPredictedTime = 0;
 	int64_t iTotalAgentPredictedTime = 0;
@@ -11313,6 +13078,7 @@ static const char * g_dSqlStmts[] =
 };
 
 STATIC_ASSERT ( sizeof(g_dSqlStmts)/sizeof(g_dSqlStmts[0])==STMT_TOTAL, STMT_DESC_SHOULD_BE_SAME_AS_STMT_TOTAL );
+STATIC_ASSERT ( STMT_TOTAL<=STATS_MAX_STMTS, STATS_MAX_STMTS_SHOULD_COVER_ALL_STATEMENTS );
 
 
 /// refcounted vector
@@ -12802,6 +14568,10 @@ bool MakeSnippets ( CSphString sIndex, CSphVector<ExcerptQuery_t> & dQueries, CS
 	bool bScattered = ( q.m_iLoadFiles & 2 )!=0;
 	bool bSkipAbsentFiles = !( q.m_iLoadFiles & 1 );
 
+	// snippets_threads overrides dist_threads for snippets
+	int iSnippetThreads = sphGetSnippetThreads();
+	int iConfThreads = iSnippetThreads>0 ? iSnippetThreads : g_iDistThreads;
+
 	if ( bRemote )
 	{
 		dRemoteSnippets.m_iAgentConnectTimeout = pDist->m_iAgentConnectTimeout;
@@ -12827,9 +14597,9 @@ bool MakeSnippets ( CSphString sIndex, CSphVector<ExcerptQuery_t> & dQueries, CS
 			return false;
 		}
 
-		if ( g_iDistThreads<=1 && bScattered )
+		if ( iConfThreads<=1 && bScattered )
 		{
-			sError.SetSprintf ( "%s", "load_files_scattered works only together with dist_threads>1" );
+			sError.SetSprintf ( "%s", "load_files_scattered works only together with dist_threads>1 or snippets_threads>1" );
 			return false;
 		}
 		sIndex = dDistLocal[0];
@@ -12871,7 +14641,7 @@ bool MakeSnippets ( CSphString sIndex, CSphVector<ExcerptQuery_t> & dQueries, CS
 
 	bool bOk = true;
 	int iAbsentHead = EOF_ITEM;
-	if ( g_iDistThreads<=1 || dQueries.GetLength()<2 )
+	if ( iConfThreads<=1 || dQueries.GetLength()<2 )
 	{
 		// boring single threaded loop
 		ARRAY_FOREACH ( i, dQueries )
@@ -12970,10 +14740,22 @@ bool MakeSnippets ( CSphString sIndex, CSphVector<ExcerptQuery_t> & dQueries, CS
 		CSphMutex tLock;
 		tLock.Init();
 
+		// dedicated snippet workers come from the pool, otherwise dist_threads ones get spawned for this call
+		// the current thread is always the 1st worker
+		int iThreads = g_iDistThreads;
+		int iPoolSlots = 0;
+		bool bPool = ( iSnippetThreads>0 );
+		if ( bPool )
+		{
+			iPoolSlots = sphSnippetThreadsAcquire ( Min ( iSnippetThreads, dQueries.GetLength() )-1 );
+			iThreads = iPoolSlots+1;
+		}
+
 		CrashQuery_t tCrashQuery = SphCrashLogger_c::GetQuery(); // transfer query info for crash logger to new thread
 		int iCurQuery = 0;
-		CSphVector<SnippetThread_t> dThreads ( g_iDistThreads );
-		for ( int i=0; i<g_iDistThreads; i++ )
+		CSphVector<SnippetThread_t> dThreads ( iThreads );
+		CSphSnippetJobs tJobs;
+		for ( int i=0; i<iThreads; i++ )
 		{
 			SnippetThread_t & t = dThreads[i];
 			t.m_pLock = &tLock;
@@ -12982,7 +14764,9 @@ bool MakeSnippets ( CSphString sIndex, CSphVector<ExcerptQuery_t> & dQueries, CS
 			t.m_pCurQuery = &iCurQuery;
 			t.m_pIndex = pIndex;
 			t.m_tCrashQuery = tCrashQuery;
-			if ( i )
+			if ( i && bPool )
+				tJobs.Run ( SnippetThreadFunc, &dThreads[i] );
+			else if ( i )
 				SphCrashLogger_c::ThreadCreate ( &dThreads[i].m_tThd, SnippetThreadFunc, &dThreads[i] );
 		}
 
@@ -13011,8 +14795,13 @@ bool MakeSnippets ( CSphString sIndex, CSphVector<ExcerptQuery_t> & dQueries, CS
 			iSuccesses = RemoteWaitForAgents ( dRemoteSnippets.m_dAgents, dRemoteSnippets.m_iAgentQueryTimeout, tParser ); // FIXME? profile update time too?
 		}
 
-		for ( int i=1; i<dThreads.GetLength(); i++ )
-			sphThreadJoin ( &dThreads[i].m_tThd );
+		if ( bPool )
+			tJobs.Wait();
+		else
+			for ( int i=1; i<dThreads.GetLength(); i++ )
+				sphThreadJoin ( &dThreads[i].m_tThd );
+
+		sphSnippetThreadsRelease ( iPoolSlots );
 
 		if ( iSuccesses!=dRemoteSnippets.m_dAgents.GetLength() )
 		{
@@ -13647,6 +15436,11 @@ public:
 	{
 		return sValue && ( m_sPattern.IsEmpty() || sphWildcardMatch ( sValue, m_sPattern.cstr() ) );
 	}
+
+	bool HasPattern () const
+	{
+		return !m_sPattern.IsEmpty();
+	}
 };
 
 // string vector with 'like' matcher
@@ -13710,6 +15504,89 @@ static inline void FormatMsec ( CSphString & sOut, int64_t tmTime )
 	sOut.SetSprintf ( "%d.%03d", (int)( tmTime/1000000 ), (int)( (tmTime%1000000)/1000 ) );
 }
 
+/// latency in msec, with usec precision
+static inline void FormatLatency ( CSphString & sOut, int64_t tmTime )
+{
+	sOut.SetSprintf ( "%d.%03d", (int)( tmTime/1000 ), (int)( tmTime%1000 ) );
+}
+
+/// add sample counts and p50/p95/p99/p999 rows of both windows of a latency histogram
+static void AddLatencyToStatus ( VectorLike & dStatus, const char * sPrefix, const LatencyHistogram_t & tHist, bool bSkipEmpty )
+{
+	static const int dPermilles[] = { 500, 950, 990, 999 };
+	static const char * dNames[] = { "p50", "p95", "p99", "p999" };
+
+	int64_t dBuckets[LATENCY_BUCKETS];
+	if ( bSkipEmpty && !tHist.Collect ( dBuckets, true ) )
+		return;
+
+	for ( int iWindow=0; iWindow<2; iWindow++ )
+	{
+		const char * sWindow = iWindow ? "5m" : "1m";
+		int64_t iTotal = tHist.Collect ( dBuckets, iWindow==1 );
+		if ( dStatus.MatchAddVa ( "%s_%s_count", sPrefix, sWindow ) )
+			dStatus.Add().SetSprintf ( INT64_FMT, iTotal );
+
+		for ( int i=0; i<(int)( sizeof(dPermilles)/sizeof(dPermilles[0]) ); i++ )
+			if ( dStatus.MatchAddVa ( "%s_%s_%s", sPrefix, sWindow, dNames[i] ) )
+				FormatLatency ( dStatus.Add(), LatencyPercentile ( dBuckets, iTotal, dPermilles[i] ) );
+	}
+}
+
+/// raw 5 minutes window of a latency histogram as a JSON object; buckets are [max_usec, count] pairs
+static void AppendLatencyJson ( CSphStringBuilder & tOut, const char * sName, const LatencyHistogram_t & tHist )
+{
+	int64_t dBuckets[LATENCY_BUCKETS];
+	int64_t iTotal = tHist.Collect ( dBuckets, true );
+	if ( !iTotal )
+		return;
+
+	tOut.Appendf ( "%s\"%s\":{\"count\":"INT64_FMT",\"buckets\":[", tOut.Length()>1 ? "," : "", sName, iTotal );
+	bool bFirst = true;
+	for ( int i=0; i<LATENCY_BUCKETS; i++ )
+		if ( dBuckets[i] )
+		{
+			tOut.Appendf ( "%s["INT64_FMT","INT64_FMT"]", bFirst ? "" : ",", LatencyBucketMax(i), dBuckets[i] );
+			bFirst = false;
+		}
+	tOut += "]}";
+}
+
+/// machine-readable dump of all the tracked latency histograms
+static void BuildLatencyJson ( CSphStringBuilder & tOut )
+{
+	tOut += "{";
+	CSphString sName;
+	for ( int i=0; i<SEARCHD_COMMAND_TOTAL; i++ )
+	{
+		sName.SetSprintf ( "command_%s_wall", g_dApiCommands[i] );
+		AppendLatencyJson ( tOut, sName.cstr(), g_pStats->m_dCommandLatency[i] );
+	}
+	for ( int i=0; i<STMT_TOTAL; i++ )
+	{
+		sName.SetSprintf ( "sql_%s_wall", g_dSqlStmts[i] );
+		AppendLatencyJson ( tOut, sName.cstr(), g_pStats->m_dStmtLatency[i] );
+	}
+	AppendLatencyJson ( tOut, "queue_wait", g_pStats->m_tQueueWait );
+
+	for ( IndexHashIterator_c it ( g_pLocalIndexes ); it.Next(); )
+	{
+		const IndexLatency_t * pLatency = FindIndexLatency ( it.GetKey().cstr(), false );
+		if ( !pLatency )
+			continue;
+		sName.SetSprintf ( "index_%s_query_wall", it.GetKey().cstr() );
+		AppendLatencyJson ( tOut, sName.cstr(), pLatency->m_tWall );
+	}
+
+	g_pStats->m_hDashBoard.IterateStart();
+	while ( g_pStats->m_hDashBoard.IterateNext() )
+	{
+		sName.SetSprintf ( "agent_%s_latency", g_pStats->m_hDashBoard.IterateGetKey().cstr() );
+		AppendLatencyJson ( tOut, sName.cstr(), g_pStats->m_dDashboard.m_dItemStats [ g_pStats->m_hDashBoard.IterateGet() ].m_tLatency );
+	}
+	tOut += "}";
+}
+
 void BuildStatus ( VectorLike & dStatus )
 {
 	assert ( g_pStats );
@@ -13748,6 +15625,12 @@ void BuildStatus ( VectorLike & dStatus )
 		dStatus.Add().SetSprintf ( FMT64, g_pStats->m_iAgentConnect );
 	if ( dStatus.MatchAdd ( "agent_retry" ) )
 		dStatus.Add().SetSprintf ( FMT64, g_pStats->m_iAgentRetry );
+	if ( dStatus.MatchAdd ( "agent_hedged" ) )
+		dStatus.Add().SetSprintf ( FMT64, g_pStats->m_iAgentHedged );
+	if ( dStatus.MatchAdd ( "agent_result_bytes" ) )
+		dStatus.Add().SetSprintf ( FMT64, g_pStats->m_iAgentResultBytes );
+	if ( dStatus.MatchAdd ( "agent_result_bytes_saved" ) )
+		dStatus.Add().SetSprintf ( FMT64, g_pStats->m_iAgentResultSaved );
 	if ( dStatus.MatchAdd ( "queries" ) )
 		dStatus.Add().SetSprintf ( FMT64, g_pStats->m_iQueries );
 	if ( dStatus.MatchAdd ( "dist_queries" ) )
@@ -13770,10 +15653,50 @@ void BuildStatus ( VectorLike & dStatus )
 			for ( int k=0; k<eMaxStat; ++k )
 				if ( dStatus.MatchAddVa ( "ag_%s_%d_%d_%s", sIdx, i+1, j+1, tStats.m_sNames[k] ) )
 					dStatus.Add().SetSprintf ( FMT64, tStats.m_iStats[k] );
+
+			int iDash = dAgents[i].GetAgents()[j].m_iDashIndex;
+			if ( iDash>=0 && iDash<STATS_MAX_DASH )
+			{
+				CSphString sPrefix;
+				sPrefix.SetSprintf ( "ag_%s_%d_%d_latency", sIdx, i+1, j+1 );
+				AddLatencyToStatus ( dStatus, sPrefix.cstr(), g_pStats->m_dDashboard.m_dItemStats[iDash].m_tLatency, true );
+			}
 		}
 	}
 	g_tDistLock.Unlock();
 
+	if ( g_iExpansionCacheSize>0 )
+	{
+		CSphIndexStatus tCache;
+		for ( IndexHashIterator_c it ( g_pLocalIndexes ); it.Next(); )
+		{
+			const ServedIndex_t & tServed = it.Get();
+			if ( !tServed.m_bEnabled || !tServed.m_pIndex )
+				continue;
+			tServed.ReadLock();
+			tServed.m_pIndex->GetExpansionCacheStatus ( &tCache );
+			tServed.Unlock();
+		}
+
+		if ( dStatus.MatchAdd ( "expansion_cache_hits" ) )
+			dStatus.Add().SetSprintf ( FMT64, tCache.m_iExpansionCacheHits );
+		if ( dStatus.MatchAdd ( "expansion_cache_misses" ) )
+			dStatus.Add().SetSprintf ( FMT64, tCache.m_iExpansionCacheMisses );
+		if ( dStatus.MatchAdd ( "expansion_cache_bytes" ) )
+			dStatus.Add().SetSprintf ( FMT64, tCache.m_iExpansionCacheBytes );
+	}
+
+	{
+		int64_t iHits = 0, iMisses = 0, iBytes = 0;
+		sphGetDocstoreCacheStatus ( iHits, iMisses, iBytes );
+		if ( dStatus.MatchAdd ( "docstore_cache_hits" ) )
+			dStatus.Add().SetSprintf ( FMT64, iHits );
+		if ( dStatus.MatchAdd ( "docstore_cache_misses" ) )
+			dStatus.Add().SetSprintf ( FMT64, iMisses );
+		if ( dStatus.MatchAdd ( "docstore_cache_bytes" ) )
+			dStatus.Add().SetSprintf ( FMT64, iBytes );
+	}
+
 	if ( dStatus.MatchAdd ( "query_wall" ) )
 		FormatMsec ( dStatus.Add(), g_pStats->m_iQueryTime );
 
@@ -13851,6 +15774,28 @@ void BuildStatus ( VectorLike & dStatus )
 		if ( dStatus.MatchAdd ( "avg_query_readtime" ) )
 			dStatus.Add() = OFF;
 	}
+
+	// tail latencies, over the last 1 and 5 minutes
+	CSphString sPrefix;
+	for ( int i=0; i<SEARCHD_COMMAND_TOTAL; i++ )
+	{
+		sPrefix.SetSprintf ( "command_%s_wall", g_dApiCommands[i] );
+		AddLatencyToStatus ( dStatus, sPrefix.cstr(), g_pStats->m_dCommandLatency[i], true );
+	}
+	for ( int i=0; i<STMT_TOTAL; i++ )
+	{
+		sPrefix.SetSprintf ( "sql_%s_wall", g_dSqlStmts[i] );
+		AddLatencyToStatus ( dStatus, sPrefix.cstr(), g_pStats->m_dStmtLatency[i], true );
+	}
+	AddLatencyToStatus ( dStatus, "queue_wait", g_pStats->m_tQueueWait, false );
+
+	// raw histograms are big, so only dump them when explicitly asked for
+	if ( dStatus.HasPattern() && dStatus.MatchAdd ( "latency_histograms" ) )
+	{
+		CSphStringBuilder tJson;
+		BuildLatencyJson ( tJson );
+		dStatus.Add ( tJson.cstr() );
+	}
 }
 
 void BuildOneAgentStatus ( VectorLike & dStatus, const CSphString& sAgent, const char * sPrefix="agent" )
@@ -14057,6 +16002,43 @@ static void AddIOStatsToMeta ( VectorLike & dStatus, const CSphIOStats & tStats,
 		dStatus.Add().SetSprintf ( "%d.%d", (int)( tStats.m_iWriteBytes/1024 ), (int)( tStats.m_iWriteBytes%1024 )/100 );
 }
 
+static void AddWorkStatsToMeta ( VectorLike & dStatus, const CSphQueryResultMeta & tMeta )
+{
+	// local work plus whatever the agents reported
+	CSphQueryStats tStats = tMeta.m_tStats;
+	tStats.Add ( tMeta.m_tAgentStats );
+	tStats.m_iFetchedDocs += tMeta.m_iAgentFetchedDocs;
+	tStats.m_iFetchedHits += tMeta.m_iAgentFetchedHits;
+	tStats.m_iSkips += tMeta.m_iAgentFetchedSkips;
+
+	if ( dStatus.MatchAdd ( "fetched_docs" ) )
+		dStatus.Add().SetSprintf ( "%u", tStats.m_iFetchedDocs );
+
+	if ( dStatus.MatchAdd ( "fetched_hits" ) )
+		dStatus.Add().SetSprintf ( "%u", tStats.m_iFetchedHits );
+
+	if ( dStatus.MatchAdd ( "skiplist_jumps" ) )
+		dStatus.Add().SetSprintf ( "%u", tStats.m_iSkips );
+
+	if ( dStatus.MatchAdd ( "pushed_matches" ) )
+		dStatus.Add().SetSprintf ( INT64_FMT, tStats.m_iPushedMatches );
+
+	if ( dStatus.MatchAdd ( "filter_evals" ) )
+		dStatus.Add().SetSprintf ( INT64_FMT, tStats.m_iFilterEvals );
+
+	if ( dStatus.MatchAdd ( "spd_read_kbytes" ) )
+		dStatus.Add().SetSprintf ( "%d.%d", (int)( tStats.m_iDoclistBytes/1024 ), (int)( tStats.m_iDoclistBytes%1024 )/100 );
+
+	if ( dStatus.MatchAdd ( "spp_read_kbytes" ) )
+		dStatus.Add().SetSprintf ( "%d.%d", (int)( tStats.m_iHitlistBytes/1024 ), (int)( tStats.m_iHitlistBytes%1024 )/100 );
+
+	if ( dStatus.MatchAdd ( "spa_read_kbytes" ) )
+		dStatus.Add().SetSprintf ( "%d.%d", (int)( tStats.m_iDocinfoBytes/1024 ), (int)( tStats.m_iDocinfoBytes%1024 )/100 );
+
+	if ( dStatus.MatchAdd ( "arena_kbytes" ) )
+		dStatus.Add().SetSprintf ( "%d.%d", (int)( tStats.m_iArenaBytes/1024 ), (int)( tStats.m_iArenaBytes%1024 )/100 );
+}
+
 void BuildMeta ( VectorLike & dStatus, const CSphQueryResultMeta & tMeta )
 {
 	if ( !tMeta.m_sError.IsEmpty() && dStatus.MatchAdd ( "error" ) )
@@ -14089,6 +16071,9 @@ void BuildMeta ( VectorLike & dStatus, const CSphQueryResultMeta & tMeta )
 		AddIOStatsToMeta ( dStatus, tMeta.m_tAgentIOStats, "agent_" );
 	}
 
+	if ( tMeta.m_sError.IsEmpty() )
+		AddWorkStatsToMeta ( dStatus, tMeta );
+
 	if ( tMeta.m_bHasPrediction )
 	{
 		if ( dStatus.MatchAdd ( "local_fetched_docs" ) )
@@ -14197,79 +16182,305 @@ void HandleCommandFlush ( int iSock, int iVer, InputBuffer_c & tReq )
 		// --console mode, no async thread/process to handle the check
 		sphLogDebug ( "attrflush: --console mode, command ignored" );
 
-	} else
-	{
-		// force a check in head process, and wait it until completes
-		// FIXME! semi active wait..
-		sphLogDebug ( "attrflush: forcing check, tag=%d", g_pFlush->m_iFlushTag );
-		g_pFlush->m_bForceCheck = true;
-		while ( g_pFlush->m_bForceCheck )
-			sphSleepMsec ( 1 );
+	} else
+	{
+		// force a check in head process, and wait it until completes
+		// FIXME! semi active wait..
+		sphLogDebug ( "attrflush: forcing check, tag=%d", g_pFlush->m_iFlushTag );
+		g_pFlush->m_bForceCheck = true;
+		while ( g_pFlush->m_bForceCheck )
+			sphSleepMsec ( 1 );
+
+		// if we are flushing now, wait until flush completes
+		while ( g_pFlush->m_bFlushing )
+			sphSleepMsec ( 10 );
+		sphLogDebug ( "attrflush: check finished, tag=%d", g_pFlush->m_iFlushTag );
+	}
+
+	// return last flush tag, just for the fun of it
+	NetOutputBuffer_c tOut ( iSock );
+	tOut.SendWord ( SEARCHD_OK );
+	tOut.SendWord ( VER_COMMAND_FLUSHATTRS );
+	tOut.SendInt ( 4 ); // resplen, 1 dword
+	tOut.SendInt ( g_pFlush->m_iFlushTag );
+	tOut.Flush ();
+	assert ( tOut.GetError()==true || tOut.GetSentCount()==12 ); // 8+resplen
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// GENERAL HANDLER
+/////////////////////////////////////////////////////////////////////////////
+
+#define THD_STATE(_state) \
+{ \
+	DISABLE_CONST_COND_CHECK \
+	if ( pThd ) \
+	{ \
+		pThd->m_eThdState = _state; \
+		pThd->m_tmStart = sphMicroTimer(); \
+		if_const ( _state==THD_NET_IDLE ) \
+			pThd->m_dBuf[0] = '\0'; \
+	} \
+	ENABLE_CONST_COND_CHECK \
+}
+
+void HandleCommandSphinxql ( int iSock, int iVer, InputBuffer_c & tReq ); // definition is below
+void StatCountCommand ( int iCmd, int iCount=1 );
+void StatCommandLatency ( int iCmd, int64_t tmWall );
+void StatStmtLatency ( SqlStmt_e eStmt, int64_t tmWall );
+void HandleCommandUserVar ( int iSock, int iVer, NetInputBuffer_c & tReq );
+
+/// ping/pong exchange over API
+void HandleCommandPing ( int iSock, int iVer, InputBuffer_c & tReq )
+{
+	if ( !CheckCommandVersion ( iVer, VER_COMMAND_PING, tReq ) )
+		return;
+
+	// parse ping
+	int iCookie = tReq.GetInt();
+
+	// return last flush tag, just for the fun of it
+	NetOutputBuffer_c tOut ( iSock );
+	tOut.SendWord ( SEARCHD_OK );
+	tOut.SendWord ( VER_COMMAND_PING );
+	tOut.SendInt ( 4 ); // resplen, 1 dword
+	tOut.SendInt ( iCookie ); // echo the cookie back
+	tOut.Flush ();
+	assert ( tOut.GetError()==true || tOut.GetSentCount()==12 ); // 8+resplen
+}
+
+inline void DecPersCount()
+{
+	CSphScopedLockedShare<InterWorkerStorage> dPersNum ( *g_pPersistentInUse );
+	DWORD& uPers = dPersNum.SharedValue<DWORD>();
+	if ( uPers )
+		--uPers;
+}
+
+static int GetOsThreadId(); // definition is below
+
+/// client connection in the multiplexed mode, shared by the concurrent requests
+struct MuxConn_t
+{
+	CSphMutex			m_tSendLock;	///< whole reply frames are written under it
+	CSphAtomic<long>	m_iInFlight;	///< requests still being handled
+
+	MuxConn_t ()	{ m_tSendLock.Init(); }
+	~MuxConn_t ()	{ m_tSendLock.Done(); }
+};
+
+/// a request read off a multiplexed connection, handled in its own thread
+struct MuxRequest_t : public ThdDesc_t
+{
+	MuxConn_t *				m_pConn;
+	MuxReply_t				m_tReply;
+	int						m_iCommand;
+	int						m_iCommandVer;
+	CSphFixedVector<BYTE>	m_dBody;
+
+	MuxRequest_t ()
+		: m_pConn ( NULL )
+		, m_iCommand ( 0 )
+		, m_iCommandVer ( 0 )
+		, m_dBody ( 0 )
+	{}
+};
+
+
+static void MuxSendError ( int iSock, MuxConn_t & tConn, DWORD uId, WORD uStatus, const char * sError )
+{
+	NetOutputBuffer_c tOut ( iSock );
+	tOut.SetMultiplexed ( &tConn.m_tSendLock, uId );
+	tOut.SendWord ( uStatus );
+	tOut.SendWord ( 0 ); // version doesn't matter
+	tOut.SendInt ( 4+strlen(sError) );
+	tOut.SendString ( sError );
+	tOut.Flush ();
+}
+
+
+static void MuxRequestThread ( void * pArg )
+{
+	MuxRequest_t * pReq = (MuxRequest_t *) pArg;
+	sphThreadSet ( g_tConnKey, &pReq->m_iConnID );
+	sphThreadSet ( g_tMuxKey, &pReq->m_tReply );
+	pReq->m_iTid = GetOsThreadId();
+
+	int64_t tmStart = sphMicroTimer();
+	StatQueueWait ( tmStart - pReq->m_tmStart );
+
+	int iSock = pReq->m_iClientSock;
+	int iVer = pReq->m_iCommandVer;
+	MuxInputBuffer_c tBuf ( pReq->m_dBody.Begin(), pReq->m_dBody.GetLength(), iSock );
+
+	CrashQuery_t tCrashQuery;
+	tCrashQuery.m_pQuery = pReq->m_dBody.Begin();
+	tCrashQuery.m_iSize = pReq->m_dBody.GetLength();
+	tCrashQuery.m_bMySQL = false;
+	tCrashQuery.m_uCMD = (WORD)pReq->m_iCommand;
+	tCrashQuery.m_uVer = (WORD)iVer;
+	SphCrashLogger_c::SetLastQuery ( tCrashQuery );
+
+	switch ( pReq->m_iCommand )
+	{
+		case SEARCHD_COMMAND_SEARCH:	HandleCommandSearch ( iSock, iVer, tBuf, pReq ); break;
+		case SEARCHD_COMMAND_EXCERPT:	HandleCommandExcerpt ( iSock, iVer, tBuf, pReq ); break;
+		case SEARCHD_COMMAND_KEYWORDS:	HandleCommandKeywords ( iSock, iVer, tBuf ); break;
+		case SEARCHD_COMMAND_UPDATE:	HandleCommandUpdate ( iSock, iVer, tBuf ); break;
+		case SEARCHD_COMMAND_STATUS:	HandleCommandStatus ( iSock, iVer, tBuf ); break;
+		case SEARCHD_COMMAND_FLUSHATTRS:HandleCommandFlush ( iSock, iVer, tBuf ); break;
+		case SEARCHD_COMMAND_SPHINXQL:	HandleCommandSphinxql ( iSock, iVer, tBuf ); break;
+		case SEARCHD_COMMAND_PING:		HandleCommandPing ( iSock, iVer, tBuf ); break;
+		default:						tBuf.SendErrorReply ( "command '%s' is not supported over multiplexed connection", g_dApiCommands[pReq->m_iCommand] ); break;
+	}
+
+	StatCommandLatency ( pReq->m_iCommand, sphMicroTimer()-tmStart );
+	SphCrashLogger_c::SetLastQuery ( CrashQuery_t() );
+
+	// done; remove myself from the table
+#if USE_WINDOWS
+	CloseHandle ( pReq->m_tThd );
+#endif
+	g_tThdMutex.Lock ();
+	g_dThd.Remove ( pReq );
+	g_tThdMutex.Unlock ();
+
+	MuxConn_t * pConn = pReq->m_pConn;
+	SafeDelete ( pReq );
+	pConn->m_iInFlight.Dec();
+}
+
+
+/// serve a connection switched to the multiplexed mode
+/// requests come framed with ids, get handled concurrently in their own threads, and replies go back framed in any order
+static void HandleMultiplexed ( int iSock, const char * sClientIP, ThdDesc_t * pThd, NetInputBuffer_c & tBuf )
+{
+	assert ( pThd );
+	int64_t iCID = pThd->m_iConnID;
+	MuxConn_t tConn;
+	int iIdle = 0;
+
+	for ( ;; )
+	{
+		// same interruptible wait as with the persistent connections
+		THD_STATE ( THD_NET_IDLE );
+		bool bFrame = tBuf.ReadFrom ( 8, 1, true );
+
+		if ( !bFrame && g_bGotSigterm )
+		{
+			sphLogDebugv ( "conn %s("INT64_FMT"): bailing on SIGTERM", sClientIP, iCID );
+			break;
+		}
+
+		if ( !bFrame && sphSockPeekErrno()==ETIMEDOUT )
+		{
+			if ( g_bGotSighup && !tConn.m_iInFlight )
+			{
+				sphLogDebugv ( "conn %s("INT64_FMT"): bailing idle multiplexed conn on SIGHUP", sClientIP, iCID );
+				break;
+			}
+
+			if ( !tConn.m_iInFlight && ++iIdle>=g_iClientTimeout )
+			{
+				sphLogDebugv ( "conn %s("INT64_FMT"): bailing idle multiplexed conn on client_timeout", sClientIP, iCID );
+				break;
+			}
+			continue;
+		}
+		iIdle = 0;
+
+		if ( !bFrame && tBuf.IsIntr() )
+			continue;
+
+		if ( !bFrame )
+			break;
+
+		// frame header, then the usual request header and body
+		THD_STATE ( THD_NET_READ );
+		DWORD uId = tBuf.GetDword ();
+		int iFrameLen = tBuf.GetInt ();
+		if ( iFrameLen<8 || !tBuf.ReadFrom ( iFrameLen ) )
+		{
+			sphWarning ( "failed to receive multiplexed request (client=%s("INT64_FMT"), len=%d, error='%s')",
+				sClientIP, iCID, iFrameLen, sphSockError() );
+			break;
+		}
 
-		// if we are flushing now, wait until flush completes
-		while ( g_pFlush->m_bFlushing )
-			sphSleepMsec ( 10 );
-		sphLogDebug ( "attrflush: check finished, tag=%d", g_pFlush->m_iFlushTag );
-	}
+		int iCommand = tBuf.GetWord ();
+		int iCommandVer = tBuf.GetWord ();
+		int iLength = tBuf.GetInt ();
+		if ( tBuf.GetError() || iLength!=iFrameLen-8 )
+		{
+			sphWarning ( "ill-formed multiplexed request (client=%s("INT64_FMT"), frame len=%d, len=%d)", sClientIP, iCID, iFrameLen, iLength );
+			break;
+		}
 
-	// return last flush tag, just for the fun of it
-	NetOutputBuffer_c tOut ( iSock );
-	tOut.SendWord ( SEARCHD_OK );
-	tOut.SendWord ( VER_COMMAND_FLUSHATTRS );
-	tOut.SendInt ( 4 ); // resplen, 1 dword
-	tOut.SendInt ( g_pFlush->m_iFlushTag );
-	tOut.Flush ();
-	assert ( tOut.GetError()==true || tOut.GetSentCount()==12 ); // 8+resplen
-}
+		if ( iCommand<0 || iCommand>=SEARCHD_COMMAND_TOTAL )
+		{
+			CSphString sError;
+			sError.SetSprintf ( "invalid command (code=%d, len=%d)", iCommand, iLength );
+			MuxSendError ( iSock, tConn, uId, SEARCHD_ERROR, sError.cstr() );
+			continue;
+		}
 
-/////////////////////////////////////////////////////////////////////////////
-// GENERAL HANDLER
-/////////////////////////////////////////////////////////////////////////////
+		StatCountCommand ( iCommand );
 
-#define THD_STATE(_state) \
-{ \
-	DISABLE_CONST_COND_CHECK \
-	if ( pThd ) \
-	{ \
-		pThd->m_eThdState = _state; \
-		pThd->m_tmStart = sphMicroTimer(); \
-		if_const ( _state==THD_NET_IDLE ) \
-			pThd->m_dBuf[0] = '\0'; \
-	} \
-	ENABLE_CONST_COND_CHECK \
-}
+		g_tThdMutex.Lock ();
+		bool bMaxed = ( g_iMaxChildren && g_dThd.GetLength()>=g_iMaxChildren );
+		g_tThdMutex.Unlock ();
+		if ( bMaxed )
+		{
+			MuxSendError ( iSock, tConn, uId, SEARCHD_RETRY, "server maxed out, retry in a second" );
+			if ( g_pStats )
+				g_pStats->m_iMaxedOut++;
+			continue;
+		}
 
-void HandleCommandSphinxql ( int iSock, int iVer, InputBuffer_c & tReq ); // definition is below
-void StatCountCommand ( int iCmd, int iCount=1 );
-void HandleCommandUserVar ( int iSock, int iVer, NetInputBuffer_c & tReq );
+		MuxRequest_t * pReq = new MuxRequest_t ();
+		pReq->m_eProto = PROTO_SPHINX;
+		pReq->m_iClientSock = iSock;
+		pReq->m_sClientName = sClientIP;
+		pReq->m_iConnID = pThd->m_iConnID;
+		pReq->m_tmConnect = pThd->m_tmConnect;
+		pReq->m_tmStart = sphMicroTimer();
+		pReq->m_eThdState = THD_QUERY;
+		pReq->m_sCommand = g_dApiCommands[iCommand];
+		pReq->m_pConn = &tConn;
+		pReq->m_tReply.m_iSock = iSock;
+		pReq->m_tReply.m_pSendLock = &tConn.m_tSendLock;
+		pReq->m_tReply.m_uId = uId;
+		pReq->m_iCommand = iCommand;
+		pReq->m_iCommandVer = iCommandVer;
+		pReq->m_dBody.Reset ( iLength );
+		if ( iLength )
+			memcpy ( pReq->m_dBody.Begin(), tBuf.GetBufferPtr()+8, iLength );
+
+		tConn.m_iInFlight.Inc();
+		g_tThdMutex.Lock ();
+		g_dThd.Add ( pReq );
+		g_tThdMutex.Unlock ();
 
-/// ping/pong exchange over API
-void HandleCommandPing ( int iSock, int iVer, InputBuffer_c & tReq )
-{
-	if ( !CheckCommandVersion ( iVer, VER_COMMAND_PING, tReq ) )
-		return;
+		if ( !SphCrashLogger_c::ThreadCreate ( &pReq->m_tThd, MuxRequestThread, pReq, true ) )
+		{
+			g_tThdMutex.Lock ();
+			g_dThd.Remove ( pReq );
+			g_tThdMutex.Unlock ();
+			SafeDelete ( pReq );
+			tConn.m_iInFlight.Dec();
 
-	// parse ping
-	int iCookie = tReq.GetInt();
+			MuxSendError ( iSock, tConn, uId, SEARCHD_RETRY, "failed to create request thread" );
+			sphWarning ( "failed to create multiplexed request thread: %s", strerror(errno) );
+		}
+	}
 
-	// return last flush tag, just for the fun of it
-	NetOutputBuffer_c tOut ( iSock );
-	tOut.SendWord ( SEARCHD_OK );
-	tOut.SendWord ( VER_COMMAND_PING );
-	tOut.SendInt ( 4 ); // resplen, 1 dword
-	tOut.SendInt ( iCookie ); // echo the cookie back
-	tOut.Flush ();
-	assert ( tOut.GetError()==true || tOut.GetSentCount()==12 ); // 8+resplen
-}
+	// the socket and the send lock must outlive the requests in flight
+	while ( tConn.m_iInFlight )
+		sphSleepMsec ( 1 );
 
-inline void DecPersCount()
-{
-	CSphScopedLockedShare<InterWorkerStorage> dPersNum ( *g_pPersistentInUse );
-	DWORD& uPers = dPersNum.SharedValue<DWORD>();
-	if ( uPers )
-		--uPers;
+	sphLogDebugv ( "conn %s("INT64_FMT"): multiplexed conn exiting", sClientIP, iCID );
 }
 
+
 void HandleClientSphinx ( int iSock, const char * sClientIP, ThdDesc_t * pThd )
 {
 	MEMORY ( MEM_API_HANDLE );
@@ -14415,6 +16626,7 @@ void HandleClientSphinx ( int iSock, const char * sClientIP, ThdDesc_t * pThd )
 		THD_STATE ( THD_QUERY );
 
 		sphLogDebugv ( "conn %s("INT64_FMT"): got command %d, handling", sClientIP, iCID, iCommand );
+		int64_t tmCommand = sphMicroTimer();
 		switch ( iCommand )
 		{
 			case SEARCHD_COMMAND_SEARCH:	HandleCommandSearch ( iSock, iCommandVer, tBuf, pThd ); break;
@@ -14442,6 +16654,37 @@ void HandleClientSphinx ( int iSock, const char * sClientIP, ThdDesc_t * pThd )
 					}
 				}
 				break;
+			case SEARCHD_COMMAND_MULTIPLEX:
+				{
+					// shared link from a master; only threads can serve its requests concurrently
+					bool bMux = ( g_eWorkers==MPM_THREADS && pThd && !bPersist );
+					if ( bMux )
+					{
+						CSphScopedLockedShare<InterWorkerStorage> dPersNum ( *g_pPersistentInUse );
+						DWORD& uPers = dPersNum.SharedValue<DWORD>();
+						if ( g_iMaxChildren && uPers+g_uAtLeastUnpersistent>=(DWORD)g_iMaxChildren )
+							bMux = false;
+						else
+							++uPers;
+					}
+					sphLogDebugv ( "conn %s("INT64_FMT"): multiplexing is %s", sClientIP, iCID, bMux ? "on" : "refused" );
+
+					NetOutputBuffer_c tOut ( iSock );
+					tOut.SendWord ( SEARCHD_OK );
+					tOut.SendWord ( VER_COMMAND_MULTIPLEX );
+					tOut.SendInt ( 4 ); // resplen, 1 dword
+					tOut.SendDword ( bMux ? 1 : 0 );
+					if ( tOut.Flush() && bMux )
+					{
+						SphCrashLogger_c::SetLastQuery ( CrashQuery_t() );
+						HandleMultiplexed ( iSock, sClientIP, pThd, tBuf );
+					}
+					if ( bMux )
+						DecPersCount();
+					if ( bPersist )
+						DecPersCount();
+					return;
+				}
 			case SEARCHD_COMMAND_STATUS:	HandleCommandStatus ( iSock, iCommandVer, tBuf ); break;
 			case SEARCHD_COMMAND_FLUSHATTRS:HandleCommandFlush ( iSock, iCommandVer, tBuf ); break;
 			case SEARCHD_COMMAND_SPHINXQL:	HandleCommandSphinxql ( iSock, iCommandVer, tBuf ); break;
@@ -14450,6 +16693,9 @@ void HandleClientSphinx ( int iSock, const char * sClientIP, ThdDesc_t * pThd )
 			default:						assert ( 0 && "INTERNAL ERROR: unhandled command" ); break;
 		}
 
+		if ( iCommand!=SEARCHD_COMMAND_PERSIST )
+			StatCommandLatency ( iCommand, sphMicroTimer()-tmCommand );
+
 		// set off query guard
 		SphCrashLogger_c::SetLastQuery ( CrashQuery_t() );
 	} while ( bPersist );
@@ -14643,6 +16889,7 @@ public:
 		: m_pBuf ( NULL )
 		, m_iLen ( 0 )
 		, m_iLimit ( sizeof ( m_dBuf ) )
+		, m_iRefBytes ( 0 )
 		, m_uPacketID ( *pPacketID )
 		, m_tOut ( *pOut )
 		, m_iSize ( 0 )
@@ -14693,6 +16940,8 @@ public:
 	void Reset ()
 	{
 		m_iLen = 0;
+		m_dRefs.Resize ( 0 );
+		m_iRefBytes = 0;
 	}
 
 	template < typename T>
@@ -14738,15 +16987,56 @@ public:
 		IncPtr ( 1 );
 	}
 
+	/// put length-coded string that might be sent by reference instead of copying
+	/// referenced data must stay intact until the output gets flushed
+	void PutStringRef ( const BYTE * pStr, int iLen )
+	{
+		Reserve ( 9+( iLen<NETOUTBUF_REF_MIN ? iLen : 0 ) );
+		char * pBegin = Get();
+		char * pOut = (char*)MysqlPack ( pBegin, iLen );
+		IncPtr ( pOut-pBegin );
+
+		if ( iLen<NETOUTBUF_REF_MIN )
+		{
+			if ( iLen )
+				memcpy ( pOut, pStr, iLen );
+			IncPtr ( iLen );
+			return;
+		}
+
+		RowRef_t & tRef = m_dRefs.Add();
+		tRef.m_iOff = m_iLen;
+		tRef.m_pData = pStr;
+		tRef.m_iLen = iLen;
+		m_iRefBytes += iLen;
+	}
+
 	/// more high level. Processing the whole tables.
 	// sends collected data, then reset
 	void Commit()
 	{
-		m_tOut.SendLSBDword ( ((m_uPacketID++)<<24) + ( Length() ) );
-		m_tOut.SendBytes ( Off ( 0 ), Length() );
+		m_tOut.SendLSBDword ( ((m_uPacketID++)<<24) + ( Length()+m_iRefBytes ) );
+
+		const char * pRow = Off ( 0 );
+		int iOff = 0;
+		ARRAY_FOREACH ( i, m_dRefs )
+		{
+			const RowRef_t & tRef = m_dRefs[i];
+			m_tOut.SendBytes ( pRow+iOff, tRef.m_iOff-iOff );
+			m_tOut.SendBytesRef ( tRef.m_pData, tRef.m_iLen );
+			iOff = tRef.m_iOff;
+		}
+		m_tOut.SendBytes ( pRow+iOff, Length()-iOff );
 		Reset();
 	}
 
+	/// flush the output if the rows sent so far reference any external data
+	/// must be called before that data gets released
+	bool FlushRefs ()
+	{
+		return m_tOut.FlushRefs();
+	}
+
 	// wrappers for popular packets
 	inline void Eof ( bool bMoreResults=false, int iWarns=0 )
 	{
@@ -14831,10 +17121,20 @@ public:
 	}
 
 private:
+	/// external blob to be sent in place of a row buffer offset
+	struct RowRef_t
+	{
+		int				m_iOff;
+		const BYTE *	m_pData;
+		int				m_iLen;
+	};
+
 	char m_dBuf[4096];
 	char * m_pBuf;
 	int m_iLen;
 	int m_iLimit;
+	CSphVector<RowRef_t> m_dRefs;
+	int m_iRefBytes;
 
 private:
 	BYTE & m_uPacketID;
@@ -15227,6 +17527,75 @@ enum
 };
 
 
+/// fetch snippet sources from the local index document storage
+static bool FetchStoredSources ( const CSphString & sIndex, const CSphVector<SphDocID_t> & dDocids, const CSphString & sField,
+	CSphVector<CSphString> & dSources, CSphString & sError )
+{
+	const ServedIndex_t * pServed = g_pLocalIndexes->GetRlockedEntry ( sIndex );
+	if ( !pServed || !pServed->m_bEnabled || !pServed->m_pIndex )
+	{
+		sError.SetSprintf ( "unknown local index '%s' in search request", sIndex.cstr() );
+		if ( pServed )
+			pServed->Unlock();
+		return false;
+	}
+
+	const CSphIndex * pIndex = pServed->m_pIndex;
+	const CSphVector<CSphString> & dStored = pIndex->GetSettings().m_dStoredFields;
+	if ( !dStored.GetLength() )
+	{
+		sError.SetSprintf ( "index '%s' has no stored fields", sIndex.cstr() );
+		pServed->Unlock();
+		return false;
+	}
+
+	if ( !sField.IsEmpty() && !dStored.Contains ( sField ) )
+	{
+		sError.SetSprintf ( "index '%s' does not store field '%s'", sIndex.cstr(), sField.cstr() );
+		pServed->Unlock();
+		return false;
+	}
+
+	CSphRefcountedPtr<ISphStoredFields> tFields ( pIndex->CreateStoredFields ( NULL ) );
+	if ( !tFields.Ptr() )
+	{
+		sError.SetSprintf ( "index '%s' has no stored fields", sIndex.cstr() );
+		pServed->Unlock();
+		return false;
+	}
+
+	// either the requested field, or all the stored fields glued together
+	CSphVector<BYTE> dDoc;
+	dSources.Resize ( dDocids.GetLength() );
+	ARRAY_FOREACH ( i, dDocids )
+	{
+		dDoc.Resize ( 0 );
+		ARRAY_FOREACH ( j, dStored )
+		{
+			if ( !sField.IsEmpty() && dStored[j]!=sField )
+				continue;
+
+			BYTE * pText = NULL;
+			int iLen = 0;
+			tFields->GetField ( dDocids[i], j, &pText, &iLen );
+			if ( !pText )
+				continue;
+
+			if ( dDoc.GetLength() )
+				dDoc.Add ( ' ' );
+			int iOff = dDoc.GetLength();
+			dDoc.Resize ( iOff+iLen );
+			memcpy ( dDoc.Begin()+iOff, pText, iLen );
+			SafeDeleteArray ( pText );
+		}
+		dSources[i].SetBinary ( dDoc.GetLength() ? (const char*)dDoc.Begin() : "", dDoc.GetLength() ); // missing docs yield empty sources
+	}
+
+	pServed->Unlock();
+	return true;
+}
+
+
 void HandleMysqlCallSnippets ( SqlRowBuffer_c & tOut, SqlStmt_t & tStmt )
 {
 	CSphString sError;
@@ -15238,9 +17607,11 @@ void HandleMysqlCallSnippets ( SqlRowBuffer_c & tOut, SqlStmt_t & tStmt )
 		tOut.Error ( tStmt.m_sStmt, "SNIPPETS() expectes exactly 3 arguments (data, index, query)" );
 		return;
 	}
-	if ( tStmt.m_dInsertValues[0].m_iType!=TOK_QUOTED_STRING && tStmt.m_dInsertValues[0].m_iType!=TOK_CONST_STRINGS )
+	const SqlInsert_t & tData = tStmt.m_dInsertValues[0];
+	bool bStored = ( tData.m_iType==TOK_CONST_INT || tData.m_iType==TOK_CONST_MVA );
+	if ( tData.m_iType!=TOK_QUOTED_STRING && tData.m_iType!=TOK_CONST_STRINGS && !bStored )
 	{
-		tOut.Error ( tStmt.m_sStmt, "SNIPPETS() argument 1 must be a string or a string list" );
+		tOut.Error ( tStmt.m_sStmt, "SNIPPETS() argument 1 must be a string, a string list, a docid or a docid list" );
 		return;
 	}
 	if ( tStmt.m_dInsertValues[1].m_iType!=TOK_QUOTED_STRING )
@@ -15259,6 +17630,7 @@ void HandleMysqlCallSnippets ( SqlRowBuffer_c & tOut, SqlStmt_t & tStmt )
 
 	ExcerptQuery_t q;
 	q.m_sWords = tStmt.m_dInsertValues[2].m_sVal;
+	CSphString sStoredField;
 
 	ARRAY_FOREACH ( i, tStmt.m_dCallOptNames )
 	{
@@ -15289,6 +17661,7 @@ void HandleMysqlCallSnippets ( SqlRowBuffer_c & tOut, SqlStmt_t & tStmt )
 		else if ( sOpt=="load_files_scattered" ) { q.m_iLoadFiles |= ( v.m_iVal!=0 )?2:0; iExpType = TOK_CONST_INT; }
 		else if ( sOpt=="allow_empty" )			{ q.m_bAllowEmpty = ( v.m_iVal!=0 ); iExpType = TOK_CONST_INT; }
 		else if ( sOpt=="emit_zones" )			{ q.m_bEmitZones = ( v.m_iVal!=0 ); iExpType = TOK_CONST_INT; }
+		else if ( sOpt=="stored_field" )		{ sStoredField = v.m_sVal; iExpType = TOK_QUOTED_STRING; }
 
 		else
 		{
@@ -15325,7 +17698,40 @@ void HandleMysqlCallSnippets ( SqlRowBuffer_c & tOut, SqlStmt_t & tStmt )
 	q.m_iRawFlags = GetRawSnippetFlags ( q );
 
 	CSphVector<ExcerptQuery_t> dQueries;
-	if ( tStmt.m_dInsertValues[0].m_iType==TOK_QUOTED_STRING )
+	if ( bStored )
+	{
+		// sources come from the document storage
+		CSphVector<SphDocID_t> dDocids;
+		if ( tData.m_iType==TOK_CONST_INT )
+			dDocids.Add ( (SphDocID_t)tData.m_iVal );
+		else if ( tData.m_pVals.Ptr() )
+		{
+			const RefcountedVector_c<SphAttr_t> & dVals = *tData.m_pVals.Ptr();
+			ARRAY_FOREACH ( i, dVals )
+				dDocids.Add ( (SphDocID_t)dVals[i] );
+		}
+
+		if ( !dDocids.GetLength() )
+		{
+			tOut.Error ( tStmt.m_sStmt, "SNIPPETS() docid list must not be empty" );
+			return;
+		}
+
+		sStoredField.ToLower();
+		CSphVector<CSphString> dSources;
+		if ( !FetchStoredSources ( sIndex, dDocids, sStoredField, dSources, sError ) )
+		{
+			tOut.Error ( tStmt.m_sStmt, sError.cstr() );
+			return;
+		}
+
+		dQueries.Resize ( dSources.GetLength() );
+		ARRAY_FOREACH ( i, dSources )
+		{
+			dQueries[i] = q; // copy the settings
+			dQueries[i].m_sSource = dSources[i];
+		}
+	} else if ( tStmt.m_dInsertValues[0].m_iType==TOK_QUOTED_STRING )
 	{
 		q.m_sSource = tStmt.m_dInsertValues[0].m_sVal; // OPTIMIZE?
 		dQueries.Add ( q );
@@ -15748,6 +18154,7 @@ void CheckPing()
 		{
 			AgentConn_t & dAgent = dAgents.Add ();
 			dAgent = dDash.m_dDescriptor;
+			dAgent.m_bPing = true;
 		}
 	}
 
@@ -16457,11 +18864,13 @@ void SendMysqlSelectResult ( SqlRowBuffer_c & dRows, const AggrResult_t & tRes,
 					{
 						DWORD nValues = *pValues++;
 						assert ( eAttrType==SPH_ATTR_UINT32SET || ( nValues%2 )==0 );
+
+						// reserve for all the values at once
+						dRows.Reserve ( nValues*SPH_MAX_NUMERIC_STR );
 						if ( eAttrType==SPH_ATTR_UINT32SET )
 						{
 							while ( nValues-- )
 							{
-								dRows.Reserve ( SPH_MAX_NUMERIC_STR );
 								int iLen = snprintf ( dRows.Get(), SPH_MAX_NUMERIC_STR, nValues>0 ? "%u," : "%u", *pValues++ );
 								dRows.IncPtr ( iLen );
 							}
@@ -16470,7 +18879,6 @@ void SendMysqlSelectResult ( SqlRowBuffer_c & dRows, const AggrResult_t & tRes,
 							for ( ; nValues; nValues-=2, pValues+=2 )
 							{
 								int64_t iVal = MVA_UPSIZE ( pValues );
-								dRows.Reserve ( SPH_MAX_NUMERIC_STR );
 								int iLen = snprintf ( dRows.Get(), SPH_MAX_NUMERIC_STR, nValues>2 ? INT64_FMT"," : INT64_FMT, iVal );
 								dRows.IncPtr ( iLen );
 							}
@@ -16503,25 +18911,29 @@ void SendMysqlSelectResult ( SqlRowBuffer_c & dRows, const AggrResult_t & tRes,
 						iLen = sphUnpackStr ( pStrings+uOffset, &pStr );
 					}
 
-					if ( eAttrType==SPH_ATTR_JSON )
+					if ( eAttrType!=SPH_ATTR_JSON )
 					{
-						// no object at all? return NULL
-						if ( !pStr )
-						{
-							dRows.PutNULL();
-							break;
-						}
-						dTmp.Resize ( 0 );
-						sphJsonFormat ( dTmp, pStr );
-						pStr = dTmp.Begin();
-						iLen = dTmp.GetLength();
-						if ( iLen==0 )
-						{
-							// empty string (no objects) - return NULL
-							// (canonical "{}" and "[]" are handled by sphJsonFormat)
-							dRows.PutNULL();
-							break;
-						}
+						// plain strings go straight from the pool
+						dRows.PutStringRef ( pStr, iLen );
+						break;
+					}
+
+					// no object at all? return NULL
+					if ( !pStr )
+					{
+						dRows.PutNULL();
+						break;
+					}
+					dTmp.Resize ( 0 );
+					sphJsonFormat ( dTmp, pStr );
+					pStr = dTmp.Begin();
+					iLen = dTmp.GetLength();
+					if ( iLen==0 )
+					{
+						// empty string (no objects) - return NULL
+						// (canonical "{}" and "[]" are handled by sphJsonFormat)
+						dRows.PutNULL();
+						break;
 					}
 
 					// send length
@@ -16529,8 +18941,7 @@ void SendMysqlSelectResult ( SqlRowBuffer_c & dRows, const AggrResult_t & tRes,
 					char * pOutStr = (char*)MysqlPack ( dRows.Get(), iLen );
 
 					// send string data
-					if ( iLen )
-						memcpy ( pOutStr, pStr, iLen );
+					memcpy ( pOutStr, pStr, iLen );
 
 					dRows.IncPtr ( pOutStr-dRows.Get()+iLen );
 					break;
@@ -16549,15 +18960,7 @@ void SendMysqlSelectResult ( SqlRowBuffer_c & dRows, const AggrResult_t & tRes,
 						break;
 					}
 
-					// send length
-					dRows.Reserve ( iLen+4 );
-					char * pOutStr = (char*)MysqlPack ( dRows.Get(), iLen );
-
-					// send string data
-					if ( iLen )
-						memcpy ( pOutStr, pString, iLen );
-
-					dRows.IncPtr ( pOutStr-dRows.Get()+iLen );
+					dRows.PutStringRef ( (const BYTE*)pString, iLen );
 					break;
 				}
 
@@ -16634,6 +19037,9 @@ void SendMysqlSelectResult ( SqlRowBuffer_c & dRows, const AggrResult_t & tRes,
 
 	// eof packet
 	dRows.Eof ( bMoreResultsFollow, iWarns );
+
+	// rows might reference the result pools that die with the result
+	dRows.FlushRefs();
 }
 
 
@@ -17545,6 +19951,18 @@ void HandleMysqlShowIndexStatus ( SqlRowBuffer_c & tOut, const SqlStmt_t & tStmt
 		tOut.DataTuplet ( "disk_chunks", tStatus.m_iNumChunks );
 		tOut.DataTuplet ( "mem_limit", tStatus.m_iMemLimit );
 	}
+	tOut.DataTuplet ( "expansion_cache_hits", tStatus.m_iExpansionCacheHits );
+	tOut.DataTuplet ( "expansion_cache_misses", tStatus.m_iExpansionCacheMisses );
+	tOut.DataTuplet ( "expansion_cache_bytes", tStatus.m_iExpansionCacheBytes );
+
+	const IndexLatency_t * pLatency = FindIndexLatency ( tStmt.m_sIndex.cstr(), false );
+	if ( pLatency )
+	{
+		VectorLike dLatency;
+		AddLatencyToStatus ( dLatency, "query_wall", pLatency->m_tWall, false );
+		for ( int i=0; i+1<dLatency.GetLength(); i+=2 )
+			tOut.DataTuplet ( dLatency[i].cstr(), dLatency[i+1].cstr() );
+	}
 
 	pServed->Unlock();
 	tOut.Eof();
@@ -17981,6 +20399,28 @@ static void HandleMysqlShowPlan ( SqlRowBuffer_c & tOut, const CSphQueryProfile
 	tOut.PutString ( p.m_sTransformedTree.cstr() );
 	tOut.Commit();
 
+	// evaluation tree, annotated with per-node counters
+	if ( p.m_dPlanNodes.GetLength() )
+	{
+		CSphStringBuilder sTree;
+		ARRAY_FOREACH ( i, p.m_dPlanNodes )
+		{
+			const PlanNodeProfile_t & tNode = p.m_dPlanNodes[i];
+			if ( i )
+				sTree += "\n";
+			for ( int j=0; j<tNode.m_iDepth; j++ )
+				sTree += "  ";
+			sTree.Appendf ( "%s: docs="INT64_FMT", hits="INT64_FMT", doc_calls="INT64_FMT", hit_calls="INT64_FMT
+				", skips="INT64_FMT", total_ns="INT64_FMT", self_ns="INT64_FMT,
+				tNode.m_sName.cstr(), tNode.m_iDocs, tNode.m_iHits, tNode.m_iDocCalls, tNode.m_iHitCalls,
+				tNode.m_iSkips, tNode.m_tmTotal, tNode.m_tmSelf );
+		}
+
+		tOut.PutString ( "evaluation_tree" );
+		tOut.PutString ( sTree.cstr() );
+		tOut.Commit();
+	}
+
 	tOut.Eof();
 }
 
@@ -18012,6 +20452,16 @@ public:
 	// returns true if the current profile should be kept (default)
 	// returns false if profile should be discarded (eg. SHOW PROFILE case)
 	bool Execute ( const CSphString & sQuery, NetOutputBuffer_c & tOutput, BYTE & uPacketID, ThdDesc_t * pThd=NULL )
+	{
+		int64_t tmStart = sphMicroTimer();
+		SqlStmt_e eStmt = STMT_PARSE_ERROR;
+		bool bRes = ExecuteStmt ( sQuery, tOutput, uPacketID, pThd, eStmt );
+		StatStmtLatency ( eStmt, sphMicroTimer()-tmStart );
+		return bRes;
+	}
+
+private:
+	bool ExecuteStmt ( const CSphString & sQuery, NetOutputBuffer_c & tOutput, BYTE & uPacketID, ThdDesc_t * pThd, SqlStmt_e & eStmt )
 	{
 		// set on query guard
 		CrashQuery_t tCrashQuery;
@@ -18030,7 +20480,7 @@ public:
 		if ( m_tVars.m_bProfile )
 			m_tProfile.Switch ( SPH_QSTATE_UNKNOWN );
 
-		SqlStmt_e eStmt = STMT_PARSE_ERROR;
+		eStmt = STMT_PARSE_ERROR;
 		if ( bParsedOK )
 		{
 			eStmt = dStmt[0].m_eStmt;
@@ -18363,6 +20813,20 @@ void StatCountCommand ( int iCmd, int iCount )
 }
 
 
+void StatCommandLatency ( int iCmd, int64_t tmWall )
+{
+	if ( g_pStats && iCmd>=0 && iCmd<SEARCHD_COMMAND_TOTAL )
+		g_pStats->m_dCommandLatency[iCmd].Add ( tmWall );
+}
+
+
+void StatStmtLatency ( SqlStmt_e eStmt, int64_t tmWall )
+{
+	if ( g_pStats && eStmt>=0 && eStmt<STMT_TOTAL )
+		g_pStats->m_dStmtLatency[eStmt].Add ( tmWall );
+}
+
+
 static void HandleClientMySQL ( int iSock, const char * sClientIP, ThdDesc_t * pThd )
 {
 	MEMORY ( MEM_SQL_HANDLE );
@@ -18592,6 +21056,10 @@ bool HasFiles ( const ServedIndex_t & tIndex, const char ** dExts )
 
 	for ( int i=0; i<sphGetExtCount(); i++ )
 	{
+		// document storage is missing from pre-v.43 indexes
+		if ( strstr ( dExts[i], ".spds" ) )
+			continue;
+
 		snprintf ( sFile, sizeof(sFile), "%s%s", sPath, dExts[i] );
 		if ( !sphIsReadable ( sFile ) )
 			return false;
@@ -19015,11 +21483,18 @@ static void RotateIndexMT ( const CSphString & sIndex )
 
 	tNewIndex.m_pIndex = sphCreateIndexPhrase ( sIndex.cstr(), NULL );
 	tNewIndex.m_pIndex->m_bExpandKeywords = pRotating->m_bExpand;
+	tNewIndex.m_pIndex->m_bInfixTrigrams = pRotating->m_bInfixTrigrams;
+	tNewIndex.m_pIndex->m_dJsonIndexPaths = pRotating->m_dJsonIndexPaths;
+	tNewIndex.m_pIndex->m_dDocidOrderedAttrs = pRotating->m_dDocidOrderedAttrs;
 	tNewIndex.m_pIndex->m_iExpansionLimit = g_iExpansionLimit;
+	tNewIndex.m_pIndex->SetExpansionCacheSize ( g_iExpansionCacheSize );
 	tNewIndex.m_pIndex->SetPreopen ( pRotating->m_bPreopen || g_bPreopenIndexes );
 	tNewIndex.m_pIndex->SetGlobalIDFPath ( pRotating->m_sGlobalIDFPath );
 	tNewIndex.m_bOnDiskAttrs = pRotating->m_bOnDiskAttrs;
 	tNewIndex.m_bOnDiskPools = pRotating->m_bOnDiskPools;
+	tNewIndex.m_bInfixTrigrams = pRotating->m_bInfixTrigrams;
+	tNewIndex.m_dJsonIndexPaths = pRotating->m_dJsonIndexPaths;
+	tNewIndex.m_dDocidOrderedAttrs = pRotating->m_dDocidOrderedAttrs;
 	SetEnableOndiskAttributes ( tNewIndex, tNewIndex.m_pIndex );
 
 	// rebase new index
@@ -19225,7 +21700,11 @@ void SeamlessTryToForkPrereader ()
 		g_pPrereading->SetName ( sPrereading );
 
 	g_pPrereading->m_bExpandKeywords = tServed.m_bExpand;
+	g_pPrereading->m_bInfixTrigrams = tServed.m_bInfixTrigrams;
+	g_pPrereading->m_dJsonIndexPaths = tServed.m_dJsonIndexPaths;
+	g_pPrereading->m_dDocidOrderedAttrs = tServed.m_dDocidOrderedAttrs;
 	g_pPrereading->m_iExpansionLimit = g_iExpansionLimit;
+	g_pPrereading->SetExpansionCacheSize ( g_iExpansionCacheSize );
 	g_pPrereading->SetPreopen ( tServed.m_bPreopen || g_bPreopenIndexes );
 	g_pPrereading->SetGlobalIDFPath ( tServed.m_sGlobalIDFPath );
 	SetEnableOndiskAttributes ( tServed, tServed.m_pIndex );
@@ -19833,6 +22312,20 @@ void ConfigureLocalIndex ( ServedDesc_t & tIdx, const CSphConfigSection & hIndex
 	tIdx.m_sGlobalIDFPath = hIndex.GetStr ( "global_idf" );
 	tIdx.m_bOnDiskAttrs = ( hIndex.GetInt ( "ondisk_attrs", 0 )==1 );
 	tIdx.m_bOnDiskPools = ( strcmp ( hIndex.GetStr ( "ondisk_attrs", "" ), "pool" )==0 );
+	tIdx.m_bInfixTrigrams = ( hIndex.GetInt ( "infix_trigrams", 0 )!=0 );
+	tIdx.m_dJsonIndexPaths.Reset();
+	CSphVector<CSphString> dJsonPaths;
+	sphSplit ( dJsonPaths, hIndex.GetStr ( "json_secondary_indexes" ), " \t," );
+	ARRAY_FOREACH ( i, dJsonPaths )
+		if ( !dJsonPaths[i].IsEmpty() )
+			tIdx.m_dJsonIndexPaths.Add ( dJsonPaths[i] );
+
+	tIdx.m_dDocidOrderedAttrs.Reset();
+	CSphVector<CSphString> dOrdered;
+	sphSplit ( dOrdered, hIndex.GetStr ( "docid_ordered_attrs" ), " \t," );
+	ARRAY_FOREACH ( i, dOrdered )
+		if ( !dOrdered[i].IsEmpty() )
+			tIdx.m_dDocidOrderedAttrs.Add ( dOrdered[i] );
 }
 
 
@@ -20126,7 +22619,7 @@ static void ConfigureDistributedIndex ( DistributedIndex_t * pIdx, const char *
 	for ( CSphVariant * pAgent = hIndex("agent_persistent"); pAgent; pAgent = pAgent->m_pNext )
 	{
 		MetaAgentDesc_t& tAgent = tIdx.m_dAgents.Add ();
-		if ( !g_iPersistentPoolSize )
+		if ( !g_iPersistentPoolSize && !g_iAgentMuxConnections )
 		{
 			sphWarning ( "index '%s': agent_persistent used, but no persistent_connections_limit defined. Fall back to non-persistent agent", szIndexName );
 			bEnablePersistentConns = false;
@@ -20180,9 +22673,23 @@ static void ConfigureDistributedIndex ( DistributedIndex_t * pIdx, const char *
 			tIdx.m_eHaStrategy = HA_AVOIDDEAD;
 		else if ( hIndex["ha_strategy"]=="noerrors" )
 			tIdx.m_eHaStrategy = HA_AVOIDERRORS;
+		else if ( hIndex["ha_strategy"]=="ewma" )
+			tIdx.m_eHaStrategy = HA_EWMA;
 		else
 			sphWarning ( "index '%s': ha_strategy (%s) is unknown for me, will use random", szIndexName, hIndex["ha_strategy"].cstr() );
 	}
+
+	// configure ha_hedge_percentile
+	if ( hIndex("ha_hedge_percentile") )
+	{
+		int iPercentile = hIndex["ha_hedge_percentile"].intval();
+		if ( !bHaveHA )
+			sphWarning ( "index '%s': ha_hedge_percentile defined, but no ha agents in the index", szIndexName );
+		else if ( iPercentile<1 || iPercentile>99 )
+			sphWarning ( "index '%s': ha_hedge_percentile must be in 1..99 range, ignored", szIndexName );
+		else
+			tIdx.m_iHedgePercentile = iPercentile;
+	}
 	tIdx.ShareHACounters();
 }
 
@@ -20217,7 +22724,11 @@ void PreCreateTemplateIndex ( ServedDesc_t & tServed, const CSphConfigSection &
 {
 	tServed.m_pIndex = sphCreateIndexTemplate ( );
 	tServed.m_pIndex->m_bExpandKeywords = tServed.m_bExpand;
+	tServed.m_pIndex->m_bInfixTrigrams = tServed.m_bInfixTrigrams;
+	tServed.m_pIndex->m_dJsonIndexPaths = tServed.m_dJsonIndexPaths;
+	tServed.m_pIndex->m_dDocidOrderedAttrs = tServed.m_dDocidOrderedAttrs;
 	tServed.m_pIndex->m_iExpansionLimit = g_iExpansionLimit;
+	tServed.m_pIndex->SetExpansionCacheSize ( g_iExpansionCacheSize );
 	tServed.m_bEnabled = false;
 
 	CSphString sError;
@@ -20228,7 +22739,11 @@ void PreCreatePlainIndex ( ServedDesc_t & tServed, const char * sName )
 {
 	tServed.m_pIndex = sphCreateIndexPhrase ( sName, tServed.m_sIndexPath.cstr() );
 	tServed.m_pIndex->m_bExpandKeywords = tServed.m_bExpand;
+	tServed.m_pIndex->m_bInfixTrigrams = tServed.m_bInfixTrigrams;
+	tServed.m_pIndex->m_dJsonIndexPaths = tServed.m_dJsonIndexPaths;
+	tServed.m_pIndex->m_dDocidOrderedAttrs = tServed.m_dDocidOrderedAttrs;
 	tServed.m_pIndex->m_iExpansionLimit = g_iExpansionLimit;
+	tServed.m_pIndex->SetExpansionCacheSize ( g_iExpansionCacheSize );
 	tServed.m_pIndex->SetPreopen ( tServed.m_bPreopen || g_bPreopenIndexes );
 	tServed.m_pIndex->SetGlobalIDFPath ( tServed.m_sGlobalIDFPath );
 	SetEnableOndiskAttributes ( tServed, tServed.m_pIndex );
@@ -20357,7 +22872,11 @@ ESphAddIndex AddIndex ( const char * szIndexName, const CSphConfigSection & hInd
 
 		ConfigureLocalIndex ( tIdx, hIndex );
 		tIdx.m_pIndex->m_bExpandKeywords = tIdx.m_bExpand;
+		tIdx.m_pIndex->m_bInfixTrigrams = tIdx.m_bInfixTrigrams;
+		tIdx.m_pIndex->m_dJsonIndexPaths = tIdx.m_dJsonIndexPaths;
+		tIdx.m_pIndex->m_dDocidOrderedAttrs = tIdx.m_dDocidOrderedAttrs;
 		tIdx.m_pIndex->m_iExpansionLimit = g_iExpansionLimit;
+		tIdx.m_pIndex->SetExpansionCacheSize ( g_iExpansionCacheSize );
 		tIdx.m_pIndex->SetPreopen ( tIdx.m_bPreopen || g_bPreopenIndexes );
 		tIdx.m_pIndex->SetGlobalIDFPath ( tIdx.m_sGlobalIDFPath );
 		SetEnableOndiskAttributes ( tIdx, tIdx.m_pIndex );
@@ -21911,6 +24430,7 @@ void HandlerThread ( void * pArg )
 	ThdDesc_t * pThd = (ThdDesc_t*) pArg;
 	sphThreadSet ( g_tConnKey, &pThd->m_iConnID );
 	pThd->m_iTid = GetOsThreadId();
+	StatQueueWait ( sphMicroTimer() - pThd->m_tmConnect );
 	HandleClient ( pThd->m_eProto, pThd->m_iClientSock, pThd->m_sClientName.cstr(), pThd );
 	sphSockClose ( pThd->m_iClientSock );
 
@@ -22135,9 +24655,34 @@ void ConfigureSearchd ( const CSphConfig & hConf, bool bOptPIDFile )
 	if ( hSearchd.Exists ( "persistent_connections_limit" ) && hSearchd["persistent_connections_limit"].intval()>=0 )
 		g_iPersistentPoolSize = hSearchd["persistent_connections_limit"].intval();
 
+	g_iAgentMuxConnections = Max ( hSearchd.GetInt ( "agent_multiplex_connections", 0 ), 0 );
+
+	if ( hSearchd.Exists ( "agent_result_encoding" ) )
+	{
+		const CSphString & sEncoding = hSearchd["agent_result_encoding"].strval();
+		if ( sEncoding=="rows" )
+			g_uAgentResultEncoding = 0;
+		else if ( sEncoding=="columnar" )
+			g_uAgentResultEncoding = RESULT_COLUMNAR;
+		else if ( sEncoding=="compressed" )
+		{
+#if USE_ZLIB
+			g_uAgentResultEncoding = RESULT_COLUMNAR | RESULT_COMPRESSED;
+#else
+			sphWarning ( "agent_result_encoding=compressed requires zlib support; using columnar" );
+			g_uAgentResultEncoding = RESULT_COLUMNAR;
+#endif
+		}
+		else
+			sphWarning ( "unknown agent_result_encoding value '%s'; using columnar", sEncoding.cstr() );
+	}
+
 	g_bPreopenIndexes = hSearchd.GetInt ( "preopen_indexes", (int)g_bPreopenIndexes )!=0;
 	sphSetUnlinkOld ( hSearchd.GetInt ( "unlink_old", 1 )!=0 );
 	g_iExpansionLimit = hSearchd.GetInt ( "expansion_limit", 0 );
+	g_iExpansionCacheSize = hSearchd.GetSize64 ( "expansion_cache_size", 0 );
+	if ( hSearchd.Exists ( "docstore_cache_size" ) )
+		sphSetDocstoreCacheSize ( hSearchd.GetSize64 ( "docstore_cache_size", 0 ) );
 	g_bOnDiskAttrs = ( hSearchd.GetInt ( "ondisk_attrs_default", 0 )==1 );
 	g_bOnDiskPools = ( strcmp ( hSearchd.GetStr ( "ondisk_attrs_default", "" ), "pool" )==0 );
 
@@ -22159,6 +24704,7 @@ void ConfigureSearchd ( const CSphConfig & hConf, bool bOptPIDFile )
 	g_iMaxFilterValues = hSearchd.GetInt ( "max_filter_values", g_iMaxFilterValues );
 	g_iMaxBatchQueries = hSearchd.GetInt ( "max_batch_queries", g_iMaxBatchQueries );
 	g_iDistThreads = hSearchd.GetInt ( "dist_threads", g_iDistThreads );
+	sphSetSnippetThreads ( hSearchd.GetInt ( "snippets_threads", 0 ), SphCrashLogger_c::ThreadCreate );
 	if ( hSearchd.Exists ( "prefork" ) )
 	{
 		g_iPreforkChildren = hSearchd.GetInt ( "prefork", g_iPreforkChildren );
@@ -22851,6 +25397,21 @@ int WINAPI ServiceMain ( int argc, char **argv )
 	{
 		if ( !sphThreadKeyCreate ( &g_tConnKey ) )
 			sphFatal ( "failed to create TLS for connection ID" );
+		if ( !sphThreadKeyCreate ( &g_tMuxKey ) )
+			sphFatal ( "failed to create TLS for multiplexed replies" );
+	}
+
+#if USE_WINDOWS
+	if ( g_iAgentMuxConnections )
+	{
+		sphWarning ( "agent_multiplex_connections is not supported on Windows; ignored" );
+		g_iAgentMuxConnections = 0;
+	}
+#endif
+	if ( g_iAgentMuxConnections && g_eWorkers!=MPM_THREADS )
+	{
+		sphWarning ( "agent_multiplex_connections requires workers=threads; ignored" );
+		g_iAgentMuxConnections = 0;
 	}
 
 	////////////////////
@@ -23148,6 +25709,9 @@ int WINAPI ServiceMain ( int argc, char **argv )
 	if ( !g_bOptNoDetach )
 		g_bLogStdout = false;
 
+	if ( !sphInitMatchArena() )
+		sphWarning ( "unable to init match arenas" );
+
 	if ( g_bIOStats && !sphInitIOStats () )
 		sphWarning ( "unable to init IO statistics" );
 
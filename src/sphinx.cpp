@@ -1065,6 +1065,20 @@ struct DiskSubstringPayload_t : public ISphSubstringPayload
 	CSphFixedVector<Slice64_t>	m_dDoclist;
 	int							m_iTotalDocs;
 	int							m_iTotalHits;
+
+	virtual ISphSubstringPayload * Clone () const
+	{
+		DiskSubstringPayload_t * pClone = new DiskSubstringPayload_t ( m_dDoclist.GetLength() );
+		memcpy ( pClone->m_dDoclist.Begin(), m_dDoclist.Begin(), m_dDoclist.GetSizeBytes() );
+		pClone->m_iTotalDocs = m_iTotalDocs;
+		pClone->m_iTotalHits = m_iTotalHits;
+		return pClone;
+	}
+
+	virtual int64_t GetSizeBytes () const
+	{
+		return sizeof(*this) + m_dDoclist.GetSizeBytes();
+	}
 };
 
 
@@ -1075,7 +1089,7 @@ class DiskPayloadQword_c : public DiskIndexQword_c<INLINE_HITS, false, false, fa
 
 public:
 	explicit DiskPayloadQword_c ( const DiskSubstringPayload_t * pPayload, bool bExcluded,
-		const CSphAutofile & tDoclist, const CSphAutofile & tHitlist, CSphQueryProfile * pProfile )
+		const CSphAutofile & tDoclist, const CSphAutofile & tHitlist, CSphQueryProfile * pProfile, CSphQueryStats * pStats )
 		: BASE ( true, bExcluded )
 	{
 		m_pPayload = pPayload;
@@ -1087,11 +1101,13 @@ public:
 		this->m_rdDoclist.SetBuffers ( g_iReadBuffer, g_iReadUnhinted );
 		this->m_rdDoclist.m_pProfile = pProfile;
 		this->m_rdDoclist.m_eProfileState = SPH_QSTATE_READ_DOCS;
+		this->m_rdDoclist.m_pStatBytes = pStats ? &pStats->m_iDoclistBytes : NULL;
 
 		this->m_rdHitlist.SetFile ( tHitlist );
 		this->m_rdHitlist.SetBuffers ( g_iReadBuffer, g_iReadUnhinted );
 		this->m_rdHitlist.m_pProfile = pProfile;
 		this->m_rdHitlist.m_eProfileState = SPH_QSTATE_READ_HITS;
+		this->m_rdHitlist.m_pStatBytes = pStats ? &pStats->m_iHitlistBytes : NULL;
 	}
 
 	virtual const CSphMatch & GetNextDoc ( DWORD * pDocinfo )
@@ -1199,15 +1215,20 @@ private:
 	const BYTE *	m_pBuf;
 	BYTE			m_sWord [ MAX_KEYWORD_BYTES ];
 	int				m_iLen;
-	BYTE			m_uHint;
 	bool			m_bHaveSkips;
 
+	const BYTE *	m_pEntryData;
+
 public:
 	explicit		KeywordsBlockReader_c ( const BYTE * pBuf, bool bHaveSkiplists );
 	bool			UnpackWord();
 
 	const char *	GetWord() const			{ return (const char*)m_sWord; }
 	int				GetWordLen() const		{ return m_iLen; }
+	const BYTE *	GetEntryData() const	{ return m_pEntryData; }
+
+	/// decode entry data (everything after the keyword itself) into a given entry
+	static const BYTE *	UnpackEntryData ( const BYTE * pData, bool bHaveSkiplists, CSphDictEntry & tEntry );
 };
 
 
@@ -1247,6 +1268,7 @@ public:
 
 	BYTE *								m_pWords;				///< arena for checkpoint's words
 	BYTE *								m_pInfixBlocksWords;	///< arena for infix checkpoint's words
+	TrigramInfixes_c					m_tTrigrams;			///< optional trigram infix index, built on load
 
 public:
 	explicit							CWordlist ();
@@ -1259,6 +1281,7 @@ public:
 	bool								GetWord ( const BYTE * pBuf, SphWordID_t iWordID, CSphDictEntry & tWord ) const;
 
 	const BYTE *						AcquireDict ( const CSphWordlistCheckpoint * pCheckpoint ) const;
+	void								BuildTrigrams ();
 	virtual void						GetPrefixedWords ( const char * sSubstring, int iSubLen, const char * sWildcard, Args_t & tArgs ) const;
 	virtual void						GetInfixedWords ( const char * sSubstring, int iSubLen, const char * sWildcard, Args_t & tArgs ) const;
 
@@ -1352,7 +1375,12 @@ static const char * g_dOldExts31[] = { ".old.sph", ".old.spa", ".old.spi", ".old
 static const char * g_dCurExts31[] = { ".sph", ".spa", ".spi", ".spd", ".spp", ".spm", ".spk", ".sps", ".spe", ".mvp" };
 static const char * g_dLocExts31[] = { ".sph", ".spa", ".spi", ".spd", ".spp", ".spm", ".spk", ".sps", ".spe", ".spl" };
 
-static const char ** g_pppAllExts[] = { g_dCurExts31, g_dNewExts31, g_dOldExts31, g_dLocExts31 };
+static const char * g_dNewExts43[] = { ".new.sph", ".new.spa", ".new.spi", ".new.spd", ".new.spp", ".new.spm", ".new.spk", ".new.sps", ".new.spe", ".new.spds" };
+static const char * g_dOldExts43[] = { ".old.sph", ".old.spa", ".old.spi", ".old.spd", ".old.spp", ".old.spm", ".old.spk", ".old.sps", ".old.spe", ".old.spds", ".old.mvp" };
+static const char * g_dCurExts43[] = { ".sph", ".spa", ".spi", ".spd", ".spp", ".spm", ".spk", ".sps", ".spe", ".spds", ".mvp" };
+static const char * g_dLocExts43[] = { ".sph", ".spa", ".spi", ".spd", ".spp", ".spm", ".spk", ".sps", ".spe", ".spds", ".spl" };
+
+static const char ** g_pppAllExts[] = { g_dCurExts43, g_dNewExts43, g_dOldExts43, g_dLocExts43 };
 
 
 const char ** sphGetExts ( ESphExtType eType, DWORD uVersion )
@@ -1367,7 +1395,7 @@ const char ** sphGetExts ( ESphExtType eType, DWORD uVersion )
 		case SPH_EXT_TYPE_LOC: return g_dLocExts17;
 		}
 
-	} else
+	} else if ( uVersion<43 )
 	{
 		switch ( eType )
 		{
@@ -1376,6 +1404,16 @@ const char ** sphGetExts ( ESphExtType eType, DWORD uVersion )
 		case SPH_EXT_TYPE_CUR: return g_dCurExts31;
 		case SPH_EXT_TYPE_LOC: return g_dLocExts31;
 		}
+
+	} else
+	{
+		switch ( eType )
+		{
+		case SPH_EXT_TYPE_NEW: return g_dNewExts43;
+		case SPH_EXT_TYPE_OLD: return g_dOldExts43;
+		case SPH_EXT_TYPE_CUR: return g_dCurExts43;
+		case SPH_EXT_TYPE_LOC: return g_dLocExts43;
+		}
 	}
 
 	assert ( 0 && "Unknown extension type" );
@@ -1386,8 +1424,10 @@ int sphGetExtCount ( DWORD uVersion )
 {
 	if ( uVersion<31 )
 		return 8;
-	else
+	else if ( uVersion<43 )
 		return 9;
+	else
+		return 10;
 }
 
 const char * sphGetExt ( ESphExtType eType, ESphExt eExt )
@@ -1567,6 +1607,7 @@ public:
 
 	template <class QWORDDST, class QWORDSRC>
 	static bool					MergeWords ( const CSphIndex_VLN * pDstIndex, const CSphIndex_VLN * pSrcIndex, const ISphFilter * pFilter, const CSphVector<SphDocID_t> & dKillList, SphDocID_t uMinID, CSphHitBuilder * pHitBuilder, CSphString & sError, CSphSourceStats & tStat, CSphIndexProgress & tProgress, ThrottleState_t * pThrottle, volatile bool * pGlobalStop, volatile bool * pLocalStop );
+	static bool					MergeDocstores ( const CSphIndex_VLN * pDstIndex, const CSphIndex_VLN * pSrcIndex, ISphFilter * pFilter, const CSphVector<SphDocID_t> & dKillList, CSphString & sError );
 	static bool					DoMerge ( const CSphIndex_VLN * pDstIndex, const CSphIndex_VLN * pSrcIndex, bool bMergeKillLists, ISphFilter * pFilter, const CSphVector<SphDocID_t> & dKillList, CSphString & sError, CSphIndexProgress & tProgress, ThrottleState_t * pThrottle, volatile bool * pGlobalStop, volatile bool * pLocalStop );
 
 	virtual int					UpdateAttributes ( const CSphAttrUpdate & tUpd, int iIndex, CSphString & sError, CSphString & sWarning );
@@ -1587,8 +1628,11 @@ public:
 	virtual const CSphSourceStats &		GetStats () const { return m_tStats; }
 	virtual int64_t *					GetFieldLens() const { return m_tSettings.m_bIndexFieldLens ? m_dFieldLens.Begin() : NULL; }
 	virtual void				GetStatus ( CSphIndexStatus* ) const;
+	virtual ISphStoredFields *	CreateStoredFields ( const CSphDeadRows * pDeadRows ) const;
+	bool						GetStoredField ( SphDocID_t uDocid, int iField, const CSphDeadRows * pDeadRows, BYTE ** ppText, int * pLen ) const;
 	virtual bool 				BuildDocList ( SphAttr_t ** ppDocList, int64_t * pCount, CSphString * pError ) const;
 	virtual bool				ReplaceKillList ( const SphDocID_t * pKillist, int iCount );
+	virtual void				LookupRows ( const SphDocID_t * pDocs, int iCount, CSphVector<DWORD> & dRows ) const;
 
 private:
 
@@ -1616,6 +1660,7 @@ private:
 
 	int64_t						m_iDocinfo;				///< my docinfo cache size
 	CSphSharedBuffer<DWORD>		m_pDocinfoHash;			///< hashed ids, to accelerate lookups
+	CSphSharedBuffer<DWORD>		m_pDocinfoDirect;		///< dense docid to row map (row+1, 0 means no such id); replaces the hash when ids are dense enough
 	int64_t						m_iDocinfoIndex;		///< docinfo "index" entries count (each entry is 2x docinfo rows, for min/max)
 	DWORD *						m_pDocinfoIndex;		///< docinfo "index", to accelerate filtering during full-scan (2x rows for each block, and 2x rows for the whole index, 1+m_uDocinfoIndex entries)
 
@@ -1648,12 +1693,16 @@ private:
 
 	CSphAutofile				m_tDoclistFile;			///< doclist file
 	CSphAutofile				m_tHitlistFile;			///< hitlist file
+	CSphDocstore				m_tDocstore;			///< stored fields
+	CSphVector<CSphJsonIndex>	m_dJsonIndexes;			///< JSON secondary indexes, built on load
+	CSphVector<DocidOrderedAttr_t>	m_dDocidOrdered;	///< attributes verified to be non-decreasing with docid, on load
 
 #define SPH_SHARED_VARS_COUNT 2
 
 	DWORD *						m_pPreread;
 	DWORD *						m_pAttrsStatus;
 	CSphSharedBuffer<DWORD>		m_dShared;				///< are we ready to search
+	mutable CSphProcessSharedMutex	m_tUpdateLock;		///< serializes attribute updaters and flushes (searchers never take it)
 
 	bool						m_bPreallocated;		///< are we ready to preread
 	DWORD						m_uVersion;				///< data files version
@@ -1671,7 +1720,8 @@ private:
 
 	bool						ParsedMultiQuery ( const CSphQuery * pQuery, CSphQueryResult * pResult, int iSorters, ISphMatchSorter ** ppSorters, const XQQuery_t & tXQ, CSphDict * pDict, const CSphMultiQueryArgs & tArgs, CSphQueryNodeCache * pNodeCache, const SphWordStatChecker_t & tStatDiff ) const;
 	bool						MultiScan ( const CSphQuery * pQuery, CSphQueryResult * pResult, int iSorters, ISphMatchSorter ** ppSorters, const CSphMultiQueryArgs & tArgs ) const;
-	void						MatchExtended ( CSphQueryContext * pCtx, const CSphQuery * pQuery, int iSorters, ISphMatchSorter ** ppSorters, ISphRanker * pRanker, int iTag, int iIndexWeight ) const;
+	void						BindStoredFields ( int iSorters, ISphMatchSorter ** ppSorters, const CSphMultiQueryArgs & tArgs ) const;
+	void						MatchExtended ( CSphQueryContext * pCtx, const CSphQuery * pQuery, int iSorters, ISphMatchSorter ** ppSorters, ISphRanker * pRanker, const ISphQwordSetup & tSetup, int iTag, int iIndexWeight ) const;
 
 	const DWORD *				FindDocinfo ( SphDocID_t uDocID ) const;
 	void						CopyDocinfo ( const CSphQueryContext * pCtx, CSphMatch & tMatch, const DWORD * pFound ) const;
@@ -1689,6 +1739,7 @@ private:
 	bool						LoadPersistentMVA ( CSphString & sError );
 
 	bool						JuggleFile ( const char* szExt, CSphString & sError, bool bNeedOrigin=true ) const;
+	bool						SaveAttributesState ( DWORD uAttrStatus, int64_t iTID, CSphString & sError ) const;
 	XQNode_t *					ExpandPrefix ( XQNode_t * pNode, CSphQueryResultMeta * pResult, CSphScopedPayload * pPayloads ) const;
 
 	const CSphRowitem *			CopyRow ( const CSphRowitem * pDocinfo, DWORD * pTmpDocinfo, const CSphColumnInfo * pNewAttr, int iOldStride ) const;
@@ -2080,6 +2131,223 @@ const DWORD * CSphMatch::GetAttrMVA ( const CSphAttrLocator & tLoc, const DWORD
 	return pPool + uIndex;
 }
 
+//////////////////////////////////////////////////////////////////////////
+// MATCH ARENA
+//////////////////////////////////////////////////////////////////////////
+
+// debug builds precede every dynamic row with its size, and check that on every access
+#ifndef NDEBUG
+static const int	MATCH_ROW_HEADER		= 1;
+#else
+static const int	MATCH_ROW_HEADER		= 0;
+#endif
+static const int	MATCH_ARENA_MIN_CHUNK	= 4096;		///< first chunk size, in rowitems
+static const int	MATCH_ARENA_MAX_CHUNK	= 262144;	///< chunk size limit, in rowitems
+
+static bool				g_bMatchArena = false;
+static SphThreadKey_t	g_tMatchArenaTls;
+
+
+/// arena chunk; every chunk holds rows of the same size, so that they could be detached without any schema
+struct CSphMatchArena::Chunk_t
+{
+	Chunk_t *			m_pNext;
+	CSphRowitem *		m_pData;
+	int					m_iDynamic;	///< row size, in rowitems
+	int					m_iStride;	///< row size plus header, padded to keep rows 8-byte aligned
+	int					m_iSize;	///< chunk size, in rowitems
+	int					m_iUsed;	///< rowitems carved so far
+
+	Chunk_t ( int iDynamic, int iStride, int iSize )
+		: m_pNext ( NULL )
+		, m_iDynamic ( iDynamic )
+		, m_iStride ( iStride )
+		, m_iSize ( iSize )
+		, m_iUsed ( 0 )
+	{
+		m_pData = new CSphRowitem [ iSize ];
+	}
+
+	~Chunk_t ()
+	{
+		SafeDeleteArray ( m_pData );
+	}
+};
+
+
+bool sphInitMatchArena ()
+{
+	if ( !sphThreadKeyCreate ( &g_tMatchArenaTls ) )
+		return false;
+
+	g_bMatchArena = true;
+	return true;
+}
+
+
+void sphDoneMatchArena ()
+{
+	if ( !g_bMatchArena )
+		return;
+
+	sphThreadKeyDelete ( g_tMatchArenaTls );
+	g_bMatchArena = false;
+}
+
+
+static CSphRowitem * AllocHeapRow ( int iDynamic )
+{
+	CSphRowitem * pRow = new CSphRowitem [ iDynamic+MATCH_ROW_HEADER ] + MATCH_ROW_HEADER;
+#ifndef NDEBUG
+	pRow[-1] = iDynamic;
+#endif
+	return pRow;
+}
+
+
+CSphRowitem * sphAllocDynamicRow ( int iDynamic )
+{
+	assert ( iDynamic>0 );
+	CSphMatchArena * pArena = g_bMatchArena ? (CSphMatchArena *)sphThreadGet ( g_tMatchArenaTls ) : NULL;
+	if ( pArena )
+		return pArena->Alloc ( iDynamic );
+	return AllocHeapRow ( iDynamic );
+}
+
+
+void sphFreeDynamicRow ( CSphRowitem * pRow )
+{
+	CSphMatchArena::Free ( pRow );
+}
+
+
+CSphMatchArena::CSphMatchArena ()
+	: m_pChunks ( NULL )
+	, m_pLast ( NULL )
+	, m_iNextSize ( MATCH_ARENA_MIN_CHUNK )
+	, m_iReserved ( 0 )
+	, m_bStarted ( false )
+	, m_pPrev ( NULL )
+{}
+
+
+CSphMatchArena::~CSphMatchArena ()
+{
+	Stop();
+	while ( m_pChunks )
+	{
+		Chunk_t * pNext = m_pChunks->m_pNext;
+		delete m_pChunks;
+		m_pChunks = pNext;
+	}
+}
+
+
+void CSphMatchArena::Start ()
+{
+	if ( !g_bMatchArena || m_bStarted )
+		return;
+
+	m_pPrev = (CSphMatchArena *)sphThreadGet ( g_tMatchArenaTls );
+	sphThreadSet ( g_tMatchArenaTls, this );
+	m_bStarted = true;
+}
+
+
+void CSphMatchArena::Stop ()
+{
+	if ( !m_bStarted )
+		return;
+
+	// nested arenas must stop in reverse order, otherwise the outer one would get reinstalled while stopped
+	assert ( sphThreadGet ( g_tMatchArenaTls )==this );
+	sphThreadSet ( g_tMatchArenaTls, m_pPrev );
+	m_bStarted = false;
+}
+
+
+CSphRowitem * CSphMatchArena::Alloc ( int iDynamic )
+{
+	assert ( iDynamic>0 );
+
+	// rows of the same size mostly come in a row, so check the last chunk first
+	Chunk_t * pChunk = m_pLast;
+	if ( !pChunk || pChunk->m_iDynamic!=iDynamic )
+	{
+		pChunk = m_pChunks;
+		while ( pChunk && pChunk->m_iDynamic!=iDynamic )
+			pChunk = pChunk->m_pNext;
+	}
+
+	if ( !pChunk || pChunk->m_iUsed+pChunk->m_iStride>pChunk->m_iSize )
+	{
+		int iStride = ( MATCH_ROW_HEADER+iDynamic+1 ) & ~1;
+		int iSize = Max ( m_iNextSize, iStride );
+		m_iNextSize = Min ( 2*m_iNextSize, MATCH_ARENA_MAX_CHUNK );
+
+		pChunk = new Chunk_t ( iDynamic, iStride, iSize - iSize % iStride );
+		pChunk->m_pNext = m_pChunks;
+		m_pChunks = pChunk;
+		m_iReserved += pChunk->m_iSize*sizeof(CSphRowitem);
+	}
+
+	CSphRowitem * pRow = pChunk->m_pData + pChunk->m_iUsed + MATCH_ROW_HEADER;
+#ifndef NDEBUG
+	pRow[-1] = iDynamic;
+#endif
+	pChunk->m_iUsed += pChunk->m_iStride;
+	m_pLast = pChunk;
+	return pRow;
+}
+
+
+const CSphMatchArena::Chunk_t * CSphMatchArena::FindChunk ( const CSphRowitem * pRow ) const
+{
+	for ( const Chunk_t * pChunk = m_pChunks; pChunk; pChunk = pChunk->m_pNext )
+		if ( pRow>=pChunk->m_pData && pRow<pChunk->m_pData+pChunk->m_iSize )
+			return pChunk;
+	return NULL;
+}
+
+
+bool CSphMatchArena::Owns ( const CSphRowitem * pRow ) const
+{
+	return FindChunk ( pRow )!=NULL;
+}
+
+
+void CSphMatchArena::Free ( CSphRowitem * pRow )
+{
+	assert ( pRow );
+
+	// rows of the current arenas go away with them
+	const CSphMatchArena * pArena = g_bMatchArena ? (const CSphMatchArena *)sphThreadGet ( g_tMatchArenaTls ) : NULL;
+	for ( ; pArena; pArena = pArena->m_pPrev )
+		if ( pArena->FindChunk ( pRow ) )
+			return;
+
+	delete [] ( pRow-MATCH_ROW_HEADER );
+}
+
+
+void CSphMatchArena::Detach ( CSphMatch * pMatches, int iCount ) const
+{
+	for ( int i=0; i<iCount; i++ )
+	{
+		CSphMatch & tMatch = pMatches[i];
+		if ( !tMatch.m_pDynamic )
+			continue;
+
+		const Chunk_t * pChunk = FindChunk ( tMatch.m_pDynamic );
+		if ( !pChunk )
+			continue;
+
+		CSphRowitem * pRow = AllocHeapRow ( pChunk->m_iDynamic );
+		memcpy ( pRow, tMatch.m_pDynamic, pChunk->m_iDynamic*sizeof(CSphRowitem) );
+		tMatch.m_pDynamic = pRow;
+	}
+}
+
 /////////////////////////////////////////////////////////////////////////////
 // TOKENIZING EXCEPTIONS
 /////////////////////////////////////////////////////////////////////////////
@@ -7048,6 +7316,12 @@ CSphQueryStats::CSphQueryStats()
 	, m_iFetchedDocs ( 0 )
 	, m_iFetchedHits ( 0 )
 	, m_iSkips ( 0 )
+	, m_iDoclistBytes ( 0 )
+	, m_iHitlistBytes ( 0 )
+	, m_iDocinfoBytes ( 0 )
+	, m_iPushedMatches ( 0 )
+	, m_iFilterEvals ( 0 )
+	, m_iArenaBytes ( 0 )
 {
 }
 
@@ -7056,6 +7330,12 @@ void CSphQueryStats::Add ( const CSphQueryStats & tStats )
 	m_iFetchedDocs += tStats.m_iFetchedDocs;
 	m_iFetchedHits += tStats.m_iFetchedHits;
 	m_iSkips += tStats.m_iSkips;
+	m_iDoclistBytes += tStats.m_iDoclistBytes;
+	m_iHitlistBytes += tStats.m_iHitlistBytes;
+	m_iDocinfoBytes += tStats.m_iDocinfoBytes;
+	m_iPushedMatches += tStats.m_iPushedMatches;
+	m_iFilterEvals += tStats.m_iFilterEvals;
+	m_iArenaBytes += tStats.m_iArenaBytes;
 }
 
 
@@ -7937,6 +8217,7 @@ void CSphWriter::SeekTo ( SphOffset_t iPos )
 CSphReader::CSphReader ( BYTE * pBuf, int iSize )
 	: m_pProfile ( NULL )
 	, m_eProfileState ( SPH_QSTATE_IO )
+	, m_pStatBytes ( NULL )
 	, m_iFD ( -1 )
 	, m_iPos ( 0 )
 	, m_iBuffPos ( 0 )
@@ -8152,6 +8433,8 @@ void CSphReader::UpdateCache ()
 
 	m_iBuffPos = 0;
 	m_iBuffUsed = sphPread ( m_iFD, m_pBuff, iReadLen, iNewPos ); // FIXME! what about throttling?
+	if ( m_pStatBytes && m_iBuffUsed>0 )
+		*m_pStatBytes += m_iBuffUsed;
 
 	if ( m_iBuffUsed<0 )
 	{
@@ -9570,6 +9853,8 @@ CSphMultiQueryArgs::CSphMultiQueryArgs ( const KillListVector & dKillList, int i
 	, m_bLocalDF ( false )
 	, m_pLocalDocs ( NULL )
 	, m_iTotalDocs ( 0 )
+	, m_pDeadRows ( NULL )
+	, m_pStoredFields ( NULL )
 {
 	assert ( iIndexWeight>0 );
 }
@@ -9583,6 +9868,8 @@ CSphIndex::CSphIndex ( const char * sIndexName, const char * sFilename )
 	: m_iTID ( 0 )
 	, m_bExpandKeywords ( false )
 	, m_iExpansionLimit ( 0 )
+	, m_bInfixTrigrams ( false )
+	, m_pExpansionCache ( NULL )
 	, m_tSchema ( sFilename )
 	, m_bInplaceSettings ( false )
 	, m_iHitGap ( 0 )
@@ -9602,11 +9889,13 @@ CSphIndex::CSphIndex ( const char * sIndexName, const char * sFilename )
 	, m_sIndexName ( sIndexName )
 	, m_sFilename ( sFilename )
 {
+	m_pExpansionCache = new CSphExpansionCache();
 }
 
 
 CSphIndex::~CSphIndex ()
 {
+	SafeDelete ( m_pExpansionCache );
 	SafeDelete ( m_pFieldFilter );
 	SafeDelete ( m_pQueryTokenizer );
 	SafeDelete ( m_pTokenizer );
@@ -9614,6 +9903,18 @@ CSphIndex::~CSphIndex ()
 }
 
 
+void CSphIndex::SetExpansionCacheSize ( int64_t iMaxBytes )
+{
+	m_pExpansionCache->SetMaxBytes ( iMaxBytes );
+}
+
+
+void CSphIndex::GetExpansionCacheStatus ( CSphIndexStatus * pRes ) const
+{
+	m_pExpansionCache->GetStatus ( pRes );
+}
+
+
 void CSphIndex::SetInplaceSettings ( int iHitGap, int iDocinfoGap, float fRelocFactor, float fWriteFactor )
 {
 	m_iHitGap = iHitGap;
@@ -9784,6 +10085,41 @@ CSphIndex_VLN::~CSphIndex_VLN ()
 
 /////////////////////////////////////////////////////////////////////////////
 
+/// store a plain attribute value into a row that concurrent searches might be reading
+/// unlike sphSetRowAttr(), bitfields are written with one store, so readers never see a cleared field;
+/// bigints span two rowitems and still get two stores
+static inline void PublishRowAttr ( CSphRowitem * pRow, const CSphAttrLocator & tLoc, SphAttr_t uValue )
+{
+	assert ( pRow );
+	volatile CSphRowitem * pItem = pRow + ( tLoc.m_iBitOffset >> ROWITEM_SHIFT );
+	if ( tLoc.m_iBitCount==2*ROWITEM_BITS )
+	{
+		pItem[0] = CSphRowitem ( uValue & ( ( SphAttr_t(1) << ROWITEM_BITS )-1 ) );
+		pItem[1] = CSphRowitem ( uValue >> ROWITEM_BITS );
+
+	} else if ( tLoc.m_iBitCount==ROWITEM_BITS )
+	{
+		*pItem = CSphRowitem ( uValue );
+
+	} else
+	{
+		int iShift = tLoc.m_iBitOffset & ( ( 1 << ROWITEM_SHIFT )-1 );
+		CSphRowitem uMask = ( ( 1UL << tLoc.m_iBitCount )-1 ) << iShift;
+		*pItem = ( *pItem & ~uMask ) | ( uMask & ( uValue << iShift ) );
+	}
+}
+
+
+/// make sure widened block ranges become visible before the row value they cover
+static inline void PublishBarrier ()
+{
+#if USE_WINDOWS
+	MemoryBarrier();
+#elif HAVE_SYNC_FETCH
+	__sync_synchronize();
+#endif
+}
+
 
 int CSphIndex_VLN::UpdateAttributes ( const CSphAttrUpdate & tUpd, int iIndex, CSphString & sError, CSphString & sWarning )
 {
@@ -9807,9 +10143,6 @@ int CSphIndex_VLN::UpdateAttributes ( const CSphAttrUpdate & tUpd, int iIndex, C
 	if ( !m_iDocinfo || !uRows )
 		return 0;
 
-	if ( m_bBinlog && g_pBinlog )
-		g_pBinlog->BinlogUpdateAttributes ( &m_iTID, m_sIndexName.cstr(), tUpd );
-
 	// remap update schema to index schema
 	int iUpdLen = tUpd.m_dAttrs.GetLength();
 	CSphVector<CSphAttrLocator> dLocators ( iUpdLen );
@@ -9921,9 +10254,21 @@ int CSphIndex_VLN::UpdateAttributes ( const CSphAttrUpdate & tUpd, int iIndex, C
 		}
 	}
 
+	// in-place JSON updates make secondary indexes over those columns stale
+	// updated values might also break the docid order
+	for ( int i=0; i<iUpdLen; i++ )
+		if ( dJsonFields.BitGet ( i ) )
+			sphInvalidateJsonIndexes ( m_dJsonIndexes, tUpd.m_dAttrs[i] );
+		else
+			sphInvalidateDocidOrderedAttr ( m_dDocidOrdered, tUpd.m_dAttrs[i] );
+
 	// FIXME! FIXME! FIXME! overwriting just-freed blocks might hurt concurrent searchers;
 	// should implement a simplistic MVCC-style delayed-free to avoid that
 
+	// plain updates only hold a shared index lock (searches keep running), so updaters
+	// serialize here; that keeps binlog order equal to apply order, and flushes consistent
+	CSphScopedLock<CSphProcessSharedMutex> tUpdateLock ( m_tUpdateLock );
+
 	// do the update
 	const int iFirst = ( iIndex<0 ) ? 0 : iIndex;
 	const int iLast = ( iIndex<0 ) ? uRows : iIndex+1;
@@ -9981,6 +10326,7 @@ int CSphIndex_VLN::UpdateAttributes ( const CSphAttrUpdate & tUpd, int iIndex, C
 
 	// preallocate
 	bool bFailed = false;
+	int iFound = 0;
 	for ( int iUpd=iFirst; iUpd<iLast && !bFailed; iUpd++ )
 	{
 		dRowPtrs[iUpd] = NULL;
@@ -9996,6 +10342,7 @@ int CSphIndex_VLN::UpdateAttributes ( const CSphAttrUpdate & tUpd, int iIndex, C
 			continue;
 
 		dRowPtrs[iUpd] = pEntry;
+		iFound++;
 
 		int iPoolPos = tUpd.m_dRowOffset[iUpd];
 		int iMvaPtr = iUpd*iNumMVA;
@@ -10043,6 +10390,13 @@ int CSphIndex_VLN::UpdateAttributes ( const CSphAttrUpdate & tUpd, int iIndex, C
 		return -1;
 	}
 
+	// the whole batch goes to the binlog as a single entry, once it is known to apply
+	if ( !iFound )
+		return 0;
+
+	if ( m_bBinlog && g_pBinlog )
+		g_pBinlog->BinlogUpdateAttributes ( &m_iTID, m_sIndexName.cstr(), tUpd );
+
 	// preallocation went OK; do the actual update
 	int iRowStride = DOCINFO_IDSIZE + m_tSchema.GetRowSize();
 	int iUpdated = 0;
@@ -10075,9 +10429,9 @@ int CSphIndex_VLN::UpdateAttributes ( const CSphAttrUpdate & tUpd, int iIndex, C
 			{
 				// plain update
 				SphAttr_t uValue = dBigints.BitGet ( iCol ) ? MVA_UPSIZE ( &tUpd.m_dPool[iPos] ) : tUpd.m_dPool[iPos];
-				sphSetRowAttr ( pEntry, dLocators[iCol], uValue );
 
-				// update block and index ranges
+				// widen block and index ranges first, so that concurrent searches
+				// never reject a block that already holds the new value
 				for ( int i=0; i<2; i++ )
 				{
 					DWORD * pBlock = i ? pBlockRanges : pIndexRanges;
@@ -10089,18 +10443,21 @@ int CSphIndex_VLN::UpdateAttributes ( const CSphAttrUpdate & tUpd, int iIndex, C
 						float fMin = sphDW2F ( (DWORD) uMin );
 						float fMax = sphDW2F ( (DWORD) uMax );
 						if ( fValue<fMin )
-							sphSetRowAttr ( DOCINFO2ATTRS ( pBlock ), dLocators[iCol], sphF2DW ( fValue ) );
+							PublishRowAttr ( DOCINFO2ATTRS ( pBlock ), dLocators[iCol], sphF2DW ( fValue ) );
 						if ( fValue>fMax )
-							sphSetRowAttr ( DOCINFO2ATTRS ( pBlock+iRowStride ), dLocators[iCol], sphF2DW ( fValue ) );
+							PublishRowAttr ( DOCINFO2ATTRS ( pBlock+iRowStride ), dLocators[iCol], sphF2DW ( fValue ) );
 					} else // update usual integers
 					{
 						if ( uValue<uMin )
-							sphSetRowAttr ( DOCINFO2ATTRS ( pBlock ), dLocators[iCol], uValue );
+							PublishRowAttr ( DOCINFO2ATTRS ( pBlock ), dLocators[iCol], uValue );
 						if ( uValue>uMax )
-							sphSetRowAttr ( DOCINFO2ATTRS ( pBlock+iRowStride ), dLocators[iCol], uValue );
+							PublishRowAttr ( DOCINFO2ATTRS ( pBlock+iRowStride ), dLocators[iCol], uValue );
 					}
 				}
 
+				PublishBarrier();
+				PublishRowAttr ( pEntry, dLocators[iCol], uValue );
+
 				bUpdated = true;
 				uUpdateMask |= ATTRS_UPDATED;
 
@@ -10221,7 +10578,7 @@ int CSphIndex_VLN::UpdateAttributes ( const CSphAttrUpdate & tUpd, int iIndex, C
 		}
 	}
 
-	*m_pAttrsStatus |= uUpdateMask; // FIXME! add lock/atomic?
+	*m_pAttrsStatus |= uUpdateMask;
 	return iUpdated;
 }
 
@@ -10444,10 +10801,34 @@ bool CSphIndex_VLN::SaveAttributes ( CSphString & sError ) const
 		return false;
 	}
 
-	DWORD uAttrStatus = *m_pAttrsStatus;
+	// grab the dirty flags along with the last logged update; updates that land
+	// while we write will flag the attributes again, and go out with the next save
+	DWORD uAttrStatus;
+	int64_t iTID;
+	{
+		CSphScopedLock<CSphProcessSharedMutex> tUpdateLock ( m_tUpdateLock );
+		uAttrStatus = *m_pAttrsStatus;
+		iTID = m_iTID;
+		*m_pAttrsStatus = 0;
+	}
 
 	sphLogDebugvv ( "index '%s' attrs (%d) saving...", m_sIndexName.cstr(), uAttrStatus );
 
+	if ( !SaveAttributesState ( uAttrStatus, iTID, sError ) )
+	{
+		CSphScopedLock<CSphProcessSharedMutex> tUpdateLock ( m_tUpdateLock );
+		*m_pAttrsStatus |= uAttrStatus;
+		return false;
+	}
+
+	sphLogDebugvv ( "index '%s' attrs (%d) saved", m_sIndexName.cstr(), *m_pAttrsStatus );
+
+	return true;
+}
+
+
+bool CSphIndex_VLN::SaveAttributesState ( DWORD uAttrStatus, int64_t iTID, CSphString & sError ) const
+{
 	assert ( m_tSettings.m_eDocinfo==SPH_DOCINFO_EXTERN && m_iDocinfo && m_tAttr.GetWritePtr() );
 
 	for ( ; uAttrStatus & ATTRS_MVA_UPDATED ; )
@@ -10546,7 +10927,7 @@ bool CSphIndex_VLN::SaveAttributes ( CSphString & sError ) const
 		return false;
 
 	if ( m_bBinlog && g_pBinlog )
-		g_pBinlog->NotifyIndexFlush ( m_sIndexName.cstr(), m_iTID, false );
+		g_pBinlog->NotifyIndexFlush ( m_sIndexName.cstr(), iTID, false );
 
 	// save .sps file (inplace update only, no remapping/resizing)
 	if ( uAttrStatus & ATTRS_STRINGS_UPDATED )
@@ -10560,11 +10941,6 @@ bool CSphIndex_VLN::SaveAttributes ( CSphString & sError ) const
 			return false;
 	}
 
-	if ( *m_pAttrsStatus==uAttrStatus )
-		*m_pAttrsStatus = 0;
-
-	sphLogDebugvv ( "index '%s' attrs (%d) saved", m_sIndexName.cstr(), *m_pAttrsStatus );
-
 	return true;
 }
 
@@ -11391,6 +11767,9 @@ void SaveIndexSettings ( CSphWriter & tWriter, const CSphIndexSettings & tSettin
 	tWriter.PutByte ( tSettings.m_eChineseRLP );
 	tWriter.PutString ( tSettings.m_sRLPContext );
 	tWriter.PutString ( tSettings.m_sIndexTokenFilter );
+	tWriter.PutDword ( tSettings.m_dStoredFields.GetLength() );
+	ARRAY_FOREACH ( i, tSettings.m_dStoredFields )
+		tWriter.PutString ( tSettings.m_dStoredFields[i] );
 }
 
 
@@ -12383,6 +12762,58 @@ static bool sphTruncate ( int iFD )
 #endif
 }
 
+/// stored document location in the temporary document storage
+struct StoredDocEntry_t
+{
+	SphDocID_t		m_uDocid;
+	SphOffset_t		m_iOffset;
+	int				m_iLen;
+
+	bool operator < ( const StoredDocEntry_t & rhs ) const
+	{
+		if ( m_uDocid!=rhs.m_uDocid )
+			return m_uDocid<rhs.m_uDocid;
+		return m_iOffset<rhs.m_iOffset;
+	}
+};
+
+
+/// sort collected stored documents by docid, and write the final document storage
+static bool BuildDocstore ( const CSphString & sFile, const CSphString & sTmpFile, const CSphVector<CSphString> & dFields,
+	CSphVector<StoredDocEntry_t> & dDocs, CSphString & sError )
+{
+	CSphAutofile tTmp;
+	if ( dDocs.GetLength() && tTmp.Open ( sTmpFile, SPH_O_READ, sError )<0 )
+		return false;
+
+	CSphDocstoreWriter tWriter;
+	if ( !tWriter.Open ( sFile, dFields, sError ) )
+		return false;
+
+	dDocs.Sort();
+
+	CSphVector<BYTE> dDoc;
+	ARRAY_FOREACH ( i, dDocs )
+	{
+		// duplicate docid; the first one wins, just like with attributes
+		const StoredDocEntry_t & tDoc = dDocs[i];
+		if ( i && tDoc.m_uDocid==dDocs[i-1].m_uDocid )
+			continue;
+
+		dDoc.Resize ( tDoc.m_iLen );
+		if ( tDoc.m_iLen && sphPread ( tTmp.GetFD(), dDoc.Begin(), tDoc.m_iLen, tDoc.m_iOffset )!=tDoc.m_iLen )
+		{
+			sError.SetSprintf ( "failed to read '%s'", sTmpFile.cstr() );
+			tWriter.UnlinkFile();
+			return false;
+		}
+		tWriter.AddDoc ( tDoc.m_uDocid, dDoc.Begin(), tDoc.m_iLen );
+	}
+
+	return tWriter.Finish ( sError );
+}
+
+
 class DeleteOnFail : public ISphNoncopyable
 {
 public:
@@ -12647,6 +13078,21 @@ int CSphIndex_VLN::Build ( const CSphVector<CSphSource*> & dSources, int iMemory
 		}
 	}
 
+	// map stored fields to schema
+	CSphVector<int> dStoredFields;
+	CSphVector<CSphString> dStoredNames;
+	ARRAY_FOREACH ( i, m_tSettings.m_dStoredFields )
+	{
+		int iField = m_tSchema.GetFieldIndex ( m_tSettings.m_dStoredFields[i].cstr() );
+		if ( iField<0 )
+		{
+			m_sLastError.SetSprintf ( "stored field '%s' not found in schema", m_tSettings.m_dStoredFields[i].cstr() );
+			return 0;
+		}
+		dStoredFields.Add ( iField );
+		dStoredNames.Add ( m_tSchema.m_dFields[iField].m_sName );
+	}
+
 	// create temp files
 	CSphAutofile fdLock ( GetIndexFileName("tmp0"), SPH_O_NEW, m_sLastError, true );
 	CSphAutofile fdHits ( GetIndexFileName ( m_bInplaceSettings ? "spp" : "tmp1" ), SPH_O_NEW, m_sLastError, !m_bInplaceSettings );
@@ -12677,6 +13123,17 @@ int CSphIndex_VLN::Build ( const CSphVector<CSphSource*> & dSources, int iMemory
 	if ( fdLock.GetFD()<0 || fdHits.GetFD()<0 || fdDocinfos.GetFD()<0 || fdTmpFieldMVAs.GetFD ()<0 )
 		return 0;
 
+	// stored documents are collected in source order, and get sorted by docid at the very end
+	CSphWriter tStoredWriter;
+	CSphVector<StoredDocEntry_t> dStoredDocs;
+	CSphVector<BYTE> dPackedDoc;
+	if ( dStoredFields.GetLength() )
+	{
+		if ( !tStoredWriter.OpenFile ( GetIndexFileName("tmpds"), m_sLastError ) )
+			return 0;
+		dFileWatchdog.AddWriter ( &tStoredWriter );
+	}
+
 	SphOffset_t iHitsGap = 0;
 	SphOffset_t iDocinfosGap = 0;
 
@@ -12795,6 +13252,26 @@ int CSphIndex_VLN::Build ( const CSphVector<CSphSource*> & dSources, int iMemory
 			g_iIndexerCurrentDocID = pSource->m_tDocInfo.m_uDocID;
 			g_iIndexerCurrentHits = pHits-dHits.Begin();
 
+			// collect stored fields
+			if ( dStoredFields.GetLength() )
+			{
+				int iTexts = 0;
+				BYTE ** ppTexts = pSource->GetFieldTexts ( iTexts );
+
+				dPackedDoc.Resize ( 0 );
+				ARRAY_FOREACH ( i, dStoredFields )
+				{
+					const BYTE * sText = ( ppTexts && dStoredFields[i]<iTexts ) ? ppTexts[dStoredFields[i]] : NULL;
+					sphDocstorePackField ( dPackedDoc, sText, sText ? strlen ( (const char *)sText ) : 0 );
+				}
+
+				StoredDocEntry_t & tStored = dStoredDocs.Add();
+				tStored.m_uDocid = pSource->m_tDocInfo.m_uDocID;
+				tStored.m_iOffset = tStoredWriter.GetPos();
+				tStored.m_iLen = dPackedDoc.GetLength();
+				tStoredWriter.PutBytes ( dPackedDoc.Begin(), dPackedDoc.GetLength() );
+			}
+
 			DWORD * pPrevDocinfo = NULL;
 			if ( m_tSettings.m_eDocinfo==SPH_DOCINFO_EXTERN && pPrevIndex.Ptr() )
 				pPrevDocinfo = const_cast<DWORD*>( pPrevIndex->FindDocinfo ( pSource->m_tDocInfo.m_uDocID ) );
@@ -13736,6 +14213,17 @@ int CSphIndex_VLN::Build ( const CSphVector<CSphSource*> & dSources, int iMemory
 
 	tKillList.Close ();
 
+	// write document storage
+	tStoredWriter.CloseFile();
+	if ( tStoredWriter.IsError() )
+		return 0;
+
+	bool bStoredOk = BuildDocstore ( GetIndexFileName("spds"), GetIndexFileName("tmpds"), dStoredNames, dStoredDocs, m_sLastError );
+	if ( dStoredFields.GetLength() )
+		::unlink ( GetIndexFileName("tmpds").cstr() );
+	if ( !bStoredOk )
+		return 0;
+
 	///////////////////////////////////
 	// sort and write compressed index
 	///////////////////////////////////
@@ -14661,6 +15149,59 @@ bool CSphIndex_VLN::Merge ( CSphIndex * pSource, const CSphVector<CSphFilterSett
 									dKillList, m_sLastError, m_tProgress, &g_tThrottle, &bGlobalStop, &bLocalStop );
 }
 
+bool CSphIndex_VLN::MergeDocstores ( const CSphIndex_VLN * pDstIndex, const CSphIndex_VLN * pSrcIndex,
+	ISphFilter * pFilter, const CSphVector<SphDocID_t> & dKillList, CSphString & sError )
+{
+	CSphDocstoreWriter tWriter;
+	if ( !tWriter.Open ( pDstIndex->GetIndexFileName("tmp.spds"), pDstIndex->m_tSettings.m_dStoredFields, sError ) )
+		return false;
+
+	CSphDocstoreIterator tDst ( pDstIndex->m_tDocstore );
+	CSphDocstoreIterator tSrc ( pSrcIndex->m_tDocstore );
+	bool bDst = tDst.Next();
+	bool bSrc = tSrc.Next();
+	int iKill = 0;
+	CSphMatch tMatch;
+
+	while ( bDst || bSrc )
+	{
+		// source documents always win
+		if ( bSrc && ( !bDst || tSrc.m_uDocid<=tDst.m_uDocid ) )
+		{
+			tWriter.AddDoc ( tSrc.m_uDocid, tSrc.m_pPacked, tSrc.m_iPackedLen );
+			if ( bDst && tDst.m_uDocid==tSrc.m_uDocid )
+				bDst = tDst.Next();
+			bSrc = tSrc.Next();
+			continue;
+		}
+
+		// destination documents go through the kill-list and the filter, same as attributes
+		SphDocID_t uDocid = tDst.m_uDocid;
+		while ( iKill<dKillList.GetLength() && dKillList[iKill]<uDocid )
+			iKill++;
+		bool bKeep = !( iKill<dKillList.GetLength() && dKillList[iKill]==uDocid );
+
+		if ( bKeep && pFilter )
+		{
+			const DWORD * pRow = pDstIndex->FindDocinfo ( uDocid );
+			if ( pRow )
+			{
+				tMatch.m_uDocID = uDocid;
+				tMatch.m_pStatic = DOCINFO2ATTRS ( pRow );
+				tMatch.m_pDynamic = NULL;
+				bKeep = pFilter->Eval ( tMatch );
+			}
+		}
+
+		if ( bKeep )
+			tWriter.AddDoc ( uDocid, tDst.m_pPacked, tDst.m_iPackedLen );
+		bDst = tDst.Next();
+	}
+
+	return tWriter.Finish ( sError );
+}
+
+
 bool CSphIndex_VLN::DoMerge ( const CSphIndex_VLN * pDstIndex, const CSphIndex_VLN * pSrcIndex,
 							bool bMergeKillLists, ISphFilter * pFilter, const CSphVector<SphDocID_t> & dKillList
 							, CSphString & sError, CSphIndexProgress & tProgress, ThrottleState_t * pThrottle,
@@ -14687,6 +15228,17 @@ bool CSphIndex_VLN::DoMerge ( const CSphIndex_VLN * pDstIndex, const CSphIndex_V
 		return false;
 	}
 
+	const CSphVector<CSphString> & dDstStored = pDstIndex->m_tSettings.m_dStoredFields;
+	const CSphVector<CSphString> & dSrcStored = pSrcIndex->m_tSettings.m_dStoredFields;
+	bool bSameStored = ( dDstStored.GetLength()==dSrcStored.GetLength() );
+	for ( int i=0; i<dDstStored.GetLength() && bSameStored; i++ )
+		bSameStored = ( dDstStored[i]==dSrcStored[i] );
+	if ( !bSameStored )
+	{
+		sError = "stored fields must be the same on merged indices";
+		return false;
+	}
+
 	if ( pDstIndex->m_pDict->GetSettings().m_bWordDict!=pSrcIndex->m_pDict->GetSettings().m_bWordDict )
 	{
 		sError.SetSprintf ( "dictionary types must be the same (dst dict=%s, src dict=%s )",
@@ -14896,7 +15448,14 @@ bool CSphIndex_VLN::DoMerge ( const CSphIndex_VLN * pDstIndex, const CSphIndex_V
 	if ( !CheckDocsCount ( iTotalDocuments, sError ) )
 		return false;
 
-	int iOldLen = dPhantomKiller.GetLength();
+	/////////////////////////////
+	// merging document storage
+	/////////////////////////////
+
+	if ( !MergeDocstores ( pDstIndex, pSrcIndex, pFilter, dKillList, sError ) )
+		return false;
+
+	int iOldLen = dPhantomKiller.GetLength();
 	int iKillLen = dKillList.GetLength();
 	dPhantomKiller.Resize ( iOldLen+iKillLen );
 	memcpy ( dPhantomKiller.Begin()+iOldLen, dKillList.Begin(), sizeof(SphDocID_t)*iKillLen );
@@ -15235,7 +15794,11 @@ bool CSphIndex_VLN::EarlyReject ( CSphQueryContext * pCtx, CSphMatch & tMatch )
 		CopyDocinfo ( pCtx, tMatch, FindDocinfo ( tMatch.m_uDocID ) );
 	pCtx->CalcFilter ( tMatch ); // FIXME!!! leak of filtered STRING_PTR
 
-	return pCtx->m_pFilter ? !pCtx->m_pFilter->Eval ( tMatch ) : false;
+	if ( !pCtx->m_pFilter )
+		return false;
+
+	pCtx->m_tStats.m_iFilterEvals++;
+	return !pCtx->m_pFilter->Eval ( tMatch );
 }
 
 
@@ -15321,6 +15884,182 @@ bool CSphIndex_VLN::HasDocid ( SphDocID_t uDocid ) const
 }
 
 
+void CSphIndex_VLN::LookupRows ( const SphDocID_t * pDocs, int iCount, CSphVector<DWORD> & dRows ) const
+{
+	if ( !m_tAttr.GetLengthBytes() || m_iDocinfo>=UINT_MAX )
+		return;
+
+	int iStride = DOCINFO_IDSIZE + m_tSchema.GetRowSize();
+	const DWORD * pRows = m_tAttr.GetWritePtr();
+
+	for ( int i=0; i<iCount; i++ )
+	{
+		const DWORD * pRow = FindDocinfo ( pDocs[i] );
+		if ( pRow )
+			dRows.Add ( DWORD ( ( pRow-pRows ) / iStride ) );
+	}
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+CSphDeadRows::~CSphDeadRows ()
+{
+	ARRAY_FOREACH ( i, m_dPages )
+		SafeRelease ( m_dPages[i] );
+}
+
+
+/// make a copy of the page that also has the given rows deleted (all from that page, sorted)
+/// returns NULL if all of them were deleted already
+CSphDeadRows::Page_t * CSphDeadRows::KillPage ( const Page_t * pPage, const DWORD * pRows, int iCount )
+{
+	assert ( iCount>0 );
+	Page_t * pNew = new Page_t();
+
+	if ( pPage && pPage->m_dBits.GetLength() )
+	{
+		pNew->m_dBits.Reset ( PAGE_WORDS );
+		memcpy ( pNew->m_dBits.Begin(), pPage->m_dBits.Begin(), PAGE_WORDS*sizeof(DWORD) );
+		pNew->m_iDead = pPage->m_iDead;
+		for ( int i=0; i<iCount; i++ )
+		{
+			DWORD & uWord = pNew->m_dBits [ ( pRows[i] & PAGE_MASK ) >> 5 ];
+			DWORD uBit = 1UL << ( pRows[i] & 31 );
+			if ( !( uWord & uBit ) )
+			{
+				uWord |= uBit;
+				pNew->m_iDead++;
+			}
+		}
+	} else
+	{
+		// merge the sorted arrays, dropping the duplicates
+		int iOld = pPage ? pPage->m_dRows.GetLength() : 0;
+		CSphVector<WORD> dMerged ( iOld+iCount );
+		dMerged.Resize ( 0 );
+
+		int iA = 0, iB = 0;
+		while ( iA<iOld || iB<iCount )
+		{
+			WORD uRow;
+			if ( iB>=iCount || ( iA<iOld && pPage->m_dRows[iA]<=WORD ( pRows[iB] & PAGE_MASK ) ) )
+				uRow = pPage->m_dRows[iA++];
+			else
+				uRow = WORD ( pRows[iB++] & PAGE_MASK );
+
+			if ( !dMerged.GetLength() || dMerged.Last()!=uRow )
+				dMerged.Add ( uRow );
+		}
+
+		pNew->m_iDead = dMerged.GetLength();
+		if ( pNew->m_iDead<=PAGE_ARRAY_MAX )
+		{
+			pNew->m_dRows.Reset ( dMerged.GetLength() );
+			memcpy ( pNew->m_dRows.Begin(), dMerged.Begin(), dMerged.GetLength()*sizeof(WORD) );
+		} else
+		{
+			pNew->m_dBits.Reset ( PAGE_WORDS );
+			memset ( pNew->m_dBits.Begin(), 0, PAGE_WORDS*sizeof(DWORD) );
+			ARRAY_FOREACH ( i, dMerged )
+				pNew->m_dBits [ dMerged[i]>>5 ] |= 1UL << ( dMerged[i] & 31 );
+		}
+	}
+
+	if ( pPage && pNew->m_iDead==pPage->m_iDead )
+		SafeRelease ( pNew );
+	return pNew;
+}
+
+
+CSphDeadRows * CSphDeadRows::Kill ( const DWORD * pRows, int iCount ) const
+{
+	if ( !iCount )
+		return NULL;
+
+	int iPages = Max ( m_dPages.GetLength(), int ( pRows[iCount-1] >> PAGE_BITS )+1 );
+	CSphDeadRows * pNew = new CSphDeadRows();
+	pNew->m_dPages.Reset ( iPages );
+	pNew->m_iDead = m_iDead;
+
+	bool bChanged = false;
+	int iRow = 0;
+	for ( int iPage=0; iPage<iPages; iPage++ )
+	{
+		const Page_t * pPage = iPage<m_dPages.GetLength() ? m_dPages[iPage] : NULL;
+
+		int iStart = iRow;
+		while ( iRow<iCount && int ( pRows[iRow] >> PAGE_BITS )==iPage )
+		{
+			assert ( iRow==iStart || pRows[iRow-1]<=pRows[iRow] );
+			iRow++;
+		}
+
+		// untouched pages are shared with this snapshot
+		Page_t * pKilled = iRow>iStart ? KillPage ( pPage, pRows+iStart, iRow-iStart ) : NULL;
+		if ( !pKilled )
+		{
+			if ( pPage )
+				pPage->AddRef();
+			pNew->m_dPages[iPage] = pPage;
+			continue;
+		}
+
+		pNew->m_iDead += pKilled->m_iDead - ( pPage ? pPage->m_iDead : 0 );
+		pNew->m_dPages[iPage] = pKilled;
+		bChanged = true;
+	}
+	assert ( iRow==iCount );
+
+	if ( !bChanged )
+		SafeRelease ( pNew );
+	return pNew;
+}
+
+
+int64_t CSphDeadRows::GetLengthBytes () const
+{
+	int64_t iBytes = m_dPages.GetSizeBytes();
+	ARRAY_FOREACH ( i, m_dPages )
+		if ( m_dPages[i] )
+			iBytes += m_dPages[i]->m_dRows.GetSizeBytes() + m_dPages[i]->m_dBits.GetSizeBytes();
+	return iBytes;
+}
+
+
+/// rejects matches on rows deleted from the index
+/// checks the row that the match static part points to, so docinfo must be looked up before
+struct Filter_DeadRows : public ISphFilter
+{
+	const CSphDeadRows &	m_tDead;
+	const DWORD *			m_pRows;
+	int64_t					m_iRows;
+	int						m_iStride;
+
+	Filter_DeadRows ( const CSphDeadRows & tDead, const DWORD * pRows, int64_t iRows, int iStride )
+		: m_tDead ( tDead )
+		, m_pRows ( pRows )
+		, m_iRows ( iRows )
+		, m_iStride ( iStride )
+	{}
+
+	virtual bool Eval ( const CSphMatch & tMatch ) const
+	{
+		if ( !tMatch.m_pStatic )
+			return true;
+
+		const DWORD * pRow = STATIC2DOCINFO ( tMatch.m_pStatic );
+		if ( pRow<m_pRows )
+			return true;
+
+		int64_t iRow = ( pRow-m_pRows ) / m_iStride;
+		if ( iRow>=m_iRows || DOCINFO2ID ( pRow )!=tMatch.m_uDocID )
+			return true;
+
+		return !m_tDead.IsDead ( DWORD ( iRow ) );
+	}
+};
+
+
 const DWORD * CSphIndex_VLN::FindDocinfo ( SphDocID_t uDocID ) const
 {
 	if ( m_iDocinfo<=0 )
@@ -15337,6 +16076,20 @@ const DWORD * CSphIndex_VLN::FindDocinfo ( SphDocID_t uDocID ) const
 #define LOC_ROW(_index) &m_tAttr [ _index*iStride ]
 #define LOC_ID(_index) DOCINFO2ID(LOC_ROW(_index))
 
+	if ( m_pDocinfoDirect.GetLengthBytes() )
+	{
+		SphDocID_t uFirst = LOC_ID(0);
+		if ( uDocID<uFirst || uint64_t ( uDocID-uFirst )>=(uint64_t)m_pDocinfoDirect.GetNumEntries() )
+			return NULL;
+
+		DWORD uRow = m_pDocinfoDirect [ uDocID-uFirst ];
+		if ( !uRow )
+			return NULL;
+
+		int64_t iRow = uRow-1;
+		return LOC_ROW(iRow);
+	}
+
 	if ( m_pDocinfoHash.GetLengthBytes() )
 	{
 		SphDocID_t uFirst = LOC_ID(0);
@@ -15389,6 +16142,7 @@ void CSphIndex_VLN::CopyDocinfo ( const CSphQueryContext * pCtx, CSphMatch & tMa
 	// setup static pointer
 	assert ( DOCINFO2ID(pFound)==tMatch.m_uDocID );
 	tMatch.m_pStatic = DOCINFO2ATTRS(pFound);
+	pCtx->m_tStats.m_iDocinfoBytes += ( DOCINFO_IDSIZE + m_tSchema.GetRowSize() )*sizeof(DWORD);
 
 	// patch if necessary
 	if ( pCtx->m_pOverrides )
@@ -15442,6 +16196,79 @@ void CSphQueryContext::CalcFinal ( CSphMatch & tMatch ) const
 	CalcContextItems ( tMatch, m_dCalcFinal );
 }
 
+
+static void CalcContextItems ( CSphMatch * pMatches, int iCount, const CSphVector<CSphQueryContext::CalcItem_t> & dItems )
+{
+	if ( !dItems.GetLength() )
+		return;
+
+	// walk every expression tree once per batch rather than once per match
+	// items are computed in order, so dependent items still see their inputs
+	for ( int iBase=0; iBase<iCount; iBase+=SPH_EXPR_BATCH )
+	{
+		CSphMatch * pBatch = pMatches + iBase;
+		int iBatch = Min ( iCount-iBase, SPH_EXPR_BATCH );
+
+		ARRAY_FOREACH ( i, dItems )
+		{
+			const CSphQueryContext::CalcItem_t & tCalc = dItems[i];
+			if ( tCalc.m_eType==SPH_ATTR_INTEGER )
+			{
+				int dRes [ SPH_EXPR_BATCH ];
+				tCalc.m_pExpr->IntEvalBatch ( pBatch, iBatch, dRes );
+				for ( int j=0; j<iBatch; j++ )
+					pBatch[j].SetAttr ( tCalc.m_tLoc, dRes[j] );
+
+			} else if ( tCalc.m_eType==SPH_ATTR_BIGINT || tCalc.m_eType==SPH_ATTR_JSON_FIELD )
+			{
+				int64_t dRes [ SPH_EXPR_BATCH ];
+				tCalc.m_pExpr->Int64EvalBatch ( pBatch, iBatch, dRes );
+				for ( int j=0; j<iBatch; j++ )
+					pBatch[j].SetAttr ( tCalc.m_tLoc, dRes[j] );
+
+			} else if ( tCalc.m_eType==SPH_ATTR_STRINGPTR )
+			{
+				for ( int j=0; j<iBatch; j++ )
+				{
+					const BYTE * pStr = NULL;
+					tCalc.m_pExpr->StringEval ( pBatch[j], &pStr );
+					pBatch[j].SetAttr ( tCalc.m_tLoc, (SphAttr_t) pStr );
+				}
+
+			} else if ( tCalc.m_eType==SPH_ATTR_FACTORS || tCalc.m_eType==SPH_ATTR_FACTORS_JSON )
+			{
+				for ( int j=0; j<iBatch; j++ )
+					pBatch[j].SetAttr ( tCalc.m_tLoc, (SphAttr_t)tCalc.m_pExpr->FactorEval ( pBatch[j] ) );
+
+			} else
+			{
+				float dRes [ SPH_EXPR_BATCH ];
+				tCalc.m_pExpr->EvalBatch ( pBatch, iBatch, dRes );
+				for ( int j=0; j<iBatch; j++ )
+					pBatch[j].SetAttrFloat ( tCalc.m_tLoc, dRes[j] );
+			}
+		}
+	}
+}
+
+
+void CSphQueryContext::CalcFilter ( CSphMatch * pMatches, int iCount ) const
+{
+	CalcContextItems ( pMatches, iCount, m_dCalcFilter );
+}
+
+
+void CSphQueryContext::CalcSort ( CSphMatch * pMatches, int iCount ) const
+{
+	CalcContextItems ( pMatches, iCount, m_dCalcSort );
+}
+
+
+void CSphQueryContext::CalcFinal ( CSphMatch * pMatches, int iCount ) const
+{
+	CalcContextItems ( pMatches, iCount, m_dCalcFinal );
+}
+
 static inline void FreeStrItems ( CSphMatch & tMatch, const CSphVector<CSphQueryContext::CalcItem_t> & dItems )
 {
 	if ( !tMatch.m_pDynamic )
@@ -15592,8 +16419,41 @@ void CSphQueryContext::SetupExtraData ( ISphRanker * pRanker, ISphMatchSorter *
 }
 
 
+void sphSetStoredFields ( ISphMatchSorter ** ppSorters, int iSorters, ISphStoredFields * pFields )
+{
+	// walk sorter schemas rather than the context, as postlimit expressions only live there
+	for ( int i=0; i<iSorters; i++ )
+	{
+		const ISphSchema & tSchema = ppSorters[i]->GetSchema();
+		for ( int j=0; j<tSchema.GetAttrsCount(); j++ )
+		{
+			const CSphColumnInfo & tCol = tSchema.GetAttr(j);
+			if ( tCol.m_pExpr.Ptr() )
+				tCol.m_pExpr->Command ( SPH_EXPR_SET_STORED_FIELDS, pFields );
+		}
+	}
+}
+
+
+void CSphIndex_VLN::BindStoredFields ( int iSorters, ISphMatchSorter ** ppSorters, const CSphMultiQueryArgs & tArgs ) const
+{
+	// RT disk chunks get the snapshot of the whole RT index
+	if ( tArgs.m_pStoredFields )
+	{
+		sphSetStoredFields ( ppSorters, iSorters, tArgs.m_pStoredFields );
+		return;
+	}
+
+	ISphStoredFields * pFields = CreateStoredFields ( tArgs.m_pDeadRows );
+	if ( !pFields )
+		return;
+	sphSetStoredFields ( ppSorters, iSorters, pFields );
+	pFields->Release();
+}
+
+
 void CSphIndex_VLN::MatchExtended ( CSphQueryContext * pCtx, const CSphQuery * pQuery, int iSorters, ISphMatchSorter ** ppSorters,
-									ISphRanker * pRanker, int iTag, int iIndexWeight ) const
+									ISphRanker * pRanker, const ISphQwordSetup & tSetup, int iTag, int iIndexWeight ) const
 {
 	CSphQueryProfile * pProfile = pCtx->m_pProfile;
 
@@ -15601,64 +16461,151 @@ void CSphIndex_VLN::MatchExtended ( CSphQueryContext * pCtx, const CSphQuery * p
 	if ( iCutoff<=0 )
 		iCutoff = -1;
 
+	// ranker emits ascending docids; so with an ascending docid ordered sort key,
+	// once the sorter rejects a match, nothing that follows can make it into the sorter either
+	bool bEarlyDesc = false;
+	bool bEarlyStop = sphCanStopEarly ( pQuery, iSorters, ppSorters, m_dDocidOrdered, false, bEarlyDesc );
+
+	// descending keys are served by ranking docid windows from the tail backwards (skiplists let the ranker
+	// seek right to the window start), each window in the regular order; once a window is done and the sorter
+	// would reject the best of the remaining rows, no lower docid can make it either
+	// packed factors are tied to the ranker state, so those have to go the regular way
+	bool bWindows = bEarlyStop && bEarlyDesc && m_tSettings.m_eDocinfo==SPH_DOCINFO_EXTERN && m_iDocinfo>0
+		&& !( pCtx->m_uPackedFactorFlags & SPH_FACTOR_ENABLE );
+	bEarlyStop &= !bEarlyDesc;
+
+	DWORD uStride = DOCINFO_IDSIZE + m_tSchema.GetRowSize();
+	int64_t iWindowRows = (int64_t)Max ( pQuery->m_iMaxMatches, 1 )*4;
+	int64_t iWindowStart = 0;
+	int64_t iWindowEnd = m_iDocinfo;
+	SphDocID_t uWindowMin = 0;
+	SphDocID_t uWindowMax = DOCID_MAX; // exclusive
+
 	// do searching
 	CSphMatch * pMatch = pRanker->GetMatchesBuffer();
 	for ( ;; )
 	{
-		// ranker does profile switches internally
-		int iMatches = pRanker->GetMatches();
-		if ( iMatches<=0 )
-			break;
+		if ( bWindows )
+		{
+			iWindowStart = Max ( iWindowEnd-iWindowRows, 0 );
+			uWindowMin = iWindowStart ? DOCINFO2ID ( m_tAttr.GetWritePtr() + iWindowStart*uStride ) : 0;
+			uWindowMax = iWindowEnd<m_iDocinfo ? DOCINFO2ID ( m_tAttr.GetWritePtr() + iWindowEnd*uStride ) : DOCID_MAX;
+			if ( uWindowMin )
+				pRanker->HintDocid ( uWindowMin );
+		}
 
-		if ( pProfile )
-			pProfile->Switch ( SPH_QSTATE_SORT );
-		for ( int i=0; i<iMatches; i++ )
+		bool bWindowDone = false;
+		while ( !bWindowDone )
 		{
-			if ( pCtx->m_bLookupSort )
-				CopyDocinfo ( pCtx, pMatch[i], FindDocinfo ( pMatch[i].m_uDocID ) );
+			// ranker does profile switches internally
+			int iMatches = pRanker->GetMatches();
+			if ( iMatches<=0 )
+				break;
 
-			pMatch[i].m_iWeight *= iIndexWeight;
-			pCtx->CalcSort ( pMatch[i] );
+			// clip the batch to the current window
+			int iFirst = 0;
+			if ( bWindows )
+			{
+				while ( iFirst<iMatches && pMatch[iFirst].m_uDocID<uWindowMin )
+					iFirst++;
+				int iLast = iFirst;
+				while ( iLast<iMatches && pMatch[iLast].m_uDocID<uWindowMax )
+					iLast++;
+				bWindowDone = ( iLast<iMatches );
+				iMatches = iLast;
+			}
 
-			if ( pCtx->m_pWeightFilter && !pCtx->m_pWeightFilter->Eval ( pMatch[i] ) )
+			if ( pProfile )
+				pProfile->Switch ( SPH_QSTATE_SORT );
+			for ( int i=iFirst; i<iMatches; i++ )
 			{
-				pCtx->FreeStrSort ( pMatch[i] );
-				continue;
+				if ( pCtx->m_bLookupSort )
+					CopyDocinfo ( pCtx, pMatch[i], FindDocinfo ( pMatch[i].m_uDocID ) );
+
+				pMatch[i].m_iWeight *= iIndexWeight;
 			}
 
-			pMatch[i].m_iTag = iTag;
+			// compute sort-stage expressions over the whole ranker batch at once
+			pCtx->CalcSort ( pMatch+iFirst, iMatches-iFirst );
 
-			bool bRand = false;
-			bool bNewMatch = false;
-			for ( int iSorter=0; iSorter<iSorters; iSorter++ )
+			if ( pCtx->m_pWeightFilter )
+				pCtx->m_tStats.m_iFilterEvals += iMatches-iFirst;
+
+			for ( int i=iFirst; i<iMatches; i++ )
 			{
-				// all non-random sorters are in the beginning,
-				// so we can avoid the simple 'first-element' assertion
-				if ( !bRand && ppSorters[iSorter]->m_bRandomize )
+				if ( pCtx->m_pWeightFilter && !pCtx->m_pWeightFilter->Eval ( pMatch[i] ) )
 				{
-					bRand = true;
-					pMatch[i].m_iWeight = ( sphRand() & 0xffff ) * iIndexWeight;
+					pCtx->FreeStrSort ( pMatch[i] );
+					continue;
+				}
 
-					if ( pCtx->m_pWeightFilter && !pCtx->m_pWeightFilter->Eval ( pMatch[i] ) )
-						break;
+				pMatch[i].m_iTag = iTag;
+
+				if ( bEarlyStop && ppSorters[0]->WouldReject ( pMatch[i] ) )
+				{
+					for ( int j=i; j<iMatches; j++ )
+						pCtx->FreeStrSort ( pMatch[j] );
+					iCutoff = 0;
+					break;
 				}
-				bNewMatch |= ppSorters[iSorter]->Push ( pMatch[i] );
 
-				if ( pCtx->m_uPackedFactorFlags & SPH_FACTOR_ENABLE )
+				pCtx->m_tStats.m_iPushedMatches++;
+
+				bool bRand = false;
+				bool bNewMatch = false;
+				for ( int iSorter=0; iSorter<iSorters; iSorter++ )
 				{
-					pRanker->ExtraData ( EXTRA_SET_MATCHPUSHED, (void**)&(ppSorters[iSorter]->m_iJustPushed) );
-					pRanker->ExtraData ( EXTRA_SET_MATCHPOPPED, (void**)&(ppSorters[iSorter]->m_dJustPopped) );
+					// all non-random sorters are in the beginning,
+					// so we can avoid the simple 'first-element' assertion
+					if ( !bRand && ppSorters[iSorter]->m_bRandomize )
+					{
+						bRand = true;
+						pMatch[i].m_iWeight = ( sphRand() & 0xffff ) * iIndexWeight;
+
+						if ( pCtx->m_pWeightFilter && !pCtx->m_pWeightFilter->Eval ( pMatch[i] ) )
+							break;
+					}
+					bNewMatch |= ppSorters[iSorter]->Push ( pMatch[i] );
+
+					if ( pCtx->m_uPackedFactorFlags & SPH_FACTOR_ENABLE )
+					{
+						pRanker->ExtraData ( EXTRA_SET_MATCHPUSHED, (void**)&(ppSorters[iSorter]->m_iJustPushed) );
+						pRanker->ExtraData ( EXTRA_SET_MATCHPOPPED, (void**)&(ppSorters[iSorter]->m_dJustPopped) );
+					}
 				}
+				pCtx->FreeStrSort ( pMatch[i] );
+
+				if ( bNewMatch )
+					if ( --iCutoff==0 )
+					{
+						// the rest of the batch was computed ahead, release it
+						for ( int j=i+1; j<iMatches; j++ )
+							pCtx->FreeStrSort ( pMatch[j] );
+						break;
+					}
 			}
-			pCtx->FreeStrSort ( pMatch[i] );
 
-			if ( bNewMatch )
-				if ( --iCutoff==0 )
-					break;
+			if ( iCutoff==0 )
+				break;
 		}
 
-		if ( iCutoff==0 )
+		if ( !bWindows || iCutoff==0 || !iWindowStart )
+			break;
+
+		// the row right below the window is the best one left; stop if even that one can not make it
+		CSphMatch tBest;
+		const CSphRowitem * pBest = m_tAttr.GetWritePtr() + ( iWindowStart-1 )*uStride;
+		tBest.m_uDocID = DOCINFO2ID ( pBest );
+		tBest.m_pStatic = DOCINFO2ATTRS ( pBest );
+		bool bDone = ppSorters[0]->WouldReject ( tBest );
+		tBest.m_pStatic = NULL;
+		if ( bDone )
 			break;
+
+		// next window is twice as long, and goes from scratch
+		iWindowEnd = iWindowStart;
+		iWindowRows *= 2;
+		pRanker->Reset ( tSetup );
 	}
 
 	if ( pProfile )
@@ -15694,6 +16641,60 @@ struct SphFinalMatchCalc_t : ISphMatchProcessor, ISphNoncopyable
 };
 
 
+/// filter a filled batch of fullscan matches, and push the survivors to sorters
+/// early filter only (no late filters in full-scan because of no @weight); decrements iCutoff on new matches
+/// with bEarlyStop, zeroes iCutoff once the sorter rejects a match (matches only get worse along the scan then)
+static void ScanPushBatch ( CSphQueryContext & tCtx, CSphMatch * pBatch, int iBatch, bool bRandomize, int iIndexWeight,
+	int iSorters, ISphMatchSorter ** ppSorters, int & iCutoff, bool bEarlyStop )
+{
+	// survivors get compacted to the batch head
+	tCtx.CalcFilter ( pBatch, iBatch );
+	if ( tCtx.m_pFilter )
+		tCtx.m_tStats.m_iFilterEvals += iBatch;
+	int iPassed = 0;
+	for ( int i=0; i<iBatch; i++ )
+	{
+		if ( tCtx.m_pFilter && !tCtx.m_pFilter->Eval ( pBatch[i] ) )
+		{
+			tCtx.FreeStrFilter ( pBatch[i] );
+			continue;
+		}
+
+		if ( bRandomize )
+			pBatch[i].m_iWeight = ( sphRand() & 0xffff ) * iIndexWeight;
+
+		if ( i!=iPassed )
+			Swap ( pBatch[i], pBatch[iPassed] );
+		iPassed++;
+	}
+
+	// submit matches to sorters
+	tCtx.CalcSort ( pBatch, iPassed );
+
+	for ( int i=0; i<iPassed; i++ )
+	{
+		if ( bEarlyStop && iCutoff!=0 && ppSorters[0]->WouldReject ( pBatch[i] ) )
+			iCutoff = 0;
+
+		bool bNewMatch = false;
+		if ( iCutoff!=0 )
+		{
+			tCtx.m_tStats.m_iPushedMatches++;
+			for ( int iSorter=0; iSorter<iSorters; iSorter++ )
+				bNewMatch |= ppSorters[iSorter]->Push ( pBatch[i] );
+		}
+
+		// stringptr expressions should be duplicated (or taken over) at this point
+		tCtx.FreeStrFilter ( pBatch[i] );
+		tCtx.FreeStrSort ( pBatch[i] );
+
+		// handle cutoff
+		if ( bNewMatch )
+			--iCutoff;
+	}
+}
+
+
 bool CSphIndex_VLN::MultiScan ( const CSphQuery * pQuery, CSphQueryResult * pResult,
 	int iSorters, ISphMatchSorter ** ppSorters, const CSphMultiQueryArgs & tArgs ) const
 {
@@ -15746,12 +16747,19 @@ bool CSphIndex_VLN::MultiScan ( const CSphQuery * pQuery, CSphQueryResult * pRes
 
 	// set string pool for string on_sort expression fix up
 	tCtx.SetStringPool ( m_tString.GetWritePtr() );
+	BindStoredFields ( iSorters, ppSorters, tArgs );
 
 	// setup filters
 	if ( !tCtx.CreateFilters ( true, &pQuery->m_dFilters, ppSorters[iMaxSchemaIndex]->GetSchema(),
 								m_tMva.GetWritePtr(), m_tString.GetWritePtr(), pResult->m_sError, pQuery->m_eCollation, m_bArenaProhibit, tArgs.m_dKillList ) )
 		return false;
 
+	// skip deleted rows
+	const CSphDeadRows * pDeadRows = tArgs.m_pDeadRows;
+	bool bDeadRows = ( pDeadRows && pDeadRows->GetDead()>0 );
+	if ( bDeadRows )
+		tCtx.m_pFilter = sphJoinFilters ( tCtx.m_pFilter, new Filter_DeadRows ( *pDeadRows, m_tAttr.GetWritePtr(), m_iDocinfo, DOCINFO_IDSIZE + m_tSchema.GetRowSize() ) );
+
 	// check if we can early reject the whole index
 	if ( tCtx.m_pFilter && m_iDocinfoIndex )
 	{
@@ -15789,11 +16797,25 @@ bool CSphIndex_VLN::MultiScan ( const CSphQuery * pQuery, CSphQueryResult * pRes
 	tMatch.m_iWeight = tArgs.m_iIndexWeight;
 	tMatch.m_iTag = tCtx.m_dCalcFinal.GetLength() ? -1 : tArgs.m_iTag;
 
+	CSphFixedVector<CSphMatch> dBatch ( SPH_EXPR_BATCH );
+	ARRAY_FOREACH ( i, dBatch )
+	{
+		dBatch[i].Reset ( ppSorters[iMaxSchemaIndex]->GetSchema().GetDynamicSize() );
+		dBatch[i].m_iWeight = tMatch.m_iWeight;
+		dBatch[i].m_iTag = tMatch.m_iTag;
+	}
+
 	if ( pResult->m_pProfile )
 		pResult->m_pProfile->Switch ( SPH_QSTATE_FULLSCAN );
 
+	// sorting by a docid ordered attribute lets us scan in the order the matches only get worse, and stop early
+	bool bEarlyDesc = false;
+	bool bEarlyStop = sphCanStopEarly ( pQuery, iSorters, ppSorters, m_dDocidOrdered, true, bEarlyDesc );
+
 	// optimize direct lookups by id
+	// scan candidate rows only when JSON secondary indexes can serve some filters
 	// run full scan with block and row filtering for everything else
+	CSphVector<DWORD> dCandidates;
 	if ( pQuery->m_dFilters.GetLength()==1
 		&& pQuery->m_dFilters[0].m_eType==SPH_FILTER_VALUES
 		&& pQuery->m_dFilters[0].m_bExclude==false
@@ -15801,6 +16823,7 @@ bool CSphIndex_VLN::MultiScan ( const CSphQuery * pQuery, CSphQueryResult * pRes
 		&& tArgs.m_dKillList.GetLength()==0 )
 	{
 		// run id lookups
+		DWORD uStride = DOCINFO_IDSIZE + m_tSchema.GetRowSize();
 		for ( int i=0; i<pQuery->m_dFilters[0].GetNumValues(); i++ )
 		{
 			pResult->m_tStats.m_iFetchedDocs++;
@@ -15810,6 +16833,9 @@ bool CSphIndex_VLN::MultiScan ( const CSphQuery * pQuery, CSphQueryResult * pRes
 			if ( !pRow )
 				continue;
 
+			if ( bDeadRows && pDeadRows->IsDead ( DWORD ( ( pRow-m_tAttr.GetWritePtr() ) / uStride ) ) )
+				continue;
+
 			assert ( uDocid==DOCINFO2ID(pRow) );
 			tMatch.m_uDocID = uDocid;
 			CopyDocinfo ( &tCtx, tMatch, pRow );
@@ -15820,15 +16846,36 @@ bool CSphIndex_VLN::MultiScan ( const CSphQuery * pQuery, CSphQueryResult * pRes
 			// submit match to sorters
 			tCtx.CalcSort ( tMatch );
 
+			tCtx.m_tStats.m_iPushedMatches++;
 			for ( int iSorter=0; iSorter<iSorters; iSorter++ )
 				ppSorters[iSorter]->Push ( tMatch );
 
 			// stringptr expressions should be duplicated (or taken over) at this point
 			tCtx.FreeStrSort ( tMatch );
 		}
+	} else if ( sphJsonIndexCandidates ( m_dJsonIndexes, pQuery, dCandidates ) )
+	{
+		bool bReverse = bEarlyStop ? bEarlyDesc : pQuery->m_bReverseScan;
+		int iCutoff = ( pQuery->m_iCutoff<=0 ) ? -1 : pQuery->m_iCutoff;
+		DWORD uStride = DOCINFO_IDSIZE + m_tSchema.GetRowSize();
+
+		int iCandidate = 0;
+		while ( iCandidate<dCandidates.GetLength() && iCutoff!=0 )
+		{
+			int iBatch = 0;
+			for ( ; iBatch<SPH_EXPR_BATCH && iCandidate<dCandidates.GetLength(); iBatch++, iCandidate++ )
+			{
+				DWORD uRow = dCandidates [ bReverse ? dCandidates.GetLength()-1-iCandidate : iCandidate ];
+				const DWORD * pDocinfo = m_tAttr.GetWritePtr() + (int64_t)uRow*uStride;
+				dBatch[iBatch].m_uDocID = DOCINFO2ID ( pDocinfo );
+				CopyDocinfo ( &tCtx, dBatch[iBatch], pDocinfo );
+			}
+			pResult->m_tStats.m_iFetchedDocs += iBatch;
+			ScanPushBatch ( tCtx, dBatch.Begin(), iBatch, bRandomize, tArgs.m_iIndexWeight, iSorters, ppSorters, iCutoff, bEarlyStop );
+		}
 	} else
 	{
-		bool bReverse = pQuery->m_bReverseScan; // shortcut
+		bool bReverse = bEarlyStop ? bEarlyDesc : pQuery->m_bReverseScan;
 		int iCutoff = ( pQuery->m_iCutoff<=0 ) ? -1 : pQuery->m_iCutoff;
 
 		DWORD uStride = DOCINFO_IDSIZE + m_tSchema.GetRowSize();
@@ -15853,7 +16900,7 @@ bool CSphIndex_VLN::MultiScan ( const CSphQuery * pQuery, CSphQueryResult * pRes
 			}
 			int iDocinfoStep = bReverse ? -(int)uStride : (int)uStride;
 
-			if ( !tCtx.m_pOverrides && tCtx.m_pFilter && !pQuery->m_iCutoff && !tCtx.m_dCalcFilter.GetLength() && !tCtx.m_dCalcSort.GetLength() )
+			if ( !tCtx.m_pOverrides && tCtx.m_pFilter && !pQuery->m_iCutoff && !tCtx.m_dCalcFilter.GetLength() && !tCtx.m_dCalcSort.GetLength() && !bEarlyStop )
 			{
 				// kinda fastpath
 				for ( const DWORD * pDocinfo=pBlockStart; pDocinfo!=pBlockEnd; pDocinfo+=iDocinfoStep )
@@ -15861,11 +16908,14 @@ bool CSphIndex_VLN::MultiScan ( const CSphQuery * pQuery, CSphQueryResult * pRes
 					pResult->m_tStats.m_iFetchedDocs++;
 					tMatch.m_uDocID = DOCINFO2ID ( pDocinfo );
 					tMatch.m_pStatic = DOCINFO2ATTRS ( pDocinfo );
+					tCtx.m_tStats.m_iDocinfoBytes += uStride*sizeof(DWORD);
+					tCtx.m_tStats.m_iFilterEvals++;
 
 					if ( tCtx.m_pFilter->Eval ( tMatch ) )
 					{
 						if ( bRandomize )
 							tMatch.m_iWeight = ( sphRand() & 0xffff ) * tArgs.m_iIndexWeight;
+						tCtx.m_tStats.m_iPushedMatches++;
 						for ( int iSorter=0; iSorter<iSorters; iSorter++ )
 							ppSorters[iSorter]->Push ( tMatch );
 					}
@@ -15875,41 +16925,22 @@ bool CSphIndex_VLN::MultiScan ( const CSphQuery * pQuery, CSphQueryResult * pRes
 			} else
 			{
 				// generic path
-				for ( const DWORD * pDocinfo=pBlockStart; pDocinfo!=pBlockEnd; pDocinfo+=iDocinfoStep )
+				// rows are processed in batches, so that expressions get evaluated over whole arrays of matches
+				const DWORD * pDocinfo = pBlockStart;
+				while ( pDocinfo!=pBlockEnd && iCutoff!=0 )
 				{
-					pResult->m_tStats.m_iFetchedDocs++;
-					tMatch.m_uDocID = DOCINFO2ID ( pDocinfo );
-					CopyDocinfo ( &tCtx, tMatch, pDocinfo );
-
-					// early filter only (no late filters in full-scan because of no @weight)
-					tCtx.CalcFilter ( tMatch );
-					if ( tCtx.m_pFilter && !tCtx.m_pFilter->Eval ( tMatch ) )
-					{
-						tCtx.FreeStrFilter ( tMatch );
-						continue;
-					}
-
-					if ( bRandomize )
-						tMatch.m_iWeight = ( sphRand() & 0xffff ) * tArgs.m_iIndexWeight;
-
-					// submit match to sorters
-					tCtx.CalcSort ( tMatch );
-
-					bool bNewMatch = false;
-					for ( int iSorter=0; iSorter<iSorters; iSorter++ )
-						bNewMatch |= ppSorters[iSorter]->Push ( tMatch );
-
-					// stringptr expressions should be duplicated (or taken over) at this point
-					tCtx.FreeStrFilter ( tMatch );
-					tCtx.FreeStrSort ( tMatch );
-
-					// handle cutoff
-					if ( bNewMatch && --iCutoff==0 )
+					int iBatch = 0;
+					for ( ; iBatch<SPH_EXPR_BATCH && pDocinfo!=pBlockEnd; iBatch++, pDocinfo+=iDocinfoStep )
 					{
-						iIndexEntry = iEnd - iStep; // outer break
-						break;
+						dBatch[iBatch].m_uDocID = DOCINFO2ID ( pDocinfo );
+						CopyDocinfo ( &tCtx, dBatch[iBatch], pDocinfo );
 					}
+					pResult->m_tStats.m_iFetchedDocs += iBatch;
+					ScanPushBatch ( tCtx, dBatch.Begin(), iBatch, bRandomize, tArgs.m_iIndexWeight, iSorters, ppSorters, iCutoff, bEarlyStop );
 				}
+
+				if ( iCutoff==0 )
+					break;
 			}
 		}
 	}
@@ -15933,6 +16964,7 @@ bool CSphIndex_VLN::MultiScan ( const CSphQuery * pQuery, CSphQueryResult * pRes
 	pResult->m_pStrings = m_tString.GetWritePtr();
 	pResult->m_bArenaProhibit = m_bArenaProhibit;
 	pResult->m_iQueryTime += (int)( ( sphMicroTimer()-tmQueryStart )/1000 );
+	pResult->m_tStats.Add ( tCtx.m_tStats );
 	return true;
 }
 
@@ -15947,10 +16979,10 @@ ISphQword * DiskIndexQwordSetup_c::QwordSpawn ( const XQKeyword_t & tWord ) cons
 	{
 		if ( m_pIndex->GetSettings().m_eHitFormat==SPH_HIT_FORMAT_INLINE )
 		{
-			return new DiskPayloadQword_c<true> ( (const DiskSubstringPayload_t *)tWord.m_pPayload, tWord.m_bExcluded, m_tDoclist, m_tHitlist, m_pProfile );
+			return new DiskPayloadQword_c<true> ( (const DiskSubstringPayload_t *)tWord.m_pPayload, tWord.m_bExcluded, m_tDoclist, m_tHitlist, m_pProfile, m_pStats );
 		} else
 		{
-			return new DiskPayloadQword_c<false> ( (const DiskSubstringPayload_t *)tWord.m_pPayload, tWord.m_bExcluded, m_tDoclist, m_tHitlist, m_pProfile );
+			return new DiskPayloadQword_c<false> ( (const DiskSubstringPayload_t *)tWord.m_pPayload, tWord.m_bExcluded, m_tDoclist, m_tHitlist, m_pProfile, m_pStats );
 		}
 	}
 	return NULL;
@@ -16080,6 +17112,7 @@ bool DiskIndexQwordSetup_c::Setup ( ISphQword * pWord ) const
 		tWord.m_rdDoclist.SetFile ( m_tDoclist );
 		tWord.m_rdDoclist.m_pProfile = m_pProfile;
 		tWord.m_rdDoclist.m_eProfileState = SPH_QSTATE_READ_DOCS;
+		tWord.m_rdDoclist.m_pStatBytes = m_pStats ? &m_pStats->m_iDoclistBytes : NULL;
 
 		// read in skiplist
 		// OPTIMIZE? maybe cache hot decompressed lists?
@@ -16109,6 +17142,7 @@ bool DiskIndexQwordSetup_c::Setup ( ISphQword * pWord ) const
 		tWord.m_rdHitlist.SetFile ( m_tHitlist );
 		tWord.m_rdHitlist.m_pProfile = m_pProfile;
 		tWord.m_rdHitlist.m_eProfileState = SPH_QSTATE_READ_HITS;
+		tWord.m_rdHitlist.m_pStatBytes = m_pStats ? &m_pStats->m_iHitlistBytes : NULL;
 	}
 
 	return true;
@@ -16186,12 +17220,15 @@ void CSphIndex_VLN::Dealloc ()
 	m_tDoclistFile.Close ();
 	m_tHitlistFile.Close ();
 	m_pDocinfoHash.Reset ();
+	m_pDocinfoDirect.Reset ();
 	m_dAttrShared.Reset ();
 	m_dMvaShared.Reset ();
 	m_dStringShared.Reset ();
 	m_pKillList.Reset ();
 	m_tWordlist.Reset ();
+	m_pExpansionCache->Invalidate ();
 	m_pSkiplists.Reset ();
+	m_tDocstore.Reset ();
 	m_dAttrMapped.Close();
 	m_dMvaMapped.Close();
 	m_dStringMapped.Close();
@@ -16305,6 +17342,14 @@ void LoadIndexSettings ( CSphIndexSettings & tSettings, CSphReader & tReader, DW
 
 	if ( uVersion>=41 )
 		tSettings.m_sIndexTokenFilter = tReader.GetString();
+
+	tSettings.m_dStoredFields.Reset();
+	if ( uVersion>=43 )
+	{
+		tSettings.m_dStoredFields.Resize ( tReader.GetDword() );
+		ARRAY_FOREACH ( i, tSettings.m_dStoredFields )
+			tSettings.m_dStoredFields[i] = tReader.GetString();
+	}
 }
 
 
@@ -17200,6 +18245,11 @@ bool CSphIndex_VLN::Prealloc ( bool bMlock, bool bStripPath, CSphString & sWarni
 			return false;
 	}
 
+	// open document storage
+	if ( m_uVersion>=43 && m_tSettings.m_dStoredFields.GetLength() )
+		if ( !m_tDocstore.Load ( GetIndexFileName("spds"), m_sLastError ) )
+			return false;
+
 	bool bWordDict = false;
 	if ( m_pDict )
 		bWordDict = m_pDict->GetSettings().m_bWordDict;
@@ -17308,6 +18358,12 @@ bool CSphIndex_VLN::Preread ()
 	if ( !PrereadSharedBuffer ( m_tWordlist.m_pBuf, "spi" ) )
 		return false;
 
+	if ( m_bInfixTrigrams )
+	{
+		sphLogDebug ( "Building infix trigrams" );
+		m_tWordlist.BuildTrigrams();
+	}
+
 	m_tProgress.Show ( true );
 
 	//////////////////////
@@ -17341,16 +18397,45 @@ bool CSphIndex_VLN::Preread ()
 		sphWarning ( "id32 index loaded by id64 binary; attributes converted" );
 	}
 
-	// build attributes hash
-	if ( m_tAttr.GetLengthBytes() && m_pDocinfoHash.GetLengthBytes() && !g_bDebugCheck )
+	// build direct docid lookup map, but only if ids are dense enough for the map to take
+	// at most half of what the rows take; lookups become a single load instead of hash+search
+	if ( m_tAttr.GetLengthBytes() && m_pDocinfoDirect.IsEmpty() && m_iDocinfo>0 && m_iDocinfo<UINT_MAX && !g_bDebugCheck )
 	{
-		sphLogDebug ( "Hashing docinfo" );
-		assert ( CheckDocsCount ( m_iDocinfo, m_sLastError ) );
 		int iStride = DOCINFO_IDSIZE + m_tSchema.GetRowSize();
 		SphDocID_t uFirst = DOCINFO2ID ( &m_tAttr[0] );
-		SphDocID_t uRange = DOCINFO2ID ( &m_tAttr[ ( m_iDocinfo-1)*iStride ] ) - uFirst;
-		DWORD iShift = 0;
-		while ( uRange>=( 1 << DOCINFO_HASH_BITS ) )
+		uint64_t uSlots = uint64_t ( DOCINFO2ID ( &m_tAttr[ ( m_iDocinfo-1 )*iStride ] ) - uFirst ) + 1;
+
+		if ( uSlots*2<=uint64_t ( m_iDocinfo*iStride ) )
+		{
+			sphLogDebug ( "Mapping docinfo" );
+			CSphString sWarning;
+			if ( !m_pDocinfoDirect.Alloc ( uSlots, m_sLastError, sWarning ) )
+				return false;
+
+			DWORD * pMap = m_pDocinfoDirect.GetWritePtr();
+			memset ( pMap, 0, m_pDocinfoDirect.GetLengthBytes() );
+			for ( int64_t i=0; i<m_iDocinfo; i++ )
+			{
+				uint64_t uSlot = uint64_t ( DOCINFO2ID ( &m_tAttr[ i*iStride ] ) - uFirst );
+				if ( uSlot<uSlots ) // might not hold on broken (unsorted) data
+					pMap[uSlot] = (DWORD)( i+1 );
+			}
+
+			// hash is not needed anymore
+			m_pDocinfoHash.Reset();
+		}
+	}
+
+	// build attributes hash
+	if ( m_tAttr.GetLengthBytes() && m_pDocinfoHash.GetLengthBytes() && !g_bDebugCheck )
+	{
+		sphLogDebug ( "Hashing docinfo" );
+		assert ( CheckDocsCount ( m_iDocinfo, m_sLastError ) );
+		int iStride = DOCINFO_IDSIZE + m_tSchema.GetRowSize();
+		SphDocID_t uFirst = DOCINFO2ID ( &m_tAttr[0] );
+		SphDocID_t uRange = DOCINFO2ID ( &m_tAttr[ ( m_iDocinfo-1)*iStride ] ) - uFirst;
+		DWORD iShift = 0;
+		while ( uRange>=( 1 << DOCINFO_HASH_BITS ) )
 		{
 			iShift++;
 			uRange >>= 1;
@@ -17387,6 +18472,27 @@ bool CSphIndex_VLN::Preread ()
 	if ( m_uVersion < 20 && !PrecomputeMinMax() )
 		return false;
 
+	// build JSON secondary indexes
+	if ( m_dJsonIndexPaths.GetLength() && m_iDocinfo>0 && m_tAttr.GetLengthBytes() )
+	{
+		sphLogDebug ( "Building JSON secondary indexes" );
+		CSphString sWarning;
+		sphBuildJsonIndexes ( m_dJsonIndexes, m_dJsonIndexPaths, m_tSchema, m_tAttr.GetWritePtr(), m_iDocinfo,
+			DOCINFO_IDSIZE + m_tSchema.GetRowSize(), m_tString.GetWritePtr(), sWarning );
+		if ( !sWarning.IsEmpty() )
+			sphWarning ( "index '%s': %s", m_sIndexName.cstr(), sWarning.cstr() );
+	}
+
+	// verify docid ordered attributes
+	if ( m_dDocidOrderedAttrs.GetLength() )
+	{
+		CSphString sWarning;
+		sphCheckDocidOrderedAttrs ( m_dDocidOrdered, m_dDocidOrderedAttrs, m_tSchema, m_tAttr.GetWritePtr(), m_iDocinfo,
+			DOCINFO_IDSIZE + m_tSchema.GetRowSize(), sWarning );
+		if ( !sWarning.IsEmpty() )
+			sphWarning ( "index '%s': %s", m_sIndexName.cstr(), sWarning.cstr() );
+	}
+
 	// paranoid MVA verification
 #if PARANOID
 	// find out what attrs are MVA
@@ -17473,6 +18579,8 @@ bool CSphIndex_VLN::Rename ( const char * sNewBase )
 			continue;
 		if ( !strcmp ( sExt, ".spe" ) && m_uVersion<31 ) // .spe files are v31+
 			continue;
+		if ( !strcmp ( sExt, ".spds" ) && m_uVersion<43 ) // .spds files are v43+
+			continue;
 
 #if !USE_WINDOWS
 		if ( !strcmp ( sExt, ".spl" ) && m_iLockFD<0 ) // .spl files are locks
@@ -18380,6 +19488,28 @@ static void BuildExpandedTree ( const XQKeyword_t & tRootWord, ISphWordlist::Arg
 }
 
 
+/// fetch wordlist expansions for a wildcard, going through the index expansion cache
+static void GetExpandedWords ( ExpansionContext_t & tCtx, bool bPrefix, const char * sSubstring, int iSubLen,
+	const char * sWildcard, const char * sFull, ISphWordlist::Args_t & tArgs )
+{
+	CSphString sKey;
+	if ( tCtx.m_pCache && tCtx.m_pCache->IsEnabled() )
+	{
+		sKey.SetSprintf ( "%c%d:%d:%s", bPrefix ? 'p' : 'i', (int)tArgs.m_bPayload, tArgs.m_iExpansionLimit, sFull );
+		if ( tCtx.m_pCache->Lookup ( sKey, tCtx.m_iCacheGeneration, tArgs ) )
+			return;
+	}
+
+	if ( bPrefix )
+		tCtx.m_pWordlist->GetPrefixedWords ( sSubstring, iSubLen, sWildcard, tArgs );
+	else
+		tCtx.m_pWordlist->GetInfixedWords ( sSubstring, iSubLen, sWildcard, tArgs );
+
+	if ( !sKey.IsEmpty() )
+		tCtx.m_pCache->Store ( sKey, tCtx.m_iCacheGeneration, tArgs );
+}
+
+
 /// do wildcard expansion for keywords dictionary
 /// (including prefix and infix expansion)
 XQNode_t * sphExpandXQNode ( XQNode_t * pNode, ExpansionContext_t & tCtx )
@@ -18482,7 +19612,7 @@ XQNode_t * sphExpandXQNode ( XQNode_t * pNode, ExpansionContext_t & tCtx )
 			iPrefix++;
 		}
 
-		tCtx.m_pWordlist->GetPrefixedWords ( sPrefix, iPrefix, sWildcard, tWordlist );
+		GetExpandedWords ( tCtx, true, sPrefix, iPrefix, sWildcard, sFull, tWordlist );
 
 	} else
 	{
@@ -18512,7 +19642,7 @@ XQNode_t * sphExpandXQNode ( XQNode_t * pNode, ExpansionContext_t & tCtx )
 			return pNode;
 
 		// ignore heading star
-		tCtx.m_pWordlist->GetInfixedWords ( sMaxInfix, iMaxInfix, sFull, tWordlist );
+		GetExpandedWords ( tCtx, false, sMaxInfix, iMaxInfix, sFull, sFull, tWordlist );
 	}
 
 	// no real expansions?
@@ -18580,6 +19710,8 @@ ExpansionContext_t::ExpansionContext_t()
 	, m_pPayloads ( NULL )
 	, m_eHitless ( SPH_HITLESS_NONE )
 	, m_pIndexData ( NULL )
+	, m_pCache ( NULL )
+	, m_iCacheGeneration ( 0 )
 {}
 
 
@@ -18601,6 +19733,8 @@ XQNode_t * CSphIndex_VLN::ExpandPrefix ( XQNode_t * pNode, CSphQueryResultMeta *
 	tCtx.m_bMergeSingles = ( m_tSettings.m_eDocinfo!=SPH_DOCINFO_INLINE );
 	tCtx.m_pPayloads = pPayloads;
 	tCtx.m_eHitless = m_tSettings.m_eHitless;
+	tCtx.m_pCache = m_pExpansionCache;
+	tCtx.m_iCacheGeneration = m_pExpansionCache->GetGeneration();
 
 	pNode = sphExpandXQNode ( pNode, tCtx );
 	pNode->Check ( true );
@@ -19205,6 +20339,7 @@ bool CSphIndex_VLN::ParsedMultiQuery ( const CSphQuery * pQuery, CSphQueryResult
 
 	// set string pool for string on_sort expression fix up
 	tCtx.SetStringPool ( m_tString.GetWritePtr() );
+	BindStoredFields ( iSorters, ppSorters, tArgs );
 
 	tCtx.m_uPackedFactorFlags = tArgs.m_uPackedFactorFlags;
 
@@ -19248,13 +20383,13 @@ bool CSphIndex_VLN::ParsedMultiQuery ( const CSphQuery * pQuery, CSphQueryResult
 	tTermSetup.m_pCtx = &tCtx;
 	tTermSetup.m_pNodeCache = pNodeCache;
 
-	// setup prediction constrain
-	CSphQueryStats tQueryStats;
+	// setup work counters and prediction constrain
+	CSphQueryStats & tQueryStats = tCtx.m_tStats;
 	bool bCollectPredictionCounters = ( pQuery->m_iMaxPredictedMsec>0 );
 	int64_t iNanoBudget = (int64_t)(pQuery->m_iMaxPredictedMsec) * 1000000; // from milliseconds to nanoseconds
-	tQueryStats.m_pNanoBudget = &iNanoBudget;
 	if ( bCollectPredictionCounters )
-		tTermSetup.m_pStats = &tQueryStats;
+		tQueryStats.m_pNanoBudget = &iNanoBudget;
+	tTermSetup.m_pStats = &tQueryStats;
 
 	// bind weights
 	tCtx.BindWeights ( pQuery, m_tSchema );
@@ -19302,6 +20437,12 @@ bool CSphIndex_VLN::ParsedMultiQuery ( const CSphQuery * pQuery, CSphQueryResult
 								m_tMva.GetWritePtr(), m_tString.GetWritePtr(), pResult->m_sError, pQuery->m_eCollation, m_bArenaProhibit, tArgs.m_dKillList ) )
 		return false;
 
+	// skip deleted rows; that needs docinfo lookups, see below
+	const CSphDeadRows * pDeadRows = tArgs.m_pDeadRows;
+	bool bDeadRows = ( pDeadRows && pDeadRows->GetDead()>0 );
+	if ( bDeadRows )
+		tCtx.m_pFilter = sphJoinFilters ( tCtx.m_pFilter, new Filter_DeadRows ( *pDeadRows, m_tAttr.GetWritePtr(), m_iDocinfo, DOCINFO_IDSIZE + m_tSchema.GetRowSize() ) );
+
 	// check if we can early reject the whole index
 	if ( tCtx.m_pFilter && m_iDocinfoIndex )
 	{
@@ -19314,7 +20455,7 @@ bool CSphIndex_VLN::ParsedMultiQuery ( const CSphQuery * pQuery, CSphQueryResult
 	}
 
 	// setup lookup
-	tCtx.m_bLookupFilter = ( m_tSettings.m_eDocinfo==SPH_DOCINFO_EXTERN ) && pQuery->m_dFilters.GetLength();
+	tCtx.m_bLookupFilter = ( m_tSettings.m_eDocinfo==SPH_DOCINFO_EXTERN ) && ( pQuery->m_dFilters.GetLength() || bDeadRows );
 	if ( tCtx.m_dCalcFilter.GetLength() || pQuery->m_eRanker==SPH_RANK_EXPR || pQuery->m_eRanker==SPH_RANK_EXPORT )
 		tCtx.m_bLookupFilter = true; // suboptimal in case of attr-independent expressions, but we don't care
 
@@ -19353,7 +20494,7 @@ bool CSphIndex_VLN::ParsedMultiQuery ( const CSphQuery * pQuery, CSphQueryResult
 		case SPH_MATCH_EXTENDED:
 		case SPH_MATCH_EXTENDED2:
 		case SPH_MATCH_BOOLEAN:
-			MatchExtended ( &tCtx, pQuery, iSorters, ppSorters, pRanker.Ptr(), iMyTag, tArgs.m_iIndexWeight );
+			MatchExtended ( &tCtx, pQuery, iSorters, ppSorters, pRanker.Ptr(), tTermSetup, iMyTag, tArgs.m_iIndexWeight );
 			break;
 
 		default:
@@ -19402,13 +20543,10 @@ bool CSphIndex_VLN::ParsedMultiQuery ( const CSphQuery * pQuery, CSphQueryResult
 	if ( pProfile )
 		pProfile->Switch ( SPH_QSTATE_UNKNOWN );
 
+	tQueryStats.m_pNanoBudget = NULL;
+	pResult->m_tStats.Add ( tQueryStats );
 	if ( bCollectPredictionCounters )
-	{
-		pResult->m_tStats.m_iFetchedDocs += tQueryStats.m_iFetchedDocs;
-		pResult->m_tStats.m_iFetchedHits += tQueryStats.m_iFetchedHits;
-		pResult->m_tStats.m_iSkips += tQueryStats.m_iSkips;
 		pResult->m_bHasPrediction = true;
-	}
 
 	return true;
 }
@@ -19427,14 +20565,20 @@ void CSphIndex_VLN::GetStatus ( CSphIndexStatus* pRes ) const
 		+ m_dFieldLens.GetSizeBytes()
 
 		+ m_pDocinfoHash.GetLengthBytes()
+		+ m_pDocinfoDirect.GetLengthBytes()
 		+ m_tAttr.GetLengthBytes()
 		+ m_tMva.GetLengthBytes()
 		+ m_tString.GetLengthBytes()
 		+ m_tWordlist.m_pBuf.GetLengthBytes()
+		+ m_tWordlist.m_tTrigrams.GetSizeBytes()
 		+ m_pKillList.GetLengthBytes()
 		+ m_pSkiplists.GetLengthBytes()
+		+ m_tDocstore.GetSizeBytes()
 		+ m_dShared.GetLengthBytes();
 
+	ARRAY_FOREACH ( i, m_dJsonIndexes )
+		pRes->m_iRamUse += m_dJsonIndexes[i].GetSizeBytes();
+
 	char sFile [ SPH_MAX_FILENAME_LEN ];
 	pRes->m_iDiskUse = 0;
 	for ( int i=0; i<sphGetExtCount ( m_uVersion ); i++ )
@@ -19444,6 +20588,72 @@ void CSphIndex_VLN::GetStatus ( CSphIndexStatus* pRes ) const
 		if ( stat ( sFile, &st )==0 )
 			pRes->m_iDiskUse += st.st_size;
 	}
+
+	GetExpansionCacheStatus ( pRes );
+}
+
+
+/// plain index stored fields; the index data never changes, so the snapshot only needs the deleted rows
+class StoredFieldsVLN_c : public ISphStoredFields
+{
+public:
+	StoredFieldsVLN_c ( const CSphIndex_VLN * pIndex, const CSphVector<CSphString> & dFields, const CSphDocstore & tDocstore, const CSphDeadRows * pDeadRows )
+		: m_pIndex ( pIndex )
+		, m_pDeadRows ( pDeadRows )
+		, m_dFields ( dFields.GetLength() )
+	{
+		if ( m_pDeadRows )
+			m_pDeadRows->AddRef();
+		ARRAY_FOREACH ( i, dFields )
+			m_dFields[i] = tDocstore.GetFieldIndex ( dFields[i].cstr() );
+	}
+
+	virtual bool GetField ( SphDocID_t uDocid, int iField, BYTE ** ppText, int * pLen ) const
+	{
+		return m_pIndex->GetStoredField ( uDocid, m_dFields[iField], m_pDeadRows, ppText, pLen );
+	}
+
+protected:
+	virtual ~StoredFieldsVLN_c ()
+	{
+		SafeRelease ( m_pDeadRows );
+	}
+
+private:
+	const CSphIndex_VLN *	m_pIndex;
+	const CSphDeadRows *	m_pDeadRows;
+	CSphFixedVector<int>	m_dFields;		///< document storage field numbers
+};
+
+
+ISphStoredFields * CSphIndex_VLN::CreateStoredFields ( const CSphDeadRows * pDeadRows ) const
+{
+	if ( !m_tDocstore.GetFields().GetLength() )
+		return NULL;
+	return new StoredFieldsVLN_c ( this, m_tSettings.m_dStoredFields, m_tDocstore, pDeadRows );
+}
+
+
+bool CSphIndex_VLN::GetStoredField ( SphDocID_t uDocid, int iField, const CSphDeadRows * pDeadRows, BYTE ** ppText, int * pLen ) const
+{
+	*ppText = NULL;
+	*pLen = 0;
+
+	// rows deleted from RT disk chunks still have their text stored, but must not serve it
+	if ( pDeadRows && pDeadRows->GetDead() )
+	{
+		const DWORD * pRow = FindDocinfo ( uDocid );
+		if ( !pRow )
+			return false;
+
+		int iStride = DOCINFO_IDSIZE + m_tSchema.GetRowSize();
+		if ( pDeadRows->IsDead ( DWORD ( ( pRow-m_tAttr.GetWritePtr() ) / iStride ) ) )
+			return true;
+	}
+
+	if ( iField<0 )
+		return HasDocid ( uDocid );
+	return m_tDocstore.GetField ( uDocid, iField, ppText, pLen );
 }
 
 //////////////////////////////////////////////////////////////////////////
@@ -31111,6 +32321,7 @@ void CWordlist::Reset ()
 	m_dCheckpoints.Reset ( 0 );
 	SafeDeleteArray ( m_pWords );
 	SafeDeleteArray ( m_pInfixBlocksWords );
+	m_tTrigrams.Reset();
 }
 
 bool CWordlist::ReadCP ( CSphAutofile & tFile, DWORD uVersion, bool bWordDict, CSphString & sError )
@@ -31262,6 +32473,7 @@ KeywordsBlockReader_c::KeywordsBlockReader_c ( const BYTE * pBuf, bool bSkips )
 	m_iLen = 0;
 	m_bHaveSkips = bSkips;
 	m_sKeyword = m_sWord;
+	m_pEntryData = NULL;
 }
 
 
@@ -31301,21 +32513,29 @@ bool KeywordsBlockReader_c::UnpackWord()
 	m_iLen = iMatch + iDelta;
 	m_sWord[m_iLen] = '\0';
 
-	m_iDoclistOffset = sphUnzipOffset ( m_pBuf );
-	m_iDocs = sphUnzipInt ( m_pBuf );
-	m_iHits = sphUnzipInt ( m_pBuf );
-	m_uHint = ( m_iDocs>=DOCLIST_HINT_THRESH ) ? *m_pBuf++ : 0;
-	m_iDoclistHint = DoclistHintUnpack ( m_iDocs, m_uHint );
-	if ( m_bHaveSkips && ( m_iDocs > SPH_SKIPLIST_BLOCK ) )
-		m_iSkiplistOffset = sphUnzipInt ( m_pBuf );
-	else
-		m_iSkiplistOffset = 0;
+	m_pEntryData = m_pBuf;
+	m_pBuf = UnpackEntryData ( m_pBuf, m_bHaveSkips, *this );
 
 	assert ( m_iLen>0 );
 	return true;
 }
 
 
+const BYTE * KeywordsBlockReader_c::UnpackEntryData ( const BYTE * pBuf, bool bHaveSkips, CSphDictEntry & tEntry )
+{
+	tEntry.m_iDoclistOffset = sphUnzipOffset ( pBuf );
+	tEntry.m_iDocs = sphUnzipInt ( pBuf );
+	tEntry.m_iHits = sphUnzipInt ( pBuf );
+	BYTE uHint = ( tEntry.m_iDocs>=DOCLIST_HINT_THRESH ) ? *pBuf++ : 0;
+	tEntry.m_iDoclistHint = DoclistHintUnpack ( tEntry.m_iDocs, uHint );
+	if ( bHaveSkips && ( tEntry.m_iDocs > SPH_SKIPLIST_BLOCK ) )
+		tEntry.m_iSkiplistOffset = sphUnzipInt ( pBuf );
+	else
+		tEntry.m_iSkiplistOffset = 0;
+	return pBuf;
+}
+
+
 bool CWordlist::GetWord ( const BYTE * pBuf, SphWordID_t iWordID, CSphDictEntry & tWord ) const
 {
 	SphWordID_t iLastID = 0;
@@ -31421,192 +32641,1903 @@ const char * ISphWordlist::Args_t::GetWordExpanded ( int iIndex ) const
 }
 
 
-struct DiskExpandedEntry_t
-{
-	int		m_iNameOff;
-	int		m_iDocs;
-	int		m_iHits;
-};
+//////////////////////////////////////////////////////////////////////////
+// EXPANSION CACHE
+//////////////////////////////////////////////////////////////////////////
 
-struct DiskExpandedPayload_t
-{
-	int			m_iDocs;
-	int			m_iHits;
-	uint64_t	m_uDoclistOff;
-	int			m_iDoclistHint;
-};
+CSphExpansionCache::CSphExpansionCache ()
+	: m_pHead ( NULL )
+	, m_pTail ( NULL )
+	, m_iMaxBytes ( 0 )
+	, m_iUsedBytes ( 0 )
+	, m_iGeneration ( 0 )
+	, m_iHits ( 0 )
+	, m_iMisses ( 0 )
+{}
 
 
-struct DictEntryDiskPayload_t
+CSphExpansionCache::~CSphExpansionCache ()
 {
-	explicit DictEntryDiskPayload_t ( bool bPayload, ESphHitless eHitless )
-	{
-		m_bPayload = bPayload;
-		m_eHitless = eHitless;
-		if ( bPayload )
-			m_dWordPayload.Reserve ( 1000 );
+	Shrink ( 0 );
+}
 
-		m_dWordExpand.Reserve ( 1000 );
-		m_dWordBuf.Reserve ( 8096 );
-	}
 
-	void Add ( const CSphDictEntry & tWord, int iWordLen )
-	{
-		if ( !m_bPayload || !sphIsExpandedPayload ( tWord.m_iDocs, tWord.m_iHits ) ||
-			m_eHitless==SPH_HITLESS_ALL || ( m_eHitless==SPH_HITLESS_SOME && ( tWord.m_iDocs & HITLESS_DOC_FLAG )!=0 ) ) // FIXME!!! do we need hitless=some as payloads?
-		{
-			DiskExpandedEntry_t & tExpand = m_dWordExpand.Add();
+void CSphExpansionCache::SetMaxBytes ( int64_t iMaxBytes )
+{
+	CSphScopedLock<CSphStaticMutex> tLock ( m_tLock );
+	m_iMaxBytes = Max ( iMaxBytes, 0 );
+	Shrink ( m_iMaxBytes );
+}
 
-			int iOff = m_dWordBuf.GetLength();
-			tExpand.m_iNameOff = iOff;
-			tExpand.m_iDocs = tWord.m_iDocs;
-			tExpand.m_iHits = tWord.m_iHits;
-			m_dWordBuf.Resize ( iOff + iWordLen + 1 );
-			memcpy ( m_dWordBuf.Begin() + iOff + 1, tWord.m_sKeyword, iWordLen );
-			m_dWordBuf[iOff] = (BYTE)iWordLen;
 
-		} else
-		{
-			DiskExpandedPayload_t & tExpand = m_dWordPayload.Add();
-			tExpand.m_iDocs = tWord.m_iDocs;
-			tExpand.m_iHits = tWord.m_iHits;
-			tExpand.m_uDoclistOff = tWord.m_iDoclistOffset;
-			tExpand.m_iDoclistHint = tWord.m_iDoclistHint;
-		}
-	}
+void CSphExpansionCache::Unlink ( Entry_t * pEntry )
+{
+	if ( pEntry->m_pPrev )
+		pEntry->m_pPrev->m_pNext = pEntry->m_pNext;
+	else
+		m_pHead = pEntry->m_pNext;
 
-	void Convert ( ISphWordlist::Args_t & tArgs )
-	{
-		if ( !m_dWordExpand.GetLength() && !m_dWordPayload.GetLength() )
-			return;
+	if ( pEntry->m_pNext )
+		pEntry->m_pNext->m_pPrev = pEntry->m_pPrev;
+	else
+		m_pTail = pEntry->m_pPrev;
 
-		int iTotalDocs = 0;
-		int iTotalHits = 0;
-		if ( m_dWordExpand.GetLength() )
-		{
-			LimitExpanded ( tArgs.m_iExpansionLimit, m_dWordExpand );
+	pEntry->m_pPrev = pEntry->m_pNext = NULL;
+}
 
-			const BYTE * sBase = m_dWordBuf.Begin();
-			ARRAY_FOREACH ( i, m_dWordExpand )
-			{
-				const DiskExpandedEntry_t & tCur = m_dWordExpand[i];
-				int iDocs = tCur.m_iDocs;
 
-				if ( m_eHitless==SPH_HITLESS_SOME )
-					iDocs = ( tCur.m_iDocs & HITLESS_DOC_MASK );
+void CSphExpansionCache::LinkHead ( Entry_t * pEntry )
+{
+	pEntry->m_pPrev = NULL;
+	pEntry->m_pNext = m_pHead;
+	if ( m_pHead )
+		m_pHead->m_pPrev = pEntry;
+	m_pHead = pEntry;
+	if ( !m_pTail )
+		m_pTail = pEntry;
+}
 
-				tArgs.AddExpanded ( sBase + tCur.m_iNameOff + 1, sBase[tCur.m_iNameOff], iDocs, tCur.m_iHits );
 
-				iTotalDocs += iDocs;
-				iTotalHits += tCur.m_iHits;
-			}
-		}
+void CSphExpansionCache::Delete ( Entry_t * pEntry )
+{
+	Unlink ( pEntry );
+	m_hEntries.Delete ( pEntry->m_sKey );
+	m_iUsedBytes -= pEntry->m_iBytes;
+	SafeDelete ( pEntry );
+}
 
-		if ( m_dWordPayload.GetLength() )
-		{
-			LimitExpanded ( tArgs.m_iExpansionLimit, m_dWordPayload );
 
-			DiskSubstringPayload_t * pPayload = new DiskSubstringPayload_t ( m_dWordPayload.GetLength() );
-			// sorting by ascending doc-list offset gives some (15%) speed-up too
-			sphSort ( m_dWordPayload.Begin(), m_dWordPayload.GetLength(), bind ( &DiskExpandedPayload_t::m_uDoclistOff ) );
+void CSphExpansionCache::Shrink ( int64_t iMaxBytes )
+{
+	while ( m_pTail && m_iUsedBytes>iMaxBytes )
+		Delete ( m_pTail );
+	assert ( m_pTail || m_iUsedBytes==0 );
+}
 
-			ARRAY_FOREACH ( i, m_dWordPayload )
-			{
-				const DiskExpandedPayload_t & tCur = m_dWordPayload[i];
-				assert ( m_eHitless==SPH_HITLESS_NONE || ( m_eHitless==SPH_HITLESS_SOME && ( tCur.m_iDocs & HITLESS_DOC_FLAG )==0 ) );
 
-				iTotalDocs += tCur.m_iDocs;
-				iTotalHits += tCur.m_iHits;
-				pPayload->m_dDoclist[i].m_uOff = tCur.m_uDoclistOff;
-				pPayload->m_dDoclist[i].m_iLen = tCur.m_iDoclistHint;
-			}
+bool CSphExpansionCache::Lookup ( const CSphString & sKey, int iGeneration, ISphWordlist::Args_t & tArgs )
+{
+	if ( !IsEnabled() )
+		return false;
 
-			pPayload->m_iTotalDocs = iTotalDocs;
-			pPayload->m_iTotalHits = iTotalHits;
-			tArgs.m_pPayload = pPayload;
-		}
-		tArgs.m_iTotalDocs = iTotalDocs;
-		tArgs.m_iTotalHits = iTotalHits;
+	CSphScopedLock<CSphStaticMutex> tLock ( m_tLock );
+	Entry_t ** ppEntry = ( iGeneration==m_iGeneration ) ? m_hEntries ( sKey ) : NULL;
+	if ( !ppEntry )
+	{
+		m_iMisses++;
+		return false;
 	}
 
-	// sort expansions by frequency desc
-	// clip the less frequent ones if needed, as they are likely misspellings
-	template < typename T >
-	void LimitExpanded ( int iExpansionLimit, CSphVector<T> & dVec ) const
+	Entry_t * pEntry = *ppEntry;
+	ARRAY_FOREACH ( i, pEntry->m_dExpanded )
 	{
-		if ( !iExpansionLimit || dVec.GetLength()<=iExpansionLimit )
-			return;
-
-		sphSort ( dVec.Begin(), dVec.GetLength(), ExpandedOrderDesc_T<T>() );
-		dVec.Resize ( iExpansionLimit );
+		const SphExpanded_t & tWord = pEntry->m_dExpanded[i];
+		const char * sWord = pEntry->m_dWords.Begin() + tWord.m_iNameOff;
+		tArgs.AddExpanded ( (const BYTE *)sWord, strlen ( sWord ), tWord.m_iDocs, tWord.m_iHits );
 	}
+	tArgs.m_pPayload = pEntry->m_pPayload ? pEntry->m_pPayload->Clone() : NULL;
+	tArgs.m_iTotalDocs = pEntry->m_iTotalDocs;
+	tArgs.m_iTotalHits = pEntry->m_iTotalHits;
 
-	bool								m_bPayload;
-	ESphHitless							m_eHitless;
-	CSphVector<DiskExpandedEntry_t>		m_dWordExpand;
-	CSphVector<DiskExpandedPayload_t>	m_dWordPayload;
-	CSphVector<BYTE>					m_dWordBuf;
-};
+	Unlink ( pEntry );
+	LinkHead ( pEntry );
+	m_iHits++;
+	return true;
+}
 
 
-void CWordlist::GetPrefixedWords ( const char * sSubstring, int iSubLen, const char * sWildcard, Args_t & tArgs ) const
+void CSphExpansionCache::Store ( const CSphString & sKey, int iGeneration, const ISphWordlist::Args_t & tArgs )
 {
-	assert ( sSubstring && *sSubstring && iSubLen>0 );
-
-	// empty index?
-	if ( !m_dCheckpoints.GetLength() )
+	if ( !IsEnabled() )
 		return;
 
-	DictEntryDiskPayload_t tDict2Payload ( tArgs.m_bPayload, tArgs.m_eHitless );
-
-	const CSphWordlistCheckpoint * pCheckpoint = FindCheckpoint ( sSubstring, iSubLen, 0, true );
-	const int iSkipMagic = ( BYTE(*sSubstring)<0x20 ); // whether to skip heading magic chars in the prefix, like NONSTEMMED maker
-	while ( pCheckpoint )
+	// payloads that could not be copied (ie. bound to the query) are never cached
+	ISphSubstringPayload * pPayload = NULL;
+	if ( tArgs.m_pPayload )
 	{
-		// decode wordlist chunk
-		KeywordsBlockReader_c tDictReader ( AcquireDict ( pCheckpoint ), m_bHaveSkips );
-		while ( tDictReader.UnpackWord() )
-		{
-			// block is sorted
-			// so once keywords are greater than the prefix, no more matches
-			int iCmp = sphDictCmp ( sSubstring, iSubLen, (const char *)tDictReader.m_sKeyword, tDictReader.GetWordLen() );
-			if ( iCmp<0 )
-				break;
+		pPayload = tArgs.m_pPayload->Clone();
+		if ( !pPayload )
+			return;
+	}
 
-			// does it match the prefix *and* the entire wildcard?
-			if ( iCmp==0 && sphWildcardMatch ( (const char *)tDictReader.m_sKeyword + iSkipMagic, sWildcard ) )
-				tDict2Payload.Add ( tDictReader, tDictReader.GetWordLen() );
-		}
+	Entry_t * pEntry = new Entry_t();
+	pEntry->m_sKey = sKey;
+	pEntry->m_pPayload = pPayload;
+	pEntry->m_iTotalDocs = tArgs.m_iTotalDocs;
+	pEntry->m_iTotalHits = tArgs.m_iTotalHits;
+	pEntry->m_dExpanded.Resize ( tArgs.m_dExpanded.GetLength() );
+	ARRAY_FOREACH ( i, tArgs.m_dExpanded )
+	{
+		const char * sWord = tArgs.GetWordExpanded ( i );
+		int iLen = strlen ( sWord );
+		int iOff = pEntry->m_dWords.GetLength();
+		pEntry->m_dWords.Resize ( iOff+iLen+1 );
+		memcpy ( pEntry->m_dWords.Begin()+iOff, sWord, iLen+1 );
 
-		pCheckpoint++;
-		if ( pCheckpoint > &m_dCheckpoints.Last() )
-			break;
+		pEntry->m_dExpanded[i] = tArgs.m_dExpanded[i];
+		pEntry->m_dExpanded[i].m_iNameOff = iOff;
+	}
+	pEntry->m_iBytes = sizeof(Entry_t) + sKey.Length() + pEntry->m_dExpanded.GetSizeBytes() + pEntry->m_dWords.GetSizeBytes()
+		+ ( pPayload ? pPayload->GetSizeBytes() : 0 );
 
-		if ( sphDictCmp ( sSubstring, iSubLen, pCheckpoint->m_sWord, strlen ( pCheckpoint->m_sWord ) )<0 )
-			break;
+	CSphScopedLock<CSphStaticMutex> tLock ( m_tLock );
+	if ( iGeneration!=m_iGeneration || pEntry->m_iBytes>m_iMaxBytes || m_hEntries ( sKey ) )
+	{
+		SafeDelete ( pEntry );
+		return;
 	}
 
-	tDict2Payload.Convert ( tArgs );
+	Shrink ( m_iMaxBytes - pEntry->m_iBytes );
+	m_hEntries.Add ( pEntry, sKey );
+	LinkHead ( pEntry );
+	m_iUsedBytes += pEntry->m_iBytes;
 }
 
-bool operator < ( const InfixBlock_t & a, const char * b )
-{
-	return strcmp ( a.m_sInfix, b )<0;
-}
 
-bool operator == ( const InfixBlock_t & a, const char * b )
+void CSphExpansionCache::Invalidate ()
 {
-	return strcmp ( a.m_sInfix, b )==0;
+	CSphScopedLock<CSphStaticMutex> tLock ( m_tLock );
+	m_iGeneration++;
+	Shrink ( 0 );
 }
 
-bool operator < ( const char * a, const InfixBlock_t & b )
+
+void CSphExpansionCache::GetStatus ( CSphIndexStatus * pRes ) const
 {
-	return strcmp ( a, b.m_sInfix )<0;
+	CSphScopedLock<CSphStaticMutex> tLock ( m_tLock );
+	pRes->m_iExpansionCacheHits += m_iHits;
+	pRes->m_iExpansionCacheMisses += m_iMisses;
+	pRes->m_iExpansionCacheBytes += m_iUsedBytes;
 }
 
+//////////////////////////////////////////////////////////////////////////
+// DOCUMENT STORAGE
+//////////////////////////////////////////////////////////////////////////
 
-bool sphLookupInfixCheckpoints ( const char * sInfix, int iBytes, const BYTE * pInfixes, const CSphVector<InfixBlock_t> & dInfixBlocks, int iInfixCodepointBytes, CSphVector<int> & dCheckpoints )
-{
+static const DWORD	DOCSTORE_MAGIC			= 0x53445053;	///< "SPDS"
+static const DWORD	DOCSTORE_VERSION		= 1;
+static const int	DOCSTORE_BLOCK_SIZE		= 16384;		///< raw (uncompressed) block size we aim for
+
+
+int sphCompressBound ( int iLen )
+{
+#if USE_ZLIB
+	return (int) compressBound ( iLen );
+#else
+	return iLen;
+#endif
+}
+
+
+int sphCompressBlock ( const BYTE * pSrc, int iSrcLen, BYTE * pDst, int iDstLen )
+{
+#if USE_ZLIB
+	uLongf uDstLen = iDstLen;
+	if ( iSrcLen<=0 || compress2 ( pDst, &uDstLen, pSrc, iSrcLen, Z_BEST_SPEED )!=Z_OK )
+		return 0;
+	return (int)uDstLen;
+#else
+	return 0;
+#endif
+}
+
+
+bool sphDecompressBlock ( const BYTE * pSrc, int iSrcLen, BYTE * pDst, int iDstLen )
+{
+#if USE_ZLIB
+	uLongf uDstLen = iDstLen;
+	return uncompress ( pDst, &uDstLen, pSrc, iSrcLen )==Z_OK && uDstLen==(uLongf)iDstLen;
+#else
+	return false;
+#endif
+}
+
+
+void sphDocstorePackField ( CSphVector<BYTE> & dPacked, const BYTE * pData, int iLen )
+{
+	BYTE dLen[16];
+	int iLenBytes = sphEncodeVLB8 ( dLen, iLen );
+	int iOff = dPacked.GetLength();
+	dPacked.Resize ( iOff+iLenBytes+iLen );
+	memcpy ( dPacked.Begin()+iOff, dLen, iLenBytes );
+	if ( iLen )
+		memcpy ( dPacked.Begin()+iOff+iLenBytes, pData, iLen );
+}
+
+
+bool sphDocstoreUnpackField ( const BYTE * pPacked, int iPackedLen, int iField, const BYTE ** ppData, int * pLen )
+{
+	const BYTE * p = pPacked;
+	const BYTE * pMax = pPacked + iPackedLen;
+	for ( int i=0; p<pMax; i++ )
+	{
+		uint64_t uLen = 0;
+		p = spnDecodeVLB8 ( p, uLen );
+		if ( uLen>(uint64_t)( pMax-p ) )
+			return false;
+
+		if ( i==iField )
+		{
+			*ppData = p;
+			*pLen = (int)uLen;
+			return true;
+		}
+		p += uLen;
+	}
+	return false;
+}
+
+
+void sphDocstoreCopyField ( const BYTE * pPacked, int iPackedLen, int iField, BYTE ** ppData, int * pLen )
+{
+	*ppData = NULL;
+	*pLen = 0;
+
+	const BYTE * pData = NULL;
+	int iLen = 0;
+	if ( !sphDocstoreUnpackField ( pPacked, iPackedLen, iField, &pData, &iLen ) || !iLen )
+		return;
+
+	BYTE * pCopy = new BYTE [ iLen+1 ];
+	memcpy ( pCopy, pData, iLen );
+	pCopy[iLen] = '\0';
+	*ppData = pCopy;
+	*pLen = iLen;
+}
+
+
+/// scan raw block for the given docid
+static bool DocstoreFindInBlock ( const BYTE * pBlock, int iBlockLen, SphDocID_t uFirstDocid, SphDocID_t uDocid, const BYTE ** ppDoc, int * pDocLen )
+{
+	const BYTE * p = pBlock;
+	const BYTE * pMax = pBlock + iBlockLen;
+	SphDocID_t uCur = uFirstDocid;
+
+	while ( p<pMax )
+	{
+		uint64_t uDelta = 0, uLen = 0;
+		p = spnDecodeVLB8 ( p, uDelta );
+		p = spnDecodeVLB8 ( p, uLen );
+		uCur += (SphDocID_t)uDelta;
+		if ( uLen>(uint64_t)( pMax-p ) || uCur>uDocid )
+			return false;
+
+		if ( uCur==uDocid )
+		{
+			*ppDoc = p;
+			*pDocLen = (int)uLen;
+			return true;
+		}
+		p += uLen;
+	}
+	return false;
+}
+
+
+struct DocstoreKeyHash_fn
+{
+	static inline DWORD Hash ( uint64_t uKey )
+	{
+		return (DWORD)uKey ^ ( (DWORD)( uKey>>32 )*2654435761U );
+	}
+};
+
+
+/// global LRU cache of decompressed docstore blocks, shared by all the indexes
+/// fields are copied out under the lock, so evictions never affect the readers
+class DocstoreCache_c : public ISphNoncopyable
+{
+public:
+	DocstoreCache_c ()
+		: m_pHead ( NULL )
+		, m_pTail ( NULL )
+		, m_iMaxBytes ( 16*1024*1024 )
+		, m_iUsedBytes ( 0 )
+		, m_iHits ( 0 )
+		, m_iMisses ( 0 )
+		, m_iLastUid ( 0 )
+	{}
+
+	~DocstoreCache_c ()
+	{
+		Shrink ( 0 );
+	}
+
+	int NewUid ()
+	{
+		CSphScopedLock<CSphStaticMutex> tLock ( m_tLock );
+		return ++m_iLastUid;
+	}
+
+	void SetMaxBytes ( int64_t iMaxBytes )
+	{
+		CSphScopedLock<CSphStaticMutex> tLock ( m_tLock );
+		m_iMaxBytes = Max ( iMaxBytes, 0 );
+		Shrink ( m_iMaxBytes );
+	}
+
+	/// copy the document field out of the cached block; returns false if the block is not cached
+	bool FindField ( int iUid, int iBlock, SphDocID_t uFirstDocid, SphDocID_t uDocid, int iField, BYTE ** ppData, int * pLen, bool & bFound )
+	{
+		CSphScopedLock<CSphStaticMutex> tLock ( m_tLock );
+		Entry_t ** ppEntry = m_hEntries ( GetKey ( iUid, iBlock ) );
+		if ( !ppEntry )
+		{
+			m_iMisses++;
+			return false;
+		}
+
+		Entry_t * pEntry = *ppEntry;
+		const BYTE * pDoc = NULL;
+		int iDocLen = 0;
+		bFound = DocstoreFindInBlock ( pEntry->m_dData.Begin(), pEntry->m_dData.GetLength(), uFirstDocid, uDocid, &pDoc, &iDocLen );
+		if ( bFound )
+			sphDocstoreCopyField ( pDoc, iDocLen, iField, ppData, pLen );
+
+		Unlink ( pEntry );
+		LinkHead ( pEntry );
+		m_iHits++;
+		return true;
+	}
+
+	/// takes over the block data
+	void Store ( int iUid, int iBlock, CSphVector<BYTE> & dRaw )
+	{
+		CSphScopedLock<CSphStaticMutex> tLock ( m_tLock );
+		uint64_t uKey = GetKey ( iUid, iBlock );
+		int64_t iBytes = sizeof(Entry_t) + dRaw.GetSizeBytes();
+		if ( iBytes>m_iMaxBytes || m_hEntries ( uKey ) )
+			return;
+
+		Shrink ( m_iMaxBytes - iBytes );
+		Entry_t * pEntry = new Entry_t();
+		pEntry->m_uKey = uKey;
+		pEntry->m_iBytes = iBytes;
+		pEntry->m_dData.SwapData ( dRaw );
+		m_hEntries.Add ( pEntry, uKey );
+		LinkHead ( pEntry );
+		m_iUsedBytes += iBytes;
+	}
+
+	/// drop all the blocks of the given store
+	void Drop ( int iUid )
+	{
+		CSphScopedLock<CSphStaticMutex> tLock ( m_tLock );
+		Entry_t * pEntry = m_pHead;
+		while ( pEntry )
+		{
+			Entry_t * pNext = pEntry->m_pNext;
+			if ( (int)( pEntry->m_uKey>>32 )==iUid )
+				Delete ( pEntry );
+			pEntry = pNext;
+		}
+	}
+
+	void GetStatus ( int64_t & iHits, int64_t & iMisses, int64_t & iBytes ) const
+	{
+		CSphScopedLock<CSphStaticMutex> tLock ( m_tLock );
+		iHits = m_iHits;
+		iMisses = m_iMisses;
+		iBytes = m_iUsedBytes;
+	}
+
+private:
+	struct Entry_t
+	{
+		uint64_t			m_uKey;
+		CSphVector<BYTE>	m_dData;
+		int64_t				m_iBytes;
+		Entry_t *			m_pPrev;
+		Entry_t *			m_pNext;
+
+		Entry_t () : m_uKey ( 0 ), m_iBytes ( 0 ), m_pPrev ( NULL ), m_pNext ( NULL ) {}
+	};
+
+	static inline uint64_t GetKey ( int iUid, int iBlock )
+	{
+		return ( uint64_t(iUid)<<32 ) | DWORD(iBlock);
+	}
+
+	void Unlink ( Entry_t * pEntry )
+	{
+		if ( pEntry->m_pPrev )
+			pEntry->m_pPrev->m_pNext = pEntry->m_pNext;
+		else
+			m_pHead = pEntry->m_pNext;
+
+		if ( pEntry->m_pNext )
+			pEntry->m_pNext->m_pPrev = pEntry->m_pPrev;
+		else
+			m_pTail = pEntry->m_pPrev;
+
+		pEntry->m_pPrev = pEntry->m_pNext = NULL;
+	}
+
+	void LinkHead ( Entry_t * pEntry )
+	{
+		pEntry->m_pPrev = NULL;
+		pEntry->m_pNext = m_pHead;
+		if ( m_pHead )
+			m_pHead->m_pPrev = pEntry;
+		m_pHead = pEntry;
+		if ( !m_pTail )
+			m_pTail = pEntry;
+	}
+
+	void Delete ( Entry_t * pEntry )
+	{
+		Unlink ( pEntry );
+		m_hEntries.Delete ( pEntry->m_uKey );
+		m_iUsedBytes -= pEntry->m_iBytes;
+		SafeDelete ( pEntry );
+	}
+
+	void Shrink ( int64_t iMaxBytes )
+	{
+		while ( m_pTail && m_iUsedBytes>iMaxBytes )
+			Delete ( m_pTail );
+	}
+
+	mutable CSphStaticMutex		m_tLock;
+	CSphOrderedHash < Entry_t *, uint64_t, DocstoreKeyHash_fn, 4096 >	m_hEntries;
+	Entry_t *					m_pHead;		///< most recently used
+	Entry_t *					m_pTail;		///< least recently used
+	int64_t						m_iMaxBytes;
+	int64_t						m_iUsedBytes;
+	int64_t						m_iHits;
+	int64_t						m_iMisses;
+	int							m_iLastUid;
+};
+
+static DocstoreCache_c g_tDocstoreCache;
+
+
+void sphSetDocstoreCacheSize ( int64_t iMaxBytes )
+{
+	g_tDocstoreCache.SetMaxBytes ( iMaxBytes );
+}
+
+
+void sphGetDocstoreCacheStatus ( int64_t & iHits, int64_t & iMisses, int64_t & iBytes )
+{
+	g_tDocstoreCache.GetStatus ( iHits, iMisses, iBytes );
+}
+
+
+CSphDocstoreWriter::CSphDocstoreWriter ()
+	: m_uLastDocid ( 0 )
+	, m_iMaxBlockLen ( 0 )
+{}
+
+
+bool CSphDocstoreWriter::Open ( const CSphString & sFile, const CSphVector<CSphString> & dFields, CSphString & sError )
+{
+	m_dBlocks.Reset();
+	m_dBlock.Resize ( 0 );
+	m_uLastDocid = 0;
+	m_iMaxBlockLen = 0;
+
+	if ( !m_tWriter.OpenFile ( sFile, sError ) )
+		return false;
+
+	m_tWriter.PutDword ( DOCSTORE_MAGIC );
+	m_tWriter.PutDword ( DOCSTORE_VERSION );
+	m_tWriter.PutDword ( DOCSTORE_BLOCK_SIZE );
+	m_tWriter.PutDword ( dFields.GetLength() );
+	ARRAY_FOREACH ( i, dFields )
+		m_tWriter.PutString ( dFields[i] );
+
+	return !m_tWriter.IsError();
+}
+
+
+void CSphDocstoreWriter::AddDoc ( SphDocID_t uDocid, const BYTE * pPacked, int iPackedLen )
+{
+	assert ( uDocid>m_uLastDocid || !m_dBlocks.GetLength() );
+
+	if ( !m_dBlock.GetLength() )
+	{
+		DocstoreBlock_t & tBlock = m_dBlocks.Add();
+		tBlock.m_uFirstDocid = uDocid;
+		tBlock.m_iOffset = m_tWriter.GetPos();
+		m_uLastDocid = uDocid;
+	}
+
+	BYTE dHeader[32];
+	int iHeader = sphEncodeVLB8 ( dHeader, uDocid-m_uLastDocid );
+	iHeader += sphEncodeVLB8 ( dHeader+iHeader, iPackedLen );
+
+	int iOff = m_dBlock.GetLength();
+	m_dBlock.Resize ( iOff+iHeader+iPackedLen );
+	memcpy ( m_dBlock.Begin()+iOff, dHeader, iHeader );
+	if ( iPackedLen )
+		memcpy ( m_dBlock.Begin()+iOff+iHeader, pPacked, iPackedLen );
+	m_uLastDocid = uDocid;
+
+	if ( m_dBlock.GetLength()>=DOCSTORE_BLOCK_SIZE )
+		FlushBlock();
+}
+
+
+void CSphDocstoreWriter::FlushBlock ()
+{
+	if ( !m_dBlock.GetLength() )
+		return;
+
+	int iRawLen = m_dBlock.GetLength();
+	m_iMaxBlockLen = Max ( m_iMaxBlockLen, iRawLen );
+	m_dCompressed.Resize ( sphCompressBound ( iRawLen ) );
+	int iPackedLen = sphCompressBlock ( m_dBlock.Begin(), iRawLen, m_dCompressed.Begin(), m_dCompressed.GetLength() );
+
+	// poorly compressible blocks are stored as is (stored length equals raw length)
+	m_tWriter.PutDword ( iRawLen );
+	if ( iPackedLen>0 && iPackedLen<iRawLen )
+	{
+		m_tWriter.PutDword ( iPackedLen );
+		m_tWriter.PutBytes ( m_dCompressed.Begin(), iPackedLen );
+	} else
+	{
+		m_tWriter.PutDword ( iRawLen );
+		m_tWriter.PutBytes ( m_dBlock.Begin(), iRawLen );
+	}
+
+	m_dBlock.Resize ( 0 );
+}
+
+
+bool CSphDocstoreWriter::Finish ( CSphString & sError )
+{
+	FlushBlock();
+
+	SphOffset_t iIndexOffset = m_tWriter.GetPos();
+	m_tWriter.PutDword ( m_dBlocks.GetLength() );
+	m_tWriter.PutDword ( m_iMaxBlockLen );
+	ARRAY_FOREACH ( i, m_dBlocks )
+	{
+		m_tWriter.PutOffset ( m_dBlocks[i].m_uFirstDocid );
+		m_tWriter.PutOffset ( m_dBlocks[i].m_iOffset );
+	}
+	m_tWriter.PutOffset ( iIndexOffset );
+	m_tWriter.CloseFile();
+
+	if ( m_tWriter.IsError() )
+	{
+		if ( sError.IsEmpty() )
+			sError = "failed to write document storage";
+		return false;
+	}
+	return true;
+}
+
+
+void CSphDocstoreWriter::UnlinkFile ()
+{
+	m_tWriter.UnlinkFile();
+}
+
+
+CSphDocstore::CSphDocstore ()
+	: m_iIndexOffset ( 0 )
+	, m_iMaxBlockLen ( 0 )
+	, m_iUid ( 0 )
+{}
+
+
+CSphDocstore::~CSphDocstore ()
+{
+	Reset();
+}
+
+
+void CSphDocstore::Reset ()
+{
+	if ( m_iUid )
+		g_tDocstoreCache.Drop ( m_iUid );
+	m_iUid = 0;
+	m_dFields.Reset();
+	m_dBlocks.Reset();
+	m_iIndexOffset = 0;
+	m_iMaxBlockLen = 0;
+	m_tFile.Close();
+}
+
+
+bool CSphDocstore::Load ( const CSphString & sFile, CSphString & sError )
+{
+	Reset();
+
+	CSphAutoreader rdStore;
+	if ( !rdStore.Open ( sFile, sError ) )
+		return false;
+
+	if ( rdStore.GetDword()!=DOCSTORE_MAGIC )
+	{
+		sError.SetSprintf ( "%s: invalid document storage header", sFile.cstr() );
+		return false;
+	}
+
+	DWORD uVersion = rdStore.GetDword();
+	if ( uVersion==0 || uVersion>DOCSTORE_VERSION )
+	{
+		sError.SetSprintf ( "%s is v.%d, binary is v.%d", sFile.cstr(), uVersion, DOCSTORE_VERSION );
+		return false;
+	}
+
+	rdStore.GetDword(); // block size
+	m_dFields.Resize ( rdStore.GetDword() );
+	ARRAY_FOREACH ( i, m_dFields )
+		m_dFields[i] = rdStore.GetString();
+
+	SphOffset_t iSize = rdStore.GetFilesize();
+	rdStore.SeekTo ( iSize-sizeof(SphOffset_t), sizeof(SphOffset_t) );
+	m_iIndexOffset = rdStore.GetOffset();
+
+	rdStore.SeekTo ( m_iIndexOffset, 0 );
+	m_dBlocks.Resize ( rdStore.GetDword() );
+	m_iMaxBlockLen = (int)rdStore.GetDword();
+	ARRAY_FOREACH ( i, m_dBlocks )
+	{
+		m_dBlocks[i].m_uFirstDocid = (SphDocID_t)rdStore.GetOffset();
+		m_dBlocks[i].m_iOffset = rdStore.GetOffset();
+	}
+
+	if ( rdStore.GetErrorFlag() )
+	{
+		sError = rdStore.GetErrorMessage();
+		Reset();
+		return false;
+	}
+	rdStore.Close();
+
+	if ( m_iMaxBlockLen<0 )
+	{
+		sError.SetSprintf ( "%s: invalid block length %d", sFile.cstr(), m_iMaxBlockLen );
+		Reset();
+		return false;
+	}
+
+	if ( m_tFile.Open ( sFile, SPH_O_READ, sError )<0 )
+	{
+		Reset();
+		return false;
+	}
+
+	m_iUid = g_tDocstoreCache.NewUid();
+	return true;
+}
+
+
+int CSphDocstore::GetFieldIndex ( const char * sName ) const
+{
+	ARRAY_FOREACH ( i, m_dFields )
+		if ( strcasecmp ( m_dFields[i].cstr(), sName )==0 )
+			return i;
+	return -1;
+}
+
+
+bool CSphDocstore::ReadBlock ( int iBlock, CSphVector<BYTE> & dRaw ) const
+{
+	SphOffset_t iStart = m_dBlocks[iBlock].m_iOffset;
+	SphOffset_t iEnd = ( iBlock+1<m_dBlocks.GetLength() ) ? m_dBlocks[iBlock+1].m_iOffset : m_iIndexOffset;
+
+	// stored data is never longer than the raw data, and that is never longer than the longest written block
+	const int HEADER_LEN = 2*sizeof(DWORD);
+	if ( iEnd-iStart<HEADER_LEN || iEnd-iStart>HEADER_LEN+(SphOffset_t)m_iMaxBlockLen )
+		return false;
+	int iLen = (int)( iEnd-iStart );
+
+	CSphVector<BYTE> dData ( iLen );
+	if ( sphPread ( m_tFile.GetFD(), dData.Begin(), iLen, iStart )!=iLen )
+		return false;
+
+	DWORD uRawLen, uStoredLen;
+	memcpy ( &uRawLen, dData.Begin(), sizeof(DWORD) );
+	memcpy ( &uStoredLen, dData.Begin()+sizeof(DWORD), sizeof(DWORD) );
+	if ( uStoredLen!=(DWORD)( iLen-HEADER_LEN ) || uRawLen<uStoredLen || uRawLen>(DWORD)m_iMaxBlockLen )
+		return false;
+
+	const BYTE * pStored = dData.Begin() + HEADER_LEN;
+	dRaw.Resize ( uRawLen );
+	if ( uRawLen==uStoredLen )
+	{
+		memcpy ( dRaw.Begin(), pStored, uRawLen );
+		return true;
+	}
+
+	return sphDecompressBlock ( pStored, uStoredLen, dRaw.Begin(), uRawLen );
+}
+
+
+bool CSphDocstore::GetField ( SphDocID_t uDocid, int iField, BYTE ** ppData, int * pLen ) const
+{
+	*ppData = NULL;
+	*pLen = 0;
+
+	if ( !m_dBlocks.GetLength() || uDocid<m_dBlocks[0].m_uFirstDocid )
+		return false;
+
+	// find the last block that starts at or before the docid
+	int iLeft = 0;
+	int iRight = m_dBlocks.GetLength()-1;
+	while ( iLeft<iRight )
+	{
+		int iMid = iLeft + ( iRight-iLeft+1 )/2;
+		if ( m_dBlocks[iMid].m_uFirstDocid<=uDocid )
+			iLeft = iMid;
+		else
+			iRight = iMid-1;
+	}
+
+	const DocstoreBlock_t & tBlock = m_dBlocks[iLeft];
+	bool bFound = false;
+	if ( g_tDocstoreCache.FindField ( m_iUid, iLeft, tBlock.m_uFirstDocid, uDocid, iField, ppData, pLen, bFound ) )
+		return bFound;
+
+	CSphVector<BYTE> dRaw;
+	if ( !ReadBlock ( iLeft, dRaw ) )
+		return false;
+
+	const BYTE * pDoc = NULL;
+	int iDocLen = 0;
+	bFound = DocstoreFindInBlock ( dRaw.Begin(), dRaw.GetLength(), tBlock.m_uFirstDocid, uDocid, &pDoc, &iDocLen );
+	if ( bFound )
+		sphDocstoreCopyField ( pDoc, iDocLen, iField, ppData, pLen );
+
+	g_tDocstoreCache.Store ( m_iUid, iLeft, dRaw );
+	return bFound;
+}
+
+
+CSphDocstoreIterator::CSphDocstoreIterator ( const CSphDocstore & tStore )
+	: m_uDocid ( 0 )
+	, m_pPacked ( NULL )
+	, m_iPackedLen ( 0 )
+	, m_tStore ( tStore )
+	, m_iBlock ( -1 )
+	, m_pCur ( NULL )
+{}
+
+
+bool CSphDocstoreIterator::Next ()
+{
+	while ( !m_pCur || m_pCur>=m_dBlock.Begin()+m_dBlock.GetLength() )
+	{
+		if ( ++m_iBlock>=m_tStore.GetBlocksCount() || !m_tStore.ReadBlock ( m_iBlock, m_dBlock ) )
+			return false;
+		m_pCur = m_dBlock.Begin();
+		m_uDocid = m_tStore.m_dBlocks[m_iBlock].m_uFirstDocid;
+	}
+
+	uint64_t uDelta = 0, uLen = 0;
+	m_pCur = spnDecodeVLB8 ( m_pCur, uDelta );
+	m_pCur = spnDecodeVLB8 ( m_pCur, uLen );
+	if ( uLen>(uint64_t)( m_dBlock.Begin()+m_dBlock.GetLength()-m_pCur ) )
+		return false;
+
+	m_uDocid += (SphDocID_t)uDelta;
+	m_pPacked = m_pCur;
+	m_iPackedLen = (int)uLen;
+	m_pCur += uLen;
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// COLUMNAR RESULT SETS
+//////////////////////////////////////////////////////////////////////////
+
+// columnar block layout (all numbers are LSB varints unless noted)
+// docids column, then weights column, then one column per schema attribute
+// integer columns are zigzag coded deltas from the previous match
+// float column is raw 4-byte LSB values
+// mva column is value count followed by deltas within the set
+// string columns use a per-column dictionary: code 0 is null, code 1..N refers
+// to an already seen value, code N+1 is followed by a new length-prefixed value
+// json field and factor columns carry the same payload as the row-wise format
+
+static void ColumnarZip ( CSphVector<BYTE> & dOut, uint64_t uValue )
+{
+	while ( uValue>=0x80 )
+	{
+		dOut.Add ( (BYTE)( uValue | 0x80 ) );
+		uValue >>= 7;
+	}
+	dOut.Add ( (BYTE)uValue );
+}
+
+
+static void ColumnarZipDelta ( CSphVector<BYTE> & dOut, uint64_t uValue, uint64_t & uPrev )
+{
+	int64_t iDelta = (int64_t)( uValue-uPrev );
+	uPrev = uValue;
+	ColumnarZip ( dOut, ( (uint64_t)iDelta<<1 ) ^ (uint64_t)( iDelta>>63 ) );
+}
+
+
+static void ColumnarAppend ( CSphVector<BYTE> & dOut, const BYTE * pData, int iLen )
+{
+	int iOff = dOut.GetLength();
+	dOut.Resize ( iOff+iLen );
+	memcpy ( dOut.Begin()+iOff, pData, iLen );
+}
+
+
+/// bounds checked reader over a columnar block
+struct ColumnarReader_t
+{
+	const BYTE *	m_pCur;
+	const BYTE *	m_pMax;
+	bool			m_bError;
+
+	ColumnarReader_t ( const BYTE * pData, int iLen )
+		: m_pCur ( pData )
+		, m_pMax ( pData+iLen )
+		, m_bError ( false )
+	{}
+
+	int Left () const
+	{
+		return m_pMax-m_pCur;
+	}
+
+	uint64_t Unzip ()
+	{
+		uint64_t uRes = 0;
+		for ( int iShift=0; iShift<64 && m_pCur<m_pMax; iShift+=7 )
+		{
+			BYTE uByte = *m_pCur++;
+			uRes |= uint64_t ( uByte & 0x7f ) << iShift;
+			if (!( uByte & 0x80 ))
+				return uRes;
+		}
+		m_bError = true;
+		return 0;
+	}
+
+	uint64_t UnzipDelta ( uint64_t & uPrev )
+	{
+		uint64_t uZig = Unzip();
+		uPrev += ( uZig>>1 ) ^ ( 0 - ( uZig & 1 ) );
+		return uPrev;
+	}
+
+	const BYTE * GetBytes ( int iLen )
+	{
+		if ( iLen<0 || Left()<iLen )
+		{
+			m_bError = true;
+			m_pCur = m_pMax;
+			return NULL;
+		}
+		const BYTE * pRes = m_pCur;
+		m_pCur += iLen;
+		return pRes;
+	}
+};
+
+
+/// decoded dictionary entry of a string column
+struct ColumnarDictEntry_t
+{
+	int		m_iOff;		///< offset into strings storage for pooled strings, into the block otherwise
+	int		m_iLen;
+};
+
+
+/// per-column string dictionary for the columnar encoder
+class ColumnarDict_c
+{
+public:
+	explicit ColumnarDict_c ( int iMaxEntries )
+	{
+		int iSlots = 16;
+		while ( iSlots<2*iMaxEntries )
+			iSlots <<= 1;
+		m_dSlots.Resize ( iSlots );
+		m_dSlots.Fill ( -1 );
+	}
+
+	/// returns 1-based code of a known value; or adds the value and returns 0
+	int FindOrAdd ( const BYTE * pStr, int iLen )
+	{
+		DWORD uMask = m_dSlots.GetLength()-1;
+		DWORD uSlot = (DWORD)sphFNV64 ( pStr, iLen ) & uMask;
+		while ( m_dSlots[uSlot]>=0 )
+		{
+			const Entry_t & tEntry = m_dEntries [ m_dSlots[uSlot] ];
+			if ( tEntry.m_iLen==iLen && !memcmp ( tEntry.m_pStr, pStr, iLen ) )
+				return m_dSlots[uSlot]+1;
+			uSlot = ( uSlot+1 ) & uMask;
+		}
+
+		m_dSlots[uSlot] = m_dEntries.GetLength();
+		Entry_t & tEntry = m_dEntries.Add();
+		tEntry.m_pStr = pStr;
+		tEntry.m_iLen = iLen;
+		return 0;
+	}
+
+	int GetLength () const
+	{
+		return m_dEntries.GetLength();
+	}
+
+private:
+	struct Entry_t
+	{
+		const BYTE *	m_pStr;
+		int				m_iLen;
+	};
+
+	CSphVector<int>		m_dSlots;
+	CSphVector<Entry_t>	m_dEntries;
+};
+
+
+void sphEncodeColumnar ( CSphVector<BYTE> & dRaw, const CSphMatch * pMatches, int iCount, const ISphSchema & tSchema, int iAttrsCount, const CSphTaggedVector & dTag2Pools )
+{
+	dRaw.Reserve ( dRaw.GetLength() + iCount*( 4+2*iAttrsCount ) );
+
+	uint64_t uPrev = 0;
+	for ( int i=0; i<iCount; i++ )
+		ColumnarZipDelta ( dRaw, pMatches[i].m_uDocID, uPrev );
+
+	uPrev = 0;
+	for ( int i=0; i<iCount; i++ )
+		ColumnarZipDelta ( dRaw, (int64_t)pMatches[i].m_iWeight, uPrev );
+
+	for ( int j=0; j<iAttrsCount; j++ )
+	{
+		const CSphColumnInfo & tAttr = tSchema.GetAttr(j);
+		const CSphAttrLocator & tLoc = tAttr.m_tLocator;
+		uPrev = 0;
+
+		switch ( tAttr.m_eAttrType )
+		{
+		case SPH_ATTR_UINT32SET:
+		case SPH_ATTR_INT64SET:
+			for ( int i=0; i<iCount; i++ )
+			{
+				const CSphMatch & tMatch = pMatches[i];
+				const PoolPtrs_t & tPools = dTag2Pools [ tMatch.m_iTag ];
+				assert ( tMatch.GetAttr ( tLoc )==0 || tPools.m_pMva );
+				const DWORD * pValues = tMatch.GetAttrMVA ( tLoc, tPools.m_pMva, tPools.m_bArenaProhibit );
+				int iValues = pValues ? *pValues++ : 0;
+				ColumnarZip ( dRaw, iValues );
+
+				uint64_t uPrevMva = 0;
+				if ( tAttr.m_eAttrType==SPH_ATTR_INT64SET )
+				{
+					for ( int k=0; k<iValues; k+=2 )
+						ColumnarZipDelta ( dRaw, MVA_UPSIZE ( pValues+k ), uPrevMva );
+				} else
+				{
+					for ( int k=0; k<iValues; k++ )
+						ColumnarZipDelta ( dRaw, pValues[k], uPrevMva );
+				}
+			}
+			break;
+
+		case SPH_ATTR_STRING:
+		case SPH_ATTR_JSON:
+		case SPH_ATTR_STRINGPTR:
+			{
+				ColumnarDict_c tDict ( iCount );
+				for ( int i=0; i<iCount; i++ )
+				{
+					const CSphMatch & tMatch = pMatches[i];
+					const BYTE * pStr = NULL;
+					int iLen = 0;
+					if ( tAttr.m_eAttrType==SPH_ATTR_STRINGPTR )
+					{
+						pStr = (const BYTE *) tMatch.GetAttr ( tLoc );
+						iLen = pStr ? strlen ( (const char *)pStr ) : 0;
+					} else
+					{
+						DWORD uOffset = (DWORD) tMatch.GetAttr ( tLoc );
+						const BYTE * pStrings = dTag2Pools [ tMatch.m_iTag ].m_pStrings;
+						assert ( !uOffset || pStrings );
+						if ( uOffset ) // magic zero
+							iLen = sphUnpackStr ( pStrings+uOffset, &pStr );
+					}
+
+					if ( !iLen )
+					{
+						ColumnarZip ( dRaw, 0 );
+						continue;
+					}
+
+					int iCode = tDict.FindOrAdd ( pStr, iLen );
+					if ( iCode )
+					{
+						ColumnarZip ( dRaw, iCode );
+					} else
+					{
+						ColumnarZip ( dRaw, tDict.GetLength() );
+						ColumnarZip ( dRaw, iLen );
+						ColumnarAppend ( dRaw, pStr, iLen );
+					}
+				}
+				break;
+			}
+
+		case SPH_ATTR_JSON_FIELD:
+			for ( int i=0; i<iCount; i++ )
+			{
+				const CSphMatch & tMatch = pMatches[i];
+				uint64_t uTypeOffset = tMatch.GetAttr ( tLoc );
+				DWORD uOff = (DWORD)uTypeOffset;
+				if ( !uOff )
+				{
+					dRaw.Add ( JSON_EOF );
+					continue;
+				}
+
+				ESphJsonType eJson = ESphJsonType ( uTypeOffset>>32 );
+				const BYTE * pData = dTag2Pools [ tMatch.m_iTag ].m_pStrings + uOff;
+				int iLen = sphJsonNodeSize ( eJson, pData );
+				dRaw.Add ( (BYTE)eJson );
+				if ( sphJsonNodeSize ( eJson, NULL )<0 )
+					ColumnarZip ( dRaw, iLen );
+				ColumnarAppend ( dRaw, pData, iLen );
+			}
+			break;
+
+		case SPH_ATTR_FACTORS:
+		case SPH_ATTR_FACTORS_JSON:
+			for ( int i=0; i<iCount; i++ )
+			{
+				const BYTE * pData = (const BYTE *) pMatches[i].GetAttr ( tLoc );
+				DWORD uLength = pData ? *(const DWORD *)pData : 0;
+				ColumnarZip ( dRaw, uLength );
+				if ( pData )
+					ColumnarAppend ( dRaw, pData+sizeof(DWORD), uLength-sizeof(DWORD) );
+			}
+			break;
+
+		case SPH_ATTR_FLOAT:
+			for ( int i=0; i<iCount; i++ )
+			{
+				DWORD uValue = (DWORD) pMatches[i].GetAttr ( tLoc );
+				dRaw.Add ( (BYTE)uValue );
+				dRaw.Add ( (BYTE)( uValue>>8 ) );
+				dRaw.Add ( (BYTE)( uValue>>16 ) );
+				dRaw.Add ( (BYTE)( uValue>>24 ) );
+			}
+			break;
+
+		case SPH_ATTR_BIGINT:
+			for ( int i=0; i<iCount; i++ )
+				ColumnarZipDelta ( dRaw, pMatches[i].GetAttr ( tLoc ), uPrev );
+			break;
+
+		default:
+			for ( int i=0; i<iCount; i++ )
+				ColumnarZipDelta ( dRaw, (DWORD) pMatches[i].GetAttr ( tLoc ), uPrev );
+			break;
+		}
+	}
+}
+
+
+bool sphDecodeColumnar ( const BYTE * pData, int iLen, CSphMatch * pMatches, int iCount, const ISphSchema & tSchema, CSphVector<DWORD> & dMvaStorage, CSphVector<BYTE> & dStringsStorage )
+{
+	ColumnarReader_t tIn ( pData, iLen );
+
+	uint64_t uPrev = 0;
+	for ( int i=0; i<iCount; i++ )
+	{
+		CSphMatch & tMatch = pMatches[i];
+		tMatch.Reset ( tSchema.GetRowSize() );
+		tMatch.m_uDocID = (SphDocID_t) tIn.UnzipDelta ( uPrev );
+	}
+
+	uPrev = 0;
+	for ( int i=0; i<iCount; i++ )
+		pMatches[i].m_iWeight = (int) tIn.UnzipDelta ( uPrev );
+
+	CSphVector<ColumnarDictEntry_t> dDict;
+
+	for ( int j=0; j<tSchema.GetAttrsCount() && !tIn.m_bError; j++ )
+	{
+		const CSphColumnInfo & tAttr = tSchema.GetAttr(j);
+		const CSphAttrLocator & tLoc = tAttr.m_tLocator;
+		uPrev = 0;
+		dDict.Resize ( 0 );
+
+		for ( int i=0; i<iCount && !tIn.m_bError; i++ )
+		{
+			CSphMatch & tMatch = pMatches[i];
+			switch ( tAttr.m_eAttrType )
+			{
+			case SPH_ATTR_UINT32SET:
+			case SPH_ATTR_INT64SET:
+				{
+					int iValues = (int) tIn.Unzip();
+					bool bWide = ( tAttr.m_eAttrType==SPH_ATTR_INT64SET );
+					if ( iValues<0 || iValues>tIn.Left()*( bWide ? 2 : 1 ) || ( bWide && ( iValues%2 )!=0 ) )
+					{
+						tIn.m_bError = true;
+						break;
+					}
+
+					tMatch.SetAttr ( tLoc, dMvaStorage.GetLength() );
+					dMvaStorage.Add ( iValues );
+					uint64_t uPrevMva = 0;
+					if ( bWide )
+					{
+						for ( ; iValues; iValues -= 2 )
+						{
+							uint64_t uMva = tIn.UnzipDelta ( uPrevMva );
+							dMvaStorage.Add ( (DWORD)uMva );
+							dMvaStorage.Add ( (DWORD)( uMva>>32 ) );
+						}
+					} else
+					{
+						while ( iValues-- )
+							dMvaStorage.Add ( (DWORD) tIn.UnzipDelta ( uPrevMva ) );
+					}
+					break;
+				}
+
+			case SPH_ATTR_FLOAT:
+				{
+					const BYTE * pValue = tIn.GetBytes ( 4 );
+					if ( pValue )
+						tMatch.SetAttr ( tLoc, pValue[0] | ( pValue[1]<<8 ) | ( pValue[2]<<16 ) | ( (DWORD)pValue[3]<<24 ) );
+					break;
+				}
+
+			case SPH_ATTR_BIGINT:
+				tMatch.SetAttr ( tLoc, tIn.UnzipDelta ( uPrev ) );
+				break;
+
+			case SPH_ATTR_STRING:
+			case SPH_ATTR_JSON:
+			case SPH_ATTR_STRINGPTR:
+				{
+					int iCode = (int) tIn.Unzip();
+					if ( iCode<0 || iCode>dDict.GetLength()+1 )
+					{
+						tIn.m_bError = true;
+						break;
+					}
+
+					bool bPooled = ( tAttr.m_eAttrType!=SPH_ATTR_STRINGPTR );
+					if ( iCode==dDict.GetLength()+1 )
+					{
+						// new value; pooled strings go to the storage right away
+						ColumnarDictEntry_t & tEntry = dDict.Add();
+						tEntry.m_iLen = (int) tIn.Unzip();
+						const BYTE * pStr = tIn.GetBytes ( tEntry.m_iLen );
+						if ( !pStr || !tEntry.m_iLen )
+						{
+							tIn.m_bError = true;
+							break;
+						}
+
+						tEntry.m_iOff = pStr-pData;
+						if ( bPooled )
+						{
+							int iOff = dStringsStorage.GetLength();
+							dStringsStorage.Resize ( iOff+4+tEntry.m_iLen );
+							int iPackedLen = sphPackStrlen ( dStringsStorage.Begin() + iOff, tEntry.m_iLen );
+							memcpy ( dStringsStorage.Begin() + iOff + iPackedLen, pStr, tEntry.m_iLen );
+							dStringsStorage.Resize ( iOff+iPackedLen+tEntry.m_iLen );
+							tEntry.m_iOff = iOff;
+						}
+					}
+
+					if ( !iCode )
+					{
+						tMatch.SetAttr ( tLoc, 0 );
+
+					} else if ( bPooled )
+					{
+						tMatch.SetAttr ( tLoc, dDict[iCode-1].m_iOff );
+
+					} else
+					{
+						const ColumnarDictEntry_t & tEntry = dDict[iCode-1];
+						char * sValue = new char [ tEntry.m_iLen+1 ];
+						memcpy ( sValue, pData+tEntry.m_iOff, tEntry.m_iLen );
+						sValue [ tEntry.m_iLen ] = '\0';
+						tMatch.SetAttr ( tLoc, (SphAttr_t) sValue );
+					}
+					break;
+				}
+
+			case SPH_ATTR_JSON_FIELD:
+				{
+					const BYTE * pType = tIn.GetBytes ( 1 );
+					if ( !pType )
+						break;
+
+					ESphJsonType eJson = (ESphJsonType)*pType;
+					if ( eJson==JSON_EOF )
+					{
+						tMatch.SetAttr ( tLoc, 0 );
+						break;
+					}
+
+					int iLen = sphJsonNodeSize ( eJson, NULL );
+					if ( iLen<0 )
+						iLen = (int) tIn.Unzip();
+					const BYTE * pData = tIn.GetBytes ( iLen );
+					if ( !pData )
+						break;
+
+					int iOff = dStringsStorage.GetLength();
+					tMatch.SetAttr ( tLoc, ( (int64_t)iOff ) | ( ( (int64_t)eJson )<<32 ) );
+					ColumnarAppend ( dStringsStorage, pData, iLen );
+					break;
+				}
+
+			case SPH_ATTR_FACTORS:
+			case SPH_ATTR_FACTORS_JSON:
+				{
+					DWORD uLength = (DWORD) tIn.Unzip();
+					if ( !uLength )
+					{
+						tMatch.SetAttr ( tLoc, 0 );
+						break;
+					}
+
+					const BYTE * pFactors = ( uLength>=sizeof(DWORD) ) ? tIn.GetBytes ( uLength-sizeof(DWORD) ) : NULL;
+					if ( !pFactors )
+					{
+						tIn.m_bError = true;
+						break;
+					}
+
+					BYTE * pData = new BYTE[uLength];
+					*(DWORD *)pData = uLength;
+					memcpy ( pData+sizeof(DWORD), pFactors, uLength-sizeof(DWORD) );
+					tMatch.SetAttr ( tLoc, (SphAttr_t) pData );
+					break;
+				}
+
+			default:
+				tMatch.SetAttr ( tLoc, (DWORD) tIn.UnzipDelta ( uPrev ) );
+				break;
+			}
+		}
+	}
+
+	return !tIn.m_bError && !tIn.Left();
+}
+
+//////////////////////////////////////////////////////////////////////////
+// JSON SECONDARY INDEXES
+//////////////////////////////////////////////////////////////////////////
+
+/// split a plain dot-separated JSON path (eg. "j.a.b") into the column and the keys
+/// subscripts and quoted keys are not supported
+static bool JsonIndexSplitPath ( const CSphString & sPath, CSphString & sColumn, CSphVector<CSphString> & dKeys )
+{
+	dKeys.Resize ( 0 );
+
+	CSphString sKeys;
+	if ( !sphJsonNameSplit ( sPath.cstr(), &sColumn, &sKeys ) || sKeys.IsEmpty() )
+		return false;
+	sColumn.ToLower();
+
+	const char * s = sKeys.cstr();
+	for ( ;; )
+	{
+		const char * sEnd = s;
+		while ( *sEnd && *sEnd!='.' )
+			if ( !sphIsAttr ( *sEnd++ ) )
+				return false;
+
+		if ( sEnd==s )
+			return false;
+		dKeys.Add().SetBinary ( s, sEnd-s );
+
+		if ( !*sEnd )
+			return true;
+		s = sEnd+1;
+	}
+}
+
+
+/// string values are hashed with ascii case folded, so that the index serves both binary and libc_ci collations
+static int64_t JsonIndexStrHash ( const BYTE * s, int iLen )
+{
+	BYTE dBuf[64];
+	uint64_t uHash = SPH_FNV64_SEED;
+	while ( iLen>0 )
+	{
+		int iChunk = Min ( iLen, (int)sizeof(dBuf) );
+		for ( int i=0; i<iChunk; i++ )
+			dBuf[i] = (BYTE) tolower ( s[i] );
+		uHash = sphFNV64 ( dBuf, iChunk, uHash );
+		s += iChunk;
+		iLen -= iChunk;
+	}
+	return (int64_t)uHash;
+}
+
+
+/// doubles are indexed truncated (just as JSON filters compare them against integer values)
+static int64_t JsonIndexDouble ( double fValue )
+{
+	if ( fValue<=(double)LLONG_MIN )
+		return LLONG_MIN;
+	if ( fValue>=(double)LLONG_MAX )
+		return LLONG_MAX;
+	return (int64_t)fValue;
+}
+
+
+/// collect rows of all the entries with values in [iMin, iMax]
+static void JsonIndexCollect ( const CSphVector<JsonIndexEntry_t> & dEntries, int64_t iMin, int64_t iMax, CSphVector<DWORD> & dRows )
+{
+	int iLo = 0, iHi = dEntries.GetLength();
+	while ( iLo<iHi )
+	{
+		int iMid = iLo + ( iHi-iLo )/2;
+		if ( dEntries[iMid].m_iValue<iMin )
+			iLo = iMid+1;
+		else
+			iHi = iMid;
+	}
+
+	for ( int i=iLo; i<dEntries.GetLength() && dEntries[i].m_iValue<=iMax; i++ )
+		dRows.Add ( dEntries[i].m_uRow );
+}
+
+
+bool CSphJsonIndex::Setup ( const CSphString & sPath, const CSphSchema & tSchema, CSphString & sError )
+{
+	CSphVector<CSphString> dKeys;
+	if ( !JsonIndexSplitPath ( sPath, m_sColumn, dKeys ) )
+	{
+		sError.SetSprintf ( "'%s' is not a plain JSON path (expected column.key[.key...])", sPath.cstr() );
+		return false;
+	}
+
+	const CSphColumnInfo * pAttr = tSchema.GetAttr ( m_sColumn.cstr() );
+	if ( !pAttr || pAttr->m_eAttrType!=SPH_ATTR_JSON )
+	{
+		sError.SetSprintf ( "'%s' is not a JSON attribute", m_sColumn.cstr() );
+		return false;
+	}
+
+	m_sPath = sPath;
+	m_tLocator = pAttr->m_tLocator;
+	m_dKeys.Resize ( 0 );
+	ARRAY_FOREACH ( i, dKeys )
+		m_dKeys.Add ( JsonKey_t ( dKeys[i].cstr(), dKeys[i].Length() ) );
+	m_bValid = true;
+	return true;
+}
+
+
+void CSphJsonIndex::Build ( const CSphRowitem * pRows, int64_t iRows, int iStride, const BYTE * pStrings )
+{
+	m_dNumbers.Resize ( 0 );
+	m_dStrings.Resize ( 0 );
+	if ( !pStrings )
+		return;
+
+	const CSphRowitem * pRow = pRows;
+	for ( int64_t iRow=0; iRow<iRows; iRow++, pRow+=iStride )
+	{
+		DWORD uOffset = (DWORD) sphGetRowAttr ( DOCINFO2ATTRS ( pRow ), m_tLocator );
+		if ( !uOffset )
+			continue;
+
+		const BYTE * pVal = NULL;
+		sphUnpackStr ( pStrings+uOffset, &pVal );
+		if ( !pVal )
+			continue;
+
+		ESphJsonType eType = sphJsonFindFirst ( &pVal );
+		for ( int i=0; i<m_dKeys.GetLength() && eType!=JSON_EOF; i++ )
+			eType = sphJsonFindByKey ( eType, &pVal, m_dKeys[i].m_sKey.cstr(), m_dKeys[i].m_iLen, m_dKeys[i].m_uMask );
+
+		JsonIndexEntry_t tEntry;
+		tEntry.m_uRow = (DWORD)iRow;
+		switch ( eType )
+		{
+		case JSON_INT32:
+			// values filters read int32 as unsigned, ranges as signed; keep both keys for negatives
+			tEntry.m_iValue = sphJsonLoadInt ( &pVal );
+			m_dNumbers.Add ( tEntry );
+			if ( tEntry.m_iValue<0 )
+			{
+				tEntry.m_iValue = (DWORD)tEntry.m_iValue;
+				m_dNumbers.Add ( tEntry );
+			}
+			break;
+		case JSON_INT64:	tEntry.m_iValue = sphJsonLoadBigint ( &pVal ); m_dNumbers.Add ( tEntry ); break;
+		case JSON_DOUBLE:	tEntry.m_iValue = JsonIndexDouble ( sphQW2D ( sphJsonLoadBigint ( &pVal ) ) ); m_dNumbers.Add ( tEntry ); break;
+		case JSON_STRING:
+			{
+				int iLen = sphJsonUnpackInt ( &pVal );
+				tEntry.m_iValue = JsonIndexStrHash ( pVal, iLen );
+				m_dStrings.Add ( tEntry );
+				break;
+			}
+		default:
+			break; // other types never pass the filters we serve
+		}
+	}
+
+	m_dNumbers.Sort();
+	m_dStrings.Sort();
+}
+
+
+bool CSphJsonIndex::Lookup ( const CSphFilterSettings & tFilter, ESphCollation eCollation, CSphVector<DWORD> & dRows ) const
+{
+	if ( !m_bValid || tFilter.m_bExclude )
+		return false;
+
+	// must be exactly our path
+	CSphString sColumn;
+	CSphVector<CSphString> dKeys;
+	if ( !JsonIndexSplitPath ( tFilter.m_sAttrName, sColumn, dKeys ) || sColumn!=m_sColumn || dKeys.GetLength()!=m_dKeys.GetLength() )
+		return false;
+	ARRAY_FOREACH ( i, dKeys )
+		if ( dKeys[i]!=m_dKeys[i].m_sKey )
+			return false;
+
+	// candidates are allowed to be a superset (eg. for exclusive ranges), filters are evaluated on them anyway
+	dRows.Resize ( 0 );
+	switch ( tFilter.m_eType )
+	{
+	case SPH_FILTER_VALUES:
+		for ( int i=0; i<tFilter.GetNumValues(); i++ )
+			JsonIndexCollect ( m_dNumbers, tFilter.GetValue(i), tFilter.GetValue(i), dRows );
+		break;
+
+	case SPH_FILTER_RANGE:
+		JsonIndexCollect ( m_dNumbers, tFilter.m_iMinValue, tFilter.m_iMaxValue, dRows );
+		break;
+
+	case SPH_FILTER_STRING:
+		{
+			// libc_ci folds ascii only (LC_CTYPE stays "C"); other collations might match differently encoded values
+			if ( !tFilter.m_bHasEqual || ( eCollation!=SPH_COLLATION_BINARY && eCollation!=SPH_COLLATION_LIBC_CI ) )
+				return false;
+			int64_t iHash = JsonIndexStrHash ( (const BYTE*)tFilter.m_sRefString.cstr(), tFilter.m_sRefString.Length() );
+			JsonIndexCollect ( m_dStrings, iHash, iHash, dRows );
+			break;
+		}
+
+	default:
+		return false;
+	}
+
+	dRows.Uniq();
+	return true;
+}
+
+
+void sphBuildJsonIndexes ( CSphVector<CSphJsonIndex> & dIndexes, const CSphVector<CSphString> & dPaths, const CSphSchema & tSchema,
+	const CSphRowitem * pRows, int64_t iRows, int iStride, const BYTE * pStrings, CSphString & sWarning )
+{
+	dIndexes.Reset();
+	ARRAY_FOREACH ( i, dPaths )
+	{
+		CSphJsonIndex tIndex;
+		CSphString sError;
+		if ( !tIndex.Setup ( dPaths[i], tSchema, sError ) )
+		{
+			if ( sWarning.IsEmpty() )
+				sWarning.SetSprintf ( "json_secondary_indexes: %s", sError.cstr() );
+			else
+				sWarning.SetSprintf ( "%s; %s", sWarning.cstr(), sError.cstr() );
+			continue;
+		}
+
+		dIndexes.Add ( tIndex );
+		dIndexes.Last().Build ( pRows, iRows, iStride, pStrings );
+	}
+}
+
+
+void sphInvalidateJsonIndexes ( CSphVector<CSphJsonIndex> & dIndexes, const char * sUpdatedAttr )
+{
+	CSphString sColumn;
+	if ( !dIndexes.GetLength() || !sphJsonNameSplit ( sUpdatedAttr, &sColumn, NULL ) )
+		return;
+
+	sColumn.ToLower();
+	ARRAY_FOREACH ( i, dIndexes )
+		if ( dIndexes[i].GetColumn()==sColumn )
+			dIndexes[i].Invalidate();
+}
+
+
+bool sphJsonIndexCandidates ( const CSphVector<CSphJsonIndex> & dIndexes, const CSphQuery * pQuery, CSphVector<DWORD> & dRows )
+{
+	if ( !dIndexes.GetLength() )
+		return false;
+
+	// all filters are ANDed, so intersect candidates over every filter that an index can serve
+	bool bFound = false;
+	CSphVector<DWORD> dFilterRows;
+	ARRAY_FOREACH ( iFilter, pQuery->m_dFilters )
+		ARRAY_FOREACH ( i, dIndexes )
+		{
+			if ( !dIndexes[i].Lookup ( pQuery->m_dFilters[iFilter], pQuery->m_eCollation, dFilterRows ) )
+				continue;
+
+			if ( !bFound )
+			{
+				dRows.SwapData ( dFilterRows );
+				bFound = true;
+				break;
+			}
+
+			int iOut = 0;
+			const DWORD * pA = dRows.Begin();
+			const DWORD * pAEnd = pA + dRows.GetLength();
+			const DWORD * pB = dFilterRows.Begin();
+			const DWORD * pBEnd = pB + dFilterRows.GetLength();
+			while ( pA<pAEnd && pB<pBEnd )
+			{
+				if ( *pA<*pB )
+					pA++;
+				else if ( *pB<*pA )
+					pB++;
+				else
+				{
+					dRows[iOut++] = *pA;
+					pA++;
+					pB++;
+				}
+			}
+			dRows.Resize ( iOut );
+			break;
+		}
+
+	return bFound;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// DOCID ORDERED ATTRIBUTES
+//////////////////////////////////////////////////////////////////////////
+
+static bool IsDocidOrdered ( const CSphColumnInfo & tCol, const CSphRowitem * pRows, int64_t iRows, int iStride )
+{
+	const CSphRowitem * pRow = pRows;
+	SphAttr_t iPrev = 0;
+	for ( int64_t iRow=0; iRow<iRows; iRow++, pRow+=iStride )
+	{
+		SphAttr_t iValue = sphGetRowAttr ( DOCINFO2ATTRS ( pRow ), tCol.m_tLocator );
+		if ( iRow>0 )
+		{
+			// same comparisons as the sorters do
+			bool bLess = ( tCol.m_eAttrType==SPH_ATTR_FLOAT )
+				? sphDW2F ( (DWORD)iValue )<sphDW2F ( (DWORD)iPrev )
+				: iValue<iPrev;
+			if ( bLess )
+				return false;
+		}
+		iPrev = iValue;
+	}
+	return true;
+}
+
+
+void sphCheckDocidOrderedAttrs ( CSphVector<DocidOrderedAttr_t> & dOrdered, const CSphVector<CSphString> & dDeclared,
+	const CSphSchema & tSchema, const CSphRowitem * pRows, int64_t iRows, int iStride, CSphString & sWarning )
+{
+	dOrdered.Reset();
+	ARRAY_FOREACH ( i, dDeclared )
+	{
+		CSphString sName = dDeclared[i];
+		sName.ToLower();
+
+		CSphString sError;
+		if ( sName!="id" )
+		{
+			const CSphColumnInfo * pCol = tSchema.GetAttr ( sName.cstr() );
+			if ( !pCol )
+				sError.SetSprintf ( "attribute '%s' not found", sName.cstr() );
+			else if ( pCol->m_eAttrType!=SPH_ATTR_INTEGER && pCol->m_eAttrType!=SPH_ATTR_TIMESTAMP && pCol->m_eAttrType!=SPH_ATTR_BOOL
+				&& pCol->m_eAttrType!=SPH_ATTR_BIGINT && pCol->m_eAttrType!=SPH_ATTR_FLOAT )
+				sError.SetSprintf ( "attribute '%s' is not an integer or float", sName.cstr() );
+			else if ( !IsDocidOrdered ( *pCol, pRows, iRows, iStride ) )
+				sError.SetSprintf ( "attribute '%s' decreases with docid", sName.cstr() );
+		}
+
+		if ( !sError.IsEmpty() )
+		{
+			if ( sWarning.IsEmpty() )
+				sWarning.SetSprintf ( "docid_ordered_attrs: %s", sError.cstr() );
+			else
+				sWarning.SetSprintf ( "%s; %s", sWarning.cstr(), sError.cstr() );
+			continue;
+		}
+
+		DocidOrderedAttr_t & tAttr = dOrdered.Add();
+		tAttr.m_sName = sName;
+		tAttr.m_bValid = true;
+	}
+}
+
+
+void sphInvalidateDocidOrderedAttr ( CSphVector<DocidOrderedAttr_t> & dOrdered, const char * sUpdatedAttr )
+{
+	ARRAY_FOREACH ( i, dOrdered )
+		if ( dOrdered[i].m_sName==sUpdatedAttr )
+			dOrdered[i].m_bValid = false;
+}
+
+
+bool sphCanStopEarly ( const CSphQuery * pQuery, int iSorters, ISphMatchSorter ** ppSorters,
+	const CSphVector<DocidOrderedAttr_t> & dOrdered, bool bFullscan, bool & bDesc )
+{
+	if ( !dOrdered.GetLength() || iSorters!=1 || ppSorters[0]->IsGroupby() || ppSorters[0]->m_bRandomize || pQuery->m_dOverrides.GetLength() )
+		return false;
+
+	const CSphMatchComparatorState & tState = ppSorters[0]->GetState();
+	switch ( pQuery->m_eSort )
+	{
+	case SPH_SORT_ATTR_ASC:
+	case SPH_SORT_ATTR_DESC:
+		// these break ties by weight, and that only stays constant in full-scan
+		if ( !bFullscan )
+			return false;
+		bDesc = ( pQuery->m_eSort==SPH_SORT_ATTR_DESC );
+		break;
+
+	case SPH_SORT_EXTENDED:
+		// docid tie-breaks are fine whatever their order; anything else is not
+		for ( int i=1; i<CSphMatchComparatorState::MAX_ATTRS; i++ )
+			if ( tState.m_eKeypart[i]!=SPH_KEYPART_ID )
+				return false;
+		bDesc = ( tState.m_uAttrDesc & 1 )!=0;
+		break;
+
+	default:
+		return false;
+	}
+
+	const char * sKey = NULL;
+	switch ( tState.m_eKeypart[0] )
+	{
+	case SPH_KEYPART_ID:
+		sKey = "id";
+		break;
+
+	case SPH_KEYPART_INT:
+	case SPH_KEYPART_FLOAT:
+	{
+		if ( tState.m_dAttrs[0]<0 || tState.m_tSubExpr[0] )
+			return false;
+
+		// only the stored attribute itself; an expression might be aliased to its name (eg. 0-id AS ts)
+		const CSphColumnInfo & tCol = ppSorters[0]->GetSchema().GetAttr ( tState.m_dAttrs[0] );
+		if ( tCol.m_pExpr.Ptr() || tCol.m_eStage!=SPH_EVAL_STATIC )
+			return false;
+		sKey = tCol.m_sName.cstr();
+		break;
+	}
+
+	default:
+		return false;
+	}
+
+	ARRAY_FOREACH ( i, dOrdered )
+		if ( dOrdered[i].m_bValid && dOrdered[i].m_sName==sKey )
+			return true;
+	return false;
+}
+
+
+
+struct DiskExpandedEntry_t
+{
+	int		m_iNameOff;
+	int		m_iDocs;
+	int		m_iHits;
+};
+
+struct DiskExpandedPayload_t
+{
+	int			m_iDocs;
+	int			m_iHits;
+	uint64_t	m_uDoclistOff;
+	int			m_iDoclistHint;
+};
+
+
+struct DictEntryDiskPayload_t
+{
+	explicit DictEntryDiskPayload_t ( bool bPayload, ESphHitless eHitless )
+	{
+		m_bPayload = bPayload;
+		m_eHitless = eHitless;
+		if ( bPayload )
+			m_dWordPayload.Reserve ( 1000 );
+
+		m_dWordExpand.Reserve ( 1000 );
+		m_dWordBuf.Reserve ( 8096 );
+	}
+
+	void Add ( const CSphDictEntry & tWord, int iWordLen )
+	{
+		if ( !m_bPayload || !sphIsExpandedPayload ( tWord.m_iDocs, tWord.m_iHits ) ||
+			m_eHitless==SPH_HITLESS_ALL || ( m_eHitless==SPH_HITLESS_SOME && ( tWord.m_iDocs & HITLESS_DOC_FLAG )!=0 ) ) // FIXME!!! do we need hitless=some as payloads?
+		{
+			DiskExpandedEntry_t & tExpand = m_dWordExpand.Add();
+
+			int iOff = m_dWordBuf.GetLength();
+			tExpand.m_iNameOff = iOff;
+			tExpand.m_iDocs = tWord.m_iDocs;
+			tExpand.m_iHits = tWord.m_iHits;
+			m_dWordBuf.Resize ( iOff + iWordLen + 1 );
+			memcpy ( m_dWordBuf.Begin() + iOff + 1, tWord.m_sKeyword, iWordLen );
+			m_dWordBuf[iOff] = (BYTE)iWordLen;
+
+		} else
+		{
+			DiskExpandedPayload_t & tExpand = m_dWordPayload.Add();
+			tExpand.m_iDocs = tWord.m_iDocs;
+			tExpand.m_iHits = tWord.m_iHits;
+			tExpand.m_uDoclistOff = tWord.m_iDoclistOffset;
+			tExpand.m_iDoclistHint = tWord.m_iDoclistHint;
+		}
+	}
+
+	void Convert ( ISphWordlist::Args_t & tArgs )
+	{
+		if ( !m_dWordExpand.GetLength() && !m_dWordPayload.GetLength() )
+			return;
+
+		int iTotalDocs = 0;
+		int iTotalHits = 0;
+		if ( m_dWordExpand.GetLength() )
+		{
+			LimitExpanded ( tArgs.m_iExpansionLimit, m_dWordExpand );
+
+			const BYTE * sBase = m_dWordBuf.Begin();
+			ARRAY_FOREACH ( i, m_dWordExpand )
+			{
+				const DiskExpandedEntry_t & tCur = m_dWordExpand[i];
+				int iDocs = tCur.m_iDocs;
+
+				if ( m_eHitless==SPH_HITLESS_SOME )
+					iDocs = ( tCur.m_iDocs & HITLESS_DOC_MASK );
+
+				tArgs.AddExpanded ( sBase + tCur.m_iNameOff + 1, sBase[tCur.m_iNameOff], iDocs, tCur.m_iHits );
+
+				iTotalDocs += iDocs;
+				iTotalHits += tCur.m_iHits;
+			}
+		}
+
+		if ( m_dWordPayload.GetLength() )
+		{
+			LimitExpanded ( tArgs.m_iExpansionLimit, m_dWordPayload );
+
+			DiskSubstringPayload_t * pPayload = new DiskSubstringPayload_t ( m_dWordPayload.GetLength() );
+			// sorting by ascending doc-list offset gives some (15%) speed-up too
+			sphSort ( m_dWordPayload.Begin(), m_dWordPayload.GetLength(), bind ( &DiskExpandedPayload_t::m_uDoclistOff ) );
+
+			ARRAY_FOREACH ( i, m_dWordPayload )
+			{
+				const DiskExpandedPayload_t & tCur = m_dWordPayload[i];
+				assert ( m_eHitless==SPH_HITLESS_NONE || ( m_eHitless==SPH_HITLESS_SOME && ( tCur.m_iDocs & HITLESS_DOC_FLAG )==0 ) );
+
+				iTotalDocs += tCur.m_iDocs;
+				iTotalHits += tCur.m_iHits;
+				pPayload->m_dDoclist[i].m_uOff = tCur.m_uDoclistOff;
+				pPayload->m_dDoclist[i].m_iLen = tCur.m_iDoclistHint;
+			}
+
+			pPayload->m_iTotalDocs = iTotalDocs;
+			pPayload->m_iTotalHits = iTotalHits;
+			tArgs.m_pPayload = pPayload;
+		}
+		tArgs.m_iTotalDocs = iTotalDocs;
+		tArgs.m_iTotalHits = iTotalHits;
+	}
+
+	// sort expansions by frequency desc
+	// clip the less frequent ones if needed, as they are likely misspellings
+	template < typename T >
+	void LimitExpanded ( int iExpansionLimit, CSphVector<T> & dVec ) const
+	{
+		if ( !iExpansionLimit || dVec.GetLength()<=iExpansionLimit )
+			return;
+
+		sphSort ( dVec.Begin(), dVec.GetLength(), ExpandedOrderDesc_T<T>() );
+		dVec.Resize ( iExpansionLimit );
+	}
+
+	bool								m_bPayload;
+	ESphHitless							m_eHitless;
+	CSphVector<DiskExpandedEntry_t>		m_dWordExpand;
+	CSphVector<DiskExpandedPayload_t>	m_dWordPayload;
+	CSphVector<BYTE>					m_dWordBuf;
+};
+
+
+void CWordlist::GetPrefixedWords ( const char * sSubstring, int iSubLen, const char * sWildcard, Args_t & tArgs ) const
+{
+	assert ( sSubstring && *sSubstring && iSubLen>0 );
+
+	// empty index?
+	if ( !m_dCheckpoints.GetLength() )
+		return;
+
+	DictEntryDiskPayload_t tDict2Payload ( tArgs.m_bPayload, tArgs.m_eHitless );
+
+	const CSphWordlistCheckpoint * pCheckpoint = FindCheckpoint ( sSubstring, iSubLen, 0, true );
+	const int iSkipMagic = ( BYTE(*sSubstring)<0x20 ); // whether to skip heading magic chars in the prefix, like NONSTEMMED maker
+	while ( pCheckpoint )
+	{
+		// decode wordlist chunk
+		KeywordsBlockReader_c tDictReader ( AcquireDict ( pCheckpoint ), m_bHaveSkips );
+		while ( tDictReader.UnpackWord() )
+		{
+			// block is sorted
+			// so once keywords are greater than the prefix, no more matches
+			int iCmp = sphDictCmp ( sSubstring, iSubLen, (const char *)tDictReader.m_sKeyword, tDictReader.GetWordLen() );
+			if ( iCmp<0 )
+				break;
+
+			// does it match the prefix *and* the entire wildcard?
+			if ( iCmp==0 && sphWildcardMatch ( (const char *)tDictReader.m_sKeyword + iSkipMagic, sWildcard ) )
+				tDict2Payload.Add ( tDictReader, tDictReader.GetWordLen() );
+		}
+
+		pCheckpoint++;
+		if ( pCheckpoint > &m_dCheckpoints.Last() )
+			break;
+
+		if ( sphDictCmp ( sSubstring, iSubLen, pCheckpoint->m_sWord, strlen ( pCheckpoint->m_sWord ) )<0 )
+			break;
+	}
+
+	tDict2Payload.Convert ( tArgs );
+}
+
+bool operator < ( const InfixBlock_t & a, const char * b )
+{
+	return strcmp ( a.m_sInfix, b )<0;
+}
+
+bool operator == ( const InfixBlock_t & a, const char * b )
+{
+	return strcmp ( a.m_sInfix, b )==0;
+}
+
+bool operator < ( const char * a, const InfixBlock_t & b )
+{
+	return strcmp ( a, b.m_sInfix )<0;
+}
+
+
+bool sphLookupInfixCheckpoints ( const char * sInfix, int iBytes, const BYTE * pInfixes, const CSphVector<InfixBlock_t> & dInfixBlocks, int iInfixCodepointBytes, CSphVector<int> & dCheckpoints )
+{
 	assert ( pInfixes );
 	dCheckpoints.Resize ( 0 );
 
@@ -31693,6 +34624,153 @@ int sphGetInfixLength ( const char * sInfix, int iBytes, int iInfixCodepointByte
 }
 
 
+void TrigramInfixes_c::Reset ()
+{
+	m_dWords.Reset();
+	m_dPairs.Reset();
+	m_dWordBuf.Reset();
+	m_dTrigrams.Reset();
+	m_dPostings.Reset();
+}
+
+
+void TrigramInfixes_c::AddWord ( const BYTE * sWord, int iLen, int64_t iEntryOff )
+{
+	int iWord = m_dWords.GetLength();
+	Word_t & tWord = m_dWords.Add();
+	tWord.m_iEntryOff = iEntryOff;
+	tWord.m_iNameOff = m_dWordBuf.GetLength();
+	BYTE * pName = m_dWordBuf.AddN ( iLen+1 );
+	memcpy ( pName, sWord, iLen );
+	pName[iLen] = '\0';
+
+	for ( int i=0; i+3<=iLen; i++ )
+		m_dPairs.Add ( ( uint64_t ( Pack ( sWord+i ) )<<32 ) | (DWORD)iWord );
+}
+
+
+void TrigramInfixes_c::Finish ()
+{
+	// sorted pairs are grouped by trigram, with ascending ordinals within each group
+	CSphVector<uint64_t> & dPairs = m_dPairs;
+	dPairs.Uniq();
+
+	BYTE dZipped[16];
+	int iStart = 0;
+	while ( iStart<dPairs.GetLength() )
+	{
+		Trigram_t & tTrigram = m_dTrigrams.Add();
+		tTrigram.m_uTrigram = (DWORD)( dPairs[iStart]>>32 );
+		tTrigram.m_iOffset = m_dPostings.GetLength();
+
+		DWORD uLast = 0;
+		int iEnd = iStart;
+		for ( ; iEnd<dPairs.GetLength() && (DWORD)( dPairs[iEnd]>>32 )==tTrigram.m_uTrigram; iEnd++ )
+		{
+			DWORD uWord = (DWORD)( dPairs[iEnd] & 0xffffffffUL );
+			int iZipped = sphEncodeVLB8 ( dZipped, uWord-uLast );
+			memcpy ( m_dPostings.AddN ( iZipped ), dZipped, iZipped );
+			uLast = uWord;
+		}
+
+		tTrigram.m_iCount = iEnd - iStart;
+		iStart = iEnd;
+	}
+
+	dPairs.Reset();
+}
+
+
+int64_t TrigramInfixes_c::GetSizeBytes () const
+{
+	return (int64_t)m_dWords.GetSizeBytes() + m_dWordBuf.GetSizeBytes() + m_dTrigrams.GetSizeBytes() + m_dPostings.GetSizeBytes();
+}
+
+
+struct TrigramCountLess_fn
+{
+	template < typename T >
+	bool IsLess ( const T * a, const T * b ) const
+	{
+		return a->m_iCount < b->m_iCount;
+	}
+};
+
+
+bool TrigramInfixes_c::GetCandidates ( const BYTE * sSubstring, int iSubLen, CSphVector<int> & dWords ) const
+{
+	dWords.Resize ( 0 );
+	if ( iSubLen<3 )
+		return false;
+
+	// every trigram of the substring must be there
+	CSphVector<const Trigram_t *> dLists;
+	for ( int i=0; i+3<=iSubLen; i++ )
+	{
+		const Trigram_t * pTrigram = m_dTrigrams.BinarySearch ( TrigramKey_fn(), Pack ( sSubstring+i ) );
+		if ( !pTrigram )
+			return true;
+		dLists.Add ( pTrigram );
+	}
+
+	// intersect starting from the shortest list
+	dLists.Uniq();
+	dLists.Sort ( TrigramCountLess_fn() );
+
+	const BYTE * pCur = m_dPostings.Begin() + dLists[0]->m_iOffset;
+	dWords.Resize ( dLists[0]->m_iCount );
+	DWORD uLast = 0;
+	ARRAY_FOREACH ( i, dWords )
+	{
+		uint64_t uDelta = 0;
+		pCur = spnDecodeVLB8 ( pCur, uDelta );
+		uLast += (DWORD)uDelta;
+		dWords[i] = (int)uLast;
+	}
+
+	for ( int iList=1; iList<dLists.GetLength() && dWords.GetLength(); iList++ )
+	{
+		pCur = m_dPostings.Begin() + dLists[iList]->m_iOffset;
+		int iLeft = dLists[iList]->m_iCount;
+		uLast = 0;
+
+		int iSrc = 0, iDst = 0;
+		while ( iSrc<dWords.GetLength() && iLeft>0 )
+		{
+			uint64_t uDelta = 0;
+			pCur = spnDecodeVLB8 ( pCur, uDelta );
+			uLast += (DWORD)uDelta;
+			iLeft--;
+
+			while ( iSrc<dWords.GetLength() && (DWORD)dWords[iSrc]<uLast )
+				iSrc++;
+			if ( iSrc<dWords.GetLength() && (DWORD)dWords[iSrc]==uLast )
+				dWords[iDst++] = dWords[iSrc++];
+		}
+		dWords.Resize ( iDst );
+	}
+
+	return true;
+}
+
+
+void CWordlist::BuildTrigrams ()
+{
+	if ( !m_bWordDict || !m_iInfixCodepointBytes || m_pBuf.IsEmpty() )
+		return;
+
+	m_tTrigrams.Reset();
+	const BYTE * pBuf = m_pBuf.GetWritePtr();
+	ARRAY_FOREACH ( iCP, m_dCheckpoints )
+	{
+		KeywordsBlockReader_c tReader ( pBuf + m_dCheckpoints[iCP].m_iWordlistOffset, m_bHaveSkips );
+		while ( tReader.UnpackWord() )
+			m_tTrigrams.AddWord ( (const BYTE *)tReader.GetWord(), tReader.GetWordLen(), tReader.GetEntryData() - pBuf );
+	}
+	m_tTrigrams.Finish();
+}
+
+
 void CWordlist::GetInfixedWords ( const char * sSubstring, int iSubLen, const char * sWildcard, Args_t & tArgs ) const
 {
 	// dict must be of keywords type, and fully cached
@@ -31700,6 +34778,32 @@ void CWordlist::GetInfixedWords ( const char * sSubstring, int iSubLen, const ch
 	if ( m_pBuf.IsEmpty() || !m_dCheckpoints.GetLength() )
 		return;
 
+	// trigram index path, no dictionary blocks decoding at all
+	CSphVector<int> dWords;
+	if ( !m_tTrigrams.IsEmpty() && m_tTrigrams.GetCandidates ( (const BYTE *)sSubstring, iSubLen, dWords ) )
+	{
+		DictEntryDiskPayload_t tDict2Payload ( tArgs.m_bPayload, tArgs.m_eHitless );
+		const int iSkipMagic = ( tArgs.m_bHasMorphology ? 1 : 0 );
+
+		CSphDictEntry tEntry;
+		ARRAY_FOREACH ( i, dWords )
+		{
+			const BYTE * sWord = m_tTrigrams.GetWord ( dWords[i] );
+			if ( tArgs.m_bHasMorphology && *sWord!=MAGIC_WORD_HEAD_NONSTEMMED )
+				continue;
+
+			if ( !sphWildcardMatch ( (const char *)sWord+iSkipMagic, sWildcard ) )
+				continue;
+
+			KeywordsBlockReader_c::UnpackEntryData ( m_pBuf.GetWritePtr() + m_tTrigrams.GetEntryOffset ( dWords[i] ), m_bHaveSkips, tEntry );
+			tEntry.m_sKeyword = sWord;
+			tDict2Payload.Add ( tEntry, strlen ( (const char *)sWord ) );
+		}
+
+		tDict2Payload.Convert ( tArgs );
+		return;
+	}
+
 	// extract key1, upto 6 chars from infix start
 	int iBytes1 = sphGetInfixLength ( sSubstring, iSubLen, m_iInfixCodepointBytes );
 
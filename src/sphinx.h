@@ -1282,6 +1282,57 @@ inline int sphUnpackStr ( const BYTE * pRow, const BYTE ** ppStr )
 }
 
 
+/// init per-thread match arenas (until then, all dynamic rows come from the heap)
+bool			sphInitMatchArena ();
+
+/// clean up per-thread match arenas
+void			sphDoneMatchArena ();
+
+/// allocate dynamic match row, from the current thread's match arena if any
+CSphRowitem *	sphAllocDynamicRow ( int iDynamic );
+
+/// free dynamic match row (arena ones are left to their arena)
+void			sphFreeDynamicRow ( CSphRowitem * pRow );
+
+
+class CSphMatch;
+
+/// per-query match arena
+/// carves dynamic match rows out of big chunks instead of allocating every row on the heap
+/// rows are never freed one by one; the whole arena goes away at query end, so the rows
+/// that must outlive the query (ie. result ones) have to be detached first
+class CSphMatchArena : public ISphNoncopyable
+{
+public:
+					CSphMatchArena ();
+					~CSphMatchArena ();
+
+	void			Start ();	///< make this arena current for the calling thread
+	void			Stop ();	///< restore previously current arena; arenas must stop in reverse start order
+
+	CSphRowitem *	Alloc ( int iDynamic );
+	static void		Free ( CSphRowitem * pRow );
+	bool			Owns ( const CSphRowitem * pRow ) const;
+
+	/// move rows carved by this arena to the heap, so that these matches could outlive it
+	void			Detach ( CSphMatch * pMatches, int iCount ) const;
+
+	int64_t			GetReservedBytes () const { return m_iReserved; }	///< total bytes of chunks carved by this arena so far
+
+private:
+	struct Chunk_t;
+
+	Chunk_t *		m_pChunks;		///< all my chunks, newest first
+	Chunk_t *		m_pLast;		///< chunk we carved the last row from
+	int				m_iNextSize;	///< next chunk size, in rowitems
+	int64_t			m_iReserved;	///< bytes reserved in all chunks so far
+	bool			m_bStarted;
+	CSphMatchArena *	m_pPrev;
+
+	const Chunk_t *	FindChunk ( const CSphRowitem * pRow ) const;
+};
+
+
 /// search query match (document info plus weight/tag)
 class CSphMatch
 {
@@ -1319,11 +1370,8 @@ public:
 	/// dtor. frees everything
 	~CSphMatch ()
 	{
-#ifndef NDEBUG
 		if ( m_pDynamic )
-			m_pDynamic--;
-#endif
-		SafeDeleteArray ( m_pDynamic );
+			sphFreeDynamicRow ( m_pDynamic );
 	}
 
 	/// reset
@@ -1336,12 +1384,7 @@ public:
 		m_uDocID = 0;
 		if ( !m_pDynamic && iDynamic )
 		{
-#ifndef NDEBUG
-			m_pDynamic = new CSphRowitem [ iDynamic+1 ];
-			*m_pDynamic++ = iDynamic;
-#else
-			m_pDynamic = new CSphRowitem [ iDynamic ];
-#endif
+			m_pDynamic = sphAllocDynamicRow ( iDynamic );
 			// dynamic stuff might contain pointers now (STRINGPTR type)
 			// so we gotta cleanup
 			memset ( m_pDynamic, 0, iDynamic*sizeof(CSphRowitem) );
@@ -1367,14 +1410,7 @@ private:
 		if ( iDynamic )
 		{
 			if ( !m_pDynamic )
-			{
-#ifndef NDEBUG
-				m_pDynamic = new CSphRowitem [ iDynamic+1 ];
-				*m_pDynamic++ = iDynamic;
-#else
-				m_pDynamic = new CSphRowitem [ iDynamic ];
-#endif
-			}
+				m_pDynamic = sphAllocDynamicRow ( iDynamic );
 
 			if ( this!=&rhs )
 			{
@@ -1992,6 +2028,10 @@ public:
 	/// get next kill list doc id
 	virtual bool						IterateKillListNext ( SphDocID_t & uDocId ) = 0;
 
+	/// get current document full-text fields, valid after IterateDocument() until the next call
+	/// returns NULL if the source can not provide them; iFields receives the number of fields returned
+	virtual BYTE **						GetFieldTexts ( int & iFields ) { iFields = 0; return NULL; }
+
 	/// post-index callback
 	/// gets called when the indexing is succesfully (!) over
 	virtual void						PostIndex () {}
@@ -2048,6 +2088,7 @@ public:
 	virtual SphRange_t		IterateFieldMVAStart ( int iAttr );
 	virtual bool			IterateFieldMVAStart ( int, CSphString & ) { assert ( 0 && "not implemented" ); return false; }
 	virtual bool			HasJoinedFields () { return m_iPlainFieldsLength!=m_tSchema.m_dFields.GetLength(); }
+	virtual BYTE **			GetFieldTexts ( int & iFields ) { iFields = m_iPlainFieldsLength; return m_tState.m_dFields; }
 
 protected:
 	int						ParseFieldMVA ( CSphVector < DWORD > & dMva, const char * szValue, bool bMva64 ) const;
@@ -2733,6 +2774,12 @@ struct CSphQueryStats
 	DWORD		m_iFetchedDocs;		///< processed documents
 	DWORD		m_iFetchedHits;		///< processed hits (aka positions)
 	DWORD		m_iSkips;			///< number of Skip() calls
+	int64_t		m_iDoclistBytes;	///< bytes read from doclists (.spd)
+	int64_t		m_iHitlistBytes;	///< bytes read from hitlists (.spp)
+	int64_t		m_iDocinfoBytes;	///< bytes of row attributes (.spa) accessed
+	int64_t		m_iPushedMatches;	///< matches pushed to sorters
+	int64_t		m_iFilterEvals;		///< filter evaluations
+	int64_t		m_iArenaBytes;		///< bytes of match arena chunks reserved
 
 				CSphQueryStats();
 
@@ -2774,7 +2821,8 @@ public:
 	DWORD					m_iAgentFetchedHits;	///< distributed fetched hits
 	DWORD					m_iAgentFetchedSkips;	///< distributed fetched skips
 
-	CSphQueryStats 			m_tStats;			///< query prediction counters
+	CSphQueryStats 			m_tStats;			///< query work and prediction counters
+	CSphQueryStats			m_tAgentStats;		///< agent work counters (for distributed searches)
 	bool					m_bHasPrediction;	///< is prediction counters set?
 
 	CSphString				m_sError;			///< error message
@@ -3096,6 +3144,9 @@ public:
 
 	/// get a pointer to the worst element, NULL if there is no fixed location
 	virtual const CSphMatch *	GetWorst() const { return NULL; }
+
+	/// check if the queue is full, and the entry is worse than everything in it (ie. Push() would drop it)
+	virtual bool		WouldReject ( const CSphMatch & ) const { return false; }
 };
 
 
@@ -3154,6 +3205,8 @@ struct CSphIndexSettings : public CSphSourceSettings
 
 	CSphString		m_sIndexTokenFilter;	///< indexing time token filter spec string (pretty useless for disk, vital for RT)
 
+	CSphVector<CSphString>	m_dStoredFields;	///< full-text fields whose original text is kept in the document storage
+
 					CSphIndexSettings ();
 };
 
@@ -3179,6 +3232,9 @@ struct CSphIndexStatus
 	int64_t			m_iRamChunkSize; // not used for plain
 	int				m_iNumChunks; // not used for plain
 	int64_t			m_iMemLimit; // not used for plain
+	int64_t			m_iExpansionCacheHits;
+	int64_t			m_iExpansionCacheMisses;
+	int64_t			m_iExpansionCacheBytes;
 
 	CSphIndexStatus()
 		: m_iRamUse ( 0 )
@@ -3186,6 +3242,9 @@ struct CSphIndexStatus
 		, m_iRamChunkSize ( 0 )
 		, m_iNumChunks ( 0 )
 		, m_iMemLimit ( 0 )
+		, m_iExpansionCacheHits ( 0 )
+		, m_iExpansionCacheMisses ( 0 )
+		, m_iExpansionCacheBytes ( 0 )
 	{}
 };
 
@@ -3197,6 +3256,23 @@ struct KillListTrait_t
 
 typedef CSphVector<KillListTrait_t> KillListVector;
 
+class CSphExpansionCache;
+class CSphDeadRows;
+
+
+/// stored fields of an index as of some moment, usually as of the search that made it
+/// searches bind it to the stored field expressions once, and these keep it for as long as they need,
+/// maybe past the search itself (eg. to build snippets of the final matches)
+class ISphStoredFields : public ISphRefcountedMT
+{
+public:
+	/// fetch original text of a stored field by docid; fields are numbered as in the index settings
+	/// text is a new[] allocated zero-terminated copy (NULL if empty, or if the document is deleted)
+	/// returns false if there is no such document at all
+	virtual bool			GetField ( SphDocID_t uDocid, int iField, BYTE ** ppText, int * pLen ) const = 0;
+};
+
+
 struct CSphMultiQueryArgs : public ISphNoncopyable
 {
 	const KillListVector &					m_dKillList;
@@ -3206,6 +3282,8 @@ struct CSphMultiQueryArgs : public ISphNoncopyable
 	bool									m_bLocalDF;
 	const SmallStringHash_T<int64_t> *		m_pLocalDocs;
 	int64_t									m_iTotalDocs;
+	const CSphDeadRows *					m_pDeadRows;	///< rows to skip as deleted (maybe NULL)
+	ISphStoredFields *						m_pStoredFields;	///< stored fields snapshot to bind to the expressions (NULL to use the index own one)
 
 	CSphMultiQueryArgs ( const KillListVector & dKillList, int iIndexWeight );
 };
@@ -3302,6 +3380,12 @@ public:
 	/// return additional index info
 	virtual void				GetStatus ( CSphIndexStatus* ) const = 0;
 
+	/// add wildcard expansion cache counters to index info
+	virtual void				GetExpansionCacheStatus ( CSphIndexStatus * pRes ) const;
+
+	/// make a snapshot of the stored fields (NULL if the index keeps none); rows in pDeadRows are skipped as deleted
+	virtual ISphStoredFields *	CreateStoredFields ( const CSphDeadRows * ) const { return NULL; }
+
 public:
 	virtual bool				EarlyReject ( CSphQueryContext * pCtx, CSphMatch & tMatch ) const = 0;
 	void						SetCacheSize ( int iMaxCachedDocs, int iMaxCachedHits );
@@ -3357,13 +3441,23 @@ public:
 	/// internal replace kill-list and rewrite spk file, DO NOT USE
 	virtual bool				ReplaceKillList ( const SphDocID_t *, int ) { return true; }
 
+	/// internal find row numbers of documents (in the documents order, missing ones are skipped), DO NOT USE
+	virtual void				LookupRows ( const SphDocID_t *, int, CSphVector<DWORD> & ) const {}
+
 public:
 	int64_t						m_iTID;
 
 	bool						m_bExpandKeywords;		///< enable automatic query-time keyword expansion (to "( word | =word | *word* )")
 	int							m_iExpansionLimit;
+	bool						m_bInfixTrigrams;		///< build in-memory trigram index over dictionary on load, for faster infix expansion
+	CSphVector<CSphString>		m_dJsonIndexPaths;		///< JSON subkeys (eg. j.category) to build in-memory secondary indexes for, on load
+	CSphVector<CSphString>		m_dDocidOrderedAttrs;	///< attributes declared non-decreasing with docid (checked on load), for early terminating top-K searches
+
+	/// set wildcard expansion cache size, in bytes (0 disables the cache)
+	void						SetExpansionCacheSize ( int64_t iMaxBytes );
 
 protected:
+	CSphExpansionCache *		m_pExpansionCache;		///< per-index cache of wildcard expansions
 
 	CSphSchema					m_tSchema;
 	CSphString					m_sLastError;
@@ -1133,6 +1133,131 @@ private:
 };
 
 
+/// functor that re-encodes a slice token cache into the whole document cache
+/// shifting byte offsets and token positions by the slice start
+class CacheRebaser_c
+{
+public:
+	DWORD	m_uMaxPos;
+
+	CacheRebaser_c ( CacheStreamer_c & tDst, int iStartDelta, DWORD uPosDelta )
+		: m_uMaxPos ( 0 )
+		, m_tDst ( tDst )
+		, m_iStartDelta ( iStartDelta )
+		, m_uPosDelta ( uPosDelta )
+	{}
+
+	bool OnToken ( TokenInfo_t & tTok, const CSphVector<SphWordID_t> & )
+	{
+		m_uMaxPos = Max ( m_uMaxPos, tTok.m_uPosition );
+		tTok.m_iStart += m_iStartDelta;
+		tTok.m_uPosition += m_uPosDelta;
+		m_tDst.StoreToken ( tTok );
+		return true;
+	}
+
+	bool OnOverlap ( int iStart, int iLen, int iBoundary )
+	{
+		m_tDst.StoreOverlap ( iStart+m_iStartDelta, iLen, iBoundary<0 ? iBoundary : iBoundary+m_iStartDelta );
+		return true;
+	}
+
+	void OnSkipHtml ( int iStart, int iLen )
+	{
+		m_tDst.StoreSkipHtml ( iStart+m_iStartDelta, iLen );
+	}
+
+	void OnSPZ ( BYTE iSPZ, DWORD uPosition, const char * szZone, int iZone )
+	{
+		m_tDst.StoreSPZ ( iSPZ, uPosition ? uPosition+m_uPosDelta : 0, szZone, iZone );
+	}
+
+	void OnTail ( int iStart, int iLen, int iBoundary )
+	{
+		m_tDst.StoreTail ( iStart+m_iStartDelta, iLen, iBoundary<0 ? iBoundary : iBoundary+m_iStartDelta );
+	}
+
+	void OnFinish () {}
+
+private:
+	CacheStreamer_c &	m_tDst;
+	int					m_iStartDelta;
+	DWORD				m_uPosDelta;
+};
+
+
+/// functor that matches keywords over a document slice, and stores the tokens along with their term indexes
+/// so that passages could be collected off the merged token cache later, just like with the collected hits
+class SliceCollector_c : public TokenFunctorTraits_c
+{
+public:
+	CSphVector<SphHitMark_t>	m_dHits;
+	DWORD						m_uFoundWords;
+	bool						m_bTail;
+
+public:
+	SliceCollector_c ( SnippetsDocIndex_c & tContainer, ISphTokenizer * pTokenizer,
+		CSphDict * pDict, const ExcerptQuery_t & tQuery, const CSphIndexSettings & tSettingsIndex,
+		const char * sDoc, int iDocLen, CacheStreamer_c & tTokenContainer )
+		: TokenFunctorTraits_c ( tContainer, pTokenizer, pDict, tQuery, tSettingsIndex, sDoc, iDocLen )
+		, m_uFoundWords ( 0 )
+		, m_bTail ( false )
+		, m_tTokenContainer ( tTokenContainer )
+	{}
+
+	bool OnToken ( TokenInfo_t & tTok, const CSphVector<SphWordID_t> & dTokens )
+	{
+		int iTermIndex = m_tContainer.FindWord ( tTok.m_uWordId, tTok.m_sWord, tTok.m_iLen );
+		ARRAY_FOREACH_COND ( i, dTokens, iTermIndex==-1 )
+			iTermIndex = m_tContainer.FindWord ( dTokens[i], NULL, 0 );
+
+		if ( iTermIndex!=-1 )
+		{
+			m_uFoundWords |= 1 << iTermIndex;
+			SphHitMark_t & tHit = m_dHits.Add();
+			tHit.m_uPosition = tTok.m_uPosition;
+			tHit.m_uSpan = 1;
+		}
+
+		tTok.m_iTermIndex = iTermIndex;
+		m_tTokenContainer.StoreToken ( tTok );
+		return true;
+	}
+
+	bool OnOverlap ( int iStart, int iLen, int iBoundary )
+	{
+		m_tTokenContainer.StoreOverlap ( iStart, iLen, iBoundary );
+		return true;
+	}
+
+	void OnSkipHtml ( int iStart, int iLen )
+	{
+		m_tTokenContainer.StoreSkipHtml ( iStart, iLen );
+	}
+
+	void OnSPZ ( BYTE iSPZ, DWORD uPosition, const char * szZone, int iZone )
+	{
+		m_tTokenContainer.StoreSPZ ( iSPZ, uPosition, szZone, iZone );
+	}
+
+	void OnTail ( int iStart, int iLen, int iBoundary )
+	{
+		m_bTail = true;
+		m_tTokenContainer.StoreTail ( iStart, iLen, iBoundary );
+	}
+
+	void OnFinish () {}
+
+	const CSphVector<int> * GetHitlist ( const XQKeyword_t & ) const
+	{
+		return NULL;
+	}
+
+private:
+	CacheStreamer_c &	m_tTokenContainer;
+};
+
+
 /// functor that processes tokens and collects matching keyword hits into mini-index
 class HitCollector_c : public TokenFunctorTraits_c
 {
@@ -2275,6 +2400,7 @@ public:
 		case STATE_ADD_WORD:
 			break;
 		}
+
 		SubmitPassages();
 	}
 
@@ -3413,6 +3539,388 @@ static void FixupQueryLimits ( const SnippetsDocIndex_c & tContainer, const Exce
 }
 
 
+//////////////////////////////////////////////////////////////////////////
+// SNIPPET WORKERS
+//////////////////////////////////////////////////////////////////////////
+
+static const int		SNIPPET_SLICE_MIN		= 64*1024;	///< min document slice to score in a separate worker, in bytes
+
+
+/// a job queued to the snippet workers
+struct SnippetJob_t
+{
+	void				( *m_fnJob )( void * );
+	void *				m_pArg;
+	CSphSnippetJobs *	m_pOwner;
+};
+
+
+/// persistent snippet workers, started on first use and fed from a job queue
+/// slots are granted up to the number of workers, so every queued job always has a worker to run on,
+/// even if jobs run by the workers queue jobs of their own
+class SnippetPool_c : public ISphNoncopyable
+{
+public:
+	SnippetPool_c ()
+		: m_iThreads ( 0 )
+		, m_iBusy ( 0 )
+		, m_bStop ( false )
+		, m_fnCreate ( NULL )
+	{
+		Verify ( m_tLock.Init() );
+		Verify ( m_tJobReady.Init ( &m_tLock ) );
+	}
+
+	~SnippetPool_c ()
+	{
+		Shutdown();
+		m_tJobReady.Done();
+		m_tLock.Done();
+	}
+
+	void Setup ( int iThreads, SnippetThreadCreate_fn fnCreate )
+	{
+		Shutdown();
+		m_iThreads = Max ( iThreads, 0 );
+		m_fnCreate = fnCreate;
+	}
+
+	int GetThreads () const
+	{
+		return m_iThreads;
+	}
+
+	void Shutdown ()
+	{
+		m_tLock.Lock();
+		m_bStop = true;
+		m_tJobReady.SetEvent();
+		m_tLock.Unlock();
+
+		ARRAY_FOREACH ( i, m_dThreads )
+			sphThreadJoin ( &m_dThreads[i] );
+		m_dThreads.Reset();
+		m_bStop = false;
+	}
+
+	int Acquire ( int iWanted )
+	{
+		if ( iWanted<=0 || !m_iThreads )
+			return 0;
+
+		CSphScopedLock<CSphMutex> tLock ( m_tLock );
+
+		// start the workers on first use, so that they run in the process that needs them (forked children included)
+		if ( m_dThreads.GetLength()<m_iThreads && !m_bStop )
+		{
+			m_dThreads.Reserve ( m_iThreads );
+			while ( m_dThreads.GetLength()<m_iThreads )
+			{
+				SphThread_t & tThd = m_dThreads.Add();
+				bool bOk = m_fnCreate
+					? m_fnCreate ( &tThd, WorkerFunc, this, false )
+					: sphThreadCreate ( &tThd, WorkerFunc, this );
+				if ( !bOk )
+				{
+					sphWarning ( "failed to create snippet worker thread, running %d out of %d", m_dThreads.GetLength()-1, m_iThreads );
+					m_dThreads.Pop();
+					m_iThreads = m_dThreads.GetLength();
+					break;
+				}
+			}
+		}
+
+		int iGranted = Max ( Min ( iWanted, m_dThreads.GetLength()-m_iBusy ), 0 );
+		m_iBusy += iGranted;
+		return iGranted;
+	}
+
+	void Release ( int iSlots )
+	{
+		if ( iSlots<=0 )
+			return;
+
+		CSphScopedLock<CSphMutex> tLock ( m_tLock );
+		m_iBusy -= iSlots;
+		assert ( m_iBusy>=0 );
+	}
+
+	void Push ( const SnippetJob_t & tJob )
+	{
+		CSphScopedLock<CSphMutex> tLock ( m_tLock );
+		assert ( m_dQueue.GetLength()<m_iBusy );
+		m_dQueue.Add ( tJob );
+		tJob.m_pOwner->m_iPending++;
+		m_tJobReady.SetEvent();
+	}
+
+	CSphMutex & GetLock ()
+	{
+		return m_tLock;
+	}
+
+private:
+	CSphMutex					m_tLock;		///< guards everything below, and the pending counters of the job groups
+	CSphAutoEvent				m_tJobReady;
+	CSphVector<SphThread_t>		m_dThreads;
+	CSphVector<SnippetJob_t>	m_dQueue;
+	int							m_iThreads;		///< pool size
+	int							m_iBusy;		///< worker slots currently granted
+	bool						m_bStop;
+	SnippetThreadCreate_fn		m_fnCreate;
+
+	static void WorkerFunc ( void * pArg )
+	{
+		SnippetPool_c * pPool = (SnippetPool_c *)pArg;
+		for ( ;; )
+		{
+			pPool->m_tLock.Lock();
+			while ( !pPool->m_dQueue.GetLength() && !pPool->m_bStop )
+			{
+				pPool->m_tLock.Unlock();
+				pPool->m_tJobReady.WaitEvent();
+				pPool->m_tLock.Lock();
+			}
+
+			// the event wakes one worker at a time, so pass it on while there is something left to do (or to stop)
+			if ( !pPool->m_dQueue.GetLength() )
+			{
+				pPool->m_tJobReady.SetEvent();
+				pPool->m_tLock.Unlock();
+				return;
+			}
+
+			SnippetJob_t tJob = pPool->m_dQueue[0];
+			pPool->m_dQueue.Remove ( 0 );
+			if ( pPool->m_dQueue.GetLength() )
+				pPool->m_tJobReady.SetEvent();
+			pPool->m_tLock.Unlock();
+
+			tJob.m_fnJob ( tJob.m_pArg );
+
+			pPool->m_tLock.Lock();
+			tJob.m_pOwner->m_iPending--;
+			tJob.m_pOwner->m_tDone.SetEvent();
+			pPool->m_tLock.Unlock();
+		}
+	}
+};
+
+static SnippetPool_c g_tSnippetPool;
+
+
+void sphSetSnippetThreads ( int iThreads, SnippetThreadCreate_fn fnCreate )
+{
+	g_tSnippetPool.Setup ( iThreads, fnCreate );
+}
+
+
+int sphGetSnippetThreads ()
+{
+	return g_tSnippetPool.GetThreads();
+}
+
+
+void sphShutdownSnippetThreads ()
+{
+	g_tSnippetPool.Shutdown();
+}
+
+
+int sphSnippetThreadsAcquire ( int iWanted )
+{
+	return g_tSnippetPool.Acquire ( iWanted );
+}
+
+
+void sphSnippetThreadsRelease ( int iSlots )
+{
+	g_tSnippetPool.Release ( iSlots );
+}
+
+
+CSphSnippetJobs::CSphSnippetJobs ()
+	: m_iPending ( 0 )
+{
+	Verify ( m_tDone.Init ( &g_tSnippetPool.GetLock() ) );
+}
+
+
+CSphSnippetJobs::~CSphSnippetJobs ()
+{
+	Wait();
+	m_tDone.Done();
+}
+
+
+void CSphSnippetJobs::Run ( void ( *fnJob )( void * ), void * pArg )
+{
+	SnippetJob_t tJob;
+	tJob.m_fnJob = fnJob;
+	tJob.m_pArg = pArg;
+	tJob.m_pOwner = this;
+	g_tSnippetPool.Push ( tJob );
+}
+
+
+void CSphSnippetJobs::Wait ()
+{
+	for ( ;; )
+	{
+		g_tSnippetPool.GetLock().Lock();
+		int iPending = m_iPending;
+		g_tSnippetPool.GetLock().Unlock();
+		if ( !iPending )
+			return;
+		m_tDone.WaitEvent();
+	}
+}
+
+
+/// whether the dictionary can be shared between worker threads
+static bool IsDictThreadSafe ( const CSphDict * pDict )
+{
+	if ( pDict->HasState() )
+		return false;
+
+#if USE_RLP
+	return false;
+#else
+	// exact and star wrappers do not forward HasState(), so check the stemmers by name
+	const CSphString & sMorph = pDict->GetSettings().m_sMorphology;
+	return !( sMorph.Length() && strstr ( sMorph.cstr(), "libstemmer_" ) );
+#endif
+}
+
+
+/// a document slice tokenized by a separate worker
+struct ExcerptSlice_t
+{
+	int						m_iStart;
+	int						m_iLen;
+	ISphTokenizer *			m_pTokenizer;
+	CacheStreamer_c *		m_pStreamer;
+	SliceCollector_c *		m_pCollector;
+
+	ExcerptSlice_t ()
+		: m_iStart ( 0 )
+		, m_iLen ( 0 )
+		, m_pTokenizer ( NULL )
+		, m_pStreamer ( NULL )
+		, m_pCollector ( NULL )
+	{}
+
+	~ExcerptSlice_t ()
+	{
+		SafeDelete ( m_pCollector );
+		SafeDelete ( m_pStreamer );
+		SafeDelete ( m_pTokenizer );
+	}
+};
+
+
+static void ExcerptSliceJobFunc ( void * pArg )
+{
+	ExcerptSlice_t * pSlice = (ExcerptSlice_t *)pArg;
+	TokenizeDocument ( *pSlice->m_pCollector, NULL, 0 );
+}
+
+
+/// split the document at whitespace, tokenize and match keywords in every slice in parallel,
+/// then merge slice token caches and hits into the whole-document ones
+/// passages are then collected off the merged cache in a single pass, same as without slicing
+/// returns false if the document was not worth (or not possible) to split
+static bool TokenizeSliced ( CacheStreamer_c & tStreamer, CSphVector<SphHitMark_t> & dHits, DWORD & uFoundWords,
+	SnippetsDocIndex_c & tContainer, const ExcerptQuery_t & tFixedSettings, const CSphIndexSettings & tIndexSettings,
+	const char * sDoc, int iDocLen, CSphDict * pDict, ISphTokenizer * pTokenizer )
+{
+	int iPool = sphGetSnippetThreads();
+	if ( iPool<=0 || iDocLen<2*SNIPPET_SLICE_MIN || !IsDictThreadSafe ( pDict ) )
+		return false;
+
+	int iGranted = sphSnippetThreadsAcquire ( Min ( iDocLen/SNIPPET_SLICE_MIN, iPool+1 )-1 );
+	if ( !iGranted )
+		return false;
+
+	// slice boundaries, always right before a whitespace char, so that no token gets split
+	CSphVector<int> dBounds;
+	dBounds.Add ( 0 );
+	int iSliceLen = iDocLen / ( iGranted+1 );
+	for ( int i=1; i<=iGranted; i++ )
+	{
+		int iBound = Max ( i*iSliceLen, dBounds.Last()+1 );
+		while ( iBound<iDocLen && !sphIsSpace ( sDoc[iBound] ) )
+			iBound++;
+		if ( iBound>=iDocLen )
+			break;
+		dBounds.Add ( iBound );
+	}
+	dBounds.Add ( iDocLen );
+
+	int iSlices = dBounds.GetLength()-1;
+	if ( iSlices<2 )
+	{
+		sphSnippetThreadsRelease ( iGranted );
+		return false;
+	}
+
+	CSphVector<ExcerptSlice_t> dSlices ( iSlices );
+	ARRAY_FOREACH ( i, dSlices )
+	{
+		ExcerptSlice_t & tSlice = dSlices[i];
+		tSlice.m_iStart = dBounds[i];
+		tSlice.m_iLen = dBounds[i+1] - dBounds[i];
+		tSlice.m_pTokenizer = pTokenizer->Clone ( SPH_CLONE_INDEX );
+		tSlice.m_pStreamer = new CacheStreamer_c ( tSlice.m_iLen );
+		tSlice.m_pCollector = new SliceCollector_c ( tContainer, tSlice.m_pTokenizer, pDict, tFixedSettings, tIndexSettings,
+			sDoc+tSlice.m_iStart, tSlice.m_iLen, *tSlice.m_pStreamer );
+	}
+
+	// 1st slice goes to the current thread, the rest to the workers
+	CSphSnippetJobs tJobs;
+	for ( int i=1; i<iSlices; i++ )
+		tJobs.Run ( ExcerptSliceJobFunc, &dSlices[i] );
+
+	ExcerptSliceJobFunc ( &dSlices[0] );
+	tJobs.Wait();
+
+	sphSnippetThreadsRelease ( iGranted );
+
+	// a slice that ends with a tail (eg. trailing punctuation) would not match the whole document stream
+	for ( int i=0; i<iSlices-1; i++ )
+		if ( dSlices[i].m_pCollector->m_bTail )
+			return false;
+
+	// keep the hits storage allocated even if nothing matched, as the extractor tells collected hits by that
+	int iTotalHits = 1;
+	ARRAY_FOREACH ( i, dSlices )
+		iTotalHits += dSlices[i].m_pCollector->m_dHits.GetLength();
+	dHits.Reserve ( iTotalHits );
+
+	// merge in document order
+	DWORD uPosDelta = 0;
+	ARRAY_FOREACH ( i, dSlices )
+	{
+		ExcerptSlice_t & tSlice = dSlices[i];
+		CacheRebaser_c tRebaser ( tStreamer, tSlice.m_iStart, uPosDelta );
+		tSlice.m_pStreamer->Tokenize ( tRebaser );
+
+		const CSphVector<SphHitMark_t> & dSliceHits = tSlice.m_pCollector->m_dHits;
+		ARRAY_FOREACH ( j, dSliceHits )
+		{
+			SphHitMark_t & tHit = dHits.Add();
+			tHit = dSliceHits[j];
+			tHit.m_uPosition += uPosDelta;
+		}
+
+		uFoundWords |= tSlice.m_pCollector->m_uFoundWords;
+		uPosDelta += tRebaser.m_uMaxPos;
+	}
+
+	return true;
+}
+
+
 static void DoHighlighting ( const ExcerptQuery_t & tQuerySettings,
 	const CSphIndexSettings & tIndexSettings, const XQQuery_t & tExtQuery, DWORD eExtQuerySPZ,
 	const char * sDoc, int iDocLen,
@@ -3479,13 +3987,27 @@ static void DoHighlighting ( const ExcerptQuery_t & tQuerySettings,
 			FixupQueryLimits ( tContainer, tQuerySettings, tFixedSettings, sWarning );
 
 			CacheStreamer_c tStreamer ( iDocLen );
-			ExtractExcerpts_c tExtractor ( tContainer, pTokenizer, pDict, tFixedSettings, tIndexSettings, sDoc, iDocLen, NULL, &tStreamer );
+
+			// large plain documents get tokenized slice by slice in parallel
+			CSphVector<SphHitMark_t> dSliceHits;
+			DWORD uSliceWords = 0;
+			bool bSliced = !iSPZ && !pStripper && !bRetainHtml && !tFixedSettings.m_bEmitZones
+				&& TokenizeSliced ( tStreamer, dSliceHits, uSliceWords, tContainer, tFixedSettings, tIndexSettings, sDoc, iDocLen, pDict, pTokenizer );
+
+			ExtractExcerpts_c tExtractor ( tContainer, pTokenizer, pDict, tFixedSettings, tIndexSettings, sDoc, iDocLen,
+				bSliced ? &dSliceHits : NULL, bSliced ? NULL : &tStreamer );
 			tExtractor.m_bCollectExtraZoneInfo = true;
 
-			TokenizeDocument ( tExtractor, pStripper, iSPZ );
+			if ( bSliced )
+			{
+				tExtractor.m_uFoundWords = uSliceWords;
+				tStreamer.Tokenize ( tExtractor );
+			} else
+				TokenizeDocument ( tExtractor, pStripper, iSPZ );
 
 			tStreamer.m_pZoneInfo = &tExtractor.m_tZoneInfo;
-			HighlightPassages ( tStreamer, tExtractor, tFixedSettings, tIndexSettings, tContainer, sDoc, iDocLen, pDict, pTokenizer, NULL, &tExtractor.m_tZoneInfo, dRes );
+			HighlightPassages ( tStreamer, tExtractor, tFixedSettings, tIndexSettings, tContainer, sDoc, iDocLen, pDict, pTokenizer,
+				bSliced ? &dSliceHits : NULL, &tExtractor.m_tZoneInfo, dRes );
 		}
 
 		// add trailing zero, and return
@@ -81,6 +81,46 @@ struct XQQuery_t;
 void sphBuildExcerpt ( ExcerptQuery_t & tOptions, const CSphIndex * pIndex, const CSphHTMLStripper * pStripper, const XQQuery_t & tExtQuery,
 						DWORD eExtQuerySPZ, CSphString & sWarning, CSphString & sError, CSphDict * pDict, ISphTokenizer * pDocTokenizer, ISphTokenizer * pQueryTokenizer );
 
+/// snippet worker thread creation hook, so that the daemon could wrap its workers
+typedef bool ( *SnippetThreadCreate_fn ) ( SphThread_t * pThread, void ( *fnThread )( void * ), void * pArg, bool bDetached );
+
+/// set snippet worker pool size (0 means no dedicated workers)
+/// workers are started on first use and kept running; any previous ones get stopped here, so no snippets must be in flight
+void sphSetSnippetThreads ( int iThreads, SnippetThreadCreate_fn fnCreate=NULL );
+
+/// get snippet worker pool size
+int sphGetSnippetThreads ();
+
+/// stop and join the snippet workers
+void sphShutdownSnippetThreads ();
+
+/// try to grab up to iWanted worker slots from the pool
+/// returns the number of slots actually granted (might be 0)
+int sphSnippetThreadsAcquire ( int iWanted );
+
+/// return previously granted slots to the pool
+void sphSnippetThreadsRelease ( int iSlots );
+
+/// a group of jobs run by the snippet workers; the owner waits for all of them
+class CSphSnippetJobs : public ISphNoncopyable
+{
+public:
+					CSphSnippetJobs ();
+					~CSphSnippetJobs ();
+
+	/// queue a job; jobs must not outnumber the slots granted by sphSnippetThreadsAcquire()
+	void			Run ( void ( *fnJob )( void * ), void * pArg );
+
+	/// wait until all the queued jobs complete
+	void			Wait ();
+
+private:
+	int				m_iPending;
+	CSphAutoEvent	m_tDone;
+
+	friend class SnippetPool_c;
+};
+
 #endif // _sphinxexcerpt_
 
 //
@@ -38,6 +38,30 @@ UservarIntSet_c * ( *g_pUservarsHook )( const CSphString & sUservar );
 // EVALUATION ENGINE
 //////////////////////////////////////////////////////////////////////////
 
+void ISphExpr::EvalBatch ( const CSphMatch * pMatches, int iCount, float * pOut ) const
+{
+	assert ( iCount<=SPH_EXPR_BATCH );
+	for ( int i=0; i<iCount; i++ )
+		pOut[i] = Eval ( pMatches[i] );
+}
+
+
+void ISphExpr::IntEvalBatch ( const CSphMatch * pMatches, int iCount, int * pOut ) const
+{
+	assert ( iCount<=SPH_EXPR_BATCH );
+	for ( int i=0; i<iCount; i++ )
+		pOut[i] = IntEval ( pMatches[i] );
+}
+
+
+void ISphExpr::Int64EvalBatch ( const CSphMatch * pMatches, int iCount, int64_t * pOut ) const
+{
+	assert ( iCount<=SPH_EXPR_BATCH );
+	for ( int i=0; i<iCount; i++ )
+		pOut[i] = Int64Eval ( pMatches[i] );
+}
+
+
 struct ExprLocatorTraits_t : public ISphExpr
 {
 	CSphAttrLocator m_tLocator;
@@ -50,6 +74,30 @@ struct ExprLocatorTraits_t : public ISphExpr
 		if ( eCmd==SPH_EXPR_GET_DEPENDENT_COLS )
 			static_cast < CSphVector<int>* >(pArg)->Add ( m_iLocator );
 	}
+
+	/// fetch attribute values for a batch of matches
+	/// locator checks are hoisted out of the loop for the common single rowitem case
+	template < typename T >
+	void GetAttrBatch ( const CSphMatch * pMatches, int iCount, T * pOut ) const
+	{
+		if ( m_tLocator.m_iBitOffset>=0 && m_tLocator.m_iBitCount==ROWITEM_BITS )
+		{
+			int iItem = m_tLocator.m_iBitOffset >> ROWITEM_SHIFT;
+			if ( m_tLocator.m_bDynamic )
+			{
+				for ( int i=0; i<iCount; i++ )
+					pOut[i] = (T) pMatches[i].m_pDynamic[iItem];
+			} else
+			{
+				for ( int i=0; i<iCount; i++ )
+					pOut[i] = (T) pMatches[i].m_pStatic[iItem];
+			}
+			return;
+		}
+
+		for ( int i=0; i<iCount; i++ )
+			pOut[i] = (T) pMatches[i].GetAttr ( m_tLocator );
+	}
 };
 
 
@@ -59,6 +107,9 @@ struct Expr_GetInt_c : public ExprLocatorTraits_t
 	virtual float Eval ( const CSphMatch & tMatch ) const { return (float) tMatch.GetAttr ( m_tLocator ); } // FIXME! OPTIMIZE!!! we can go the short route here
 	virtual int IntEval ( const CSphMatch & tMatch ) const { return (int)tMatch.GetAttr ( m_tLocator ); }
 	virtual int64_t Int64Eval ( const CSphMatch & tMatch ) const { return (int64_t)tMatch.GetAttr ( m_tLocator ); }
+	virtual void EvalBatch ( const CSphMatch * pMatches, int iCount, float * pOut ) const { GetAttrBatch ( pMatches, iCount, pOut ); }
+	virtual void IntEvalBatch ( const CSphMatch * pMatches, int iCount, int * pOut ) const { GetAttrBatch ( pMatches, iCount, pOut ); }
+	virtual void Int64EvalBatch ( const CSphMatch * pMatches, int iCount, int64_t * pOut ) const { GetAttrBatch ( pMatches, iCount, pOut ); }
 };
 
 
@@ -68,6 +119,9 @@ struct Expr_GetBits_c : public ExprLocatorTraits_t
 	virtual float Eval ( const CSphMatch & tMatch ) const { return (float) tMatch.GetAttr ( m_tLocator ); }
 	virtual int IntEval ( const CSphMatch & tMatch ) const { return (int)tMatch.GetAttr ( m_tLocator ); }
 	virtual int64_t Int64Eval ( const CSphMatch & tMatch ) const { return (int64_t)tMatch.GetAttr ( m_tLocator ); }
+	virtual void EvalBatch ( const CSphMatch * pMatches, int iCount, float * pOut ) const { GetAttrBatch ( pMatches, iCount, pOut ); }
+	virtual void IntEvalBatch ( const CSphMatch * pMatches, int iCount, int * pOut ) const { GetAttrBatch ( pMatches, iCount, pOut ); }
+	virtual void Int64EvalBatch ( const CSphMatch * pMatches, int iCount, int64_t * pOut ) const { GetAttrBatch ( pMatches, iCount, pOut ); }
 };
 
 
@@ -77,6 +131,23 @@ struct Expr_GetSint_c : public ExprLocatorTraits_t
 	virtual float Eval ( const CSphMatch & tMatch ) const { return (float)(int)tMatch.GetAttr ( m_tLocator ); }
 	virtual int IntEval ( const CSphMatch & tMatch ) const { return (int)tMatch.GetAttr ( m_tLocator ); }
 	virtual int64_t Int64Eval ( const CSphMatch & tMatch ) const { return (int)tMatch.GetAttr ( m_tLocator ); }
+	virtual void IntEvalBatch ( const CSphMatch * pMatches, int iCount, int * pOut ) const { GetAttrBatch ( pMatches, iCount, pOut ); }
+
+	virtual void EvalBatch ( const CSphMatch * pMatches, int iCount, float * pOut ) const
+	{
+		int dVals [ SPH_EXPR_BATCH ];
+		GetAttrBatch ( pMatches, iCount, dVals );
+		for ( int i=0; i<iCount; i++ )
+			pOut[i] = (float)dVals[i];
+	}
+
+	virtual void Int64EvalBatch ( const CSphMatch * pMatches, int iCount, int64_t * pOut ) const
+	{
+		int dVals [ SPH_EXPR_BATCH ];
+		GetAttrBatch ( pMatches, iCount, dVals );
+		for ( int i=0; i<iCount; i++ )
+			pOut[i] = dVals[i];
+	}
 };
 
 
@@ -84,6 +155,14 @@ struct Expr_GetFloat_c : public ExprLocatorTraits_t
 {
 	Expr_GetFloat_c ( const CSphAttrLocator & tLocator, int iLocator ) : ExprLocatorTraits_t ( tLocator, iLocator ) {}
 	virtual float Eval ( const CSphMatch & tMatch ) const { return tMatch.GetAttrFloat ( m_tLocator ); }
+
+	virtual void EvalBatch ( const CSphMatch * pMatches, int iCount, float * pOut ) const
+	{
+		DWORD dVals [ SPH_EXPR_BATCH ];
+		GetAttrBatch ( pMatches, iCount, dVals );
+		for ( int i=0; i<iCount; i++ )
+			pOut[i] = sphDW2F ( dVals[i] );
+	}
 };
 
 
@@ -143,6 +222,9 @@ struct Expr_GetConst_c : public ISphExpr
 	virtual float Eval ( const CSphMatch & ) const { return m_fValue; }
 	virtual int IntEval ( const CSphMatch & ) const { return (int)m_fValue; }
 	virtual int64_t Int64Eval ( const CSphMatch & ) const { return (int64_t)m_fValue; }
+	virtual void EvalBatch ( const CSphMatch *, int iCount, float * pOut ) const { for ( int i=0; i<iCount; i++ ) pOut[i] = m_fValue; }
+	virtual void IntEvalBatch ( const CSphMatch *, int iCount, int * pOut ) const { for ( int i=0; i<iCount; i++ ) pOut[i] = (int)m_fValue; }
+	virtual void Int64EvalBatch ( const CSphMatch *, int iCount, int64_t * pOut ) const { for ( int i=0; i<iCount; i++ ) pOut[i] = (int64_t)m_fValue; }
 };
 
 
@@ -153,6 +235,9 @@ struct Expr_GetIntConst_c : public ISphExpr
 	virtual float Eval ( const CSphMatch & ) const { return (float) m_iValue; } // no assert() here cause generic float Eval() needs to work even on int-evaluator tree
 	virtual int IntEval ( const CSphMatch & ) const { return m_iValue; }
 	virtual int64_t Int64Eval ( const CSphMatch & ) const { return m_iValue; }
+	virtual void EvalBatch ( const CSphMatch *, int iCount, float * pOut ) const { for ( int i=0; i<iCount; i++ ) pOut[i] = (float)m_iValue; }
+	virtual void IntEvalBatch ( const CSphMatch *, int iCount, int * pOut ) const { for ( int i=0; i<iCount; i++ ) pOut[i] = m_iValue; }
+	virtual void Int64EvalBatch ( const CSphMatch *, int iCount, int64_t * pOut ) const { for ( int i=0; i<iCount; i++ ) pOut[i] = m_iValue; }
 };
 
 
@@ -163,6 +248,8 @@ struct Expr_GetInt64Const_c : public ISphExpr
 	virtual float Eval ( const CSphMatch & ) const { return (float) m_iValue; } // no assert() here cause generic float Eval() needs to work even on int-evaluator tree
 	virtual int IntEval ( const CSphMatch & ) const { assert ( 0 ); return (int)m_iValue; }
 	virtual int64_t Int64Eval ( const CSphMatch & ) const { return m_iValue; }
+	virtual void EvalBatch ( const CSphMatch *, int iCount, float * pOut ) const { for ( int i=0; i<iCount; i++ ) pOut[i] = (float)m_iValue; }
+	virtual void Int64EvalBatch ( const CSphMatch *, int iCount, int64_t * pOut ) const { for ( int i=0; i<iCount; i++ ) pOut[i] = m_iValue; }
 };
 
 
@@ -450,6 +537,7 @@ struct Expr_GetId_c : public ISphExpr
 	virtual float Eval ( const CSphMatch & tMatch ) const { return (float)tMatch.m_uDocID; }
 	virtual int IntEval ( const CSphMatch & tMatch ) const { return (int)tMatch.m_uDocID; }
 	virtual int64_t Int64Eval ( const CSphMatch & tMatch ) const { return (int64_t)tMatch.m_uDocID; }
+	virtual void Int64EvalBatch ( const CSphMatch * pMatches, int iCount, int64_t * pOut ) const { for ( int i=0; i<iCount; i++ ) pOut[i] = (int64_t)pMatches[i].m_uDocID; }
 };
 
 
@@ -458,6 +546,8 @@ struct Expr_GetWeight_c : public ISphExpr
 	virtual float Eval ( const CSphMatch & tMatch ) const { return (float)tMatch.m_iWeight; }
 	virtual int IntEval ( const CSphMatch & tMatch ) const { return (int)tMatch.m_iWeight; }
 	virtual int64_t Int64Eval ( const CSphMatch & tMatch ) const { return (int64_t)tMatch.m_iWeight; }
+	virtual void EvalBatch ( const CSphMatch * pMatches, int iCount, float * pOut ) const { for ( int i=0; i<iCount; i++ ) pOut[i] = (float)pMatches[i].m_iWeight; }
+	virtual void IntEvalBatch ( const CSphMatch * pMatches, int iCount, int * pOut ) const { for ( int i=0; i<iCount; i++ ) pOut[i] = pMatches[i].m_iWeight; }
 };
 
 //////////////////////////////////////////////////////////////////////////
@@ -787,12 +877,15 @@ protected:
 	CSphString		m_sKey;
 	int				m_iKeyLen;
 	DWORD			m_uKeyBloom;
+	DWORD			m_uKeyCrc;
+	mutable int		m_iKeySlot;		///< last resolved key directory slot; documents mostly share keys, so it usually hits
 
 public:
 	/// takes over the expressions
 	Expr_JsonFastKey_c ( const CSphAttrLocator & tLocator, int iLocator, ISphExpr * pArg )
 		: ExprLocatorTraits_t ( tLocator, iLocator )
 		, m_pStrings ( NULL )
+		, m_iKeySlot ( -1 )
 	{
 		assert ( ( tLocator.m_iBitOffset % ROWITEM_BITS )==0 );
 		assert ( tLocator.m_iBitCount==ROWITEM_BITS );
@@ -801,6 +894,7 @@ public:
 		m_sKey = pKey->m_sVal;
 		m_iKeyLen = pKey->m_iLen;
 		m_uKeyBloom = sphJsonKeyMask ( m_sKey.cstr(), m_iKeyLen );
+		m_uKeyCrc = sphCRC32 ( m_sKey.cstr(), m_iKeyLen );
 		SafeRelease ( pArg );
 	}
 
@@ -828,12 +922,20 @@ public:
 		const BYTE * pJson;
 		sphUnpackStr ( m_pStrings + uOffset, &pJson );
 
-		// all root objects start with a Bloom mask; quickly check it
-		if ( ( sphGetDword(pJson) & m_uKeyBloom )!=m_uKeyBloom )
+		// all small root objects start with a Bloom mask; quickly check it
+		// large ones (with a key directory) are regular objects behind a zero mask
+		ESphJsonType eRoot = JSON_ROOT;
+		DWORD uRootMask = sphGetDword(pJson);
+		if ( !uRootMask )
+		{
+			eRoot = sphJsonFindFirst ( &pJson );
+			if ( eRoot!=JSON_OBJECT )
+				return 0;
+		} else if ( ( uRootMask & m_uKeyBloom )!=m_uKeyBloom )
 			return 0;
 
 		// OPTIMIZE? FindByKey does an extra (redundant) bloom check inside
-		ESphJsonType eJson = sphJsonFindByKey ( JSON_ROOT, &pJson, m_sKey.cstr(), m_iKeyLen, m_uKeyBloom );
+		ESphJsonType eJson = sphJsonFindByKey ( eRoot, &pJson, m_sKey.cstr(), m_iKeyLen, m_uKeyBloom, m_uKeyCrc, &m_iKeySlot );
 		if ( eJson==JSON_EOF )
 			return 0;
 
@@ -1474,14 +1576,66 @@ DECLARE_END()
 	DECLARE_BINARY_INT ( _classname##Int_c,		(float)IntEval(tMatch),		_expr2,					(int64_t)IntEval(tMatch) ) \
 	DECLARE_BINARY_INT ( _classname##Int64_c,	(float)Int64Eval(tMatch),	(int)Int64Eval(tMatch),	_expr3 )
 
+// batch-capable binary nodes
+// expressions are written in terms of VFIRST and VSECOND, ie. already evaluated arguments,
+// so that the very same expression can be used both per-match and in a tight per-batch loop
+#define VFIRST		tFirst
+#define VSECOND		tSecond
+
+#define BINARY_BATCH_LOOP(_type,_method,_expr) \
+	{ \
+		_type dFirst [ SPH_EXPR_BATCH ]; \
+		_type dSecond [ SPH_EXPR_BATCH ]; \
+		m_pFirst->_method ( pMatches, iCount, dFirst ); \
+		m_pSecond->_method ( pMatches, iCount, dSecond ); \
+		for ( int i=0; i<iCount; i++ ) \
+		{ \
+			_type tFirst = dFirst[i]; \
+			_type tSecond = dSecond[i]; \
+			pOut[i] = _expr; \
+		} \
+	}
+
+#define BINARY_SCALAR(_type,_first,_second,_expr) \
+	{ \
+		_type tFirst = _first; \
+		_type tSecond = _second; \
+		return _expr; \
+	}
+
+#define DECLARE_BINARY_VEC(_classname,_expr,_expr2,_expr3) \
+		DECLARE_BINARY_TRAITS ( _classname ) \
+		virtual float Eval ( const CSphMatch & tMatch ) const BINARY_SCALAR ( float, FIRST, SECOND, _expr ) \
+		virtual int IntEval ( const CSphMatch & tMatch ) const BINARY_SCALAR ( int, INTFIRST, INTSECOND, _expr2 ) \
+		virtual int64_t Int64Eval ( const CSphMatch & tMatch ) const BINARY_SCALAR ( int64_t, INT64FIRST, INT64SECOND, _expr3 ) \
+		virtual void EvalBatch ( const CSphMatch * pMatches, int iCount, float * pOut ) const BINARY_BATCH_LOOP ( float, EvalBatch, _expr ) \
+		virtual void IntEvalBatch ( const CSphMatch * pMatches, int iCount, int * pOut ) const BINARY_BATCH_LOOP ( int, IntEvalBatch, _expr2 ) \
+		virtual void Int64EvalBatch ( const CSphMatch * pMatches, int iCount, int64_t * pOut ) const BINARY_BATCH_LOOP ( int64_t, Int64EvalBatch, _expr3 ) \
+	};
+
+#define DECLARE_BINARY_VEC_TYPED(_classname,_type,_first,_second,_method,_expr) \
+		DECLARE_BINARY_TRAITS ( _classname ) \
+		virtual float Eval ( const CSphMatch & tMatch ) const BINARY_SCALAR ( _type, _first, _second, (float)(_expr) ) \
+		virtual int IntEval ( const CSphMatch & tMatch ) const BINARY_SCALAR ( _type, _first, _second, (int)(_expr) ) \
+		virtual int64_t Int64Eval ( const CSphMatch & tMatch ) const BINARY_SCALAR ( _type, _first, _second, (int64_t)(_expr) ) \
+		virtual void EvalBatch ( const CSphMatch * pMatches, int iCount, float * pOut ) const BINARY_BATCH_LOOP ( _type, _method, (float)(_expr) ) \
+		virtual void IntEvalBatch ( const CSphMatch * pMatches, int iCount, int * pOut ) const BINARY_BATCH_LOOP ( _type, _method, (int)(_expr) ) \
+		virtual void Int64EvalBatch ( const CSphMatch * pMatches, int iCount, int64_t * pOut ) const BINARY_BATCH_LOOP ( _type, _method, (int64_t)(_expr) ) \
+	};
+
+#define DECLARE_BINARY_VEC_POLY(_classname,_expr,_expr2,_expr3) \
+	DECLARE_BINARY_VEC_TYPED ( _classname##Float_c,	float,		FIRST,		SECOND,			EvalBatch,		_expr ) \
+	DECLARE_BINARY_VEC_TYPED ( _classname##Int_c,	int,		INTFIRST,	INTSECOND,		IntEvalBatch,	_expr2 ) \
+	DECLARE_BINARY_VEC_TYPED ( _classname##Int64_c,	int64_t,	INT64FIRST,	INT64SECOND,	Int64EvalBatch,	_expr3 )
+
 #define IFFLT(_expr)	( (_expr) ? 1.0f : 0.0f )
 #define IFINT(_expr)	( (_expr) ? 1 : 0 )
 
-DECLARE_BINARY_INT ( Expr_Add_c,	FIRST + SECOND,						(DWORD)INTFIRST + (DWORD)INTSECOND,				(uint64_t)INT64FIRST + (uint64_t)INT64SECOND )
-DECLARE_BINARY_INT ( Expr_Sub_c,	FIRST - SECOND,						(DWORD)INTFIRST - (DWORD)INTSECOND,				(uint64_t)INT64FIRST - (uint64_t)INT64SECOND )
-DECLARE_BINARY_INT ( Expr_Mul_c,	FIRST * SECOND,						(DWORD)INTFIRST * (DWORD)INTSECOND,				(uint64_t)INT64FIRST * (uint64_t)INT64SECOND )
-DECLARE_BINARY_INT ( Expr_BitAnd_c,	(float)(int(FIRST)&int(SECOND)),	INTFIRST & INTSECOND,				INT64FIRST & INT64SECOND )
-DECLARE_BINARY_INT ( Expr_BitOr_c,	(float)(int(FIRST)|int(SECOND)),	INTFIRST | INTSECOND,				INT64FIRST | INT64SECOND )
+DECLARE_BINARY_VEC ( Expr_Add_c,	VFIRST + VSECOND,						(DWORD)VFIRST + (DWORD)VSECOND,			(uint64_t)VFIRST + (uint64_t)VSECOND )
+DECLARE_BINARY_VEC ( Expr_Sub_c,	VFIRST - VSECOND,						(DWORD)VFIRST - (DWORD)VSECOND,			(uint64_t)VFIRST - (uint64_t)VSECOND )
+DECLARE_BINARY_VEC ( Expr_Mul_c,	VFIRST * VSECOND,						(DWORD)VFIRST * (DWORD)VSECOND,			(uint64_t)VFIRST * (uint64_t)VSECOND )
+DECLARE_BINARY_VEC ( Expr_BitAnd_c,	(float)(int(VFIRST)&int(VSECOND)),		VFIRST & VSECOND,						VFIRST & VSECOND )
+DECLARE_BINARY_VEC ( Expr_BitOr_c,	(float)(int(VFIRST)|int(VSECOND)),		VFIRST | VSECOND,						VFIRST | VSECOND )
 DECLARE_BINARY_INT ( Expr_Mod_c,	(float)(int(FIRST)%int(SECOND)),	INTFIRST % INTSECOND,				INT64FIRST % INT64SECOND )
 
 DECLARE_BINARY_TRAITS ( Expr_Div_c )
@@ -1491,6 +1645,9 @@ DECLARE_BINARY_TRAITS ( Expr_Div_c )
                // ideally this would be SQLNULL instead of plain 0.0f
                return fSecond ? m_pFirst->Eval ( tMatch )/fSecond : 0.0f;
        }
+
+	virtual void EvalBatch ( const CSphMatch * pMatches, int iCount, float * pOut ) const
+		BINARY_BATCH_LOOP ( float, EvalBatch, VSECOND ? VFIRST/VSECOND : 0.0f )
 DECLARE_END()
 
 DECLARE_BINARY_TRAITS ( Expr_Idiv_c )
@@ -1516,15 +1673,15 @@ DECLARE_BINARY_TRAITS ( Expr_Idiv_c )
 	}
 DECLARE_END()
 
-DECLARE_BINARY_POLY ( Expr_Lt,		IFFLT ( FIRST<SECOND ),					IFINT ( INTFIRST<INTSECOND ),		IFINT ( INT64FIRST<INT64SECOND ) )
-DECLARE_BINARY_POLY ( Expr_Gt,		IFFLT ( FIRST>SECOND ),					IFINT ( INTFIRST>INTSECOND ),		IFINT ( INT64FIRST>INT64SECOND ) )
-DECLARE_BINARY_POLY ( Expr_Lte,		IFFLT ( FIRST<=SECOND ),				IFINT ( INTFIRST<=INTSECOND ),		IFINT ( INT64FIRST<=INT64SECOND ) )
-DECLARE_BINARY_POLY ( Expr_Gte,		IFFLT ( FIRST>=SECOND ),				IFINT ( INTFIRST>=INTSECOND ),		IFINT ( INT64FIRST>=INT64SECOND ) )
-DECLARE_BINARY_POLY ( Expr_Eq,		IFFLT ( fabs ( FIRST-SECOND )<=1e-6 ),	IFINT ( INTFIRST==INTSECOND ),		IFINT ( INT64FIRST==INT64SECOND ) )
-DECLARE_BINARY_POLY ( Expr_Ne,		IFFLT ( fabs ( FIRST-SECOND )>1e-6 ),	IFINT ( INTFIRST!=INTSECOND ),		IFINT ( INT64FIRST!=INT64SECOND ) )
+DECLARE_BINARY_VEC_POLY ( Expr_Lt,		IFFLT ( VFIRST<VSECOND ),					IFINT ( VFIRST<VSECOND ),		IFINT ( VFIRST<VSECOND ) )
+DECLARE_BINARY_VEC_POLY ( Expr_Gt,		IFFLT ( VFIRST>VSECOND ),					IFINT ( VFIRST>VSECOND ),		IFINT ( VFIRST>VSECOND ) )
+DECLARE_BINARY_VEC_POLY ( Expr_Lte,		IFFLT ( VFIRST<=VSECOND ),					IFINT ( VFIRST<=VSECOND ),		IFINT ( VFIRST<=VSECOND ) )
+DECLARE_BINARY_VEC_POLY ( Expr_Gte,		IFFLT ( VFIRST>=VSECOND ),					IFINT ( VFIRST>=VSECOND ),		IFINT ( VFIRST>=VSECOND ) )
+DECLARE_BINARY_VEC_POLY ( Expr_Eq,		IFFLT ( fabs ( VFIRST-VSECOND )<=1e-6 ),	IFINT ( VFIRST==VSECOND ),		IFINT ( VFIRST==VSECOND ) )
+DECLARE_BINARY_VEC_POLY ( Expr_Ne,		IFFLT ( fabs ( VFIRST-VSECOND )>1e-6 ),		IFINT ( VFIRST!=VSECOND ),		IFINT ( VFIRST!=VSECOND ) )
 
-DECLARE_BINARY_INT ( Expr_Min_c,	Min ( FIRST, SECOND ),					Min ( INTFIRST, INTSECOND ),		Min ( INT64FIRST, INT64SECOND ) )
-DECLARE_BINARY_INT ( Expr_Max_c,	Max ( FIRST, SECOND ),					Max ( INTFIRST, INTSECOND ),		Max ( INT64FIRST, INT64SECOND ) )
+DECLARE_BINARY_VEC ( Expr_Min_c,	Min ( VFIRST, VSECOND ),				Min ( VFIRST, VSECOND ),			Min ( VFIRST, VSECOND ) )
+DECLARE_BINARY_VEC ( Expr_Max_c,	Max ( VFIRST, VSECOND ),				Max ( VFIRST, VSECOND ),			Max ( VFIRST, VSECOND ) )
 DECLARE_BINARY_FLT ( Expr_Pow_c,	float ( pow ( FIRST, SECOND ) ) )
 
 DECLARE_BINARY_POLY ( Expr_And,		FIRST!=0.0f && SECOND!=0.0f,		IFINT ( INTFIRST && INTSECOND ),	IFINT ( INT64FIRST && INT64SECOND ) )
@@ -1577,6 +1734,201 @@ DECLARE_TERNARY ( Expr_If_c,	( FIRST!=0.0f ) ? SECOND : THIRD,	INTFIRST ? INTSEC
 DECLARE_TERNARY ( Expr_Madd_c,	FIRST*SECOND+THIRD,					INTFIRST*INTSECOND + INTTHIRD,		INT64FIRST*INT64SECOND + INT64THIRD )
 DECLARE_TERNARY ( Expr_Mul3_c,	FIRST*SECOND*THIRD,					INTFIRST*INTSECOND*INTTHIRD,		INT64FIRST*INT64SECOND*INT64THIRD )
 
+//////////////////////////////////////////////////////////////////////////
+// FUSED EVALUATORS
+//////////////////////////////////////////////////////////////////////////
+
+// a handful of shapes (attr CMP const, IF over that, const*attr+attr) dominate real queries
+// those get specialized at parse time, with operand types resolved into template args,
+// so that the whole shape costs a single virtual call instead of one per node
+
+/// integer attribute operand, converted exactly as Expr_GetInt_c does
+struct FusedIntAttr_t
+{
+	static inline float Get ( const CSphMatch & tMatch, const CSphAttrLocator & tLoc, float ) { return (float) tMatch.GetAttr ( tLoc ); }
+	static inline int Get ( const CSphMatch & tMatch, const CSphAttrLocator & tLoc, int ) { return (int) tMatch.GetAttr ( tLoc ); }
+	static inline int64_t Get ( const CSphMatch & tMatch, const CSphAttrLocator & tLoc, int64_t ) { return (int64_t) tMatch.GetAttr ( tLoc ); }
+};
+
+/// float attribute operand, converted exactly as Expr_GetFloat_c does
+struct FusedFloatAttr_t
+{
+	static inline float Get ( const CSphMatch & tMatch, const CSphAttrLocator & tLoc, float ) { return tMatch.GetAttrFloat ( tLoc ); }
+	static inline int Get ( const CSphMatch & tMatch, const CSphAttrLocator & tLoc, int ) { return (int) tMatch.GetAttrFloat ( tLoc ); }
+	static inline int64_t Get ( const CSphMatch & tMatch, const CSphAttrLocator & tLoc, int64_t ) { return (int64_t) tMatch.GetAttrFloat ( tLoc ); }
+};
+
+struct FusedLt_t	{ template < typename T > static inline bool Cmp ( T a, T b ) { return a<b; } };
+struct FusedGt_t	{ template < typename T > static inline bool Cmp ( T a, T b ) { return a>b; } };
+struct FusedLte_t	{ template < typename T > static inline bool Cmp ( T a, T b ) { return a<=b; } };
+struct FusedGte_t	{ template < typename T > static inline bool Cmp ( T a, T b ) { return a>=b; } };
+
+struct FusedEq_t
+{
+	template < typename T > static inline bool Cmp ( T a, T b ) { return a==b; }
+	static inline bool Cmp ( float a, float b ) { return fabs ( a-b )<=1e-6; }
+};
+
+struct FusedNe_t
+{
+	template < typename T > static inline bool Cmp ( T a, T b ) { return a!=b; }
+	static inline bool Cmp ( float a, float b ) { return fabs ( a-b )>1e-6; }
+};
+
+
+/// attr CMP const condition, compared in T math
+template < typename ATTR, typename T, typename CMP >
+struct FusedAttrCmp_T
+{
+	CSphAttrLocator		m_tLocator;
+	T					m_tConst;
+
+	FusedAttrCmp_T ( const CSphAttrLocator & tLocator, T tConst )
+		: m_tLocator ( tLocator )
+		, m_tConst ( tConst )
+	{}
+
+	inline bool Test ( const CSphMatch & tMatch ) const
+	{
+		return CMP::Cmp ( ATTR::Get ( tMatch, m_tLocator, m_tConst ), m_tConst );
+	}
+};
+
+
+/// fused attr CMP const
+template < typename COND >
+struct Expr_FusedCmp_T : public ExprLocatorTraits_t
+{
+	COND m_tCond;
+
+	Expr_FusedCmp_T ( const COND & tCond, int iLocator )
+		: ExprLocatorTraits_t ( tCond.m_tLocator, iLocator )
+		, m_tCond ( tCond )
+	{}
+
+	virtual float Eval ( const CSphMatch & tMatch ) const { return m_tCond.Test ( tMatch ) ? 1.0f : 0.0f; }
+	virtual int IntEval ( const CSphMatch & tMatch ) const { return m_tCond.Test ( tMatch ) ? 1 : 0; }
+	virtual int64_t Int64Eval ( const CSphMatch & tMatch ) const { return m_tCond.Test ( tMatch ) ? 1 : 0; }
+
+	virtual void EvalBatch ( const CSphMatch * pMatches, int iCount, float * pOut ) const
+	{
+		for ( int i=0; i<iCount; i++ )
+			pOut[i] = m_tCond.Test ( pMatches[i] ) ? 1.0f : 0.0f;
+	}
+
+	virtual void IntEvalBatch ( const CSphMatch * pMatches, int iCount, int * pOut ) const
+	{
+		for ( int i=0; i<iCount; i++ )
+			pOut[i] = m_tCond.Test ( pMatches[i] ) ? 1 : 0;
+	}
+
+	virtual void Int64EvalBatch ( const CSphMatch * pMatches, int iCount, int64_t * pOut ) const
+	{
+		for ( int i=0; i<iCount; i++ )
+			pOut[i] = m_tCond.Test ( pMatches[i] ) ? 1 : 0;
+	}
+};
+
+
+/// fused IF ( attr CMP const, expr, expr )
+template < typename COND >
+struct Expr_FusedIf_T : public ExprLocatorTraits_t
+{
+	COND		m_tCond;
+	ISphExpr *	m_pThen;
+	ISphExpr *	m_pElse;
+
+	Expr_FusedIf_T ( const COND & tCond, int iLocator, ISphExpr * pThen, ISphExpr * pElse )
+		: ExprLocatorTraits_t ( tCond.m_tLocator, iLocator )
+		, m_tCond ( tCond )
+		, m_pThen ( pThen )
+		, m_pElse ( pElse )
+	{}
+
+	~Expr_FusedIf_T ()
+	{
+		SafeRelease ( m_pThen );
+		SafeRelease ( m_pElse );
+	}
+
+	virtual float Eval ( const CSphMatch & tMatch ) const { return m_tCond.Test ( tMatch ) ? m_pThen->Eval ( tMatch ) : m_pElse->Eval ( tMatch ); }
+	virtual int IntEval ( const CSphMatch & tMatch ) const { return m_tCond.Test ( tMatch ) ? m_pThen->IntEval ( tMatch ) : m_pElse->IntEval ( tMatch ); }
+	virtual int64_t Int64Eval ( const CSphMatch & tMatch ) const { return m_tCond.Test ( tMatch ) ? m_pThen->Int64Eval ( tMatch ) : m_pElse->Int64Eval ( tMatch ); }
+
+	virtual void Command ( ESphExprCommand eCmd, void * pArg )
+	{
+		ExprLocatorTraits_t::Command ( eCmd, pArg );
+		m_pThen->Command ( eCmd, pArg );
+		m_pElse->Command ( eCmd, pArg );
+	}
+};
+
+
+/// fused const*attr+attr
+template < typename MUL, typename ADD >
+struct Expr_FusedMadd_T : public ISphExpr
+{
+	CSphAttrLocator		m_tMul;
+	CSphAttrLocator		m_tAdd;
+	int					m_iMul;
+	int					m_iAdd;
+	float				m_fConst;
+	int					m_iConst;
+	int64_t				m_iConst64;
+
+	Expr_FusedMadd_T ( const CSphAttrLocator & tMul, int iMul, const CSphAttrLocator & tAdd, int iAdd, float fConst, int iConst, int64_t iConst64 )
+		: m_tMul ( tMul )
+		, m_tAdd ( tAdd )
+		, m_iMul ( iMul )
+		, m_iAdd ( iAdd )
+		, m_fConst ( fConst )
+		, m_iConst ( iConst )
+		, m_iConst64 ( iConst64 )
+	{}
+
+	virtual float Eval ( const CSphMatch & tMatch ) const
+	{
+		return m_fConst*MUL::Get ( tMatch, m_tMul, m_fConst ) + ADD::Get ( tMatch, m_tAdd, m_fConst );
+	}
+
+	virtual int IntEval ( const CSphMatch & tMatch ) const
+	{
+		return m_iConst*MUL::Get ( tMatch, m_tMul, m_iConst ) + ADD::Get ( tMatch, m_tAdd, m_iConst );
+	}
+
+	virtual int64_t Int64Eval ( const CSphMatch & tMatch ) const
+	{
+		return m_iConst64*MUL::Get ( tMatch, m_tMul, m_iConst64 ) + ADD::Get ( tMatch, m_tAdd, m_iConst64 );
+	}
+
+	virtual void EvalBatch ( const CSphMatch * pMatches, int iCount, float * pOut ) const
+	{
+		for ( int i=0; i<iCount; i++ )
+			pOut[i] = m_fConst*MUL::Get ( pMatches[i], m_tMul, m_fConst ) + ADD::Get ( pMatches[i], m_tAdd, m_fConst );
+	}
+
+	virtual void IntEvalBatch ( const CSphMatch * pMatches, int iCount, int * pOut ) const
+	{
+		for ( int i=0; i<iCount; i++ )
+			pOut[i] = m_iConst*MUL::Get ( pMatches[i], m_tMul, m_iConst ) + ADD::Get ( pMatches[i], m_tAdd, m_iConst );
+	}
+
+	virtual void Int64EvalBatch ( const CSphMatch * pMatches, int iCount, int64_t * pOut ) const
+	{
+		for ( int i=0; i<iCount; i++ )
+			pOut[i] = m_iConst64*MUL::Get ( pMatches[i], m_tMul, m_iConst64 ) + ADD::Get ( pMatches[i], m_tAdd, m_iConst64 );
+	}
+
+	virtual void Command ( ESphExprCommand eCmd, void * pArg )
+	{
+		if ( eCmd==SPH_EXPR_GET_DEPENDENT_COLS )
+		{
+			static_cast < CSphVector<int>* >(pArg)->Add ( m_iMul );
+			static_cast < CSphVector<int>* >(pArg)->Add ( m_iAdd );
+		}
+	}
+};
+
 //////////////////////////////////////////////////////////////////////////
 
 #define DECLARE_TIMESTAMP(_classname,_expr) \
@@ -2149,6 +2501,8 @@ private:
 	ISphExpr *				CreateInNode ( int iNode );
 	ISphExpr *				CreateLengthNode ( const ExprNode_t & tNode, ISphExpr * pLeft );
 	ISphExpr *				CreateGeodistNode ( int iArgs );
+	ISphExpr *				CreateFusedCmpNode ( int iNode, ISphExpr * pThen, ISphExpr * pElse );
+	ISphExpr *				CreateFusedMaddNode ( int iArgsNode );
 	ISphExpr *				CreatePFNode ( int iArg );
 	ISphExpr *				CreateBitdotNode ( int iArgsNode, CSphVector<ISphExpr *> & dArgs );
 	ISphExpr *				CreateUdfNode ( int iCall, ISphExpr * pLeft );
@@ -3829,6 +4183,15 @@ ISphExpr * ExprParser_t::CreateTree ( int iNode )
 	else if ( tNode.m_eArgType==SPH_ATTR_BIGINT )	return new _classname##Int64_c ( pLeft, pRight ); \
 	else											return new _classname##Float_c ( pLeft, pRight );
 
+	// fused attr-vs-const comparisons
+	ISphExpr * pFused = CreateFusedCmpNode ( iNode, NULL, NULL );
+	if ( pFused )
+	{
+		SafeRelease ( pLeft );
+		SafeRelease ( pRight );
+		return pFused;
+	}
+
 	switch ( tNode.m_iToken )
 	{
 		case TOK_ATTR_INT:		return new Expr_GetInt_c ( tNode.m_tLocator, tNode.m_iLocator );
@@ -3937,8 +4300,29 @@ ISphExpr * ExprParser_t::CreateTree ( int iNode )
 					case FUNC_POW:		return new Expr_Pow_c ( dArgs[0], dArgs[1] );
 					case FUNC_IDIV:		return new Expr_Idiv_c ( dArgs[0], dArgs[1] );
 
-					case FUNC_IF:		return new Expr_If_c ( dArgs[0], dArgs[1], dArgs[2] );
-					case FUNC_MADD:		return new Expr_Madd_c ( dArgs[0], dArgs[1], dArgs[2] );
+					case FUNC_IF:
+					{
+						CSphVector<int> dNodes;
+						GatherArgNodes ( tNode.m_iLeft, dNodes );
+						ISphExpr * pFusedIf = CreateFusedCmpNode ( dNodes[0], dArgs[1], dArgs[2] );
+						if ( pFusedIf )
+						{
+							SafeRelease ( dArgs[0] );
+							return pFusedIf;
+						}
+						return new Expr_If_c ( dArgs[0], dArgs[1], dArgs[2] );
+					}
+					case FUNC_MADD:
+					{
+						ISphExpr * pFusedMadd = CreateFusedMaddNode ( tNode.m_iLeft );
+						if ( pFusedMadd )
+						{
+							ARRAY_FOREACH ( i, dArgs )
+								SafeRelease ( dArgs[i] );
+							return pFusedMadd;
+						}
+						return new Expr_Madd_c ( dArgs[0], dArgs[1], dArgs[2] );
+					}
 					case FUNC_MUL3:		return new Expr_Mul3_c ( dArgs[0], dArgs[1], dArgs[2] );
 					case FUNC_ATAN2:	return new Expr_Atan2_c ( dArgs[0], dArgs[1] );
 
@@ -5201,6 +5585,159 @@ ISphExpr * ExprParser_t::CreateLengthNode ( const ExprNode_t & tNode, ISphExpr *
 }
 
 
+/// attribute that fused evaluators can read directly
+static inline bool IsFusableAttr ( const ExprNode_t * pNode )
+{
+	return pNode->m_iToken==TOK_ATTR_INT || pNode->m_iToken==TOK_ATTR_BITS || pNode->m_iToken==TOK_ATTR_FLOAT;
+}
+
+/// constant node value in all numeric flavors, converted the same way as Expr_Get*Const_c evaluators do
+static void GetConstValues ( const ExprNode_t * pNode, float & fValue, int & iValue, int64_t & iValue64 )
+{
+	assert ( IsConst ( pNode ) );
+	if ( pNode->m_iToken==TOK_CONST_FLOAT )
+	{
+		fValue = pNode->m_fConst;
+		iValue = (int)fValue;
+		iValue64 = (int64_t)fValue;
+
+	} else if ( pNode->m_eRetType==SPH_ATTR_INTEGER )
+	{
+		iValue = (int)pNode->m_iConst;
+		fValue = (float)iValue;
+		iValue64 = iValue;
+
+	} else if ( pNode->m_eRetType==SPH_ATTR_BIGINT )
+	{
+		iValue64 = pNode->m_iConst;
+		fValue = (float)iValue64;
+		iValue = (int)iValue64;
+
+	} else
+	{
+		fValue = float ( pNode->m_iConst );
+		iValue = (int)fValue;
+		iValue64 = (int64_t)fValue;
+	}
+}
+
+template < typename COND >
+static ISphExpr * SpawnFusedCond ( const COND & tCond, int iLocator, ISphExpr * pThen, ISphExpr * pElse )
+{
+	if ( pThen )
+		return new Expr_FusedIf_T<COND> ( tCond, iLocator, pThen, pElse );
+	return new Expr_FusedCmp_T<COND> ( tCond, iLocator );
+}
+
+template < typename ATTR, typename T >
+static ISphExpr * SpawnFusedCmp ( int iToken, const ExprNode_t * pAttr, T tConst, ISphExpr * pThen, ISphExpr * pElse )
+{
+	const CSphAttrLocator & tLoc = pAttr->m_tLocator;
+	int iLoc = pAttr->m_iLocator;
+	switch ( iToken )
+	{
+		case '<':		return SpawnFusedCond ( FusedAttrCmp_T<ATTR,T,FusedLt_t> ( tLoc, tConst ), iLoc, pThen, pElse );
+		case '>':		return SpawnFusedCond ( FusedAttrCmp_T<ATTR,T,FusedGt_t> ( tLoc, tConst ), iLoc, pThen, pElse );
+		case TOK_LTE:	return SpawnFusedCond ( FusedAttrCmp_T<ATTR,T,FusedLte_t> ( tLoc, tConst ), iLoc, pThen, pElse );
+		case TOK_GTE:	return SpawnFusedCond ( FusedAttrCmp_T<ATTR,T,FusedGte_t> ( tLoc, tConst ), iLoc, pThen, pElse );
+		case TOK_EQ:	return SpawnFusedCond ( FusedAttrCmp_T<ATTR,T,FusedEq_t> ( tLoc, tConst ), iLoc, pThen, pElse );
+		case TOK_NE:	return SpawnFusedCond ( FusedAttrCmp_T<ATTR,T,FusedNe_t> ( tLoc, tConst ), iLoc, pThen, pElse );
+		default:		return NULL;
+	}
+}
+
+/// fused attr CMP const (or const CMP attr) node; IF() over it when branches are given
+/// returns NULL when the node is not of a fusable shape, branches ownership stays with the caller then
+ISphExpr * ExprParser_t::CreateFusedCmpNode ( int iNode, ISphExpr * pThen, ISphExpr * pElse )
+{
+	const ExprNode_t & tNode = m_dNodes[iNode];
+	int iToken = tNode.m_iToken;
+	if ( iToken!='<' && iToken!='>' && iToken!=TOK_LTE && iToken!=TOK_GTE && iToken!=TOK_EQ && iToken!=TOK_NE )
+		return NULL;
+	if ( tNode.m_iLeft<0 || tNode.m_iRight<0 )
+		return NULL;
+
+	const ExprNode_t * pAttr = &m_dNodes [ tNode.m_iLeft ];
+	const ExprNode_t * pConst = &m_dNodes [ tNode.m_iRight ];
+	if ( IsConst ( pAttr ) && IsFusableAttr ( pConst ) )
+	{
+		// const CMP attr, mirror it
+		Swap ( pAttr, pConst );
+		switch ( iToken )
+		{
+			case '<':		iToken = '>'; break;
+			case '>':		iToken = '<'; break;
+			case TOK_LTE:	iToken = TOK_GTE; break;
+			case TOK_GTE:	iToken = TOK_LTE; break;
+			default:		break;
+		}
+	}
+
+	if ( !IsFusableAttr ( pAttr ) || !IsConst ( pConst ) )
+		return NULL;
+
+	float fConst;
+	int iConst;
+	int64_t iConst64;
+	GetConstValues ( pConst, fConst, iConst, iConst64 );
+
+	// same argument type dispatch as LOC_SPAWN_POLY does
+	if ( pAttr->m_iToken==TOK_ATTR_FLOAT )
+	{
+		if ( tNode.m_eArgType==SPH_ATTR_INTEGER || tNode.m_eArgType==SPH_ATTR_BIGINT )
+			return NULL;
+		return SpawnFusedCmp<FusedFloatAttr_t> ( iToken, pAttr, fConst, pThen, pElse );
+	}
+
+	if ( tNode.m_eArgType==SPH_ATTR_INTEGER )
+		return SpawnFusedCmp<FusedIntAttr_t> ( iToken, pAttr, iConst, pThen, pElse );
+	else if ( tNode.m_eArgType==SPH_ATTR_BIGINT )
+		return SpawnFusedCmp<FusedIntAttr_t> ( iToken, pAttr, iConst64, pThen, pElse );
+	else
+		return SpawnFusedCmp<FusedIntAttr_t> ( iToken, pAttr, fConst, pThen, pElse );
+}
+
+/// fused MADD ( const, attr, attr ) node, or NULL when the args are not of that shape
+ISphExpr * ExprParser_t::CreateFusedMaddNode ( int iArgsNode )
+{
+	CSphVector<int> dNodes;
+	GatherArgNodes ( iArgsNode, dNodes );
+	if ( dNodes.GetLength()!=3 )
+		return NULL;
+
+	const ExprNode_t * pConst = &m_dNodes[dNodes[0]];
+	const ExprNode_t * pMul = &m_dNodes[dNodes[1]];
+	const ExprNode_t * pAdd = &m_dNodes[dNodes[2]];
+	if ( !IsConst ( pConst ) )
+		Swap ( pConst, pMul );
+
+	if ( !IsConst ( pConst ) || !IsFusableAttr ( pMul ) || !IsFusableAttr ( pAdd ) )
+		return NULL;
+
+	float fConst;
+	int iConst;
+	int64_t iConst64;
+	GetConstValues ( pConst, fConst, iConst, iConst64 );
+
+	bool bMulFloat = ( pMul->m_iToken==TOK_ATTR_FLOAT );
+	bool bAddFloat = ( pAdd->m_iToken==TOK_ATTR_FLOAT );
+
+#define LOC_SPAWN_MADD(_mul,_add) \
+	return new Expr_FusedMadd_T<_mul,_add> ( pMul->m_tLocator, pMul->m_iLocator, pAdd->m_tLocator, pAdd->m_iLocator, fConst, iConst, iConst64 );
+
+	if ( bMulFloat && bAddFloat )
+		LOC_SPAWN_MADD ( FusedFloatAttr_t, FusedFloatAttr_t )
+	else if ( bMulFloat )
+		LOC_SPAWN_MADD ( FusedFloatAttr_t, FusedIntAttr_t )
+	else if ( bAddFloat )
+		LOC_SPAWN_MADD ( FusedIntAttr_t, FusedFloatAttr_t )
+	else
+		LOC_SPAWN_MADD ( FusedIntAttr_t, FusedIntAttr_t )
+
+#undef LOC_SPAWN_MADD
+}
+
+
 ISphExpr * ExprParser_t::CreateGeodistNode ( int iArgs )
 {
 	CSphVector<int> dArgs;
@@ -6298,7 +6835,8 @@ ISphExpr * ExprParser_t::Parse ( const char * sExpr, const ISphSchema & tSchema,
 				dNodes.Add ( tExpr.m_iLeft );
 		}
 
-#define SPH_EXPRNODE_STACK_SIZE 160
+// batch evaluators also keep a couple of SPH_EXPR_BATCH sized arrays per node
+#define SPH_EXPRNODE_STACK_SIZE ( 160 + 2*SPH_EXPR_BATCH*(int)sizeof(int64_t) )
 		int64_t iExprStack = sphGetStackUsed() + iMaxHeight*SPH_EXPRNODE_STACK_SIZE;
 		if ( g_iThreadStackSize<=iExprStack )
 		{
@@ -76,9 +76,14 @@ enum ESphExprCommand
 	SPH_EXPR_SET_STRING_POOL,
 	SPH_EXPR_SET_EXTRA_DATA,
 	SPH_EXPR_GET_DEPENDENT_COLS, ///< used to determine proper evaluating stage
-	SPH_EXPR_GET_UDF
+	SPH_EXPR_GET_UDF,
+	SPH_EXPR_SET_STORED_FIELDS	///< bind stored fields snapshot (ISphStoredFields) of the searched index
 };
 
+/// max matches per batch evaluation call
+/// batch evaluators keep per-node temporary arrays of this size on stack
+#define SPH_EXPR_BATCH	32
+
 /// expression evaluator
 /// can always be evaluated in floats using Eval()
 /// can sometimes be evaluated in integers using IntEval(), depending on type as returned from sphExprParse()
@@ -94,6 +99,16 @@ public:
 	/// evaluate this expression for that match, using int64 math
 	virtual int64_t Int64Eval ( const CSphMatch & tMatch ) const { assert ( 0 ); return (int64_t) Eval ( tMatch ); }
 
+	/// evaluate this expression for a batch of matches, using float math
+	/// iCount must not exceed SPH_EXPR_BATCH; default implementation just loops over Eval()
+	virtual void EvalBatch ( const CSphMatch * pMatches, int iCount, float * pOut ) const;
+
+	/// evaluate this expression for a batch of matches, using int math
+	virtual void IntEvalBatch ( const CSphMatch * pMatches, int iCount, int * pOut ) const;
+
+	/// evaluate this expression for a batch of matches, using int64 math
+	virtual void Int64EvalBatch ( const CSphMatch * pMatches, int iCount, int64_t * pOut ) const;
+
 	/// Evaluate string attr.
 	/// Note, that sometimes this method returns pointer to a static buffer
 	/// and sometimes it allocates a new buffer, so aware of memory leaks.
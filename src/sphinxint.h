@@ -47,7 +47,7 @@
 //////////////////////////////////////////////////////////////////////////
 
 const DWORD		INDEX_MAGIC_HEADER			= 0x58485053;		///< my magic 'SPHX' header
-const DWORD		INDEX_FORMAT_VERSION		= 42;				///< my format version
+const DWORD		INDEX_FORMAT_VERSION		= 43;				///< my format version
 
 const char		MAGIC_SYNONYM_WHITESPACE	= 1;				// used internally in tokenizer only
 const char		MAGIC_CODE_SENTENCE			= 2;				// emitted from tokenizer on sentence boundary
@@ -130,6 +130,32 @@ enum ESphQueryState
 STATIC_ASSERT ( SPH_QSTATE_UNKNOWN==0, BAD_QUERY_STATE_ENUM_BASE );
 
 
+/// full-text evaluation tree node counters, for plan profiling
+struct PlanNodeProfile_t
+{
+	CSphString		m_sName;		///< node type and details
+	int				m_iDepth;		///< depth in the evaluation tree, 0 for the root
+	int64_t			m_iDocCalls;	///< GetDocsChunk() calls
+	int64_t			m_iHitCalls;	///< GetHitsChunk() calls
+	int64_t			m_iDocs;		///< documents emitted
+	int64_t			m_iHits;		///< hits emitted
+	int64_t			m_iSkips;		///< skiplist hints (keyword nodes only)
+	int64_t			m_tmTotal;		///< time spent in this node and its children, in nanoseconds
+	int64_t			m_tmSelf;		///< time spent in this node only, in nanoseconds
+
+	PlanNodeProfile_t ()
+		: m_iDepth ( 0 )
+		, m_iDocCalls ( 0 )
+		, m_iHitCalls ( 0 )
+		, m_iDocs ( 0 )
+		, m_iHits ( 0 )
+		, m_iSkips ( 0 )
+		, m_tmTotal ( 0 )
+		, m_tmSelf ( 0 )
+	{}
+};
+
+
 /// search query profile
 class CSphQueryProfile
 {
@@ -141,6 +167,7 @@ public:
 	int64_t			m_tmTotal [ SPH_QSTATE_TOTAL+1 ];	///< total time spent per state
 
 	CSphStringBuilder	m_sTransformedTree;					///< transformed query tree
+	CSphVector<PlanNodeProfile_t>	m_dPlanNodes;			///< evaluation tree nodes with their counters, depth first
 
 public:
 	/// create empty and stopped profile
@@ -167,6 +194,7 @@ public:
 	{
 		memset ( m_dSwitches, 0, sizeof(m_dSwitches) );
 		memset ( m_tmTotal, 0, sizeof(m_tmTotal) );
+		m_dPlanNodes.Reset();
 		m_eState = eNew;
 		m_tmStamp = sphMicroTimer();
 	}
@@ -275,6 +303,7 @@ class CSphReader
 public:
 	CSphQueryProfile *	m_pProfile;
 	ESphQueryState		m_eProfileState;
+	int64_t *			m_pStatBytes;		///< per-query counter of bytes read from disk, if any
 
 public:
 	CSphReader ( BYTE * pBuf=NULL, int iSize=0 );
@@ -445,6 +474,8 @@ public:
 	const SmallStringHash_T<int64_t> *		m_pLocalDocs;
 	int64_t									m_iTotalDocs;
 
+	mutable CSphQueryStats					m_tStats;				///< per-query work counters
+
 public:
 	CSphQueryContext ();
 	~CSphQueryContext ();
@@ -458,6 +489,11 @@ public:
 	void						CalcSort ( CSphMatch & tMatch ) const;
 	void						CalcFinal ( CSphMatch & tMatch ) const;
 
+	/// batched versions, evaluate every item over an array of matches at once
+	void						CalcFilter ( CSphMatch * pMatches, int iCount ) const;
+	void						CalcSort ( CSphMatch * pMatches, int iCount ) const;
+	void						CalcFinal ( CSphMatch * pMatches, int iCount ) const;
+
 	void						FreeStrFilter ( CSphMatch & tMatch ) const;
 	void						FreeStrSort ( CSphMatch & tMatch ) const;
 	void						FreeStrFinal ( CSphMatch & tMatch ) const;
@@ -472,6 +508,9 @@ private:
 	CSphVector<const UservarIntSet_c*>		m_dUserVals;
 };
 
+/// bind stored fields snapshot to every expression of the given sorters (including postlimit ones)
+void sphSetStoredFields ( ISphMatchSorter ** ppSorters, int iSorters, ISphStoredFields * pFields );
+
 //////////////////////////////////////////////////////////////////////////
 // MEMORY TRACKER
 //////////////////////////////////////////////////////////////////////////
@@ -942,6 +981,28 @@ struct PoolPtrs_t
 	{}
 };
 
+/// match tag to MVA and strings pools mapping
+class CSphTaggedVector
+{
+public:
+	const PoolPtrs_t & operator [] ( int iTag ) const
+	{
+		return m_dPool [ iTag & 0x7FFFFFF ];
+	}
+	PoolPtrs_t & operator [] ( int iTag )
+	{
+		return m_dPool [ iTag & 0x7FFFFFF ];
+	}
+
+	void Resize ( int iSize )
+	{
+		m_dPool.Resize ( iSize );
+	}
+
+private:
+	CSphVector<PoolPtrs_t> m_dPool;
+};
+
 //////////////////////////////////////////////////////////////////////////
 // INLINES, FIND_XXX() GENERIC FUNCTIONS
 //////////////////////////////////////////////////////////////////////////
@@ -1695,7 +1756,7 @@ enum ESphExt
 {
 	SPH_EXT_SPH = 0,
 	SPH_EXT_SPA = 1,
-	SPH_EXT_MVP = 9
+	SPH_EXT_MVP = 10
 };
 
 const char ** sphGetExts ( ESphExtType eType, DWORD uVersion=INDEX_FORMAT_VERSION );
@@ -1803,6 +1864,10 @@ struct ISphSubstringPayload
 {
 	ISphSubstringPayload () {}
 	virtual ~ISphSubstringPayload() {}
+
+	/// deep copy for the expansion cache; NULL means this payload can not be cached
+	virtual ISphSubstringPayload *	Clone () const { return NULL; }
+	virtual int64_t					GetSizeBytes () const { return 0; }
 };
 
 
@@ -1853,6 +1918,339 @@ private:
 };
 
 
+/// per-index cache of wildcard expansions (words, stats and merged payload)
+/// bounded by memory size, evicts least recently used entries
+/// generation gets bumped on every invalidation, so that results computed
+/// against the older index data are neither served nor stored
+class CSphExpansionCache : public ISphNoncopyable
+{
+public:
+						CSphExpansionCache ();
+						~CSphExpansionCache ();
+
+	void				SetMaxBytes ( int64_t iMaxBytes );
+	int64_t				GetMaxBytes () const { return m_iMaxBytes; }
+	bool				IsEnabled () const { return m_iMaxBytes>0; }
+	int					GetGeneration () const { return m_iGeneration; }
+
+	bool				Lookup ( const CSphString & sKey, int iGeneration, ISphWordlist::Args_t & tArgs );
+	void				Store ( const CSphString & sKey, int iGeneration, const ISphWordlist::Args_t & tArgs );
+	void				Invalidate ();
+	void				GetStatus ( CSphIndexStatus * pRes ) const;
+
+private:
+	struct Entry_t
+	{
+		CSphString					m_sKey;
+		CSphVector<SphExpanded_t>	m_dExpanded;	///< m_iNameOff points into m_dWords here
+		CSphVector<char>			m_dWords;
+		ISphSubstringPayload *		m_pPayload;
+		int							m_iTotalDocs;
+		int							m_iTotalHits;
+		int64_t						m_iBytes;
+		Entry_t *					m_pPrev;
+		Entry_t *					m_pNext;
+
+		Entry_t () : m_pPayload ( NULL ), m_iTotalDocs ( 0 ), m_iTotalHits ( 0 ), m_iBytes ( 0 ), m_pPrev ( NULL ), m_pNext ( NULL ) {}
+		~Entry_t () { SafeDelete ( m_pPayload ); }
+	};
+
+	void				Unlink ( Entry_t * pEntry );
+	void				LinkHead ( Entry_t * pEntry );
+	void				Delete ( Entry_t * pEntry );
+	void				Shrink ( int64_t iMaxBytes );
+
+	mutable CSphStaticMutex		m_tLock;
+	SmallStringHash_T<Entry_t *>	m_hEntries;
+	Entry_t *					m_pHead;		///< most recently used
+	Entry_t *					m_pTail;		///< least recently used
+	int64_t						m_iMaxBytes;
+	int64_t						m_iUsedBytes;
+	volatile int				m_iGeneration;
+	int64_t						m_iHits;
+	int64_t						m_iMisses;
+};
+
+//////////////////////////////////////////////////////////////////////////
+// DOCUMENT STORAGE
+//////////////////////////////////////////////////////////////////////////
+
+/// worst case sphCompressBlock() output length
+int		sphCompressBound ( int iLen );
+
+/// zlib compress a block; returns compressed length, or 0 if it could not be compressed (or zlib is not available)
+int		sphCompressBlock ( const BYTE * pSrc, int iSrcLen, BYTE * pDst, int iDstLen );
+
+/// decompress exactly iDstLen bytes; returns false on malformed input (or if zlib is not available)
+bool	sphDecompressBlock ( const BYTE * pSrc, int iSrcLen, BYTE * pDst, int iDstLen );
+
+/// append a field to the packed stored document (fields are stored as length-prefixed blobs, in order)
+void	sphDocstorePackField ( CSphVector<BYTE> & dPacked, const BYTE * pData, int iLen );
+
+/// locate a field in the packed stored document; returns false if there is no such field
+bool	sphDocstoreUnpackField ( const BYTE * pPacked, int iPackedLen, int iField, const BYTE ** ppData, int * pLen );
+
+/// copy a field out of the packed stored document into a new[] allocated zero-terminated buffer (NULL if the field is empty)
+void	sphDocstoreCopyField ( const BYTE * pPacked, int iPackedLen, int iField, BYTE ** ppData, int * pLen );
+
+/// set global decompressed blocks cache size, in bytes (0 disables the cache)
+void	sphSetDocstoreCacheSize ( int64_t iMaxBytes );
+
+/// get global decompressed blocks cache counters
+void	sphGetDocstoreCacheStatus ( int64_t & iHits, int64_t & iMisses, int64_t & iBytes );
+
+
+struct DocstoreBlock_t
+{
+	SphDocID_t		m_uFirstDocid;
+	SphOffset_t		m_iOffset;
+};
+
+
+/// document storage (.spds) writer
+/// stored documents must be added in ascending docid order
+class CSphDocstoreWriter : ISphNoncopyable
+{
+public:
+							CSphDocstoreWriter ();
+
+	bool					Open ( const CSphString & sFile, const CSphVector<CSphString> & dFields, CSphString & sError );
+	void					AddDoc ( SphDocID_t uDocid, const BYTE * pPacked, int iPackedLen );
+	bool					Finish ( CSphString & sError );
+	void					UnlinkFile ();
+
+private:
+	CSphWriter					m_tWriter;
+	CSphVector<DocstoreBlock_t>	m_dBlocks;
+	CSphVector<BYTE>			m_dBlock;		///< raw data of the block being collected
+	CSphVector<BYTE>			m_dCompressed;
+	SphDocID_t					m_uLastDocid;
+	int							m_iMaxBlockLen;	///< longest raw block written so far
+
+	void					FlushBlock ();
+};
+
+
+/// document storage (.spds) reader
+/// keeps the block index in RAM, reads blocks on demand through the global block cache
+class CSphDocstore : ISphNoncopyable
+{
+public:
+							CSphDocstore ();
+							~CSphDocstore ();
+
+	bool					Load ( const CSphString & sFile, CSphString & sError );
+	void					Reset ();
+
+	const CSphVector<CSphString> &	GetFields () const { return m_dFields; }
+	int						GetFieldIndex ( const char * sName ) const;
+	int						GetBlocksCount () const { return m_dBlocks.GetLength(); }
+	int64_t					GetSizeBytes () const { return m_dBlocks.GetSizeBytes(); }
+
+	/// fetch one stored field by docid, decoded straight from the (cached) block into a new[] allocated zero-terminated copy
+	/// the copy is NULL if the field is empty; returns false if there is no such document
+	bool					GetField ( SphDocID_t uDocid, int iField, BYTE ** ppData, int * pLen ) const;
+
+	/// read and decompress a whole block, bypassing the cache
+	bool					ReadBlock ( int iBlock, CSphVector<BYTE> & dRaw ) const;
+
+private:
+	friend class CSphDocstoreIterator;
+
+	CSphVector<CSphString>		m_dFields;
+	CSphVector<DocstoreBlock_t>	m_dBlocks;
+	SphOffset_t					m_iIndexOffset;	///< block index offset, ie. end of the last block
+	int							m_iMaxBlockLen;	///< longest raw block in the file, to reject corrupted block headers
+	CSphAutofile				m_tFile;
+	int							m_iUid;			///< block cache key prefix
+};
+
+
+/// sequential reader over all the documents in the document storage
+class CSphDocstoreIterator : ISphNoncopyable
+{
+public:
+	explicit				CSphDocstoreIterator ( const CSphDocstore & tStore );
+
+	/// advance to the next document; returns false on eof or error
+	bool					Next ();
+
+public:
+	SphDocID_t				m_uDocid;
+	const BYTE *			m_pPacked;
+	int						m_iPackedLen;
+
+private:
+	const CSphDocstore &	m_tStore;
+	CSphVector<BYTE>		m_dBlock;
+	int						m_iBlock;
+	const BYTE *			m_pCur;
+};
+
+//////////////////////////////////////////////////////////////////////////
+// COLUMNAR RESULT SETS
+//////////////////////////////////////////////////////////////////////////
+
+/// append matches encoded column by column (agent result sets); only the first iAttrsCount attributes are encoded
+void	sphEncodeColumnar ( CSphVector<BYTE> & dRaw, const CSphMatch * pMatches, int iCount, const ISphSchema & tSchema, int iAttrsCount, const CSphTaggedVector & dTag2Pools );
+
+/// decode a columnar block into already allocated matches; MVA and pooled string values are appended to the given storages
+/// returns false on malformed block
+bool	sphDecodeColumnar ( const BYTE * pData, int iLen, CSphMatch * pMatches, int iCount, const ISphSchema & tSchema, CSphVector<DWORD> & dMvaStorage, CSphVector<BYTE> & dStringsStorage );
+
+
+/// JSON secondary index entry
+struct JsonIndexEntry_t
+{
+	int64_t			m_iValue;		///< integer value, or folded string hash
+	DWORD			m_uRow;			///< row number
+
+	bool operator < ( const JsonIndexEntry_t & rhs ) const
+	{
+		return m_iValue<rhs.m_iValue || ( m_iValue==rhs.m_iValue && m_uRow<rhs.m_uRow );
+	}
+};
+
+
+/// in-memory secondary index over a JSON attribute subkey (eg. j.category)
+/// maps scalar values found at that path to row numbers; used to select fullscan candidates
+class CSphJsonIndex
+{
+public:
+							CSphJsonIndex () : m_bValid ( false ) {}
+
+	/// resolve the path (column and dot-separated keys) against the schema
+	bool					Setup ( const CSphString & sPath, const CSphSchema & tSchema, CSphString & sError );
+
+	/// index all the rows; rows are in docinfo format (docid followed by attributes)
+	void					Build ( const CSphRowitem * pRows, int64_t iRows, int iStride, const BYTE * pStrings );
+
+	/// collect rows that might pass the filter (sorted, unique)
+	/// returns false if the filter can not be served by this index
+	bool					Lookup ( const CSphFilterSettings & tFilter, ESphCollation eCollation, CSphVector<DWORD> & dRows ) const;
+
+	/// stop serving lookups; in-place JSON updates call this, as rows can not be reindexed under a shared lock
+	void					Invalidate () { m_bValid = false; }
+
+	const CSphString &		GetPath () const { return m_sPath; }
+	const CSphString &		GetColumn () const { return m_sColumn; }
+	int64_t					GetSizeBytes () const { return m_dNumbers.GetSizeBytes() + m_dStrings.GetSizeBytes(); }
+
+protected:
+	bool						m_bValid;
+	CSphString					m_sPath;
+	CSphString					m_sColumn;
+	CSphVector<JsonKey_t>		m_dKeys;
+	CSphAttrLocator				m_tLocator;
+	CSphVector<JsonIndexEntry_t>	m_dNumbers;		///< int and double (truncated) values, sorted
+	CSphVector<JsonIndexEntry_t>	m_dStrings;		///< case-folded string hashes, sorted
+};
+
+/// build JSON secondary indexes for the given paths; paths that do not resolve are reported and skipped
+void	sphBuildJsonIndexes ( CSphVector<CSphJsonIndex> & dIndexes, const CSphVector<CSphString> & dPaths, const CSphSchema & tSchema,
+	const CSphRowitem * pRows, int64_t iRows, int iStride, const BYTE * pStrings, CSphString & sWarning );
+
+/// invalidate JSON secondary indexes over the column of an updated JSON subkey (eg. j.category)
+void	sphInvalidateJsonIndexes ( CSphVector<CSphJsonIndex> & dIndexes, const char * sUpdatedAttr );
+
+/// select candidate rows for the query filters using JSON secondary indexes
+/// returns false if none of the filters can use them; otherwise dRows gets the intersection (sorted)
+bool	sphJsonIndexCandidates ( const CSphVector<CSphJsonIndex> & dIndexes, const CSphQuery * pQuery, CSphVector<DWORD> & dRows );
+
+
+/// attribute (or "id") that is non-decreasing with docid, so that top-K searches ordered by it can stop early
+struct DocidOrderedAttr_t
+{
+	CSphString		m_sName;		///< lowercase attribute name, or "id"
+	bool			m_bValid;		///< cleared by UPDATE, as that might break the order
+};
+
+/// verify attributes declared as non-decreasing with docid against the rows (docinfo format)
+/// attributes that are missing, of unsupported types or out of order are reported and skipped
+void	sphCheckDocidOrderedAttrs ( CSphVector<DocidOrderedAttr_t> & dOrdered, const CSphVector<CSphString> & dDeclared,
+	const CSphSchema & tSchema, const CSphRowitem * pRows, int64_t iRows, int iStride, CSphString & sWarning );
+
+/// stop trusting the order of an updated attribute
+void	sphInvalidateDocidOrderedAttr ( CSphVector<DocidOrderedAttr_t> & dOrdered, const char * sUpdatedAttr );
+
+/// check if a search might stop as soon as the (full) sorter rejects a match
+/// that holds when the sort key only gets worse along the docid order; bDesc returns the docid order to scan in
+bool	sphCanStopEarly ( const CSphQuery * pQuery, int iSorters, ISphMatchSorter ** ppSorters,
+	const CSphVector<DocidOrderedAttr_t> & dOrdered, bool bFullscan, bool & bDesc );
+
+
+/// deleted rows of an immutable row set (disk index or RT disk chunk), addressed by row number
+/// a map is an immutable snapshot; Kill() makes a new one that shares all the untouched pages with this one,
+/// so a search just keeps a reference to the snapshot it started with, and needs neither locks nor kill-lists
+/// rows are split into 64K-row pages, that only get allocated on the first delete in their range;
+/// a page keeps its deleted rows as a sorted array of 16-bit offsets (roaring style),
+/// until that array would get bigger than a plain bitmap of the page, and then turns into that bitmap
+class CSphDeadRows : public ISphRefcountedMT
+{
+public:
+	static const int	PAGE_BITS = 16;
+	static const int	PAGE_WORDS = 1 << ( PAGE_BITS-5 );	///< bitmap page size, in DWORDs
+	static const int	PAGE_ARRAY_MAX = 2*PAGE_WORDS;		///< max array page length, in WORDs
+	static const DWORD	PAGE_MASK = ( 1UL << PAGE_BITS )-1;
+
+						CSphDeadRows () : m_dPages ( 0 ), m_iDead ( 0 ) {}
+
+	/// make a snapshot that also has the given rows deleted; rows must be sorted
+	/// returns NULL if all of them were deleted already
+	CSphDeadRows *		Kill ( const DWORD * pRows, int iCount ) const;
+
+	inline bool			IsDead ( DWORD uRow ) const
+	{
+		DWORD uPage = uRow >> PAGE_BITS;
+		if ( uPage>=(DWORD)m_dPages.GetLength() || !m_dPages[uPage] )
+			return false;
+		return m_dPages[uPage]->IsDead ( WORD ( uRow & PAGE_MASK ) );
+	}
+
+	int64_t				GetDead () const { return m_iDead; }
+	int64_t				GetLengthBytes () const;
+
+protected:
+	virtual				~CSphDeadRows ();
+
+private:
+	/// deleted rows of a 64K rows range, either an array or a bitmap
+	struct Page_t : public ISphRefcountedMT
+	{
+		CSphFixedVector<WORD>	m_dRows;	///< sorted offsets of deleted rows (if the page is an array)
+		CSphFixedVector<DWORD>	m_dBits;	///< deleted rows bitmap (if the page is a bitmap)
+		int						m_iDead;
+
+		Page_t () : m_dRows ( 0 ), m_dBits ( 0 ), m_iDead ( 0 ) {}
+
+		inline bool IsDead ( WORD uOff ) const
+		{
+			if ( m_dBits.GetLength() )
+				return ( m_dBits [ uOff>>5 ] & ( 1UL << ( uOff & 31 ) ) )!=0;
+
+			int iLeft = 0;
+			int iRight = m_dRows.GetLength()-1;
+			while ( iLeft<=iRight )
+			{
+				int iMid = ( iLeft+iRight ) >> 1;
+				if ( m_dRows[iMid]==uOff )
+					return true;
+				if ( m_dRows[iMid]<uOff )
+					iLeft = iMid+1;
+				else
+					iRight = iMid-1;
+			}
+			return false;
+		}
+	};
+
+	static Page_t *		KillPage ( const Page_t * pPage, const DWORD * pRows, int iCount );
+
+	CSphFixedVector<const Page_t *>	m_dPages;
+	int64_t							m_iDead;
+};
+
+
 struct ExpansionContext_t
 {
 	const ISphWordlist * m_pWordlist;
@@ -1866,6 +2264,8 @@ struct ExpansionContext_t
 	CSphScopedPayload * m_pPayloads;
 	ESphHitless m_eHitless;
 	const void * m_pIndexData;
+	CSphExpansionCache * m_pCache;
+	int m_iCacheGeneration;
 
 	ExpansionContext_t ();
 };
@@ -1984,6 +2384,58 @@ public:
 };
 
 
+/// trigram infix index over the keywords dictionary
+/// maps every keyword byte trigram to a compressed list of keyword ordinals,
+/// and every keyword ordinal to its text and dictionary entry data,
+/// so that infix lookups intersect posting lists instead of scanning dictionary blocks
+class TrigramInfixes_c : public ISphNoncopyable
+{
+public:
+	bool				IsEmpty () const { return m_dWords.GetLength()==0; }
+	void				Reset ();
+
+	/// add next keyword (in dictionary order), along with its entry data offset; then call Finish()
+	void				AddWord ( const BYTE * sWord, int iLen, int64_t iEntryOff );
+	void				Finish ();
+	int64_t				GetSizeBytes () const;
+
+	/// fill ordinals of the keywords that contain every trigram of a given substring
+	/// returns false when substring is too short to be looked up via trigrams
+	bool				GetCandidates ( const BYTE * sSubstring, int iSubLen, CSphVector<int> & dWords ) const;
+
+	const BYTE *		GetWord ( int iWord ) const { return m_dWordBuf.Begin() + m_dWords[iWord].m_iNameOff; }
+	int64_t				GetEntryOffset ( int iWord ) const { return m_dWords[iWord].m_iEntryOff; }
+
+private:
+	struct Word_t
+	{
+		int64_t		m_iEntryOff;	///< entry data offset into the wordlist buffer
+		int			m_iNameOff;		///< keyword text offset into words arena
+	};
+
+	struct Trigram_t
+	{
+		DWORD		m_uTrigram;
+		int			m_iCount;		///< keywords count in the posting list
+		int64_t		m_iOffset;		///< posting list offset into postings arena
+
+		bool operator < ( const Trigram_t & rhs ) const { return m_uTrigram<rhs.m_uTrigram; }
+	};
+
+	struct TrigramKey_fn
+	{
+		DWORD operator () ( const Trigram_t & tTrigram ) const { return tTrigram.m_uTrigram; }
+	};
+
+	static DWORD		Pack ( const BYTE * s ) { return ( DWORD(s[0])<<16 ) | ( DWORD(s[1])<<8 ) | DWORD(s[2]); }
+
+	CSphVector<Word_t>			m_dWords;
+	CSphTightVector<BYTE>		m_dWordBuf;
+	CSphVector<Trigram_t>		m_dTrigrams;	///< sorted by trigram
+	CSphTightVector<BYTE>		m_dPostings;	///< delta coded keyword ordinals
+	CSphVector<uint64_t>		m_dPairs;		///< ( trigram, keyword ordinal ) pairs collected until Finish()
+};
+
 ISphInfixBuilder * sphCreateInfixBuilder ( int iCodepointBytes, CSphString * pError );
 bool sphLookupInfixCheckpoints ( const char * sInfix, int iBytes, const BYTE * pInfixes, const CSphVector<InfixBlock_t> & dInfixBlocks, int iInfixCodepointBytes, CSphVector<int> & dCheckpoints );
 // calculate length, upto iInfixCodepointBytes chars from infix start
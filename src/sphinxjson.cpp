@@ -40,6 +40,38 @@ struct JsonNode_t
 };
 #define YYSTYPE JsonNode_t
 
+
+/// compute key mask (for Bloom filtering) from the key crc
+static inline DWORD JsonCrcMask ( DWORD uCrc )
+{
+	return
+		( 1UL<<( uCrc & 31 ) ) +
+		( 1UL<<( ( uCrc>>8 ) & 31 ) );
+}
+
+
+/// object key directory entry
+struct JsonKeyDirEntry_t
+{
+	DWORD			m_uCrc;			///< key crc
+	DWORD			m_uOffset;		///< entry offset, relative to the object bloom mask
+
+	bool operator < ( const JsonKeyDirEntry_t & rhs ) const
+	{
+		return m_uCrc<rhs.m_uCrc || ( m_uCrc==rhs.m_uCrc && m_uOffset<rhs.m_uOffset );
+	}
+};
+
+
+/// locate object key directory by the object payload end, return NULL if there is none
+static inline const BYTE * JsonKeyDir ( const BYTE * pEnd, int * pKeys )
+{
+	if ( pEnd[-1]!=JSON_KEYDIR_MARKER )
+		return NULL;
+	*pKeys = (int)sphGetDword ( pEnd-5 );
+	return pEnd - 5 - (*pKeys)*2*sizeof(DWORD);
+}
+
 // must be included after YYSTYPE declaration
 #include "yysphinxjson.h"
 
@@ -296,7 +328,8 @@ public:
 		}
 
 		// check for the root (bson v1), note sKey shouldn't be set
-		if ( eType==JSON_OBJECT && m_dBuffer.GetLength()==4 && !sKey )
+		// large roots are stored as a regular object (behind a zero mask) so that they get a key directory
+		if ( eType==JSON_OBJECT && m_dBuffer.GetLength()==4 && !sKey && dNodes.GetLength()<JSON_KEYDIR_MIN_KEYS )
 			eType = JSON_ROOT;
 
 		// write node type
@@ -328,6 +361,8 @@ public:
 			{
 				DWORD uMask = 0;
 				int iOfs = 0;
+				bool bKeyDir = ( eType==JSON_OBJECT && dNodes.GetLength()>=JSON_KEYDIR_MIN_KEYS );
+				CSphVector<JsonKeyDirEntry_t> dKeyDir ( bKeyDir ? dNodes.GetLength() : 0 );
 
 				if ( eType==JSON_OBJECT )
 				{
@@ -339,11 +374,30 @@ public:
 				{
 					char * sObjKey = m_pBuf + dNodes[i].m_iKeyStart;
 					int iLen = KeyUnescape ( &sObjKey, dNodes[i].m_iKeyEnd-dNodes[i].m_iKeyStart );
+					DWORD uCrc = sphCRC32 ( sObjKey, iLen );
+					if ( bKeyDir )
+					{
+						dKeyDir[i].m_uCrc = uCrc;
+						dKeyDir[i].m_uOffset = m_dBuffer.GetLength()-iOfs-1;
+					}
 					WriteNode ( dNodes[i], sObjKey, iLen );
-					uMask |= sphJsonKeyMask ( sObjKey, iLen );
+					uMask |= JsonCrcMask ( uCrc );
 				}
 				m_dBuffer.Add ( JSON_EOF );
 
+				// offsets are relative to the mask, so they survive PackSize() moving the payload
+				if ( bKeyDir )
+				{
+					dKeyDir.Sort();
+					ARRAY_FOREACH ( i, dKeyDir )
+					{
+						StoreInt ( (int)dKeyDir[i].m_uCrc );
+						StoreInt ( (int)dKeyDir[i].m_uOffset );
+					}
+					StoreInt ( dKeyDir.GetLength() );
+					m_dBuffer.Add ( JSON_KEYDIR_MARKER );
+				}
+
 				if ( eType==JSON_OBJECT )
 				{
 					StoreMask ( iOfs+1, uMask );
@@ -435,11 +489,19 @@ public:
 		case JSON_ROOT:
 		case JSON_OBJECT:
 			{
+				const BYTE * pEnd = NULL;
 				if ( eType==JSON_OBJECT )
-					sphJsonUnpackInt ( &p );
+				{
+					int iSize = sphJsonUnpackInt ( &p );
+					pEnd = p + iSize;
+				}
 
 				DWORD uMask = sphGetDword(p);
-				printf ( "%s (bloom mask: 0x%08x)\n", eType==JSON_OBJECT ? "JSON_OBJECT" : "JSON_ROOT", uMask );
+				int iKeys = 0;
+				if ( pEnd && JsonKeyDir ( pEnd, &iKeys ) )
+					printf ( "JSON_OBJECT (bloom mask: 0x%08x, key directory: %d)\n", uMask, iKeys );
+				else
+					printf ( "%s (bloom mask: 0x%08x)\n", eType==JSON_OBJECT ? "JSON_OBJECT" : "JSON_ROOT", uMask );
 				p += 4; // skip bloom table
 				for ( ;; )
 				{
@@ -454,6 +516,8 @@ public:
 					p += iStrLen;
 					DebugDump ( eInnerType, &p, iLevel+1 );
 				}
+				if ( pEnd )
+					p = pEnd; // skip key directory
 				break;
 			}
 
@@ -584,10 +648,7 @@ bool sphJsonParse ( CSphVector<BYTE> & dData, char * sData, bool bAutoconv, bool
 
 DWORD sphJsonKeyMask ( const char * sKey, int iLen )
 {
-	DWORD uCrc = sphCRC32 ( sKey, iLen );
-	return
-		( 1UL<<( uCrc & 31 ) ) +
-		( 1UL<<( ( uCrc>>8 ) & 31 ) );
+	return JsonCrcMask ( sphCRC32 ( sKey, iLen ) );
 }
 
 
@@ -671,7 +732,11 @@ int sphJsonFieldLength ( ESphJsonType eType, const BYTE * pData )
 	case JSON_OBJECT:
 	case JSON_ROOT:
 		if ( eType==JSON_OBJECT )
-			sphJsonUnpackInt ( &p ); // skip size
+		{
+			int iSize = sphJsonUnpackInt ( &p );
+			if ( JsonKeyDir ( p+iSize, &iCount ) )
+				return iCount;
+		}
 		p += 4; // skip filter
 		for ( ;; )
 		{
@@ -703,18 +768,72 @@ ESphJsonType sphJsonFindFirst ( const BYTE ** ppData )
 }
 
 
+static ESphJsonType JsonFindByKeyDir ( const BYTE * pObj, const BYTE * pDir, int iKeys, const BYTE ** ppValue, const void * pKey, int iLen, DWORD uCrc, int * pSlot )
+{
+	// check the hinted slot first; only accept it when it is the first one with its crc
+	// (duplicate keys must resolve to the first entry, just like the linear scan does)
+	int iSlot = pSlot ? *pSlot : -1;
+	if ( iSlot<0 || iSlot>=iKeys || sphGetDword ( pDir+iSlot*8 )!=uCrc || ( iSlot>0 && sphGetDword ( pDir+iSlot*8-8 )==uCrc ) )
+	{
+		// lower bound by crc
+		int iLo = 0, iHi = iKeys;
+		while ( iLo<iHi )
+		{
+			int iMid = iLo + ( iHi-iLo )/2;
+			if ( sphGetDword ( pDir+iMid*8 )<uCrc )
+				iLo = iMid+1;
+			else
+				iHi = iMid;
+		}
+		iSlot = iLo;
+	}
+
+	for ( ; iSlot<iKeys && sphGetDword ( pDir+iSlot*8 )==uCrc; iSlot++ )
+	{
+		const BYTE * p = pObj + sphGetDword ( pDir+iSlot*8+4 );
+		ESphJsonType eType = (ESphJsonType) *p++;
+		int iStrLen = sphJsonUnpackInt ( &p );
+		if ( iStrLen==iLen && !memcmp ( p, pKey, iStrLen ) )
+		{
+			if ( pSlot )
+				*pSlot = iSlot;
+			*ppValue = p + iStrLen;
+			return eType;
+		}
+	}
+
+	return JSON_EOF;
+}
+
+
 ESphJsonType sphJsonFindByKey ( ESphJsonType eType, const BYTE ** ppValue, const void * pKey, int iLen, DWORD uMask )
+{
+	return sphJsonFindByKey ( eType, ppValue, pKey, iLen, uMask, sphCRC32 ( pKey, iLen ), NULL );
+}
+
+
+ESphJsonType sphJsonFindByKey ( ESphJsonType eType, const BYTE ** ppValue, const void * pKey, int iLen, DWORD uMask, DWORD uCrc, int * pSlot )
 {
 	if ( eType!=JSON_OBJECT && eType!=JSON_ROOT )
 		return JSON_EOF;
 
 	const BYTE * p = *ppValue;
+	const BYTE * pEnd = NULL;
 	if ( eType==JSON_OBJECT )
-		sphJsonUnpackInt ( &p );
+	{
+		int iSize = sphJsonUnpackInt ( &p );
+		pEnd = p + iSize;
+	}
 
 	if ( ( sphGetDword(p) & uMask )!=uMask )
 		return JSON_EOF;
 
+	// large object? use its key directory
+	int iKeys = 0;
+	const BYTE * pDir = pEnd ? JsonKeyDir ( pEnd, &iKeys ) : NULL;
+	if ( pDir )
+		return JsonFindByKeyDir ( p, pDir, iKeys, ppValue, pKey, iLen, uCrc, pSlot );
+
 	p += 4;
 	for ( ;; )
 	{
@@ -930,8 +1049,12 @@ const BYTE * sphJsonFieldFormat ( CSphVector<BYTE> & dOut, const BYTE * pData, E
 		case JSON_ROOT:
 		case JSON_OBJECT:
 			{
+				const BYTE * pEnd = NULL;
 				if ( eType==JSON_OBJECT )
-					sphJsonUnpackInt ( &p );
+				{
+					int iSize = sphJsonUnpackInt ( &p );
+					pEnd = p + iSize;
+				}
 				p += 4; // skip bloom table
 				dOut.Add ( '{' );
 				for ( int i=0;;i++ )
@@ -946,6 +1069,8 @@ const BYTE * sphJsonFieldFormat ( CSphVector<BYTE> & dOut, const BYTE * pData, E
 					p = sphJsonFieldFormat ( dOut, p, eNode, true );
 				}
 				dOut.Add ( '}' );
+				if ( pEnd )
+					p = pEnd; // skip key directory
 				break;
 			}
 		case JSON_TRUE:		JsonAddStr ( dOut, bQuoteString ? "true" : "1" ); break;
@@ -41,6 +41,13 @@ enum ESphJsonType
 };
 
 
+/// objects with at least this many keys get a sorted key directory appended to their payload
+/// directory is (key crc, entry offset) pairs sorted by crc, then the entry count and a marker byte
+/// objects without a directory always end with JSON_EOF, so the marker tells them apart
+#define JSON_KEYDIR_MIN_KEYS	16
+#define JSON_KEYDIR_MARKER		0xff
+
+
 /// get stored value from SphinxBSON blob
 inline int sphJsonLoadInt ( const BYTE ** pp )
 {
@@ -113,6 +120,10 @@ ESphJsonType sphJsonFindFirst ( const BYTE ** ppData );
 /// find value by key in SphinxBSON blob, return associated type
 ESphJsonType sphJsonFindByKey ( ESphJsonType eType, const BYTE ** ppValue, const void * pKey, int iLen, DWORD uMask );
 
+/// find value by key in SphinxBSON blob, return associated type
+/// uses precomputed key crc, and a key directory slot hint (updated on successful directory lookups)
+ESphJsonType sphJsonFindByKey ( ESphJsonType eType, const BYTE ** ppValue, const void * pKey, int iLen, DWORD uMask, DWORD uCrc, int * pSlot );
+
 /// find value by index in SphinxBSON blob, return associated type
 ESphJsonType sphJsonFindByIndex ( ESphJsonType eType, const BYTE ** ppValue, int iIndex );
 
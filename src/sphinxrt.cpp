@@ -406,7 +406,11 @@ public:
 	bool						m_bTlsKlist;	///< whether to apply TLS K-list during merge (must only be used by writer during Commit())
 	CSphTightVector<BYTE>		m_dStrings;		///< strings storage
 	CSphTightVector<DWORD>		m_dMvas;		///< MVAs storage
+	CSphTightVector<BYTE>		m_dStored;			///< packed stored documents, in rows order
+	CSphTightVector<DWORD>		m_dStoredOffsets;	///< per-row offsets into m_dStored (empty when nothing is stored)
 	CSphVector<BYTE>			m_dKeywordCheckpoints;
+	CSphVector<CSphJsonIndex>	m_dJsonIndexes;		///< JSON secondary indexes over rows (built on creation, merge and load)
+	CSphVector<DocidOrderedAttr_t>	m_dDocidOrdered;	///< declared docid ordered attributes that hold in this segment
 	mutable CSphAtomic<long>	m_tRefCount;
 
 	RtSegment_t ()
@@ -427,16 +431,56 @@ public:
 		SafeDelete ( m_pKlist );
 	}
 
+	/// wipe all the data but keep the buffers, so that a freed segment can be filled anew
+	void Recycle ()
+	{
+		assert ( m_tRefCount==0 );
+		m_tSegmentSeq.Lock ();
+		m_iTag = m_iSegments++;
+		m_tSegmentSeq.Unlock ();
+
+		m_dWords.Resize ( 0 );
+		m_dWordCheckpoints.Resize ( 0 );
+		m_dInfixFilterCP.Resize ( 0 );
+		m_dDocs.Resize ( 0 );
+		m_dHits.Resize ( 0 );
+		m_iRows = 0;
+		m_iAliveRows = 0;
+		m_dRows.Resize ( 0 );
+		m_bTlsKlist = false;
+		m_dStrings.Resize ( 0 );
+		m_dStrings.Add ( 0 ); // dummy zero offset
+		m_dMvas.Resize ( 0 );
+		m_dMvas.Add ( 0 ); // dummy zero offset
+		m_dStored.Resize ( 0 );
+		m_dStoredOffsets.Resize ( 0 );
+		m_dKeywordCheckpoints.Resize ( 0 );
+		m_dJsonIndexes.Reset();
+		m_dDocidOrdered.Resize ( 0 );
+
+		if ( m_pKlist->m_dKilled.GetLength() )
+		{
+			SafeDelete ( m_pKlist );
+			m_pKlist = new KlistRefcounted_t();
+		}
+	}
+
 
 	int64_t GetUsedRam () const
 	{
+		int64_t iJsonIndexes = 0;
+		ARRAY_FOREACH ( i, m_dJsonIndexes )
+			iJsonIndexes += m_dJsonIndexes[i].GetSizeBytes();
+
 		// FIXME! gonna break on vectors over 2GB
-		return
+		return iJsonIndexes +
 			( (int64_t)m_dWords.GetLimit() )*sizeof(m_dWords[0]) +
 			( (int64_t)m_dDocs.GetLimit() )*sizeof(m_dDocs[0]) +
 			( (int64_t)m_dHits.GetLimit() )*sizeof(m_dHits[0]) +
 			( (int64_t)m_dStrings.GetLimit() )*sizeof(m_dStrings[0]) +
 			( (int64_t)m_dMvas.GetLimit() )*sizeof(m_dMvas[0]) +
+			( (int64_t)m_dStored.GetLimit() )*sizeof(m_dStored[0]) +
+			( (int64_t)m_dStoredOffsets.GetLimit() )*sizeof(m_dStoredOffsets[0]) +
 			( (int64_t)m_dKeywordCheckpoints.GetLimit() )*sizeof(m_dKeywordCheckpoints[0])+
 			( (int64_t)m_dRows.GetLimit() )*sizeof(m_dRows[0]) +
 			( (int64_t)m_dInfixFilterCP.GetLength()*sizeof(m_dInfixFilterCP[0]) );
@@ -456,6 +500,43 @@ public:
 
 	const CSphRowitem *		FindRow ( SphDocID_t uDocid ) const;
 	const CSphRowitem *		FindAliveRow ( SphDocID_t uDocid ) const;
+
+	bool HasStored () const
+	{
+		return m_dStoredOffsets.GetLength()!=0;
+	}
+
+	/// get packed stored document of the given row
+	void GetStoredDoc ( const CSphRowitem * pRow, const BYTE ** ppDoc, int * pLen ) const
+	{
+		int iRow = ( pRow - m_dRows.Begin() ) / GetStride();
+		assert ( iRow>=0 && iRow<m_dStoredOffsets.GetLength() );
+		DWORD uEnd = ( iRow+1<m_dStoredOffsets.GetLength() ) ? m_dStoredOffsets[iRow+1] : m_dStored.GetLength();
+		*ppDoc = m_dStored.Begin() + m_dStoredOffsets[iRow];
+		*pLen = uEnd - m_dStoredOffsets[iRow];
+	}
+
+	/// append packed stored document for the next row
+	void AddStoredDoc ( const BYTE * pDoc, int iLen )
+	{
+		m_dStoredOffsets.Add ( m_dStored.GetLength() );
+		if ( iLen )
+		{
+			int iOff = m_dStored.GetLength();
+			m_dStored.Resize ( iOff+iLen );
+			memcpy ( m_dStored.Begin()+iOff, pDoc, iLen );
+		}
+	}
+
+	/// copy packed stored document of the given row from another segment
+	void CopyStoredDoc ( const RtSegment_t * pSrc, const CSphRowitem * pSrcRow )
+	{
+		const BYTE * pDoc = NULL;
+		int iLen = 0;
+		if ( pSrc->HasStored() )
+			pSrc->GetStoredDoc ( pSrcRow, &pDoc, &iLen );
+		AddStoredDoc ( pDoc, iLen );
+	}
 };
 
 int RtSegment_t::m_iSegments = 0;
@@ -839,8 +920,9 @@ struct RtHitReader2_t : public RtHitReader_t
 
 //////////////////////////////////////////////////////////////////////////
 
-/// forward ref
+/// forward refs
 struct RtIndex_t;
+class CSphSource_StringVector;
 
 struct JSONAttr_t
 {
@@ -848,6 +930,21 @@ struct JSONAttr_t
 	int		m_iLen;
 };
 
+/// stored document location in the accumulator
+struct RtStoredDoc_t
+{
+	SphDocID_t		m_uDocid;
+	int				m_iOffset;
+	int				m_iLen;
+
+	bool operator < ( const RtStoredDoc_t & rhs ) const
+	{
+		if ( m_uDocid!=rhs.m_uDocid )
+			return m_uDocid<rhs.m_uDocid;
+		return m_iOffset<rhs.m_iOffset;
+	}
+};
+
 /// indexing accumulator
 class RtAccum_t
 {
@@ -860,6 +957,8 @@ public:
 	CSphTightVector<BYTE>		m_dStrings;
 	CSphTightVector<DWORD>		m_dMvas;
 	CSphVector<DWORD>			m_dPerDocHitsCount;
+	CSphTightVector<BYTE>		m_dStored;		///< packed stored documents, in insertion order
+	CSphVector<RtStoredDoc_t>	m_dStoredDocs;
 
 	bool						m_bKeywordDict;
 	CSphDict *					m_pDict;
@@ -870,15 +969,25 @@ private:
 	CSphDict *					m_pDictCloned;
 	ISphRtDictWraper *			m_pDictRt;
 
+public:
+	// indexing state reused across documents and transactions, so that steady inserts do not hit the heap
+	ISphTokenizer *				m_pTokenizer;		///< indexing tokenizer clone, with per-index filters on top
+	CSphSource_StringVector *	m_pSource;			///< document source that builds the hits
+	long						m_iIndexingGen;		///< index setup generation the two above were made for
+	bool						m_bTokenFilterOptions;	///< whether the token filter got per-document options
+	CSphVector<BYTE>			m_dPackedStored;	///< stored fields of the current document
+
 public:
 					explicit RtAccum_t ( bool bKeywordDict );
 					~RtAccum_t();
 
 	void			SetupDict ( RtIndex_t * pIndex, CSphDict * pDict, bool bKeywordDict );
 	void			ResetDict ();
+	void			ResetIndexing ();
 	void			Sort ();
 
 	void			AddDocument ( ISphHits * pHits, const CSphMatch & tDoc, int iRowSize, const char ** ppStr, const CSphVector<DWORD> & dMvas, const CSphVector<JSONAttr_t> & dJson );
+	void			AddStoredDoc ( SphDocID_t uDocid, const CSphVector<BYTE> & dPacked );
 	RtSegment_t *	CreateSegment ( int iRowSize, int iWordsCheckpoint );
 	void			CleanupDuplicates ( int iRowSize );
 	void			GrabLastWarning ( CSphString & sWarning );
@@ -887,6 +996,9 @@ public:
 /// TLS indexing accumulator (we disallow two uncommitted adds within one thread; and so need at most one)
 static SphThreadKey_t g_tTlsAccumKey;
 
+/// RT index setup generations sequence (tells accumulators their cached indexing state went stale)
+static CSphAtomic<long> g_tRtIndexingGen;
+
 /// binlog file view of the index
 /// everything that a given log file needs to know about an index
 struct BinlogIndexInfo_t
@@ -1004,7 +1116,7 @@ public:
 	void	CheckPath ( const CSphConfigSection & hSearchd, bool bTestMode );
 
 private:
-	static const DWORD		BINLOG_VERSION = 5;
+	static const DWORD		BINLOG_VERSION = 6;
 
 	static const DWORD		BINLOG_HEADER_MAGIC = 0x4c425053;	/// magic 'SPBL' header that marks binlog file
 	static const DWORD		BLOP_MAGIC = 0x214e5854;			/// magic 'TXN!' header that marks binlog entry
@@ -1060,17 +1172,43 @@ private:
 };
 
 
+/// disk chunks retired (by optimize or truncate) while some readers might still use them
+/// every reader holds the epoch that was current when it started; an epoch keeps all the newer ones alive,
+/// so a chunk goes away once the last reader that could have seen it is gone
+struct RtRetiredChunks_t : public ISphRefcountedMT
+{
+	CSphVector<const CSphIndex *>	m_dChunks;	///< chunks retired during this epoch
+	RtRetiredChunks_t *				m_pNext;	///< next epoch
+
+	RtRetiredChunks_t ()
+		: m_pNext ( NULL )
+	{}
+
+protected:
+	virtual ~RtRetiredChunks_t ()
+	{
+		ARRAY_FOREACH ( i, m_dChunks )
+			SafeDelete ( m_dChunks[i] );
+		SafeRelease ( m_pNext );
+	}
+};
+
+
 struct SphChunkGuard_t
 {
 	CSphFixedVector<const RtSegment_t *>	m_dRamChunks;
 	CSphFixedVector<const CSphIndex *>		m_dDiskChunks;
 	CSphFixedVector<const KlistRefcounted_t *>		m_dKill;
-	CSphRwlock *							m_pReading;
+	CSphFixedVector<const CSphDeadRows *>	m_dDeadRows;	///< per disk chunk, its deleted rows snapshot
+	RtRetiredChunks_t *						m_pRetiredChunks;	///< keeps m_dDiskChunks alive
+	int										m_iExpansionGeneration;	///< expansion cache generation that matches these RAM chunks
 	SphChunkGuard_t ()
 		: m_dRamChunks ( 0 )
 		, m_dDiskChunks ( 0 )
 		, m_dKill ( 0 )
-		, m_pReading ( NULL )
+		, m_dDeadRows ( 0 )
+		, m_pRetiredChunks ( NULL )
+		, m_iExpansionGeneration ( 0 )
 	{
 	}
 	~SphChunkGuard_t();
@@ -1083,7 +1221,9 @@ struct RtIndex_t : public ISphRtIndex, public ISphNoncopyable, public ISphWordli
 {
 private:
 	static const DWORD			META_HEADER_MAGIC	= 0x54525053;	///< my magic 'SPRT' header
-	static const DWORD			META_VERSION		= 9;			///< current version
+	static const DWORD			META_VERSION		= 10;			///< current version
+	static const int			SEGMENT_POOL_SIZE	= 16;			///< max freed segments kept for reuse
+	static const int			SEGMENT_POOL_MAX_RAM	= 131072;	///< max RAM of a freed segment that we still keep
 
 private:
 	int							m_iStride;
@@ -1092,7 +1232,6 @@ private:
 
 	CSphMutex					m_tWriting;
 	mutable CSphRwlock			m_tChunkLock;
-	mutable CSphRwlock			m_tReading;
 
 	/// double buffer stuff (allows to work with RAM chunk while future disk is being saved)
 	/// m_dSegments consists of two parts
@@ -1109,6 +1248,8 @@ private:
 	CSphString					m_sPath;
 	bool						m_bPathStripped;
 	CSphVector<CSphIndex*>		m_dDiskChunks;
+	CSphVector<CSphDeadRows*>	m_dDeadRows;					///< per disk chunk, current snapshot of its deleted rows
+	RtRetiredChunks_t *			m_pRetiredChunks;				///< current retired disk chunks epoch
 	int							m_iLockFD;
 	mutable CSphKilllist		m_tKlist;							///< kill list for disk chunks and saved chunks
 	int							m_iDiskBase;
@@ -1123,8 +1264,12 @@ private:
 	int							m_iWordsCheckpoint;
 	int							m_iMaxCodepointLength;
 	ISphTokenizer *				m_pTokenizerIndexing;
+	long						m_iIndexingGen;						///< bumped whenever tokenizer, dict or schema change; invalidates accumulators indexing state
 	int							m_iOndiskAttrs;						///< int because we need 3-state, not just bool
 
+	CSphMutex					m_tSegmentPoolLock;
+	CSphVector<RtSegment_t*>	m_dSegmentPool;						///< small freed segments, recycled along with their buffers
+
 public:
 	explicit					RtIndex_t ( const CSphSchema & tSchema, const char * sIndexName, int64_t iRamSize, const char * sPath, bool bKeywordDict );
 	virtual						~RtIndex_t ();
@@ -1142,11 +1287,15 @@ public:
 	virtual bool				Truncate ( CSphString & sError );
 	virtual void				Optimize ( volatile bool * pForceTerminate, ThrottleState_t * pThrottle );
 	CSphIndex *					GetDiskChunk ( int iChunk ) { return m_dDiskChunks.GetLength()>iChunk ? m_dDiskChunks[iChunk] : NULL; }
+	RtSegment_t *				AllocSegment ();	///< new empty segment, recycled one if we have any
 
 private:
 	/// acquire thread-local indexing accumulator
 	/// returns NULL if another index already uses it in an open txn
 	RtAccum_t *					AcquireAccum ( CSphString * sError=NULL );
+	bool						SetupAccumIndexing ( RtAccum_t * pAcc, const CSphString & sTokenFilterOptions, CSphString & sError );
+	bool						CreateAccumIndexing ( RtAccum_t * pAcc, CSphString & sError );
+	void						RecycleSegment ( const RtSegment_t * pSeg );
 
 	RtSegment_t *				MergeSegments ( const RtSegment_t * pSeg1, const RtSegment_t * pSeg2, const CSphVector<SphDocID_t> * pAccKlist, bool bHasMorphology );
 	const RtWord_t *			CopyWord ( RtSegment_t * pDst, RtWordWriter_t & tOutWord, const RtSegment_t * pSrc, const RtWord_t * pWord, RtWordReader_t & tInWord, const CSphVector<SphDocID_t> * pAccKlist );
@@ -1162,6 +1311,9 @@ private:
 	void						SaveDiskChunk ( int64_t iTID, const SphChunkGuard_t & tGuard, const CSphSourceStats & tStats );
 	CSphIndex *					LoadDiskChunk ( const char * sChunk, CSphString & sError ) const;
 	bool						LoadRamChunk ( DWORD uVersion, bool bRebuildInfixes );
+	void						KillDiskChunkRows ( int iChunk );
+	CSphDeadRows *				KillChunkDocs ( int iChunk, CSphVector<SphDocID_t> & dDocs ) const;
+	RtRetiredChunks_t *			RetireDiskChunks ( const CSphIndex * const * ppChunks, int iChunks );
 	bool						SaveRamChunk ();
 
 	virtual void				GetPrefixedWords ( const char * sSubstring, int iSubLen, const char * sWildcard, Args_t & tArgs ) const;
@@ -1212,6 +1364,8 @@ public:
 	virtual bool						EarlyReject ( CSphQueryContext * pCtx, CSphMatch & ) const;
 	virtual const CSphSourceStats &		GetStats () const { return m_tStats; }
 	virtual void				GetStatus ( CSphIndexStatus* ) const;
+	virtual void				GetExpansionCacheStatus ( CSphIndexStatus * pRes ) const;
+	virtual ISphStoredFields *	CreateStoredFields ( const CSphDeadRows * ) const;
 
 	virtual bool				MultiQuery ( const CSphQuery * pQuery, CSphQueryResult * pResult, int iSorters, ISphMatchSorter ** ppSorters, const CSphMultiQueryArgs & tArgs ) const;
 	virtual bool				MultiQueryEx ( int iQueries, const CSphQuery * ppQueries, CSphQueryResult ** ppResults, ISphMatchSorter ** ppSorters, const CSphMultiQueryArgs & tArgs ) const;
@@ -1235,6 +1389,8 @@ public:
 
 	bool						IsWordDict () const { return m_bKeywordDict; }
 	void						BuildSegmentInfixes ( RtSegment_t * pSeg, bool bHasMorphology ) const;
+	void						BuildSegmentJsonIndexes ( RtSegment_t * pSeg ) const;
+	void						CheckSegmentDocidOrder ( RtSegment_t * pSeg ) const;
 
 	// TODO: implement me
 	virtual	void				SetProgressCallback ( CSphIndexProgress::IndexingProgress_fn ) {}
@@ -1269,10 +1425,12 @@ RtIndex_t::RtIndex_t ( const CSphSchema & tSchema, const char * sIndexName, int6
 	, m_bKeywordDict ( bKeywordDict )
 	, m_iWordsCheckpoint ( RTDICT_CHECKPOINT_V5 )
 	, m_pTokenizerIndexing ( NULL )
+	, m_iIndexingGen ( g_tRtIndexingGen.Inc()+1 )
 	, m_iOndiskAttrs ( 0 )
 {
 	MEMORY ( MEM_INDEX_RT );
 
+	m_pRetiredChunks = new RtRetiredChunks_t();
 	m_tSchema = tSchema;
 	m_iStride = DOCINFO_IDSIZE + m_tSchema.GetRowSize();
 
@@ -1287,9 +1445,9 @@ RtIndex_t::RtIndex_t ( const CSphSchema & tSchema, const char * sIndexName, int6
 
 	Verify ( m_tWriting.Init() );
 	Verify ( m_tChunkLock.Init() );
-	Verify ( m_tReading.Init() );
 	Verify ( m_tFlushLock.Init() );
 	Verify ( m_tOptimizingLock.Init() );
+	Verify ( m_tSegmentPoolLock.Init() );
 }
 
 
@@ -1304,9 +1462,9 @@ RtIndex_t::~RtIndex_t ()
 		SaveMeta ( m_dDiskChunks.GetLength(), m_iTID );
 	}
 
+	Verify ( m_tSegmentPoolLock.Done() );
 	Verify ( m_tOptimizingLock.Done() );
 	Verify ( m_tFlushLock.Done() );
-	Verify ( m_tReading.Done() );
 	Verify ( m_tChunkLock.Done() );
 	Verify ( m_tWriting.Done() );
 
@@ -1317,8 +1475,16 @@ RtIndex_t::~RtIndex_t ()
 	ARRAY_FOREACH ( i, m_dRetired )
 		SafeDelete ( m_dRetired[i] );
 
+	ARRAY_FOREACH ( i, m_dSegmentPool )
+		SafeDelete ( m_dSegmentPool[i] );
+
+	// disk chunks might still be used by stored fields snapshots of the finished queries
 	ARRAY_FOREACH ( i, m_dDiskChunks )
-		SafeDelete ( m_dDiskChunks[i] );
+		m_pRetiredChunks->m_dChunks.Add ( m_dDiskChunks[i] );
+	SafeRelease ( m_pRetiredChunks );
+
+	ARRAY_FOREACH ( i, m_dDeadRows )
+		SafeRelease ( m_dDeadRows[i] );
 
 	SafeDelete ( m_pTokenizerIndexing );
 
@@ -1415,9 +1581,11 @@ int64_t RtIndex_t::GetUsedRam () const
 class CSphSource_StringVector : public CSphSource_Document
 {
 public:
-	explicit			CSphSource_StringVector ( int iFields, const char ** ppFields, const CSphSchema & tSchema );
+	explicit			CSphSource_StringVector ( const CSphSchema & tSchema );
 	virtual				~CSphSource_StringVector () {}
 
+	void				SetFields ( int iFields, const char ** ppFields );
+
 	virtual bool		Connect ( CSphString & );
 	virtual void		Disconnect ();
 
@@ -1441,11 +1609,15 @@ protected:
 };
 
 
-CSphSource_StringVector::CSphSource_StringVector ( int iFields, const char ** ppFields, const CSphSchema & tSchema )
+CSphSource_StringVector::CSphSource_StringVector ( const CSphSchema & tSchema )
 	: CSphSource_Document ( "$stringvector" )
 {
 	m_tSchema = tSchema;
+	m_iMaxHits = 0; // force all hits build
+}
 
+void CSphSource_StringVector::SetFields ( int iFields, const char ** ppFields )
+{
 	m_dFields.Resize ( 1+iFields );
 	for ( int i=0; i<iFields; i++ )
 	{
@@ -1453,8 +1625,6 @@ CSphSource_StringVector::CSphSource_StringVector ( int iFields, const char ** pp
 		assert ( m_dFields[i] );
 	}
 	m_dFields [ iFields ] = NULL;
-
-	m_iMaxHits = 0; // force all hits build
 }
 
 bool CSphSource_StringVector::Connect ( CSphString & )
@@ -1498,9 +1668,73 @@ bool RtIndex_t::AddDocument ( int iFields, const char ** ppFields, const CSphMat
 	if ( !pAcc )
 		return false;
 
+	if ( !SetupAccumIndexing ( pAcc, sTokenFilterOptions, sError ) )
+		return false;
+
+	CSphSource_StringVector & tSrc = *pAcc->m_pSource;
+	tSrc.SetFields ( iFields, ppFields );
+	tSrc.SetDict ( pAcc->m_pDict );
+	m_tSchema.CloneWholeMatch ( &tSrc.m_tDocInfo, tDoc );
+	int64_t iSrcBytes = tSrc.GetStats().m_iTotalBytes;
+
+	if ( !tSrc.IterateStart ( sError ) || !tSrc.IterateDocument ( sError ) )
+		return false;
+
+	ISphHits * pHits = tSrc.IterateHits ( sError );
+	pAcc->GrabLastWarning ( sWarning );
+
+	if ( !AddDocument ( pHits, tDoc, ppStr, dMvas, sError, sWarning ) )
+		return false;
+
+	if ( m_tSettings.m_dStoredFields.GetLength() )
+	{
+		CSphVector<BYTE> & dPacked = pAcc->m_dPackedStored;
+		dPacked.Resize ( 0 );
+		ARRAY_FOREACH ( i, m_tSettings.m_dStoredFields )
+		{
+			int iField = m_tSchema.GetFieldIndex ( m_tSettings.m_dStoredFields[i].cstr() );
+			const char * sText = ( iField>=0 && iField<iFields ) ? ppFields[iField] : NULL;
+			sphDocstorePackField ( dPacked, (const BYTE *)sText, sText ? strlen ( sText ) : 0 );
+		}
+		pAcc->AddStoredDoc ( tDoc.m_uDocID, dPacked );
+	}
+
+	m_tStats.m_iTotalBytes += tSrc.GetStats().m_iTotalBytes - iSrcBytes;
+
+	return true;
+}
+
+
+/// prepare the accumulator tokenizer and document source for the next document
+/// those are only (re)created when our setup changed since they were made
+bool RtIndex_t::SetupAccumIndexing ( RtAccum_t * pAcc, const CSphString & sTokenFilterOptions, CSphString & sError )
+{
+	// token filter options are per document; a document without them needs a pristine filter
+	if ( pAcc->m_bTokenFilterOptions && sTokenFilterOptions.IsEmpty() )
+		pAcc->ResetIndexing();
+
+	if ( !pAcc->m_pSource || pAcc->m_iIndexingGen!=m_iIndexingGen )
+	{
+		pAcc->ResetIndexing();
+		if ( !CreateAccumIndexing ( pAcc, sError ) )
+			return false;
+	}
+
+	if ( !sTokenFilterOptions.IsEmpty() && !m_tSettings.m_sIndexTokenFilter.IsEmpty() )
+	{
+		pAcc->m_bTokenFilterOptions = true;
+		if ( !pAcc->m_pTokenizer->SetFilterOptions ( sTokenFilterOptions.cstr(), sError ) )
+			return false;
+	}
+	return true;
+}
+
+
+bool RtIndex_t::CreateAccumIndexing ( RtAccum_t * pAcc, CSphString & sError )
+{
+
 	CSphScopedPtr<ISphTokenizer> pTokenizer ( m_pTokenizerIndexing->Clone ( SPH_CLONE_INDEX ) ); // avoid race
 
-	// OPTIMIZE? do not create filter on each(!) INSERT
 	if ( !m_tSettings.m_sIndexTokenFilter.IsEmpty() )
 	{
 		ISphTokenizer * p = pTokenizer.LeakPtr();
@@ -1512,16 +1746,12 @@ bool RtIndex_t::AddDocument ( int iFields, const char ** ppFields, const CSphMat
 		}
 		if ( !pTokenizer->SetFilterSchema ( m_tSchema, sError ) )
 			return false;
-		if ( !sTokenFilterOptions.IsEmpty() )
-			if ( !pTokenizer->SetFilterOptions ( sTokenFilterOptions.cstr(), sError ) )
-				return false;
 	}
 
-	// OPTIMIZE? do not create filter on each(!) INSERT
 	if ( m_tSettings.m_uAotFilterMask )
 		pTokenizer = sphAotCreateFilter ( pTokenizer.LeakPtr(), m_pDict, m_tSettings.m_bIndexExactWords, m_tSettings.m_uAotFilterMask );
 
-	CSphSource_StringVector tSrc ( iFields, ppFields, m_tSchema );
+	CSphScopedPtr<CSphSource_StringVector> pSrc ( new CSphSource_StringVector ( m_tSchema ) );
 
 	// SPZ setup
 	if ( m_tSettings.m_bIndexSP && !pTokenizer->EnableSentenceIndexing ( sError ) )
@@ -1530,29 +1760,19 @@ bool RtIndex_t::AddDocument ( int iFields, const char ** ppFields, const CSphMat
 	if ( !m_tSettings.m_sZones.IsEmpty() && !pTokenizer->EnableZoneIndexing ( sError ) )
 		return false;
 
-	if ( m_tSettings.m_bHtmlStrip && !tSrc.SetStripHTML ( m_tSettings.m_sHtmlIndexAttrs.cstr(), m_tSettings.m_sHtmlRemoveElements.cstr(),
+	if ( m_tSettings.m_bHtmlStrip && !pSrc->SetStripHTML ( m_tSettings.m_sHtmlIndexAttrs.cstr(), m_tSettings.m_sHtmlRemoveElements.cstr(),
 			m_tSettings.m_bIndexSP, m_tSettings.m_sZones.cstr(), sError ) )
 		return false;
 
-	tSrc.Setup ( m_tSettings );
-	tSrc.SetTokenizer ( pTokenizer.Ptr() );
-	tSrc.SetDict ( pAcc->m_pDict );
-	if ( !tSrc.Connect ( m_sLastError ) )
-		return false;
-
-	m_tSchema.CloneWholeMatch ( &tSrc.m_tDocInfo, tDoc );
-
-	if ( !tSrc.IterateStart ( sError ) || !tSrc.IterateDocument ( sError ) )
+	pSrc->Setup ( m_tSettings );
+	pSrc->SetTokenizer ( pTokenizer.Ptr() );
+	pSrc->SetDict ( pAcc->m_pDict );
+	if ( !pSrc->Connect ( m_sLastError ) )
 		return false;
 
-	ISphHits * pHits = tSrc.IterateHits ( sError );
-	pAcc->GrabLastWarning ( sWarning );
-
-	if ( !AddDocument ( pHits, tDoc, ppStr, dMvas, sError, sWarning ) )
-		return false;
-
-	m_tStats.m_iTotalBytes += tSrc.GetStats().m_iTotalBytes;
-
+	pAcc->m_pTokenizer = pTokenizer.LeakPtr();
+	pAcc->m_pSource = pSrc.LeakPtr();
+	pAcc->m_iIndexingGen = m_iIndexingGen;
 	return true;
 }
 
@@ -1664,6 +1884,10 @@ RtAccum_t::RtAccum_t ( bool bKeywordDict )
 	, m_pRefIndex ( NULL )
 	, m_pDictCloned ( NULL )
 	, m_pDictRt ( NULL )
+	, m_pTokenizer ( NULL )
+	, m_pSource ( NULL )
+	, m_iIndexingGen ( 0 )
+	, m_bTokenFilterOptions ( false )
 {
 	m_dStrings.Add ( 0 );
 	m_dMvas.Add ( 0 );
@@ -1671,10 +1895,19 @@ RtAccum_t::RtAccum_t ( bool bKeywordDict )
 
 RtAccum_t::~RtAccum_t()
 {
+	ResetIndexing();
 	SafeDelete ( m_pDictCloned );
 	SafeDelete ( m_pDictRt );
 }
 
+void RtAccum_t::ResetIndexing ()
+{
+	SafeDelete ( m_pSource );
+	SafeDelete ( m_pTokenizer );
+	m_iIndexingGen = 0;
+	m_bTokenFilterOptions = false;
+}
+
 void RtAccum_t::SetupDict ( RtIndex_t * pIndex, CSphDict * pDict, bool bKeywordDict )
 {
 	if ( pIndex!=m_pRefIndex || pDict!=m_pRefDict || bKeywordDict!=m_bKeywordDict )
@@ -1876,7 +2109,7 @@ RtSegment_t * RtAccum_t::CreateSegment ( int iRowSize, int iWordsCheckpoint )
 
 	MEMORY ( MEM_RT_ACCUM );
 
-	RtSegment_t * pSeg = new RtSegment_t ();
+	RtSegment_t * pSeg = m_pIndex->AllocSegment();
 
 	CSphWordHit tClosingHit;
 	tClosingHit.m_uWordID = WORDID_MAX;
@@ -1989,11 +2222,48 @@ RtSegment_t * RtAccum_t::CreateSegment ( int iRowSize, int iWordsCheckpoint )
 	pSeg->m_dMvas.SwapData ( m_dMvas );
 	sphSortDocinfos ( pSeg->m_dRows.Begin(), pSeg->m_dRows.GetLength()/iStride, iStride );
 
+	// align stored documents with the sorted rows; the last copy of a duplicate wins, same as with attributes
+	if ( m_dStoredDocs.GetLength() )
+	{
+		m_dStoredDocs.Sort();
+		pSeg->m_dStored.Reserve ( m_dStored.GetLength() );
+		pSeg->m_dStoredOffsets.Reserve ( pSeg->m_iRows );
+
+		int iStored = 0;
+		for ( int iRow=0; iRow<pSeg->m_iRows; iRow++ )
+		{
+			SphDocID_t uDocid = DOCINFO2ID ( &pSeg->m_dRows [ iRow*iStride ] );
+			while ( iStored<m_dStoredDocs.GetLength() && ( m_dStoredDocs[iStored].m_uDocid<uDocid
+				|| ( iStored+1<m_dStoredDocs.GetLength() && m_dStoredDocs[iStored+1].m_uDocid==uDocid ) ) )
+				iStored++;
+
+			if ( iStored<m_dStoredDocs.GetLength() && m_dStoredDocs[iStored].m_uDocid==uDocid )
+				pSeg->AddStoredDoc ( m_dStored.Begin()+m_dStoredDocs[iStored].m_iOffset, m_dStoredDocs[iStored].m_iLen );
+			else
+				pSeg->AddStoredDoc ( NULL, 0 );
+		}
+	}
+	m_dStored.Resize ( 0 );
+	m_dStoredDocs.Resize ( 0 );
+
 	// done
 	return pSeg;
 }
 
 
+void RtAccum_t::AddStoredDoc ( SphDocID_t uDocid, const CSphVector<BYTE> & dPacked )
+{
+	RtStoredDoc_t & tDoc = m_dStoredDocs.Add();
+	tDoc.m_uDocid = uDocid;
+	tDoc.m_iOffset = m_dStored.GetLength();
+	tDoc.m_iLen = dPacked.GetLength();
+
+	m_dStored.Resize ( tDoc.m_iOffset+tDoc.m_iLen );
+	if ( tDoc.m_iLen )
+		memcpy ( m_dStored.Begin()+tDoc.m_iOffset, dPacked.Begin(), tDoc.m_iLen );
+}
+
+
 struct AccumDocHits_t
 {
 	SphDocID_t m_uDocid;
@@ -2636,12 +2906,36 @@ void RtIndex_t::BuildSegmentInfixes ( RtSegment_t * pSeg, bool bHasMorphology )
 }
 
 
+void RtIndex_t::BuildSegmentJsonIndexes ( RtSegment_t * pSeg ) const
+{
+	if ( !pSeg || !m_dJsonIndexPaths.GetLength() )
+		return;
+
+	CSphString sWarning;
+	sphBuildJsonIndexes ( pSeg->m_dJsonIndexes, m_dJsonIndexPaths, m_tSchema, pSeg->m_dRows.Begin(), pSeg->m_iRows, m_iStride,
+		pSeg->m_dStrings.Begin(), sWarning );
+	if ( !sWarning.IsEmpty() )
+		sphWarning ( "index '%s': %s", m_sIndexName.cstr(), sWarning.cstr() );
+}
+
+
+void RtIndex_t::CheckSegmentDocidOrder ( RtSegment_t * pSeg ) const
+{
+	if ( !pSeg || !m_dDocidOrderedAttrs.GetLength() )
+		return;
+
+	// segments hold arbitrary docid subsets, so an attribute might only be ordered in some of them; skip the rest quietly
+	CSphString sWarning;
+	sphCheckDocidOrderedAttrs ( pSeg->m_dDocidOrdered, m_dDocidOrderedAttrs, m_tSchema, pSeg->m_dRows.Begin(), pSeg->m_iRows, m_iStride, sWarning );
+}
+
+
 RtSegment_t * RtIndex_t::MergeSegments ( const RtSegment_t * pSeg1, const RtSegment_t * pSeg2, const CSphVector<SphDocID_t> * pAccKlist, bool bHasMorphology )
 {
 	if ( pSeg1->m_iTag > pSeg2->m_iTag )
 		Swap ( pSeg1, pSeg2 );
 
-	RtSegment_t * pSeg = new RtSegment_t ();
+	RtSegment_t * pSeg = AllocSegment();
 
 	////////////////////
 	// merge attributes
@@ -2670,6 +2964,10 @@ RtSegment_t * RtIndex_t::MergeSegments ( const RtSegment_t * pSeg1, const RtSegm
 	StorageStringVector_t tStorageString ( m_tSchema, dStrings );
 	StorageMvaVector_t tStorageMva ( m_tSchema, dMvas );
 
+	bool bStored = ( pSeg1->HasStored() || pSeg2->HasStored() );
+	if ( bStored )
+		pSeg->m_dStored.Reserve ( Max ( pSeg1->m_dStored.GetLength(), pSeg2->m_dStored.GetLength() ) );
+
 	RtRowIterator_t tIt1 ( pSeg1, m_iStride, true, pAccKlist, pSeg1->GetKlist() );
 	RtRowIterator_t tIt2 ( pSeg2, m_iStride, true, pAccKlist, pSeg2->GetKlist() );
 
@@ -2681,6 +2979,8 @@ RtSegment_t * RtIndex_t::MergeSegments ( const RtSegment_t * pSeg1, const RtSegm
 		if ( !pRow2 || ( pRow1 && pRow2 && DOCINFO2ID(pRow1)<DOCINFO2ID(pRow2) ) )
 		{
 			assert ( pRow1 );
+			if ( bStored )
+				pSeg->CopyStoredDoc ( pSeg1, pRow1 );
 			for ( int i=0; i<m_iStride; i++ )
 				dRows.Add ( *pRow1++ );
 			CSphRowitem * pDstRow = dRows.Begin() + dRows.GetLength() - m_iStride;
@@ -2691,6 +2991,8 @@ RtSegment_t * RtIndex_t::MergeSegments ( const RtSegment_t * pSeg1, const RtSegm
 		{
 			assert ( pRow2 );
 			assert ( !pRow1 || ( DOCINFO2ID(pRow1)!=DOCINFO2ID(pRow2) ) ); // all dupes must be killed and skipped by the iterator
+			if ( bStored )
+				pSeg->CopyStoredDoc ( pSeg2, pRow2 );
 			for ( int i=0; i<m_iStride; i++ )
 				dRows.Add ( *pRow2++ );
 			CSphRowitem * pDstRow = dRows.Begin() + dRows.GetLength() - m_iStride;
@@ -2710,7 +3012,7 @@ RtSegment_t * RtIndex_t::MergeSegments ( const RtSegment_t * pSeg1, const RtSegm
 	// merged segment might be completely killed by committed data
 	if ( !pSeg->m_iRows )
 	{
-		SafeDelete ( pSeg );
+		RecycleSegment ( pSeg );
 		return NULL;
 	}
 
@@ -2773,6 +3075,8 @@ RtSegment_t * RtIndex_t::MergeSegments ( const RtSegment_t * pSeg1, const RtSegm
 		FixupSegmentCheckpoints ( pSeg );
 
 	BuildSegmentInfixes ( pSeg, bHasMorphology );
+	BuildSegmentJsonIndexes ( pSeg );
+	CheckSegmentDocidOrder ( pSeg );
 
 	assert ( pSeg->m_dRows.GetLength() );
 	assert ( pSeg->m_iRows );
@@ -2807,6 +3111,8 @@ void RtIndex_t::Commit ( int * pDeleted )
 		pAcc->m_dStrings.Resize ( 1 );
 		pAcc->m_dMvas.Resize ( 1 );
 		pAcc->m_dPerDocHitsCount.Resize ( 0 );
+		pAcc->m_dStored.Resize ( 0 );
+		pAcc->m_dStoredDocs.Resize ( 0 );
 		pAcc->ResetDict();
 		return;
 	}
@@ -2823,6 +3129,8 @@ void RtIndex_t::Commit ( int * pDeleted )
 	assert ( !pNewSeg || pNewSeg->m_bTlsKlist==false );
 
 	BuildSegmentInfixes ( pNewSeg, m_pDict->HasMorphology() );
+	BuildSegmentJsonIndexes ( pNewSeg );
+	CheckSegmentDocidOrder ( pNewSeg );
 
 #if PARANOID
 	if ( pNewSeg )
@@ -2835,6 +3143,8 @@ void RtIndex_t::Commit ( int * pDeleted )
 	pAcc->m_dStrings.Resize ( 1 ); // handle dummy zero offset
 	pAcc->m_dMvas.Resize ( 1 );
 	pAcc->m_dPerDocHitsCount.Resize ( 0 );
+	pAcc->m_dStored.Resize ( 0 );
+	pAcc->m_dStoredDocs.Resize ( 0 );
 	pAcc->ResetDict();
 
 	// sort accum klist, too
@@ -2846,7 +3156,7 @@ void RtIndex_t::Commit ( int * pDeleted )
 	// done; cleanup accum
 	pAcc->m_pIndex = NULL;
 	pAcc->m_iAccumDocs = 0;
-	pAcc->m_dAccumKlist.Reset();
+	pAcc->m_dAccumKlist.Resize ( 0 );
 	// reset accumulated warnings
 	CSphString sWarning;
 	pAcc->GrabLastWarning ( sWarning );
@@ -2985,6 +3295,9 @@ void RtIndex_t::CommitReplayable ( RtSegment_t * pNewSeg, CSphVector<SphDocID_t>
 	// adjust for an incoming accumulator K-list
 	int iTotalKilled = 0;
 	int iDiskLiveKLen = 0;
+	CSphVector<RtSegment_t*> dKlistSegs;
+	CSphVector<KlistRefcounted_t*> dKlists;
+	CSphFixedVector< CSphVector<SphDocID_t> > dChunkKills ( m_dDiskChunks.GetLength() );
 	if ( dAccKlist.GetLength() )
 	{
 		// update totals
@@ -3001,6 +3314,7 @@ void RtIndex_t::CommitReplayable ( RtSegment_t * pNewSeg, CSphVector<SphDocID_t>
 			bool bRamAlive = false;
 			bool bSavedOrDiskAlive = false;
 			bool bAlreadyKilled = false;
+			int iDiskChunk = -1;
 			for ( ;; )
 			{
 				for ( int j=m_dRamChunks.GetLength()-1; j>=m_iDoubleBuffer && !bRamAlive; --j )
@@ -3028,7 +3342,10 @@ void RtIndex_t::CommitReplayable ( RtSegment_t * pNewSeg, CSphVector<SphDocID_t>
 				{
 					bSavedOrDiskAlive = m_dDiskChunks[j]->HasDocid ( uDocid );
 					if ( bSavedOrDiskAlive )
+					{
+						iDiskChunk = j;
 						break;
+					}
 					// killed in previous disk chunks?
 					if ( sphBinarySearch ( m_dDiskChunks[j]->GetKillList(), m_dDiskChunks[j]->GetKillList()+m_dDiskChunks[j]->GetKillListSize()-1, uDocid ) )
 						break;
@@ -3040,6 +3357,10 @@ void RtIndex_t::CommitReplayable ( RtSegment_t * pNewSeg, CSphVector<SphDocID_t>
 			if ( bRamAlive || bSavedOrDiskAlive )
 				iTotalKilled++;
 
+			// only the chunk with the live version needs the kill, as it killed the older versions already
+			if ( !bAlreadyKilled && iDiskChunk>=0 )
+				dChunkKills[iDiskChunk].Add ( uDocid );
+
 			if ( bAlreadyKilled || !bSavedOrDiskAlive )
 			{
 				// we can't just RemoveFast() elements from vector
@@ -3079,18 +3400,11 @@ void RtIndex_t::CommitReplayable ( RtSegment_t * pNewSeg, CSphVector<SphDocID_t>
 				pKlist->m_dKilled.Reset ( dSegmentKlist.GetLength() );
 				memcpy ( pKlist->m_dKilled.Begin(), dSegmentKlist.Begin(), sizeof(dSegmentKlist[0]) * dSegmentKlist.GetLength() );
 
-				// swap data, update counters
-				m_tChunkLock.WriteLock();
-
-				uint64_t uRefs = pSeg->m_pKlist->m_tRefCount.Dec();
-				Swap ( pSeg->m_pKlist, pKlist ); // hold swapped kill-list for postponed delete
+				// update counters; the kill-list itself is swapped in along with the new segments
 				pSeg->m_iAliveRows -= iAdded;
 				assert ( pSeg->m_iAliveRows>=0 );
-
-				m_tChunkLock.Unlock();
-
-				if ( uRefs==1 ) // 1 means we only owner when decrement event occurred
-					SafeDelete ( pKlist );
+				dKlistSegs.Add ( pSeg );
+				dKlists.Add ( pKlist );
 			}
 
 			// mark as good
@@ -3111,6 +3425,11 @@ void RtIndex_t::CommitReplayable ( RtSegment_t * pNewSeg, CSphVector<SphDocID_t>
 	if ( iDiskLiveKLen )
 		m_tKlist.Add ( dAccKlist.Begin(), iDiskLiveKLen );
 
+	// disk chunks get new deleted rows snapshots, that go live along with the new segments
+	CSphVector<CSphDeadRows*> dDeadRows ( dChunkKills.GetLength() );
+	ARRAY_FOREACH ( i, dChunkKills )
+		dDeadRows[i] = dChunkKills[i].GetLength() ? KillChunkDocs ( i, dChunkKills[i] ) : NULL;
+
 	ARRAY_FOREACH ( i, dSegments )
 	{
 		RtSegment_t * pSeg = dSegments[i];
@@ -3125,16 +3444,39 @@ void RtIndex_t::CommitReplayable ( RtSegment_t * pNewSeg, CSphVector<SphDocID_t>
 	// wipe out readers - now we are only using RAM segments
 	m_tChunkLock.WriteLock ();
 
+	// segments are about to change, cached wildcard expansions are no longer valid
+	// readers take the generation under the chunk lock, so none could pair the new one with the old segments
+	m_pExpansionCache->Invalidate();
+
 	// go live!
 	// got rid of 'old' double-buffer segments then add 'new' onces
 	m_dRamChunks.Resize ( m_iDoubleBuffer + dSegments.GetLength() );
 	memcpy ( m_dRamChunks.Begin() + m_iDoubleBuffer, dSegments.Begin(), sizeof(dSegments[0]) * dSegments.GetLength() );
 
+	// kills must go live along with the new versions of the documents
+	ARRAY_FOREACH ( i, dKlistSegs )
+	{
+		uint64_t uRefs = dKlistSegs[i]->m_pKlist->m_tRefCount.Dec();
+		Swap ( dKlistSegs[i]->m_pKlist, dKlists[i] ); // hold swapped kill-list for postponed delete
+		if ( uRefs!=1 ) // 1 means we only owner when decrement event occurred
+			dKlists[i] = NULL;
+	}
+	ARRAY_FOREACH ( i, dDeadRows )
+		if ( dDeadRows[i] )
+			Swap ( m_dDeadRows[i], dDeadRows[i] ); // hold replaced snapshot for postponed release
+
 	// phase 3, enable readers again
 	// we might need to dump data to disk now
 	// but during the dump, readers can still use RAM chunk data
 	Verify ( m_tChunkLock.Unlock() );
 
+	ARRAY_FOREACH ( i, dKlists )
+		SafeDelete ( dKlists[i] );
+
+	// searches that took the replaced snapshots keep them till done
+	ARRAY_FOREACH ( i, dDeadRows )
+		SafeRelease ( dDeadRows[i] );
+
 	// update stats
 	m_tStats.m_iTotalDocuments += iNewDocs - iTotalKilled;
 
@@ -3177,6 +3519,21 @@ void RtIndex_t::CommitReplayable ( RtSegment_t * pNewSeg, CSphVector<SphDocID_t>
 }
 
 
+/// move disk chunks out of service and start a new retired chunks epoch; must be called under chunk write lock
+/// returns the previous epoch, that the caller must release once the lock is gone
+RtRetiredChunks_t * RtIndex_t::RetireDiskChunks ( const CSphIndex * const * ppChunks, int iChunks )
+{
+	RtRetiredChunks_t * pPrev = m_pRetiredChunks;
+	for ( int i=0; i<iChunks; i++ )
+		pPrev->m_dChunks.Add ( ppChunks[i] );
+
+	m_pRetiredChunks = new RtRetiredChunks_t();
+	m_pRetiredChunks->AddRef();
+	pPrev->m_pNext = m_pRetiredChunks;
+	return pPrev;
+}
+
+
 void RtIndex_t::FreeRetired()
 {
 	m_dRetired.Uniq();
@@ -3184,7 +3541,7 @@ void RtIndex_t::FreeRetired()
 	{
 		if ( m_dRetired[i]->m_tRefCount==0 )
 		{
-			SafeDelete ( m_dRetired[i] );
+			RecycleSegment ( m_dRetired[i] );
 			m_dRetired.RemoveFast ( i );
 			i--;
 		}
@@ -3192,6 +3549,41 @@ void RtIndex_t::FreeRetired()
 }
 
 
+RtSegment_t * RtIndex_t::AllocSegment ()
+{
+	RtSegment_t * pSeg = NULL;
+	{
+		CSphScopedLock<CSphMutex> tLock ( m_tSegmentPoolLock );
+		if ( m_dSegmentPool.GetLength() )
+			pSeg = m_dSegmentPool.Pop();
+	}
+
+	if ( !pSeg )
+		return new RtSegment_t ();
+
+	pSeg->Recycle();
+	return pSeg;
+}
+
+
+void RtIndex_t::RecycleSegment ( const RtSegment_t * pSeg )
+{
+	// only keep small segments; those are what a steady stream of small commits keeps creating and merging
+	// bigger buffers would just overstate the RAM usage of the segments that reuse them
+	RtSegment_t * pFree = const_cast<RtSegment_t *> ( pSeg );
+	if ( pFree->GetUsedRam()<=SEGMENT_POOL_MAX_RAM )
+	{
+		CSphScopedLock<CSphMutex> tLock ( m_tSegmentPoolLock );
+		if ( m_dSegmentPool.GetLength()<SEGMENT_POOL_SIZE )
+		{
+			m_dSegmentPool.Add ( pFree );
+			return;
+		}
+	}
+	SafeDelete ( pFree );
+}
+
+
 void RtIndex_t::RollBack ()
 {
 	assert ( g_bRTChangesAllowed );
@@ -3206,12 +3598,14 @@ void RtIndex_t::RollBack ()
 	pAcc->m_dStrings.Resize ( 1 ); // handle dummy zero offset
 	pAcc->m_dMvas.Resize ( 1 );
 	pAcc->m_dPerDocHitsCount.Resize ( 0 );
+	pAcc->m_dStored.Resize ( 0 );
+	pAcc->m_dStoredDocs.Resize ( 0 );
 	pAcc->ResetDict();
 
 	// finish cleaning up and release accumulator
 	pAcc->m_pIndex = NULL;
 	pAcc->m_iAccumDocs = 0;
-	pAcc->m_dAccumKlist.Reset();
+	pAcc->m_dAccumKlist.Resize ( 0 );
 }
 
 bool RtIndex_t::DeleteDocument ( const SphDocID_t * pDocs, int iDocs, CSphString & sError )
@@ -3345,6 +3739,10 @@ void RtIndex_t::SaveDiskDataImpl ( const char * sFilename, const SphChunkGuard_t
 	tMvaWriter.OpenFile ( sName.cstr(), sError );
 	tMvaWriter.PutDword ( 0 ); // dummy dword, to reserve magic zero offset
 
+	sName.SetSprintf ( "%s.spds", sFilename );
+	CSphDocstoreWriter tDocstoreWriter;
+	tDocstoreWriter.Open ( sName, m_tSettings.m_dStoredFields, sError );
+
 #if USE_WINDOWS
 #pragma warning(push,1)
 #pragma warning(disable:4310)
@@ -3419,6 +3817,13 @@ void RtIndex_t::SaveDiskDataImpl ( const char * sFilename, const SphChunkGuard_t
 		// emit it
 		wrRows.PutBytes ( pRow, iStride*sizeof(CSphRowitem) );
 
+		// stored fields go along with the row
+		const BYTE * pStored = NULL;
+		int iStoredLen = 0;
+		if ( pSegment->HasStored() )
+			pSegment->GetStoredDoc ( pRows[iMinRow], &pStored, &iStoredLen );
+		tDocstoreWriter.AddDoc ( DOCINFO2ID_T<DOCID> ( pRows[iMinRow] ), pStored, iStoredLen );
+
 		// fast forward
 		pRows[iMinRow] = pRowIterators[iMinRow]->GetNextAliveRow();
 #ifndef NDEBUG
@@ -3437,6 +3842,7 @@ void RtIndex_t::SaveDiskDataImpl ( const char * sFilename, const SphChunkGuard_t
 
 	tMvaWriter.CloseFile();
 	tStrWriter.CloseFile ();
+	tDocstoreWriter.Finish ( sError );
 
 	////////////////////
 	// write docs & hits
@@ -3790,7 +4196,7 @@ void RtIndex_t::SaveDiskHeader ( const char * sFilename, DOCID iMinDocID, int iC
 	SphOffset_t iCheckpointsPosition, DWORD iInfixBlocksOffset, int iInfixCheckpointWordsSize, DWORD uKillListSize, uint64_t uMinMaxSize,
 	const CSphSourceStats & tStats, bool bForceID32 ) const
 {
-	static const DWORD INDEX_FORMAT_VERSION	= 39;			///< my format version
+	static const DWORD INDEX_FORMAT_VERSION	= 43;			///< my format version
 
 	CSphWriter tWriter;
 	CSphString sName, sError;
@@ -3825,6 +4231,7 @@ void RtIndex_t::SaveDiskHeader ( const char * sFilename, DOCID iMinDocID, int iC
 	// stats
 	tWriter.PutDword ( (DWORD)tStats.m_iTotalDocuments ); // FIXME? we don't expect over 4G docs per just 1 local index
 	tWriter.PutOffset ( tStats.m_iTotalBytes );
+	tWriter.PutDword ( 0 ); // m_iTotalDups, v.40+
 
 	// index settings
 	tWriter.PutDword ( m_tSettings.m_iMinPrefixLen );
@@ -3847,6 +4254,10 @@ void RtIndex_t::SaveDiskHeader ( const char * sFilename, DOCID iMinDocID, int iC
 	tWriter.PutByte ( m_tSettings.m_bIndexFieldLens ); // v. 35+
 	tWriter.PutByte ( m_tSettings.m_eChineseRLP ); // v. 39+
 	tWriter.PutString ( m_tSettings.m_sRLPContext ); // v. 39+
+	tWriter.PutString ( m_tSettings.m_sIndexTokenFilter ); // v. 41+
+	tWriter.PutDword ( m_tSettings.m_dStoredFields.GetLength() ); // v. 43+
+	ARRAY_FOREACH ( i, m_tSettings.m_dStoredFields )
+		tWriter.PutString ( m_tSettings.m_dStoredFields[i] );
 
 	// tokenizer
 	SaveTokenizerSettings ( tWriter, m_pTokenizer, m_tSettings.m_iEmbeddedLimit );
@@ -3954,6 +4365,9 @@ void RtIndex_t::SaveDiskChunk ( int64_t iTID, const SphChunkGuard_t & tGuard, co
 	SaveMeta ( tGuard.m_dDiskChunks.GetLength()+1, iTID );
 	g_pBinlog->NotifyIndexFlush ( m_sIndexName.cstr(), m_iTID, false );
 
+	// RAM segments are about to change
+	m_pExpansionCache->Invalidate();
+
 	// swap double buffer data
 	int iNewSegmentsCount = ( m_iDoubleBuffer ? m_dRamChunks.GetLength() - m_iDoubleBuffer : 0 );
 	for ( int i=0; i<iNewSegmentsCount; i++ )
@@ -3961,12 +4375,16 @@ void RtIndex_t::SaveDiskChunk ( int64_t iTID, const SphChunkGuard_t & tGuard, co
 	m_dRamChunks.Resize ( iNewSegmentsCount );
 
 	m_dDiskChunks.Add ( pDiskChunk );
+	m_dDeadRows.Add ( new CSphDeadRows() );
 
 	// move up kill-list
 	m_tKlist.Reset ( m_dNewSegmentKlist.Begin(), m_dNewSegmentKlist.GetLength() );
 	m_dNewSegmentKlist.Reset();
 	m_dDiskChunkKlist.Reset();
 
+	// new chunk still has rows that got killed while it was saving
+	KillDiskChunkRows ( m_dDiskChunks.GetLength()-1 );
+
 	Verify ( m_tChunkLock.Unlock() );
 
 	ARRAY_FOREACH ( i, tGuard.m_dRamChunks )
@@ -3988,6 +4406,40 @@ void RtIndex_t::SaveDiskChunk ( int64_t iTID, const SphChunkGuard_t & tGuard, co
 }
 
 
+/// mark rows of a disk chunk that got killed by the newer chunks and the RAM chunk
+/// further kills get marked as they commit; caller must hold the writer lock, and the chunk lock if the chunk is live
+void RtIndex_t::KillDiskChunkRows ( int iChunk )
+{
+	CSphVector<SphDocID_t> dKlist;
+	m_tKlist.Flush ( dKlist );
+	for ( int i=iChunk+1; i<m_dDiskChunks.GetLength(); i++ )
+	{
+		int iOff = dKlist.GetLength();
+		dKlist.Resize ( iOff + m_dDiskChunks[i]->GetKillListSize() );
+		memcpy ( dKlist.Begin()+iOff, m_dDiskChunks[i]->GetKillList(), sizeof(SphDocID_t)*m_dDiskChunks[i]->GetKillListSize() );
+	}
+
+	CSphDeadRows * pDeadRows = KillChunkDocs ( iChunk, dKlist );
+	if ( pDeadRows )
+	{
+		m_dDeadRows[iChunk]->Release();
+		m_dDeadRows[iChunk] = pDeadRows;
+	}
+}
+
+
+/// make a new deleted rows snapshot of a disk chunk, that also has the given documents deleted
+/// returns NULL if none of those were alive in it; caller must hold the writer lock
+CSphDeadRows * RtIndex_t::KillChunkDocs ( int iChunk, CSphVector<SphDocID_t> & dDocs ) const
+{
+	// rows are in the docid order, so sorted docids make for sorted rows
+	dDocs.Uniq();
+	CSphVector<DWORD> dRows;
+	m_dDiskChunks[iChunk]->LookupRows ( dDocs.Begin(), dDocs.GetLength(), dRows );
+	return m_dDeadRows[iChunk]->Kill ( dRows.Begin(), dRows.GetLength() );
+}
+
+
 CSphIndex * RtIndex_t::LoadDiskChunk ( const char * sChunk, CSphString & sError ) const
 {
 	MEMORY ( MEM_INDEX_DISK );
@@ -4001,7 +4453,11 @@ CSphIndex * RtIndex_t::LoadDiskChunk ( const char * sChunk, CSphString & sError
 	}
 
 	pDiskChunk->m_iExpansionLimit = m_iExpansionLimit;
+	pDiskChunk->SetExpansionCacheSize ( m_pExpansionCache->GetMaxBytes() );
 	pDiskChunk->m_bExpandKeywords = m_bExpandKeywords;
+	pDiskChunk->m_bInfixTrigrams = m_bInfixTrigrams;
+	pDiskChunk->m_dJsonIndexPaths = m_dJsonIndexPaths;
+	pDiskChunk->m_dDocidOrderedAttrs = m_dDocidOrderedAttrs;
 	pDiskChunk->SetBinlog ( false );
 	if ( m_iOndiskAttrs )
 		pDiskChunk->SetEnableOndiskAttributes ( m_iOndiskAttrs==2 );
@@ -4179,6 +4635,7 @@ bool RtIndex_t::Prealloc ( bool, bool bStripPath, CSphString & )
 			sphDie ( "%s", m_sLastError.cstr() );
 
 		m_dDiskChunks.Add ( pIndex );
+		m_dDeadRows.Add ( new CSphDeadRows() );
 
 		// tricky bit
 		// outgoing match schema on disk chunk should be identical to our internal (!) schema
@@ -4189,6 +4646,11 @@ bool RtIndex_t::Prealloc ( bool, bool bStripPath, CSphString & )
 	// load ram chunk
 	bool bRamLoaded = LoadRamChunk ( uVersion, bRebuildInfixes );
 
+	// mark killed rows in disk chunks, now that we have the RAM kill-list too
+	if ( bRamLoaded )
+		ARRAY_FOREACH ( i, m_dDiskChunks )
+			KillDiskChunkRows ( i );
+
 	// set up values for on timer save
 	m_iSavedTID = m_iTID;
 	m_tmSaved = sphMicroTimer();
@@ -4311,6 +4773,10 @@ bool RtIndex_t::SaveRamChunk ()
 
 		// infixes
 		SaveVector ( wrChunk, pSeg->m_dInfixFilterCP );
+
+		// stored fields
+		SaveVector ( wrChunk, pSeg->m_dStored );
+		SaveVector ( wrChunk, pSeg->m_dStoredOffsets );
 	}
 
 	wrChunk.CloseFile();
@@ -4438,6 +4904,16 @@ bool RtIndex_t::LoadRamChunk ( DWORD uVersion, bool bRebuildInfixes )
 			if ( bRebuildInfixes )
 				BuildSegmentInfixes ( pSeg, bHasMorphology );
 		}
+
+		// stored fields
+		if ( uVersion>=10 )
+		{
+			LoadVector ( rdChunk, pSeg->m_dStored );
+			LoadVector ( rdChunk, pSeg->m_dStoredOffsets );
+		}
+
+		BuildSegmentJsonIndexes ( pSeg );
+		CheckSegmentDocidOrder ( pSeg );
 	}
 
 	RtSegment_t::m_tSegmentSeq.Lock();
@@ -4481,6 +4957,7 @@ void RtIndex_t::PostSetup()
 #endif
 
 	// FIXME!!! handle error
+	m_iIndexingGen = g_tRtIndexingGen.Inc()+1;
 	m_pTokenizerIndexing = m_pTokenizer->Clone ( SPH_CLONE_INDEX );
 	ISphTokenizer * pIndexing = ISphTokenizer::CreateBigramFilter ( m_pTokenizerIndexing, m_tSettings.m_eBigramIndex, m_tSettings.m_sBigramWords, m_sLastError );
 	if ( pIndexing )
@@ -5325,8 +5802,12 @@ int RtIndex_t::DebugCheck ( FILE * fp )
 
 				const BYTE * p = pData+4;
 				CSphVector<ESphJsonType> dStateStack;
+				CSphVector<const BYTE *> dObjectEnds; // object payload ends, to skip over their key directories
 				if ( pData[0] | pData[1]<<8 | pData[2]<<16 | pData[3]<<24 )
+				{
 					dStateStack.Add ( JSON_OBJECT );
+					dObjectEnds.Add ( NULL );
+				}
 
 				do
 				{
@@ -5346,7 +5827,12 @@ int RtIndex_t::DebugCheck ( FILE * fp )
 					case JSON_EOF:
 					{
 						if ( dStateStack.GetLength() && dStateStack.Last()==JSON_OBJECT )
+						{
 							dStateStack.Pop();
+							const BYTE * pEnd = dObjectEnds.Pop();
+							if ( pEnd )
+								p = pEnd;
+						}
 						break;
 					}
 
@@ -5367,7 +5853,8 @@ int RtIndex_t::DebugCheck ( FILE * fp )
 					case JSON_OBJECT:
 					{
 						dStateStack.Add ( JSON_OBJECT );
-						sphJsonUnpackInt ( &p );
+						int iObjLen = sphJsonUnpackInt ( &p );
+						dObjectEnds.Add ( p+iObjLen );
 						p += 4; // bloom mask
 						break;
 					}
@@ -5583,6 +6070,21 @@ struct RtSubstringPayload_t : public ISphSubstringPayload
 	CSphFixedVector<Slice_t>	m_dDoclist;
 	int							m_iDocsTotal;
 	int							m_iHitsTotal;
+
+	virtual ISphSubstringPayload * Clone () const
+	{
+		RtSubstringPayload_t * pClone = new RtSubstringPayload_t ( m_dSegment2Doclists.GetLength(), m_dDoclist.GetLength() );
+		memcpy ( pClone->m_dSegment2Doclists.Begin(), m_dSegment2Doclists.Begin(), m_dSegment2Doclists.GetSizeBytes() );
+		memcpy ( pClone->m_dDoclist.Begin(), m_dDoclist.Begin(), m_dDoclist.GetSizeBytes() );
+		pClone->m_iDocsTotal = m_iDocsTotal;
+		pClone->m_iHitsTotal = m_iHitsTotal;
+		return pClone;
+	}
+
+	virtual int64_t GetSizeBytes () const
+	{
+		return sizeof(*this) + m_dSegment2Doclists.GetSizeBytes() + m_dDoclist.GetSizeBytes();
+	}
 };
 
 
@@ -5764,7 +6266,11 @@ bool RtIndex_t::EarlyReject ( CSphQueryContext * pCtx, CSphMatch & tMatch ) cons
 		CopyDocinfo ( tMatch, FindDocinfo ( (RtSegment_t*)pCtx->m_pIndexData, tMatch.m_uDocID ) );
 
 	pCtx->CalcFilter ( tMatch ); // FIXME!!! leak of filtered STRING_PTR
-	return pCtx->m_pFilter ? !pCtx->m_pFilter->Eval ( tMatch ) : false;
+	if ( !pCtx->m_pFilter )
+		return false;
+
+	pCtx->m_tStats.m_iFilterEvals++;
+	return !pCtx->m_pFilter->Eval ( tMatch );
 }
 
 
@@ -6516,21 +7022,30 @@ struct SphFinalArenaCopy_t : ISphMatchProcessor
 
 void RtIndex_t::GetReaderChunks ( SphChunkGuard_t & tGuard ) const
 {
+	// generation is bumped before any new chunks go live, so take it first
+	tGuard.m_iExpansionGeneration = m_pExpansionCache->GetGeneration();
 	if ( !m_dRamChunks.GetLength() && !m_dDiskChunks.GetLength() )
 		return;
 
-	m_tReading.ReadLock();
-	tGuard.m_pReading = &m_tReading;
-
 	m_tChunkLock.ReadLock ();
+	tGuard.m_iExpansionGeneration = m_pExpansionCache->GetGeneration();
+	tGuard.m_pRetiredChunks = m_pRetiredChunks;
+	m_pRetiredChunks->AddRef();
 
 	tGuard.m_dRamChunks.Reset ( m_dRamChunks.GetLength() );
 	tGuard.m_dKill.Reset ( m_dRamChunks.GetLength() );
 	tGuard.m_dDiskChunks.Reset ( m_dDiskChunks.GetLength() );
+	tGuard.m_dDeadRows.Reset ( m_dDiskChunks.GetLength() );
 
 	memcpy ( tGuard.m_dRamChunks.Begin(), m_dRamChunks.Begin(), sizeof(m_dRamChunks[0]) * m_dRamChunks.GetLength() );
 	memcpy ( tGuard.m_dDiskChunks.Begin(), m_dDiskChunks.Begin(), sizeof(m_dDiskChunks[0]) * m_dDiskChunks.GetLength() );
 
+	ARRAY_FOREACH ( i, tGuard.m_dDeadRows )
+	{
+		tGuard.m_dDeadRows[i] = m_dDeadRows[i];
+		m_dDeadRows[i]->AddRef();
+	}
+
 	ARRAY_FOREACH ( i, tGuard.m_dRamChunks )
 	{
 		KlistRefcounted_t * pKlist = tGuard.m_dRamChunks[i]->m_pKlist;
@@ -6547,8 +7062,10 @@ void RtIndex_t::GetReaderChunks ( SphChunkGuard_t & tGuard ) const
 
 SphChunkGuard_t::~SphChunkGuard_t()
 {
-	if ( m_pReading )
-		m_pReading->Unlock();
+	SafeRelease ( m_pRetiredChunks );
+
+	ARRAY_FOREACH ( i, m_dDeadRows )
+		m_dDeadRows[i]->Release();
 
 	if ( !m_dRamChunks.GetLength() )
 		return;
@@ -6567,6 +7084,100 @@ SphChunkGuard_t::~SphChunkGuard_t()
 }
 
 
+/// RT index stored fields, as seen by a single search
+/// holds the searched segments and disk chunks alive, as postlimit expressions read it after the search is over
+class RtStoredFields_c : public ISphStoredFields
+{
+public:
+	explicit RtStoredFields_c ( const SphChunkGuard_t & tGuard )
+		: m_dRamChunks ( tGuard.m_dRamChunks.GetLength() )
+		, m_dKill ( tGuard.m_dKill.GetLength() )
+		, m_dDiskChunks ( tGuard.m_dDiskChunks.GetLength() )
+		, m_pRetiredChunks ( tGuard.m_pRetiredChunks )
+	{
+		ARRAY_FOREACH ( i, m_dRamChunks )
+		{
+			m_dRamChunks[i] = tGuard.m_dRamChunks[i];
+			m_dRamChunks[i]->m_tRefCount.Inc();
+			m_dKill[i] = tGuard.m_dKill[i];
+			const_cast<KlistRefcounted_t *> ( m_dKill[i] )->m_tRefCount.Inc();
+		}
+
+		ARRAY_FOREACH ( i, m_dDiskChunks )
+			m_dDiskChunks[i] = tGuard.m_dDiskChunks[i]->CreateStoredFields ( tGuard.m_dDeadRows[i] );
+
+		// empty index guards hold no epoch
+		if ( m_pRetiredChunks )
+			m_pRetiredChunks->AddRef();
+	}
+
+	virtual bool GetField ( SphDocID_t uDocid, int iField, BYTE ** ppText, int * pLen ) const
+	{
+		*ppText = NULL;
+		*pLen = 0;
+
+		// RAM segments hold the freshest data
+		ARRAY_FOREACH ( i, m_dRamChunks )
+		{
+			const RtSegment_t * pSeg = m_dRamChunks[i];
+			const CSphRowitem * pRow = pSeg->FindRow ( uDocid );
+			if ( !pRow || m_dKill[i]->m_dKilled.BinarySearch ( uDocid ) )
+				continue;
+
+			if ( pSeg->HasStored() )
+			{
+				const BYTE * pDoc = NULL;
+				int iDocLen = 0;
+				pSeg->GetStoredDoc ( pRow, &pDoc, &iDocLen );
+				sphDocstoreCopyField ( pDoc, iDocLen, iField, ppText, pLen );
+			}
+			return true;
+		}
+
+		// then disk chunks, newest first; kills apply to all the older chunks too, so the first hit decides
+		for ( int i=m_dDiskChunks.GetLength()-1; i>=0; i-- )
+			if ( m_dDiskChunks[i] && m_dDiskChunks[i]->GetField ( uDocid, iField, ppText, pLen ) )
+				return true;
+
+		return false;
+	}
+
+protected:
+	virtual ~RtStoredFields_c ()
+	{
+		ARRAY_FOREACH ( i, m_dRamChunks )
+		{
+			KlistRefcounted_t * pKlist = const_cast<KlistRefcounted_t *> ( m_dKill[i] );
+			if ( pKlist->m_tRefCount.Dec()==1 )
+				SafeDelete ( pKlist );
+			m_dRamChunks[i]->m_tRefCount.Dec();
+		}
+
+		// chunk snapshots first, the epoch might take the chunks away
+		ARRAY_FOREACH ( i, m_dDiskChunks )
+			SafeRelease ( m_dDiskChunks[i] );
+		SafeRelease ( m_pRetiredChunks );
+	}
+
+private:
+	CSphFixedVector<const RtSegment_t *>		m_dRamChunks;
+	CSphFixedVector<const KlistRefcounted_t *>	m_dKill;
+	CSphFixedVector<ISphStoredFields *>			m_dDiskChunks;		///< per disk chunk snapshot, NULL if it stores nothing
+	RtRetiredChunks_t *							m_pRetiredChunks;	///< keeps the disk chunks alive
+};
+
+
+ISphStoredFields * RtIndex_t::CreateStoredFields ( const CSphDeadRows * ) const
+{
+	if ( !m_tSettings.m_dStoredFields.GetLength() )
+		return NULL;
+
+	SphChunkGuard_t tGuard;
+	GetReaderChunks ( tGuard );
+	return new RtStoredFields_c ( tGuard );
+}
+
+
 // FIXME! missing MVA, index_exact_words support
 // FIXME? any chance to factor out common backend agnostic code?
 // FIXME? do we need to support pExtraFilters?
@@ -6611,6 +7222,14 @@ bool RtIndex_t::MultiQuery ( const CSphQuery * pQuery, CSphQueryResult * pResult
 	SphChunkGuard_t tGuard;
 	GetReaderChunks ( tGuard );
 
+	// stored fields are read through the snapshot of this very search, even by postlimit expressions
+	CSphRefcountedPtr<ISphStoredFields> tStoredFields;
+	if ( m_tSettings.m_dStoredFields.GetLength() )
+	{
+		tStoredFields = new RtStoredFields_c ( tGuard );
+		sphSetStoredFields ( dSorters.Begin(), dSorters.GetLength(), tStoredFields.Ptr() );
+	}
+
 	// wrappers
 	// OPTIMIZE! make a lightweight clone here? and/or remove double clone?
 	CSphScopedPtr<ISphTokenizer> pTokenizer ( m_pTokenizer->Clone ( SPH_CLONE_QUERY ) );
@@ -6671,68 +7290,20 @@ bool RtIndex_t::MultiQuery ( const CSphQuery * pQuery, CSphQueryResult * pResult
 	if ( pQuery->m_uMaxQueryMsec>0 )
 		tmMaxTimer = sphMicroTimer() + pQuery->m_uMaxQueryMsec*1000; // max_query_time
 
-	CSphVector<SphDocID_t> dCumulativeKList;
-	KillListVector dMergedKillist;
 	CSphVector<const BYTE *> dDiskStrings ( tGuard.m_dDiskChunks.GetLength() );
 	CSphVector<const DWORD *> dDiskMva ( tGuard.m_dDiskChunks.GetLength() );
 	CSphBitvec tMvaArenaFlag ( tGuard.m_dDiskChunks.GetLength() );
-	if ( tGuard.m_dDiskChunks.GetLength() )
-	{
-		m_tKlist.Flush ( dCumulativeKList );
-	}
+
+	// killed documents are marked in the deleted rows snapshot of each disk chunk, no kill-lists needed
+	KillListVector dDiskKillist;
 
 	for ( int iChunk = tGuard.m_dDiskChunks.GetLength()-1; iChunk>=0; iChunk-- )
 	{
-		// collect & sort cumulative killlist for current chunk
-		if ( iChunk<tGuard.m_dDiskChunks.GetLength()-1 )
-		{
-			const CSphIndex * pNewerChunk = tGuard.m_dDiskChunks [ iChunk+1 ];
-			int iKlistEntries = pNewerChunk->GetKillListSize();
-			if ( iKlistEntries )
-			{
-				// merging two kill lists, assuming they have sorted data
-				const SphDocID_t * pSrc1 = dCumulativeKList.Begin();
-				const SphDocID_t * pSrc2 = pNewerChunk->GetKillList();
-				const SphDocID_t * pEnd1 = pSrc1 + dCumulativeKList.GetLength();
-				const SphDocID_t * pEnd2 = pSrc2 + iKlistEntries;
-				CSphVector<SphDocID_t> dNewCumulative ( ( pEnd1-pSrc1 )+( pEnd2-pSrc2 ) );
-				SphDocID_t * pDst = dNewCumulative.Begin();
-
-				while ( pSrc1!=pEnd1 && pSrc2!=pEnd2 )
-				{
-					if ( *pSrc1<*pSrc2 )
-						*pDst = *pSrc1++;
-					else if ( *pSrc2<*pSrc1 )
-						*pDst = *pSrc2++;
-					else
-					{
-						*pDst = *pSrc1++;
-						// handle duplicates
-						while ( *pDst==*pSrc1 ) pSrc1++;
-						while ( *pDst==*pSrc2 ) pSrc2++;
-					}
-					pDst++;
-				}
-				while ( pSrc1!=pEnd1 ) *pDst++ = *pSrc1++;
-				while ( pSrc2!=pEnd2 ) *pDst++ = *pSrc2++;
-
-				assert ( pDst<=( dNewCumulative.Begin()+dNewCumulative.GetLength() ) );
-				dNewCumulative.Resize ( pDst-dNewCumulative.Begin() );
-				dNewCumulative.SwapData ( dCumulativeKList );
-			}
-		}
-
-		dMergedKillist.Resize ( 0 );
-		if ( dCumulativeKList.GetLength() )
-		{
-			dMergedKillist.Resize ( 1 );
-			dMergedKillist.Last().m_pBegin = dCumulativeKList.Begin();
-			dMergedKillist.Last().m_iLen = dCumulativeKList.GetLength();
-		}
-
 		CSphQueryResult tChunkResult;
 		tChunkResult.m_pProfile = pResult->m_pProfile;
-		CSphMultiQueryArgs tMultiArgs ( dMergedKillist, tArgs.m_iIndexWeight );
+		CSphMultiQueryArgs tMultiArgs ( dDiskKillist, tArgs.m_iIndexWeight );
+		tMultiArgs.m_pDeadRows = tGuard.m_dDeadRows[iChunk];
+		tMultiArgs.m_pStoredFields = tStoredFields.Ptr();
 		// storing index in matches tag for finding strings attrs offset later, biased against default zero and segments
 		tMultiArgs.m_iTag = tGuard.m_dRamChunks.GetLength()+iChunk+1;
 		tMultiArgs.m_uPackedFactorFlags = tArgs.m_uPackedFactorFlags;
@@ -6819,6 +7390,7 @@ bool RtIndex_t::MultiQuery ( const CSphQuery * pQuery, CSphQueryResult * pResult
 	tTermSetup.m_pWarning = &pResult->m_sWarning;
 	tTermSetup.SetSegment ( -1 );
 	tTermSetup.m_pCtx = &tCtx;
+	tTermSetup.m_pStats = &tCtx.m_tStats;
 
 	// bind weights
 	tCtx.BindWeights ( pQuery, m_tSchema );
@@ -6870,6 +7442,8 @@ bool RtIndex_t::MultiQuery ( const CSphQuery * pQuery, CSphQueryResult * pResult
 		tExpCtx.m_bMergeSingles = true;
 		tExpCtx.m_pPayloads = &tPayloads;
 		tExpCtx.m_pIndexData = &tGuard.m_dRamChunks;
+		tExpCtx.m_pCache = m_pExpansionCache;
+		tExpCtx.m_iCacheGeneration = tGuard.m_iExpansionGeneration;
 
 		tParsed.m_pRoot = sphExpandXQNode ( tParsed.m_pRoot, tExpCtx );
 	}
@@ -6951,17 +7525,53 @@ bool RtIndex_t::MultiQuery ( const CSphQuery * pQuery, CSphQueryResult * pResult
 					dSorters[i]->SetMVAPool ( tGuard.m_dRamChunks[iSeg]->m_dMvas.Begin(), false );
 				}
 
+				// JSON secondary indexes might narrow the segment down to candidate rows
+				// those are not k-list filtered yet, so check them one by one
+				CSphVector<DWORD> dCandidates;
+				bool bCandidates = sphJsonIndexCandidates ( tGuard.m_dRamChunks[iSeg]->m_dJsonIndexes, pQuery, dCandidates );
+				int iCandidate = 0;
+
+				// sorting by a docid ordered attribute lets us walk the segment best rows first, and leave it
+				// as soon as the sorter is full and rejects a row; descending orders walk the rows backwards
+				bool bEarlyDesc = false;
+				bool bEarlyStop = sphCanStopEarly ( pQuery, dSorters.GetLength(), dSorters.Begin(),
+					tGuard.m_dRamChunks[iSeg]->m_dDocidOrdered, true, bEarlyDesc );
+				int iRowBack = ( bEarlyStop && bEarlyDesc && !bCandidates ) ? tGuard.m_dRamChunks[iSeg]->m_iRows : -1;
+				if ( bEarlyStop && bEarlyDesc && bCandidates )
+					for ( int i=0, j=dCandidates.GetLength()-1; i<j; i++, j-- )
+						Swap ( dCandidates[i], dCandidates[j] );
+
 				RtRowIterator_t tIt ( tGuard.m_dRamChunks[iSeg], m_iStride, false, NULL, tGuard.m_dKill[iSeg]->m_dKilled );
 				for ( ;; )
 				{
-					const CSphRowitem * pRow = tIt.GetNextAliveRow();
-					if ( !pRow )
-						break;
+					const CSphRowitem * pRow = NULL;
+					if ( bCandidates )
+					{
+						if ( iCandidate>=dCandidates.GetLength() )
+							break;
+						pRow = tGuard.m_dRamChunks[iSeg]->m_dRows.Begin() + (int64_t)dCandidates[iCandidate++]*m_iStride;
+						if ( tGuard.m_dKill[iSeg]->m_dKilled.BinarySearch ( DOCINFO2ID(pRow) ) )
+							continue;
+					} else if ( iRowBack>=0 )
+					{
+						if ( --iRowBack<0 )
+							break;
+						pRow = tGuard.m_dRamChunks[iSeg]->m_dRows.Begin() + (int64_t)iRowBack*m_iStride;
+						if ( tGuard.m_dKill[iSeg]->m_dKilled.BinarySearch ( DOCINFO2ID(pRow) ) )
+							continue;
+					} else
+					{
+						pRow = tIt.GetNextAliveRow();
+						if ( !pRow )
+							break;
+					}
 
 					tMatch.m_uDocID = DOCINFO2ID(pRow);
 					tMatch.m_pStatic = DOCINFO2ATTRS(pRow); // FIXME! overrides
 
 					tCtx.CalcFilter ( tMatch );
+					if ( tCtx.m_pFilter )
+						tCtx.m_tStats.m_iFilterEvals++;
 					if ( tCtx.m_pFilter && !tCtx.m_pFilter->Eval ( tMatch ) )
 					{
 						tCtx.FreeStrFilter ( tMatch );
@@ -6971,12 +7581,20 @@ bool RtIndex_t::MultiQuery ( const CSphQuery * pQuery, CSphQueryResult * pResult
 					if ( bRandomize )
 						tMatch.m_iWeight = ( sphRand() & 0xffff ) * tArgs.m_iIndexWeight;
 
+					// every row left in this segment sorts no better than this one
+					if ( bEarlyStop && dSorters[0]->WouldReject ( tMatch ) )
+					{
+						tCtx.FreeStrFilter ( tMatch );
+						break;
+					}
+
 					tCtx.CalcSort ( tMatch );
 					tCtx.CalcFinal ( tMatch ); // OPTIMIZE? could be possibly done later
 
 					// storing segment in matches tag for finding strings attrs offset later, biased against default zero
 					tMatch.m_iTag = iSeg+1;
 
+					tCtx.m_tStats.m_iPushedMatches++;
 					bool bNewMatch = false;
 					ARRAY_FOREACH ( iSorter, dSorters )
 						bNewMatch |= dSorters[iSorter]->Push ( tMatch );
@@ -7048,6 +7666,8 @@ bool RtIndex_t::MultiQuery ( const CSphQuery * pQuery, CSphQueryResult * pResult
 						tCtx.CalcSort ( pMatch[i] );
 						tCtx.CalcFinal ( pMatch[i] ); // OPTIMIZE? could be possibly done later
 
+						if ( tCtx.m_pWeightFilter )
+							tCtx.m_tStats.m_iFilterEvals++;
 						if ( tCtx.m_pWeightFilter && !tCtx.m_pWeightFilter->Eval ( pMatch[i] ) )
 						{
 							tCtx.FreeStrSort ( pMatch[i] );
@@ -7058,6 +7678,7 @@ bool RtIndex_t::MultiQuery ( const CSphQuery * pQuery, CSphQueryResult * pResult
 						// storing segment in matches tag for finding strings attrs offset later, biased against default zero
 						pMatch[i].m_iTag = iSeg+1;
 
+						tCtx.m_tStats.m_iPushedMatches++;
 						bool bNewMatch = false;
 						ARRAY_FOREACH ( iSorter, dSorters )
 							bNewMatch |= dSorters[iSorter]->Push ( pMatch[i] );
@@ -7215,6 +7836,9 @@ bool RtIndex_t::MultiQuery ( const CSphQuery * pQuery, CSphQueryResult * pResult
 
 	// query timer
 	pResult->m_iQueryTime = int ( ( sphMicroTimer()-tmQueryStart )/1000 );
+
+	// disk chunks account themselves, add up the RAM segments work
+	pResult->m_tStats.Add ( tCtx.m_tStats );
 	return true;
 }
 
@@ -7672,6 +8296,7 @@ int RtIndex_t::UpdateAttributes ( const CSphAttrUpdate & tUpd, int iIndex, CSphS
 					{
 						bUpdated = true;
 						uUpdateMask |= ATTRS_STRINGS_UPDATED;
+						sphInvalidateJsonIndexes ( pSegment->m_dJsonIndexes, tUpd.m_dAttrs[iCol] );
 
 					} else
 						iJsonWarnings++;
@@ -7688,6 +8313,7 @@ int RtIndex_t::UpdateAttributes ( const CSphAttrUpdate & tUpd, int iIndex, CSphS
 
 					SphAttr_t uValue = dBigints.BitGet ( iCol ) ? MVA_UPSIZE ( &tUpd.m_dPool[iPos] ) : tUpd.m_dPool[iPos];
 					sphSetRowAttr ( const_cast<CSphRowitem *>( pRow ), dLocators[iCol], uValue );
+					sphInvalidateDocidOrderedAttr ( pSegment->m_dDocidOrdered, tUpd.m_dAttrs[iCol] );
 					iPos += dBigints.BitGet ( iCol ) ? 2 : 1;
 				} else
 				{
@@ -7972,6 +8598,7 @@ bool RtIndex_t::AddRemoveAttribute ( bool bAdd, const CSphString & sAttrName, ES
 		m_tSchema.RemoveAttr ( sAttrName.cstr(), false );
 
 	m_iStride = DOCINFO_IDSIZE + m_tSchema.GetRowSize();
+	m_iIndexingGen = g_tRtIndexingGen.Inc()+1;
 
 	// modify the in-memory data of disk chunks
 	// fixme: we can't rollback in-memory changes, so we just show errors here for now
@@ -8198,8 +8825,14 @@ bool RtIndex_t::AttachDiskIndex ( CSphIndex * pIndex, CSphString & sError )
 
 	// recreate disk chunk list, resave header file
 	m_dDiskChunks.Add ( pIndex );
+	m_dDeadRows.Add ( new CSphDeadRows() );
 	SaveMeta ( m_dDiskChunks.GetLength(), m_iTID );
 
+	// new chunk kill-list applies to the older ones
+	// (daemon holds an exclusive lock, so no searches to race with)
+	ARRAY_FOREACH ( i, m_dDiskChunks )
+		KillDiskChunkRows ( i );
+
 	// FIXME? do something about binlog too?
 	// g_pBinlog->NotifyIndexFlush ( m_sIndexName.cstr(), m_iTID, false );
 
@@ -8241,13 +8874,22 @@ bool RtIndex_t::Truncate ( CSphString & )
 	}
 
 	// kill in-memory data, reset stats
-	ARRAY_FOREACH ( i, m_dDiskChunks )
-		SafeDelete ( m_dDiskChunks[i] );
+	// chunks and segments might still be used by stored fields snapshots of the finished queries
+	Verify ( m_tChunkLock.WriteLock() );
+	RtRetiredChunks_t * pRetired = RetireDiskChunks ( m_dDiskChunks.Begin(), m_dDiskChunks.GetLength() );
+	ARRAY_FOREACH ( i, m_dDeadRows )
+		SafeRelease ( m_dDeadRows[i] );
 	m_dDiskChunks.Reset();
+	m_dDeadRows.Reset();
 
 	ARRAY_FOREACH ( i, m_dRamChunks )
-		SafeDelete ( m_dRamChunks[i] );
+		m_dRetired.Add ( m_dRamChunks[i] );
 	m_dRamChunks.Reset();
+	m_pExpansionCache->Invalidate();
+	Verify ( m_tChunkLock.Unlock() );
+
+	pRetired->Release();
+	FreeRetired();
 
 	// we don't want kill list to work if we perform ATTACH right after this TRUNCATE
 	m_tKlist.Reset ( NULL, 0 );
@@ -8370,14 +9012,27 @@ void RtIndex_t::Optimize ( volatile bool * pForceTerminate, ThrottleState_t * pT
 		Verify ( m_tWriting.Lock() );
 		Verify ( m_tChunkLock.WriteLock() );
 
+		// old chunks go away with the last search that might still use them
+		const CSphIndex * dRetired[] = { pOldest, pOlder };
+		RtRetiredChunks_t * pRetired = RetireDiskChunks ( dRetired, 2 );
+
 		m_dDiskChunks[1] = pMerged.LeakPtr();
 		m_dDiskChunks.Remove ( 0 );
+		m_dDeadRows[0]->Release();
+		m_dDeadRows[1]->Release();
+		m_dDeadRows[1] = new CSphDeadRows();
+		m_dDeadRows.Remove ( 0 );
 		m_iDiskBase++;
 		int iDiskChunksCount = m_dDiskChunks.GetLength();
 
+		// merge only dropped what was killed before it started
+		// merged chunk is new to every search, so it gets all the kills since as dead rows right away
+		KillDiskChunkRows ( 0 );
+
 		Verify ( m_tChunkLock.Unlock() );
 		SaveMeta ( iDiskChunksCount, m_iTID );
 		Verify ( m_tWriting.Unlock() );
+		pRetired->Release();
 
 		if ( *pForceTerminate || m_bOptimizeStop )
 		{
@@ -8386,16 +9041,6 @@ void RtIndex_t::Optimize ( volatile bool * pForceTerminate, ThrottleState_t * pT
 			break;
 		}
 
-		// exclusive reader (to make sure that disk chunks not used any more) and writer lock here
-		Verify ( m_tReading.WriteLock() );
-		Verify ( m_tWriting.Lock() );
-
-		SafeDelete ( pOlder );
-		SafeDelete ( pOldest );
-
-		Verify ( m_tWriting.Unlock() );
-		Verify ( m_tReading.Unlock() );
-
 		// we might remove old index files
 		sphUnlinkIndex ( sRename.cstr(), true );
 		sphUnlinkIndex ( sOldest.cstr(), true );
@@ -8439,6 +9084,9 @@ void RtIndex_t::GetStatus ( CSphIndexStatus * pRes ) const
 		+ m_dDiskChunks.GetSizeBytes()
 		+ pRes->m_iRamChunkSize;
 
+	ARRAY_FOREACH ( i, m_dDeadRows )
+		pRes->m_iRamUse += m_dDeadRows[i]->GetLengthBytes();
+
 	pRes->m_iMemLimit = m_iSoftRamLimit;
 	pRes->m_iDiskUse = 0;
 
@@ -8464,8 +9112,22 @@ void RtIndex_t::GetStatus ( CSphIndexStatus * pRes ) const
 	pRes->m_iNumChunks = m_dDiskChunks.GetLength();
 
 	Verify ( m_tChunkLock.Unlock() );
+
+	GetExpansionCacheStatus ( pRes );
+}
+
+
+void RtIndex_t::GetExpansionCacheStatus ( CSphIndexStatus * pRes ) const
+{
+	Verify ( m_tChunkLock.ReadLock() );
+	ARRAY_FOREACH ( i, m_dDiskChunks )
+		m_dDiskChunks[i]->GetExpansionCacheStatus ( pRes );
+	Verify ( m_tChunkLock.Unlock() );
+
+	m_pExpansionCache->GetStatus ( pRes );
 }
 
+
 //////////////////////////////////////////////////////////////////////////
 // RECONFIGURE
 //////////////////////////////////////////////////////////////////////////
@@ -8540,6 +9202,7 @@ void RtIndex_t::Reconfigure ( CSphReconfigureSetup & tSetup )
 
 	m_iMaxCodepointLength = m_pTokenizer->GetMaxCodepointLength();
 	SetupQueryTokenizer();
+	m_iIndexingGen = g_tRtIndexingGen.Inc()+1;
 
 	// FIXME!!! handle error
 	SafeDelete ( m_pTokenizerIndexing );
@@ -8857,6 +9520,8 @@ void RtBinlog_c::BinlogCommit ( int64_t * pTID, const char * sIndexName, const R
 		SaveVector ( m_tWriter, pSeg->m_dStrings );
 		SaveVector ( m_tWriter, pSeg->m_dMvas );
 		SaveVector ( m_tWriter, pSeg->m_dKeywordCheckpoints );
+		SaveVector ( m_tWriter, pSeg->m_dStored );
+		SaveVector ( m_tWriter, pSeg->m_dStoredOffsets );
 	}
 	SaveVector ( m_tWriter, dKlist );
 
@@ -8898,14 +9563,16 @@ void RtBinlog_c::BinlogUpdateAttributes ( int64_t * pTID, const char * sIndexNam
 		m_tWriter.ZipOffset ( tUpd.m_dTypes[i] );
 	}
 
+	// update queue passes raw rows (with zero docids) for matches that point into the index
 	CSphVector<SphDocID_t> dActiveDocids;
 	bool bUseRaw = false;
-	if ( tUpd.m_dDocids.GetLength()==0 && tUpd.m_dRows.GetLength()!=0 )
+	ARRAY_FOREACH_COND ( i, tUpd.m_dRows, !bUseRaw )
+		bUseRaw = ( tUpd.m_dRows[i]!=NULL );
+	if ( bUseRaw )
 	{
-		bUseRaw = true;
 		dActiveDocids.Resize ( tUpd.m_dRows.GetLength() );
 		ARRAY_FOREACH ( i, tUpd.m_dRows )
-			dActiveDocids[i] = DOCINFO2ID ( tUpd.m_dRows[i] );
+			dActiveDocids[i] = tUpd.m_dRows[i] ? DOCINFO2ID ( tUpd.m_dRows[i] ) : tUpd.m_dDocids[i];
 	}
 	const CSphVector<SphDocID_t> & dBinlogDocids = bUseRaw ? dActiveDocids : tUpd.m_dDocids;
 
@@ -9572,6 +10239,8 @@ bool RtBinlog_c::ReplayCommit ( int iBinlog, DWORD uReplayFlags, BinlogReader_c
 		LoadVector ( tReader, pSeg->m_dStrings );
 		LoadVector ( tReader, pSeg->m_dMvas );
 		LoadVector ( tReader, pSeg->m_dKeywordCheckpoints );
+		LoadVector ( tReader, pSeg->m_dStored );
+		LoadVector ( tReader, pSeg->m_dStoredOffsets );
 	}
 	LoadVector ( tReader, dKlist );
 
@@ -9614,6 +10283,8 @@ bool RtBinlog_c::ReplayCommit ( int iBinlog, DWORD uReplayFlags, BinlogReader_c
 			FixupSegmentCheckpoints ( pSeg.Ptr() );
 			tIndex.m_pRT->BuildSegmentInfixes ( pSeg.Ptr(), tIndex.m_pRT->GetDictionary()->HasMorphology() );
 		}
+		tIndex.m_pRT->BuildSegmentJsonIndexes ( pSeg.Ptr() );
+		tIndex.m_pRT->CheckSegmentDocidOrder ( pSeg.Ptr() );
 
 		// actually replay
 		tIndex.m_pRT->CommitReplayable ( pSeg.LeakPtr(), dKlist );
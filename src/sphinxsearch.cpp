@@ -134,7 +134,7 @@ class ExtNode_i
 {
 public:
 								ExtNode_i ();
-	virtual						~ExtNode_i () { SafeDeleteArray ( m_pDocinfo ); }
+	virtual						~ExtNode_i () { SafeDeleteArray ( m_pDocinfo ); SafeDelete ( m_pNodeProfile ); }
 
 	static ExtNode_i *			Create ( const XQNode_t * pNode, const ISphQwordSetup & tSetup );
 	static ExtNode_i *			Create ( const XQKeyword_t & tWord, const XQNode_t * pNode, const ISphQwordSetup & tSetup );
@@ -142,8 +142,21 @@ public:
 
 	virtual void				Reset ( const ISphQwordSetup & tSetup ) = 0;
 	virtual void				HintDocid ( SphDocID_t uMinID ) = 0;
-	virtual const ExtDoc_t *	GetDocsChunk() = 0;
-	virtual const ExtHit_t *	GetHitsChunk ( const ExtDoc_t * pDocs ) = 0;
+
+	// chunk getters; counted and timed when the plan is being profiled
+	inline const ExtDoc_t * GetDocsChunk()
+	{
+		if ( !m_pNodeProfile )
+			return GetDocsChunkImpl();
+		return ProfiledDocsChunk();
+	}
+
+	inline const ExtHit_t * GetHitsChunk ( const ExtDoc_t * pDocs )
+	{
+		if ( !m_pNodeProfile )
+			return GetHitsChunkImpl ( pDocs );
+		return ProfiledHitsChunk ( pDocs );
+	}
 
 	virtual int					GetQwords ( ExtQwordsHash_t & hQwords ) = 0;
 	virtual void				SetQwordsIDF ( const ExtQwordsHash_t & hQwords ) = 0;
@@ -165,6 +178,12 @@ public:
 		printf ( "ExtNode\n" );
 	}
 
+	/// attach plan profile counters to this node and its children, depth first
+	virtual void AttachProfile ( CSphVector<PlanNodeProfile_t*> & dNodes, int iDepth )
+	{
+		AddNodeProfile ( dNodes, iDepth, "NODE" );
+	}
+
 	// return specific extra data may be associated with the node
 	// intended to be used a bit similar to QueryInterface() in COM technology
 	// but simpler due to enum instead of 128-bit GUID, and no ref. counting
@@ -178,6 +197,25 @@ private:
 		return false;
 	}
 
+	const ExtDoc_t *			ProfiledDocsChunk ();
+	const ExtHit_t *			ProfiledHitsChunk ( const ExtDoc_t * pDocs );
+
+protected:
+	virtual const ExtDoc_t *	GetDocsChunkImpl() = 0;
+	virtual const ExtHit_t *	GetHitsChunkImpl ( const ExtDoc_t * pDocs ) = 0;
+
+	PlanNodeProfile_t *			m_pNodeProfile;	///< plan profile counters, NULL unless profiling
+
+	PlanNodeProfile_t * AddNodeProfile ( CSphVector<PlanNodeProfile_t*> & dNodes, int iDepth, const char * sName )
+	{
+		if ( !m_pNodeProfile )
+			m_pNodeProfile = new PlanNodeProfile_t();
+		m_pNodeProfile->m_sName = sName;
+		m_pNodeProfile->m_iDepth = iDepth;
+		dNodes.Add ( m_pNodeProfile );
+		return m_pNodeProfile;
+	}
+
 public:
 	static const int			MAX_DOCS = 512;
 	static const int			MAX_HITS = 512;
@@ -313,8 +351,8 @@ public:
 
 	void						Init ( ISphQword * pQword, const FieldMask_t& uFields, const ISphQwordSetup & tSetup, bool bNotWeighted );
 	virtual void				Reset ( const ISphQwordSetup & tSetup );
-	virtual const ExtDoc_t *	GetDocsChunk();
-	virtual const ExtHit_t *	GetHitsChunk ( const ExtDoc_t * pDocs );
+	virtual const ExtDoc_t *	GetDocsChunkImpl();
+	virtual const ExtHit_t *	GetHitsChunkImpl ( const ExtDoc_t * pDocs );
 
 	virtual int					GetQwords ( ExtQwordsHash_t & hQwords );
 	virtual void				SetQwordsIDF ( const ExtQwordsHash_t & hQwords );
@@ -335,10 +373,18 @@ public:
 		m_pQword->HintDocid ( uMinID );
 		if ( m_pStats )
 			m_pStats->m_iSkips++;
+		if ( m_pNodeProfile )
+			m_pNodeProfile->m_iSkips++;
 		if ( m_pNanoBudget )
 			*m_pNanoBudget -= g_iPredictorCostSkip;
 	}
 
+	virtual void AttachProfile ( CSphVector<PlanNodeProfile_t*> & dNodes, int iDepth )
+	{
+		AddNodeProfile ( dNodes, iDepth, "" )->m_sName.SetSprintf ( "KEYWORD(%s, querypos=%d)",
+			m_pQword->m_sWord.cstr(), m_pQword->m_iAtomPos );
+	}
+
 	virtual void DebugDump ( int iLevel )
 	{
 		DebugIndent ( iLevel );
@@ -406,7 +452,7 @@ public:
 	{}
 
 	virtual void				Reset ( const ISphQwordSetup & ) { m_uFieldPos = 0; }
-	virtual const ExtHit_t *	GetHitsChunk ( const ExtDoc_t * pDocs );
+	virtual const ExtHit_t *	GetHitsChunkImpl ( const ExtDoc_t * pDocs );
 	virtual bool				GotHitless () { return true; }
 
 protected:
@@ -572,8 +618,8 @@ protected:
 								ExtConditional ( ISphQword * pQword, const XQNode_t * pNode, const ISphQwordSetup & tSetup );
 public:
 	virtual void				Reset ( const ISphQwordSetup & tSetup );
-	virtual const ExtDoc_t *	GetDocsChunk();
-	virtual const ExtHit_t *	GetHitsChunk ( const ExtDoc_t * pDocs );
+	virtual const ExtDoc_t *	GetDocsChunkImpl();
+	virtual const ExtHit_t *	GetHitsChunkImpl ( const ExtDoc_t * pDocs );
 	virtual bool				GotHitless () { return false; }
 
 private:
@@ -635,6 +681,13 @@ public:
 		m_pChildren[1]->DebugDump ( iLevel+1 );
 	}
 
+	void AttachProfileT ( const char * sName, CSphVector<PlanNodeProfile_t*> & dNodes, int iDepth )
+	{
+		AddNodeProfile ( dNodes, iDepth, sName );
+		m_pChildren[0]->AttachProfile ( dNodes, iDepth+1 );
+		m_pChildren[1]->AttachProfile ( dNodes, iDepth+1 );
+	}
+
 	void SetNodePos ( WORD uPosLeft, WORD uPosRight )
 	{
 		m_dNodePos[0] = uPosLeft;
@@ -666,10 +719,11 @@ class ExtAnd_c : public ExtTwofer_c
 public:
 								ExtAnd_c ( ExtNode_i * pFirst, ExtNode_i * pSecond, const ISphQwordSetup & tSetup ) : ExtTwofer_c ( pFirst, pSecond, tSetup ) {}
 								ExtAnd_c() {} ///< to be used with Init()
-	virtual const ExtDoc_t *	GetDocsChunk();
-	virtual const ExtHit_t *	GetHitsChunk ( const ExtDoc_t * pDocs );
+	virtual const ExtDoc_t *	GetDocsChunkImpl();
+	virtual const ExtHit_t *	GetHitsChunkImpl ( const ExtDoc_t * pDocs );
 
 	void DebugDump ( int iLevel ) { DebugDumpT ( "ExtAnd", iLevel ); }
+	void AttachProfile ( CSphVector<PlanNodeProfile_t*> & dNodes, int iDepth ) { AttachProfileT ( "AND", dNodes, iDepth ); }
 };
 
 class ExtAndZonespanned : public ExtAnd_c
@@ -687,8 +741,9 @@ public:
 		if ( pSecond && !pSecond->GetExtraData ( EXTRA_GET_DATA_ZONESPANS, (void**) &m_dChildzones[1] ) )
 			assert ( false );
 	}
-	virtual const ExtHit_t *	GetHitsChunk ( const ExtDoc_t * pDocs );
+	virtual const ExtHit_t *	GetHitsChunkImpl ( const ExtDoc_t * pDocs );
 	void DebugDump ( int iLevel ) { DebugDumpT ( "ExtAndZonespan", iLevel ); }
+	void AttachProfile ( CSphVector<PlanNodeProfile_t*> & dNodes, int iDepth ) { AttachProfileT ( "AND-ZONESPAN", dNodes, iDepth ); }
 
 private:
 	ZoneSpansHolder *			m_dChildzones[2];
@@ -725,10 +780,11 @@ class ExtOr_c : public ExtTwofer_c
 {
 public:
 								ExtOr_c ( ExtNode_i * pFirst, ExtNode_i * pSecond, const ISphQwordSetup & tSetup ) : ExtTwofer_c ( pFirst, pSecond, tSetup ) {}
-	virtual const ExtDoc_t *	GetDocsChunk();
-	virtual const ExtHit_t *	GetHitsChunk ( const ExtDoc_t * pDocs );
+	virtual const ExtDoc_t *	GetDocsChunkImpl();
+	virtual const ExtHit_t *	GetHitsChunkImpl ( const ExtDoc_t * pDocs );
 
 	void DebugDump ( int iLevel ) { DebugDumpT ( "ExtOr", iLevel ); }
+	void AttachProfile ( CSphVector<PlanNodeProfile_t*> & dNodes, int iDepth ) { AttachProfileT ( "OR", dNodes, iDepth ); }
 };
 
 
@@ -737,9 +793,10 @@ class ExtMaybe_c : public ExtOr_c
 {
 public:
 								ExtMaybe_c ( ExtNode_i * pFirst, ExtNode_i * pSecond, const ISphQwordSetup & tSetup ) : ExtOr_c ( pFirst, pSecond, tSetup ) {}
-	virtual const ExtDoc_t *	GetDocsChunk();
+	virtual const ExtDoc_t *	GetDocsChunkImpl();
 
 	void DebugDump ( int iLevel ) { DebugDumpT ( "ExtMaybe", iLevel ); }
+	void AttachProfile ( CSphVector<PlanNodeProfile_t*> & dNodes, int iDepth ) { AttachProfileT ( "MAYBE", dNodes, iDepth ); }
 };
 
 
@@ -748,11 +805,12 @@ class ExtAndNot_c : public ExtTwofer_c
 {
 public:
 								ExtAndNot_c ( ExtNode_i * pFirst, ExtNode_i * pSecond, const ISphQwordSetup & tSetup );
-	virtual const ExtDoc_t *	GetDocsChunk();
-	virtual const ExtHit_t *	GetHitsChunk ( const ExtDoc_t * pDocs );
+	virtual const ExtDoc_t *	GetDocsChunkImpl();
+	virtual const ExtHit_t *	GetHitsChunkImpl ( const ExtDoc_t * pDocs );
 	virtual void				Reset ( const ISphQwordSetup & tSetup );
 
 	void DebugDump ( int iLevel ) { DebugDumpT ( "ExtAndNot", iLevel ); }
+	void AttachProfile ( CSphVector<PlanNodeProfile_t*> & dNodes, int iDepth ) { AttachProfileT ( "ANDNOT", dNodes, iDepth ); }
 
 protected:
 	bool						m_bPassthrough;
@@ -855,14 +913,19 @@ public:
 	}
 
 public:
-	virtual const ExtDoc_t *	GetDocsChunk();
-	virtual const ExtHit_t *	GetHitsChunk ( const ExtDoc_t * pDocs );
+	virtual const ExtDoc_t *	GetDocsChunkImpl();
+	virtual const ExtHit_t *	GetHitsChunkImpl ( const ExtDoc_t * pDocs );
 	virtual void DebugDump ( int iLevel )
 	{
 		DebugIndent ( iLevel );
 		printf ( "%s\n", FSM::GetName() );
 		m_pNode->DebugDump ( iLevel+1 );
 	}
+	virtual void AttachProfile ( CSphVector<PlanNodeProfile_t*> & dNodes, int iDepth )
+	{
+		AddNodeProfile ( dNodes, iDepth, FSM::GetPlanName() );
+		m_pNode->AttachProfile ( dNodes, iDepth+1 );
+	}
 private:
 	bool						EmitTail ( int & iHit );	///< the "trickiest part" extracted in order to process the proximity also
 };
@@ -881,6 +944,7 @@ protected:
 	bool						HitFSM ( const ExtHit_t* pHit, ExtHit_t* dTarget );
 
 	inline static const char *	GetName() { return "ExtPhrase"; }
+	inline static const char *	GetPlanName() { return "PHRASE"; }
 	inline void ResetFSM()
 	{
 		m_dStates.Resize(0);
@@ -903,6 +967,7 @@ protected:
 	bool						HitFSM ( const ExtHit_t* pHit, ExtHit_t* dTarget );
 
 	inline static const char *	GetName() { return "ExtProximity"; }
+	inline static const char *	GetPlanName() { return "PROXIMITY"; }
 	inline void ResetFSM()
 	{
 		m_uExpPos = 0;
@@ -935,6 +1000,7 @@ protected:
 	bool						HitFSM ( const ExtHit_t * pHit, ExtHit_t * dTarget );
 
 	inline static const char *	GetName() { return "ExtMultinear"; }
+	inline static const char *	GetPlanName() { return "NEAR"; }
 	inline void ResetFSM()
 	{
 		m_iRing = m_uLastP = m_uPrelastP = 0;
@@ -987,8 +1053,8 @@ public:
 	virtual						~ExtQuorum_c ();
 
 	virtual void				Reset ( const ISphQwordSetup & tSetup );
-	virtual const ExtDoc_t *	GetDocsChunk();
-	virtual const ExtHit_t *	GetHitsChunk ( const ExtDoc_t * pDocs );
+	virtual const ExtDoc_t *	GetDocsChunkImpl();
+	virtual const ExtHit_t *	GetHitsChunkImpl ( const ExtDoc_t * pDocs );
 
 	virtual int					GetQwords ( ExtQwordsHash_t & hQwords );
 	virtual void				SetQwordsIDF ( const ExtQwordsHash_t & hQwords );
@@ -1033,6 +1099,16 @@ private:
 	const ExtHit_t *			GetHitsChunkDupesTail ();
 	const ExtHit_t *			GetHitsChunkSimple ( const ExtDoc_t * pDocs );
 
+public:
+	virtual void AttachProfile ( CSphVector<PlanNodeProfile_t*> & dNodes, int iDepth )
+	{
+		AddNodeProfile ( dNodes, iDepth, "" )->m_sName.SetSprintf ( "QUORUM(count=%d)", m_iThresh );
+		ARRAY_FOREACH ( i, m_dInitialChildren )
+			m_dInitialChildren[i].m_pTerm->AttachProfile ( dNodes, iDepth+1 );
+	}
+
+private:
+
 	int							CountQuorum ( bool bFixDupes )
 	{
 		if ( !m_bHasDupes )
@@ -1065,8 +1141,8 @@ public:
 								~ExtOrder_c ();
 
 	virtual void				Reset ( const ISphQwordSetup & tSetup );
-	virtual const ExtDoc_t *	GetDocsChunk();
-	virtual const ExtHit_t *	GetHitsChunk ( const ExtDoc_t * pDocs );
+	virtual const ExtDoc_t *	GetDocsChunkImpl();
+	virtual const ExtHit_t *	GetHitsChunkImpl ( const ExtDoc_t * pDocs );
 	virtual int					GetQwords ( ExtQwordsHash_t & hQwords );
 	virtual void				SetQwordsIDF ( const ExtQwordsHash_t & hQwords );
 	virtual void				GetTermDupes ( const ExtQwordsHash_t & hQwords, CSphVector<WORD> & dTermDupes ) const;
@@ -1079,6 +1155,13 @@ public:
 			m_dChildren[i]->HintDocid ( uMinID );
 	}
 
+	virtual void AttachProfile ( CSphVector<PlanNodeProfile_t*> & dNodes, int iDepth )
+	{
+		AddNodeProfile ( dNodes, iDepth, "BEFORE" );
+		ARRAY_FOREACH ( i, m_dChildren )
+			m_dChildren[i]->AttachProfile ( dNodes, iDepth+1 );
+	}
+
 protected:
 	CSphVector<ExtNode_i *>		m_dChildren;
 	CSphVector<const ExtDoc_t*>	m_pDocsChunk;	///< last document chunk (for hit fetching)
@@ -1102,8 +1185,8 @@ public:
 	ExtUnit_c ( ExtNode_i * pFirst, ExtNode_i * pSecond, const FieldMask_t& dFields, const ISphQwordSetup & tSetup, const char * sUnit );
 	~ExtUnit_c ();
 
-	virtual const ExtDoc_t *	GetDocsChunk();
-	virtual const ExtHit_t *	GetHitsChunk ( const ExtDoc_t * pDocs );
+	virtual const ExtDoc_t *	GetDocsChunkImpl();
+	virtual const ExtHit_t *	GetHitsChunkImpl ( const ExtDoc_t * pDocs );
 	virtual void				Reset ( const ISphQwordSetup & tSetup );
 	virtual int					GetQwords ( ExtQwordsHash_t & hQwords );
 	virtual void				SetQwordsIDF ( const ExtQwordsHash_t & hQwords );
@@ -1130,6 +1213,13 @@ public:
 		m_pArg2->DebugDump ( iLevel+1 );
 	}
 
+	virtual void AttachProfile ( CSphVector<PlanNodeProfile_t*> & dNodes, int iDepth )
+	{
+		AddNodeProfile ( dNodes, iDepth, m_sUnit==MAGIC_WORD_SENTENCE ? "SENTENCE" : "PARAGRAPH" );
+		m_pArg1->AttachProfile ( dNodes, iDepth+1 );
+		m_pArg2->AttachProfile ( dNodes, iDepth+1 );
+	}
+
 protected:
 	inline const ExtDoc_t * ReturnDocsChunk ( int iDocs, int iMyHit )
 	{
@@ -1147,6 +1237,7 @@ private:
 	ExtNode_i *			m_pArg1;				///< left arg
 	ExtNode_i *			m_pArg2;				///< right arg
 	ExtTerm_c *			m_pDot;					///< dot positions
+	const char *		m_sUnit;				///< unit magic word, sentence or paragraph
 
 	ExtHit_t			m_dMyHits[MAX_HITS];	///< matching hits buffer (inherited m_dHits will receive filtered results)
 	SphDocID_t			m_uHitsOverFor;			///< no more hits for matches block starting with this ID
@@ -1175,6 +1266,7 @@ public:
 								ExtRanker_c ( const XQQuery_t & tXQ, const ISphQwordSetup & tSetup );
 	virtual						~ExtRanker_c ();
 	virtual void				Reset ( const ISphQwordSetup & tSetup );
+	virtual void				HintDocid ( SphDocID_t uMinID )							{ if ( m_pRoot ) m_pRoot->HintDocid ( uMinID ); }
 
 	virtual CSphMatch *			GetMatchesBuffer () { return m_dMatches; }
 	virtual const ExtDoc_t *	GetFilteredDocs ();
@@ -1217,6 +1309,11 @@ protected:
 	CSphVector<SphDocID_t>		m_dZoneMin;				///< first docid we (tried) to cache
 	ZoneVVector_t				m_dZoneInfo;
 	bool						m_bZSlist;
+
+protected:
+	CSphVector<PlanNodeProfile_t*>	m_dPlanNodes;		///< evaluation tree counters when profiling, owned by the nodes
+
+	void						FlushPlanProfile ();
 };
 
 
@@ -1265,6 +1362,12 @@ public:
 					ExtRanker_T ( const XQQuery_t & tXQ, const ISphQwordSetup & tSetup );
 	virtual int		GetMatches ();
 
+	virtual void	Reset ( const ISphQwordSetup & tSetup )
+	{
+		ExtRanker_c::Reset ( tSetup );
+		m_pHitBase = NULL;
+	}
+
 	virtual bool InitState ( const CSphQueryContext & tCtx, CSphString & sError )
 	{
 		return m_tState.Init ( tCtx.m_iWeights, &tCtx.m_dWeights[0], this, sError, tCtx.m_uPackedFactorFlags );
@@ -1305,7 +1408,8 @@ static inline void CopyExtDoc ( ExtDoc_t & tDst, const ExtDoc_t & tSrc, CSphRowi
 }
 
 ExtNode_i::ExtNode_i ()
-	: m_iAtomPos ( 0 )
+	: m_pNodeProfile ( NULL )
+	, m_iAtomPos ( 0 )
 	, m_iStride ( 0 )
 	, m_pDocinfo ( NULL )
 {
@@ -1314,6 +1418,34 @@ ExtNode_i::ExtNode_i ()
 }
 
 
+const ExtDoc_t * ExtNode_i::ProfiledDocsChunk ()
+{
+	int64_t tmStart = sphNanoTimer();
+	const ExtDoc_t * pDocs = GetDocsChunkImpl();
+	m_pNodeProfile->m_tmTotal += sphNanoTimer() - tmStart;
+	m_pNodeProfile->m_iDocCalls++;
+
+	if ( pDocs )
+		for ( const ExtDoc_t * pDoc = pDocs; pDoc->m_uDocid!=DOCID_MAX; pDoc++ )
+			m_pNodeProfile->m_iDocs++;
+	return pDocs;
+}
+
+
+const ExtHit_t * ExtNode_i::ProfiledHitsChunk ( const ExtDoc_t * pDocs )
+{
+	int64_t tmStart = sphNanoTimer();
+	const ExtHit_t * pHits = GetHitsChunkImpl ( pDocs );
+	m_pNodeProfile->m_tmTotal += sphNanoTimer() - tmStart;
+	m_pNodeProfile->m_iHitCalls++;
+
+	if ( pHits )
+		for ( const ExtHit_t * pHit = pHits; pHit->m_uDocid!=DOCID_MAX; pHit++ )
+			m_pNodeProfile->m_iHits++;
+	return pHits;
+}
+
+
 static ISphQword * CreateQueryWord ( const XQKeyword_t & tWord, const ISphQwordSetup & tSetup, CSphDict * pZonesDict=NULL )
 {
 	BYTE sTmp [ 3*SPH_MAX_WORD_LEN + 16 ];
@@ -1542,8 +1674,8 @@ public:
 	explicit						ExtPayload_c ( const XQNode_t * pNode, const ISphQwordSetup & tSetup );
 	virtual void					Reset ( const ISphQwordSetup & tSetup );
 	virtual void					HintDocid ( SphDocID_t ) {} // FIXME!!! implement with tree
-	virtual const ExtDoc_t *		GetDocsChunk();
-	virtual const ExtHit_t *		GetHitsChunk ( const ExtDoc_t * pDocs );
+	virtual const ExtDoc_t *		GetDocsChunkImpl();
+	virtual const ExtHit_t *		GetHitsChunkImpl ( const ExtDoc_t * pDocs );
 
 	virtual int						GetQwords ( ExtQwordsHash_t & hQwords );
 	virtual void					SetQwordsIDF ( const ExtQwordsHash_t & hQwords );
@@ -1552,6 +1684,11 @@ public:
 	virtual int						GetDocsCount () { return m_tWord.m_iDocs; }
 	virtual uint64_t				GetWordID () const { return m_tWord.m_uWordID; }
 
+	virtual void AttachProfile ( CSphVector<PlanNodeProfile_t*> & dNodes, int iDepth )
+	{
+		AddNodeProfile ( dNodes, iDepth, "" )->m_sName.SetSprintf ( "PAYLOAD(%s, querypos=%d)", m_tWord.m_sWord.cstr(), m_tWord.m_iAtomPos );
+	}
+
 private:
 	void							PopulateCache ( const ISphQwordSetup & tSetup, bool bFillStat );
 };
@@ -1668,7 +1805,7 @@ void ExtPayload_c::Reset ( const ISphQwordSetup & tSetup )
 }
 
 
-const ExtDoc_t * ExtPayload_c::GetDocsChunk()
+const ExtDoc_t * ExtPayload_c::GetDocsChunkImpl()
 {
 	m_iCurHit = m_iCurDocsEnd;
 	if ( m_iCurDocsEnd>=m_dCache.GetLength() )
@@ -1702,7 +1839,7 @@ const ExtDoc_t * ExtPayload_c::GetDocsChunk()
 }
 
 
-const ExtHit_t * ExtPayload_c::GetHitsChunk ( const ExtDoc_t * pDocs )
+const ExtHit_t * ExtPayload_c::GetHitsChunkImpl ( const ExtDoc_t * pDocs )
 {
 	if ( m_iCurHit>=m_iCurDocsEnd )
 		return NULL;
@@ -2031,7 +2168,7 @@ void ExtTerm_c::Reset ( const ISphQwordSetup & tSetup )
 	tSetup.QwordSetup ( m_pQword );
 }
 
-const ExtDoc_t * ExtTerm_c::GetDocsChunk()
+const ExtDoc_t * ExtTerm_c::GetDocsChunkImpl()
 {
 	m_pLastChecked = m_dDocs;
 	m_bTail = false;
@@ -2107,7 +2244,7 @@ const ExtDoc_t * ExtTerm_c::GetDocsChunk()
 	return ReturnDocsChunk ( iDoc, "term" );
 }
 
-const ExtHit_t * ExtTerm_c::GetHitsChunk ( const ExtDoc_t * pMatched )
+const ExtHit_t * ExtTerm_c::GetHitsChunkImpl ( const ExtDoc_t * pMatched )
 {
 	if ( !pMatched )
 		return NULL;
@@ -2239,7 +2376,7 @@ void ExtTerm_c::GetTermDupes ( const ExtQwordsHash_t & hQwords, CSphVector<WORD>
 
 //////////////////////////////////////////////////////////////////////////
 
-const ExtHit_t * ExtTermHitless_c::GetHitsChunk ( const ExtDoc_t * pMatched )
+const ExtHit_t * ExtTermHitless_c::GetHitsChunkImpl ( const ExtDoc_t * pMatched )
 {
 	if ( !pMatched )
 		return NULL;
@@ -2405,13 +2542,13 @@ inline bool TermAcceptor_c<TERM_POS_ZONESPAN>::IsAcceptableHit ( const ExtHit_t
 }
 
 template < TermPosFilter_e T, class ExtBase >
-const ExtDoc_t * ExtConditional<T,ExtBase>::GetDocsChunk()
+const ExtDoc_t * ExtConditional<T,ExtBase>::GetDocsChunkImpl()
 {
 	SphDocID_t uSkipID = m_uLastID;
 	// fetch more docs if needed
 	if ( !m_pRawDocs )
 	{
-		m_pRawDocs = ExtBase::GetDocsChunk();
+		m_pRawDocs = ExtBase::GetDocsChunkImpl();
 		if ( !m_pRawDocs )
 			return NULL;
 
@@ -2434,13 +2571,13 @@ const ExtDoc_t * ExtConditional<T,ExtBase>::GetDocsChunk()
 	{
 		// try to fetch more hits for current raw docs block if we're out
 		if ( !pHit || pHit->m_uDocid==DOCID_MAX )
-			pHit = ExtBase::GetHitsChunk ( m_pRawDocs );
+			pHit = ExtBase::GetHitsChunkImpl ( m_pRawDocs );
 
 		// did we touch all the hits we had? if so, we're fully done with
 		// current raw docs block, and should start a new one
 		if ( !pHit )
 		{
-			m_pRawDocs = ExtBase::GetDocsChunk();
+			m_pRawDocs = ExtBase::GetDocsChunkImpl();
 			if ( !m_pRawDocs ) // no more incoming documents? bail
 				break;
 
@@ -2509,7 +2646,7 @@ const ExtDoc_t * ExtConditional<T,ExtBase>::GetDocsChunk()
 
 
 template < TermPosFilter_e T, class ExtBase >
-const ExtHit_t * ExtConditional<T,ExtBase>::GetHitsChunk ( const ExtDoc_t * pDocs )
+const ExtHit_t * ExtConditional<T,ExtBase>::GetHitsChunkImpl ( const ExtDoc_t * pDocs )
 {
 	if ( m_eState==COPY_DONE )
 	{
@@ -2575,7 +2712,7 @@ const ExtHit_t * ExtConditional<T,ExtBase>::GetHitsChunk ( const ExtDoc_t * pDoc
 	{
 		// where do we stand?
 		if ( !m_pRawHit || m_pRawHit->m_uDocid==DOCID_MAX )
-			m_pRawHit = ExtBase::GetHitsChunk ( m_pRawDocs );
+			m_pRawHit = ExtBase::GetHitsChunkImpl ( m_pRawDocs );
 
 		// no more hits for current chunk
 		if ( !m_pRawHit )
@@ -2670,7 +2807,7 @@ void ExtTwofer_c::GetTermDupes ( const ExtQwordsHash_t & hQwords, CSphVector<WOR
 
 //////////////////////////////////////////////////////////////////////////
 
-const ExtDoc_t * ExtAnd_c::GetDocsChunk()
+const ExtDoc_t * ExtAnd_c::GetDocsChunkImpl()
 {
 	const ExtDoc_t * pCur0 = m_pCurDoc[0];
 	const ExtDoc_t * pCur1 = m_pCurDoc[1];
@@ -2740,7 +2877,7 @@ const ExtDoc_t * ExtAnd_c::GetDocsChunk()
 	return ReturnDocsChunk ( iDoc, "and" );
 }
 
-const ExtHit_t * ExtAnd_c::GetHitsChunk ( const ExtDoc_t * pDocs )
+const ExtHit_t * ExtAnd_c::GetHitsChunkImpl ( const ExtDoc_t * pDocs )
 {
 	const ExtHit_t * pCur0 = m_pCurHit[0];
 	const ExtHit_t * pCur1 = m_pCurHit[1];
@@ -2872,7 +3009,7 @@ bool ExtAndZonespanned::IsSameZonespan ( int iLeft, int iRight ) const
 	return false;
 }
 
-const ExtHit_t * ExtAndZonespanned::GetHitsChunk ( const ExtDoc_t * pDocs )
+const ExtHit_t * ExtAndZonespanned::GetHitsChunkImpl ( const ExtDoc_t * pDocs )
 {
 	const ExtHit_t * pCur0 = m_pCurHit[0];
 	const ExtHit_t * pCur1 = m_pCurHit[1];
@@ -2992,7 +3129,7 @@ const ExtHit_t * ExtAndZonespanned::GetHitsChunk ( const ExtDoc_t * pDocs )
 
 //////////////////////////////////////////////////////////////////////////
 
-const ExtDoc_t * ExtOr_c::GetDocsChunk()
+const ExtDoc_t * ExtOr_c::GetDocsChunkImpl()
 {
 	const ExtDoc_t * pCur0 = m_pCurDoc[0];
 	const ExtDoc_t * pCur1 = m_pCurDoc[1];
@@ -3082,7 +3219,7 @@ const ExtDoc_t * ExtOr_c::GetDocsChunk()
 	return ReturnDocsChunk ( iDoc, "or" );
 }
 
-const ExtHit_t * ExtOr_c::GetHitsChunk ( const ExtDoc_t * pDocs )
+const ExtHit_t * ExtOr_c::GetHitsChunkImpl ( const ExtDoc_t * pDocs )
 {
 	const ExtHit_t * pCur0 = m_pCurHit[0];
 	const ExtHit_t * pCur1 = m_pCurHit[1];
@@ -3174,7 +3311,7 @@ const ExtHit_t * ExtOr_c::GetHitsChunk ( const ExtDoc_t * pDocs )
 // same docID as in lhs
 //
 // we do this to return hits from rhs too which we need to affect match rank
-const ExtDoc_t * ExtMaybe_c::GetDocsChunk()
+const ExtDoc_t * ExtMaybe_c::GetDocsChunkImpl()
 {
 	const ExtDoc_t * pCur0 = m_pCurDoc[0];
 	const ExtDoc_t * pCur1 = m_pCurDoc[1];
@@ -3221,7 +3358,7 @@ ExtAndNot_c::ExtAndNot_c ( ExtNode_i * pFirst, ExtNode_i * pSecond, const ISphQw
 {
 }
 
-const ExtDoc_t * ExtAndNot_c::GetDocsChunk()
+const ExtDoc_t * ExtAndNot_c::GetDocsChunkImpl()
 {
 	// if reject-list is over, simply pass through to accept-list
 	if ( m_bPassthrough )
@@ -3299,7 +3436,7 @@ const ExtDoc_t * ExtAndNot_c::GetDocsChunk()
 	return ReturnDocsChunk ( iDoc, "andnot" );
 }
 
-const ExtHit_t * ExtAndNot_c::GetHitsChunk ( const ExtDoc_t * pDocs )
+const ExtHit_t * ExtAndNot_c::GetHitsChunkImpl ( const ExtDoc_t * pDocs )
 {
 	return m_pChildren[0]->GetHitsChunk ( pDocs );
 }
@@ -3375,7 +3512,7 @@ uint64_t ExtNWayT::GetWordID() const
 }
 
 template < class FSM >
-const ExtDoc_t * ExtNWay_c<FSM>::GetDocsChunk()
+const ExtDoc_t * ExtNWay_c<FSM>::GetDocsChunkImpl()
 {
 	// initial warmup
 	if ( !m_pDoc )
@@ -3481,7 +3618,7 @@ const ExtDoc_t * ExtNWay_c<FSM>::GetDocsChunk()
 }
 
 template < class FSM >
-const ExtHit_t * ExtNWay_c<FSM>::GetHitsChunk ( const ExtDoc_t * pDocs )
+const ExtHit_t * ExtNWay_c<FSM>::GetHitsChunkImpl ( const ExtDoc_t * pDocs )
 {
 	// if we already emitted hits for this matches block, do not do that again
 	SphDocID_t uFirstMatch = pDocs->m_uDocid;
@@ -4143,7 +4280,7 @@ uint64_t ExtQuorum_c::GetWordID() const
 	return uHash;
 }
 
-const ExtDoc_t * ExtQuorum_c::GetDocsChunk()
+const ExtDoc_t * ExtQuorum_c::GetDocsChunkImpl()
 {
 	// warmup
 	ARRAY_FOREACH ( i, m_dChildren )
@@ -4243,7 +4380,7 @@ const ExtDoc_t * ExtQuorum_c::GetDocsChunk()
 	return ReturnDocsChunk ( iDoc, "quorum" );
 }
 
-const ExtHit_t * ExtQuorum_c::GetHitsChunk ( const ExtDoc_t * pDocs )
+const ExtHit_t * ExtQuorum_c::GetHitsChunkImpl ( const ExtDoc_t * pDocs )
 {
 	// dupe tail hits
 	if ( m_bHasDupes && m_uMatchedDocid )
@@ -4746,7 +4883,7 @@ int ExtOrder_c::GetMatchingHits ( SphDocID_t uDocid, ExtHit_t * pHitbuf, int iLi
 }
 
 
-const ExtDoc_t * ExtOrder_c::GetDocsChunk()
+const ExtDoc_t * ExtOrder_c::GetDocsChunkImpl()
 {
 	if ( m_bDone )
 		return NULL;
@@ -4849,7 +4986,7 @@ const ExtDoc_t * ExtOrder_c::GetDocsChunk()
 }
 
 
-const ExtHit_t * ExtOrder_c::GetHitsChunk ( const ExtDoc_t * pDocs )
+const ExtHit_t * ExtOrder_c::GetHitsChunkImpl ( const ExtDoc_t * pDocs )
 {
 	if ( pDocs->m_uDocid==m_uHitsOverFor )
 		return NULL;
@@ -4953,6 +5090,7 @@ ExtUnit_c::ExtUnit_c ( ExtNode_i * pFirst, ExtNode_i * pSecond, const FieldMask_
 {
 	m_pArg1 = pFirst;
 	m_pArg2 = pSecond;
+	m_sUnit = sUnit;
 
 	XQKeyword_t tDot;
 	tDot.m_sWord = sUnit;
@@ -5186,7 +5324,7 @@ void ExtUnit_c::SkipTailHits ()
 }
 
 
-const ExtDoc_t * ExtUnit_c::GetDocsChunk()
+const ExtDoc_t * ExtUnit_c::GetDocsChunkImpl()
 {
 	// SENTENCE operator is essentially AND on steroids
 	// that also takes relative dot positions into account
@@ -5298,7 +5436,7 @@ const ExtDoc_t * ExtUnit_c::GetDocsChunk()
 }
 
 
-const ExtHit_t * ExtUnit_c::GetHitsChunk ( const ExtDoc_t * pDocs )
+const ExtHit_t * ExtUnit_c::GetHitsChunkImpl ( const ExtDoc_t * pDocs )
 {
 	SphDocID_t uFirstMatch = pDocs->m_uDocid;
 
@@ -5516,6 +5654,10 @@ ExtRanker_c::ExtRanker_c ( const XQQuery_t & tXQ, const ISphQwordSetup & tSetup
 		tSetup.m_pCtx->m_pProfile->m_sTransformedTree.Clear();
 		Explain ( tXQ.m_pRoot, tSetup.m_pIndex->GetMatchSchema(), tXQ.m_dZones,
 			tSetup.m_pCtx->m_pProfile->m_sTransformedTree, 0 );
+
+		// also count and time every node of the evaluation tree
+		if ( m_pRoot )
+			m_pRoot->AttachProfile ( m_dPlanNodes, 0 );
 	}
 
 	m_pDoclist = NULL;
@@ -5560,6 +5702,7 @@ ExtRanker_c::ExtRanker_c ( const XQQuery_t & tXQ, const ISphQwordSetup & tSetup
 
 ExtRanker_c::~ExtRanker_c ()
 {
+	FlushPlanProfile();
 	SafeDelete ( m_pRoot );
 	ARRAY_FOREACH ( i, m_dZones )
 	{
@@ -5568,10 +5711,57 @@ ExtRanker_c::~ExtRanker_c ()
 	}
 }
 
+/// move the evaluation tree counters to the query profile
+/// rankers over the same tree (say, RT segments and chunks) get summed up, other trees get appended
+void ExtRanker_c::FlushPlanProfile ()
+{
+	if ( !m_dPlanNodes.GetLength() || !m_pCtx || !m_pCtx->m_pProfile )
+		return;
+
+	// self time is total time minus direct children total time
+	ARRAY_FOREACH ( i, m_dPlanNodes )
+	{
+		PlanNodeProfile_t & tNode = *m_dPlanNodes[i];
+		tNode.m_tmSelf = tNode.m_tmTotal;
+		for ( int j=i+1; j<m_dPlanNodes.GetLength() && m_dPlanNodes[j]->m_iDepth>tNode.m_iDepth; j++ )
+			if ( m_dPlanNodes[j]->m_iDepth==tNode.m_iDepth+1 )
+				tNode.m_tmSelf -= m_dPlanNodes[j]->m_tmTotal;
+	}
+
+	CSphVector<PlanNodeProfile_t> & dOut = m_pCtx->m_pProfile->m_dPlanNodes;
+	int iBase = dOut.GetLength() - m_dPlanNodes.GetLength();
+	bool bSame = ( iBase>=0 && dOut[iBase].m_iDepth==0 );
+	for ( int i=0; i<m_dPlanNodes.GetLength() && bSame; i++ )
+		bSame = ( dOut[iBase+i].m_iDepth==m_dPlanNodes[i]->m_iDepth && dOut[iBase+i].m_sName==m_dPlanNodes[i]->m_sName );
+
+	if ( !bSame )
+	{
+		ARRAY_FOREACH ( i, m_dPlanNodes )
+			dOut.Add ( *m_dPlanNodes[i] );
+		return;
+	}
+
+	ARRAY_FOREACH ( i, m_dPlanNodes )
+	{
+		const PlanNodeProfile_t & tSrc = *m_dPlanNodes[i];
+		PlanNodeProfile_t & tDst = dOut[iBase+i];
+		tDst.m_iDocCalls += tSrc.m_iDocCalls;
+		tDst.m_iHitCalls += tSrc.m_iHitCalls;
+		tDst.m_iDocs += tSrc.m_iDocs;
+		tDst.m_iHits += tSrc.m_iHits;
+		tDst.m_iSkips += tSrc.m_iSkips;
+		tDst.m_tmTotal += tSrc.m_tmTotal;
+		tDst.m_tmSelf += tSrc.m_tmSelf;
+	}
+}
+
+
 void ExtRanker_c::Reset ( const ISphQwordSetup & tSetup )
 {
 	if ( m_pRoot )
 		m_pRoot->Reset ( tSetup );
+	m_pDoclist = NULL;
+	m_pHitlist = NULL;
 	ARRAY_FOREACH ( i, m_dZones )
 	{
 		m_dZoneStartTerm[i]->Reset ( tSetup );
@@ -9257,9 +9447,16 @@ public:
 
 	virtual void HintDocid ( SphDocID_t ) {}
 
-	virtual const ExtDoc_t * GetDocsChunk();
+	virtual void AttachProfile ( CSphVector<PlanNodeProfile_t*> & dNodes, int iDepth )
+	{
+		AddNodeProfile ( dNodes, iDepth, "CACHED" );
+		if ( m_pChild )
+			m_pChild->AttachProfile ( dNodes, iDepth+1 );
+	}
+
+	virtual const ExtDoc_t * GetDocsChunkImpl();
 
-	virtual const ExtHit_t * GetHitsChunk ( const ExtDoc_t * pMatched );
+	virtual const ExtHit_t * GetHitsChunkImpl ( const ExtDoc_t * pMatched );
 
 	virtual int GetQwords ( ExtQwordsHash_t & hQwords )
 	{
@@ -9428,7 +9625,7 @@ void ExtNodeCached_t::StepForwardToHitsFor ( SphDocID_t uDocId )
 	m_iHitIndex = iEnd;
 }
 
-const ExtDoc_t * ExtNodeCached_t::GetDocsChunk()
+const ExtDoc_t * ExtNodeCached_t::GetDocsChunkImpl()
 {
 	if ( !m_pNode || !m_pChild )
 		return NULL;
@@ -9454,7 +9651,7 @@ const ExtDoc_t * ExtNodeCached_t::GetDocsChunk()
 	return ReturnDocsChunk ( iDoc, "cached" );
 }
 
-const ExtHit_t * ExtNodeCached_t::GetHitsChunk ( const ExtDoc_t * pMatched )
+const ExtHit_t * ExtNodeCached_t::GetHitsChunkImpl ( const ExtDoc_t * pMatched )
 {
 	if ( !m_pNode || !m_pChild )
 		return NULL;
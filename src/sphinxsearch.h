@@ -161,6 +161,9 @@ public:
 	virtual CSphMatch *			GetMatchesBuffer() = 0;
 	virtual int					GetMatches () = 0;
 	virtual void				Reset ( const ISphQwordSetup & tSetup ) = 0;
+
+	/// hint that matches below the given docid are not needed (might be ignored, so those must be skipped anyway)
+	virtual void				HintDocid ( SphDocID_t ) {}
 };
 
 /// factory
@@ -162,6 +162,11 @@ public:
 		return m_pData;
 	}
 
+	virtual bool WouldReject ( const CSphMatch & tEntry ) const
+	{
+		return m_iUsed==m_iSize && COMP::IsLess ( tEntry, m_pData[0], m_tState );
+	}
+
 	/// add entry to the queue
 	virtual bool Push ( const CSphMatch & tEntry )
 	{
@@ -482,6 +487,369 @@ public:
 
 //////////////////////////////////////////////////////////////////////////
 
+/// one part of a packed sort key
+struct PackedKeypart_t
+{
+	ESphSortKeyPart		m_eType;	///< SPH_KEYPART_ID, WEIGHT, INT or FLOAT
+	CSphAttrLocator		m_tLoc;		///< attr locator (INT and FLOAT only)
+	int					m_iBits;	///< width within the packed key
+	bool				m_bInvert;	///< lesser values sort better
+};
+
+
+/// fixed-width sort key; compares just like the functor it was built for,
+/// ie. a<b exactly when COMP::IsLess() would say so
+struct PackedKey_t
+{
+	uint64_t	m_uHi;
+	uint64_t	m_uLo;
+
+	inline bool operator < ( const PackedKey_t & b ) const
+	{
+		return m_uHi<b.m_uHi || ( m_uHi==b.m_uHi && m_uLo<b.m_uLo );
+	}
+};
+
+
+/// heap entry, a packed key and the match slot it came from
+struct PackedKeyEntry_t
+{
+	PackedKey_t	m_tKey;
+	int			m_iSlot;
+
+	inline bool operator < ( const PackedKeyEntry_t & b ) const
+	{
+		return m_tKey<b.m_tKey;
+	}
+};
+
+
+/// build packed key layout for a plain match sorting function
+/// returns false if the function or some of its key parts can not be packed into 128 bits
+static bool SetupPackedKeyparts ( ESphSortFunc eFunc, const CSphMatchComparatorState & tState, CSphVector<PackedKeypart_t> & dParts )
+{
+	dParts.Resize ( 0 );
+	const int DOCID_BITS = 8*sizeof(SphDocID_t);
+
+	// weight and docid tie-breaks are the same for all the functions
+	PackedKeypart_t tWeight;
+	tWeight.m_eType = SPH_KEYPART_WEIGHT;
+	tWeight.m_iBits = 32;
+	tWeight.m_bInvert = false;
+
+	PackedKeypart_t tDocid;
+	tDocid.m_eType = SPH_KEYPART_ID;
+	tDocid.m_iBits = DOCID_BITS;
+	tDocid.m_bInvert = true;
+
+	int iKeys = 0;
+	switch ( eFunc )
+	{
+		case FUNC_REL_DESC:
+			dParts.Add ( tWeight );
+			dParts.Add ( tDocid );
+			break;
+
+		case FUNC_ATTR_DESC:
+		case FUNC_ATTR_ASC:
+		{
+			// these compare the raw attribute value, whatever the attribute type
+			if ( tState.m_eKeypart[0]==SPH_KEYPART_STRING || tState.m_eKeypart[0]==SPH_KEYPART_STRINGPTR || tState.m_tSubKeys[0].m_sKey.cstr() )
+				return false;
+			PackedKeypart_t & tAttr = dParts.Add();
+			tAttr.m_eType = SPH_KEYPART_INT;
+			tAttr.m_tLoc = tState.m_tLocator[0];
+			tAttr.m_iBits = tState.m_tLocator[0].m_iBitCount;
+			tAttr.m_bInvert = ( eFunc==FUNC_ATTR_ASC );
+			dParts.Add ( tWeight );
+			dParts.Add ( tDocid );
+			break;
+		}
+
+		case FUNC_EXPR:
+		{
+			PackedKeypart_t & tExpr = dParts.Add();
+			tExpr.m_eType = SPH_KEYPART_FLOAT;
+			tExpr.m_tLoc = tState.m_tLocator[0];
+			tExpr.m_iBits = 32;
+			tExpr.m_bInvert = false;
+			dParts.Add ( tDocid );
+			break;
+		}
+
+		case FUNC_GENERIC2:		iKeys = 2; break;
+		case FUNC_GENERIC3:		iKeys = 3; break;
+		case FUNC_GENERIC4:		iKeys = 4; break;
+		case FUNC_GENERIC5:		iKeys = 5; break;
+		default:				return false;
+	}
+
+	for ( int i=0; i<iKeys; i++ )
+	{
+		if ( tState.m_tSubKeys[i].m_sKey.cstr() || tState.m_tSubExpr[i] )
+			return false;
+
+		PackedKeypart_t & tPart = dParts.Add();
+		tPart.m_eType = tState.m_eKeypart[i];
+		tPart.m_tLoc = tState.m_tLocator[i];
+		tPart.m_bInvert = ( ( tState.m_uAttrDesc>>i ) & 1 )==0;
+
+		switch ( tPart.m_eType )
+		{
+			case SPH_KEYPART_ID:		tPart.m_iBits = DOCID_BITS; break;
+			case SPH_KEYPART_WEIGHT:	tPart.m_iBits = 32; break;
+			case SPH_KEYPART_INT:		tPart.m_iBits = tPart.m_tLoc.m_iBitCount; break;
+			case SPH_KEYPART_FLOAT:		tPart.m_iBits = 32; break;
+			default:					return false;
+		}
+
+		// docids are unique, nothing after them ever gets compared
+		if ( tPart.m_eType==SPH_KEYPART_ID )
+			break;
+	}
+	if ( iKeys && dParts.Last().m_eType!=SPH_KEYPART_ID )
+		dParts.Add ( tDocid );
+
+	int iBits = 0;
+	ARRAY_FOREACH ( i, dParts )
+	{
+		if ( dParts[i].m_iBits<=0 || dParts[i].m_iBits>64 )
+			return false;
+		iBits += dParts[i].m_iBits;
+	}
+	return iBits<=128;
+}
+
+
+/// heap sorter over packed keys
+/// sort keys are extracted once per pushed match into a fixed-width integer key, and the heap
+/// only moves and compares those; matches stay put in their slots, and only the ones that pass
+/// the heap top get cloned at all
+class CSphPackedKeyQueue : public CSphMatchQueueTraits
+{
+protected:
+	const ESphSortFunc						m_eFunc;
+	CSphVector<PackedKeypart_t>				m_dParts;
+	CSphFixedVector<PackedKeyEntry_t>		m_dHeap;
+	CSphFixedVector<int>					m_dFreeSlots;
+
+public:
+	/// ctor
+	CSphPackedKeyQueue ( ESphSortFunc eFunc, int iSize, bool bUsesAttrs )
+		: CSphMatchQueueTraits ( iSize, bUsesAttrs )
+		, m_eFunc ( eFunc )
+		, m_dHeap ( iSize )
+		, m_dFreeSlots ( iSize )
+	{
+		ARRAY_FOREACH ( i, m_dFreeSlots )
+			m_dFreeSlots[i] = iSize-1-i;
+	}
+
+	/// check if given sorting function and state can be packed
+	static bool IsSupported ( ESphSortFunc eFunc, const CSphMatchComparatorState & tState )
+	{
+		CSphVector<PackedKeypart_t> dParts;
+		return SetupPackedKeyparts ( eFunc, tState, dParts );
+	}
+
+	/// setup key layout along with the state; the state must pass IsSupported()
+	virtual void SetState ( const CSphMatchComparatorState & tState )
+	{
+		CSphMatchQueueTraits::SetState ( tState );
+		bool bOk = SetupPackedKeyparts ( m_eFunc, m_tState, m_dParts );
+		assert ( bOk );
+		(void)bOk;
+	}
+
+	virtual bool IsGroupby () const
+	{
+		return false;
+	}
+
+	virtual const CSphMatch * GetWorst() const
+	{
+		return m_iUsed ? m_pData + m_dHeap[0].m_iSlot : NULL;
+	}
+
+	virtual bool WouldReject ( const CSphMatch & tEntry ) const
+	{
+		return m_iUsed==m_iSize && GetKey ( tEntry ) < m_dHeap[0].m_tKey;
+	}
+
+	/// add entry to the queue
+	virtual bool Push ( const CSphMatch & tEntry )
+	{
+		m_iTotal++;
+
+		PackedKeyEntry_t tNew;
+		tNew.m_tKey = GetKey ( tEntry );
+
+		if ( m_iUsed==m_iSize )
+		{
+			// if it's worse that current min, reject it, else pop off current min
+			if ( tNew.m_tKey < m_dHeap[0].m_tKey )
+				return true;
+			else
+				Pop ();
+		}
+
+		// do add
+		tNew.m_iSlot = m_dFreeSlots [ m_iSize-1-m_iUsed ];
+		m_tSchema.CloneMatch ( m_pData+tNew.m_iSlot, tEntry );
+
+		// sift up if needed, so that worst (lesser) ones float to the top
+		int iEntry = m_iUsed++;
+		while ( iEntry )
+		{
+			int iParent = ( iEntry-1 ) >> 1;
+			if ( !( tNew < m_dHeap[iParent] ) )
+				break;
+			m_dHeap[iEntry] = m_dHeap[iParent];
+			iEntry = iParent;
+		}
+		m_dHeap[iEntry] = tNew;
+
+		return true;
+	}
+
+	/// add grouped entry (must not happen)
+	virtual bool PushGrouped ( const CSphMatch &, bool )
+	{
+		assert ( 0 );
+		return false;
+	}
+
+	/// remove root (ie. top priority) entry
+	virtual void Pop ()
+	{
+		assert ( m_iUsed );
+		int iSlot = m_dHeap[0].m_iSlot;
+		m_tSchema.FreeStringPtrs ( m_pData+iSlot );
+		m_dFreeSlots [ m_iSize-m_iUsed ] = iSlot;
+		if ( !(--m_iUsed) ) // empty queue? just return
+			return;
+
+		// make the last entry my new root, and sift it down
+		PackedKeyEntry_t tLast = m_dHeap[m_iUsed];
+		int iEntry = 0;
+		for ( ;; )
+		{
+			// select smallest child
+			int iChild = (iEntry<<1) + 1;
+			if ( iChild>=m_iUsed )
+				break;
+			if ( iChild+1<m_iUsed && m_dHeap[iChild+1] < m_dHeap[iChild] )
+				iChild++;
+
+			// if smallest child is less than entry, do float it to the top
+			if ( !( m_dHeap[iChild] < tLast ) )
+				break;
+			m_dHeap[iEntry] = m_dHeap[iChild];
+			iEntry = iChild;
+		}
+		m_dHeap[iEntry] = tLast;
+	}
+
+	/// store all entries into specified location in sorted order, and remove them from queue
+	int Flatten ( CSphMatch * pTo, int iTag )
+	{
+		assert ( m_iUsed>=0 );
+		pTo += m_iUsed;
+		int iCopied = m_iUsed;
+		while ( m_iUsed>0 )
+		{
+			--pTo;
+			m_tSchema.FreeStringPtrs ( pTo );
+			Swap ( *pTo, m_pData [ m_dHeap[0].m_iSlot ] );
+			if ( iTag>=0 )
+				pTo->m_iTag = iTag;
+			Pop ();
+		}
+		m_iTotal = 0;
+		return iCopied;
+	}
+
+	void Finalize ( ISphMatchProcessor & tProcessor, bool bCallProcessInResultSetOrder )
+	{
+		if ( !GetLength() )
+			return;
+
+		if ( !bCallProcessInResultSetOrder )
+		{
+			// just evaluate in heap order
+			for ( int i=0; i<m_iUsed; i++ )
+				tProcessor.Process ( m_pData + m_dHeap[i].m_iSlot );
+		} else
+		{
+			// means final-stage calls will be evaluated
+			// a) over the final, pre-limit result set
+			// b) in the final result set order
+			CSphFixedVector<PackedKeyEntry_t> dSorted ( m_iUsed );
+			memcpy ( dSorted.Begin(), m_dHeap.Begin(), sizeof(PackedKeyEntry_t)*m_iUsed );
+			sphSort ( dSorted.Begin(), dSorted.GetLength(), SphGreater_T<PackedKeyEntry_t>() );
+
+			ARRAY_FOREACH ( i, dSorted )
+				tProcessor.Process ( m_pData + dSorted[i].m_iSlot );
+		}
+	}
+
+protected:
+	/// extract packed key from a match
+	inline PackedKey_t GetKey ( const CSphMatch & tMatch ) const
+	{
+		PackedKey_t tKey;
+		tKey.m_uHi = 0;
+		tKey.m_uLo = 0;
+
+		ARRAY_FOREACH ( i, m_dParts )
+		{
+			const PackedKeypart_t & tPart = m_dParts[i];
+			uint64_t uVal;
+			switch ( tPart.m_eType )
+			{
+				case SPH_KEYPART_ID:
+					uVal = (uint64_t)tMatch.m_uDocID;
+					break;
+
+				case SPH_KEYPART_WEIGHT:
+					uVal = (DWORD)tMatch.m_iWeight ^ 0x80000000UL;
+					break;
+
+				case SPH_KEYPART_FLOAT:
+				{
+					// make float bits compare as unsigned ints; -0 equals +0
+					float fVal = tMatch.GetAttrFloat ( tPart.m_tLoc );
+					DWORD uBits = fVal==0.0f ? 0 : sphF2DW ( fVal );
+					uVal = ( uBits & 0x80000000UL ) ? (DWORD)~uBits : ( uBits | 0x80000000UL );
+					break;
+				}
+
+				default:
+					// 64-bit values compare signed, narrower ones never get sign extended
+					uVal = (uint64_t)tMatch.GetAttr ( tPart.m_tLoc );
+					if ( tPart.m_iBits==64 )
+						uVal ^= U64C(0x8000000000000000);
+					break;
+			}
+
+			if ( tPart.m_iBits==64 )
+			{
+				if ( tPart.m_bInvert )
+					uVal = ~uVal;
+				tKey.m_uHi = tKey.m_uLo;
+				tKey.m_uLo = uVal;
+			} else
+			{
+				if ( tPart.m_bInvert )
+					uVal = ~uVal & ( ( U64C(1)<<tPart.m_iBits )-1 );
+				tKey.m_uHi = ( tKey.m_uHi<<tPart.m_iBits ) | ( tKey.m_uLo>>( 64-tPart.m_iBits ) );
+				tKey.m_uLo = ( tKey.m_uLo<<tPart.m_iBits ) | uVal;
+			}
+		}
+		return tKey;
+	}
+};
+
 /// collector for UPDATE statement
 class CSphUpdateQueue : public CSphMatchQueueTraits
 {
@@ -4901,6 +5269,7 @@ ISphMatchSorter * sphCreateQueue ( SphQueueSettings_t & tQueue )
 
 	// expressions from select items
 	bool bHasCount = false;
+	SmallStringHash_T<CSphString> hComputedExprs; // expression text to the alias of a select item that computes it
 
 	if ( tQueue.m_bComputeItems )
 		ARRAY_FOREACH ( iItem, pQuery->m_dItems )
@@ -4970,6 +5339,11 @@ ISphMatchSorter * sphCreateQueue ( SphQueueSettings_t & tQueue )
 		CSphColumnInfo tExprCol ( tItem.m_sAlias.cstr(), SPH_ATTR_NONE );
 		DWORD uQueryPackedFactorFlags = SPH_FACTOR_DISABLE;
 
+		// common subexpression elimination
+		// the very same expression is already computed by one of the preceding items, so just read that column
+		const CSphString * pComputed = hComputedExprs ( sExpr );
+		bool bReused = ( pComputed && tItem.m_eAggrFunc!=SPH_AGGR_CAT );
+
 		// tricky bit
 		// GROUP_CONCAT() adds an implicit TO_STRING() conversion on top of its argument
 		// and then the aggregate operation simply concatenates strings as matches arrive
@@ -4984,7 +5358,7 @@ ISphMatchSorter * sphCreateQueue ( SphQueueSettings_t & tQueue )
 				&tExprCol.m_bWeight, sError, pProfiler, tQueue.m_pHook, &bHasZonespanlist, &uQueryPackedFactorFlags, &tExprCol.m_eStage );
 		} else
 		{
-			tExprCol.m_pExpr = sphExprParse ( sExpr.cstr(), tSorterSchema, &tExprCol.m_eAttrType,
+			tExprCol.m_pExpr = sphExprParse ( bReused ? pComputed->cstr() : sExpr.cstr(), tSorterSchema, &tExprCol.m_eAttrType,
 				&tExprCol.m_bWeight, sError, pProfiler, tQueue.m_pHook, &bHasZonespanlist, &uQueryPackedFactorFlags, &tExprCol.m_eStage );
 		}
 
@@ -5072,6 +5446,16 @@ ISphMatchSorter * sphCreateQueue ( SphQueueSettings_t & tQueue )
 				break;
 			}
 
+			// plain deterministic numeric expressions can be shared with identical items that follow
+			if ( !bReused && !tExprCol.m_bWeight && ( tExprCol.m_eAttrType==SPH_ATTR_INTEGER || tExprCol.m_eAttrType==SPH_ATTR_BIGINT
+				|| tExprCol.m_eAttrType==SPH_ATTR_FLOAT ) )
+			{
+				bool bGotUDF = false;
+				tExprCol.m_pExpr->Command ( SPH_EXPR_GET_UDF, &bGotUDF );
+				if ( !bGotUDF )
+					hComputedExprs.Add ( tExprCol.m_sName, sExpr );
+			}
+
 			// add it!
 			// NOTE, "final" stage might need to be fixed up later
 			// we'll do that when parsing sorting clause
@@ -5373,6 +5757,8 @@ ISphMatchSorter * sphCreateQueue ( SphQueueSettings_t & tQueue )
 			pTop = new CSphUpdateQueue ( pQuery->m_iMaxMatches, tQueue.m_pUpdate, pQuery->m_bIgnoreNonexistent, pQuery->m_bStrict );
 		else if ( tQueue.m_pDeletes )
 			pTop = new CSphDeleteQueue ( pQuery->m_iMaxMatches, tQueue.m_pDeletes );
+		else if ( !pQuery->m_bSortKbuffer && !( uPackedFactorFlags & SPH_FACTOR_ENABLE ) && CSphPackedKeyQueue::IsSupported ( eMatchFunc, tStateMatch ) )
+			pTop = new CSphPackedKeyQueue ( eMatchFunc, pQuery->m_iMaxMatches, bUsesAttrs );
 		else
 			pTop = CreatePlainSorter ( eMatchFunc, pQuery->m_bSortKbuffer, pQuery->m_iMaxMatches, bUsesAttrs, uPackedFactorFlags & SPH_FACTOR_ENABLE );
 	} else
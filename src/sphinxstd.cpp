@@ -19,6 +19,7 @@
 
 #if !USE_WINDOWS
 #include <sys/time.h> // for gettimeofday
+#include <time.h> // for clock_gettime
 
 // define this if you want to run gprof over the threads model - to track children threads also.
 #define USE_GPROF 0
@@ -1722,6 +1723,33 @@ int64_t sphMicroTimer()
 #endif // USE_WINDOWS
 }
 
+
+/// nanosecond precision monotonic timestamp
+int64_t sphNanoTimer()
+{
+#if USE_WINDOWS
+	static int64_t iFreq = 0;
+	LARGE_INTEGER iLarge;
+	if ( !iFreq )
+	{
+		QueryPerformanceFrequency ( &iLarge );
+		iFreq = iLarge.QuadPart;
+	}
+
+	// split the scaling, as the counter times 1e9 overflows 64bit int quickly
+	QueryPerformanceCounter ( &iLarge );
+	return ( iLarge.QuadPart / iFreq )*1000000000 + ( iLarge.QuadPart % iFreq )*1000000000 / iFreq;
+
+#elif defined(HAVE_CLOCK_GETTIME) && defined(CLOCK_MONOTONIC)
+	struct timespec ts;
+	clock_gettime ( CLOCK_MONOTONIC, &ts );
+	return int64_t(ts.tv_sec)*int64_t(1000000000) + int64_t(ts.tv_nsec);
+
+#else
+	return sphMicroTimer()*1000;
+#endif // USE_WINDOWS
+}
+
 //////////////////////////////////////////////////////////////////////////
 
 int CSphStrHashFunc::Hash ( const CSphString & sKey )
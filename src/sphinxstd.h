@@ -327,6 +327,10 @@ inline double sphQW2D ( uint64_t d )	{ union { double f; uint64_t d; } u; u.d =
 /// current UNIX timestamp in seconds multiplied by 1000000, plus microseconds since the beginning of current second
 int64_t		sphMicroTimer ();
 
+/// nanosecond precision monotonic timestamp, for fine grained profiling
+/// falls back to microsecond precision where no monotonic clock is available
+int64_t		sphNanoTimer ();
+
 /// double argument squared
 inline double sqr ( double v ) { return v*v;}
 
@@ -426,6 +426,7 @@ static KeyDesc_t g_dKeysIndex[] =
 	{ "agent_persistent",		KEY_LIST, NULL },
 	{ "agent_connect_timeout",	0, NULL },
 	{ "ha_strategy",			0, NULL	},
+	{ "ha_hedge_percentile",	0, NULL },
 	{ "agent_query_timeout",	0, NULL },
 	{ "html_strip",				0, NULL },
 	{ "html_index_attrs",		0, NULL },
@@ -468,6 +469,10 @@ static KeyDesc_t g_dKeysIndex[] =
 	{ "global_idf",				0, NULL },
 	{ "rlp_context",			0, NULL },
 	{ "ondisk_attrs",			0, NULL },
+	{ "infix_trigrams",			0, NULL },
+	{ "json_secondary_indexes",	0, NULL },
+	{ "docid_ordered_attrs",	0, NULL },
+	{ "stored_fields",			0, NULL },
 	{ "index_token_filter",		0, NULL },
 	{ NULL,						0, NULL }
 };
@@ -520,11 +525,14 @@ static KeyDesc_t g_dKeysSearchd[] =
 	{ "workers",				0, NULL },
 	{ "prefork",				KEY_HIDDEN, NULL },
 	{ "dist_threads",			0, NULL },
+	{ "snippets_threads",		0, NULL },
 	{ "binlog_flush",			0, NULL },
 	{ "binlog_path",			0, NULL },
 	{ "binlog_max_log_size",	0, NULL },
 	{ "thread_stack",			0, NULL },
 	{ "expansion_limit",		0, NULL },
+	{ "expansion_cache_size",	0, NULL },
+	{ "docstore_cache_size",	0, NULL },
 	{ "rt_flush_period",		0, NULL },
 	{ "query_log_format",		0, NULL },
 	{ "mysql_version_string",	0, NULL },
@@ -541,6 +549,8 @@ static KeyDesc_t g_dKeysSearchd[] =
 	{ "ha_period_karma",		0, NULL },
 	{ "predicted_time_costs",	0, NULL },
 	{ "persistent_connections_limit",	0, NULL },
+	{ "agent_multiplex_connections",	0, NULL },
+	{ "agent_result_encoding",		0, NULL },
 	{ "ondisk_attrs_default",	0, NULL },
 	{ "shutdown_timeout",		0, NULL },
 	{ "query_log_min_msec",		0, NULL },
@@ -1290,6 +1300,10 @@ bool sphConfIndex ( const CSphConfigSection & hIndex, CSphIndexSettings & tSetti
 	sFields.ToLower();
 	sphSplit ( tSettings.m_dInfixFields, sFields.cstr() );
 
+	sFields = hIndex.GetStr ( "stored_fields" );
+	sFields.ToLower();
+	sphSplit ( tSettings.m_dStoredFields, sFields.cstr() );
+
 	if ( tSettings.m_iMinPrefixLen==0 && tSettings.m_dPrefixFields.GetLength()!=0 )
 	{
 		fprintf ( stdout, "WARNING: min_prefix_len=0, prefix_fields ignored\n" );
@@ -20,6 +20,8 @@
 #include "sphinxrt.h"
 #include "sphinxint.h"
 #include "sphinxstem.h"
+#include "sphinxjson.h"
+#include "sphinxfilter.h"
 #include <math.h>
 
 #define SNOWBALL 0
@@ -792,6 +794,15 @@ void TestExpr ()
 	tMatch.m_iWeight = 456;
 	tMatch.m_pStatic = pRow;
 
+	// batch evaluation must agree with per-match one
+	CSphMatch dBatch[5];
+	for ( int i=0; i<5; i++ )
+	{
+		dBatch[i].m_uDocID = tMatch.m_uDocID;
+		dBatch[i].m_iWeight = tMatch.m_iWeight;
+		dBatch[i].m_pStatic = pRow;
+	}
+
 	struct ExprTest_t
 	{
 		const char *	m_sExpr;
@@ -830,7 +841,12 @@ void TestExpr ()
 		{ "(aaa+bbb)/sqrt(3)/sqrt(3)",		1.0f },
 		{ "aaa-bbb-2",						-3.0f },
 		{ "ccc/2*4/bbb",					3.0f },
-		{ "(2+(aaa*bbb))+3",				7.0f }
+		{ "(2+(aaa*bbb))+3",				7.0f },
+		{ "if(bbb>1,ccc,aaa)",				3.0f },
+		{ "if(2>=ccc,ccc,aaa)",				1.0f },
+		{ "bbb*3+ccc",						9.0f },
+		{ "ccc=3",							1.0f },
+		{ "aaa<>1",							0.0f }
 	};
 
 	const int nTests = sizeof(dTests)/sizeof(dTests[0]);
@@ -853,6 +869,15 @@ void TestExpr ()
 			assert ( 0 );
 		}
 
+		float dValues[5];
+		pExpr->EvalBatch ( dBatch, 5, dValues );
+		for ( int i=0; i<5; i++ )
+			if ( dValues[i]!=fValue )
+			{
+				printf ( "FAILED; batch %d expected %.3f, got %.3f\n", i, fValue, dValues[i] );
+				assert ( 0 );
+			}
+
 		printf ( "ok\n" );
 	}
 
@@ -1498,6 +1523,61 @@ void TestMisc ()
 	}
 
 	printf ( "ok\n" );
+
+	printf ( "testing match arena... " );
+	Verify ( sphInitMatchArena() );
+
+	// arena rows come zeroed (and aligned, where there is no debug header); results get detached out of the arena
+	const int MATCHES = 20000;
+	CSphMatch * pMatches = new CSphMatch [ MATCHES ];
+	{
+		CSphMatchArena tArena;
+		tArena.Start();
+		for ( int i=0; i<MATCHES; i++ )
+		{
+			pMatches[i].Reset ( 1 + i%7 );
+			assert ( tArena.Owns ( pMatches[i].m_pDynamic ) );
+#ifdef NDEBUG
+			assert ( ( ( (uintptr_t)pMatches[i].m_pDynamic ) & 7 )==0 );
+#endif
+			for ( int j=0; j<1+i%7; j++ )
+			{
+				assert ( pMatches[i].m_pDynamic[j]==0 );
+				pMatches[i].m_pDynamic[j] = i+j;
+			}
+		}
+
+		// nested arena; rows of the outer one are left alone, and stops go in reverse order
+		{
+			CSphMatchArena tInner;
+			tInner.Start();
+			CSphMatch tInnerMatch;
+			tInnerMatch.Reset ( 3 );
+			assert ( tInner.Owns ( tInnerMatch.m_pDynamic ) && !tArena.Owns ( tInnerMatch.m_pDynamic ) );
+			sphFreeDynamicRow ( pMatches[1].m_pDynamic );
+			assert ( pMatches[1].m_pDynamic[0]==1 );
+			assert ( tInner.GetReservedBytes()>0 && tArena.GetReservedBytes()>tInner.GetReservedBytes() );
+		}
+
+		tArena.Detach ( pMatches, MATCHES );
+		for ( int i=0; i<MATCHES; i+=997 )
+			assert ( !tArena.Owns ( pMatches[i].m_pDynamic ) );
+	}
+
+	for ( int i=0; i<MATCHES; i+=997 )
+		for ( int j=0; j<1+i%7; j++ )
+			assert ( pMatches[i].m_pDynamic[j]==DWORD(i+j) );
+	SafeDeleteArray ( pMatches );
+
+	// no arena, plain heap rows
+	CSphMatch tHeap;
+	tHeap.Reset ( 5 );
+#ifndef NDEBUG
+	assert ( tHeap.m_pDynamic[-1]==5 );
+#endif
+
+	sphDoneMatchArena();
+	printf ( "ok\n" );
 }
 #endif
 
@@ -2187,6 +2267,200 @@ void TestStridedSort ()
 	assert ( dUniq1.GetLength()==2 && dUniq1[0]==1 && dUniq1[1]==3 );
 }
 
+void TestPackedSort ()
+{
+	printf ( "testing packed key sorter... " );
+
+	CSphColumnInfo tCol;
+	CSphSchema tSchema;
+	tCol.m_eAttrType = SPH_ATTR_INTEGER; tCol.m_sName = "u"; tSchema.AddAttr ( tCol, false );
+	tCol.m_eAttrType = SPH_ATTR_BIGINT; tCol.m_sName = "b"; tSchema.AddAttr ( tCol, false );
+	tCol.m_eAttrType = SPH_ATTR_FLOAT; tCol.m_sName = "f"; tSchema.AddAttr ( tCol, false );
+	tCol.m_eAttrType = SPH_ATTR_BOOL; tCol.m_sName = "t"; tSchema.AddAttr ( tCol, false );
+
+	// lots of duplicates, so that tie-breaks matter
+	const int COUNT = 500;
+	const int iStride = tSchema.GetRowSize();
+	CSphVector<CSphRowitem> dRows ( COUNT*iStride );
+	CSphMatch * pMatches = new CSphMatch [ COUNT ];
+	for ( int i=0; i<COUNT; i++ )
+	{
+		CSphMatch & tMatch = pMatches[i];
+		tMatch.m_uDocID = 1 + ( sphRand() % 100000 );
+		tMatch.m_iWeight = (int)( sphRand() % 5 ) - 2;
+		tMatch.m_pStatic = dRows.Begin() + i*iStride;
+
+		CSphRowitem * pRow = dRows.Begin() + i*iStride;
+		const float dFloats[] = { -1.5f, -0.0f, 0.0f, 2.5f, 1e9f };
+		sphSetRowAttr ( pRow, tSchema.GetAttr(0).m_tLocator, 0xfffffff0UL + sphRand()%16 );
+		sphSetRowAttr ( pRow, tSchema.GetAttr(1).m_tLocator, (SphAttr_t)( sphRand()%7 ) - 3 );
+		sphSetRowAttr ( pRow, tSchema.GetAttr(2).m_tLocator, sphF2DW ( dFloats [ sphRand()%5 ] ) );
+		sphSetRowAttr ( pRow, tSchema.GetAttr(3).m_tLocator, sphRand()%2 );
+	}
+
+	// k-buffer sorter never packs keys, so that is our reference
+	const char * dClauses[] = { "u DESC", "b ASC, f DESC", "f ASC, t DESC, @weight DESC", "t ASC, b DESC, u ASC, id DESC", "@weight ASC, b ASC" };
+	for ( int iClause=0; iClause<(int)(sizeof(dClauses)/sizeof(dClauses[0])); iClause++ )
+	{
+		CSphQueryResult dResults[2];
+		for ( int iPass=0; iPass<2; iPass++ )
+		{
+			CSphQuery tQuery;
+			tQuery.m_eSort = SPH_SORT_EXTENDED;
+			tQuery.m_sSortBy = dClauses[iClause];
+			tQuery.m_iMaxMatches = 50;
+			tQuery.m_bSortKbuffer = ( iPass==1 );
+
+			SphQueueSettings_t tQueueSettings ( tQuery, tSchema, dResults[iPass].m_sError, NULL );
+			tQueueSettings.m_bComputeItems = false;
+			ISphMatchSorter * pSorter = sphCreateQueue ( tQueueSettings );
+			assert ( pSorter );
+			for ( int i=0; i<COUNT; i++ )
+				pSorter->Push ( pMatches[i] );
+			sphFlattenQueue ( pSorter, &dResults[iPass], 0 );
+			SafeDelete ( pSorter );
+		}
+
+		assert ( dResults[0].m_dMatches.GetLength()==50 && dResults[1].m_dMatches.GetLength()==50 );
+		ARRAY_FOREACH ( i, dResults[0].m_dMatches )
+			assert ( dResults[0].m_dMatches[i].m_uDocID==dResults[1].m_dMatches[i].m_uDocID );
+	}
+
+	SafeDeleteArray ( pMatches );
+	printf ( "ok\n" );
+}
+
+
+struct EarlyStopCase_t
+{
+	const char *	m_sExpr;		///< select item aliased to the sort key, or NULL
+	const char *	m_sSortBy;
+	bool			m_bFullscan;
+	bool			m_bStop;		///< whether early stop is expected
+	bool			m_bDesc;
+};
+
+void TestEarlyStop ()
+{
+	printf ( "testing early stop on docid ordered attrs... " );
+
+	CSphColumnInfo tCol;
+	CSphSchema tSchema;
+	tCol.m_eAttrType = SPH_ATTR_INTEGER; tCol.m_sName = "ts"; tSchema.AddAttr ( tCol, false );
+	tCol.m_eAttrType = SPH_ATTR_INTEGER; tCol.m_sName = "v"; tSchema.AddAttr ( tCol, false );
+
+	CSphVector<DocidOrderedAttr_t> dOrdered;
+	dOrdered.Add().m_sName = "ts";
+	dOrdered.Add().m_sName = "id";
+	ARRAY_FOREACH ( i, dOrdered )
+		dOrdered[i].m_bValid = true;
+
+	// ts never decreases with docid, and has lots of ties
+	const int COUNT = 1000;
+	const int iStride = tSchema.GetRowSize();
+	CSphVector<CSphRowitem> dRows ( COUNT*iStride );
+	CSphMatch * pMatches = new CSphMatch [ COUNT ];
+	for ( int i=0; i<COUNT; i++ )
+	{
+		CSphMatch & tMatch = pMatches[i];
+		tMatch.m_uDocID = 1 + i;
+		tMatch.m_pStatic = dRows.Begin() + i*iStride;
+		sphSetRowAttr ( dRows.Begin() + i*iStride, tSchema.GetAttr(0).m_tLocator, 100 + i/7 );
+		sphSetRowAttr ( dRows.Begin() + i*iStride, tSchema.GetAttr(1).m_tLocator, sphRand()%50 );
+	}
+
+	const EarlyStopCase_t dCases[] =
+	{
+		{ NULL, "ts ASC", false, true, false },
+		{ NULL, "ts ASC, id DESC", false, true, false },
+		{ NULL, "ts DESC, id ASC", true, true, true },
+		{ NULL, "id DESC", true, true, true },
+		{ NULL, "ts DESC", false, true, true },
+		{ NULL, "ts ASC, @weight DESC", true, false, false },
+		{ NULL, "v ASC", true, false, false },
+		{ "0-id", "ts ASC", true, false, false },	// alias replaces the attribute, and goes the other way
+		{ "ts*2", "k ASC", true, false, false },
+	};
+
+	for ( int iCase=0; iCase<(int)(sizeof(dCases)/sizeof(dCases[0])); iCase++ )
+	{
+		const EarlyStopCase_t & tCase = dCases[iCase];
+
+		CSphQuery tQuery;
+		tQuery.m_eSort = SPH_SORT_EXTENDED;
+		tQuery.m_sSortBy = tCase.m_sSortBy;
+		tQuery.m_iMaxMatches = 20;
+		if ( !tCase.m_sExpr )
+			tQuery.m_dItems.Add().m_sExpr = "*";
+		else
+		{
+			CSphQueryItem & tItem = tQuery.m_dItems.Add();
+			tItem.m_sExpr = tCase.m_sExpr;
+			tItem.m_sAlias = strcmp ( tCase.m_sSortBy, "k ASC" ) ? "ts" : "k";
+		}
+
+		CSphQueryResult dResults[2];
+		for ( int iPass=0; iPass<2; iPass++ )
+		{
+			SphQueueSettings_t tQueueSettings ( tQuery, tSchema, dResults[iPass].m_sError, NULL );
+			ISphMatchSorter * pSorter = sphCreateQueue ( tQueueSettings );
+			assert ( pSorter );
+
+			bool bDesc = false;
+			bool bStop = sphCanStopEarly ( &tQuery, 1, &pSorter, dOrdered, tCase.m_bFullscan, bDesc );
+			assert ( bStop==tCase.m_bStop );
+			assert ( !bStop || bDesc==tCase.m_bDesc );
+
+			// no point pushing to the sorters that could not stop (and would need their expressions computed)
+			if ( !bStop )
+			{
+				SafeDelete ( pSorter );
+				break;
+			}
+
+			// first pass pushes everything, second one stops as search would, and must get the same top
+			for ( int i=0; i<COUNT; i++ )
+			{
+				const CSphMatch & tMatch = pMatches [ bDesc ? COUNT-1-i : i ];
+				if ( iPass==1 && pSorter->WouldReject ( tMatch ) )
+					break;
+				pSorter->Push ( tMatch );
+			}
+
+			sphFlattenQueue ( pSorter, &dResults[iPass], 0 );
+			SafeDelete ( pSorter );
+		}
+
+		if ( !tCase.m_bStop )
+			continue;
+
+		assert ( dResults[0].m_dMatches.GetLength()==20 && dResults[1].m_dMatches.GetLength()==20 );
+		ARRAY_FOREACH ( i, dResults[0].m_dMatches )
+			assert ( dResults[0].m_dMatches[i].m_uDocID==dResults[1].m_dMatches[i].m_uDocID );
+	}
+
+	// updated attribute is no longer trusted
+	{
+		CSphQuery tQuery;
+		tQuery.m_eSort = SPH_SORT_EXTENDED;
+		tQuery.m_sSortBy = "ts ASC";
+		tQuery.m_dItems.Add().m_sExpr = "*";
+
+		CSphString sError;
+		SphQueueSettings_t tQueueSettings ( tQuery, tSchema, sError, NULL );
+		ISphMatchSorter * pSorter = sphCreateQueue ( tQueueSettings );
+		assert ( pSorter );
+
+		bool bDesc = false;
+		sphInvalidateDocidOrderedAttr ( dOrdered, "ts" );
+		Verify ( !sphCanStopEarly ( &tQuery, 1, &pSorter, dOrdered, true, bDesc ) );
+		SafeDelete ( pSorter );
+	}
+
+	SafeDeleteArray ( pMatches );
+	printf ( "ok\n" );
+}
+
 //////////////////////////////////////////////////////////////////////////
 
 class SphTestDoc_c : public CSphSource_Document
@@ -2253,7 +2527,7 @@ static void DeleteIndexFiles ( const char * sIndex )
 		"kill", "lock", "meta", "ram",
 		"0.spa", "0.spd", "0.spe", "0.sph",
 		"0.spi", "0.spk", "0.spm", "0.spp",
-		"0.sps" };
+		"0.sps", "0.spds" };
 
 	CSphString sName;
 	for ( int i=0; i<(int)(sizeof(sExts)/sizeof(sExts[0])); i++ )
@@ -2576,6 +2850,134 @@ void TestRTSendVsMerge ()
 	DeleteIndexFiles ( RT_INDEX_FILE_NAME );
 }
 
+void TestRTDocidWindows ()
+{
+	DeleteIndexFiles ( RT_INDEX_FILE_NAME );
+	printf ( "testing rt docid windows from the tail... " );
+
+	TestRTInit ();
+
+	CSphString sError, sWarning;
+	CSphDictSettings tDictSettings;
+	tDictSettings.m_bWordDict = false;
+
+	ISphTokenizer * pTok = sphCreateUTF8Tokenizer();
+	CSphDict * pDict = sphCreateDictionaryCRC ( tDictSettings, NULL, pTok, "rt", sError );
+
+	CSphColumnInfo tCol;
+	CSphSchema tSrcSchema;
+
+	CSphSourceSettings tParams;
+	tSrcSchema.Reset();
+
+	tCol.m_sName = "title";
+	tSrcSchema.m_dFields.Add ( tCol );
+
+	tCol.m_sName = "content";
+	tSrcSchema.m_dFields.Add ( tCol );
+
+	tCol.m_sName = "tag1";
+	tCol.m_eAttrType = SPH_ATTR_INTEGER;
+	tSrcSchema.AddAttr ( tCol, true );
+
+	tCol.m_sName = "tag2";
+	tCol.m_eAttrType = SPH_ATTR_INTEGER;
+	tSrcSchema.AddAttr ( tCol, true );
+
+	SphDocRandomizer_c * pSrc = new SphDocRandomizer_c ( tSrcSchema );
+
+	pSrc->SetTokenizer ( pTok );
+	pSrc->SetDict ( pDict );
+
+	pSrc->Setup ( tParams );
+	Verify ( pSrc->Connect ( sError ) );
+	Verify ( pSrc->IterateStart ( sError ) );
+
+	Verify ( pSrc->UpdateSchema ( &tSrcSchema, sError ) );
+
+	CSphSchema tSchema; // source schema must be all dynamic attrs; but index ones must be static
+	tSchema.m_dFields = tSrcSchema.m_dFields;
+	for ( int i=0; i<tSrcSchema.GetAttrsCount(); i++ )
+		tSchema.AddAttr ( tSrcSchema.GetAttr(i), false );
+
+	ISphRtIndex * pIndex = sphCreateIndexRT ( tSchema, "testrt", 128*1024, RT_INDEX_FILE_NAME, false );
+
+	pIndex->SetTokenizer ( pTok ); // index will own this pair from now on
+	pIndex->SetDictionary ( pDict );
+	pIndex->m_dDocidOrderedAttrs.Add ( "id" );
+	pIndex->PostSetup();
+	Verify ( pIndex->Prealloc ( false, false, sError ) );
+
+	CSphVector<DWORD> dMvas;
+	for ( ;; )
+	{
+		Verify ( pSrc->IterateDocument ( sError ) );
+		if ( !pSrc->m_tDocInfo.m_uDocID )
+			break;
+
+		ISphHits * pHits = pSrc->IterateHits ( sError );
+		if ( !pHits )
+			break;
+
+		pIndex->AddDocument ( pHits, pSrc->m_tDocInfo, NULL, dMvas, sError, sWarning );
+	}
+	pIndex->Commit ();
+	pSrc->Disconnect();
+
+	// windows only work on disk chunks
+	pIndex->ForceDiskChunk();
+
+	// only the older docs pass the filter, so a few tail windows come up empty, and the ranker gets reset in between
+	// id tie-break on top of unique ids changes nothing but keeps the search from stopping early
+	const char * dSortBy[] = { "id DESC", "id DESC, @weight DESC" };
+	CSphQueryResult dResults[2];
+	int64_t dTotal[2];
+	for ( int iPass=0; iPass<2; iPass++ )
+	{
+		CSphQuery tQuery;
+		tQuery.m_sQuery = "cat";
+		tQuery.m_eMode = SPH_MATCH_EXTENDED2;
+		tQuery.m_eSort = SPH_SORT_EXTENDED;
+		tQuery.m_sSortBy = dSortBy[iPass];
+		tQuery.m_iMaxMatches = 10;
+
+		CSphFilterSettings & tFilter = tQuery.m_dFilters.Add();
+		tFilter.m_sAttrName = "@id";
+		tFilter.m_eType = SPH_FILTER_RANGE;
+		tFilter.m_iMinValue = 1;
+		tFilter.m_iMaxValue = 300;
+
+		CSphMultiQueryArgs tArgs ( KillListVector(), 1 );
+		SphQueueSettings_t tQueueSettings ( tQuery, pIndex->GetMatchSchema(), dResults[iPass].m_sError, NULL );
+		tQueueSettings.m_bComputeItems = false;
+		ISphMatchSorter * pSorter = sphCreateQueue ( tQueueSettings );
+		assert ( pSorter );
+		Verify ( pIndex->MultiQuery ( &tQuery, &dResults[iPass], 1, &pSorter, tArgs ) );
+		dTotal[iPass] = pSorter->GetTotalCount();
+		sphFlattenQueue ( pSorter, &dResults[iPass], 0 );
+		SafeDelete ( pSorter );
+	}
+
+	// windowed search stopped before it got to all the matching docs, yet found the same top
+	assert ( dTotal[1]==300 && dTotal[0]<dTotal[1] );
+	assert ( dResults[0].m_dMatches.GetLength()==10 && dResults[1].m_dMatches.GetLength()==10 );
+	ARRAY_FOREACH ( i, dResults[0].m_dMatches )
+	{
+		assert ( dResults[0].m_dMatches[i].m_uDocID==(SphDocID_t)( 300-i ) );
+		assert ( dResults[0].m_dMatches[i].m_uDocID==dResults[1].m_dMatches[i].m_uDocID );
+		assert ( dResults[0].m_dMatches[i].m_iWeight==dResults[1].m_dMatches[i].m_iWeight );
+	}
+
+	SafeDelete ( pIndex );
+	SafeDelete ( pSrc );
+
+	sphRTDone ();
+
+	printf ( "ok\n" );
+
+	DeleteIndexFiles ( RT_INDEX_FILE_NAME );
+}
+
 void TestRankerFactors ()
 {
 	const char * dFields[] = {
@@ -3041,6 +3443,823 @@ void TestWildcards()
 
 //////////////////////////////////////////////////////////////////////////
 
+void TestTrigramInfixes()
+{
+	printf ( "testing trigram infixes... " );
+
+	// dictionary order, mix of ascii, utf-8 and random words
+	CSphVector<CSphString> dWords;
+	const char * dFixed[] = { "ab", "abc", "abcabc", "bcd", "hello", "helloworld", "world", "\xd0\xbf\xd1\x80\xd0\xb8\xd0\xb2\xd0\xb5\xd1\x82",
+		"\xd0\xbf\xd1\x80\xd0\xbe", "caf\xc3\xa9", "\xc3\xa9t\xc3\xa9" };
+	for ( int i=0; i<(int)( sizeof(dFixed)/sizeof(dFixed[0]) ); i++ )
+		dWords.Add ( dFixed[i] );
+	for ( int i=0; i<2000; i++ )
+	{
+		char sWord[16];
+		int iLen = 1 + sphRand()%10;
+		for ( int j=0; j<iLen; j++ )
+			sWord[j] = (char)( 'a' + sphRand()%5 );
+		sWord[iLen] = '\0';
+		dWords.Add ( sWord );
+	}
+	dWords.Uniq();
+
+	TrigramInfixes_c tTrigrams;
+	ARRAY_FOREACH ( i, dWords )
+		tTrigrams.AddWord ( (const BYTE *)dWords[i].cstr(), dWords[i].Length(), i );
+	tTrigrams.Finish();
+	assert ( !tTrigrams.IsEmpty() );
+
+	// candidates must be a superset of the real infix matches, for every substring of every word
+	CSphVector<int> dCandidates;
+	int iChecked = 0;
+	ARRAY_FOREACH ( iWord, dWords )
+	{
+		const char * sWord = dWords[iWord].cstr();
+		int iLen = dWords[iWord].Length();
+		for ( int iStart=0; iStart<iLen; iStart++ )
+			for ( int iSub=1; iStart+iSub<=iLen && iSub<=6; iSub++ )
+			{
+				CSphString sSub;
+				sSub.SetBinary ( sWord+iStart, iSub );
+
+				bool bLookup = tTrigrams.GetCandidates ( (const BYTE *)sSub.cstr(), iSub, dCandidates );
+				assert ( bLookup==( iSub>=3 ) );
+				if ( !bLookup )
+				{
+					assert ( dCandidates.GetLength()==0 );
+					continue;
+				}
+
+				ARRAY_FOREACH ( i, dCandidates )
+				{
+					assert ( dCandidates[i]>=0 && dCandidates[i]<dWords.GetLength() );
+					assert ( !i || dCandidates[i-1]<dCandidates[i] );
+					assert ( !strcmp ( (const char *)tTrigrams.GetWord ( dCandidates[i] ), dWords[dCandidates[i]].cstr() ) );
+					assert ( tTrigrams.GetEntryOffset ( dCandidates[i] )==dCandidates[i] );
+				}
+
+				ARRAY_FOREACH ( i, dWords )
+					if ( strstr ( dWords[i].cstr(), sSub.cstr() ) )
+					{
+						Verify ( dCandidates.BinarySearch ( i ) );
+						iChecked++;
+					}
+			}
+	}
+	assert ( iChecked>0 );
+
+	// absent trigram, and utf-8 infixes shorter than 3 chars but not bytes
+	Verify ( tTrigrams.GetCandidates ( (const BYTE *)"xyz", 3, dCandidates ) );
+	assert ( dCandidates.GetLength()==0 );
+	Verify ( tTrigrams.GetCandidates ( (const BYTE *)"\xd0\xbf\xd1\x80", 4, dCandidates ) );
+	assert ( dCandidates.GetLength()==2 );
+	assert ( !tTrigrams.GetCandidates ( (const BYTE *)"\xc3\xa9", 2, dCandidates ) );
+
+	printf ( "ok\n" );
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+void TestExpansionCache()
+{
+	printf ( "testing expansion cache... " );
+
+	CSphExpansionCache tCache;
+	CSphString sKey ( "p0:0:abc*" );
+
+	ISphWordlist::Args_t tSrc ( false, 0, false, SPH_HITLESS_NONE, NULL );
+	tSrc.AddExpanded ( (const BYTE *)"abc", 3, 10, 20 );
+	tSrc.AddExpanded ( (const BYTE *)"abcdef", 6, 1, 2 );
+	tSrc.m_iTotalDocs = 11;
+	tSrc.m_iTotalHits = 22;
+
+	// disabled cache stores nothing
+	tCache.Store ( sKey, tCache.GetGeneration(), tSrc );
+	ISphWordlist::Args_t tMiss ( false, 0, false, SPH_HITLESS_NONE, NULL );
+	assert ( !tCache.Lookup ( sKey, tCache.GetGeneration(), tMiss ) );
+
+	tCache.SetMaxBytes ( 1024*1024 );
+	tCache.Store ( sKey, tCache.GetGeneration(), tSrc );
+
+	ISphWordlist::Args_t tHit ( false, 0, false, SPH_HITLESS_NONE, NULL );
+	assert ( tCache.Lookup ( sKey, tCache.GetGeneration(), tHit ) );
+	assert ( tHit.m_dExpanded.GetLength()==2 );
+	assert ( strcmp ( tHit.GetWordExpanded(0), "abc" )==0 );
+	assert ( strcmp ( tHit.GetWordExpanded(1), "abcdef" )==0 );
+	assert ( tHit.m_dExpanded[1].m_iDocs==1 && tHit.m_dExpanded[1].m_iHits==2 );
+	assert ( tHit.m_iTotalDocs==11 && tHit.m_iTotalHits==22 );
+
+	// stale generation neither hits nor stores
+	int iOldGen = tCache.GetGeneration();
+	tCache.Invalidate();
+	ISphWordlist::Args_t tStale ( false, 0, false, SPH_HITLESS_NONE, NULL );
+	assert ( !tCache.Lookup ( sKey, iOldGen, tStale ) );
+	tCache.Store ( sKey, iOldGen, tSrc );
+	assert ( !tCache.Lookup ( sKey, tCache.GetGeneration(), tStale ) );
+
+	// memory limit evicts least recently used entries
+	tCache.SetMaxBytes ( 1 );
+	tCache.Store ( sKey, tCache.GetGeneration(), tSrc );
+	CSphIndexStatus tStatus;
+	tCache.GetStatus ( &tStatus );
+	assert ( tStatus.m_iExpansionCacheBytes==0 );
+	assert ( tStatus.m_iExpansionCacheHits==1 );
+
+	printf ( "ok\n" );
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+void TestDocstore()
+{
+	printf ( "testing document storage... " );
+
+	// codec roundtrip on repetitive, random and mixed data of various lengths, including the empty one
+	CSphVector<BYTE> dSrc, dPacked, dUnpacked;
+#if USE_ZLIB
+	for ( int iPass=0; iPass<200; iPass++ )
+	{
+		int iLen = iPass<50 ? iPass : (int)( sphRand() % 70000 );
+		dSrc.Resize ( iLen );
+		for ( int i=0; i<iLen; i++ )
+			switch ( iPass%3 )
+			{
+				case 0:		dSrc[i] = (BYTE)"the quick brown fox "[i%20]; break;
+				case 1:		dSrc[i] = (BYTE)( sphRand() & 0xff ); break;
+				default:	dSrc[i] = ( i/1000 )%2 ? (BYTE)( sphRand() & 0xff ) : (BYTE)( i%7 ); break;
+			}
+
+		dPacked.Resize ( sphCompressBound ( iLen ) );
+		int iPacked = sphCompressBlock ( dSrc.Begin(), iLen, dPacked.Begin(), dPacked.GetLength() );
+		assert ( iLen ? iPacked>0 : iPacked==0 );
+		if ( !iPacked )
+			continue;
+
+		dUnpacked.Resize ( iLen );
+		Verify ( sphDecompressBlock ( dPacked.Begin(), iPacked, dUnpacked.Begin(), iLen ) );
+		assert ( memcmp ( dSrc.Begin(), dUnpacked.Begin(), iLen )==0 );
+
+		// truncated data, or a wrong expected length must be rejected
+		assert ( !sphDecompressBlock ( dPacked.Begin(), iPacked/2, dUnpacked.Begin(), iLen ) );
+		dUnpacked.Resize ( iLen+1 );
+		assert ( !sphDecompressBlock ( dPacked.Begin(), iPacked, dUnpacked.Begin(), iLen+1 ) );
+	}
+
+	// repetitive data must actually shrink
+	dSrc.Resize ( 50000 );
+	for ( int i=0; i<dSrc.GetLength(); i++ )
+		dSrc[i] = (BYTE)"the quick brown fox "[i%20];
+	dPacked.Resize ( sphCompressBound ( dSrc.GetLength() ) );
+	assert ( sphCompressBlock ( dSrc.Begin(), dSrc.GetLength(), dPacked.Begin(), dPacked.GetLength() )<dSrc.GetLength()/10 );
+#endif
+
+	// write enough documents to span several blocks
+	const char * sFile = "__docstore.spds";
+	const int DOCS = 3000;
+	CSphVector<CSphString> dFields;
+	dFields.Add ( "title" );
+	dFields.Add ( "body" );
+
+	CSphString sError;
+	CSphDocstoreWriter tWriter;
+	Verify ( tWriter.Open ( sFile, dFields, sError ) );
+	for ( int i=1; i<=DOCS; i++ )
+	{
+		CSphString sTitle, sBody;
+		sTitle.SetSprintf ( "title %d", i );
+		sBody.SetSprintf ( "body of document %d goes here", i*3 );
+		dPacked.Resize ( 0 );
+		sphDocstorePackField ( dPacked, (const BYTE*)sTitle.cstr(), sTitle.Length() );
+		sphDocstorePackField ( dPacked, (const BYTE*)sBody.cstr(), sBody.Length() );
+		tWriter.AddDoc ( i*2, dPacked.Begin(), dPacked.GetLength() );
+	}
+	Verify ( tWriter.Finish ( sError ) );
+
+	CSphDocstore tStore;
+	Verify ( tStore.Load ( sFile, sError ) );
+	assert ( tStore.GetBlocksCount()>1 );
+	assert ( tStore.GetFieldIndex ( "body" )==1 );
+	assert ( tStore.GetFieldIndex ( "nope" )==-1 );
+
+	// random access, twice to go through the block cache
+	BYTE * pData = NULL;
+	int iLen = 0;
+	for ( int iPass=0; iPass<2; iPass++ )
+		for ( int i=1; i<=DOCS; i+=97 )
+		{
+			CSphString sBody;
+			sBody.SetSprintf ( "body of document %d goes here", i*3 );
+			Verify ( tStore.GetField ( i*2, 1, &pData, &iLen ) );
+			assert ( iLen==sBody.Length() && strcmp ( (const char*)pData, sBody.cstr() )==0 );
+			SafeDeleteArray ( pData );
+			assert ( !tStore.GetField ( i*2+1, 1, &pData, &iLen ) && !pData );
+		}
+	assert ( !tStore.GetField ( 0, 0, &pData, &iLen ) );
+	assert ( !tStore.GetField ( DOCS*2+2, 0, &pData, &iLen ) );
+
+	// sequential scan
+	int iDocs = 0;
+	CSphDocstoreIterator tIt ( tStore );
+	while ( tIt.Next() )
+	{
+		iDocs++;
+		assert ( tIt.m_uDocid==SphDocID_t ( iDocs*2 ) );
+	}
+	assert ( iDocs==DOCS );
+	tStore.Reset();
+
+	// corrupted raw length of the 1st block (right after the header) must fail the lookup, not allocate
+	FILE * fp = fopen ( sFile, "r+b" );
+	assert ( fp );
+	DWORD uBadLen = 0xfffffff0UL;
+	Verify ( fseek ( fp, 4*sizeof(DWORD) + sizeof(DWORD)+strlen("title") + sizeof(DWORD)+strlen("body"), SEEK_SET )==0 );
+	Verify ( fwrite ( &uBadLen, sizeof(uBadLen), 1, fp )==1 );
+	fclose ( fp );
+
+	Verify ( tStore.Load ( sFile, sError ) );
+	assert ( !tStore.GetField ( 2, 1, &pData, &iLen ) );
+	Verify ( tStore.GetField ( DOCS*2, 1, &pData, &iLen ) );
+	SafeDeleteArray ( pData );
+
+	tStore.Reset();
+	unlink ( sFile );
+	printf ( "ok\n" );
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+/// build a bag of words excerpt of the document
+void BuildTestExcerpt ( const CSphIndex * pIndex, const CSphString & sDoc, const char * sWords, int iLimit, int iAround, int iPassages,
+	bool bWeightOrder, CSphVector<BYTE> & dRes )
+{
+	ExcerptQuery_t tQuery;
+	tQuery.m_sSource = sDoc;
+	tQuery.m_sWords = sWords;
+	tQuery.m_iLimit = iLimit;
+	tQuery.m_iAround = iAround;
+	tQuery.m_iLimitPassages = iPassages;
+	tQuery.m_bWeightOrder = bWeightOrder;
+
+	CSphString sError, sWarning;
+	SnippetContext_t tCtx;
+	Verify ( tCtx.Setup ( pIndex, tQuery, sError ) );
+	sphBuildExcerpt ( tQuery, pIndex, tCtx.m_tStripper.Ptr(), tCtx.m_tExtQuery, tCtx.m_eExtQuerySPZ,
+		sWarning, sError, tCtx.m_pDict, tCtx.m_tTokenizer.Ptr(), tCtx.m_pQueryTokenizer );
+	assert ( sError.IsEmpty() );
+	dRes.SwapData ( tQuery.m_dRes );
+}
+
+void TestExcerptSlices()
+{
+	printf ( "testing sliced excerpts... " );
+
+	CSphString sError;
+	CSphDictSettings tDictSettings;
+	ISphTokenizer * pTok = sphCreateUTF8Tokenizer();
+	CSphDict * pDict = sphCreateDictionaryCRC ( tDictSettings, NULL, pTok, "excerpt", sError );
+
+	CSphIndex * pIndex = sphCreateIndexPhrase ( "excerpt", "__excerpt" );
+	pIndex->SetTokenizer ( pTok ); // index will own this pair from now on
+	pIndex->SetDictionary ( pDict );
+	pIndex->PostSetup();
+
+	// large enough to be split into several slices; keywords all over the document, thicker in a few spots
+	CSphVector<char> dDoc;
+	const char * dKeywords[] = { "alpha", "beta", "gamma" };
+	while ( dDoc.GetLength()<600*1024 )
+	{
+		char sWord[32];
+		int iRand = sphRand()%1000;
+		int iSpot = ( dDoc.GetLength()/1024 )%150;
+		if ( iRand<3 || ( iSpot==7 && iRand<100 ) )
+			snprintf ( sWord, sizeof(sWord), "%s ", dKeywords[iRand%3] );
+		else
+			snprintf ( sWord, sizeof(sWord), "%sw%d ", ( iRand%37 ) ? "" : ". ", iRand%500 );
+		int iLen = strlen ( sWord );
+		memcpy ( dDoc.AddN ( iLen ), sWord, iLen );
+	}
+	dDoc.Add ( '\0' );
+	CSphString sDoc = dDoc.Begin();
+
+	const char * dWords[] = { "alpha", "beta gamma", "alpha gamma w1", "nomatch" };
+	for ( int iCase=0; iCase<16; iCase++ )
+	{
+		const char * sWords = dWords[iCase%4];
+		int iLimit = ( iCase/4 )%2 ? 1024 : 256;
+		int iAround = ( iCase/8 ) ? 2 : 5;
+		int iPassages = ( iCase%3 ) ? 0 : 3;
+		bool bWeightOrder = ( iCase%2 )!=0;
+
+		CSphVector<BYTE> dRes[2];
+		for ( int iPass=0; iPass<2; iPass++ )
+		{
+			sphSetSnippetThreads ( iPass ? 4 : 0 );
+			BuildTestExcerpt ( pIndex, sDoc, sWords, iLimit, iAround, iPassages, bWeightOrder, dRes[iPass] );
+		}
+		assert ( dRes[0].GetLength()==dRes[1].GetLength() && !memcmp ( dRes[0].Begin(), dRes[1].Begin(), dRes[0].GetLength() ) );
+		assert ( iCase%4==3 || strstr ( (const char *)dRes[0].Begin(), "<b>" ) );
+	}
+	sphSetSnippetThreads ( 0 );
+
+	SafeDelete ( pIndex );
+	printf ( "ok\n" );
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+void TestJsonKeyDir()
+{
+	printf ( "testing JSON key directory... " );
+
+	// large root and large nested object get a key directory; small ones keep the old format
+	CSphString sJson = "{\"k0\":0";
+	for ( int i=1; i<40; i++ )
+		sJson.SetSprintf ( "%s,\"k%d\":%d", sJson.cstr(), i, i );
+	sJson.SetSprintf ( "%s,\"k7\":777,\"sub\":%s},\"small\":{\"a\":1}}", sJson.cstr(), sJson.cstr() );
+
+	CSphVector<char> dSrc ( sJson.Length()+2 );
+	memcpy ( dSrc.Begin(), sJson.cstr(), sJson.Length() );
+	dSrc[sJson.Length()] = dSrc[sJson.Length()+1] = '\0';
+
+	CSphString sError;
+	CSphVector<BYTE> dBson;
+	Verify ( sphJsonParse ( dBson, dSrc.Begin(), false, false, sError ) );
+
+	const BYTE * pRoot = dBson.Begin();
+	ESphJsonType eRoot = sphJsonFindFirst ( &pRoot );
+	assert ( eRoot==JSON_OBJECT );
+	assert ( sphJsonFieldLength ( eRoot, pRoot )==43 );
+
+	int iSlot = -1;
+	for ( int iPass=0; iPass<2; iPass++ )
+		for ( int i=0; i<40; i++ )
+		{
+			CSphString sKey;
+			sKey.SetSprintf ( "k%d", i );
+			const BYTE * p = pRoot;
+			ESphJsonType eType = sphJsonFindByKey ( eRoot, &p, sKey.cstr(), sKey.Length(), sphJsonKeyMask ( sKey.cstr(), sKey.Length() ),
+				sphCRC32 ( sKey.cstr(), sKey.Length() ), &iSlot );
+			assert ( eType==JSON_INT32 && sphJsonLoadInt ( &p )==i ); // duplicate k7 must resolve to the first one
+			(void)eType;
+		}
+
+	const BYTE * p = pRoot;
+	assert ( sphJsonFindByKey ( eRoot, &p, "nope", 4, sphJsonKeyMask ( "nope", 4 ) )==JSON_EOF );
+	ESphJsonType eSub = sphJsonFindByKey ( eRoot, &p, "sub", 3, sphJsonKeyMask ( "sub", 3 ) );
+	assert ( eSub==JSON_OBJECT );
+	const BYTE * pSub = p;
+	assert ( sphJsonFindByKey ( eSub, &p, "k39", 3, sphJsonKeyMask ( "k39", 3 ) )==JSON_INT32 && sphJsonLoadInt ( &p )==39 );
+
+	// formatting must skip directories and roundtrip
+	CSphVector<BYTE> dOut;
+	sphJsonFormat ( dOut, dBson.Begin() );
+	assert ( dOut.GetLength()==sJson.Length() && !memcmp ( dOut.Begin(), sJson.cstr(), dOut.GetLength() ) );
+	assert ( sphJsonFieldLength ( eSub, pSub )==40 );
+	(void)eSub;
+	(void)pSub;
+
+	printf ( "ok\n" );
+}
+
+
+/// candidates of JSON secondary indexes must cover every row that passes the filters in a full-scan
+/// returns false if the indexes do not serve the query, or miss a row
+bool JsonIndexCoversFullscan ( const CSphVector<CSphJsonIndex> & dIndexes, const CSphQuery & tQuery, const CSphSchema & tSchema,
+	const CSphVector<CSphRowitem> & dRows, int iStride, const CSphVector<BYTE> & dStrings )
+{
+	CSphVector<DWORD> dCandidates;
+	if ( !sphJsonIndexCandidates ( dIndexes, &tQuery, dCandidates ) )
+		return false;
+
+	CSphVector<ISphFilter *> dFilters;
+	ARRAY_FOREACH ( i, tQuery.m_dFilters )
+	{
+		CSphString sError;
+		dFilters.Add ( sphCreateFilter ( tQuery.m_dFilters[i], tSchema, NULL, dStrings.Begin(), sError, tQuery.m_eCollation, false ) );
+		assert ( dFilters.Last() );
+	}
+
+	bool bCovered = true;
+	int iRows = dRows.GetLength()/iStride;
+	for ( int iRow=0; iRow<iRows && bCovered; iRow++ )
+	{
+		CSphMatch tMatch;
+		tMatch.m_uDocID = DOCINFO2ID ( dRows.Begin() + iRow*iStride );
+		tMatch.m_pStatic = DOCINFO2ATTRS ( dRows.Begin() + iRow*iStride );
+
+		bool bPass = true;
+		ARRAY_FOREACH_COND ( i, dFilters, bPass )
+			bPass = dFilters[i]->Eval ( tMatch );
+		if ( bPass && !dCandidates.BinarySearch ( (DWORD)iRow ) )
+			bCovered = false;
+		tMatch.m_pStatic = NULL;
+	}
+
+	ARRAY_FOREACH ( i, dFilters )
+		SafeDelete ( dFilters[i] );
+	return bCovered;
+}
+
+void TestJsonIndexes()
+{
+	printf ( "testing JSON secondary indexes... " );
+
+	CSphColumnInfo tCol;
+	CSphSchema tSchema;
+	tCol.m_eAttrType = SPH_ATTR_INTEGER; tCol.m_sName = "gid"; tSchema.AddAttr ( tCol, false );
+	tCol.m_eAttrType = SPH_ATTR_JSON; tCol.m_sName = "j"; tSchema.AddAttr ( tCol, false );
+	const CSphAttrLocator & tLoc = tSchema.GetAttr(1).m_tLocator;
+
+	// rows in docinfo format; missing values, keys of other types and mixed case strings
+	const int ROWS = 500;
+	const int iStride = DOCINFO_IDSIZE + tSchema.GetRowSize();
+	CSphVector<CSphRowitem> dRows ( ROWS*iStride );
+	dRows.Fill ( 0 );
+	CSphVector<BYTE> dStrings;
+	dStrings.Add ( 0 );
+	for ( int i=0; i<ROWS; i++ )
+	{
+		CSphRowitem * pRow = dRows.Begin() + i*iStride;
+		DOCINFOSETID ( pRow, (SphDocID_t)( 1+i ) );
+		if ( i%10==0 )
+			continue;
+
+		CSphString sJson, sError;
+		if ( i%10==1 )
+			sJson = "{\"name\":\"none\"}";
+		else if ( i%13==0 )
+			sJson.SetSprintf ( "{\"cat\":\"%d\", \"price\":\"cheap\"}", i%7 );
+		else
+			sJson.SetSprintf ( "{\"cat\":%d, \"price\":%d.5, \"name\":\"%s%d\", \"sub\":{\"v\":%d}}",
+				i%7, i%40, ( i%2 ) ? "ITEM" : "item", i%5, -( i%4 ) );
+
+		CSphVector<BYTE> dJson;
+		Verify ( sphJsonParse ( dJson, (char*)sJson.cstr(), false, false, sError ) );
+		int iOff = dStrings.GetLength();
+		sphSetRowAttr ( DOCINFO2ATTRS ( pRow ), tLoc, iOff );
+		dStrings.Resize ( iOff+4+dJson.GetLength() );
+		dStrings.Resize ( iOff + sphPackStrlen ( dStrings.Begin()+iOff, dJson.GetLength() ) + dJson.GetLength() );
+		memcpy ( dStrings.Begin()+dStrings.GetLength()-dJson.GetLength(), dJson.Begin(), dJson.GetLength() );
+	}
+
+	CSphVector<CSphString> dPaths;
+	dPaths.Add ( "j.cat" );
+	dPaths.Add ( "j.price" );
+	dPaths.Add ( "j.sub.v" );
+	dPaths.Add ( "J.name" );
+	dPaths.Add ( "gid.x" );
+	dPaths.Add ( "j" );
+
+	CSphString sWarning;
+	CSphVector<CSphJsonIndex> dIndexes;
+	sphBuildJsonIndexes ( dIndexes, dPaths, tSchema, dRows.Begin(), ROWS, iStride, dStrings.Begin(), sWarning );
+	assert ( dIndexes.GetLength()==4 && !sWarning.IsEmpty() );
+
+	// every query here is served by the indexes
+	for ( int iQuery=0; iQuery<8; iQuery++ )
+	{
+		CSphQuery tQuery;
+		CSphFilterSettings & tFilter = tQuery.m_dFilters.Add();
+		switch ( iQuery )
+		{
+		case 0:
+			tFilter.m_sAttrName = "j.cat";
+			tFilter.m_eType = SPH_FILTER_VALUES;
+			tFilter.m_dValues.Add ( 3 );
+			tFilter.m_dValues.Add ( 5 );
+			break;
+		case 1:
+			tFilter.m_sAttrName = "j.cat";
+			tFilter.m_eType = SPH_FILTER_RANGE;
+			tFilter.m_iMinValue = 2;
+			tFilter.m_iMaxValue = 4;
+			break;
+		case 2:
+			tFilter.m_sAttrName = "j.price";
+			tFilter.m_eType = SPH_FILTER_RANGE;
+			tFilter.m_iMinValue = 10;
+			tFilter.m_iMaxValue = 20;
+			break;
+		case 3:
+			tFilter.m_sAttrName = "j.sub.v";
+			tFilter.m_eType = SPH_FILTER_VALUES;
+			tFilter.m_dValues.Add ( -2 );
+			break;
+		case 4:
+			tFilter.m_sAttrName = "j.sub.v";
+			tFilter.m_eType = SPH_FILTER_RANGE;
+			tFilter.m_iMinValue = -3;
+			tFilter.m_iMaxValue = -1;
+			break;
+		case 5:
+		case 6:
+			tFilter.m_sAttrName = "j.name";
+			tFilter.m_eType = SPH_FILTER_STRING;
+			tFilter.m_sRefString = "item3";
+			tQuery.m_eCollation = ( iQuery==5 ) ? SPH_COLLATION_LIBC_CI : SPH_COLLATION_BINARY;
+			break;
+		case 7:
+			{
+				// ANDed filters intersect, including the ones no index serves
+				tFilter.m_sAttrName = "j.cat";
+				tFilter.m_eType = SPH_FILTER_VALUES;
+				tFilter.m_dValues.Add ( 1 );
+				tFilter.m_dValues.Add ( 2 );
+				CSphFilterSettings & tName = tQuery.m_dFilters.Add();
+				tName.m_sAttrName = "j.name";
+				tName.m_eType = SPH_FILTER_STRING;
+				tName.m_sRefString = "ITEM2";
+				CSphFilterSettings & tGid = tQuery.m_dFilters.Add();
+				tGid.m_sAttrName = "gid";
+				tGid.m_eType = SPH_FILTER_VALUES;
+				tGid.m_dValues.Add ( 0 );
+				break;
+			}
+		}
+		assert ( JsonIndexCoversFullscan ( dIndexes, tQuery, tSchema, dRows, iStride, dStrings ) );
+	}
+
+	// filters that indexes can not serve
+	CSphQuery tQuery;
+	CSphVector<DWORD> dCandidates;
+	CSphFilterSettings & tFilter = tQuery.m_dFilters.Add();
+	tFilter.m_sAttrName = "j.cat";
+	tFilter.m_eType = SPH_FILTER_VALUES;
+	tFilter.m_dValues.Add ( 6 );
+	tFilter.m_bExclude = true;
+	assert ( !sphJsonIndexCandidates ( dIndexes, &tQuery, dCandidates ) );
+	tFilter.m_bExclude = false;
+	tFilter.m_sAttrName = "j.sub";
+	assert ( !sphJsonIndexCandidates ( dIndexes, &tQuery, dCandidates ) );
+	tFilter.m_sAttrName = "j.cat";
+	assert ( JsonIndexCoversFullscan ( dIndexes, tQuery, tSchema, dRows, iStride, dStrings ) );
+
+	// in-place update of row 3 from cat 3 to 6; the index no longer covers it until invalidated
+	const BYTE * pVal = NULL;
+	sphUnpackStr ( dStrings.Begin() + sphGetRowAttr ( DOCINFO2ATTRS ( dRows.Begin() + 3*iStride ), tLoc ), &pVal );
+	ESphJsonType eType = sphJsonFindFirst ( &pVal );
+	eType = sphJsonFindByKey ( eType, &pVal, "cat", 3, sphJsonKeyMask ( "cat", 3 ) );
+	assert ( eType==JSON_INT32 );
+	(void)eType;
+	int iNew = 6;
+	memcpy ( const_cast<BYTE *> ( pVal ), &iNew, sizeof(iNew) );
+
+	assert ( !JsonIndexCoversFullscan ( dIndexes, tQuery, tSchema, dRows, iStride, dStrings ) );
+	sphInvalidateJsonIndexes ( dIndexes, "gid" );
+	assert ( sphJsonIndexCandidates ( dIndexes, &tQuery, dCandidates ) );
+	sphInvalidateJsonIndexes ( dIndexes, "J.cat" );
+	assert ( !sphJsonIndexCandidates ( dIndexes, &tQuery, dCandidates ) );
+	tFilter.m_sAttrName = "j.price";
+	assert ( !sphJsonIndexCandidates ( dIndexes, &tQuery, dCandidates ) );
+
+	printf ( "ok\n" );
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+bool ColumnarMatchesEqual ( const CSphSchema & tSchema, const CSphMatch & tSrc, const CSphVector<DWORD> & dMva, const CSphVector<BYTE> & dStrings,
+	const CSphMatch & tOut, const CSphVector<DWORD> & dOutMva, const CSphVector<BYTE> & dOutStrings )
+{
+	if ( tSrc.m_uDocID!=tOut.m_uDocID || tSrc.m_iWeight!=tOut.m_iWeight )
+		return false;
+
+	for ( int j=0; j<tSchema.GetAttrsCount(); j++ )
+	{
+		const CSphAttrLocator & tLoc = tSchema.GetAttr(j).m_tLocator;
+		SphAttr_t uSrc = tSrc.GetAttr ( tLoc );
+		SphAttr_t uOut = tOut.GetAttr ( tLoc );
+
+		switch ( tSchema.GetAttr(j).m_eAttrType )
+		{
+		case SPH_ATTR_UINT32SET:
+		case SPH_ATTR_INT64SET:
+			{
+				const DWORD * pSrc = tSrc.GetAttrMVA ( tLoc, dMva.Begin(), true );
+				const DWORD * pOut = tOut.GetAttrMVA ( tLoc, dOutMva.Begin(), true );
+				DWORD uValues = pSrc ? *pSrc : 0;
+				if ( uValues!=( pOut ? *pOut : 0 ) || ( uValues && memcmp ( pSrc+1, pOut+1, uValues*sizeof(DWORD) ) ) )
+					return false;
+				break;
+			}
+
+		case SPH_ATTR_STRING:
+		case SPH_ATTR_JSON:
+			{
+				const BYTE * pSrc = NULL;
+				const BYTE * pOut = NULL;
+				int iSrcLen = uSrc ? sphUnpackStr ( dStrings.Begin()+uSrc, &pSrc ) : 0;
+				int iOutLen = uOut ? sphUnpackStr ( dOutStrings.Begin()+uOut, &pOut ) : 0;
+				if ( iSrcLen!=iOutLen || ( iSrcLen && memcmp ( pSrc, pOut, iSrcLen ) ) )
+					return false;
+				break;
+			}
+
+		case SPH_ATTR_JSON_FIELD:
+			if ( ( uSrc>>32 )!=( uOut>>32 ) || !(DWORD)uSrc!=!(DWORD)uOut )
+				return false;
+			if ( (DWORD)uSrc && memcmp ( dStrings.Begin()+(DWORD)uSrc, dOutStrings.Begin()+(DWORD)uOut, 4 ) ) // int32 nodes only
+				return false;
+			break;
+
+		case SPH_ATTR_STRINGPTR:
+			if ( !uSrc!=!uOut || ( uSrc && strcmp ( (const char*)uSrc, (const char*)uOut ) ) )
+				return false;
+			break;
+
+		default:
+			if ( uSrc!=uOut )
+				return false;
+			break;
+		}
+	}
+	return true;
+}
+
+
+void TestColumnar()
+{
+	printf ( "testing columnar result sets... " );
+
+	CSphColumnInfo tCol;
+	CSphSchema tSchema;
+	tCol.m_eAttrType = SPH_ATTR_INTEGER; tCol.m_sName = "u"; tSchema.AddAttr ( tCol, true );
+	tCol.m_eAttrType = SPH_ATTR_BIGINT; tCol.m_sName = "b"; tSchema.AddAttr ( tCol, true );
+	tCol.m_eAttrType = SPH_ATTR_FLOAT; tCol.m_sName = "f"; tSchema.AddAttr ( tCol, true );
+	tCol.m_eAttrType = SPH_ATTR_UINT32SET; tCol.m_sName = "m"; tSchema.AddAttr ( tCol, true );
+	tCol.m_eAttrType = SPH_ATTR_INT64SET; tCol.m_sName = "m64"; tSchema.AddAttr ( tCol, true );
+	tCol.m_eAttrType = SPH_ATTR_STRING; tCol.m_sName = "s"; tSchema.AddAttr ( tCol, true );
+	tCol.m_eAttrType = SPH_ATTR_JSON; tCol.m_sName = "j"; tSchema.AddAttr ( tCol, true );
+	tCol.m_eAttrType = SPH_ATTR_JSON_FIELD; tCol.m_sName = "jf"; tSchema.AddAttr ( tCol, true );
+	tCol.m_eAttrType = SPH_ATTR_STRINGPTR; tCol.m_sName = "sp"; tSchema.AddAttr ( tCol, true );
+
+	// source pools; offset 0 means null in both
+	CSphVector<DWORD> dMva;
+	CSphVector<BYTE> dStrings;
+	dMva.Add ( 0 );
+	dStrings.Add ( 0 );
+
+	const char * dWords[] = { "alpha", "beta", "gamma" };
+	CSphVector<SphAttr_t> dStrOffsets, dJsonOffsets, dNodeOffsets;
+	for ( int i=0; i<3; i++ )
+	{
+		dStrOffsets.Add ( dStrings.GetLength() );
+		int iLen = strlen ( dWords[i] );
+		int iOff = dStrings.GetLength();
+		dStrings.Resize ( iOff+4+iLen );
+		dStrings.Resize ( iOff + sphPackStrlen ( dStrings.Begin()+iOff, iLen ) + iLen );
+		memcpy ( dStrings.Begin()+dStrings.GetLength()-iLen, dWords[i], iLen );
+
+		CSphString sJson, sError;
+		sJson.SetSprintf ( "{\"name\":\"%s\", \"tags\":[%d,%d]}", dWords[i], i, i*i );
+		CSphVector<BYTE> dJson;
+		Verify ( sphJsonParse ( dJson, (char*)sJson.cstr(), false, false, sError ) );
+		dJsonOffsets.Add ( dStrings.GetLength() );
+		iOff = dStrings.GetLength();
+		dStrings.Resize ( iOff+4+dJson.GetLength() );
+		dStrings.Resize ( iOff + sphPackStrlen ( dStrings.Begin()+iOff, dJson.GetLength() ) + dJson.GetLength() );
+		memcpy ( dStrings.Begin()+dStrings.GetLength()-dJson.GetLength(), dJson.Begin(), dJson.GetLength() );
+
+		// int32 json field nodes
+		dNodeOffsets.Add ( dStrings.GetLength() | ( ( (int64_t)JSON_INT32 )<<32 ) );
+		int iValue = 1000*i - 1;
+		dStrings.Resize ( dStrings.GetLength()+4 );
+		memcpy ( dStrings.Begin()+dStrings.GetLength()-4, &iValue, 4 );
+	}
+
+	const int COUNT = 300;
+	CSphMatch * pSrc = new CSphMatch [ COUNT ];
+	for ( int i=0; i<COUNT; i++ )
+	{
+		CSphMatch & tMatch = pSrc[i];
+		tMatch.Reset ( tSchema.GetRowSize() );
+		tMatch.m_uDocID = ( i%50 ) ? 1000+i*3 : 1000000-i;
+		tMatch.m_iWeight = (int)( sphRand() % 3000 ) - 1000;
+		tMatch.m_iTag = 0;
+		tMatch.SetAttr ( tSchema.GetAttr(0).m_tLocator, sphRand() );
+		tMatch.SetAttr ( tSchema.GetAttr(1).m_tLocator, ( i%2 ? -1 : 1 ) * (int64_t)sphRand() * sphRand() );
+		tMatch.SetAttr ( tSchema.GetAttr(2).m_tLocator, sphF2DW ( i*0.25f - 10.0f ) );
+
+		// mva, with some empty values
+		int iValues = i%4;
+		tMatch.SetAttr ( tSchema.GetAttr(3).m_tLocator, iValues ? dMva.GetLength() : 0 );
+		if ( iValues )
+		{
+			dMva.Add ( iValues );
+			for ( int k=0; k<iValues; k++ )
+				dMva.Add ( 100*k + i );
+		}
+		tMatch.SetAttr ( tSchema.GetAttr(4).m_tLocator, iValues ? dMva.GetLength() : 0 );
+		if ( iValues )
+		{
+			dMva.Add ( 2*iValues );
+			for ( int k=0; k<iValues; k++ )
+			{
+				uint64_t uValue = ( (uint64_t)k<<40 ) + i;
+				dMva.Add ( (DWORD)uValue );
+				dMva.Add ( (DWORD)( uValue>>32 ) );
+			}
+		}
+
+		// repeating strings, json and json fields, with nulls
+		tMatch.SetAttr ( tSchema.GetAttr(5).m_tLocator, ( i%5 ) ? dStrOffsets[i%3] : 0 );
+		tMatch.SetAttr ( tSchema.GetAttr(6).m_tLocator, ( i%7 ) ? dJsonOffsets[i%3] : 0 );
+		tMatch.SetAttr ( tSchema.GetAttr(7).m_tLocator, ( i%6 ) ? dNodeOffsets[i%3] : 0 );
+		tMatch.SetAttr ( tSchema.GetAttr(8).m_tLocator, ( i%4 ) ? (SphAttr_t)dWords[i%3] : 0 );
+	}
+
+	CSphTaggedVector dTag2Pools;
+	dTag2Pools.Resize ( 1 );
+	dTag2Pools[0].m_pMva = dMva.Begin();
+	dTag2Pools[0].m_pStrings = dStrings.Begin();
+	dTag2Pools[0].m_bArenaProhibit = true;
+
+	for ( int iPass=0; iPass<2; iPass++ )
+	{
+		// full result set, then an empty one
+		int iCount = iPass ? 0 : COUNT;
+		CSphVector<BYTE> dBlock;
+		sphEncodeColumnar ( dBlock, pSrc, iCount, tSchema, tSchema.GetAttrsCount(), dTag2Pools );
+		assert ( iCount || !dBlock.GetLength() );
+
+		CSphVector<DWORD> dOutMva;
+		CSphVector<BYTE> dOutStrings;
+		dOutMva.Add ( 0 );
+		dOutStrings.Add ( 0 );
+		CSphMatch * pOut = new CSphMatch [ iCount ];
+		Verify ( sphDecodeColumnar ( dBlock.Begin(), dBlock.GetLength(), pOut, iCount, tSchema, dOutMva, dOutStrings ) );
+
+		for ( int i=0; i<iCount; i++ )
+			assert ( ColumnarMatchesEqual ( tSchema, pSrc[i], dMva, dStrings, pOut[i], dOutMva, dOutStrings ) );
+
+		// truncated block must be rejected
+		if ( !iPass )
+		{
+			for ( int i=0; i<COUNT; i++ )
+				tSchema.FreeStringPtrs ( &pOut[i] );
+			Verify ( !sphDecodeColumnar ( dBlock.Begin(), dBlock.GetLength()-1, pOut, iCount, tSchema, dOutMva, dOutStrings ) );
+		}
+
+		for ( int i=0; i<iCount; i++ )
+			tSchema.FreeStringPtrs ( &pOut[i] );
+		SafeDeleteArray ( pOut );
+	}
+
+	// source string pointers are static, and must not be freed
+	SafeDeleteArray ( pSrc );
+
+	printf ( "ok\n" );
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+void TestDeadRows()
+{
+	printf ( "testing dead rows map... " );
+
+	const DWORD ROWS = 200000;
+	CSphDeadRows * pEmpty = new CSphDeadRows();
+	assert ( pEmpty->GetDead()==0 && pEmpty->GetLengthBytes()==0 && !pEmpty->IsDead ( 0 ) );
+	assert ( !pEmpty->Kill ( NULL, 0 ) );
+
+	// sparse kills only allocate the (array) pages they touch
+	DWORD dSparse[] = { 0, 31, 32, 32, ROWS-1 };
+	CSphDeadRows * pSparse = pEmpty->Kill ( dSparse, sizeof(dSparse)/sizeof(dSparse[0]) );
+	assert ( pSparse && pSparse->GetDead()==4 );
+	assert ( pSparse->GetLengthBytes()<256 );
+	for ( DWORD i=0; i<ROWS+100; i++ )
+		assert ( pSparse->IsDead(i)==( i==0 || i==31 || i==32 || i==ROWS-1 ) );
+
+	// older snapshots stay intact, repeated kills make no new snapshot
+	assert ( !pEmpty->IsDead ( 31 ) );
+	assert ( !pSparse->Kill ( dSparse+1, 2 ) );
+
+	// dense kills turn pages into bitmaps
+	CSphVector<DWORD> dDense;
+	for ( DWORD i=0; i<ROWS; i+=3 )
+		dDense.Add ( i );
+	CSphDeadRows * pDense = pSparse->Kill ( dDense.Begin(), dDense.GetLength() );
+	assert ( pDense && pDense->GetDead()==( ROWS+2 )/3 + 3 );
+	for ( DWORD i=0; i<ROWS; i++ )
+		assert ( pDense->IsDead(i)==( i%3==0 || i==31 || i==32 || i==ROWS-1 ) );
+	assert ( pDense->GetLengthBytes()<=4*CSphDeadRows::PAGE_WORDS*(int64_t)sizeof(DWORD) + 256 );
+
+	// both pages kinds merge further kills
+	DWORD dMore[] = { 1, 69999, 70000 };
+	CSphDeadRows * pMore = pDense->Kill ( dMore, sizeof(dMore)/sizeof(dMore[0]) );
+	assert ( pMore && pMore->GetDead()==pDense->GetDead()+2 );
+	assert ( pMore->IsDead ( 1 ) && pMore->IsDead ( 69999 ) && pMore->IsDead ( 70000 ) && !pDense->IsDead ( 1 ) );
+
+	pMore->Release();
+	pDense->Release();
+	pSparse->Release();
+	pEmpty->Release();
+
+	printf ( "ok\n" );
+}
+
+//////////////////////////////////////////////////////////////////////////
+
 void TestLog2()
 {
 	printf ( "testing integer log2 implementation... " );
@@ -3647,12 +4866,23 @@ int main ()
 	TestRwlock ();
 	TestCleanup ();
 	TestStridedSort ();
+	TestPackedSort ();
+	TestEarlyStop ();
 	TestRTWeightBoundary ();
 	TestWriter();
 	TestRTSendVsMerge ();
+	TestRTDocidWindows ();
 	TestSentenceTokenizer ();
 	TestSpanSearch ();
 	TestWildcards();
+	TestTrigramInfixes();
+	TestExpansionCache();
+	TestDocstore();
+	TestExcerptSlices();
+	TestColumnar();
+	TestDeadRows();
+	TestJsonKeyDir();
+	TestJsonIndexes();
 	TestLog2();
 	TestArabicStemmer();
 	TestSource ();